@@ -0,0 +1,144 @@
+/**
+ ******************************************************************************
+ * @file    attitude.h
+ * @brief   Gyro/accel attitude fusion (complementary and Madgwick)
+ ******************************************************************************
+ *
+ * Filters:
+ *   - ATTITUDE_FILTER_COMPLEMENTARY: keeps the gravity direction in the
+ *     body frame, rotates it by the gyro each update and pulls it towards
+ *     the accelerometer by gain (fraction per update). Yaw integrates the
+ *     Z-Y-X Euler yaw rate worked out from the gravity direction.
+ *   - ATTITUDE_FILTER_MADGWICK: quaternion driven by the gyro, corrected by
+ *     one normalised gradient-descent step towards the accelerometer at
+ *     gain beta (rad/s).
+ *
+ * Neither filter can correct yaw (no magnetometer); it drifts with the
+ * residual gyro Z bias, as the integrated heading in imu.c does.
+ *
+ * Arithmetic:
+ *   Updates are integer-only for soft-float Cortex-M3: Q30 state (unit
+ *   vector / quaternion), 32x32->64 multiplies, and an integer fast inverse
+ *   square root (CLZ normalisation, 12-entry seed table, two Newton steps)
+ *   for every normalisation. Inputs are raw MPU6050 samples; scale factors
+ *   and the update period fold into constants at init. Floats only appear
+ *   in Attitude_Init/SetPeriod/SetGyroBias and the getters.
+ *
+ ******************************************************************************
+ */
+
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Q30 fixed-point number: 2 integer bits (with sign), 30 fractional bits */
+typedef int32_t q30_t;
+
+#define Q30_SHIFT 30
+#define Q30_ONE ((q30_t)1 << Q30_SHIFT)
+
+/* Raw sensor scale (MPU6050 at ±250 deg/s) */
+#ifndef ATTITUDE_GYRO_LSB_PER_DPS
+#define ATTITUDE_GYRO_LSB_PER_DPS 131.0f
+#endif
+
+/* Default gains */
+#define ATTITUDE_COMPLEMENTARY_TAU 0.5f /* Accel correction time constant (s) */
+#define ATTITUDE_MADGWICK_BETA 0.1f     /* rad/s */
+
+/**
+ * @brief  Fusion algorithm
+ */
+typedef enum {
+  ATTITUDE_FILTER_COMPLEMENTARY = 0,
+  ATTITUDE_FILTER_MADGWICK
+} Attitude_Filter_t;
+
+/**
+ * @brief  Attitude filter state
+ */
+typedef struct {
+  Attitude_Filter_t filter;
+  float period; /* Update period (s) */
+  float gain;   /* tau (s) or beta (rad/s) */
+
+  /* Constants folded from the period and gain */
+  int32_t gyro_k;    /* rad per update per 1/256 LSB (Q54) */
+  q30_t correction;  /* Accel correction per update (Q30) */
+  int32_t bias[3];   /* Gyro bias in 1/256 LSB */
+
+  q30_t q[4];        /* Madgwick: w, x, y, z */
+  q30_t up[3];       /* Complementary: gravity direction in body frame */
+  uint32_t yaw;      /* Complementary: yaw, 2^32 = one turn */
+  uint8_t aligned;   /* State set from the accelerometer */
+} Attitude_t;
+
+/**
+ * @brief  Initialize a filter
+ * @param  att: Filter state
+ * @param  filter: Algorithm
+ * @param  period: Update period (s)
+ * @param  gain: Complementary time constant (s) or Madgwick beta (rad/s)
+ * @note   The first update aligns roll/pitch to the accelerometer
+ */
+void Attitude_Init(Attitude_t *att, Attitude_Filter_t filter, float period,
+                   float gain);
+
+/**
+ * @brief  Change the update period
+ * @param  att: Filter state
+ * @param  period: Update period (s)
+ */
+void Attitude_SetPeriod(Attitude_t *att, float period);
+
+/**
+ * @brief  Set the gyro bias subtracted from every sample
+ * @param  att: Filter state
+ * @param  bias_dps: Bias per axis (deg/s)
+ */
+void Attitude_SetGyroBias(Attitude_t *att, const float bias_dps[3]);
+
+/**
+ * @brief  Re-align to the next accelerometer sample with yaw zero
+ * @param  att: Filter state
+ */
+void Attitude_Reset(Attitude_t *att);
+
+/**
+ * @brief  Fuse one sample
+ * @param  att: Filter state
+ * @param  gyro: Raw gyro X, Y, Z
+ * @param  accel: Raw accel X, Y, Z (any scale; only the direction is used)
+ * @note   Integer-only; a zero accel vector skips the correction
+ */
+void Attitude_Update(Attitude_t *att, const int16_t gyro[3],
+                     const int16_t accel[3]);
+
+/**
+ * @brief  Get Euler angles (Z-Y-X: yaw, then pitch, then roll)
+ * @param  att: Filter state
+ * @param  roll: Roll in degrees (NULL to skip)
+ * @param  pitch: Pitch in degrees (NULL to skip)
+ * @param  yaw: Yaw in degrees, -180 to 180 (NULL to skip)
+ * @note   Float trig: call from telemetry, not every update
+ */
+void Attitude_GetEuler(const Attitude_t *att, float *roll, float *pitch,
+                       float *yaw);
+
+/**
+ * @brief  Get the attitude quaternion (body to world)
+ * @param  att: Filter state
+ * @param  q: Destination w, x, y, z
+ */
+void Attitude_GetQuaternion(const Attitude_t *att, float q[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ATTITUDE_H */
@@ -0,0 +1,124 @@
+/**
+ ******************************************************************************
+ * @file    autotune.h
+ * @brief   Relay-feedback (Astrom-Hagglund) PID autotuner
+ ******************************************************************************
+ *
+ * The loop is closed through a relay instead of the PID: the output is
+ * +amplitude while the error is above +hysteresis, -amplitude below
+ * -hysteresis. Most plants settle into a limit cycle whose peak-to-peak
+ * measurement 2a and period Tu give the ultimate gain
+ *   Ku = 4 * amplitude / (pi * sqrt(a^2 - hysteresis^2))
+ * and the gains follow from a tuning rule:
+ *
+ *   Rule            Kp         Ti          Td
+ *   Ziegler-Nichols PI   0.45 Ku    Tu / 1.2    -
+ *   Ziegler-Nichols PID  0.6 Ku     Tu / 2      Tu / 8
+ *   Tyreus-Luyben PI     Ku / 3.2   2.2 Tu      -
+ *   Tyreus-Luyben PID    Ku / 2.2   2.2 Tu      Tu / 6.3
+ *
+ * with Ki = Kp / Ti and Kd = Kp * Td. Tyreus-Luyben is the more damped
+ * choice; Ziegler-Nichols responds faster with more overshoot.
+ *
+ ******************************************************************************
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Limit cycles discarded while the oscillation builds up */
+#define AUTOTUNE_SKIP_CYCLES 2U
+
+/**
+ * @brief  Tuning rule
+ */
+typedef enum {
+  AUTOTUNE_RULE_ZN_PI = 0,
+  AUTOTUNE_RULE_ZN_PID,
+  AUTOTUNE_RULE_TL_PI,
+  AUTOTUNE_RULE_TL_PID
+} Autotune_Rule_t;
+
+/**
+ * @brief  Autotuner status
+ */
+typedef enum {
+  AUTOTUNE_RUNNING = 0,
+  AUTOTUNE_DONE,
+  AUTOTUNE_FAILED /* Timeout, or no oscillation above the hysteresis */
+} Autotune_Status_t;
+
+/**
+ * @brief  Relay autotuner state
+ */
+typedef struct {
+  /* Configuration */
+  float amplitude;  /* Relay output (+-) */
+  float hysteresis; /* Error band before switching */
+  float timeout;    /* Seconds */
+  uint8_t cycles;   /* Cycles averaged after the skipped ones */
+
+  /* Relay */
+  Autotune_Status_t status;
+  float time;
+  int8_t relay; /* +1 or -1 */
+  float high;   /* Measurement extremes in the current cycle */
+  float low;
+  float last_rise; /* Time of the last upward switch, < 0 for none */
+  uint8_t seen;    /* Completed cycles */
+  float sum_amplitude;
+  float sum_period;
+
+  /* Result */
+  float ku; /* Ultimate gain */
+  float tu; /* Ultimate period (s) */
+} Autotune_t;
+
+/**
+ * @brief  Start a relay experiment
+ * @param  at: Autotuner state
+ * @param  amplitude: Relay output amplitude (> 0)
+ * @param  hysteresis: Error band (>= 0, above the measurement noise)
+ * @param  cycles: Limit cycles to average (>= 1)
+ * @param  timeout: Give up after this many seconds
+ */
+void Autotune_Init(Autotune_t *at, float amplitude, float hysteresis,
+                   uint8_t cycles, float timeout);
+
+/**
+ * @brief  Advance one tick
+ * @param  at: Autotuner state
+ * @param  setpoint: Value to oscillate around
+ * @param  measurement: Measured value
+ * @param  dt: Time step in seconds
+ * @retval Relay output (+-amplitude while running, 0 once finished)
+ */
+float Autotune_Update(Autotune_t *at, float setpoint, float measurement,
+                      float dt);
+
+/**
+ * @brief  Get the experiment status
+ */
+Autotune_Status_t Autotune_GetStatus(const Autotune_t *at);
+
+/**
+ * @brief  Gains from the measured Ku and Tu
+ * @param  at: Autotuner state (status AUTOTUNE_DONE)
+ * @param  rule: Tuning rule
+ * @param  Kp, Ki, Kd: Destination gains
+ * @retval 0 on success, -1 if the experiment has not succeeded
+ */
+int8_t Autotune_ComputeGains(const Autotune_t *at, Autotune_Rule_t rule,
+                             float *Kp, float *Ki, float *Kd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUTOTUNE_H */
@@ -0,0 +1,122 @@
+/**
+ ******************************************************************************
+ * @file    control_loop.h
+ * @brief   Timer-triggered control loop with DWT timing statistics
+ ******************************************************************************
+ *
+ * Hardware Setup:
+ *   - Timer: TIM4 update interrupt (no pins used)
+ *   - Rate: CONTROL_LOOP_MIN_HZ - CONTROL_LOOP_MAX_HZ, 1MHz timer tick
+ *   - Priority: CONTROL_LOOP_IRQ_PRIORITY (below SysTick and encoder EXTI,
+ *     so no encoder edge is lost while the update runs)
+ *
+ * Timing (DWT cycle counter, 72 cycles = 1us):
+ *   - Jitter:    start-to-start interval minus the nominal period
+ *   - Execution: cycles spent in the update callback
+ *   - Overrun:   update still running when the next period started
+ *
+ ******************************************************************************
+ */
+
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Supported loop rates */
+#define CONTROL_LOOP_MIN_HZ 100U
+#define CONTROL_LOOP_MAX_HZ 2000U
+
+/* NVIC priority (0 = highest, 15 = lowest) */
+#define CONTROL_LOOP_IRQ_PRIORITY 2U
+
+/* Histograms: last bin collects everything beyond the range */
+#define CONTROL_LOOP_HIST_BINS 16U
+#define CONTROL_LOOP_JITTER_BIN_SHIFT 6U /* 64 cycles (~0.9us) per bin */
+
+/**
+ * @brief  Control update callback
+ * @param  dt: Loop period in seconds
+ */
+typedef void (*ControlLoop_Callback_t)(float dt);
+
+/**
+ * @brief  Timing statistics (all times in CPU cycles)
+ */
+typedef struct {
+  uint32_t iterations; /* Completed updates */
+  uint32_t overruns;   /* Updates that exceeded one period */
+
+  int32_t jitter_min; /* Start interval minus period */
+  int32_t jitter_max;
+  uint32_t exec_min; /* Callback execution time */
+  uint32_t exec_max;
+
+  /* |jitter| in bins of (1 << CONTROL_LOOP_JITTER_BIN_SHIFT) cycles */
+  uint32_t jitter_hist[CONTROL_LOOP_HIST_BINS];
+
+  /* Execution time in bins of period / CONTROL_LOOP_HIST_BINS */
+  uint32_t exec_hist[CONTROL_LOOP_HIST_BINS];
+} ControlLoop_Stats_t;
+
+/**
+ * @brief  Configure TIM4 and the DWT cycle counter
+ * @param  rate_hz: Loop rate (CONTROL_LOOP_MIN_HZ - CONTROL_LOOP_MAX_HZ)
+ * @param  callback: Update function called from the interrupt
+ * @retval 0 on success, -1 if rate or callback is invalid
+ */
+int8_t ControlLoop_Init(uint32_t rate_hz, ControlLoop_Callback_t callback);
+
+/**
+ * @brief  Start periodic updates
+ */
+void ControlLoop_Start(void);
+
+/**
+ * @brief  Stop periodic updates
+ */
+void ControlLoop_Stop(void);
+
+/**
+ * @brief  Change the loop rate without reinitialising
+ * @param  rate_hz: Loop rate (CONTROL_LOOP_MIN_HZ - CONTROL_LOOP_MAX_HZ)
+ * @retval 0 on success, -1 if rate is invalid
+ * @note   Safe from the main loop (interrupts are masked while the timer
+ *         and the statistics change); clears the statistics
+ */
+int8_t ControlLoop_SetRate(uint32_t rate_hz);
+
+/**
+ * @brief  Get configured loop rate
+ * @retval Rate in Hz
+ */
+uint32_t ControlLoop_GetRate(void);
+
+/**
+ * @brief  Get number of completed updates
+ */
+uint32_t ControlLoop_GetIterations(void);
+
+/**
+ * @brief  Copy a consistent snapshot of the timing statistics
+ * @param  stats: Destination
+ */
+void ControlLoop_GetStats(ControlLoop_Stats_t *stats);
+
+/**
+ * @brief  Clear timing statistics
+ */
+void ControlLoop_ResetStats(void);
+
+/* Interrupt handler (called from stm32f1xx_it.c) */
+void ControlLoop_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONTROL_LOOP_H */
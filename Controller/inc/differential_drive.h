@@ -13,6 +13,26 @@
  *   Left Motor  = Base Speed - Heading Correction
  *   Right Motor = Base Speed + Heading Correction
  *
+ * Speed changes follow a jerk/acceleration-limited profile
+ * (motion_profile.h): the profiled velocity is the speed PID setpoint, and
+ * the speed PIDs add feedforward from it (pid.h):
+ *   Base Speed = Speed PID + FF_KV * velocity + FF_KS * sign(velocity)
+ *                + FF_KA * acceleration
+ * An optional gain schedule interpolates the speed PID gains over the
+ * profiled speed every tick.
+ *
+ * Each running tick also integrates the pose (odometry.h) from the encoder
+ * deltas and the IMU heading. With TELEMETRY_ENABLE it also publishes a
+ * telemetry frame (telemetry.h) with the PID terms and motor outputs.
+ *
+ * Autotuning (autotune.h) replaces the PIDs with relays around the
+ * feedforward operating point at DRIVE_AUTOTUNE_SPEED, one loop at a time
+ * (so the feedforward has to be set first):
+ *   1. Each wheel: a relay on its own speed error
+ *   2. Heading: a relay on the heading drives the differential
+ * The measured Ku/Tu give the gains through the selected rule; they are
+ * applied as each phase finishes, and the drive stops at the end.
+ *
  ******************************************************************************
  */
 
@@ -23,26 +43,77 @@
 extern "C" {
 #endif
 
+#include "autotune.h"
+#include "imu.h"
+#include "pid.h"
 #include <stdint.h>
 
-/* Default PID tuning values (adjust for your robot) */
-#define SPEED_PID_KP 2.0f
-#define SPEED_PID_KI 0.5f
-#define SPEED_PID_KD 0.1f
+/* Default PID tuning values (adjust for your robot). The speed loop sees a
+ * speed quantised to one count per tick (1000 counts/s at 1 kHz), so it has
+ * no derivative term, and Kp stays well below full output for a 500 counts/s
+ * error; these settle in the simulator (controller_sim). */
+#define SPEED_PID_KP 0.3f
+#define SPEED_PID_KI 3.0f
+#define SPEED_PID_KD 0.0f
 
 #define HEADING_PID_KP 5.0f
 #define HEADING_PID_KI 0.1f
 #define HEADING_PID_KD 0.5f
 
+/* Default speed profile limits */
+#define DRIVE_MAX_ACCEL 2000.0f /* counts/s^2 */
+#define DRIVE_MAX_JERK 20000.0f /* counts/s^3 (0 = trapezoidal) */
+
+/* Default feedforward gains: motor command per counts/s, static friction
+ * offset, per counts/s^2. Off until identified on the robot
+ * (DifferentialDrive_SetFeedforward); the speed PIDs alone then behave as
+ * without feedforward. */
+#define DRIVE_FF_KV 0.0f
+#define DRIVE_FF_KS 0.0f
+#define DRIVE_FF_KA 0.0f
+
+/* Autotune experiment: wheel speed (counts/s), relay amplitudes (motor
+ * command), hysteresis (counts/s, degrees), cycles averaged, timeout per
+ * phase (s) */
+#ifndef DRIVE_AUTOTUNE_SPEED
+#define DRIVE_AUTOTUNE_SPEED 500.0f
+#endif
+#define DRIVE_AUTOTUNE_SPEED_RELAY 100.0f
+#define DRIVE_AUTOTUNE_SPEED_HYST 50.0f
+#define DRIVE_AUTOTUNE_HEADING_RELAY 100.0f
+#define DRIVE_AUTOTUNE_HEADING_HYST 0.2f
+#define DRIVE_AUTOTUNE_CYCLES 4U
+#define DRIVE_AUTOTUNE_TIMEOUT 5.0f
+
 /**
  * @brief  Drive state enumeration
  */
 typedef enum {
   DRIVE_STATE_STOPPED,
   DRIVE_STATE_RUNNING,
-  DRIVE_STATE_CALIBRATING
+  DRIVE_STATE_CALIBRATING,
+  DRIVE_STATE_AUTOTUNING
 } DriveState_t;
 
+/**
+ * @brief  Relay measurement and resulting gains for one loop
+ */
+typedef struct {
+  float ku; /* Ultimate gain */
+  float tu; /* Ultimate period (s) */
+  float Kp, Ki, Kd;
+} DriveAutotune_Loop_t;
+
+/**
+ * @brief  Autotune result
+ */
+typedef struct {
+  Autotune_Status_t status; /* AUTOTUNE_RUNNING until the run ends */
+  DriveAutotune_Loop_t left;
+  DriveAutotune_Loop_t right;
+  DriveAutotune_Loop_t heading;
+} DriveAutotune_Result_t;
+
 /**
  * @brief  Initialize differential drive controller
  */
@@ -51,6 +122,7 @@ void DifferentialDrive_Init(void);
 /**
  * @brief  Set target forward speed
  * @param  speed: Target speed in encoder counts per second
+ * @note   Reached along the speed profile; 0 ramps down, then stops
  */
 void DifferentialDrive_SetSpeed(float speed);
 
@@ -73,12 +145,39 @@ DriveState_t DifferentialDrive_GetState(void);
 
 /**
  * @brief  Calibrate sensors (IMU gyro bias)
+ * @retval IMU_Calibrate() status; retry on IMU_CALIB_MOTION
  * @note   Robot must be stationary during calibration
  */
-void DifferentialDrive_Calibrate(void);
+IMU_CalibStatus_t DifferentialDrive_Calibrate(void);
+
+/**
+ * @brief  Use a stored calibration instead of calibrating (settings.h)
+ * @param  gyro_z_bias: deg/s
+ * @note   Resets encoders, heading and pose like DifferentialDrive_Calibrate
+ */
+void DifferentialDrive_RestoreCalibration(float gyro_z_bias);
+
+/**
+ * @brief  Start relay autotuning of the speed and heading PIDs
+ * @param  rule: Rule turning Ku/Tu into gains
+ * @retval 0 on success, -1 unless the drive is stopped and the speed
+ *         feedforward (Kv) is set
+ * @note   The robot drives forward at DRIVE_AUTOTUNE_SPEED (about one
+ *         metre); the state returns to DRIVE_STATE_STOPPED at the end. On
+ *         failure the previous gains are kept. Success turns off the speed
+ *         gain schedule.
+ */
+int8_t DifferentialDrive_StartAutotune(Autotune_Rule_t rule);
+
+/**
+ * @brief  Get the result of the last autotune run
+ * @param  result: Destination
+ */
+void DifferentialDrive_GetAutotuneResult(DriveAutotune_Result_t *result);
 
 /**
  * @brief  Set speed PID gains
+ * @note   Turns off the speed gain schedule
  */
 void DifferentialDrive_SetSpeedPID(float Kp, float Ki, float Kd);
 
@@ -87,6 +186,67 @@ void DifferentialDrive_SetSpeedPID(float Kp, float Ki, float Kd);
  */
 void DifferentialDrive_SetHeadingPID(float Kp, float Ki, float Kd);
 
+/**
+ * @brief  Get speed PID gains (both wheels share them)
+ * @param  gains: Destination {Kp, Ki, Kd}
+ */
+void DifferentialDrive_GetSpeedPID(float gains[3]);
+
+/**
+ * @brief  Get heading PID gains
+ * @param  gains: Destination {Kp, Ki, Kd}
+ */
+void DifferentialDrive_GetHeadingPID(float gains[3]);
+
+/**
+ * @brief  Set PID integral limits (anti-windup)
+ * @param  speed: Limit for both speed PIDs
+ * @param  heading: Limit for the heading PID
+ */
+void DifferentialDrive_SetIntegralLimits(float speed, float heading);
+
+/**
+ * @brief  Get PID integral limits
+ * @param  limits: Destination {speed, heading}
+ */
+void DifferentialDrive_GetIntegralLimits(float limits[2]);
+
+/**
+ * @brief  Set speed profile limits
+ * @param  max_accel: counts/s^2 (> 0)
+ * @param  max_jerk: counts/s^3, 0 for a trapezoidal profile
+ */
+void DifferentialDrive_SetProfile(float max_accel, float max_jerk);
+
+/**
+ * @brief  Set speed feedforward gains
+ * @param  Kv: Per counts/s of profiled speed
+ * @param  Ks: Static offset in the direction of travel
+ * @param  Ka: Per counts/s^2 of profiled acceleration
+ */
+void DifferentialDrive_SetFeedforward(float Kv, float Ks, float Ka);
+
+/**
+ * @brief  Schedule the speed PID gains over |profiled speed|
+ * @param  points: Gains in increasing speed order (counts/s)
+ * @param  count: Number of points, 0 to turn the schedule off
+ * @retval 0 on success, -1 if the table is invalid (schedule unchanged)
+ */
+int8_t DifferentialDrive_SetSpeedSchedule(const PID_GainPoint_t *points,
+                                          uint8_t count);
+
+/**
+ * @brief  Get the target speed (end point of the profile)
+ * @retval Speed in counts/second
+ */
+float DifferentialDrive_GetTargetSpeed(void);
+
+/**
+ * @brief  Get the profiled speed (current speed setpoint)
+ * @retval Speed in counts/second
+ */
+float DifferentialDrive_GetProfiledSpeed(void);
+
 /**
  * @brief  Get current average wheel speed
  * @retval Speed in counts/second
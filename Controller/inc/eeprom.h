@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * @file    eeprom.h
+ * @brief   EEPROM emulation in two flash pages (after the Cube application
+ *          Projects/STM32F103RB-Nucleo/Applications/EEPROM)
+ ******************************************************************************
+ *
+ * Layout:
+ *   - The last two 1KB pages of the 64KB flash, kept out of the program by
+ *     the linker script (FLASH LENGTH = 62K)
+ *   - Each page starts with a status halfword (ERASED, RECEIVE_DATA or
+ *     VALID_PAGE), followed by 4-byte records {data u16, virtual address
+ *     u16} appended in write order: 255 records per page
+ *   - A read returns the last record with the address in the valid page
+ *
+ * When the valid page is full, the last value of every variable moves to
+ * the other page (RECEIVE_DATA until done), then the old page is erased.
+ * EE_Init() finishes or undoes whatever a reset interrupted, the same as
+ * the Cube algorithm: a variable reads its old or its new value, and a
+ * record half written (no address yet) is never read.
+ *
+ * Flash timing (stalls the CPU, interrupts included, while busy):
+ *   - Halfword program: ~52us
+ *   - Page erase: ~20ms, only on a page transfer or a format
+ * Programming runs on the HSI, which SystemClock_Config() leaves on.
+ *
+ ******************************************************************************
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Flash page size (STM32F103x8/xB) */
+#define EE_PAGE_SIZE 0x400U
+
+/* Emulation pages: the last two pages of the 64KB flash */
+#define EE_PAGE0_ADDRESS ((uint32_t)(FLASH_BASE + 0xF800U))
+#define EE_PAGE1_ADDRESS ((uint32_t)(FLASH_BASE + 0xFC00U))
+
+/* Variables are virtual addresses 1..EE_VAR_COUNT (a page transfer copies
+ * one record per variable, of the 255 a page holds) */
+#define EE_VAR_COUNT 64U
+
+/* Page status */
+#define EE_ERASED ((uint16_t)0xFFFF)       /* Page is empty */
+#define EE_RECEIVE_DATA ((uint16_t)0xEEEE) /* Page is receiving a transfer */
+#define EE_VALID_PAGE ((uint16_t)0x0000)   /* Page holds the valid data */
+
+/* Return codes */
+#define EE_OK ((uint16_t)0x0000)
+#define EE_NOT_FOUND ((uint16_t)0x0001)   /* EE_ReadVariable: never written */
+#define EE_FLASH_ERROR ((uint16_t)0x0002) /* Program/erase failed */
+#define EE_BAD_ADDRESS ((uint16_t)0x0003) /* Outside 1..EE_VAR_COUNT */
+#define EE_PAGE_FULL ((uint16_t)0x0080)
+#define EE_NO_VALID_PAGE ((uint16_t)0x00AB)
+
+/**
+ * @brief  Restore the pages to a valid state (format them if needed)
+ * @retval EE_OK, or EE_FLASH_ERROR
+ * @note   Call once at startup, before any read or write
+ */
+uint16_t EE_Init(void);
+
+/**
+ * @brief  Read the last value written to a variable
+ * @param  virt_address: Variable (1..EE_VAR_COUNT)
+ * @param  data: Destination
+ * @retval EE_OK, EE_NOT_FOUND, EE_BAD_ADDRESS or EE_NO_VALID_PAGE
+ */
+uint16_t EE_ReadVariable(uint16_t virt_address, uint16_t *data);
+
+/**
+ * @brief  Write a variable (appends a record, transfers the page if full)
+ * @param  virt_address: Variable (1..EE_VAR_COUNT)
+ * @param  data: Value
+ * @retval EE_OK, EE_FLASH_ERROR, EE_BAD_ADDRESS or EE_NO_VALID_PAGE
+ */
+uint16_t EE_WriteVariable(uint16_t virt_address, uint16_t data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_H */
@@ -4,13 +4,31 @@
  * @brief   Dual Quadrature Encoder Interface (Left/Right wheels)
  ******************************************************************************
  *
- * Hardware Setup:
+ * Two backends, selected with ENCODER_MODE:
+ *
+ * EXTI mode (default) - one interrupt per edge, XOR-based direction:
  *   - Left Encoder A  -> PA1 (EXTI1)
  *   - Left Encoder B  -> PA2 (EXTI2)
  *   - Right Encoder A -> PB8 (EXTI8)
  *   - Right Encoder B -> PB9 (EXTI9)
+ *   Every edge is timestamped.
+ *
+ * Timer mode (opt-in: ENCODER_MODE=ENCODER_MODE_TIMER, or
+ * CONTROLLER_ENCODER_TIMER in CMake) - hardware x4 decoding, no per-edge
+ * interrupts. The EXTI pins are not timer inputs, so the encoders move:
+ *   - Left Encoder A  -> PA0 (TIM2_CH1)   was PA1
+ *   - Left Encoder B  -> PA1 (TIM2_CH2)   was PA2
+ *   - Right Encoder A -> PA8 (TIM1_CH1)   was PB8
+ *   - Right Encoder B -> PA9 (TIM1_CH2)   was PB9; PA9 is also USART1 TX,
+ *     which is then unavailable
+ *   The 16-bit counters are extended to 32 bits by counting overflows in
+ *   the update interrupt (one interrupt per 65536 counts). At low speed the
+ *   CH1/CH2 capture interrupts timestamp rising A and B edges (2 per 4
+ *   counts) for the speed estimator; they are disabled once the count delta
+ *   takes over.
  *
- * Both encoders use EXTI for edge detection with XOR-based direction.
+ * Speed uses the hybrid period/count estimator (speed_estimator.h) with
+ * edge timestamps from DWT->CYCCNT.
  *
  ******************************************************************************
  */
@@ -29,10 +47,49 @@ extern "C" {
 #define WHEEL_DIAMETER_MM 65 /* Wheel diameter in mm */
 
 /**
- * @brief  Initialize both encoders using external interrupts
+ * @brief  Encoder backend
+ */
+typedef enum {
+  ENCODER_MODE_EXTI = 0, /* GPIO edge interrupts */
+  ENCODER_MODE_TIMER     /* TIM2/TIM1 encoder interface */
+} Encoder_Mode_t;
+
+/* Backend used by Encoder_Init(); timer mode needs the wiring above */
+#ifndef ENCODER_MODE
+#define ENCODER_MODE ENCODER_MODE_EXTI
+#endif
+
+/* NVIC priority for encoder interrupts (above IMU and control loop) */
+#define ENCODER_IRQ_PRIORITY 0U
+
+/* Speed estimator: counts per tick where the count delta takes over */
+#define ENCODER_SPEED_BLEND_COUNTS 16
+
+/* Speed estimator: report 0 after this long without an edge */
+#define ENCODER_STOP_TIMEOUT_MS 200
+
+/**
+ * @brief  Initialize both encoders using the ENCODER_MODE backend
  */
 void Encoder_Init(void);
 
+/**
+ * @brief  Initialize both encoders using the given backend
+ * @param  mode: ENCODER_MODE_EXTI or ENCODER_MODE_TIMER
+ */
+void Encoder_InitMode(Encoder_Mode_t mode);
+
+/**
+ * @brief  Get the active backend
+ */
+Encoder_Mode_t Encoder_GetMode(void);
+
+/**
+ * @brief  Get the number of encoder interrupts serviced since init
+ * @note   Edge interrupts in EXTI mode, overflow interrupts in timer mode
+ */
+uint32_t Encoder_GetIrqCount(void);
+
 /**
  * @brief  Get left encoder count
  * @retval Signed 32-bit count value
@@ -59,6 +116,18 @@ float Encoder_GetSpeedLeft(float dt);
  */
 float Encoder_GetSpeedRight(float dt);
 
+/**
+ * @brief  Confidence of the last left speed estimate
+ * @retval 0.0 (coarse/stale) to 1.0 (period measurement or at rest)
+ */
+float Encoder_GetConfidenceLeft(void);
+
+/**
+ * @brief  Confidence of the last right speed estimate
+ * @retval 0.0 (coarse/stale) to 1.0 (period measurement or at rest)
+ */
+float Encoder_GetConfidenceRight(void);
+
 /**
  * @brief  Reset both encoder counts to zero
  */
@@ -85,6 +154,9 @@ void Encoder_GetDelta(int32_t *left_delta, int32_t *right_delta);
 void Encoder_EXTI1_Handler(void);   /* Left A */
 void Encoder_EXTI2_Handler(void);   /* Left B */
 void Encoder_EXTI9_5_Handler(void); /* Right A/B (EXTI8, EXTI9) */
+void Encoder_TIM2_Handler(void);    /* Left counter overflow / capture */
+void Encoder_TIM1_UP_Handler(void); /* Right counter overflow */
+void Encoder_TIM1_CC_Handler(void); /* Right A/B capture */
 
 #ifdef __cplusplus
 }
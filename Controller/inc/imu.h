@@ -8,6 +8,34 @@
  *   - I2C1_SDA -> PB7
  *   - I2C1_SCL -> PB6
  *   - MPU6050 Address: 0x68 (AD0 = GND) or 0x69 (AD0 = VCC)
+ *   - I2C1 at 400kHz (fast mode)
+ *   - DMA1 Channel 7 (I2C1_RX) for the burst reads
+ *
+ * Acquisition:
+ *   IMU_StartRead() queues a burst read and returns immediately. The I2C1
+ *   event interrupt sequences the register write and repeated START, DMA
+ *   receives the data and the DMA interrupt publishes it into a double
+ *   buffer. IMU_Update() only reads the latest published data, so the
+ *   control loop never waits on the bus.
+ *
+ *   - IMU_MODE_REGISTER: 100Hz output, one 14-byte burst from ACCEL_XOUT_H
+ *     per tick; heading integrates the latest rate over dt.
+ *   - IMU_MODE_FIFO: gyro Z at IMU_FIFO_RATE_HZ into the MPU6050 FIFO. Each
+ *     tick chains three bursts from the DMA interrupt: INT_STATUS with the
+ *     accel/temp/gyro registers (FIFO overflow flag), FIFO_COUNT, then up
+ *     to IMU_FIFO_MAX_BATCH samples from FIFO_R_W. Heading integrates every
+ *     sample (trapezoidal); samples left behind are drained next tick.
+ *     IMU_ResetHeading() also empties the FIFO on the next tick (stale
+ *     samples from while the loop was idle), so call it at rest. The chain takes ~1.1ms of bus time at 100Hz, so
+ *     use register mode above a 1kHz loop rate.
+ *
+ *   A read still in flight when the next one starts counts as a timeout and
+ *   resets I2C1; bus errors abort the transfer the same way.
+ *
+ * Attitude:
+ *   Each new accel/gyro sample also feeds an attitude filter (attitude.h,
+ *   IMU_ATTITUDE_FILTER) for roll and pitch. heading stays the gyro Z
+ *   integral above, which uses every FIFO sample.
  *
  ******************************************************************************
  */
@@ -19,6 +47,7 @@
 extern "C" {
 #endif
 
+#include "attitude.h"
 #include <stdint.h>
 
 /* MPU6050 I2C Address (AD0 = GND) */
@@ -30,11 +59,89 @@ extern "C" {
 #define MPU6050_REG_CONFIG 0x1A
 #define MPU6050_REG_GYRO_CONFIG 0x1B
 #define MPU6050_REG_ACCEL_CONFIG 0x1C
+#define MPU6050_REG_FIFO_EN 0x23
+#define MPU6050_REG_INT_ENABLE 0x38
+#define MPU6050_REG_INT_STATUS 0x3A
+#define MPU6050_REG_ACCEL_XOUT_H 0x3B
+#define MPU6050_REG_TEMP_OUT_H 0x41
 #define MPU6050_REG_GYRO_XOUT_H 0x43
 #define MPU6050_REG_GYRO_YOUT_H 0x45
 #define MPU6050_REG_GYRO_ZOUT_H 0x47
+#define MPU6050_REG_USER_CTRL 0x6A
+#define MPU6050_REG_FIFO_COUNTH 0x72
+#define MPU6050_REG_FIFO_R_W 0x74
 #define MPU6050_REG_WHO_AM_I 0x75
 
+/* Register bits */
+#define MPU6050_FIFO_EN_ZG 0x10        /* FIFO_EN: gyro Z into the FIFO */
+#define MPU6050_INT_FIFO_OFLOW 0x10    /* INT_ENABLE / INT_STATUS */
+#define MPU6050_INT_DATA_RDY 0x01      /* INT_ENABLE / INT_STATUS */
+#define MPU6050_USER_CTRL_FIFO_EN 0x40
+#define MPU6050_USER_CTRL_FIFO_RESET 0x04
+
+/* FIFO capacity in bytes */
+#define MPU6050_FIFO_SIZE 1024U
+
+/* Burst read: ACCEL_XOUT_H .. GYRO_ZOUT_L */
+#define MPU6050_BURST_LEN 14
+
+/* Burst read: INT_STATUS, then ACCEL_XOUT_H .. GYRO_ZOUT_L */
+#define MPU6050_STATUS_BURST_LEN 15
+
+/**
+ * @brief  Acquisition mode
+ */
+typedef enum {
+  IMU_MODE_REGISTER = 0, /* Latest output registers once per tick */
+  IMU_MODE_FIFO          /* Every gyro Z sample through the FIFO */
+} IMU_Mode_t;
+
+/* Mode used by IMU_Init() */
+#ifndef IMU_MODE
+#define IMU_MODE IMU_MODE_FIFO
+#endif
+
+/* FIFO mode sample rate (1kHz gyro clock / (1 + SMPLRT_DIV)) */
+#define IMU_FIFO_RATE_HZ 1000U
+
+/* FIFO samples read per tick at most (2 bytes each) */
+#define IMU_FIFO_MAX_BATCH 64U
+
+/* Attitude filter fed by IMU_Update() and its gain (see attitude.h) */
+#ifndef IMU_ATTITUDE_FILTER
+#define IMU_ATTITUDE_FILTER ATTITUDE_FILTER_COMPLEMENTARY
+#endif
+#define IMU_ATTITUDE_GAIN                                                      \
+  (IMU_ATTITUDE_FILTER == ATTITUDE_FILTER_MADGWICK                            \
+       ? ATTITUDE_MADGWICK_BETA                                                \
+       : ATTITUDE_COMPLEMENTARY_TAU)
+
+/* Calibration readings per second, paced by data-ready. The 44Hz DLPF
+ * correlates closer readings, so FIFO mode takes every tenth sample */
+#define IMU_CALIB_RATE_HZ 100U
+
+/* Calibration ends once the standard error of the bias (deg/s) is below
+ * IMU_CALIB_TOLERANCE, after at least IMU_CALIB_MIN_SAMPLES readings.
+ * Noise is ~0.05 deg/s RMS per reading: ~25 readings, 250ms */
+#define IMU_CALIB_TOLERANCE 0.01f
+#define IMU_CALIB_MIN_SAMPLES 20U
+#define IMU_CALIB_MAX_SAMPLES 300U
+
+/* A reading this far (deg/s) from the running mean is motion: the
+ * estimate restarts, and the calibration gives up after
+ * IMU_CALIB_MAX_RESTARTS of them */
+#define IMU_CALIB_MOTION_DPS 0.5f
+#define IMU_CALIB_MAX_RESTARTS 10U
+
+/* Longest wait (ms) for data-ready before the sensor counts as lost */
+#define IMU_DATA_READY_TIMEOUT_MS 50U
+
+/* IMU_CheckGyroBias(): readings, at IMU_CALIB_RATE_HZ */
+#define IMU_BIAS_CHECK_SAMPLES 25U
+
+/* NVIC priority for I2C1 and DMA1 Channel 7 (above the control loop) */
+#define IMU_IRQ_PRIORITY 1U
+
 /**
  * @brief  IMU data structure
  */
@@ -46,26 +153,146 @@ typedef struct {
   float heading; /* Integrated heading in degrees */
 
   float gyro_z_bias; /* Gyro Z bias (calibrated) */
+
+  float accel_x; /* Accel X in g */
+  float accel_y; /* Accel Y in g */
+  float accel_z; /* Accel Z in g */
 } IMU_Data_t;
 
 /**
- * @brief  Initialize IMU (MPU6050) over I2C1
+ * @brief  Raw sample from one burst read
+ */
+typedef struct {
+  int16_t accel[3]; /* X, Y, Z */
+  int16_t temp;
+  int16_t gyro[3]; /* X, Y, Z */
+  uint32_t sequence; /* Increments with every published sample */
+} IMU_Sample_t;
+
+/**
+ * @brief  Acquisition statistics
+ */
+typedef struct {
+  uint32_t started;    /* Burst reads started */
+  uint32_t completed;  /* Samples published */
+  uint32_t errors;     /* NACK, bus error, arbitration lost, DMA error */
+  uint32_t timeouts;   /* Reads still in flight at the next start */
+  uint32_t recoveries; /* I2C1 peripheral resets */
+
+  /* FIFO mode */
+  uint32_t fifo_batches;   /* FIFO reads published */
+  uint32_t fifo_samples;   /* Samples published (all integrated) */
+  uint32_t fifo_max_batch; /* Most samples in one read */
+  uint32_t fifo_backlog;   /* Reads that left samples in the FIFO */
+  uint32_t fifo_overflows; /* INT_STATUS reported samples lost */
+  uint32_t fifo_resets;    /* FIFO emptied (heading reset, recovery) */
+} IMU_Stats_t;
+
+/**
+ * @brief  Outcome of IMU_Calibrate()
+ */
+typedef enum {
+  IMU_CALIB_OK = 0,  /* Bias converged and applied */
+  IMU_CALIB_MOTION,  /* Kept moving: IMU_CALIB_MAX_RESTARTS exceeded */
+  IMU_CALIB_TIMEOUT, /* No convergence within IMU_CALIB_MAX_SAMPLES */
+  IMU_CALIB_BUS_ERROR
+} IMU_CalibStatus_t;
+
+/**
+ * @brief  Last calibration
+ */
+typedef struct {
+  IMU_CalibStatus_t status;
+  uint32_t readings; /* Taken in total */
+  uint32_t samples;  /* In the estimate (since the last restart) */
+  uint32_t restarts; /* Motion detected */
+  float bias;        /* Mean rate (deg/s), applied if status is OK */
+  float noise;       /* Standard deviation of a reading (deg/s) */
+  float std_error;   /* Of the bias (deg/s) */
+} IMU_Calibration_t;
+
+/**
+ * @brief  Initialize IMU (MPU6050) over I2C1 in IMU_MODE
  * @retval 0 on success, -1 on failure
  */
 int8_t IMU_Init(void);
 
+/**
+ * @brief  Initialize IMU (MPU6050) over I2C1 in a given mode
+ * @param  mode: IMU_MODE_REGISTER or IMU_MODE_FIFO
+ * @retval 0 on success, -1 on failure
+ */
+int8_t IMU_InitMode(IMU_Mode_t mode);
+
+/**
+ * @brief  Get the active acquisition mode
+ */
+IMU_Mode_t IMU_GetMode(void);
+
 /**
  * @brief  Calibrate gyroscope (robot must be stationary)
- * @note   Samples gyro for ~1 second to calculate bias
+ * @retval IMU_CALIB_OK if the bias converged; otherwise the bias is left
+ *         unchanged
+ * @note   Blocking: readings at IMU_CALIB_RATE_HZ (Welford running mean
+ *         and variance) until the bias converges, typically 250ms, at most
+ *         IMU_CALIB_MAX_SAMPLES readings. A constant rotation cannot be
+ *         told from a bias.
+ */
+IMU_CalibStatus_t IMU_Calibrate(void);
+
+/**
+ * @brief  Get the result of the last IMU_Calibrate()
+ */
+void IMU_GetCalibration(IMU_Calibration_t *out);
+
+/**
+ * @brief  Set the gyro Z bias (a stored calibration)
+ * @param  bias: deg/s, subtracted from every reading
+ */
+void IMU_SetGyroBias(float bias);
+
+/**
+ * @brief  Read the MPU6050 die temperature (blocking, like IMU_Calibrate)
+ * @param  temp_c: Destination in degrees C
+ * @retval 0 on success, -1 on a bus error
+ */
+int8_t IMU_ReadTemperature(float *temp_c);
+
+/**
+ * @brief  Check the robot stands still and the gyro Z bias still nulls the
+ *         rate
+ * @param  tolerance: Largest |mean rate - bias| accepted (deg/s)
+ * @retval 0 if both hold, -1 otherwise or on a bus error
+ * @note   Blocking: IMU_BIAS_CHECK_SAMPLES readings, paced like IMU_Calibrate
  */
-void IMU_Calibrate(void);
+int8_t IMU_CheckGyroBias(float tolerance);
 
 /**
- * @brief  Update IMU readings and integrate heading
- * @param  dt: Time delta in seconds
+ * @brief  Start a non-blocking burst read (call at the top of each tick)
+ */
+void IMU_StartRead(void);
+
+/**
+ * @brief  Update IMU readings from the latest sample and integrate heading
+ * @param  dt: Time delta in seconds (register mode; FIFO samples carry
+ *             their own period)
+ * @note   Never blocks. Register mode holds the previous rate if no new
+ *         sample arrived; FIFO mode integrates nothing until samples do.
  */
 void IMU_Update(float dt);
 
+/**
+ * @brief  Copy the latest published raw sample
+ * @param  sample: Destination
+ */
+void IMU_GetSample(IMU_Sample_t *sample);
+
+/**
+ * @brief  Copy acquisition statistics
+ * @param  stats: Destination
+ */
+void IMU_GetStats(IMU_Stats_t *stats);
+
 /**
  * @brief  Get current yaw rate (Z-axis rotation)
  * @retval Yaw rate in deg/s
@@ -79,16 +306,32 @@ float IMU_GetYawRate(void);
 float IMU_GetHeading(void);
 
 /**
- * @brief  Reset heading to zero
+ * @brief  Reset heading to zero (FIFO mode: also discards queued samples)
+ * @note   Also re-aligns the attitude filter on the next sample
  */
 void IMU_ResetHeading(void);
 
+/**
+ * @brief  Get the fused attitude
+ * @param  roll: Roll in degrees (NULL to skip)
+ * @param  pitch: Pitch in degrees (NULL to skip)
+ * @param  yaw: Filter yaw in degrees (NULL to skip); tilt compensated but
+ *              only updated once per sample, unlike IMU_GetHeading()
+ * @note   Float trig: not for every control tick
+ */
+void IMU_GetAttitude(float *roll, float *pitch, float *yaw);
+
 /**
  * @brief  Get pointer to IMU data structure
  * @retval Pointer to IMU_Data_t
  */
 IMU_Data_t *IMU_GetData(void);
 
+/* Interrupt handlers (called from stm32f1xx_it.c) */
+void IMU_I2C1_EV_Handler(void);
+void IMU_I2C1_ER_Handler(void);
+void IMU_DMA1_Channel7_Handler(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,85 @@
+/**
+ ******************************************************************************
+ * @file    motion_profile.h
+ * @brief   Jerk/acceleration-limited velocity profile generator
+ ******************************************************************************
+ *
+ * Moves a velocity towards its target one tick at a time:
+ *   - S-curve (max_jerk > 0): acceleration ramps at max_jerk up to
+ *     max_accel, and back down so it reaches zero as the velocity lands
+ *     on the target (time-optimal for the limits)
+ *   - Trapezoidal (max_jerk = 0): constant max_accel, acceleration steps
+ *
+ * Each update is constant time (one square root) and the target may change
+ * at any tick; the profile continues from the current velocity and
+ * acceleration. Units follow the caller (e.g. counts/s, counts/s^2,
+ * counts/s^3).
+ *
+ ******************************************************************************
+ */
+
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief  Profile generator state
+ */
+typedef struct {
+  float max_accel; /* Acceleration limit (> 0) */
+  float max_jerk;  /* Jerk limit, 0 for trapezoidal */
+
+  float target;   /* Velocity to reach */
+  float velocity; /* Profiled velocity */
+  float accel;    /* Profiled acceleration */
+} MotionProfile_t;
+
+/**
+ * @brief  Initialize a profile at rest
+ * @param  profile: Profile state
+ * @param  max_accel: Acceleration limit (> 0)
+ * @param  max_jerk: Jerk limit, 0 for a trapezoidal profile
+ */
+void MotionProfile_Init(MotionProfile_t *profile, float max_accel,
+                        float max_jerk);
+
+/**
+ * @brief  Change the limits (takes effect on the next update)
+ */
+void MotionProfile_SetLimits(MotionProfile_t *profile, float max_accel,
+                             float max_jerk);
+
+/**
+ * @brief  Set the velocity to move towards
+ */
+void MotionProfile_SetTarget(MotionProfile_t *profile, float target);
+
+/**
+ * @brief  Jump to a velocity with zero acceleration (target too)
+ */
+void MotionProfile_Reset(MotionProfile_t *profile, float velocity);
+
+/**
+ * @brief  Advance one tick
+ * @param  profile: Profile state
+ * @param  dt: Time step in seconds
+ * @retval Profiled velocity (acceleration in profile->accel)
+ */
+float MotionProfile_Update(MotionProfile_t *profile, float dt);
+
+/**
+ * @brief  Check whether the target has been reached
+ * @retval 1 if velocity equals target with zero acceleration
+ */
+uint8_t MotionProfile_IsDone(const MotionProfile_t *profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MOTION_PROFILE_H */
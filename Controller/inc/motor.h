@@ -13,9 +13,22 @@
  *   - Right Motor IN2  -> PB1 (GPIO - direction)
  *
  * PWM Configuration:
- *   - Timer: TIM3
- *   - Frequency: 1kHz
- *   - Resolution: 0-1000 (0.1% steps)
+ *   - Timer: TIM3, center-aligned mode 1 (counts 0 -> ARR -> 0)
+ *   - Frequency: MOTOR_PWM_HZ (20kHz, above hearing), settable at runtime
+ *     from MOTOR_PWM_MIN_HZ to MOTOR_PWM_MAX_HZ
+ *   - Resolution: ARR = 72MHz / (2 * frequency) duty steps, prescaler 1
+ *     whenever ARR fits 16 bits (1800 steps at 20kHz, 1440 at 25kHz)
+ *   - ARR and CCR1/CCR2 are preloaded: new values take effect together at
+ *     the next update event (either end of the count), never mid-period
+ *
+ * Effort to duty:
+ *   Motor_SetLeft/Right take an effort of -1000..1000. Its magnitude goes
+ *   through the compensation table, MOTOR_COMP_POINTS duty values (per
+ *   mille) at efforts 0, 100, ..., 1000, interpolated linearly; effort 0
+ *   is always 0 duty (brake). A table starting above 0 skips the deadband
+ *   where the motor cannot overcome its static friction; a measured table
+ *   also straightens the speed/effort curve. The default is linear from
+ *   MOTOR_DEADBAND.
  *
  ******************************************************************************
  */
@@ -34,6 +47,24 @@ extern "C" {
 #define MOTOR_MAX_SPEED 1000
 #define MOTOR_MIN_SPEED (-1000)
 
+/* Default PWM frequency and the settable range (Hz) */
+#ifndef MOTOR_PWM_HZ
+#define MOTOR_PWM_HZ 20000U
+#endif
+#define MOTOR_PWM_MIN_HZ 100U
+#define MOTOR_PWM_MAX_HZ 25000U
+
+/* Compensation table: duty (per mille) at efforts 0, 100, ..., 1000 */
+#define MOTOR_COMP_POINTS 11U
+#define MOTOR_COMP_STEP (MOTOR_MAX_SPEED / (MOTOR_COMP_POINTS - 1U))
+
+/* Default deadband (duty per mille at the smallest effort). 0 leaves the
+ * effort linear: the drive's FF_KS already offsets static friction in the
+ * direction of travel (differential_drive.h), and both would add up */
+#ifndef MOTOR_DEADBAND
+#define MOTOR_DEADBAND 0U
+#endif
+
 /**
  * @brief  Initialize dual motor control (TIM3 PWM on PA6/PA7)
  */
@@ -55,6 +86,8 @@ void Motor_SetRight(int16_t speed);
  * @brief  Set both motors speed and direction
  * @param  left_speed: -1000 to +1000
  * @param  right_speed: -1000 to +1000
+ * @note   Both wheels change on the same PWM edge (the next update event);
+ *         interrupts are held off for the six register writes
  */
 void Motor_SetBoth(int16_t left_speed, int16_t right_speed);
 
@@ -68,6 +101,47 @@ void Motor_Stop(void);
  */
 void Motor_Coast(void);
 
+/**
+ * @brief  Change the PWM frequency, keeping the commanded efforts
+ * @param  hz: MOTOR_PWM_MIN_HZ to MOTOR_PWM_MAX_HZ
+ * @retval 0 on success, -1 if out of range (frequency unchanged)
+ * @note   The new period starts at the next update event
+ */
+int8_t Motor_SetFrequency(uint32_t hz);
+
+/**
+ * @brief  Get the PWM frequency the timer runs at (after rounding)
+ * @retval Frequency in Hz
+ */
+uint32_t Motor_GetFrequency(void);
+
+/**
+ * @brief  Get the PWM resolution
+ * @retval Duty steps per period (ARR)
+ */
+uint16_t Motor_GetResolution(void);
+
+/**
+ * @brief  Load an effort-to-duty compensation table
+ * @param  duty: MOTOR_COMP_POINTS duty values (per mille), non-decreasing,
+ *         at most 1000
+ * @retval 0 on success, -1 if invalid (table unchanged)
+ */
+int8_t Motor_SetCompensation(const uint16_t duty[MOTOR_COMP_POINTS]);
+
+/**
+ * @brief  Load a linear table from a deadband to full duty
+ * @param  deadband: Duty (per mille) at the smallest effort, below 1000
+ * @retval 0 on success, -1 if invalid
+ */
+int8_t Motor_SetDeadband(uint16_t deadband);
+
+/**
+ * @brief  Get the compensation table
+ * @param  duty: Destination, MOTOR_COMP_POINTS values (per mille)
+ */
+void Motor_GetCompensation(uint16_t duty[MOTOR_COMP_POINTS]);
+
 #ifdef __cplusplus
 }
 #endif
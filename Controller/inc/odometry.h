@@ -0,0 +1,128 @@
+/**
+ ******************************************************************************
+ * @file    odometry.h
+ * @brief   Wheel odometry: pose (x, y, theta) from encoders and IMU yaw
+ ******************************************************************************
+ *
+ * Frame:
+ *   - Origin and x axis: robot pose at the last Odometry_Reset()
+ *   - theta positive counter-clockwise, y to the left of the start heading
+ *
+ * Each update takes the encoder deltas since the previous one:
+ *   ds     = (dL + dR) / 2 * (pi * WHEEL_DIAMETER_MM / ENCODER_CPR)
+ *   dtheta = IMU yaw change, or (dR - dL) * count length / track width
+ *   x     += ds * chord * cos(theta + dtheta / 2)
+ *   y     += ds * chord * sin(theta + dtheta / 2)
+ * with chord = 1 - dtheta^2 / 24 (arc to chord), so constant-curvature
+ * segments integrate exactly.
+ *
+ * Arithmetic:
+ *   Updates are integer-only: theta is a binary angle (2^32 = one turn),
+ *   x/y are Q16 micrometres, and sin/cos come from a 257-entry Q30
+ *   quarter-wave table with linear interpolation (error < 5e-6). Floats
+ *   only appear in the setters, the getters and the IMU yaw conversion.
+ *
+ ******************************************************************************
+ */
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Distance between the wheel contact points (adjust for your robot) */
+#ifndef ODOMETRY_TRACK_WIDTH_MM
+#define ODOMETRY_TRACK_WIDTH_MM 150.0f
+#endif
+
+/**
+ * @brief  Source of the heading change
+ */
+typedef enum {
+  ODOMETRY_HEADING_IMU = 0, /* IMU_GetHeading() (no wheel slip in yaw) */
+  ODOMETRY_HEADING_ENCODER  /* Wheel difference over the track width */
+} Odometry_Heading_t;
+
+/* Heading source used by Odometry_Init() */
+#ifndef ODOMETRY_HEADING
+#define ODOMETRY_HEADING ODOMETRY_HEADING_IMU
+#endif
+
+/**
+ * @brief  Robot pose
+ */
+typedef struct {
+  float x;     /* mm */
+  float y;     /* mm */
+  float theta; /* Degrees, -180 to 180, CCW positive */
+} Odometry_Pose_t;
+
+/**
+ * @brief  Initialize: default track width and heading source, pose zero
+ */
+void Odometry_Init(void);
+
+/**
+ * @brief  Set the track width
+ * @param  track_mm: Distance between the wheels in mm (> 0)
+ */
+void Odometry_SetTrackWidth(float track_mm);
+
+/**
+ * @brief  Get the track width
+ * @retval Distance between the wheels in mm
+ */
+float Odometry_GetTrackWidth(void);
+
+/**
+ * @brief  Select the heading source
+ */
+void Odometry_SetHeadingSource(Odometry_Heading_t source);
+
+/**
+ * @brief  Get the heading source
+ */
+Odometry_Heading_t Odometry_GetHeadingSource(void);
+
+/**
+ * @brief  Set the pose to zero (call together with Encoder_Reset() and
+ *         IMU_ResetHeading())
+ */
+void Odometry_Reset(void);
+
+/**
+ * @brief  The IMU heading was reset to zero: keep the pose, measure the
+ *         next yaw change from zero
+ */
+void Odometry_ResetYawReference(void);
+
+/**
+ * @brief  Integrate one control tick from Encoder_GetDelta() and the IMU
+ *         heading
+ * @note   Call after IMU_Update(); Encoder_GetDelta() has no other user
+ */
+void Odometry_Update(void);
+
+/**
+ * @brief  Integrate one step from explicit measurements
+ * @param  left_delta: Left encoder counts since the previous step
+ * @param  right_delta: Right encoder counts since the previous step
+ * @param  yaw_deg: IMU heading in degrees (ignored with the encoder source)
+ */
+void Odometry_Step(int32_t left_delta, int32_t right_delta, float yaw_deg);
+
+/**
+ * @brief  Get the current pose
+ * @param  pose: Destination
+ */
+void Odometry_GetPose(Odometry_Pose_t *pose);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ODOMETRY_H */
@@ -0,0 +1,144 @@
+/**
+ ******************************************************************************
+ * @file    param_server.h
+ * @brief   Live parameter get/set over USART3 RX with a circular DMA ring
+ ******************************************************************************
+ *
+ * Hardware Setup:
+ *   - USART3_RX -> PB11 (input, pull-up), same baud as the TX stream
+ *   - DMA1 Channel 3 (USART3_RX), circular into a PARAM_SERVER_RX_SIZE ring
+ *   - USART3 IDLE and DMA half/full interrupts only wake the main loop
+ *
+ * Commands are ASCII lines ending in '\n' ('\r' is ignored), parsed where
+ * the DMA left them in the ring, wrapped or not:
+ *   get NAME                    ->  NAME=VALUE
+ *   set NAME=VALUE [NAME=VALUE] ->  ok
+ *   save                        ->  ok (settings.h; drive stopped only)
+ *   anything else               ->  err <reason>
+ * A set line is checked completely (names, numbers, ranges) before any of
+ * it takes effect, then applied with interrupts masked: the control loop
+ * runs from an interrupt, so it sees all of the line's values or none.
+ *
+ * Parameters:
+ *   speed.kp speed.ki speed.kd        Speed PID gains (both wheels)
+ *   heading.kp heading.ki heading.kd  Heading PID gains
+ *   speed.ilimit heading.ilimit       PID integral limits
+ *   target_speed                      counts/s, along the speed profile
+ *   loop_hz                           Control loop rate
+ *
+ * Parsing runs from ParamServer_Poll() in the main loop, never in the
+ * control interrupt. Replies go to the function given to
+ * ParamServer_Init(); in the telemetry build main.c passes
+ * Telemetry_SendReply, the trace build has no reply channel. Only one
+ * reply waits for the link at a time: a host sending lines back to back
+ * loses the replies in between (replies_dropped), not the commands.
+ *
+ ******************************************************************************
+ */
+
+#ifndef PARAM_SERVER_H
+#define PARAM_SERVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef PARAM_SERVER_ENABLE
+#define PARAM_SERVER_ENABLE 1
+#endif
+
+/* Receive ring (power of two): 22ms of back-to-back bytes at 921600, so a
+ * main loop held up for 10ms between polls loses nothing */
+#define PARAM_SERVER_RX_SIZE 2048U
+
+/* Used only if the TX stream has not already configured USART3 */
+#define PARAM_SERVER_UART_BAUD 921600U
+
+/* NVIC priority (0 = highest, 15 = lowest): below the control loop */
+#define PARAM_SERVER_IRQ_PRIORITY 4U
+
+/* Most NAME=VALUE pairs in one set line */
+#define PARAM_SERVER_MAX_SETS 8U
+
+/* Longest reply in characters */
+#define PARAM_SERVER_REPLY_MAX 48U
+
+/**
+ * @brief  Reply sink
+ * @param  text: Reply characters (not terminated)
+ * @param  length: Number of characters
+ * @retval 0 if accepted, -1 if dropped
+ */
+typedef int8_t (*ParamServer_Reply_t)(const char *text, uint32_t length);
+
+/**
+ * @brief  Parameter server statistics
+ */
+typedef struct {
+  uint32_t lines;           /* Complete lines seen (blank lines excluded) */
+  uint32_t gets;            /* Successful get commands */
+  uint32_t sets;            /* Successful set lines (each applied at once) */
+  uint32_t saves;           /* Successful save commands */
+  uint32_t errors;          /* Lines rejected with an err reply */
+  uint32_t overflows;       /* Lines longer than the ring, discarded */
+  uint32_t overruns;        /* Ring overwritten before it was parsed (the
+                               lines up to the next intact '\n' are lost) */
+  uint32_t replies_dropped; /* Replies the sink refused */
+} ParamServer_Stats_t;
+
+/**
+ * @brief  Start USART3 reception into the DMA ring
+ * @param  reply: Reply sink, NULL for none
+ * @note   Call after the TX stream (Trace_Init/Telemetry_Init), which sets
+ *         the baud rate
+ */
+void ParamServer_Init(ParamServer_Reply_t reply);
+
+/**
+ * @brief  Parse and execute every complete line received so far
+ * @note   Call from the main loop
+ */
+void ParamServer_Poll(void);
+
+/**
+ * @brief  Execute one command line in place
+ * @param  ring: Buffer holding the line
+ * @param  size: Buffer size (power of two); the line may wrap past the end
+ * @param  start: Index of the first character
+ * @param  length: Characters, without the '\n'
+ * @retval 0 if executed, -1 if rejected
+ */
+int8_t ParamServer_Execute(const uint8_t *ring, uint32_t size, uint32_t start,
+                           uint32_t length);
+
+/**
+ * @brief  Read a parameter by name
+ * @param  name: Registry name (terminated)
+ * @param  value: Destination
+ * @retval 0 on success, -1 if unknown
+ */
+int8_t ParamServer_Get(const char *name, float *value);
+
+/**
+ * @brief  Get parameter server statistics
+ * @param  out: Destination
+ */
+void ParamServer_GetStats(ParamServer_Stats_t *out);
+
+/**
+ * @brief  USART3 interrupt handler (line idle)
+ */
+void ParamServer_USART3_Handler(void);
+
+/**
+ * @brief  DMA1 channel 3 interrupt handler (ring half/full)
+ */
+void ParamServer_DMA1_Channel3_Handler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARAM_SERVER_H */
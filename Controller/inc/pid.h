@@ -9,6 +9,14 @@
  *   - Anti-windup with integral clamping
  *   - Output saturation
  *   - Derivative on measurement to reduce kick
+ *   - Optional static feedforward: Kv*setpoint + Ks*sign(setpoint) +
+ *     Ka*setpoint_accel, inside the saturation and anti-windup
+ *   - Gain schedule: (Kp, Ki, Kd) table over an operating point, linearly
+ *     interpolated with slopes precomputed at init (no divide per tick)
+ *   - Batched variant (PID_Batch_t): N controllers in struct-of-arrays
+ *     form at a fixed rate, Ki*dt and Kd/dt precomputed, select-based
+ *     saturation
+ *   - Q16.16 fixed-point variant (PID_Q16_t) for soft-float builds
  *
  ******************************************************************************
  */
@@ -30,6 +38,11 @@ typedef struct {
   float Ki; /* Integral gain */
   float Kd; /* Derivative gain */
 
+  /* Feedforward (all zero = off) */
+  float Kv; /* Per unit of setpoint */
+  float Ks; /* Static: times the sign of the setpoint */
+  float Ka; /* Per unit of setpoint acceleration */
+
   float integral;         /* Integral accumulator */
   float prev_measurement; /* Previous measurement (for derivative on
                              measurement) */
@@ -37,6 +50,10 @@ typedef struct {
   float integral_limit; /* Anti-windup: max integral value */
   float output_min;     /* Output saturation minimum */
   float output_max;     /* Output saturation maximum */
+
+  /* Last compute's P and D terms (the I term is `integral`) */
+  float proportional;
+  float derivative;
 } PID_t;
 
 /**
@@ -61,6 +78,19 @@ void PID_Init(PID_t *pid, float Kp, float Ki, float Kd, float output_min,
  */
 float PID_Compute(PID_t *pid, float setpoint, float measurement, float dt);
 
+/**
+ * @brief  Compute PID output plus feedforward
+ * @param  pid: Pointer to PID structure
+ * @param  setpoint: Desired value
+ * @param  setpoint_accel: Rate of change of the setpoint (for Ka)
+ * @param  measurement: Actual measured value
+ * @param  dt: Time delta in seconds
+ * @retval PID output + Kv*setpoint + Ks*sign(setpoint) + Ka*setpoint_accel
+ *         (clamped to min/max; saturation also stops the integrator)
+ */
+float PID_ComputeFF(PID_t *pid, float setpoint, float setpoint_accel,
+                    float measurement, float dt);
+
 /**
  * @brief  Reset PID controller state
  * @param  pid: Pointer to PID structure
@@ -81,6 +111,261 @@ void PID_SetGains(PID_t *pid, float Kp, float Ki, float Kd);
  */
 void PID_SetIntegralLimit(PID_t *pid, float limit);
 
+/**
+ * @brief  Set feedforward gains (PID_Init sets all to zero)
+ * @param  pid: Pointer to PID structure
+ * @param  Kv, Ks, Ka: Velocity, static and acceleration gains
+ */
+void PID_SetFeedforward(PID_t *pid, float Kv, float Ks, float Ka);
+
+/**
+ * @brief  Get the P, I and D terms of the last compute
+ * @param  pid: Pointer to PID structure
+ * @param  terms: Destination P, I, D
+ */
+void PID_GetTerms(const PID_t *pid, float terms[3]);
+
+/* ================ Gain Schedule ================ */
+
+#define PID_SCHEDULE_MAX_POINTS 8U
+
+/**
+ * @brief  Gains at one operating point
+ */
+typedef struct {
+  float point; /* Operating point (e.g. speed), strictly increasing */
+  float Kp;
+  float Ki;
+  float Kd;
+} PID_GainPoint_t;
+
+/**
+ * @brief  Gain schedule with per-segment slopes
+ */
+typedef struct {
+  uint8_t count;
+  float point[PID_SCHEDULE_MAX_POINTS];
+  float gains[PID_SCHEDULE_MAX_POINTS][3];     /* Kp, Ki, Kd at each point */
+  float slope[PID_SCHEDULE_MAX_POINTS - 1][3]; /* Per unit of point */
+} PID_Schedule_t;
+
+/**
+ * @brief  Build a gain schedule (divides once per segment, here only)
+ * @param  schedule: Schedule to fill
+ * @param  points: Gains in strictly increasing point order
+ * @param  count: 1 to PID_SCHEDULE_MAX_POINTS
+ * @retval 0 on success, -1 if count or ordering is invalid
+ */
+int8_t PID_Schedule_Init(PID_Schedule_t *schedule,
+                         const PID_GainPoint_t *points, uint8_t count);
+
+/**
+ * @brief  Interpolate the schedule
+ * @param  schedule: Gain schedule
+ * @param  point: Operating point (held at the end values outside the table)
+ * @param  gains: Destination Kp, Ki, Kd
+ */
+void PID_Schedule_Interpolate(const PID_Schedule_t *schedule, float point,
+                              float gains[3]);
+
+/**
+ * @brief  Interpolate the schedule and load the gains into a PID
+ * @param  pid: Pointer to PID structure
+ * @param  schedule: Gain schedule
+ * @param  point: Operating point (held at the end values outside the table)
+ * @note   Linear search and multiply-adds only; call every tick
+ */
+void PID_ApplySchedule(PID_t *pid, const PID_Schedule_t *schedule,
+                       float point);
+
+/* ================ Batched PID ================ */
+
+#define PID_BATCH_MAX 4U
+
+/**
+ * @brief  N float PIDs sharing one sample time, struct-of-arrays
+ * @note   Same semantics as PID_ComputeFF per controller, but Ki*dt and
+ *         Kd/dt are folded in whenever gains or dt change, so an update
+ *         is multiply-adds and selects with no divide.
+ */
+typedef struct {
+  uint8_t count;
+  float dt;     /* Sample time (s) */
+  float inv_dt; /* 1 / dt */
+
+  /* Gains as set (to refold when dt changes) */
+  float Ki[PID_BATCH_MAX];
+  float Kd[PID_BATCH_MAX];
+
+  /* Folded gains */
+  float Kp[PID_BATCH_MAX];
+  float Ki_dt[PID_BATCH_MAX]; /* Ki * dt */
+  float Kd_dt[PID_BATCH_MAX]; /* Kd / dt */
+  float Kv[PID_BATCH_MAX];
+  float Ks[PID_BATCH_MAX];
+  float Ka[PID_BATCH_MAX];
+
+  /* Limits */
+  float integral_limit[PID_BATCH_MAX];
+  float output_min[PID_BATCH_MAX];
+  float output_max[PID_BATCH_MAX];
+
+  /* State */
+  float integral[PID_BATCH_MAX];
+  float prev_measurement[PID_BATCH_MAX];
+
+  /* Last update's P and D terms (the I term is `integral`) */
+  float proportional[PID_BATCH_MAX];
+  float derivative[PID_BATCH_MAX];
+} PID_Batch_t;
+
+/**
+ * @brief  Initialize a batch (all gains and limits zero)
+ * @param  batch: Batch state
+ * @param  count: Number of controllers (1 to PID_BATCH_MAX)
+ * @param  dt: Sample time in seconds (> 0)
+ * @retval 0 on success, -1 if count or dt is invalid
+ */
+int8_t PID_Batch_Init(PID_Batch_t *batch, uint8_t count, float dt);
+
+/**
+ * @brief  Configure one controller (same defaults as PID_Init)
+ * @param  batch: Batch state
+ * @param  index: Controller index
+ * @param  Kp, Ki, Kd: Gains
+ * @param  output_min, output_max: Output saturation
+ */
+void PID_Batch_Setup(PID_Batch_t *batch, uint8_t index, float Kp, float Ki,
+                     float Kd, float output_min, float output_max);
+
+/**
+ * @brief  Change the sample time (refolds every controller's gains)
+ */
+void PID_Batch_SetPeriod(PID_Batch_t *batch, float dt);
+
+/**
+ * @brief  Set one controller's gains
+ */
+void PID_Batch_SetGains(PID_Batch_t *batch, uint8_t index, float Kp,
+                        float Ki, float Kd);
+
+/**
+ * @brief  Set one controller's feedforward gains
+ */
+void PID_Batch_SetFeedforward(PID_Batch_t *batch, uint8_t index, float Kv,
+                              float Ks, float Ka);
+
+/**
+ * @brief  Set one controller's integral limit
+ */
+void PID_Batch_SetIntegralLimit(PID_Batch_t *batch, uint8_t index,
+                                float limit);
+
+/**
+ * @brief  Reset one controller's state
+ */
+void PID_Batch_Reset(PID_Batch_t *batch, uint8_t index);
+
+/**
+ * @brief  Reset every controller's state
+ */
+void PID_Batch_ResetAll(PID_Batch_t *batch);
+
+/**
+ * @brief  Update every controller
+ * @param  batch: Batch state
+ * @param  setpoint: Setpoints [count]
+ * @param  setpoint_accel: Setpoint rates for Ka [count], NULL for none
+ * @param  measurement: Measurements [count]
+ * @param  output: Outputs [count]
+ */
+void PID_Batch_Compute(PID_Batch_t *batch, const float *setpoint,
+                       const float *setpoint_accel, const float *measurement,
+                       float *output);
+
+/**
+ * @brief  Get one controller's terms from the last update
+ * @param  terms: Destination {P, I, D}
+ */
+void PID_Batch_GetTerms(const PID_Batch_t *batch, uint8_t index,
+                        float terms[3]);
+
+/* ================ Q16.16 Fixed-Point PID ================ */
+
+/* Q16.16 fixed-point number: 16 integer bits, 16 fractional bits */
+typedef int32_t q16_t;
+
+#define Q16_SHIFT 16
+#define Q16_ONE ((q16_t)1 << Q16_SHIFT)
+#define Q16_FROM_INT(x) ((q16_t)(x) * Q16_ONE)
+#define Q16_FROM_FLOAT(x)                                                      \
+  ((q16_t)((x) * 65536.0f + (((x) >= 0.0f) ? 0.5f : -0.5f)))
+#define Q16_TO_FLOAT(x) ((float)(x) * (1.0f / 65536.0f))
+
+/* Ki*dt is kept with extra fractional bits (Q8.24) so small integral gains
+ * at high loop rates do not lose resolution */
+#define PID_Q16_KI_SHIFT 24
+
+/**
+ * @brief  Fixed-point PID controller structure
+ * @note   The sample time is fixed at init so the hot path needs no divide:
+ *         Ki*dt and Kd/dt are precomputed whenever gains change.
+ */
+typedef struct {
+  q16_t Kp;    /* Proportional gain (Q16.16) */
+  int32_t Ki_dt; /* Ki * dt (Q8.24) */
+  q16_t Kd_dt; /* Kd / dt (Q16.16) */
+
+  q16_t integral;         /* Integral accumulator */
+  q16_t prev_measurement; /* Previous measurement (derivative on measurement) */
+
+  q16_t integral_limit; /* Anti-windup: max integral value */
+  q16_t output_min;     /* Output saturation minimum */
+  q16_t output_max;     /* Output saturation maximum */
+
+  float dt; /* Sample time in seconds (used to rescale gains) */
+} PID_Q16_t;
+
+/**
+ * @brief  Initialize fixed-point PID controller
+ * @param  pid: Pointer to PID structure
+ * @param  Kp, Ki, Kd: Gains (same units as PID_Init)
+ * @param  output_min: Minimum output value
+ * @param  output_max: Maximum output value
+ * @param  dt: Fixed sample time in seconds (must be > 0)
+ */
+void PID_Q16_Init(PID_Q16_t *pid, float Kp, float Ki, float Kd,
+                  float output_min, float output_max, float dt);
+
+/**
+ * @brief  Compute fixed-point PID output (same semantics as PID_Compute)
+ * @param  pid: Pointer to PID structure
+ * @param  setpoint: Desired value (Q16.16)
+ * @param  measurement: Actual measured value (Q16.16)
+ * @retval PID output (Q16.16, clamped to min/max)
+ */
+q16_t PID_Q16_Compute(PID_Q16_t *pid, q16_t setpoint, q16_t measurement);
+
+/**
+ * @brief  Reset fixed-point PID controller state
+ * @param  pid: Pointer to PID structure
+ */
+void PID_Q16_Reset(PID_Q16_t *pid);
+
+/**
+ * @brief  Set new fixed-point PID gains
+ * @param  pid: Pointer to PID structure
+ * @param  Kp, Ki, Kd: New gains
+ */
+void PID_Q16_SetGains(PID_Q16_t *pid, float Kp, float Ki, float Kd);
+
+/**
+ * @brief  Set integral limit for anti-windup
+ * @param  pid: Pointer to PID structure
+ * @param  limit: Maximum integral value
+ */
+void PID_Q16_SetIntegralLimit(PID_Q16_t *pid, float limit);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * @file    settings.h
+ * @brief   Calibration, gains and odometry parameters kept in flash
+ ******************************************************************************
+ *
+ * Storage:
+ *   Two record slots of 16-bit variables in the EEPROM emulation
+ *   (eeprom.h), each a version, a sequence number, the fields of
+ *   Settings_t (floats as two halves), then a CRC-16 written last. A save
+ *   goes to the slot not holding the newest valid record, with the next
+ *   sequence number, and rewrites only the variables that changed there;
+ *   loading takes the valid record with the highest sequence number. A
+ *   reset in the middle of a save fails that slot's CRC, and the next boot
+ *   loads the record saved before it.
+ *
+ * Boot (Settings_Restore):
+ *   1. Stored gains, integral limits and odometry parameters are applied
+ *   2. The stored gyro bias is used, skipping the calibration, unless
+ *      - the MPU6050 die temperature moved more than SETTINGS_MAX_TEMP_DELTA
+ *        since it was calibrated (the bias drifts with temperature), or
+ *      - the stationarity check fails: IMU_BIAS_CHECK_SAMPLES gyro
+ *        readings must show the robot still and average within
+ *        SETTINGS_BIAS_TOLERANCE of the stored bias
+ *   Otherwise the caller calibrates and calls Settings_Store().
+ *
+ * Flash writes stall the CPU, interrupts included (eeprom.h): store only
+ * while the drive is stopped.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef SETTINGS_ENABLE
+#define SETTINGS_ENABLE 1
+#endif
+
+/* Record layout version: a stored record of another version is ignored */
+#define SETTINGS_VERSION 2U
+
+/* Largest die temperature change (C) a stored gyro bias is trusted over */
+#define SETTINGS_MAX_TEMP_DELTA 5.0f
+
+/* Largest |mean rate - stored bias| (deg/s) at boot; 0.05 deg/s is 3
+ * degrees of heading drift per minute */
+#define SETTINGS_BIAS_TOLERANCE 0.05f
+
+/**
+ * @brief  Stored parameters
+ */
+typedef struct {
+  float gyro_z_bias;        /* deg/s */
+  float gyro_temp_c;        /* Die temperature at calibration */
+  float speed_pid[3];       /* Kp, Ki, Kd */
+  float heading_pid[3];     /* Kp, Ki, Kd */
+  float integral_limits[2]; /* Speed, heading */
+  float track_width_mm;
+  uint16_t heading_source; /* Odometry_Heading_t */
+} Settings_t;
+
+/**
+ * @brief  Outcome of Settings_Restore()
+ */
+typedef enum {
+  SETTINGS_RESTORED = 0, /* Everything applied, no calibration needed */
+  SETTINGS_NONE,         /* Nothing valid stored: defaults kept */
+  SETTINGS_TEMPERATURE,  /* Applied, but the bias is from another temp */
+  SETTINGS_BIAS_CHECK,   /* Applied, but the stationarity check failed */
+  SETTINGS_FLASH_ERROR   /* The EEPROM emulation could not start */
+} Settings_Result_t;
+
+/**
+ * @brief  Load the newest stored record
+ * @param  out: Destination
+ * @retval 0 on success, -1 if no slot holds a valid record of this version
+ */
+int8_t Settings_Load(Settings_t *out);
+
+/**
+ * @brief  Store a record in the older slot (only the variables that
+ *         changed are written)
+ * @param  in: Parameters to store
+ * @retval 0 on success, -1 on a flash error
+ */
+int8_t Settings_Save(const Settings_t *in);
+
+/**
+ * @brief  Read the live parameters (drive, IMU bias, odometry)
+ * @param  out: Destination
+ */
+void Settings_Capture(Settings_t *out);
+
+/**
+ * @brief  Apply gains, integral limits and odometry parameters (not the
+ *         gyro bias, see Settings_Restore)
+ * @param  in: Parameters
+ */
+void Settings_Apply(const Settings_t *in);
+
+/**
+ * @brief  Start the EEPROM emulation and restore the stored parameters
+ * @retval SETTINGS_RESTORED if the calibration can be skipped
+ * @note   Call after DifferentialDrive_Init(), with the robot stationary
+ */
+Settings_Result_t Settings_Restore(void);
+
+/**
+ * @brief  Store the live parameters (after a calibration or tuning)
+ * @retval 0 on success, -1 on a flash error
+ * @note   Main loop only, with the drive stopped
+ */
+int8_t Settings_Store(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SETTINGS_H */
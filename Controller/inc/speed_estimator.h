@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * @file    speed_estimator.h
+ * @brief   Hybrid period/count wheel speed estimator
+ ******************************************************************************
+ *
+ * Counting edges per control tick quantises speed to 1 count/tick (100
+ * counts/s at 100Hz). This estimator also uses edge timestamps:
+ *   - Few edges per tick: speed = counts between the last timestamped edges
+ *     / time between them (period measurement, exact at any speed). When
+ *     the last span is not whole quadrature cycles but the span from the
+ *     edge before is, that one is used: A/B phase and duty cycle errors
+ *     cancel over a cycle.
+ *   - Many edges per tick: blends linearly from blend_counts / 2 to the
+ *     count delta over the tick, reaching it at blend_counts. Timestamps
+ *     are only needed below that.
+ *   - No timestamped edge this tick: holds the speed until the next edge is
+ *     overdue, then bounds it by edge_counts / time since the last edge
+ *     (1 / time since the count last changed, if that is less), and
+ *     reports 0 after the stop timeout without a count.
+ *   - Timestamped edges may be up to edge_counts apart (timer captures of
+ *     rising A and B only, or capture gated off when fast): a period spans
+ *     up to edge_counts stop timeouts, and edges from before a tick that
+ *     fell back to the count delta are not used.
+ *   - Starting, reversing or no timestamps at all: count delta (over the
+ *     time since the wheel last moved, when starting from rest).
+ *
+ * Confidence (0.0 - 1.0) is 1 for a period measurement or at rest, the
+ * blend weight for a count-only estimate, is kept while a speed is held,
+ * and drops as an edge becomes overdue.
+ *
+ * Times are free-running cycle counts (e.g. DWT->CYCCNT); each update is
+ * constant time with at most three divisions.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SPEED_ESTIMATOR_H
+#define SPEED_ESTIMATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Counts per quadrature cycle: edge spacing errors repeat with this period */
+#define SPEED_ESTIMATOR_CYCLE_COUNTS 4
+
+/**
+ * @brief  Speed estimator state
+ */
+typedef struct {
+  float clock_hz;      /* Timestamp clock */
+  float edge_counts;   /* Counts between timestamped edges */
+  float blend_scale;   /* 1 / blend_counts */
+  uint32_t stop_ticks; /* No edge for this long (cycles) means stopped */
+
+  int32_t count;      /* Count at the previous update */
+  uint32_t time;      /* Time of the previous update */
+  int32_t edge_count; /* Count at the last timestamped edge */
+  uint32_t edge_time; /* Time of the last timestamped edge */
+  int32_t prev_edge_count; /* The timestamped edge before that */
+  uint32_t prev_edge_time;
+  uint32_t move_time; /* Last time the wheel was seen moving */
+  uint8_t edge_valid; /* Timestamped edges (0-2) of the current motion */
+
+  float velocity;   /* Estimated speed in counts/s */
+  float confidence; /* 0.0 - 1.0 */
+} SpeedEstimator_t;
+
+/**
+ * @brief  Initialize estimator
+ * @param  est: Pointer to estimator
+ * @param  clock_hz: Timestamp clock frequency
+ * @param  edge_counts: Counts between timestamped edges (1 if every edge)
+ * @param  blend_counts: Counts per update at which the count delta takes over
+ * @param  stop_time: Seconds without an edge before reporting 0
+ */
+void SpeedEstimator_Init(SpeedEstimator_t *est, uint32_t clock_hz,
+                         uint32_t edge_counts, uint32_t blend_counts,
+                         float stop_time);
+
+/**
+ * @brief  Restart from rest at a given count
+ * @param  est: Pointer to estimator
+ * @param  count: Current count
+ * @param  now: Current time
+ */
+void SpeedEstimator_Reset(SpeedEstimator_t *est, int32_t count, uint32_t now);
+
+/**
+ * @brief  Update the estimate (call once per control tick)
+ * @param  est: Pointer to estimator
+ * @param  count: Current count
+ * @param  edge_count: Count at the most recent timestamped edge
+ * @param  edge_time: Time of the most recent timestamped edge
+ * @param  now: Current time
+ * @retval Speed in counts/second
+ */
+float SpeedEstimator_Update(SpeedEstimator_t *est, int32_t count,
+                            int32_t edge_count, uint32_t edge_time,
+                            uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPEED_ESTIMATOR_H */
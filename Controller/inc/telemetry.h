@@ -0,0 +1,158 @@
+/**
+ ******************************************************************************
+ * @file    telemetry.h
+ * @brief   Per-tick binary telemetry frames over USART DMA
+ ******************************************************************************
+ *
+ * Hardware Setup:
+ *   - USART3_TX -> PB10 (921600 baud, 8N1)
+ *   - DMA1 Channel 2 (USART3_TX)
+ *   - CRC unit (CRC-32, polynomial 0x04C11DB7, init 0xFFFFFFFF)
+ *
+ * USART3 is the only USART with a free TX pin and DMA channel on this
+ * pinout (PA9 is TIM1_CH2, USART2_TX shares DMA1 channel 7 with the IMU),
+ * so telemetry replaces the trace dump: build with TELEMETRY_ENABLE=1 and
+ * TRACE_ENABLE=0.
+ *
+ * Sending:
+ *   Telemetry_Publish() stamps, checksums and COBS-encodes a frame into
+ *   whichever of two buffers the DMA is not reading, then starts the DMA if
+ *   the USART is idle. Otherwise the frame waits and the DMA complete
+ *   interrupt starts it; a newer frame replaces a waiting one and counts as
+ *   dropped. The caller never waits for the USART.
+ *
+ *   Telemetry_SendReply() carries short text replies (param_server.h) in a
+ *   third buffer; a waiting reply goes out before a waiting frame.
+ *
+ * Frame on the wire:
+ *   COBS(frame (64 bytes) | crc u32) | 0x00
+ *   crc: hardware CRC over the frame as 16 little-endian words
+ *   A 70-byte frame takes 760us at 921600 baud, so one per tick keeps up
+ *   at a 1kHz control loop. Decode with Controller/tools/telemetry_decode.py.
+ *
+ * Reply on the wire:
+ *   COBS(text, zero-padded to whole words | crc u32) | 0x00
+ *   At most TELEMETRY_REPLY_MAX characters, so a reply payload is never
+ *   the length of a frame payload.
+ *
+ ******************************************************************************
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef TELEMETRY_ENABLE
+#define TELEMETRY_ENABLE 0
+#endif
+
+#define TELEMETRY_UART_BAUD 921600U
+
+/* NVIC priority (0 = highest, 15 = lowest): below the control loop */
+#define TELEMETRY_IRQ_PRIORITY 3U
+
+/* Frame plus CRC, COBS overhead (one byte per 254) and the delimiter */
+#define TELEMETRY_FRAME_LEN 64U
+#define TELEMETRY_PAYLOAD_LEN (TELEMETRY_FRAME_LEN + 4U)
+#define TELEMETRY_ENCODED_MAX                                                  \
+  (TELEMETRY_PAYLOAD_LEN + TELEMETRY_PAYLOAD_LEN / 254U + 2U)
+
+/* Longest text reply (keeps the payload shorter than a frame's) */
+#define TELEMETRY_REPLY_MAX 60U
+
+/**
+ * @brief  Telemetry frame (little-endian, no padding)
+ */
+typedef struct {
+  uint32_t timestamp; /* DWT cycles when published */
+  uint16_t seq;       /* Frame counter (wraps) */
+  uint16_t dropped;   /* Frames dropped so far (wraps) */
+  float speed_left;   /* counts/s */
+  float speed_right;  /* counts/s */
+  float setpoint;     /* Profiled speed, counts/s */
+  float heading;      /* Degrees */
+  float pid[3][3];    /* P, I, D terms: left speed, right speed, heading */
+  int16_t motor_left; /* Motor commands, -1000 to 1000 */
+  int16_t motor_right;
+} Telemetry_Frame_t;
+
+_Static_assert(sizeof(Telemetry_Frame_t) == TELEMETRY_FRAME_LEN,
+               "telemetry frame layout");
+
+/**
+ * @brief  Telemetry statistics
+ */
+typedef struct {
+  uint32_t published;       /* Frames passed to Telemetry_Publish() */
+  uint32_t sent;            /* Frames fully handed to the USART */
+  uint32_t dropped;         /* Waiting frames replaced by newer ones */
+  uint32_t replies;         /* Replies fully handed to the USART */
+  uint32_t replies_dropped; /* Replies refused: one already waiting */
+} Telemetry_Stats_t;
+
+/**
+ * @brief  Configure the CRC unit and USART3 TX with DMA
+ */
+void Telemetry_Init(void);
+
+/**
+ * @brief  Send a frame (never blocks)
+ * @param  frame: Measurements; timestamp, seq and dropped are filled in
+ * @note   Call from one context (the control loop)
+ */
+void Telemetry_Publish(Telemetry_Frame_t *frame);
+
+/**
+ * @brief  Send a text reply between frames (never blocks)
+ * @param  text: Characters (no terminator needed)
+ * @param  length: Up to TELEMETRY_REPLY_MAX
+ * @retval 0 on success, -1 if too long or a reply is still waiting
+ * @note   Call from one context (the main loop)
+ */
+int8_t Telemetry_SendReply(const char *text, uint32_t length);
+
+/**
+ * @brief  Checksum and COBS-encode a frame, with the trailing delimiter
+ * @param  frame: Frame to encode
+ * @param  out: Destination (TELEMETRY_ENCODED_MAX bytes)
+ * @retval Encoded length in bytes
+ */
+uint32_t Telemetry_Encode(const Telemetry_Frame_t *frame, uint8_t *out);
+
+/**
+ * @brief  COBS-encode a buffer (no delimiter)
+ * @param  in: Data
+ * @param  length: Data length in bytes
+ * @param  out: Destination (length + length / 254 + 1 bytes)
+ * @retval Encoded length in bytes
+ */
+uint32_t Telemetry_CobsEncode(const uint8_t *in, uint32_t length,
+                              uint8_t *out);
+
+/**
+ * @brief  Check whether a frame is being sent
+ * @retval 1 if busy, 0 if idle
+ */
+uint8_t Telemetry_IsBusy(void);
+
+/**
+ * @brief  Get telemetry statistics
+ * @param  out: Destination
+ */
+void Telemetry_GetStats(Telemetry_Stats_t *out);
+
+/**
+ * @brief  DMA1 channel 2 interrupt handler (USART3 TX complete)
+ */
+void Telemetry_DMA1_Channel2_Handler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ * @file    trace.h
+ * @brief   Cycle-stamped enter/exit tracing with a USART binary dump
+ ******************************************************************************
+ *
+ * Hardware Setup:
+ *   - USART3_TX -> PB10 (921600 baud, 8N1)
+ *   - DMA1 Channel 2 (USART3_TX)
+ *
+ * Recording:
+ *   TRACE_ENTER(id) / TRACE_EXIT(id) stamp an event with DWT->CYCCNT into a
+ *   RAM ring. Producers reserve a slot with LDREX/STREX and commit it by
+ *   writing the slot tag last, so any interrupt priority (and the main loop)
+ *   can record without masking interrupts. A full ring drops the event and
+ *   counts it.
+ *
+ * Draining:
+ *   Trace_Flush() packs committed events into a packet and sends it by DMA;
+ *   the DMA complete interrupt chains the next packet while events remain.
+ *   Decode with Controller/tools/trace_decode.py.
+ *
+ * Packet format (little-endian):
+ *   0xA5 0x5A | seq u8 | count u8 | dropped u16 |
+ *   count x (event u8, cycles u32) | checksum u8
+ *   event: bit 7 set on exit, bits 0-6 trace id
+ *   dropped: events lost to a full ring so far (wraps at 16 bits)
+ *   checksum: XOR of every byte after the sync word
+ *
+ * Build with TRACE_ENABLE=0 to compile the macros out.
+ *
+ ******************************************************************************
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+/* Ring size in events (power of two, 8 bytes each) */
+#define TRACE_BUFFER_SIZE 256U
+
+/* Events per packet (5 bytes each plus 7 bytes framing) */
+#define TRACE_PACKET_EVENTS 64U
+
+#define TRACE_UART_BAUD 921600U
+
+/* NVIC priority (0 = highest, 15 = lowest): below everything traced */
+#define TRACE_IRQ_PRIORITY 3U
+
+#define TRACE_SYNC_0 0xA5U
+#define TRACE_SYNC_1 0x5AU
+#define TRACE_EVENT_EXIT 0x80U
+
+/**
+ * @brief  Traced code (names in trace_decode.py follow this order)
+ */
+typedef enum {
+  TRACE_ID_CONTROL_LOOP_ISR = 0, /* TIM4 update interrupt */
+  TRACE_ID_DRIVE_UPDATE,         /* DifferentialDrive_Update() */
+  TRACE_ID_IMU_UPDATE,           /* IMU_Update() */
+  TRACE_ID_ENCODER_LEFT_ISR,     /* Left encoder EXTI / TIM2 */
+  TRACE_ID_ENCODER_RIGHT_ISR,    /* Right encoder EXTI / TIM1 */
+  TRACE_ID_IMU_I2C_ISR,          /* I2C1 event / error */
+  TRACE_ID_IMU_DMA_ISR,          /* DMA1 channel 7 (IMU burst) */
+  TRACE_ID_ATTITUDE_UPDATE,      /* Attitude_Update() from IMU_Update() */
+  TRACE_ID_ODOMETRY_UPDATE,      /* Odometry_Update() */
+  TRACE_ID_DRIVE_PID,            /* Speed and heading PIDs in the drive */
+  TRACE_ID_COUNT
+} Trace_Id_t;
+
+/**
+ * @brief  Trace statistics
+ */
+typedef struct {
+  uint32_t recorded; /* Events committed to the ring */
+  uint32_t dropped;  /* Events lost to a full ring */
+  uint32_t sent;     /* Events handed to the USART */
+  uint32_t packets;  /* Packets sent */
+} Trace_Stats_t;
+
+#if TRACE_ENABLE
+#define TRACE_ENTER(id) Trace_Record((uint8_t)(id))
+#define TRACE_EXIT(id) Trace_Record((uint8_t)((id) | TRACE_EVENT_EXIT))
+#else
+#define TRACE_ENTER(id) ((void)0)
+#define TRACE_EXIT(id) ((void)0)
+#endif
+
+/**
+ * @brief  Start the DWT cycle counter and configure USART3 TX with DMA
+ */
+void Trace_Init(void);
+
+/**
+ * @brief  Record an event (use TRACE_ENTER / TRACE_EXIT)
+ * @param  event: Trace id, with TRACE_EVENT_EXIT set on exit
+ */
+void Trace_Record(uint8_t event);
+
+/**
+ * @brief  Start sending buffered events if the USART is idle
+ * @note   Call from the main loop; not reentrant with itself
+ */
+void Trace_Flush(void);
+
+/**
+ * @brief  Check whether a packet is being sent
+ * @retval 1 if busy, 0 if idle
+ */
+uint8_t Trace_IsBusy(void);
+
+/**
+ * @brief  Get trace statistics
+ * @param  out: Destination
+ */
+void Trace_GetStats(Trace_Stats_t *out);
+
+/**
+ * @brief  DMA1 channel 2 interrupt handler (USART3 TX complete)
+ */
+void Trace_DMA1_Channel2_Handler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
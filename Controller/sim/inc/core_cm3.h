@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * @file    core_cm3.h
+ * @brief   Host stand-in for the CMSIS Cortex-M3 core header
+ ******************************************************************************
+ *
+ * Included by the Cube device header (stm32f103xb.h) in the host simulator
+ * build. Provides the access qualifiers, core intrinsics, NVIC calls and
+ * DWT/CoreDebug registers the Controller sources use, routed to the
+ * simulator.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_CORE_CM3_H
+#define SIM_CORE_CM3_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* IO access qualifiers */
+#define __I volatile const
+#define __O volatile
+#define __IO volatile
+#define __IM volatile const
+#define __OM volatile
+#define __IOM volatile
+
+/* Compiler helpers */
+#define __STATIC_INLINE static inline
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __WEAK __attribute__((weak))
+
+/* ================ Simulated Core ================ */
+
+void Sim_NVIC_EnableIRQ(int32_t irqn);
+void Sim_NVIC_DisableIRQ(int32_t irqn);
+void Sim_NVIC_SetPriority(int32_t irqn, uint32_t priority);
+void Sim_SetPrimask(uint32_t primask);
+uint32_t Sim_GetPrimask(void);
+
+#define NVIC_EnableIRQ(irqn) Sim_NVIC_EnableIRQ((int32_t)(irqn))
+#define NVIC_DisableIRQ(irqn) Sim_NVIC_DisableIRQ((int32_t)(irqn))
+#define NVIC_SetPriority(irqn, prio)                                           \
+  Sim_NVIC_SetPriority((int32_t)(irqn), (uint32_t)(prio))
+
+#define __disable_irq() Sim_SetPrimask(1U)
+#define __enable_irq() Sim_SetPrimask(0U)
+#define __get_PRIMASK() Sim_GetPrimask()
+#define __set_PRIMASK(x) Sim_SetPrimask(x)
+#define __NOP() ((void)0)
+#define __DSB() ((void)0)
+#define __ISB() ((void)0)
+#define __DMB() ((void)0)
+#define __WFI() ((void)0)
+
+/* Exclusive access: handlers run to completion between firmware calls, so
+ * nothing can intervene between a load and store and the store succeeds */
+__STATIC_INLINE uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+
+__STATIC_INLINE uint32_t __STREXW(uint32_t value, volatile uint32_t *addr) {
+  *addr = value;
+  return 0U;
+}
+
+#define __CLREX() ((void)0)
+
+/* ================ Debug / Trace ================ */
+
+/* DWT cycle counter; the board keeps CYCCNT in step with simulated time */
+typedef struct {
+  __IOM uint32_t CTRL;
+  __IOM uint32_t CYCCNT;
+  __IOM uint32_t CPICNT;
+  __IOM uint32_t EXCCNT;
+  __IOM uint32_t SLEEPCNT;
+  __IOM uint32_t LSUCNT;
+  __IOM uint32_t FOLDCNT;
+  __IM uint32_t PCSR;
+} DWT_Type;
+
+typedef struct {
+  __IOM uint32_t DHCSR;
+  __OM uint32_t DCRSR;
+  __IOM uint32_t DCRDR;
+  __IOM uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+extern DWT_Type Sim_DWT;
+extern CoreDebug_Type Sim_CoreDebug;
+
+#define DWT (&Sim_DWT)
+#define CoreDebug (&Sim_CoreDebug)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_CORE_CM3_H */
@@ -0,0 +1,102 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench.h
+ * @brief   Simulator options and the module benches
+ ******************************************************************************
+ *
+ * Each --bench-X option runs one Sim_Bench_X() in place of the closed-loop
+ * drive run. A bench prints its measurements as key=value lines and returns
+ * EXIT_FAILURE when a check fails, so ctest runs them all (CMakeLists.txt).
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_BENCH_H
+#define SIM_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "autotune.h"
+#include "imu.h"
+#include "pid.h"
+#include <stdint.h>
+
+/* ================ Defines ================ */
+
+#define RAD_TO_DEG 57.29577951
+
+/* Main loop wake-up interval while command bytes arrive (the firmware
+ * wakes on each tick and on the ring's half/full/idle interrupts) */
+#define PARAM_POLL_STEP 0.001
+
+/* ================ Types ================ */
+
+/**
+ * @brief  Command line options
+ */
+typedef struct {
+  double duration;     /* Simulated seconds */
+  double rate_hz;      /* Control loop rate */
+  float target_speed;  /* counts/s */
+  float speed_gains[3];
+  float heading_gains[3];
+  uint8_t speed_gains_set;
+  uint8_t heading_gains_set;
+  float profile[2];     /* Drive max accel, max jerk */
+  float feedforward[3]; /* Drive Kv, Ks, Ka */
+  PID_GainPoint_t schedule[PID_SCHEDULE_MAX_POINTS]; /* Speed gain schedule */
+  uint8_t schedule_count;
+  uint8_t profile_set;
+  uint8_t feedforward_set;
+  Autotune_Rule_t autotune_rule;
+  uint8_t autotune; /* Relay-tune the PIDs before the step */
+  uint32_t seed;
+  const char *csv_path;
+  const char *trace_path;
+  const char *commands_path; /* Sent to the parameter server at the step */
+  const char *flash_path;    /* Flash image kept between runs */
+  float imu_temp;            /* MPU6050 die temperature (C) */
+  uint8_t imu_temp_set;
+  const char *attitude_log; /* Recorded samples for --bench-attitude */
+  IMU_Mode_t imu_mode;
+  double i2c_glitch; /* Bus hold start time, < 0 for none */
+} Sim_Options_t;
+
+/* ================ Function Prototypes ================ */
+
+/* Benches (sim_bench_*.c): EXIT_SUCCESS or EXIT_FAILURE */
+int Sim_Bench_Pid(const Sim_Options_t *opt);
+int Sim_Bench_Encoder(const Sim_Options_t *opt);
+int Sim_Bench_Speed(const Sim_Options_t *opt);
+int Sim_Bench_Imu(const Sim_Options_t *opt);
+int Sim_Bench_Calib(const Sim_Options_t *opt);
+int Sim_Bench_Attitude(const Sim_Options_t *opt);
+int Sim_Bench_Odometry(const Sim_Options_t *opt);
+int Sim_Bench_Profile(const Sim_Options_t *opt);
+int Sim_Bench_Autotune(const Sim_Options_t *opt);
+int Sim_Bench_Telemetry(const Sim_Options_t *opt);
+int Sim_Bench_Params(const Sim_Options_t *opt);
+int Sim_Bench_Eeprom(const Sim_Options_t *opt);
+int Sim_Bench_Motor(const Sim_Options_t *opt);
+int Sim_Bench_Loop(const Sim_Options_t *opt);
+
+/* Shared helpers (sim_bench.c) */
+void Sim_Bench_InitBoard(uint32_t seed);
+int Sim_Bench_Result(const char *name, uint32_t failures);
+double Sim_WallTime(void);
+uint32_t Sim_XorShift(uint32_t *state);
+double Sim_WrapDegrees(double angle);
+const char *Sim_CalibStatusName(IMU_CalibStatus_t status);
+
+/* USART3 stream: the trace dump, or telemetry in controller_sim_telemetry */
+void Sim_StreamInit(void);
+void Sim_StreamFlush(void);
+uint8_t Sim_StreamIsBusy(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_BENCH_H */
@@ -0,0 +1,118 @@
+/**
+ ******************************************************************************
+ * @file    sim_board.h
+ * @brief   Simulated robot board: wires the plant to the MCU pins
+ ******************************************************************************
+ *
+ * Connections (same as the real robot):
+ *   - TIM3 CH1/CH2 duty + PA4/PA5, PB0/PB1 -> left/right H-bridge (the
+ *     plant sees the average: PWM frequency and ripple are not modelled)
+ *   - Wheel encoders, wired for the backend the firmware selected:
+ *       timer mode: left PA0/PA1 (TIM2), right PA8/PA9 (TIM1)
+ *       EXTI mode:  left PA1/PA2, right PB8/PB9
+ *   - MPU6050 on I2C1, z axis = body yaw
+ *   - SysTick every 1ms
+ *   - TIM2/TIM3/TIM4 update interrupts at their PSC/ARR period (unless in
+ *     encoder mode)
+ *   - DWT->CYCCNT tracks simulated time at SYSCLK
+ *
+ * Time advances in fixed physics steps. Encoder edges are emitted one at a
+ * time so the EXTI handlers and timer encoder inputs see every transition.
+ * I2C1 transfers consume simulated time at the configured bus clock.
+ * Firmware computation costs modelled cycles: irq_cycles for every
+ * interrupt handler, plus what the caller spends with Sim_Board_Spend().
+ * Cycle counts are those of the model, not of a Cortex-M3; handlers run to
+ * completion, so a handler never preempts another.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_BOARD_H
+#define SIM_BOARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sim_mpu6050.h"
+#include "sim_plant.h"
+#include <stdint.h>
+
+/**
+ * @brief  Board configuration
+ */
+typedef struct {
+  Plant_Config_t plant;
+  Sim_MPU6050_Config_t imu;
+  float physics_hz;    /* Physics step rate */
+  uint32_t irq_cycles; /* Modelled CPU cycles per interrupt handler */
+} Sim_Board_Config_t;
+
+/**
+ * @brief  Fill in default board configuration
+ */
+void Sim_Board_DefaultConfig(Sim_Board_Config_t *config);
+
+/**
+ * @brief  Reset peripherals, plant and sensors
+ */
+void Sim_Board_Init(const Sim_Board_Config_t *config);
+
+/**
+ * @brief  Advance simulated time, running physics and interrupts
+ * @param  seconds: Time to advance
+ */
+void Sim_Board_Advance(double seconds);
+
+/**
+ * @brief  Get simulated time in seconds
+ */
+double Sim_Board_GetTime(void);
+
+/**
+ * @brief  Spend CPU cycles on firmware computation: the clock and
+ *         DWT->CYCCNT move on, and events due meanwhile run late, when the
+ *         CPU is free again
+ * @param  cycles: SYSCLK cycles
+ */
+void Sim_Board_Spend(uint32_t cycles);
+
+/**
+ * @brief  Get plant (ground truth) state
+ */
+const Plant_t *Sim_Board_GetPlant(void);
+
+/**
+ * @brief  Get the H-bridge inputs the firmware is currently driving
+ */
+void Sim_Board_GetBridges(Plant_Bridge_t *left, Plant_Bridge_t *right);
+
+/**
+ * @brief  Spin the wheels at fixed rates, ignoring the motors
+ * @param  enable: 1 to override the motor model, 0 to release
+ * @param  left_omega: Left wheel rate (rad/s)
+ * @param  right_omega: Right wheel rate (rad/s)
+ */
+void Sim_Board_SpinWheels(uint8_t enable, float left_omega,
+                          float right_omega);
+
+/**
+ * @brief  Turn the body at a fixed yaw rate, ignoring the wheels
+ * @param  enable: 1 to override the plant heading, 0 to release
+ * @param  yaw_rate: Yaw rate (rad/s, CCW positive)
+ * @note   Combine with Sim_Board_SpinWheels() to keep the wheels still
+ */
+void Sim_Board_RotateBody(uint8_t enable, float yaw_rate);
+
+/**
+ * @brief  Get the encoder positions the board has signalled (ground truth)
+ * @param  left: Left wheel edges
+ * @param  right: Right wheel edges
+ */
+void Sim_Board_GetEncoderEdges(int64_t *left, int64_t *right);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_BOARD_H */
@@ -0,0 +1,86 @@
+/**
+ ******************************************************************************
+ * @file    sim_mpu6050.h
+ * @brief   Simulated MPU6050 on the I2C1 bus
+ ******************************************************************************
+ *
+ * Register-level model of the parts of the MPU6050 the firmware uses:
+ *   - Register file with auto-incrementing pointer (burst reads/writes)
+ *   - WHO_AM_I, sleep bit and DEVICE_RESET in PWR_MGMT_1
+ *   - Sample clock from SMPLRT_DIV and DLPF_CFG (8kHz when DLPF is off)
+ *   - FS_SEL / AFS_SEL scaling of gyro and accel outputs
+ *   - 1024-byte FIFO fed per FIFO_EN at the sample rate, FIFO_COUNT,
+ *     FIFO_R_W, FIFO_RESET and the overflow flag in INT_STATUS
+ *     (cleared by reading)
+ *   - Gyro bias (constant, plus a temperature coefficient away from 25 C)
+ *     and white Gaussian noise (deterministic seed)
+ *   - TEMP_OUT at a fixed die temperature
+ *   - DATA_RDY in INT_STATUS (with INT_ENABLE.DATA_RDY_EN) on each sample
+ *
+ * The sensor holds its output registers between samples like the real part.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_MPU6050_H
+#define SIM_MPU6050_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sim_periph.h"
+#include <stdint.h>
+
+/**
+ * @brief  Sensor imperfections
+ */
+typedef struct {
+  float gyro_bias_dps[3];  /* Bias per axis at 25 C (deg/s) */
+  float gyro_tempco_dps;   /* Bias change per degree C, every axis */
+  float gyro_noise_dps;    /* Noise standard deviation per sample (deg/s) */
+  float accel_noise_g;     /* Noise standard deviation per sample (g) */
+  float temperature_c;     /* Die temperature */
+  uint32_t seed;           /* Noise generator seed */
+} Sim_MPU6050_Config_t;
+
+/**
+ * @brief  Reset the model and attach it to I2C1
+ * @param  config: Sensor imperfections
+ */
+void Sim_MPU6050_Init(const Sim_MPU6050_Config_t *config);
+
+/**
+ * @brief  Advance the sensor to time t with the true body motion
+ * @param  t: Simulation time in seconds
+ * @param  gyro_dps: True angular rate (x, y, z) in deg/s
+ * @param  accel_g: True specific force (x, y, z) in g
+ */
+void Sim_MPU6050_Step(double t, const float gyro_dps[3], const float accel_g[3]);
+
+/**
+ * @brief  Get the current output data rate
+ * @retval Samples per second (0 while sleeping)
+ */
+float Sim_MPU6050_GetSampleRate(void);
+
+/**
+ * @brief  Get number of samples produced since init
+ */
+uint32_t Sim_MPU6050_GetSampleCount(void);
+
+/**
+ * @brief  Add a gyro Z rate the plant does not see (the robot handled)
+ * @param  start: Simulation time in seconds
+ * @param  duration: Seconds
+ * @param  amplitude_dps: Rate in deg/s
+ * @param  freq_hz: Sine frequency, 0 for a constant rate
+ */
+void Sim_MPU6050_SetDisturbance(double start, double duration,
+                                float amplitude_dps, float freq_hz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_MPU6050_H */
@@ -0,0 +1,267 @@
+/**
+ ******************************************************************************
+ * @file    sim_periph.h
+ * @brief   Simulated STM32F103 register layer for the host build
+ ******************************************************************************
+ *
+ * Peripherals live in a RAM image (Sim_PeriphMem). Most registers are plain
+ * memory; the ones with access side effects are modelled here:
+ *   - NVIC enable/pending state and interrupt dispatch
+ *   - EXTI edge detection on GPIO input changes
+ *   - I2C1 master (SB/ADDR/TXE/RXNE sequencing, event/error interrupts,
+ *     DMA receive) with one attached slave, timed from the CCR/CR2 setup
+ *   - DMA1 channels (single, circular, HT/TC/TE flags and interrupts)
+ *   - Timer encoder interface (mode 3) clocked from the CH1/CH2 inputs
+ *   - USART3 transmitter and receiver with DMA, timed from BRR
+ *   - CRC calculation unit
+ *   - Flash program/erase controller over a RAM image of the main flash
+ *   - GPIO BSRR/BRR (set/reset ODR bits; read as 0)
+ *
+ * Interrupts are delivered synchronously by the simulator between firmware
+ * calls. Write-1-to-clear pending bits (EXTI->PR) are cleared by the
+ * simulator after the handler returns; timer SR flags written through
+ * WRITE_REG behave as rc_w0.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_PERIPH_H
+#define SIM_PERIPH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f1xx.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief  I2C slave device attached to a simulated bus
+ */
+typedef struct {
+  uint8_t address; /* 7-bit address */
+  void *ctx;       /* Device state */
+
+  void (*start)(void *ctx, uint8_t read); /* (Repeated) START + address ACK */
+  void (*write)(void *ctx, uint8_t data); /* Byte written by the master */
+  uint8_t (*read)(void *ctx);             /* Byte requested by the master */
+  void (*stop)(void *ctx);                /* STOP condition */
+} Sim_I2C_Slave_t;
+
+/**
+ * @brief  Flash operation counts since the chip was blank
+ */
+typedef struct {
+  uint32_t programs;        /* Halfwords programmed */
+  uint32_t erases;          /* Pages erased */
+  uint32_t max_page_erases; /* Erases of the most worn page */
+  uint32_t errors;          /* PGERR / WRPRTERR raised */
+  double busy_time;         /* Seconds the CPU stalled */
+} Sim_Flash_Stats_t;
+
+/**
+ * @brief  Register accesses made through READ_REG/WRITE_REG, per bus
+ */
+typedef struct {
+  uint32_t apb1_reads;
+  uint32_t apb1_writes;
+  uint32_t apb2_reads;
+  uint32_t apb2_writes;
+  uint32_t ahb_reads;
+  uint32_t ahb_writes;
+} Sim_Bus_Stats_t;
+
+/**
+ * @brief  Reset all peripheral registers and interrupt state
+ */
+void Sim_Periph_Reset(void);
+
+/**
+ * @brief  Attach a slave device to I2C1
+ * @param  slave: Device descriptor (must outlive the simulation)
+ */
+void Sim_I2C1_Attach(const Sim_I2C_Slave_t *slave);
+
+/**
+ * @brief  Hold the I2C1 bus (no operation completes) or release it
+ */
+void Sim_I2C1_SetStuck(uint8_t hold);
+
+/**
+ * @brief  Write bytes transmitted on USART3 to a file
+ * @param  file: Destination, or NULL to discard
+ */
+void Sim_USART3_SetOutput(FILE *file);
+
+/**
+ * @brief  Bytes transmitted on USART3 since reset
+ */
+uint32_t Sim_USART3_BytesSent(void);
+
+/**
+ * @brief  Queue bytes to arrive on USART3 RX, back to back at the baud rate
+ * @param  data: Bytes
+ * @param  length: Number of bytes
+ * @retval Bytes queued (fewer if the queue is full)
+ */
+uint32_t Sim_USART3_Receive(const uint8_t *data, uint32_t length);
+
+/**
+ * @brief  Bytes queued on USART3 RX that have not arrived yet
+ */
+uint32_t Sim_USART3_RxQueued(void);
+
+/**
+ * @brief  Bytes arrived on USART3 RX since reset
+ */
+uint32_t Sim_USART3_BytesReceived(void);
+
+/**
+ * @brief  Blank the flash (all 0xFF) and clear its statistics
+ */
+void Sim_Flash_Erase(void);
+
+/**
+ * @brief  Load the flash contents (SIM_FLASH_SIZE bytes) from a file
+ * @retval 0 on success, -1 if the file is short
+ */
+int8_t Sim_Flash_Load(FILE *file);
+
+/**
+ * @brief  Save the flash contents to a file
+ * @retval 0 on success, -1 on a write error
+ */
+int8_t Sim_Flash_Save(FILE *file);
+
+/**
+ * @brief  Fail the power during a later program or erase; the flash stays
+ *         unpowered until Sim_Flash_Reset() / Sim_Periph_Reset()
+ * @param  operations: Operations that still complete before it
+ * @param  seed: Random seed for what the cut operation leaves behind
+ */
+void Sim_Flash_CutPower(uint32_t operations, uint32_t seed);
+
+/**
+ * @brief  Check whether the power failed since the last reset
+ */
+uint8_t Sim_Flash_PowerLost(void);
+
+/**
+ * @brief  Operation counts and busy time since the flash was blank
+ */
+void Sim_Flash_GetStats(Sim_Flash_Stats_t *out);
+
+/**
+ * @brief  Register accesses since the last reset (or clear)
+ */
+void Sim_Periph_GetBusStats(Sim_Bus_Stats_t *out);
+
+/**
+ * @brief  Clear the register access counts
+ */
+void Sim_Periph_ClearBusStats(void);
+
+/**
+ * @brief  Connect the simulation clock
+ * @param  now: Returns the current CPU time in seconds
+ * @param  wait: Burns CPU time (polling); runs due events when called
+ *               outside an interrupt handler
+ */
+void Sim_Periph_SetClock(double (*now)(void), void (*wait)(double seconds));
+
+/**
+ * @brief  Set the modelled CPU cost of each interrupt handler (entry, body
+ *         and exit), charged as the handler returns
+ * @param  cycles: SYSCLK cycles per handler (0 = free)
+ * @param  spend: Moves the CPU clock on by that many cycles
+ */
+void Sim_Periph_SetIRQCost(uint32_t cycles, void (*spend)(uint32_t cycles));
+
+/**
+ * @brief  Time of the next peripheral event in seconds (INFINITY if none)
+ */
+double Sim_Periph_NextEventTime(void);
+
+/**
+ * @brief  Complete peripheral events that are due
+ */
+void Sim_Periph_Service(void);
+
+/**
+ * @brief  Drive a GPIO input pin level (updates IDR, fires EXTI if armed)
+ * @param  port: GPIO port (GPIOA, GPIOB, ...)
+ * @param  pin: Pin number 0-15
+ * @param  level: 0 or 1
+ */
+void Sim_GPIO_SetInput(GPIO_TypeDef *port, uint8_t pin, uint8_t level);
+
+/**
+ * @brief  Read a GPIO output pin level (ODR)
+ */
+uint8_t Sim_GPIO_GetOutput(GPIO_TypeDef *port, uint8_t pin);
+
+/**
+ * @brief  Mark an interrupt pending and dispatch it if enabled
+ * @param  irqn: Device IRQ number, or SysTick_IRQn
+ */
+void Sim_RaiseIRQ(int32_t irqn);
+
+/**
+ * @brief  Check whether an interrupt is enabled in the NVIC
+ */
+uint8_t Sim_IRQEnabled(int32_t irqn);
+
+/**
+ * @brief  Number of times an interrupt handler has run since reset
+ */
+uint32_t Sim_IRQCount(int32_t irqn);
+
+/* ================ Model Internals ================ */
+
+double Sim_Now(void);
+void Sim_Wait(double seconds);
+
+void Sim_I2C1_Reset(void);
+uint32_t Sim_I2C1_Read(uintptr_t offset);
+void Sim_I2C1_Write(uintptr_t offset, uint32_t value);
+double Sim_I2C1_NextEventTime(void);
+void Sim_I2C1_Service(void);
+
+void Sim_TIM_InputChanged(GPIO_TypeDef *port, uint8_t pin, uint8_t level);
+
+void Sim_USART3_Reset(void);
+void Sim_USART3_WriteDR(uint32_t value);
+uint32_t Sim_USART3_ReadDR(void);
+double Sim_USART3_NextEventTime(void);
+void Sim_USART3_Service(void);
+
+void Sim_CRC_Reset(void);
+void Sim_CRC_WriteDR(uint32_t value);
+void Sim_CRC_WriteCR(uint32_t value);
+
+void Sim_Flash_Reset(void);
+uint32_t Sim_Flash_ReadSR(void);
+void Sim_Flash_WriteSR(uint32_t value);
+void Sim_Flash_WriteKEYR(uint32_t value);
+void Sim_Flash_WriteCR(uint32_t value);
+
+void Sim_DMA_Reset(void);
+uint8_t Sim_DMA_Write(volatile uint32_t *reg, uint32_t value);
+
+/**
+ * @brief  Peripheral DMA request: move one data item on a DMA1 channel
+ * @param  channel: DMA1 channel 1-7
+ */
+void Sim_DMA_Request(uint8_t channel);
+
+/**
+ * @brief  Items moved since the channel was enabled (or last wrapped)
+ */
+uint32_t Sim_DMA_Moved(uint8_t channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_PERIPH_H */
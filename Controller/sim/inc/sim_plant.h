@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * @file    sim_plant.h
+ * @brief   Two-wheel differential drive plant model
+ ******************************************************************************
+ *
+ * Each wheel is a brushed DC motor behind an H-bridge:
+ *   i = (V - Ke * w) / R              (electrical time constant neglected)
+ *   J * dw/dt = Kt * i - b * w - Tc * sign(w)
+ *
+ * H-bridge truth table (IN1, IN2):
+ *   1, 0 -> +duty * Vbat      0, 1 -> -duty * Vbat
+ *   0, 0 -> brake (V = 0)     1, 1 -> coast (i = 0)
+ *
+ * Body kinematics (unicycle, no slip), yaw positive counter-clockwise:
+ *   v = r * (wL + wR) / 2     yaw_rate = r * (wR - wL) / track
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_PLANT_H
+#define SIM_PLANT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief  Physical parameters
+ */
+typedef struct {
+  float battery_v;    /* Supply voltage (V) */
+  float resistance;   /* Armature resistance (ohm) */
+  float ke;           /* Back-EMF constant at the wheel (V.s/rad) */
+  float kt;           /* Torque constant at the wheel (N.m/A) */
+  float inertia;      /* Wheel + rotor inertia at the wheel (kg.m^2) */
+  float viscous;      /* Viscous friction (N.m.s/rad) */
+  float coulomb;      /* Coulomb friction (N.m) */
+  float right_gain;   /* Right motor torque mismatch (1.0 = matched) */
+  float wheel_radius; /* Wheel radius (m) */
+  float track_width;  /* Distance between wheels (m) */
+} Plant_Config_t;
+
+/**
+ * @brief  H-bridge inputs for one motor
+ */
+typedef struct {
+  uint8_t in1;
+  uint8_t in2;
+  float duty; /* PWM duty 0.0 - 1.0 */
+} Plant_Bridge_t;
+
+/**
+ * @brief  Wheel state
+ */
+typedef struct {
+  float omega; /* Angular rate (rad/s) */
+  double angle; /* Accumulated angle (rad) */
+} Plant_Wheel_t;
+
+/**
+ * @brief  Robot state
+ */
+typedef struct {
+  Plant_Config_t config;
+  Plant_Wheel_t left;
+  Plant_Wheel_t right;
+
+  double x, y;    /* Position (m) */
+  double theta;   /* Heading (rad, CCW positive) */
+  float v;        /* Forward speed (m/s) */
+  float yaw_rate; /* Yaw rate (rad/s) */
+  float accel;    /* Forward acceleration (m/s^2) */
+} Plant_t;
+
+/**
+ * @brief  Fill in default parameters (small 65mm-wheel robot, 2S battery)
+ */
+void Plant_DefaultConfig(Plant_Config_t *config);
+
+/**
+ * @brief  Reset the robot to rest at the origin, heading along +x
+ */
+void Plant_Init(Plant_t *plant, const Plant_Config_t *config);
+
+/**
+ * @brief  Advance one wheel
+ * @param  config: Physical parameters
+ * @param  wheel: Wheel state
+ * @param  bridge: H-bridge inputs
+ * @param  gain: Torque scale (motor mismatch)
+ * @param  dt: Step in seconds
+ */
+void Plant_WheelStep(const Plant_Config_t *config, Plant_Wheel_t *wheel,
+                     const Plant_Bridge_t *bridge, float gain, float dt);
+
+/**
+ * @brief  Advance the robot
+ * @param  plant: Robot state
+ * @param  left: Left H-bridge inputs
+ * @param  right: Right H-bridge inputs
+ * @param  dt: Step in seconds
+ */
+void Plant_Step(Plant_t *plant, const Plant_Bridge_t *left,
+                const Plant_Bridge_t *right, float dt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_PLANT_H */
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * @file    stm32f1xx.h
+ * @brief   Host stand-in for the STM32F1xx device family header
+ ******************************************************************************
+ *
+ * Pulls in the real Cube device header for register layouts and bit
+ * definitions, then relocates the peripheral address space into a RAM
+ * image owned by the simulator. All peripheral instance macros (GPIOA,
+ * TIM3, I2C1, ...) expand through PERIPH_BASE at the point of use, so the
+ * Controller sources compile unchanged. FLASH_BASE moves the same way to a
+ * RAM image of the main flash.
+ *
+ * Register accesses made through the CMSIS helper macros (READ_REG,
+ * WRITE_REG, SET_BIT, ...) are routed to Sim_ReadReg/Sim_WriteReg so that
+ * peripherals with side effects on access (I2C status flags, data register)
+ * can be modelled. Plain `->` accesses hit the RAM image directly.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_STM32F1XX_H
+#define SIM_STM32F1XX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "stm32f103xb.h"
+
+/* ================ Simulated Address Space ================ */
+
+/* Covers APB1, APB2 and AHB peripherals (0x40000000 - 0x40023FFF) */
+#define SIM_PERIPH_SIZE 0x24000UL
+
+extern uint32_t Sim_PeriphMem[SIM_PERIPH_SIZE / 4];
+
+#undef PERIPH_BASE
+#define PERIPH_BASE ((uintptr_t)Sim_PeriphMem)
+
+/* Main flash (64KB, STM32F103x8), programmed through the FLASH registers */
+#define SIM_FLASH_SIZE 0x10000UL
+
+extern uint32_t Sim_FlashMem[SIM_FLASH_SIZE / 4];
+
+#undef FLASH_BASE
+#define FLASH_BASE ((uintptr_t)Sim_FlashMem)
+
+uint32_t Sim_ReadReg(volatile uint32_t *reg);
+void Sim_WriteReg(volatile uint32_t *reg, uint32_t value);
+
+/* ================ Register Access Helpers ================ */
+
+#define READ_REG(REG) Sim_ReadReg(&(REG))
+#define WRITE_REG(REG, VAL) Sim_WriteReg(&(REG), (uint32_t)(VAL))
+#define SET_BIT(REG, BIT) WRITE_REG((REG), READ_REG(REG) | (uint32_t)(BIT))
+#define CLEAR_BIT(REG, BIT) WRITE_REG((REG), READ_REG(REG) & ~(uint32_t)(BIT))
+#define READ_BIT(REG, BIT) (READ_REG(REG) & (uint32_t)(BIT))
+#define CLEAR_REG(REG) WRITE_REG((REG), 0x0U)
+#define MODIFY_REG(REG, CLEARMASK, SETMASK)                                    \
+  WRITE_REG((REG), (((READ_REG(REG)) & (~(uint32_t)(CLEARMASK))) |            \
+                    (uint32_t)(SETMASK)))
+#define POSITION_VAL(VAL) (__builtin_ctz(VAL))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_STM32F1XX_H */
@@ -0,0 +1,36 @@
+/**
+ ******************************************************************************
+ * @file    stm32f1xx_hal.h
+ * @brief   Host stand-in for the STM32F1xx HAL header
+ ******************************************************************************
+ *
+ * The Controller sources only use the HAL for start-up (HAL_Init and the
+ * SysTick tick). The simulator provides the tick; nothing else is needed.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_STM32F1XX_HAL_H
+#define SIM_STM32F1XX_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32f1xx.h"
+
+typedef enum {
+  HAL_OK = 0x00U,
+  HAL_ERROR = 0x01U,
+  HAL_BUSY = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_STM32F1XX_HAL_H */
@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench.c
+ * @brief   Helpers shared by the drive run and the benches
+ ******************************************************************************
+ */
+
+#include "sim_bench.h"
+#include "sim_board.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset the board to its default configuration
+ * @param  seed: IMU noise seed
+ */
+void Sim_Bench_InitBoard(uint32_t seed) {
+  Sim_Board_Config_t config;
+  Sim_Board_DefaultConfig(&config);
+  config.imu.seed = seed;
+  Sim_Board_Init(&config);
+}
+
+/**
+ * @brief  Print the failure count of a bench
+ * @retval EXIT_SUCCESS if no check failed, EXIT_FAILURE otherwise
+ */
+int Sim_Bench_Result(const char *name, uint32_t failures) {
+  printf("%s_failures=%u\n", name, failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief  Wall clock in seconds
+ */
+double Sim_WallTime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief  xorshift32 step
+ */
+uint32_t Sim_XorShift(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/**
+ * @brief  Wrap an angle to -180..180 degrees
+ */
+double Sim_WrapDegrees(double angle) {
+  angle = fmod(angle + 180.0, 360.0);
+  return (angle < 0.0 ? angle + 360.0 : angle) - 180.0;
+}
+
+/**
+ * @brief  Name of an IMU_Calibrate() status
+ */
+const char *Sim_CalibStatusName(IMU_CalibStatus_t status) {
+  static const char *const names[] = {"ok", "motion", "timeout",
+                                      "bus_error"};
+  return (status <= IMU_CALIB_BUS_ERROR) ? names[status] : "?";
+}
+
+/**
+ * @brief  Start the USART3 stream (same choice as main.c)
+ */
+void Sim_StreamInit(void) {
+#if TELEMETRY_ENABLE
+  Telemetry_Init();
+#else
+  Trace_Init();
+#endif
+}
+
+/**
+ * @brief  Main loop background work for the stream
+ */
+void Sim_StreamFlush(void) {
+#if !TELEMETRY_ENABLE
+  Trace_Flush();
+#endif
+}
+
+/**
+ * @brief  Check whether the stream is sending
+ */
+uint8_t Sim_StreamIsBusy(void) {
+#if TELEMETRY_ENABLE
+  return Telemetry_IsBusy();
+#else
+  return Trace_IsBusy();
+#endif
+}
@@ -0,0 +1,361 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_attitude.c
+ * @brief   Attitude filter bench (--bench-attitude)
+ ******************************************************************************
+ */
+
+#include "attitude.h"
+#include "main.h"
+#include "sim_bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-attitude: raw sensor scale, truth substeps, timing repeats */
+#define GYRO_LSB_PER_DPS 131.0
+#define ACCEL_LSB_PER_G 16384.0
+#define ATTITUDE_SUBSTEPS 10
+#define ATTITUDE_TIMING_PASSES 200
+
+/* --bench-attitude tolerances per filter: RMS and largest error on each
+ * axis, yaw drift (no magnetometer: yaw error grows by up to the drift
+ * rate over the run) */
+#define ATTITUDE_MAX_RMS_DEG 1.0
+#define ATTITUDE_MAX_ERROR_DEG 2.5
+#define ATTITUDE_MAX_DRIFT_DPS 0.1
+
+/* ================ Private Types ================ */
+
+/* --bench-attitude sample: raw sensor data plus reference angles */
+typedef struct {
+  int16_t gyro[3];
+  int16_t accel[3];
+  float ref[3]; /* Roll, pitch, yaw in degrees */
+} AttitudeSample_t;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Quaternion product a (x) b (w, x, y, z)
+ */
+static void QuatMultiply(const double a[4], const double b[4], double out[4]) {
+  double w = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  double x = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  double y = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  double z = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+  out[0] = w;
+  out[1] = x;
+  out[2] = y;
+  out[3] = z;
+}
+
+/**
+ * @brief  Z-Y-X Euler angles in degrees from a body-to-world quaternion
+ */
+static void QuatToEuler(const double q[4], float euler[3]) {
+  double w = q[0], x = q[1], y = q[2], z = q[3];
+  double sin_pitch = fmax(-1.0, fmin(1.0, 2.0 * (w * y - z * x)));
+  euler[0] = (float)(atan2(2.0 * (w * x + y * z), 1.0 - 2.0 * (x * x + y * y)) *
+                     RAD_TO_DEG);
+  euler[1] = (float)(asin(sin_pitch) * RAD_TO_DEG);
+  euler[2] = (float)(atan2(2.0 * (w * z + x * y), 1.0 - 2.0 * (y * y + z * z)) *
+                     RAD_TO_DEG);
+}
+
+static int16_t Saturate16(double value) {
+  return (int16_t)fmax(-32768.0, fmin(32767.0, round(value)));
+}
+
+/**
+ * @brief  Synthetic recording: tumbling body, biased noisy raw samples
+ *
+ * Body rates are sines on all three axes (about +-14 deg roll, +-18 deg
+ * pitch, +-57 deg yaw). The gyro carries the board's default bias and
+ * noise; the accel sees gravity, noise and a 7Hz 0.05g vibration.
+ */
+static uint32_t SynthesizeAttitude(AttitudeSample_t *out, uint32_t count,
+                                   double period, uint32_t seed) {
+  const double bias[3] = {0.3, -0.2, 0.5};
+  double q[4] = {1.0, 0.0, 0.0, 0.0};
+  uint32_t rng = seed ? seed : 1;
+
+  for (uint32_t n = 0; n < count; n++) {
+    double t = n * period;
+    double rate[3];
+
+    /* Truth: integrate the body rate exactly over small substeps */
+    for (uint32_t k = 0; k < ATTITUDE_SUBSTEPS; k++) {
+      double ts = t + (k + 0.5) * period / ATTITUDE_SUBSTEPS;
+      rate[0] = 60.0 * sin(2.0 * M_PI * 0.7 * ts);
+      rate[1] = 45.0 * sin(2.0 * M_PI * 0.4 * ts + 1.0);
+      rate[2] = 90.0 * sin(2.0 * M_PI * 0.25 * ts + 0.5);
+
+      double norm = sqrt(rate[0] * rate[0] + rate[1] * rate[1] +
+                         rate[2] * rate[2]);
+      double angle = norm / RAD_TO_DEG * period / ATTITUDE_SUBSTEPS;
+      if (norm > 0.0) {
+        double s = sin(0.5 * angle) / norm;
+        double dq[4] = {cos(0.5 * angle), rate[0] * s, rate[1] * s,
+                        rate[2] * s};
+        QuatMultiply(q, dq, q);
+      }
+    }
+    double norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (uint32_t i = 0; i < 4; i++)
+      q[i] /= norm;
+
+    /* World up seen from the body */
+    double up[3] = {2.0 * (q[1] * q[3] - q[0] * q[2]),
+                    2.0 * (q[0] * q[1] + q[2] * q[3]),
+                    1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2])};
+
+    /* Sensor at the end of the sample period */
+    for (uint32_t i = 0; i < 3; i++) {
+      double noise[2];
+      for (uint32_t j = 0; j < 2; j++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        noise[j] = ((double)rng / 4294967296.0 - 0.5) * 3.4641; /* unit var */
+      }
+      double vibration = (i == 2) ? 0.05 * sin(2.0 * M_PI * 7.0 * t) : 0.0;
+      out[n].gyro[i] =
+          Saturate16((rate[i] + bias[i] + 0.05 * noise[0]) * GYRO_LSB_PER_DPS);
+      out[n].accel[i] =
+          Saturate16((up[i] + vibration + 0.004 * noise[1]) * ACCEL_LSB_PER_G);
+    }
+    QuatToEuler(q, out[n].ref);
+  }
+  return count;
+}
+
+/**
+ * @brief  Load a recording: t,gx,gy,gz,ax,ay,az,roll,pitch,yaw per line
+ *         (raw sensor units, reference angles in degrees, header optional)
+ * @retval Samples read; period set from the first and last timestamps
+ */
+static uint32_t LoadAttitudeLog(const char *path, AttitudeSample_t *out,
+                                uint32_t capacity, double *period) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return 0;
+  }
+
+  char line[256];
+  uint32_t count = 0;
+  double t_first = 0.0, t_last = 0.0;
+  while (count < capacity && fgets(line, sizeof(line), file)) {
+    double t;
+    int g[3], a[3];
+    float ref[3];
+    if (sscanf(line, "%lf,%d,%d,%d,%d,%d,%d,%f,%f,%f", &t, &g[0], &g[1],
+               &g[2], &a[0], &a[1], &a[2], &ref[0], &ref[1], &ref[2]) != 10)
+      continue;
+    if (count == 0)
+      t_first = t;
+    t_last = t;
+    for (uint32_t i = 0; i < 3; i++) {
+      out[count].gyro[i] = (int16_t)g[i];
+      out[count].accel[i] = (int16_t)a[i];
+      out[count].ref[i] = ref[i];
+    }
+    count++;
+  }
+  fclose(file);
+
+  if (count > 1)
+    *period = (t_last - t_first) / (count - 1);
+  return count;
+}
+
+/**
+ * @brief  Float Madgwick (IMU form) as the fixed-point reference
+ */
+static void MadgwickFloat(float q[4], const int16_t gyro[3],
+                          const int16_t accel[3], float bias_z, float beta,
+                          float dt) {
+  const float scale = (float)(1.0 / RAD_TO_DEG / GYRO_LSB_PER_DPS);
+  float gx = gyro[0] * scale, gy = gyro[1] * scale;
+  float gz = gyro[2] * scale - bias_z / (float)RAD_TO_DEG;
+  float w = q[0], x = q[1], y = q[2], z = q[3];
+
+  float dw = 0.5f * (-x * gx - y * gy - z * gz);
+  float dx = 0.5f * (w * gx + y * gz - z * gy);
+  float dy = 0.5f * (w * gy - x * gz + z * gx);
+  float dz = 0.5f * (w * gz + x * gy - y * gx);
+
+  float norm = sqrtf((float)accel[0] * accel[0] + (float)accel[1] * accel[1] +
+                     (float)accel[2] * accel[2]);
+  if (norm > 0.0f) {
+    float ax = accel[0] / norm, ay = accel[1] / norm, az = accel[2] / norm;
+    float f1 = 2.0f * (x * z - w * y) - ax;
+    float f2 = 2.0f * (w * x + y * z) - ay;
+    float f3 = 1.0f - 2.0f * (x * x + y * y) - az;
+    float s0 = -2.0f * y * f1 + 2.0f * x * f2;
+    float s1 = 2.0f * z * f1 + 2.0f * w * f2 - 4.0f * x * f3;
+    float s2 = -2.0f * w * f1 + 2.0f * z * f2 - 4.0f * y * f3;
+    float s3 = 2.0f * x * f1 + 2.0f * y * f2;
+    float s_norm = sqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+    if (s_norm > 0.0f) {
+      dw -= beta * s0 / s_norm;
+      dx -= beta * s1 / s_norm;
+      dy -= beta * s2 / s_norm;
+      dz -= beta * s3 / s_norm;
+    }
+  }
+
+  w += dw * dt;
+  x += dx * dt;
+  y += dy * dt;
+  z += dz * dt;
+  float q_norm = sqrtf(w * w + x * x + y * y + z * z);
+  q[0] = w / q_norm;
+  q[1] = x / q_norm;
+  q[2] = y / q_norm;
+  q[3] = z / q_norm;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Attitude filters on a recording: error against the reference
+ *         angles and host time per update
+ *
+ * Synthetic by default (see SynthesizeAttitude); --attitude-log replays a
+ * recording instead. Filters start aligned to the first sample, which is
+ * taken as zero yaw, and know the gyro Z bias (as after IMU_Calibrate).
+ * The float Madgwick shows what the Q30 arithmetic costs in accuracy.
+ * Fails if a filter's heading drifts faster than ATTITUDE_MAX_DRIFT_DPS,
+ * or its RMS or largest error on an axis exceeds the ATTITUDE_MAX_* bound
+ * (for yaw, plus the allowed drift over the run).
+ */
+int Sim_Bench_Attitude(const Sim_Options_t *opt) {
+  const uint32_t capacity = (uint32_t)(opt->duration * opt->rate_hz) + 1;
+  AttitudeSample_t *samples = calloc(capacity, sizeof(*samples));
+  if (samples == NULL)
+    return EXIT_FAILURE;
+
+  double period = 1.0 / opt->rate_hz;
+  uint32_t count;
+  if (opt->attitude_log)
+    count = LoadAttitudeLog(opt->attitude_log, samples, capacity, &period);
+  else
+    count = SynthesizeAttitude(samples, capacity, period, opt->seed);
+  if (count < 2) {
+    fprintf(stderr, "need at least two samples\n");
+    free(samples);
+    return EXIT_FAILURE;
+  }
+
+  const float bias_z = opt->attitude_log ? 0.0f : 0.5f;
+  const float bias[3] = {0.0f, 0.0f, bias_z};
+  static const struct {
+    const char *name;
+    int32_t filter; /* Attitude_Filter_t, -1 for the float reference */
+    float gain;
+  } filters[] = {
+      {"complementary_q30", ATTITUDE_FILTER_COMPLEMENTARY,
+       ATTITUDE_COMPLEMENTARY_TAU},
+      {"madgwick_q30", ATTITUDE_FILTER_MADGWICK, ATTITUDE_MADGWICK_BETA},
+      {"madgwick_float", -1, ATTITUDE_MADGWICK_BETA},
+  };
+
+  static const char *const axes[] = {"roll", "pitch", "yaw"};
+  uint32_t failures = 0;
+
+  printf("samples=%u period_s=%.4f source=%s\n", count, period,
+         opt->attitude_log ? opt->attitude_log : "synthetic");
+
+  for (uint32_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+    Attitude_t att;
+    float q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    double err_sq[3] = {0.0, 0.0, 0.0};
+    double err_max[3] = {0.0, 0.0, 0.0};
+    double yaw_drift = 0.0;
+    float yaw0 = samples[0].ref[2];
+
+    Attitude_Init(&att, filters[f].filter < 0 ? ATTITUDE_FILTER_MADGWICK
+                                              : (Attitude_Filter_t)
+                                                    filters[f].filter,
+                  (float)period, filters[f].gain);
+    Attitude_SetGyroBias(&att, bias);
+
+    for (uint32_t n = 0; n < count; n++) {
+      float euler[3];
+      if (filters[f].filter < 0) {
+        if (n == 0) {
+          /* Same alignment as the fixed-point filters */
+          Attitude_Update(&att, samples[n].gyro, samples[n].accel);
+          Attitude_GetQuaternion(&att, q);
+        }
+        MadgwickFloat(q, samples[n].gyro, samples[n].accel, bias_z,
+                      filters[f].gain, (float)period);
+        double qd[4] = {q[0], q[1], q[2], q[3]};
+        QuatToEuler(qd, euler);
+      } else {
+        Attitude_Update(&att, samples[n].gyro, samples[n].accel);
+        Attitude_GetEuler(&att, &euler[0], &euler[1], &euler[2]);
+      }
+
+      for (uint32_t i = 0; i < 3; i++) {
+        double ref = samples[n].ref[i] - (i == 2 ? yaw0 : 0.0f);
+        double error = Sim_WrapDegrees(euler[i] - ref);
+        if (i == 2 && n + 1 == count)
+          yaw_drift = error;
+        err_sq[i] += error * error;
+        if (fabs(error) > err_max[i])
+          err_max[i] = fabs(error);
+      }
+    }
+
+    /* Host cost: updates only, repeated over the recording */
+    double start = Sim_WallTime();
+    for (uint32_t pass = 0; pass < ATTITUDE_TIMING_PASSES; pass++) {
+      for (uint32_t n = 0; n < count; n++) {
+        if (filters[f].filter < 0)
+          MadgwickFloat(q, samples[n].gyro, samples[n].accel, bias_z,
+                        filters[f].gain, (float)period);
+        else
+          Attitude_Update(&att, samples[n].gyro, samples[n].accel);
+      }
+    }
+    double ns =
+        (Sim_WallTime() - start) * 1e9 / (ATTITUDE_TIMING_PASSES * count);
+
+    const double drift_allowed = ATTITUDE_MAX_DRIFT_DPS * count * period;
+    double rms[3];
+    for (uint32_t i = 0; i < 3; i++)
+      rms[i] = sqrt(err_sq[i] / count);
+
+    printf("filter=%s roll_rms_deg=%.3f pitch_rms_deg=%.3f yaw_rms_deg=%.3f "
+           "roll_max_deg=%.3f pitch_max_deg=%.3f yaw_max_deg=%.3f "
+           "yaw_drift_dps=%.4f ns_per_update=%.1f\n",
+           filters[f].name, rms[0], rms[1], rms[2], err_max[0], err_max[1],
+           err_max[2], yaw_drift / (count * period), ns);
+
+    for (uint32_t i = 0; i < 3; i++) {
+      double allowed = (i == 2) ? drift_allowed : 0.0;
+      if (rms[i] > ATTITUDE_MAX_RMS_DEG + allowed ||
+          err_max[i] > ATTITUDE_MAX_ERROR_DEG + allowed) {
+        printf("filter=%s: %s rms %.3f / max %.3f over %.2f / %.2f deg\n",
+               filters[f].name, axes[i], rms[i], err_max[i],
+               ATTITUDE_MAX_RMS_DEG + allowed,
+               ATTITUDE_MAX_ERROR_DEG + allowed);
+        failures++;
+      }
+    }
+    if (fabs(yaw_drift) > drift_allowed) {
+      printf("filter=%s: yaw drift %.3f over %.3f deg\n", filters[f].name,
+             yaw_drift, drift_allowed);
+      failures++;
+    }
+  }
+
+  free(samples);
+  return Sim_Bench_Result("attitude", failures);
+}
@@ -0,0 +1,207 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_autotune.c
+ * @brief   Relay autotuner bench (--bench-autotune)
+ ******************************************************************************
+ */
+
+#include "autotune.h"
+#include "sim_bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-autotune: plant step (finer than the loop, so switching lands
+ * within 0.1 ms of the ideal), longest plant delay, relay run */
+#define AUTOTUNE_BENCH_DT 1e-4
+#define AUTOTUNE_BENCH_MAX_DELAY 1024U
+#define AUTOTUNE_BENCH_CYCLES 4U
+#define AUTOTUNE_BENCH_TIMEOUT 5.0f
+
+/* --bench-autotune tolerance on Ku and Tu against the exact limit cycle
+ * (one plant step of switching delay, float time accumulation) */
+#define AUTOTUNE_BENCH_MAX_ERROR_PCT 1.0
+
+/* ================ Private Types ================ */
+
+/* --bench-autotune plants: y' = (K u(t - L) - y) / tau, or an integrator
+ * y' = K u(t - L) for tau = 0 */
+typedef struct {
+  const char *name;
+  double gain;  /* K */
+  double tau;   /* s, 0 for an integrator */
+  double delay; /* L, s */
+  float amplitude;
+  float hysteresis;
+} AutotunePlant_t;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Exact relay limit cycle of a plant: half peak-to-peak and period
+ *
+ * Integrator: the output ramps at K*d for L past each switch level +-h, so
+ * a = h + K*d*L and Tu = 4L + 4h/(K*d). First order with h = 0:
+ * a = K*d*(1 - e^(-L/tau)) and Tu = 2*tau*ln(2*e^(L/tau) - 1).
+ */
+static void ExactCycle(const AutotunePlant_t *plant, double *a, double *tu) {
+  const double kd = plant->gain * plant->amplitude;
+
+  if (plant->tau == 0.0) {
+    *a = plant->hysteresis + kd * plant->delay;
+    *tu = 4.0 * plant->delay + 4.0 * plant->hysteresis / kd;
+  } else {
+    *a = kd * (1.0 - exp(-plant->delay / plant->tau));
+    *tu = 2.0 * plant->tau * log(2.0 * exp(plant->delay / plant->tau) - 1.0);
+  }
+}
+
+/**
+ * @brief  Run the relay on a plant until the autotuner finishes
+ * @retval Final status
+ */
+static Autotune_Status_t RunRelay(const AutotunePlant_t *plant,
+                                  Autotune_t *at) {
+  static float queue[AUTOTUNE_BENCH_MAX_DELAY];
+  /* The step the output is held for is the last one of the delay */
+  const uint32_t delay =
+      (uint32_t)lround(plant->delay / AUTOTUNE_BENCH_DT) - 1U;
+  const double decay =
+      plant->tau > 0.0 ? exp(-AUTOTUNE_BENCH_DT / plant->tau) : 1.0;
+  double y = 0.0;
+  uint32_t head = 0;
+
+  for (uint32_t i = 0; i < delay; i++)
+    queue[i] = 0.0f;
+  Autotune_Init(at, plant->amplitude, plant->hysteresis, AUTOTUNE_BENCH_CYCLES,
+                AUTOTUNE_BENCH_TIMEOUT);
+
+  while (Autotune_GetStatus(at) == AUTOTUNE_RUNNING) {
+    float u = Autotune_Update(at, 0.0f, (float)y, (float)AUTOTUNE_BENCH_DT);
+    float applied = u;
+
+    /* Relay output reaches the plant L later */
+    if (delay) {
+      applied = queue[head];
+      queue[head] = u;
+      head = (head + 1U) % delay;
+    }
+    /* Exact step for an input held over AUTOTUNE_BENCH_DT */
+    if (plant->tau > 0.0)
+      y = plant->gain * applied + (y - plant->gain * applied) * decay;
+    else
+      y += plant->gain * applied * AUTOTUNE_BENCH_DT;
+  }
+  return Autotune_GetStatus(at);
+}
+
+/**
+ * @brief  Gains of a rule from Ku and Tu, per the table in autotune.h
+ */
+static void RuleGains(Autotune_Rule_t rule, double ku, double tu,
+                      double gains[3]) {
+  /* Kp/Ku, Ti/Tu, Td/Tu in Autotune_Rule_t order */
+  static const double table[4][3] = {{0.45, 1.0 / 1.2, 0.0},
+                                     {0.6, 1.0 / 2.0, 1.0 / 8.0},
+                                     {1.0 / 3.2, 2.2, 0.0},
+                                     {1.0 / 2.2, 2.2, 1.0 / 6.3}};
+  double kp = table[rule][0] * ku;
+
+  gains[0] = kp;
+  gains[1] = kp / (table[rule][1] * tu);
+  gains[2] = kp * table[rule][2] * tu;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Relay autotuner on plants with an exact limit cycle
+ *
+ * Delayed integrators (with and without hysteresis) and first-order plants
+ * with delay, stepped exactly at AUTOTUNE_BENCH_DT. The measured Ku and Tu
+ * are compared with 4d/(pi*sqrt(a^2 - h^2)) and the period of the exact
+ * limit cycle, and each rule's gains with the table in autotune.h. A relay
+ * whose hysteresis the plant cannot reach must fail by the timeout.
+ *
+ * Fails if Ku or Tu is off by more than AUTOTUNE_BENCH_MAX_ERROR_PCT, a
+ * rule's gains disagree with the table, or the unreachable case does not
+ * fail.
+ */
+int Sim_Bench_Autotune(const Sim_Options_t *opt) {
+  static const AutotunePlant_t plants[] = {
+      {"integrator", 10.0, 0.0, 0.02, 100.0f, 0.0f},
+      {"integrator_hyst", 10.0, 0.0, 0.02, 100.0f, 5.0f},
+      {"first_order", 2.0, 0.05, 0.02, 100.0f, 0.0f},
+      {"first_order_slow", 5.0, 0.2, 0.01, 50.0f, 0.0f},
+  };
+  uint32_t failures = 0;
+
+  (void)opt;
+
+  for (uint32_t p = 0; p < sizeof(plants) / sizeof(plants[0]); p++) {
+    const AutotunePlant_t *plant = &plants[p];
+    Autotune_t at;
+    double a, tu;
+
+    ExactCycle(plant, &a, &tu);
+    double ku = 4.0 * plant->amplitude /
+                (M_PI * sqrt(a * a - plant->hysteresis * plant->hysteresis));
+
+    if (RunRelay(plant, &at) != AUTOTUNE_DONE) {
+      printf("autotune=%s: failed after %.2f s\n", plant->name, at.time);
+      failures++;
+      continue;
+    }
+
+    double ku_error = 100.0 * fabs(at.ku - ku) / ku;
+    double tu_error = 100.0 * fabs(at.tu - tu) / tu;
+    printf("autotune=%s ku=%.4f exact_ku=%.4f tu_s=%.5f exact_tu_s=%.5f "
+           "ku_error_pct=%.3f tu_error_pct=%.3f\n",
+           plant->name, at.ku, ku, at.tu, tu, ku_error, tu_error);
+    if (ku_error > AUTOTUNE_BENCH_MAX_ERROR_PCT ||
+        tu_error > AUTOTUNE_BENCH_MAX_ERROR_PCT) {
+      printf("autotune=%s: Ku/Tu error over %.1f%%\n", plant->name,
+             AUTOTUNE_BENCH_MAX_ERROR_PCT);
+      failures++;
+    }
+
+    for (int rule = AUTOTUNE_RULE_ZN_PI; rule <= AUTOTUNE_RULE_TL_PID;
+         rule++) {
+      float got[3];
+      double want[3];
+
+      RuleGains((Autotune_Rule_t)rule, at.ku, at.tu, want);
+      if (Autotune_ComputeGains(&at, (Autotune_Rule_t)rule, &got[0], &got[1],
+                                &got[2]) != 0) {
+        printf("autotune=%s rule=%d: no gains\n", plant->name, rule);
+        failures++;
+        continue;
+      }
+      for (uint32_t g = 0; g < 3; g++) {
+        if (fabs(got[g] - want[g]) > 1e-5 * fmax(1.0, fabs(want[g]))) {
+          printf("autotune=%s rule=%d: gain %u is %.6f, table %.6f\n",
+                 plant->name, rule, g, got[g], want[g]);
+          failures++;
+        }
+      }
+    }
+  }
+
+  /* Steady state K*d below the hysteresis: no switch, so a timeout */
+  const AutotunePlant_t flat = {"unreachable", 0.01, 0.05, 0.02, 100.0f,
+                                5.0f};
+  Autotune_t at;
+  Autotune_Status_t status = RunRelay(&flat, &at);
+  float Kp, Ki, Kd;
+  printf("autotune=%s status=%s\n", flat.name,
+         status == AUTOTUNE_FAILED ? "failed" : "not_failed");
+  if (status != AUTOTUNE_FAILED ||
+      Autotune_ComputeGains(&at, AUTOTUNE_RULE_ZN_PID, &Kp, &Ki, &Kd) == 0) {
+    printf("autotune=%s: expected a failed run without gains\n", flat.name);
+    failures++;
+  }
+
+  return Sim_Bench_Result("autotune", failures);
+}
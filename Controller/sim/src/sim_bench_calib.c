@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_calib.c
+ * @brief   Gyro calibration bench (--bench-calib)
+ ******************************************************************************
+ */
+
+#include "imu.h"
+#include "main.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-calib: seeds per scenario, disturbance start after the
+ * calibration starts */
+#define CALIB_BENCH_TRIALS 50U
+#define CALIB_BUMP_DELAY 0.1
+
+/* ================ Private Types ================ */
+
+/* --bench-calib scenarios: gyro Z disturbance while calibrating */
+typedef struct {
+  const char *name;
+  IMU_Mode_t mode;
+  float amplitude; /* deg/s */
+  float freq_hz;   /* 0 for a constant rate */
+  double duration; /* s, 0 for none */
+  IMU_CalibStatus_t expected;
+} CalibScenario_t;
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Gyro calibration: duration and bias error over seeds
+ *
+ * Each scenario calibrates from a fresh board for CALIB_BENCH_TRIALS
+ * seeds: standing still in both IMU modes, a 50ms 20 deg/s bump shortly
+ * after the start (restart, then converge), and handled throughout (a
+ * 2Hz 10 deg/s wobble: give up). The error is against the simulated bias.
+ */
+int Sim_Bench_Calib(const Sim_Options_t *opt) {
+  static const CalibScenario_t scenarios[] = {
+      {"still_register", IMU_MODE_REGISTER, 0.0f, 0.0f, 0.0, IMU_CALIB_OK},
+      {"still_fifo", IMU_MODE_FIFO, 0.0f, 0.0f, 0.0, IMU_CALIB_OK},
+      {"bump_fifo", IMU_MODE_FIFO, 20.0f, 0.0f, 0.05, IMU_CALIB_OK},
+      {"handled_fifo", IMU_MODE_FIFO, 10.0f, 2.0f, 10.0, IMU_CALIB_MOTION},
+  };
+  uint32_t failures = 0;
+
+  for (uint32_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    const CalibScenario_t *scenario = &scenarios[s];
+    uint32_t expected = 0, restarts = 0, readings = 0;
+    double time_sum = 0.0, time_max = 0.0;
+    double error_sum = 0.0, error_max = 0.0;
+
+    for (uint32_t trial = 0; trial < CALIB_BENCH_TRIALS; trial++) {
+      Sim_Board_Config_t config;
+      Sim_Board_DefaultConfig(&config);
+      config.imu.seed = opt->seed + trial;
+      Sim_Board_Init(&config);
+      if (IMU_InitMode(scenario->mode) != 0) {
+        fprintf(stderr, "IMU init failed\n");
+        return EXIT_FAILURE;
+      }
+      delay_ms(100);
+
+      double t0 = Sim_Board_GetTime();
+      if (scenario->duration > 0.0)
+        Sim_MPU6050_SetDisturbance(t0 + CALIB_BUMP_DELAY, scenario->duration,
+                                   scenario->amplitude, scenario->freq_hz);
+      IMU_CalibStatus_t status = IMU_Calibrate();
+      double elapsed = Sim_Board_GetTime() - t0;
+
+      IMU_Calibration_t calib;
+      IMU_GetCalibration(&calib);
+      double truth = config.imu.gyro_bias_dps[2] +
+                     config.imu.gyro_tempco_dps *
+                         (config.imu.temperature_c - 25.0f);
+      double error = fabs(calib.bias - truth);
+
+      expected += (status == scenario->expected);
+      restarts += calib.restarts;
+      readings += calib.readings;
+      time_sum += elapsed;
+      time_max = fmax(time_max, elapsed);
+      if (status == IMU_CALIB_OK) {
+        error_sum += error;
+        error_max = fmax(error_max, error);
+      }
+    }
+
+    uint32_t ok = (scenario->expected == IMU_CALIB_OK) ? expected : 0;
+    printf("scenario=%s expect=%s as_expected=%u/%u readings=%.1f "
+           "restarts=%.1f time_s=%.3f..%.3f bias_error_dps=%.4f..%.4f\n",
+           scenario->name, Sim_CalibStatusName(scenario->expected), expected,
+           CALIB_BENCH_TRIALS, (double)readings / CALIB_BENCH_TRIALS,
+           (double)restarts / CALIB_BENCH_TRIALS,
+           time_sum / CALIB_BENCH_TRIALS, time_max,
+           ok ? error_sum / ok : 0.0, error_max);
+    failures += CALIB_BENCH_TRIALS - expected;
+  }
+
+  return Sim_Bench_Result("calib", failures);
+}
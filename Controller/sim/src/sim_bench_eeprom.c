@@ -0,0 +1,240 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_eeprom.c
+ * @brief   EEPROM emulation and settings bench (--bench-eeprom)
+ ******************************************************************************
+ */
+
+#include "eeprom.h"
+#include "main.h"
+#include "settings.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include "sim_periph.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-eeprom: random writes, power cut trials, interrupted saves */
+#define EEPROM_BENCH_WRITES 20000U
+#define EEPROM_CUT_TRIALS 2000U
+#define EEPROM_CUT_MAX_OPS 600U
+#define EEPROM_SAVE_TRIALS 200U
+
+/* STM32F103 flash endurance (erase cycles per page, datasheet minimum) */
+#define FLASH_ENDURANCE 10000.0
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Check every EEPROM variable against the expected values
+ * @param  expected: Values of variables 1..EE_VAR_COUNT
+ * @param  written: Variables written at least once
+ * @retval Variables that read back differently
+ */
+static uint32_t CheckEeprom(const uint16_t *expected, const uint8_t *written) {
+  uint32_t errors = 0;
+
+  for (uint16_t v = 1; v <= EE_VAR_COUNT; v++) {
+    uint16_t data;
+    uint16_t status = EE_ReadVariable(v, &data);
+    if (written[v - 1] ? (status != EE_OK || data != expected[v - 1])
+                       : (status != EE_NOT_FOUND))
+      errors++;
+  }
+  return errors;
+}
+
+/**
+ * @brief  Settings record with every field random
+ */
+static void RandomSettings(Settings_t *out, uint32_t *rng) {
+  float *fields[] = {&out->gyro_z_bias,       &out->gyro_temp_c,
+                     &out->speed_pid[0],      &out->speed_pid[1],
+                     &out->speed_pid[2],      &out->heading_pid[0],
+                     &out->heading_pid[1],    &out->heading_pid[2],
+                     &out->integral_limits[0], &out->integral_limits[1]};
+
+  for (uint32_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    *fields[i] = (float)(Sim_XorShift(rng) / 4294967296.0 * 100.0);
+  out->track_width_mm = 50.0f + (float)(Sim_XorShift(rng) % 200U);
+  out->heading_source = (uint16_t)(Sim_XorShift(rng) & 1U);
+}
+
+static uint8_t SameSettings(const Settings_t *a, const Settings_t *b) {
+  return a->gyro_z_bias == b->gyro_z_bias &&
+         a->gyro_temp_c == b->gyro_temp_c &&
+         memcmp(a->speed_pid, b->speed_pid, sizeof(a->speed_pid)) == 0 &&
+         memcmp(a->heading_pid, b->heading_pid, sizeof(a->heading_pid)) ==
+             0 &&
+         memcmp(a->integral_limits, b->integral_limits,
+                sizeof(a->integral_limits)) == 0 &&
+         a->track_width_mm == b->track_width_mm &&
+         a->heading_source == b->heading_source;
+}
+
+/**
+ * @brief  Check a page status for a transfer or erase in progress
+ */
+static uint8_t PageSettled(uint32_t page) {
+  uint16_t status = *(volatile uint16_t *)(uintptr_t)page;
+  return status == EE_VALID_PAGE || status == EE_ERASED;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  EEPROM emulation on the simulated flash
+ *
+ * Random variable writes from a blank chip checked against a shadow copy
+ * (page transfers, wear, stall time), then power cuts at random flash
+ * operations, and again during the recovery of half the interrupted
+ * transfers: after EE_Init() every variable must read its last value, the
+ * one being written its old or new one. Last, settings records saved with
+ * the power failing part way must load whole: the new record, or the one
+ * saved before it from the other slot, and both must occur.
+ */
+int Sim_Bench_Eeprom(const Sim_Options_t *opt) {
+  Sim_Bench_InitBoard(opt->seed);
+  Sim_Flash_Erase();
+
+  uint32_t rng = opt->seed ? opt->seed : 1;
+  uint32_t failures = 0;
+  uint16_t expected[EE_VAR_COUNT];
+  uint8_t written[EE_VAR_COUNT] = {0};
+
+  /* Writes: every variable checked after each one */
+  uint32_t init_failures = (EE_Init() != EE_OK);
+  uint32_t write_errors = 0, read_errors = 0;
+  double elapsed = 0.0;
+  for (uint32_t n = 0; n < EEPROM_BENCH_WRITES; n++) {
+    uint16_t v = (uint16_t)(1U + Sim_XorShift(&rng) % EE_VAR_COUNT);
+    uint16_t data = (uint16_t)Sim_XorShift(&rng);
+
+    double start = Sim_WallTime();
+    write_errors += (EE_WriteVariable(v, data) != EE_OK);
+    elapsed += Sim_WallTime() - start;
+    expected[v - 1] = data;
+    written[v - 1] = 1;
+    read_errors += CheckEeprom(expected, written);
+  }
+  Sim_Flash_Stats_t flash;
+  Sim_Flash_GetStats(&flash);
+  double writes_per_erase = 0.0;
+  if (flash.max_page_erases)
+    writes_per_erase = (double)EEPROM_BENCH_WRITES / flash.max_page_erases;
+  printf("writes=%u write_errors=%u read_errors=%u\n", EEPROM_BENCH_WRITES,
+         write_errors, read_errors);
+  printf("programs=%u erases=%u max_page_erases=%u writes_per_page_erase=%.1f "
+         "lifetime_writes=%.0f\n",
+         flash.programs, flash.erases, flash.max_page_erases, writes_per_erase,
+         writes_per_erase * FLASH_ENDURANCE);
+  printf("stall_us_per_write=%.1f host_ns_per_write=%.0f\n",
+         flash.busy_time * 1e6 / EEPROM_BENCH_WRITES,
+         elapsed * 1e9 / EEPROM_BENCH_WRITES);
+  failures += init_failures + write_errors + read_errors;
+
+  /* Power cuts: write until the power fails, sometimes again during the
+   * recovery, then power on and check */
+  uint32_t mid_transfer = 0, recovery_cuts = 0, lost = 0;
+  init_failures = 0;
+  for (uint32_t trial = 0; trial < EEPROM_CUT_TRIALS; trial++) {
+    uint16_t v = 0, data = 0, old = 0;
+    uint8_t was_written = 0;
+
+    Sim_Flash_CutPower(Sim_XorShift(&rng) % EEPROM_CUT_MAX_OPS,
+                       Sim_XorShift(&rng));
+    while (!Sim_Flash_PowerLost()) {
+      v = (uint16_t)(1U + Sim_XorShift(&rng) % EE_VAR_COUNT);
+      data = (uint16_t)Sim_XorShift(&rng);
+      old = expected[v - 1];
+      was_written = written[v - 1];
+      if (EE_WriteVariable(v, data) == EE_OK && !Sim_Flash_PowerLost()) {
+        expected[v - 1] = data;
+        written[v - 1] = 1;
+      }
+    }
+    uint8_t settled =
+        PageSettled(EE_PAGE0_ADDRESS) && PageSettled(EE_PAGE1_ADDRESS);
+    mid_transfer += !settled;
+    Sim_Flash_Reset();
+
+    if (!settled && (Sim_XorShift(&rng) & 1U)) {
+      Sim_Flash_CutPower(Sim_XorShift(&rng) % 40U, Sim_XorShift(&rng));
+      EE_Init();
+      recovery_cuts += Sim_Flash_PowerLost();
+      Sim_Flash_Reset();
+    }
+    init_failures += (EE_Init() != EE_OK);
+
+    /* The variable being written: old or new value */
+    uint16_t now;
+    uint16_t status = EE_ReadVariable(v, &now);
+    if (status == EE_OK && now == data) {
+      expected[v - 1] = data;
+      written[v - 1] = 1;
+    } else if (was_written ? (status != EE_OK || now != old)
+                           : (status != EE_NOT_FOUND)) {
+      lost++;
+    }
+    lost += CheckEeprom(expected, written);
+  }
+  printf("cut_trials=%u mid_transfer=%u recovery_cuts=%u init_failures=%u "
+         "lost=%u\n",
+         EEPROM_CUT_TRIALS, mid_transfer, recovery_cuts, init_failures, lost);
+  failures += init_failures + lost;
+
+  /* Settings: round trip, then saves cut short */
+  Settings_t current, next, loaded;
+  RandomSettings(&current, &rng);
+  uint8_t round_trip = (Settings_Save(&current) == 0 &&
+                        Settings_Load(&loaded) == 0 &&
+                        SameSettings(&loaded, &current));
+  printf("settings_round_trip=%s\n", round_trip ? "ok" : "failed");
+  failures += !round_trip;
+
+  uint8_t have_current = round_trip;
+  uint32_t loaded_new = 0, loaded_old = 0, rejected = 0, torn = 0;
+  uint32_t lost_saves = 0;
+  for (uint32_t trial = 0; trial < EEPROM_SAVE_TRIALS; trial++) {
+    RandomSettings(&next, &rng);
+    Sim_Flash_CutPower(Sim_XorShift(&rng) % 120U, Sim_XorShift(&rng));
+    Settings_Save(&next);
+    Sim_Flash_Reset();
+    if (EE_Init() != EE_OK)
+      torn++;
+
+    if (Settings_Load(&loaded) != 0) {
+      /* A complete save was stored before this one */
+      rejected++;
+      lost_saves += have_current;
+      have_current = 0;
+    } else if (SameSettings(&loaded, &next)) {
+      loaded_new++;
+      current = next;
+      have_current = 1;
+    } else if (have_current && SameSettings(&loaded, &current)) {
+      loaded_old++;
+    } else {
+      torn++;
+    }
+  }
+  printf("save_trials=%u loaded_new=%u loaded_old=%u rejected=%u torn=%u "
+         "lost_saves=%u\n",
+         EEPROM_SAVE_TRIALS, loaded_new, loaded_old, rejected, torn,
+         lost_saves);
+  failures += torn + lost_saves;
+
+  /* The cuts must have left both outcomes: the new slot, and the older
+   * slot once the new one was incomplete */
+  if (loaded_new == 0 || loaded_old == 0) {
+    printf("settings: cut saves never loaded the %s record\n",
+           loaded_new == 0 ? "new" : "older");
+    failures++;
+  }
+
+  return Sim_Bench_Result("eeprom", failures);
+}
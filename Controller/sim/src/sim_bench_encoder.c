@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_encoder.c
+ * @brief   Encoder interrupt rate bench (--bench-encoder)
+ ******************************************************************************
+ */
+
+#include "encoder.h"
+#include "main.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* Estimated encoder handler cost in cycles, including exception entry (12)
+ * and exit (10). Not measured: the simulator cannot time a Cortex-M3
+ * handler, so the load printed from it is an estimate too. */
+#define EXTI_ISR_CYCLES 70
+#define TIMER_ISR_CYCLES 60
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Encoder interrupt rate, estimated load and count accuracy versus
+ *         edge rate
+ *
+ * Spins the wheels in opposite directions at each edge rate (per wheel) and
+ * reverses them after a quarter of the run, so both counters cross zero and
+ * wrap in both directions, then compares the firmware counts with the edges
+ * the board generated.
+ */
+int Sim_Bench_Encoder(const Sim_Options_t *opt) {
+  static const double edge_rates[] = {1e3, 5e3, 10e3, 20e3, 50e3, 100e3, 200e3};
+  static const Encoder_Mode_t modes[] = {ENCODER_MODE_EXTI, ENCODER_MODE_TIMER};
+  int status = EXIT_SUCCESS;
+
+  for (uint32_t m = 0; m < 2; m++) {
+    const char *name = (modes[m] == ENCODER_MODE_TIMER) ? "timer" : "exti";
+    uint32_t cycles =
+        (modes[m] == ENCODER_MODE_TIMER) ? TIMER_ISR_CYCLES : EXTI_ISR_CYCLES;
+
+    for (uint32_t r = 0; r < sizeof(edge_rates) / sizeof(edge_rates[0]); r++) {
+      float omega = (float)(edge_rates[r] * 2.0 * M_PI / ENCODER_CPR);
+      Sim_Bench_InitBoard(opt->seed);
+      Encoder_InitMode(modes[m]);
+
+      /* Poll speed at the control rate so capture gating runs as on target */
+      const double tick = 0.01;
+      for (double t = tick; t <= opt->duration + 1e-9; t += tick) {
+        Sim_Board_SpinWheels(1, (t <= 0.25 * opt->duration) ? omega : -omega,
+                             (t <= 0.25 * opt->duration) ? -omega : omega);
+        Sim_Board_Advance(tick);
+        Encoder_GetSpeedLeft((float)tick);
+        Encoder_GetSpeedRight((float)tick);
+      }
+
+      int64_t left_edges, right_edges;
+      Sim_Board_GetEncoderEdges(&left_edges, &right_edges);
+      int64_t error =
+          llabs((int64_t)Encoder_GetCountLeft() - left_edges) +
+          llabs((int64_t)Encoder_GetCountRight() - right_edges);
+      double elapsed = Sim_Board_GetTime();
+      double irq_rate = Encoder_GetIrqCount() / elapsed;
+
+      printf("mode=%s edge_rate=%.0f irq_rate=%.0f est_cpu_load_pct=%.3f "
+             "count=%d,%d count_error=%lld\n",
+             name, edge_rates[r], irq_rate,
+             100.0 * irq_rate * cycles / SYSTEM_CLOCK_HZ,
+             Encoder_GetCountLeft(), Encoder_GetCountRight(),
+             (long long)error);
+      if (error != 0)
+        status = EXIT_FAILURE;
+    }
+  }
+
+  printf("est_isr_cycles=exti:%u,timer:%u\n", EXTI_ISR_CYCLES,
+         TIMER_ISR_CYCLES);
+  return status;
+}
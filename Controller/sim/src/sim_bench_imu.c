@@ -0,0 +1,156 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_imu.c
+ * @brief   IMU heading integration bench (--bench-imu)
+ ******************************************************************************
+ */
+
+#include "control_loop.h"
+#include "imu.h"
+#include "main.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-imu: board step for the yaw profile, still time around it */
+#define IMU_BENCH_STEP 1e-4
+#define IMU_BENCH_SETTLE 0.1
+
+/* ================ Private Types ================ */
+
+/* --bench-imu yaw profiles */
+typedef struct {
+  const char *name;
+  double rate_dps; /* Peak yaw rate */
+  double freq_hz;  /* Sine frequency, 0 for alternating 90 degree turns */
+} ImuProfile_t;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  ControlLoop callback for --bench-imu: acquisition only
+ */
+static void ImuBenchTick(float dt) {
+  IMU_StartRead();
+  IMU_Update(dt);
+}
+
+/**
+ * @brief  Yaw rate of a bench profile at time t (deg/s)
+ *
+ * Turns alternate +90 and -90 degrees at the peak rate, 0.137s apart so
+ * the edges drift against the sensor and loop clocks.
+ */
+static double ImuProfileRate(const ImuProfile_t *profile, double t) {
+  if (profile->freq_hz > 0.0)
+    return profile->rate_dps * sin(2.0 * M_PI * profile->freq_hz * t);
+
+  double turn = 90.0 / profile->rate_dps;
+  double slot = turn + 0.137;
+  double phase = fmod(t, 2.0 * slot);
+  if (phase < turn)
+    return profile->rate_dps;
+  if (phase >= slot && phase < slot + turn)
+    return -profile->rate_dps;
+  return 0.0;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Heading error of both IMU modes on sine and turn yaw profiles
+ *
+ * The body turns (wheels still) while the control loop runs acquisition
+ * only, starting and ending at rest. The gyro Z bias is zeroed instead of calibrated so calibration
+ * error does not hide integration error. Peak rates stay inside the
+ * +-250 deg/s range. rms is against the true heading at each tick, so it includes the
+ * one-tick acquisition latency both modes share; final is the heading
+ * error once the motion has stopped, i.e. the integration error alone.
+ */
+int Sim_Bench_Imu(const Sim_Options_t *opt) {
+  static const ImuProfile_t profiles[] = {
+      {"sine_0.5hz", 180.0, 0.5}, {"sine_2hz", 180.0, 2.0},
+      {"sine_5hz", 180.0, 5.0},   {"turns_90dps", 90.0, 0.0},
+      {"turns_200dps", 200.0, 0.0},
+  };
+  static const IMU_Mode_t modes[] = {IMU_MODE_REGISTER, IMU_MODE_FIFO};
+  const uint32_t profile_count = sizeof(profiles) / sizeof(profiles[0]);
+
+  for (uint32_t m = 0; m < 2; m++) {
+    const char *name = (modes[m] == IMU_MODE_FIFO) ? "fifo" : "register";
+
+    for (uint32_t p = 0; p < profile_count; p++) {
+      Sim_Board_Config_t config;
+      Sim_Board_DefaultConfig(&config);
+      config.imu.seed = opt->seed;
+      config.imu.gyro_bias_dps[2] = 0.0f;
+      Sim_Board_Init(&config);
+      Sim_Board_SpinWheels(1, 0.0f, 0.0f);
+
+      if (IMU_InitMode(modes[m]) != 0) {
+        fprintf(stderr, "IMU init failed\n");
+        return EXIT_FAILURE;
+      }
+      delay_ms(100);
+
+      if (ControlLoop_Init((uint32_t)opt->rate_hz, ImuBenchTick) != 0) {
+        fprintf(stderr, "rate must be %u-%u Hz\n", CONTROL_LOOP_MIN_HZ,
+                CONTROL_LOOP_MAX_HZ);
+        return EXIT_FAILURE;
+      }
+      const Plant_t *plant = Sim_Board_GetPlant();
+      double theta0 = plant->theta;
+      double t0 = Sim_Board_GetTime();
+      IMU_ResetHeading();
+      ControlLoop_Start();
+
+      /* Stand still while the reset reaches the FIFO, as on the robot */
+      Sim_Board_Advance(IMU_BENCH_SETTLE);
+      t0 = Sim_Board_GetTime();
+
+      /* Whole sine periods, so the true heading ends where it started */
+      double duration = opt->duration;
+      if (profiles[p].freq_hz > 0.0)
+        duration = ceil(duration * profiles[p].freq_hz) / profiles[p].freq_hz;
+
+      double error_sq = 0.0;
+      uint32_t ticks = 0;
+      uint32_t iterations = ControlLoop_GetIterations();
+      for (double t = 0.0; t < duration + IMU_BENCH_SETTLE;
+           t = Sim_Board_GetTime() - t0) {
+        double rate = (t < duration) ? ImuProfileRate(&profiles[p], t) : 0.0;
+        Sim_Board_RotateBody(1, (float)(rate / RAD_TO_DEG));
+        Sim_Board_Advance(IMU_BENCH_STEP);
+
+        if (ControlLoop_GetIterations() != iterations) {
+          iterations = ControlLoop_GetIterations();
+          double error = Sim_WrapDegrees((plant->theta - theta0) * RAD_TO_DEG -
+                                         IMU_GetHeading());
+          error_sq += error * error;
+          ticks++;
+        }
+      }
+      ControlLoop_Stop();
+      Sim_Board_RotateBody(0, 0.0f);
+
+      IMU_Stats_t stats;
+      IMU_GetStats(&stats);
+      double final_error =
+          Sim_WrapDegrees((plant->theta - theta0) * RAD_TO_DEG -
+                          IMU_GetHeading());
+
+      printf("mode=%s profile=%s rms_deg=%.4f final_deg=%.4f reads=%u "
+             "samples=%u max_batch=%u overflows=%u\n",
+             name, profiles[p].name, ticks ? sqrt(error_sq / ticks) : 0.0,
+             final_error, stats.completed, stats.fifo_samples,
+             stats.fifo_max_batch, stats.fifo_overflows);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
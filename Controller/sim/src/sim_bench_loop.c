@@ -0,0 +1,208 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_loop.c
+ * @brief   Control loop timing statistics bench (--bench-loop)
+ ******************************************************************************
+ */
+
+#include "control_loop.h"
+#include "encoder.h"
+#include "main.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-loop: run time per case, loop rate; cost of each encoder EXTI
+ * handler and wheel rate (rad/s, about 3800 edges/s a wheel) in the case
+ * where they delay the loop */
+#define LOOP_BENCH_TIME 1.0
+#define LOOP_BENCH_HZ 1000U
+#define LOOP_BENCH_EDGE_CYCLES 400U
+#define LOOP_BENCH_SPIN_OMEGA 20.0f
+
+/* Cycles the DWT readings may differ from the modelled cost (CYCCNT is
+ * rounded to whole cycles of simulated time) */
+#define LOOP_BENCH_CYCLE_TOLERANCE 1
+
+/* ================ Private Variables ================ */
+
+/* Modelled update cost: fixed + xorshift spread, and what was spent */
+static uint32_t bench_fixed;
+static uint32_t bench_spread;
+static uint32_t bench_rng;
+static uint32_t bench_spent_min;
+static uint32_t bench_spent_max;
+
+/* ================ Private Functions ================ */
+
+static void LoopBenchTick(float dt) {
+  uint32_t cycles = bench_fixed;
+
+  (void)dt;
+  if (bench_spread)
+    cycles += Sim_XorShift(&bench_rng) % bench_spread;
+  if (cycles < bench_spent_min)
+    bench_spent_min = cycles;
+  if (cycles > bench_spent_max)
+    bench_spent_max = cycles;
+  Sim_Board_Spend(cycles);
+}
+
+/**
+ * @brief  Run the loop for LOOP_BENCH_TIME with a modelled update cost
+ * @param  edges: Also spin the wheels on EXTI encoders whose handlers cost
+ *         LOOP_BENCH_EDGE_CYCLES each
+ */
+static void RunLoop(uint32_t fixed, uint32_t spread, uint8_t edges,
+                    ControlLoop_Stats_t *stats) {
+  Sim_Board_Config_t config;
+
+  Sim_Board_DefaultConfig(&config);
+  if (edges)
+    config.irq_cycles = LOOP_BENCH_EDGE_CYCLES;
+  Sim_Board_Init(&config);
+  if (edges) {
+    Encoder_InitMode(ENCODER_MODE_EXTI);
+    Sim_Board_SpinWheels(1, LOOP_BENCH_SPIN_OMEGA,
+                         LOOP_BENCH_SPIN_OMEGA * 1.1f);
+  }
+
+  bench_fixed = fixed;
+  bench_spread = spread;
+  bench_rng = 1;
+  bench_spent_min = UINT32_MAX;
+  bench_spent_max = 0;
+
+  ControlLoop_Init(LOOP_BENCH_HZ, LoopBenchTick);
+  ControlLoop_Start();
+  Sim_Board_Advance(LOOP_BENCH_TIME);
+  ControlLoop_Stop();
+  ControlLoop_GetStats(stats);
+}
+
+/**
+ * @brief  Histogram bins holding samples
+ */
+static uint32_t FilledBins(const uint32_t *hist) {
+  uint32_t filled = 0;
+  for (uint32_t i = 0; i < CONTROL_LOOP_HIST_BINS; i++)
+    filled += (hist[i] != 0);
+  return filled;
+}
+
+/**
+ * @brief  Samples in a histogram
+ */
+static uint32_t HistTotal(const uint32_t *hist) {
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < CONTROL_LOOP_HIST_BINS; i++)
+    total += hist[i];
+  return total;
+}
+
+static void PrintLoopCase(const char *name, const ControlLoop_Stats_t *stats) {
+  printf("case=%s iterations=%u overruns=%u exec_cycles=%u..%u "
+         "exec_bins=%u jitter_cycles=%d..%d jitter_bins=%u\n",
+         name, stats->iterations, stats->overruns, stats->exec_min,
+         stats->exec_max, FilledBins(stats->exec_hist), stats->jitter_min,
+         stats->jitter_max, FilledBins(stats->jitter_hist));
+}
+
+/**
+ * @brief  Check the exec statistics against the modelled costs spent
+ */
+static uint32_t CheckExec(const char *name, const ControlLoop_Stats_t *stats) {
+  uint32_t failures = 0;
+
+  if (stats->exec_min + LOOP_BENCH_CYCLE_TOLERANCE < bench_spent_min ||
+      stats->exec_min > bench_spent_min + LOOP_BENCH_CYCLE_TOLERANCE ||
+      stats->exec_max + LOOP_BENCH_CYCLE_TOLERANCE < bench_spent_max ||
+      stats->exec_max > bench_spent_max + LOOP_BENCH_CYCLE_TOLERANCE) {
+    printf("%s: exec %u..%u cycles, spent %u..%u\n", name, stats->exec_min,
+           stats->exec_max, bench_spent_min, bench_spent_max);
+    failures++;
+  }
+  if (HistTotal(stats->exec_hist) != stats->iterations) {
+    printf("%s: exec histogram holds %u of %u\n", name,
+           HistTotal(stats->exec_hist), stats->iterations);
+    failures++;
+  }
+  if (stats->iterations > 1 &&
+      HistTotal(stats->jitter_hist) != stats->iterations - 1) {
+    printf("%s: jitter histogram holds %u of %u\n", name,
+           HistTotal(stats->jitter_hist), stats->iterations - 1);
+    failures++;
+  }
+  return failures;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  ControlLoop DWT statistics with modelled update costs: the
+ *         execution histogram, min/max and overruns against the cycles the
+ *         update spent, and jitter from interrupts that delay the loop
+ *
+ * Cases: a fixed cost of half the period (one bin, no jitter); costs spread
+ * over the whole period (every bin); encoder edge handlers running when a
+ * period starts (jitter both ways); and a cost of 1.5 periods (every update
+ * overruns).
+ */
+int Sim_Bench_Loop(const Sim_Options_t *opt) {
+  const uint32_t period = SYSTEM_CLOCK_HZ / LOOP_BENCH_HZ;
+  const uint32_t expected = (uint32_t)(LOOP_BENCH_TIME * LOOP_BENCH_HZ);
+  ControlLoop_Stats_t stats;
+  uint32_t failures = 0;
+
+  (void)opt;
+
+  /* Half the period: all in the middle bin */
+  RunLoop(period / 2U, 0, 0, &stats);
+  PrintLoopCase("fixed", &stats);
+  failures += CheckExec("fixed", &stats);
+  if (stats.iterations + 1U < expected || stats.overruns != 0 ||
+      stats.exec_hist[CONTROL_LOOP_HIST_BINS / 2U] != stats.iterations ||
+      stats.jitter_hist[0] != stats.iterations - 1U) {
+    printf("fixed: expected %u updates, all in exec bin %u and jitter bin 0\n",
+           expected, CONTROL_LOOP_HIST_BINS / 2U);
+    failures++;
+  }
+
+  /* Spread over the period: every bin, still no overrun */
+  RunLoop(0, period, 0, &stats);
+  PrintLoopCase("spread", &stats);
+  failures += CheckExec("spread", &stats);
+  if (FilledBins(stats.exec_hist) != CONTROL_LOOP_HIST_BINS ||
+      stats.overruns != 0) {
+    printf("spread: %u exec bins filled, %u overruns\n",
+           FilledBins(stats.exec_hist), stats.overruns);
+    failures++;
+  }
+
+  /* Encoder edges just before a period starts hold the update off */
+  RunLoop(period / 10U, 0, 1, &stats);
+  PrintLoopCase("edges", &stats);
+  failures += CheckExec("edges", &stats);
+  if (stats.jitter_min >= 0 || stats.jitter_max <= 0 ||
+      FilledBins(stats.jitter_hist) < 2U) {
+    printf("edges: jitter %d..%d cycles in %u bins\n", stats.jitter_min,
+           stats.jitter_max, FilledBins(stats.jitter_hist));
+    failures++;
+  }
+
+  /* Longer than the period: every update overruns, last exec bin */
+  RunLoop(period + period / 2U, 0, 0, &stats);
+  PrintLoopCase("overrun", &stats);
+  failures += CheckExec("overrun", &stats);
+  if (stats.iterations == 0 || stats.overruns != stats.iterations ||
+      stats.exec_hist[CONTROL_LOOP_HIST_BINS - 1U] != stats.iterations) {
+    printf("overrun: %u of %u updates counted as overruns\n", stats.overruns,
+           stats.iterations);
+    failures++;
+  }
+
+  return Sim_Bench_Result("loop", failures);
+}
@@ -0,0 +1,182 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_motor.c
+ * @brief   Motor PWM and deadband bench (--bench-motor)
+ ******************************************************************************
+ */
+
+#include "main.h"
+#include "motor.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include "sim_periph.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-motor: effort sweep step, time to steady wheel speed, physics
+ * step; largest compensated effort that must already turn the wheel */
+#define MOTOR_BENCH_EFFORT_STEP 5
+#define MOTOR_BENCH_SETTLE 1.0
+#define MOTOR_BENCH_DT 1e-4
+#define MOTOR_BENCH_MAX_BREAKAWAY 10
+
+/* Estimated register access cost in cycles at 72MHz (APB2 at 72MHz, APB1
+ * at 36MHz; writes are buffered). Not measured: core instructions around
+ * the accesses are not counted. */
+#define APB2_READ_CYCLES 3
+#define APB2_WRITE_CYCLES 2
+#define APB1_READ_CYCLES 5
+#define APB1_WRITE_CYCLES 3
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Steady wheel speed (rad/s) at an effort, through TIM3 and the plant
+ */
+static float MotorSteadySpeed(const Plant_Config_t *config, int16_t effort) {
+  Plant_Bridge_t left, right;
+  Plant_Wheel_t wheel = {0.0f, 0.0};
+
+  Motor_SetLeft(effort);
+  Sim_Board_GetBridges(&left, &right);
+  for (double t = 0.0; t < MOTOR_BENCH_SETTLE; t += MOTOR_BENCH_DT)
+    Plant_WheelStep(config, &wheel, &left, 1.0f, (float)MOTOR_BENCH_DT);
+  return wheel.omega;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Motor PWM engine: period/resolution per frequency, register
+ *         accesses of Motor_SetBoth(), then the effort-to-speed curve of one
+ *         wheel with and without deadband compensation
+ *
+ * The deadband is the duty at which the plant's drive torque at rest
+ * equals its Coulomb friction. Linearity is the largest departure of the
+ * steady speed from effort * (full speed / 1000), in percent of full speed.
+ */
+int Sim_Bench_Motor(const Sim_Options_t *opt) {
+  static const uint32_t freqs[] = {1000, 5000, 10000, 16000, 20000, 25000,
+                                   MOTOR_PWM_MIN_HZ};
+  static const uint32_t bad_freqs[] = {0, MOTOR_PWM_MIN_HZ - 1U,
+                                       MOTOR_PWM_MAX_HZ + 1U};
+  Sim_Board_Config_t config;
+  uint32_t failures = 0;
+
+  (void)opt;
+  Sim_Board_DefaultConfig(&config);
+  Sim_Board_Init(&config);
+  Motor_Init();
+
+  if (!(TIM3->CR1 & TIM_CR1_CMS) || !(TIM3->CR1 & TIM_CR1_ARPE) ||
+      !(TIM3->CCMR1 & TIM_CCMR1_OC1PE) || !(TIM3->CCMR1 & TIM_CCMR1_OC2PE)) {
+    printf("preload: center-aligned/ARPE/OCxPE not set\n");
+    failures++;
+  }
+  printf("default_hz=%u resolution=%u\n", Motor_GetFrequency(),
+         Motor_GetResolution());
+  if (Motor_GetResolution() < MOTOR_MAX_SPEED)
+    failures++;
+
+  for (size_t i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++) {
+    if (Motor_SetFrequency(freqs[i]) != 0 || (TIM3->CR1 & TIM_CR1_UDIS)) {
+      failures++;
+      continue;
+    }
+    uint32_t steps = Motor_GetResolution();
+    printf("pwm_hz=%u actual_hz=%u psc=%u arr=%u bits=%.1f\n", freqs[i],
+           Motor_GetFrequency(), (unsigned)(TIM3->PSC & 0xFFFF), steps,
+           log2((double)steps));
+    if (fabs((double)Motor_GetFrequency() - freqs[i]) > 0.01 * freqs[i])
+      failures++;
+  }
+  for (size_t i = 0; i < sizeof(bad_freqs) / sizeof(bad_freqs[0]); i++) {
+    if (Motor_SetFrequency(bad_freqs[i]) == 0) {
+      printf("pwm_hz=%u accepted\n", bad_freqs[i]);
+      failures++;
+    }
+  }
+  Motor_SetFrequency(MOTOR_PWM_HZ);
+
+  /* Full effort: output never drops, left and right */
+  Plant_Bridge_t left, right;
+  Motor_SetBoth(MOTOR_MAX_SPEED, MOTOR_MIN_SPEED);
+  Sim_Board_GetBridges(&left, &right);
+  if (left.duty != 1.0f || right.duty != 1.0f || !left.in1 || !right.in2)
+    failures++;
+
+  /* Register accesses per command, all four direction combinations */
+  static const int16_t commands[][2] = {
+      {500, 500}, {-500, 500}, {500, -500}, {0, -500}};
+  Sim_Bus_Stats_t bus;
+  Sim_Periph_ClearBusStats();
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    Motor_SetBoth(commands[i][0], commands[i][1]);
+  Sim_Periph_GetBusStats(&bus);
+
+  /* Pins and compares of each command; update events left enabled */
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    Motor_SetBoth(commands[i][0], commands[i][1]);
+    Sim_Board_GetBridges(&left, &right);
+    if (left.in1 != (commands[i][0] > 0) || left.in2 != (commands[i][0] < 0) ||
+        right.in1 != (commands[i][1] > 0) ||
+        right.in2 != (commands[i][1] < 0) ||
+        (left.duty > 0.0f) != (commands[i][0] != 0) ||
+        (TIM3->CR1 & TIM_CR1_UDIS) || Sim_GetPrimask()) {
+      printf("set_both: %d,%d not applied\n", commands[i][0], commands[i][1]);
+      failures++;
+    }
+  }
+  uint32_t n = sizeof(commands) / sizeof(commands[0]);
+  printf("set_both: apb2_reads=%.1f apb2_writes=%.1f apb1_reads=%.1f "
+         "apb1_writes=%.1f bus_cycles_est=%.1f\n",
+         (double)bus.apb2_reads / n, (double)bus.apb2_writes / n,
+         (double)bus.apb1_reads / n, (double)bus.apb1_writes / n,
+         (double)(bus.apb2_reads * APB2_READ_CYCLES +
+                  bus.apb2_writes * APB2_WRITE_CYCLES +
+                  bus.apb1_reads * APB1_READ_CYCLES +
+                  bus.apb1_writes * APB1_WRITE_CYCLES) /
+             n);
+
+  /* Effort to speed, without then with compensation */
+  const Plant_Config_t *plant = &config.plant;
+  uint16_t deadband = (uint16_t)ceil(
+      1000.0 * plant->coulomb * plant->resistance /
+      (plant->kt * plant->battery_v));
+  const uint16_t deadbands[] = {0, deadband};
+  uint16_t bad_table[MOTOR_COMP_POINTS] = {0};
+  bad_table[1] = 100; /* Decreasing after this */
+
+  if (Motor_SetCompensation(bad_table) == 0 ||
+      Motor_SetDeadband(MOTOR_MAX_SPEED) == 0)
+    failures++;
+
+  for (size_t d = 0; d < sizeof(deadbands) / sizeof(deadbands[0]); d++) {
+    Motor_SetDeadband(deadbands[d]);
+
+    float full = MotorSteadySpeed(plant, MOTOR_MAX_SPEED);
+    int16_t breakaway = -1;
+    double worst = 0.0;
+    for (int16_t e = MOTOR_BENCH_EFFORT_STEP; e <= MOTOR_MAX_SPEED;
+         e += MOTOR_BENCH_EFFORT_STEP) {
+      float omega = MotorSteadySpeed(plant, e);
+      if (omega > 0.0f && breakaway < 0)
+        breakaway = e;
+      double err = fabs(omega - full * e / MOTOR_MAX_SPEED) / full;
+      if (err > worst)
+        worst = err;
+    }
+    printf("deadband=%u breakaway_effort=%d full_speed_rad_s=%.2f "
+           "linearity_err_pct=%.2f\n",
+           deadbands[d], breakaway, full, 100.0 * worst);
+    if (d > 0 && (breakaway < 0 || breakaway > MOTOR_BENCH_MAX_BREAKAWAY))
+      failures++;
+  }
+  Motor_Stop();
+
+  return Sim_Bench_Result("motor", failures);
+}
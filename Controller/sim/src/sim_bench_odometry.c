@@ -0,0 +1,148 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_odometry.c
+ * @brief   Odometry bench (--bench-odometry)
+ ******************************************************************************
+ */
+
+#include "encoder.h"
+#include "main.h"
+#include "odometry.h"
+#include "sim_bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-odometry: reference integration substeps per control tick */
+#define ODOMETRY_SUBSTEPS 100
+
+/* --bench-odometry tolerances: position error in encoder counts (each
+ * wheel lags the reference by up to one) plus float rounding per distance
+ * travelled; heading error in counts of wheel travel difference over the
+ * track */
+#define ODOMETRY_MAX_ERROR_COUNTS 2.0
+#define ODOMETRY_MAX_ERROR_PPM 10.0
+#define ODOMETRY_MAX_THETA_COUNTS 2.0
+
+/* ================ Private Types ================ */
+
+/* --bench-odometry trajectories: body speed (mm/s) and yaw rate (rad/s) */
+typedef struct {
+  const char *name;
+  double speed;
+  double yaw_rate; /* Constant part */
+  double yaw_amp;  /* Sine part */
+  double yaw_freq; /* Hz */
+} OdometryPath_t;
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Odometry against analytic trajectories
+ *
+ * Each path is a body speed plus a constant and a sinusoidal yaw rate
+ * (line, circle, spin in place, slalom). The reference pose and wheel
+ * travel are integrated in double over ODOMETRY_SUBSTEPS per tick; the
+ * odometry gets the floor-quantised encoder counts and the exact yaw
+ * (wrapped like IMU_GetHeading()), with both heading sources.
+ *
+ * Fails if the largest position error or the final heading error exceeds
+ * the ODOMETRY_MAX_* tolerances.
+ */
+int Sim_Bench_Odometry(const Sim_Options_t *opt) {
+  static const OdometryPath_t paths[] = {
+      {"line", 300.0, 0.0, 0.0, 0.0},
+      {"circle_r500", 300.0, 0.6, 0.0, 0.0},
+      {"spin", 0.0, 3.0, 0.0, 0.0},
+      {"slalom", 300.0, 0.0, 1.5, 0.25},
+  };
+  static const struct {
+    const char *name;
+    Odometry_Heading_t source;
+  } sources[] = {
+      {"imu", ODOMETRY_HEADING_IMU},
+      {"encoder", ODOMETRY_HEADING_ENCODER},
+  };
+  const double count_mm = M_PI * WHEEL_DIAMETER_MM / ENCODER_CPR;
+  const double track = ODOMETRY_TRACK_WIDTH_MM;
+  const double period = 1.0 / opt->rate_hz;
+  const uint32_t ticks = (uint32_t)(opt->duration * opt->rate_hz);
+  const double theta_allowed =
+      ODOMETRY_MAX_THETA_COUNTS * count_mm / track * RAD_TO_DEG;
+  uint32_t failures = 0;
+
+  Odometry_Init();
+
+  for (uint32_t p = 0; p < sizeof(paths) / sizeof(paths[0]); p++) {
+    const OdometryPath_t *path = &paths[p];
+
+    for (uint32_t s = 0; s < sizeof(sources) / sizeof(sources[0]); s++) {
+      double x = 0.0, y = 0.0, theta = 0.0;
+      double left = 0.0, right = 0.0; /* Wheel travel (mm) */
+      int32_t left_count = 0, right_count = 0;
+      double error_max = 0.0;
+      double elapsed = 0.0;
+      Odometry_Pose_t pose;
+
+      Odometry_SetHeadingSource(sources[s].source);
+      Odometry_Reset();
+
+      for (uint32_t n = 0; n < ticks; n++) {
+        for (uint32_t k = 0; k < ODOMETRY_SUBSTEPS; k++) {
+          double h = period / ODOMETRY_SUBSTEPS;
+          double t = n * period + (k + 0.5) * h;
+          double w = path->yaw_rate +
+                     path->yaw_amp * sin(2.0 * M_PI * path->yaw_freq * t);
+          double mid = theta + 0.5 * w * h;
+          x += path->speed * cos(mid) * h;
+          y += path->speed * sin(mid) * h;
+          theta += w * h;
+          left += (path->speed - 0.5 * w * track) * h;
+          right += (path->speed + 0.5 * w * track) * h;
+        }
+
+        int32_t left_now = (int32_t)floor(left / count_mm);
+        int32_t right_now = (int32_t)floor(right / count_mm);
+        float yaw = (float)Sim_WrapDegrees(theta * RAD_TO_DEG);
+
+        double start = Sim_WallTime();
+        Odometry_Step(left_now - left_count, right_now - right_count, yaw);
+        elapsed += Sim_WallTime() - start;
+        left_count = left_now;
+        right_count = right_now;
+
+        Odometry_GetPose(&pose);
+        double error = hypot(pose.x - x, pose.y - y);
+        if (error > error_max)
+          error_max = error;
+      }
+
+      double distance = 0.5 * (fabs(left) + fabs(right));
+      double theta_error = Sim_WrapDegrees(pose.theta - theta * RAD_TO_DEG);
+      printf("path=%s heading=%s distance_mm=%.1f final_error_mm=%.3f "
+             "max_error_mm=%.3f theta_error_deg=%.4f ns_per_step=%.1f\n",
+             path->name, sources[s].name, distance,
+             hypot(pose.x - x, pose.y - y), error_max, theta_error,
+             ticks ? elapsed * 1e9 / ticks : 0.0);
+
+      double error_allowed = ODOMETRY_MAX_ERROR_COUNTS * count_mm +
+                             ODOMETRY_MAX_ERROR_PPM * 1e-6 * distance;
+      if (error_max > error_allowed) {
+        printf("path=%s heading=%s: max error %.3f over %.3f mm\n",
+               path->name, sources[s].name, error_max, error_allowed);
+        failures++;
+      }
+      if (fabs(theta_error) > theta_allowed) {
+        printf("path=%s heading=%s: theta error %.4f over %.4f deg\n",
+               path->name, sources[s].name, theta_error, theta_allowed);
+        failures++;
+      }
+    }
+  }
+
+  Odometry_Init();
+  return Sim_Bench_Result("odometry", failures);
+}
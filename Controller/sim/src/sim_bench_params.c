@@ -0,0 +1,515 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_params.c
+ * @brief   Parameter server bench (--bench-params)
+ ******************************************************************************
+ */
+
+#include "control_loop.h"
+#include "differential_drive.h"
+#include "main.h"
+#include "param_server.h"
+#include "settings.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include "sim_periph.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-params: fuzzed lines, link test length */
+#define PARAM_FUZZ_LINES 200000U
+#define PARAM_LINK_TIME 2.0
+
+/* --bench-params link test: bytes kept queued on RX, more than arrive
+ * between the slowest polls (50ms at 921600 baud) */
+#define PARAM_LINK_QUEUE 8192U
+
+/* ================ Private Functions ================ */
+
+/* --bench-params: registry as documented in param_server.h (the reference
+ * parser checks the firmware against it) */
+typedef struct {
+  const char *name;
+  double min, max;
+  uint8_t integer;
+} ParamSpec_t;
+
+static const ParamSpec_t param_specs[] = {
+    {"speed.kp", 0.0, 1000.0, 0},
+    {"speed.ki", 0.0, 1000.0, 0},
+    {"speed.kd", 0.0, 1000.0, 0},
+    {"heading.kp", 0.0, 1000.0, 0},
+    {"heading.ki", 0.0, 1000.0, 0},
+    {"heading.kd", 0.0, 1000.0, 0},
+    {"speed.ilimit", 0.0, 1000.0, 0},
+    {"heading.ilimit", 0.0, 1000.0, 0},
+    {"target_speed", -5000.0, 5000.0, 0},
+    {"loop_hz", CONTROL_LOOP_MIN_HZ, CONTROL_LOOP_MAX_HZ, 1},
+};
+#define PARAM_SPECS (sizeof(param_specs) / sizeof(param_specs[0]))
+
+/* --bench-params command vectors: NULL reply means none expected */
+typedef struct {
+  const char *line;
+  int8_t status;
+  const char *reply;
+} ParamVector_t;
+
+static const ParamVector_t param_vectors[] = {
+    {"get speed.kp", 0, "speed.kp=0.3"},
+    {"get heading.ki", 0, "heading.ki=0.1"},
+    {"get loop_hz", 0, "loop_hz=1000"},
+    {"save", 0, "ok"}, /* Drive stopped */
+    {"save now", -1, "err usage: save"},
+    {"set speed.kp=1.5 speed.ki=0.25", 0, "ok"},
+    {"get speed.kp", 0, "speed.kp=1.5"},
+    {"get speed.ki", 0, "speed.ki=0.25"},
+    {"set speed.kp=3 nope=1", -1, "err unknown name"},
+    {"get speed.kp", 0, "speed.kp=1.5"}, /* Rejected line left no trace */
+    {"set heading.kd=2000", -1, "err out of range"},
+    {"set speed.kp=-1", -1, "err out of range"},
+    {"set speed.kp=1e3", -1, "err bad value"},
+    {"set speed.kp=", -1, "err bad value"},
+    {"set speed.kp=1.2.3", -1, "err bad value"},
+    {"set speed.kp=.", -1, "err bad value"},
+    {"set =1", -1, "err unknown name"},
+    {"set speed.kp", -1, "err usage: set NAME=VALUE"},
+    {"set", -1, "err usage: set NAME=VALUE"},
+    {"set loop_hz=150.5", -1, "err bad value"},
+    {"set loop_hz=50", -1, "err out of range"},
+    {"set loop_hz=500", 0, "ok"},
+    {"get loop_hz", 0, "loop_hz=500"},
+    {"  set\tspeed.kd=.05 \r", 0, "ok"},
+    {"get speed.kd", 0, "speed.kd=0.05"},
+    {"set speed.ilimit=250 heading.ilimit=+120.5", 0, "ok"},
+    {"get heading.ilimit", 0, "heading.ilimit=120.5"},
+    {"set target_speed=-300", 0, "ok"},
+    {"get target_speed", 0, "target_speed=-300"},
+    {"set target_speed=0", 0, "ok"},
+    {"set speed.kp=000001234.56789012345", -1, "err out of range"},
+    {"set speed.kp=0000012.500000000000", 0, "ok"},
+    {"get speed.kp", 0, "speed.kp=12.5"},
+    {"get", -1, "err usage: get NAME"},
+    {"get speed.kp speed.ki", -1, "err usage: get NAME"},
+    {"get speed.kpx", -1, "err unknown name"},
+    {"GET speed.kp", -1, "err unknown command"},
+    {"set speed.kp=1 speed.kp=1 speed.kp=1 speed.kp=1 speed.kp=1 "
+     "speed.kp=1 speed.kp=1 speed.kp=1 speed.kp=1",
+     -1, "err too many values"},
+    {"", 0, NULL},
+    {" \r", 0, NULL},
+};
+
+static char param_reply[PARAM_SERVER_REPLY_MAX + 1];
+static uint32_t param_replies;
+
+/**
+ * @brief  Reply sink that keeps the last reply
+ */
+static int8_t CaptureParamReply(const char *text, uint32_t length) {
+  memcpy(param_reply, text, length);
+  param_reply[length] = '\0';
+  param_replies++;
+  return 0;
+}
+
+/**
+ * @brief  Execute a line placed at an offset in a ring of junk
+ */
+static int8_t ExecuteAt(const uint8_t *line, uint32_t length, uint8_t *ring,
+                        uint32_t size, uint32_t offset) {
+  memset(ring, '#', size);
+  for (uint32_t i = 0; i < length; i++)
+    ring[(offset + i) & (size - 1U)] = line[i];
+  return ParamServer_Execute(ring, size, offset, length);
+}
+
+/**
+ * @brief  Split a line on the parameter server's separators
+ * @retval Number of tokens
+ */
+static uint32_t SplitTokens(char *line, char **tokens, uint32_t max) {
+  uint32_t count = 0;
+  for (char *token = strtok(line, " \t\r"); token != NULL;
+       token = strtok(NULL, " \t\r")) {
+    if (count == max)
+      return max + 1U;
+    tokens[count++] = token;
+  }
+  return count;
+}
+
+static int32_t FindParamSpec(const char *name) {
+  for (uint32_t i = 0; i < PARAM_SPECS; i++) {
+    if (strcmp(name, param_specs[i].name) == 0)
+      return (int32_t)i;
+  }
+  return -1;
+}
+
+/**
+ * @brief  Check a value against [-+]digits[.digits] / [-+].digits
+ */
+static uint8_t IsDecimal(const char *text, uint8_t *integer) {
+  uint32_t digits = 0;
+  uint8_t point = 0;
+
+  if (*text == '-' || *text == '+')
+    text++;
+  for (; *text != '\0'; text++) {
+    if (*text == '.' && !point) {
+      point = 1;
+    } else if (*text >= '0' && *text <= '9') {
+      digits++;
+    } else {
+      return 0;
+    }
+  }
+  *integer = !point;
+  return digits != 0;
+}
+
+/**
+ * @brief  Reference for ParamServer_Execute written against the protocol
+ *         description with the C library
+ * @param  values: Registry values; updated if a set line is accepted
+ * @retval 0 if the line is accepted, -1 if rejected, 1 if blank
+ */
+static int8_t ReferenceExecute(const uint8_t *line, uint32_t length,
+                               double *values) {
+  char text[256];
+  char *tokens[PARAM_SERVER_MAX_SETS + 2];
+  double staged[PARAM_SPECS];
+
+  memcpy(text, line, length);
+  text[length] = '\0';
+  uint32_t count = SplitTokens(text, tokens, PARAM_SERVER_MAX_SETS + 1U);
+  if (count == 0)
+    return 1;
+
+  if (strcmp(tokens[0], "get") == 0)
+    return (count == 2 && FindParamSpec(tokens[1]) >= 0) ? 0 : -1;
+  if (strcmp(tokens[0], "save") == 0)
+    return (count == 1 &&
+            DifferentialDrive_GetState() == DRIVE_STATE_STOPPED)
+               ? 0
+               : -1;
+  if (strcmp(tokens[0], "set") != 0 || count < 2 ||
+      count > PARAM_SERVER_MAX_SETS + 1U)
+    return -1;
+
+  memcpy(staged, values, sizeof(staged));
+  for (uint32_t i = 1; i < count; i++) {
+    char *equals = strchr(tokens[i], '=');
+    if (equals == NULL)
+      return -1;
+    *equals = '\0';
+    int32_t id = FindParamSpec(tokens[i]);
+    uint8_t integer;
+    if (id < 0 || !IsDecimal(equals + 1, &integer) ||
+        (param_specs[id].integer && !integer))
+      return -1;
+    double value = strtod(equals + 1, NULL);
+    if (value < param_specs[id].min || value > param_specs[id].max)
+      return -1;
+    staged[id] = value;
+  }
+  memcpy(values, staged, sizeof(staged));
+  return 0;
+}
+
+/**
+ * @brief  Read every registry value through the firmware
+ */
+static void ReadParams(double *values) {
+  for (uint32_t i = 0; i < PARAM_SPECS; i++) {
+    float value = 0.0f;
+    ParamServer_Get(param_specs[i].name, &value);
+    values[i] = value;
+  }
+}
+
+/**
+ * @brief  Random command line: valid, mutated or junk (never '\n' or 0)
+ */
+static uint32_t RandomCommandLine(uint8_t *line, uint32_t max, uint32_t *rng) {
+  static const char alphabet[] = " \t\r=.+-0123456789abdeghiklnoprstz_";
+  uint32_t length = 0;
+  uint32_t kind = Sim_XorShift(rng) % 10U;
+
+  if (kind < 8) {
+    /* Grammar: get NAME or set NAME=VALUE... with random spacing */
+    char text[256];
+    int n = 0;
+    uint32_t pairs = (kind < 2) ? 0 : 1 + Sim_XorShift(rng) % 4U;
+    n += snprintf(text + n, sizeof(text) - n, "%s%s",
+                  (Sim_XorShift(rng) & 3U) ? "" : " \t", pairs ? "set" : "get");
+    for (uint32_t p = 0; p < (pairs ? pairs : 1U); p++) {
+      const ParamSpec_t *spec = &param_specs[Sim_XorShift(rng) % PARAM_SPECS];
+      n += snprintf(text + n, sizeof(text) - n, "%s%s",
+                    (Sim_XorShift(rng) & 7U) ? " " : " \t ", spec->name);
+      if (!pairs)
+        break;
+      double span = spec->max - spec->min;
+      double value = spec->min - 0.1 * span +
+                     1.2 * span * (Sim_XorShift(rng) / 4294967296.0);
+      switch (Sim_XorShift(rng) % 4U) {
+      case 0:
+        n += snprintf(text + n, sizeof(text) - n, "=%.0f", value);
+        break;
+      case 1:
+        n += snprintf(text + n, sizeof(text) - n, "=%.*f",
+                      (int)(Sim_XorShift(rng) % 9U), value);
+        break;
+      case 2:
+        n += snprintf(text + n, sizeof(text) - n, "=%+.3f", value);
+        break;
+      default: /* Leading point for small values */
+        n += snprintf(text + n, sizeof(text) - n, "=.%u",
+                      Sim_XorShift(rng) % 100000U);
+        break;
+      }
+    }
+    if (Sim_XorShift(rng) & 1U)
+      n += snprintf(text + n, sizeof(text) - n, "\r");
+    length = (uint32_t)n < max ? (uint32_t)n : max;
+    memcpy(line, text, length);
+
+    /* Mutate a few bytes in most of them */
+    for (uint32_t m = (kind < 4) ? 0 : 1 + Sim_XorShift(rng) % 3U; m > 0; m--) {
+      uint32_t at = length ? Sim_XorShift(rng) % length : 0;
+      uint8_t ch = (Sim_XorShift(rng) & 3U)
+                       ? (uint8_t)alphabet[Sim_XorShift(rng) %
+                                           (sizeof(alphabet) - 1U)]
+                       : (uint8_t)(1 + Sim_XorShift(rng) % 255U);
+      if (ch == '\n')
+        ch = ' ';
+      switch (Sim_XorShift(rng) % 3U) {
+      case 0: /* Replace */
+        if (length)
+          line[at] = ch;
+        break;
+      case 1: /* Insert */
+        if (length < max) {
+          memmove(line + at + 1, line + at, length - at);
+          line[at] = ch;
+          length++;
+        }
+        break;
+      default: /* Delete */
+        if (length) {
+          memmove(line + at, line + at + 1, length - at - 1);
+          length--;
+        }
+        break;
+      }
+    }
+  } else {
+    /* Junk */
+    length = Sim_XorShift(rng) % (max < 100U ? max : 100U);
+    for (uint32_t i = 0; i < length; i++) {
+      uint8_t ch = (uint8_t)(1 + Sim_XorShift(rng) % 255U);
+      line[i] = (ch == '\n') ? ' ' : ch;
+    }
+  }
+  return length;
+}
+
+/* --bench-params link test: the control tick checks the speed gains are
+ * one of the pairs sent, never a mix */
+static const float param_pairs[2][2] = {{1.0f, 0.5f}, {2.0f, 1.0f}};
+static uint32_t param_torn;
+
+static void ParamBenchTick(float dt) {
+  float gains[3];
+
+  DifferentialDrive_Update(dt);
+  DifferentialDrive_GetSpeedPID(gains);
+  uint8_t whole = (gains[0] == SPEED_PID_KP && gains[1] == SPEED_PID_KI);
+  for (uint32_t i = 0; i < 2; i++)
+    whole |= (gains[0] == param_pairs[i][0] && gains[1] == param_pairs[i][1]);
+  param_torn += !whole;
+}
+
+/**
+ * @brief  Stream alternating set lines over USART3 RX for a while
+ * @param  poll: Main loop poll interval
+ * @retval Lines sent
+ */
+static uint32_t StreamParamLines(double poll, double duration) {
+  uint32_t sent = 0;
+
+  for (double t = 0.0; t < duration; t += poll) {
+    /* Keep the line busy: top up the transmit queue */
+    while (Sim_USART3_RxQueued() < PARAM_LINK_QUEUE) {
+      char line[64];
+      int n = snprintf(line, sizeof(line), "set speed.kp=%g speed.ki=%g\n",
+                       param_pairs[sent & 1U][0], param_pairs[sent & 1U][1]);
+      Sim_USART3_Receive((const uint8_t *)line, (uint32_t)n);
+      sent++;
+    }
+    Sim_Board_Advance(poll);
+    ParamServer_Poll();
+  }
+  return sent;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Parameter server: command vectors (wrapping in the ring),
+ *         differential fuzzing against a reference parser, then commands
+ *         streamed over the simulated USART3 RX DMA while the control
+ *         loop runs
+ */
+int Sim_Bench_Params(const Sim_Options_t *opt) {
+  Sim_Bench_InitBoard(opt->seed);
+
+  uint32_t rng = opt->seed ? opt->seed : 1;
+  uint32_t failures = 0;
+
+  Sim_StreamInit();
+  ParamServer_Init(CaptureParamReply);
+  DifferentialDrive_Init();
+  Settings_Restore(); /* Blank flash: nothing applied */
+  ControlLoop_Init(1000, ParamBenchTick);
+
+  /* Vectors, every other one wrapped around the end of the ring */
+  uint8_t ring[256];
+  uint32_t vector_failures = 0;
+  uint32_t vectors = sizeof(param_vectors) / sizeof(param_vectors[0]);
+  for (uint32_t v = 0; v < vectors; v++) {
+    const ParamVector_t *vector = &param_vectors[v];
+    uint32_t length = (uint32_t)strlen(vector->line);
+    uint32_t offset = (v & 1U) ? sizeof(ring) - length / 2U : 0U;
+    uint32_t replies = param_replies;
+
+    int8_t status = ExecuteAt((const uint8_t *)vector->line, length, ring,
+                              sizeof(ring), offset);
+    uint8_t ok = (status == vector->status);
+    if (vector->reply)
+      ok &= (param_replies == replies + 1U &&
+             strcmp(param_reply, vector->reply) == 0);
+    else
+      ok &= (param_replies == replies);
+    if (!ok) {
+      printf("vector_failed=\"%s\" status=%d reply=\"%s\"\n", vector->line,
+             status, param_reply);
+      vector_failures++;
+    }
+  }
+  printf("vectors=%u vector_failures=%u\n", vectors, vector_failures);
+  failures += vector_failures;
+
+  /* Fuzz: the firmware and the reference must agree on every line, and a
+   * rejected line must change nothing */
+  double values[PARAM_SPECS], expected[PARAM_SPECS];
+  ReadParams(expected);
+  uint32_t mismatches = 0, leaks = 0, accepted = 0, reply_failures = 0;
+  double elapsed = 0.0;
+  for (uint32_t n = 0; n < PARAM_FUZZ_LINES; n++) {
+    uint8_t line[200];
+    uint32_t length = RandomCommandLine(line, sizeof(line), &rng);
+    uint32_t offset = Sim_XorShift(&rng) % sizeof(ring);
+    uint32_t replies = param_replies;
+
+    double start = Sim_WallTime();
+    int8_t status = ExecuteAt(line, length, ring, sizeof(ring), offset);
+    elapsed += Sim_WallTime() - start;
+
+    int8_t reference = ReferenceExecute(line, length, expected);
+    if (reference == 1) {
+      mismatches += (status != 0);
+      reply_failures += (param_replies != replies);
+    } else {
+      mismatches += (status != reference);
+      reply_failures += (param_replies != replies + 1U);
+      accepted += (reference == 0);
+    }
+
+    /* Applied values within float precision of the reference */
+    ReadParams(values);
+    for (uint32_t i = 0; i < PARAM_SPECS; i++) {
+      if (fabs(values[i] - expected[i]) > 1e-6 * fabs(expected[i]) + 1e-6)
+        leaks++;
+      expected[i] = values[i]; /* Do not count a difference twice */
+    }
+  }
+  printf("fuzz_lines=%u accepted=%u mismatches=%u value_errors=%u "
+         "reply_failures=%u ns_per_line=%.1f\n",
+         PARAM_FUZZ_LINES, accepted, mismatches, leaks, reply_failures,
+         elapsed * 1e9 / PARAM_FUZZ_LINES);
+  failures += mismatches + leaks + reply_failures;
+
+  /* Link: a line longer than the ring is dropped, the next one works */
+  DifferentialDrive_SetSpeedPID(SPEED_PID_KP, SPEED_PID_KI, SPEED_PID_KD);
+  ControlLoop_SetRate(1000);
+  ParamServer_Init(CaptureParamReply);
+  uint8_t junk[PARAM_SERVER_RX_SIZE + 100U];
+  memset(junk, 'x', sizeof(junk));
+  Sim_USART3_Receive(junk, sizeof(junk));
+  Sim_USART3_Receive((const uint8_t *)"\nget speed.kp\n", 14);
+  while (Sim_USART3_RxQueued() != 0) {
+    Sim_Board_Advance(PARAM_POLL_STEP);
+    ParamServer_Poll();
+  }
+  Sim_Board_Advance(PARAM_POLL_STEP);
+  ParamServer_Poll();
+  ParamServer_Stats_t stats;
+  ParamServer_GetStats(&stats);
+  uint8_t overflow_ok = (stats.overflows == 1 && stats.lines == 1 &&
+                         strcmp(param_reply, "speed.kp=0.3") == 0);
+  printf("overlong_line overflows=%u lines=%u reply=\"%s\"\n",
+         stats.overflows, stats.lines, param_reply);
+  failures += !overflow_ok;
+
+  /* Link: back-to-back set lines while the drive runs at 1kHz. Polled
+   * every tick or held up for 10ms nothing is lost; polled slower than the
+   * ring fills, the overwritten lines are detected and skipped and parsing
+   * resyncs on the lines still intact */
+  static const double polls[] = {0.001, 0.01, 0.05};
+  const uint32_t lossless_polls = 2;
+  DifferentialDrive_Calibrate();
+  ControlLoop_Start();
+  DifferentialDrive_SetSpeed(500.0f);
+  for (uint32_t p = 0; p < sizeof(polls) / sizeof(polls[0]); p++) {
+    ParamServer_Init(CaptureParamReply);
+    param_torn = 0;
+
+    uint32_t sent = StreamParamLines(polls[p], PARAM_LINK_TIME);
+    while (Sim_USART3_RxQueued() != 0) {
+      Sim_Board_Advance(polls[p]);
+      ParamServer_Poll();
+    }
+    Sim_Board_Advance(0.001);
+    ParamServer_Poll();
+
+    ParamServer_GetStats(&stats);
+    printf("poll_ms=%.0f lines_sent=%u sets=%u errors=%u overruns=%u "
+           "torn_ticks=%u sets_per_s=%.0f\n",
+           polls[p] * 1e3, sent, stats.sets, stats.errors, stats.overruns,
+           param_torn, stats.sets / PARAM_LINK_TIME);
+    if (param_torn != 0 || stats.errors != 0) {
+      printf("poll_ms=%.0f: torn or rejected lines\n", polls[p] * 1e3);
+      failures++;
+    }
+    if (p < lossless_polls && (stats.sets != sent || stats.overruns != 0)) {
+      printf("poll_ms=%.0f: %u of %u sets lost\n", polls[p] * 1e3,
+             sent - stats.sets, sent);
+      failures++;
+    }
+    if (p >= lossless_polls &&
+        (stats.overruns == 0 || stats.sets < stats.overruns)) {
+      printf("poll_ms=%.0f: overruns not detected or not resynced\n",
+             polls[p] * 1e3);
+      failures++;
+    }
+  }
+  ControlLoop_Stop();
+
+  return Sim_Bench_Result("param", failures);
+}
@@ -0,0 +1,272 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_pid.c
+ * @brief   Float vs Q16.16 PID bench (--bench-pid)
+ ******************************************************************************
+ */
+
+#include "differential_drive.h"
+#include "encoder.h"
+#include "main.h"
+#include "pid.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* Largest output difference from the float reference (output range
+ * +-1000): Q16.16 engine, batched update; largest scheduled gain error */
+#define PID_BENCH_MAX_Q16_DIFF 0.01
+#define PID_BENCH_MAX_BATCH_DIFF 0.01
+#define PID_BENCH_MAX_GAIN_DIFF 1e-5
+
+/* Feedforward in the batch comparison (the drive defaults are 0): values of
+ * the simulated motor, so the feedforward path is compared too */
+#define PID_BENCH_FF_KV 0.19f
+#define PID_BENCH_FF_KS 30.0f
+#define PID_BENCH_FF_KA 0.01f
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Float vs Q16.16 PID on the same closed-loop wheel trajectory
+ *
+ * A float PID drives one simulated wheel through a setpoint profile. The
+ * recorded (setpoint, measurement) sequence is then replayed open-loop
+ * through both implementations to compare outputs and per-call cost.
+ * Fails if the Q16.16 engine, the gain schedule or the batched update
+ * strays from its float reference by more than the PID_BENCH_MAX_* bounds.
+ */
+int Sim_Bench_Pid(const Sim_Options_t *opt) {
+  static const float profile[] = {0.0f, 500.0f, 1500.0f, -800.0f, 0.0f};
+  const uint32_t steps_per_segment = (uint32_t)(0.5 * opt->rate_hz);
+  const uint32_t count = steps_per_segment * 5;
+  const uint32_t substeps = 20;
+  uint32_t failures = 0;
+  const float dt = (float)(1.0 / opt->rate_hz);
+  const float *gains =
+      opt->speed_gains_set ? opt->speed_gains
+                           : (const float[3]){SPEED_PID_KP, SPEED_PID_KI,
+                                              SPEED_PID_KD};
+
+  float *setpoints = malloc(count * sizeof(float));
+  float *measurements = malloc(count * sizeof(float));
+  if (setpoints == NULL || measurements == NULL)
+    return EXIT_FAILURE;
+
+  /* Record */
+  Plant_Config_t config;
+  Plant_DefaultConfig(&config);
+  Plant_Wheel_t wheel = {0.0f, 0.0};
+  PID_t pid;
+  PID_Init(&pid, gains[0], gains[1], gains[2], -1000.0f, 1000.0f);
+  PID_SetIntegralLimit(&pid, 300.0f);
+
+  double prev_angle = 0.0;
+  for (uint32_t i = 0; i < count; i++) {
+    float sp = profile[i / steps_per_segment];
+    /* Encoder-quantised speed, as Encoder_GetSpeed* would report */
+    double counts = floor(wheel.angle * ENCODER_CPR / (2.0 * M_PI)) -
+                    floor(prev_angle * ENCODER_CPR / (2.0 * M_PI));
+    float meas = (float)(counts / dt);
+    prev_angle = wheel.angle;
+
+    setpoints[i] = sp;
+    measurements[i] = meas;
+
+    float out = PID_Compute(&pid, sp, meas, dt);
+    Plant_Bridge_t bridge = {out > 0.0f, out < 0.0f, fabsf(out) / 1000.0f};
+    for (uint32_t s = 0; s < substeps; s++)
+      Plant_WheelStep(&config, &wheel, &bridge, 1.0f, dt / substeps);
+  }
+
+  /* Replay: accuracy */
+  PID_Q16_t pid_q;
+  PID_Reset(&pid);
+  PID_Q16_Init(&pid_q, gains[0], gains[1], gains[2], -1000.0f, 1000.0f, dt);
+  PID_Q16_SetIntegralLimit(&pid_q, 300.0f);
+
+  double max_diff = 0.0;
+  double sum_sq = 0.0;
+  for (uint32_t i = 0; i < count; i++) {
+    float out_f = PID_Compute(&pid, setpoints[i], measurements[i], dt);
+    q16_t out_q = PID_Q16_Compute(&pid_q, Q16_FROM_FLOAT(setpoints[i]),
+                                  Q16_FROM_FLOAT(measurements[i]));
+    double diff = fabs((double)out_f - Q16_TO_FLOAT(out_q));
+    if (diff > max_diff)
+      max_diff = diff;
+    sum_sq += diff * diff;
+  }
+
+  /* Replay: cost (inputs pre-converted so only Compute is timed) */
+  q16_t *sp_q = malloc(count * sizeof(q16_t));
+  q16_t *meas_q = malloc(count * sizeof(q16_t));
+  if (sp_q == NULL || meas_q == NULL)
+    return EXIT_FAILURE;
+  for (uint32_t i = 0; i < count; i++) {
+    sp_q[i] = Q16_FROM_FLOAT(setpoints[i]);
+    meas_q[i] = Q16_FROM_FLOAT(measurements[i]);
+  }
+
+  const uint32_t repeats = 2000;
+  volatile float sink_f = 0.0f;
+  volatile q16_t sink_q = 0;
+
+  double start = Sim_WallTime();
+  for (uint32_t r = 0; r < repeats; r++)
+    for (uint32_t i = 0; i < count; i++)
+      sink_f = PID_Compute(&pid, setpoints[i], measurements[i], dt);
+  double float_ns = (Sim_WallTime() - start) * 1e9 / ((double)repeats * count);
+
+  start = Sim_WallTime();
+  for (uint32_t r = 0; r < repeats; r++)
+    for (uint32_t i = 0; i < count; i++)
+      sink_q = PID_Q16_Compute(&pid_q, sp_q[i], meas_q[i]);
+  double q16_ns = (Sim_WallTime() - start) * 1e9 / ((double)repeats * count);
+  (void)sink_f;
+  (void)sink_q;
+
+  printf("samples=%u\n", count);
+  printf("max_abs_diff=%.4f\n", max_diff);
+  printf("rms_diff=%.4f\n", sqrt(sum_sq / count));
+  if (max_diff > PID_BENCH_MAX_Q16_DIFF) {
+    printf("q16: max_abs_diff %.4f > %.4f\n", max_diff,
+           PID_BENCH_MAX_Q16_DIFF);
+    failures++;
+  }
+  printf("float_ns_per_call=%.2f\n", float_ns);
+  printf("q16_ns_per_call=%.2f\n", q16_ns);
+
+  /* Gain schedule: interpolation against a divide-per-call reference */
+  static const PID_GainPoint_t points[] = {
+      {0.0f, 0.6f, 3.0f, 0.0f},     {300.0f, 0.4f, 2.0f, 0.01f},
+      {1000.0f, 0.25f, 1.5f, 0.0f}, {2500.0f, 0.15f, 1.0f, 0.0f},
+  };
+  const uint8_t n_points = sizeof(points) / sizeof(points[0]);
+  PID_Schedule_t schedule;
+  PID_Schedule_Init(&schedule, points, n_points);
+
+  double sched_diff = 0.0;
+  for (uint32_t i = 0; i <= 3000; i++) {
+    float x = (float)i;
+    PID_ApplySchedule(&pid, &schedule, x);
+    uint8_t k = 0;
+    while (k + 2 < n_points && x >= points[k + 1].point)
+      k++;
+    double u = fmin(1.0, (x - points[k].point) /
+                             (points[k + 1].point - points[k].point));
+    const float got[3] = {pid.Kp, pid.Ki, pid.Kd};
+    const float lo[3] = {points[k].Kp, points[k].Ki, points[k].Kd};
+    const float hi[3] = {points[k + 1].Kp, points[k + 1].Ki, points[k + 1].Kd};
+    for (uint32_t g = 0; g < 3; g++)
+      sched_diff =
+          fmax(sched_diff, fabs(got[g] - (lo[g] + u * (hi[g] - lo[g]))));
+  }
+
+  start = Sim_WallTime();
+  for (uint32_t r = 0; r < repeats; r++)
+    for (uint32_t i = 0; i < count; i++)
+      PID_ApplySchedule(&pid, &schedule, fabsf(setpoints[i]));
+  double sched_ns = (Sim_WallTime() - start) * 1e9 / ((double)repeats * count);
+
+  printf("schedule_max_gain_diff=%.2e\n", sched_diff);
+  if (sched_diff > PID_BENCH_MAX_GAIN_DIFF) {
+    printf("schedule: max_gain_diff %.2e > %.2e\n", sched_diff,
+           PID_BENCH_MAX_GAIN_DIFF);
+    failures++;
+  }
+  printf("schedule_ns_per_call=%.2f\n", sched_ns);
+
+  /* Batched: the drive's three controllers (two speed PIDs with
+   * feedforward, one heading PID), scalar calls vs one batch update */
+  PID_t scalar[3];
+  PID_Batch_t batch;
+  PID_Batch_Init(&batch, 3, dt);
+  for (uint32_t k = 0; k < 3; k++) {
+    float limit = (k < 2) ? 1000.0f : 500.0f;
+    const float *g = (k < 2) ? gains
+                             : (const float[3]){HEADING_PID_KP, HEADING_PID_KI,
+                                                HEADING_PID_KD};
+    PID_Init(&scalar[k], g[0], g[1], g[2], -limit, limit);
+    PID_Batch_Setup(&batch, (uint8_t)k, g[0], g[1], g[2], -limit, limit);
+    PID_SetIntegralLimit(&scalar[k], k < 2 ? 300.0f : 200.0f);
+    PID_Batch_SetIntegralLimit(&batch, (uint8_t)k, k < 2 ? 300.0f : 200.0f);
+    if (k < 2) {
+      PID_SetFeedforward(&scalar[k], PID_BENCH_FF_KV, PID_BENCH_FF_KS,
+                         PID_BENCH_FF_KA);
+      PID_Batch_SetFeedforward(&batch, (uint8_t)k, PID_BENCH_FF_KV,
+                               PID_BENCH_FF_KS, PID_BENCH_FF_KA);
+    }
+  }
+
+  /* Inputs per tick: wheel speeds 5% apart, heading from their difference */
+  float(*batch_sp)[3] = malloc(count * sizeof(*batch_sp));
+  float(*batch_acc)[3] = malloc(count * sizeof(*batch_acc));
+  float(*batch_meas)[3] = malloc(count * sizeof(*batch_meas));
+  if (batch_sp == NULL || batch_acc == NULL || batch_meas == NULL)
+    return EXIT_FAILURE;
+  for (uint32_t i = 0; i < count; i++) {
+    float accel = (i > 0) ? (setpoints[i] - setpoints[i - 1]) / dt : 0.0f;
+    batch_sp[i][0] = batch_sp[i][1] = setpoints[i];
+    batch_sp[i][2] = 0.0f;
+    batch_acc[i][0] = batch_acc[i][1] = accel;
+    batch_acc[i][2] = 0.0f;
+    batch_meas[i][0] = measurements[i];
+    batch_meas[i][1] = measurements[i] * 1.05f;
+    batch_meas[i][2] = measurements[i] * 0.002f;
+  }
+
+  double batch_diff = 0.0;
+  for (uint32_t i = 0; i < count; i++) {
+    float out[3];
+    PID_Batch_Compute(&batch, batch_sp[i], batch_acc[i], batch_meas[i], out);
+    for (uint32_t k = 0; k < 3; k++) {
+      float ref = PID_ComputeFF(&scalar[k], batch_sp[i][k], batch_acc[i][k],
+                                batch_meas[i][k], dt);
+      batch_diff = fmax(batch_diff, fabs((double)out[k] - ref));
+    }
+  }
+
+  volatile float sink_b = 0.0f;
+  start = Sim_WallTime();
+  for (uint32_t r = 0; r < repeats; r++)
+    for (uint32_t i = 0; i < count; i++)
+      for (uint32_t k = 0; k < 3; k++)
+        sink_b = PID_ComputeFF(&scalar[k], batch_sp[i][k], batch_acc[i][k],
+                               batch_meas[i][k], dt);
+  double scalar3_ns =
+      (Sim_WallTime() - start) * 1e9 / ((double)repeats * count);
+
+  start = Sim_WallTime();
+  for (uint32_t r = 0; r < repeats; r++)
+    for (uint32_t i = 0; i < count; i++) {
+      float out[3];
+      PID_Batch_Compute(&batch, batch_sp[i], batch_acc[i], batch_meas[i], out);
+      sink_b = out[2];
+    }
+  double batch3_ns = (Sim_WallTime() - start) * 1e9 / ((double)repeats * count);
+  (void)sink_b;
+
+  printf("batch_max_abs_diff=%.2e\n", batch_diff);
+  if (batch_diff > PID_BENCH_MAX_BATCH_DIFF) {
+    printf("batch: max_abs_diff %.2e > %.2e\n", batch_diff,
+           PID_BENCH_MAX_BATCH_DIFF);
+    failures++;
+  }
+  printf("scalar3_ns_per_tick=%.2f\n", scalar3_ns);
+  printf("batch3_ns_per_tick=%.2f\n", batch3_ns);
+
+  free(batch_sp);
+  free(batch_acc);
+  free(batch_meas);
+
+  free(setpoints);
+  free(measurements);
+  free(sp_q);
+  free(meas_q);
+  return Sim_Bench_Result("pid", failures);
+}
@@ -0,0 +1,187 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_profile.c
+ * @brief   Speed profile bench (--bench-profile)
+ ******************************************************************************
+ */
+
+#include "differential_drive.h"
+#include "main.h"
+#include "motion_profile.h"
+#include "sim_bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-profile: time after the ideal end counted as settled */
+#define PROFILE_TAIL 0.2
+
+/* --bench-profile tolerances: acceleration and jerk over their limits
+ * (float rounding on the landing step), landing later than the ideal in
+ * ticks (rounding up to a tick, then the tick that clears the
+ * acceleration) */
+#define PROFILE_LIMIT_MARGIN 1.02
+#define PROFILE_MAX_LATE_TICKS 1
+
+/* ================ Private Types ================ */
+
+/* --bench-profile velocity steps */
+typedef struct {
+  const char *name;
+  float from, to;            /* counts/s */
+  float max_accel, max_jerk; /* counts/s^2, counts/s^3 */
+} ProfileStep_t;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Ideal profile for a step from rest: velocity change and
+ *         acceleration at time t (S-curve, or trapezoidal for jerk 0)
+ * @retval Duration of the ideal profile
+ */
+static double IdealProfile(double delta, double max_accel, double max_jerk,
+                           double t, double *dv, double *accel) {
+  double sign = (delta < 0.0) ? -1.0 : 1.0;
+  double span = fabs(delta);
+
+  if (max_jerk <= 0.0) {
+    double total = span / max_accel;
+    double tc = fmin(t, total);
+    *dv = sign * max_accel * tc;
+    *accel = (t < total) ? sign * max_accel : 0.0;
+    return total;
+  }
+
+  /* Jerk phase length and peak acceleration */
+  double tj = max_accel / max_jerk;
+  double ta = span / max_accel - tj; /* Constant acceleration phase */
+  if (ta < 0.0) {
+    tj = sqrt(span / max_jerk);
+    ta = 0.0;
+  }
+  double peak = max_jerk * tj;
+  double total = 2.0 * tj + ta;
+
+  if (t < tj) {
+    *dv = 0.5 * max_jerk * t * t;
+    *accel = max_jerk * t;
+  } else if (t < tj + ta) {
+    *dv = 0.5 * max_jerk * tj * tj + peak * (t - tj);
+    *accel = peak;
+  } else if (t < total) {
+    double remaining = total - t;
+    *dv = span - 0.5 * max_jerk * remaining * remaining;
+    *accel = max_jerk * remaining;
+  } else {
+    *dv = span;
+    *accel = 0.0;
+  }
+  *dv *= sign;
+  *accel *= sign;
+  return total;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  MotionProfile_t against the closed-form ideal profiles
+ *
+ * Velocity steps from rest at the control loop rate (--rate): short and
+ * long S-curves (with and without a constant acceleration phase),
+ * reversals and a trapezoid. Reports the largest velocity and acceleration
+ * deviation, the time to land on the target against the ideal, and the
+ * host cost per update.
+ *
+ * Fails if a tick changes the velocity by more than max_accel * dt or the
+ * acceleration by more than max_jerk * dt, exceeds max_accel, passes the
+ * target, does not end exactly on the target at rest, or lands before the
+ * ideal time or more than PROFILE_MAX_LATE_TICKS after it.
+ */
+int Sim_Bench_Profile(const Sim_Options_t *opt) {
+  static const ProfileStep_t steps[] = {
+      {"scurve_short", 0.0f, 100.0f, DRIVE_MAX_ACCEL, DRIVE_MAX_JERK},
+      {"scurve_long", 0.0f, 1500.0f, DRIVE_MAX_ACCEL, DRIVE_MAX_JERK},
+      {"scurve_reverse", 500.0f, -500.0f, DRIVE_MAX_ACCEL, DRIVE_MAX_JERK},
+      {"scurve_stiff", 0.0f, 1000.0f, 4000.0f, 200000.0f},
+      {"trapezoid", 0.0f, 1000.0f, DRIVE_MAX_ACCEL, 0.0f},
+  };
+  const double dt = 1.0 / opt->rate_hz;
+  uint32_t failures = 0;
+
+  for (uint32_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+    const ProfileStep_t *step = &steps[s];
+    MotionProfile_t profile;
+    double dv, accel;
+    double total = IdealProfile(step->to - step->from, step->max_accel,
+                                step->max_jerk, 0.0, &dv, &accel);
+    uint32_t ticks = (uint32_t)ceil((total + PROFILE_TAIL) / dt);
+    double v_error = 0.0, a_error = 0.0, done = -1.0;
+    double dv_max = 0.0, da_max = 0.0, a_max = 0.0, overshoot = 0.0;
+    double sign = (step->to < step->from) ? -1.0 : 1.0;
+    float v_prev = step->from, a_prev = 0.0f;
+    double elapsed = 0.0;
+
+    MotionProfile_Init(&profile, step->max_accel, step->max_jerk);
+    MotionProfile_Reset(&profile, step->from);
+    MotionProfile_SetTarget(&profile, step->to);
+
+    for (uint32_t n = 1; n <= ticks; n++) {
+      double start = Sim_WallTime();
+      float v = MotionProfile_Update(&profile, (float)dt);
+      elapsed += Sim_WallTime() - start;
+
+      IdealProfile(step->to - step->from, step->max_accel, step->max_jerk,
+                   n * dt, &dv, &accel);
+      v_error = fmax(v_error, fabs(v - (step->from + dv)));
+      /* Trapezoid acceleration is a step: skip the tick containing it */
+      if (step->max_jerk > 0.0f || fabs(n * dt - total) >= dt)
+        a_error = fmax(a_error, fabs(profile.accel - accel));
+      if (done < 0.0 && MotionProfile_IsDone(&profile))
+        done = n * dt;
+
+      dv_max = fmax(dv_max, fabs(v - v_prev));
+      da_max = fmax(da_max, fabs(profile.accel - a_prev));
+      a_max = fmax(a_max, fabs(profile.accel));
+      overshoot = fmax(overshoot, sign * (v - step->to));
+      v_prev = v;
+      a_prev = profile.accel;
+    }
+
+    printf("profile=%s delta=%.0f ideal_time_s=%.4f done_time_s=%.4f "
+           "max_velocity_error=%.2f max_accel_error=%.1f ns_per_update=%.1f\n",
+           step->name, step->to - step->from, total, done, v_error, a_error,
+           ticks ? elapsed * 1e9 / ticks : 0.0);
+
+    double dv_limit = PROFILE_LIMIT_MARGIN * step->max_accel * dt;
+    double da_limit = PROFILE_LIMIT_MARGIN * step->max_jerk * dt;
+    double late = (ceil(total / dt - 1e-6) + PROFILE_MAX_LATE_TICKS) * dt;
+    if (dv_max > dv_limit || a_max > PROFILE_LIMIT_MARGIN * step->max_accel ||
+        (step->max_jerk > 0.0f && da_max > da_limit)) {
+      printf("profile=%s: velocity step %.2f / accel %.1f / accel step %.1f "
+             "over %.2f / %.1f / %.1f\n",
+             step->name, dv_max, a_max, da_max, dv_limit,
+             PROFILE_LIMIT_MARGIN * step->max_accel, da_limit);
+      failures++;
+    }
+    if (overshoot > 0.0) {
+      printf("profile=%s: passed the target by %.3f\n", step->name,
+             overshoot);
+      failures++;
+    }
+    if (v_prev != step->to || a_prev != 0.0f) {
+      printf("profile=%s: ended at %.3f with accel %.3f\n", step->name,
+             v_prev, a_prev);
+      failures++;
+    }
+    if (done < total - 1e-6 || done > late + 1e-6) {
+      printf("profile=%s: done at %.4f s, ideal %.4f s\n", step->name, done,
+             total);
+      failures++;
+    }
+  }
+
+  return Sim_Bench_Result("profile", failures);
+}
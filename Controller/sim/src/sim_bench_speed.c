@@ -0,0 +1,209 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_speed.c
+ * @brief   Speed estimator bench (--bench-speed)
+ ******************************************************************************
+ */
+
+#include "encoder.h"
+#include "main.h"
+#include "sim_bench.h"
+#include "speed_estimator.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* Pass criteria per scenario: estimate RMS error at most the count delta's
+ * (plus rounding: the two match once the count delta takes over), mean
+ * confidence */
+#define SPEED_BENCH_RMS_MARGIN 0.01
+#define SPEED_BENCH_MIN_CONFIDENCE 0.9
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Synthetic encoder edge stream for the speed estimator bench
+ */
+typedef struct {
+  double position;  /* Counts (fractional) */
+  double phase_err; /* Quadrature spacing error (fraction of a count) */
+  int32_t count;
+  int32_t edge_count;
+  uint32_t edge_time;
+  uint8_t capture; /* Timer mode: CC interrupts on (Encoder's GateCapture) */
+} EdgeStream_t;
+
+/* Ramp profiles (counts/s) */
+typedef struct {
+  const char *name;
+  double peak;  /* Cruise speed */
+  double accel; /* counts/s^2 */
+  double decel; /* counts/s^2, 0 to stop at once */
+} SpeedProfile_t;
+
+/**
+ * @brief  Count crossed at position p with alternating edge spacing error
+ */
+static int32_t StreamCount(const EdgeStream_t *stream, double p) {
+  int32_t n = (int32_t)floor(p);
+  /* Odd edges are displaced by phase_err (A/B not exactly 90 degrees) */
+  double frac = p - n;
+  if ((n & 1) && frac < stream->phase_err)
+    n--;
+  return n;
+}
+
+/**
+ * @brief  Advance the stream to time t at speed v, timestamping every
+ *         edge (stamp_every 1, EXTI) or, while capture is on, rising A
+ *         and B (timer captures)
+ */
+static void StreamAdvance(EdgeStream_t *stream, double v, double dt,
+                          double t_end, uint32_t stamp_every) {
+  const double substep = 1e-6;
+  for (double t = t_end - dt; t < t_end - 1e-12; t += substep) {
+    stream->position += v * substep;
+    int32_t n = StreamCount(stream, stream->position);
+    while (n != stream->count) {
+      stream->count += (n > stream->count) ? 1 : -1;
+      uint32_t phase = (uint32_t)stream->count & 3U;
+      if (stamp_every == 1 ||
+          (stream->capture && (phase == 1 || phase == 2))) {
+        stream->edge_count = stream->count;
+        stream->edge_time = (uint32_t)(uint64_t)((t + substep) * SYSTEM_CLOCK_HZ);
+      }
+    }
+  }
+}
+
+/**
+ * @brief  Speed at time t: ramp up, cruise for 1s, stop, rest
+ */
+static double ProfileSpeed(const SpeedProfile_t *profile, double t) {
+  double ramp = profile->peak / profile->accel;
+  if (t < ramp)
+    return profile->accel * t;
+  t -= ramp + 1.0;
+  if (t < 0.0)
+    return profile->peak;
+  if (profile->decel > 0.0 && t < profile->peak / profile->decel)
+    return profile->peak - profile->decel * t;
+  return 0.0;
+}
+
+/**
+ * @brief  Timer mode capture gating, as Encoder's GateCapture
+ */
+static void StreamGate(EdgeStream_t *stream, float speed, double dt) {
+  double counts = fabs(speed) * dt;
+  if (counts >= 2.0 * ENCODER_SPEED_BLEND_COUNTS)
+    stream->capture = 0;
+  else if (counts < ENCODER_SPEED_BLEND_COUNTS)
+    stream->capture = 1;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Speed estimator versus count delta on synthetic edge streams
+ *
+ * Constant speeds with 10% quadrature spacing error, plus ramps up from
+ * rest and cruise: a slow one stopping at once, and a fast one ramping down
+ * through the timer mode capture gate. Errors are against the true speed at each tick. Fails if
+ * the estimate is worse than the count delta in any scenario, or its mean
+ * confidence is below SPEED_BENCH_MIN_CONFIDENCE.
+ */
+int Sim_Bench_Speed(const Sim_Options_t *opt) {
+  static const double speeds[] = {10, 30, 100, 300, 1000, 3000, 10000};
+  static const SpeedProfile_t profiles[] = {
+      {"ramp_cruise_stop", 500.0, 1000.0, 0.0},
+      {"fast_ramp_cruise_ramp", 5000.0, 10000.0, 10000.0},
+  };
+  const uint32_t speed_count = sizeof(speeds) / sizeof(speeds[0]);
+  const uint32_t scenarios =
+      speed_count + sizeof(profiles) / sizeof(profiles[0]);
+  const double dt = 1.0 / opt->rate_hz;
+  const uint32_t stamp_modes[] = {1, 3};
+  uint32_t failures = 0;
+
+  for (uint32_t m = 0; m < 2; m++) {
+    const char *name = (stamp_modes[m] == 1) ? "exti" : "timer";
+
+    for (uint32_t i = 0; i < scenarios; i++) {
+      const SpeedProfile_t *profile =
+          (i >= speed_count) ? &profiles[i - speed_count] : NULL;
+      EdgeStream_t stream = {0.0, 0.1, 0, 0, 0, 1};
+      SpeedEstimator_t est;
+      SpeedEstimator_Init(&est, SYSTEM_CLOCK_HZ, stamp_modes[m],
+                          ENCODER_SPEED_BLEND_COUNTS,
+                          ENCODER_STOP_TIMEOUT_MS / 1000.0f);
+
+      double err_count = 0.0, err_est = 0.0, conf = 0.0;
+      uint32_t samples = 0;
+      int32_t prev_count = 0;
+      uint32_t ticks = (uint32_t)(2.0 * opt->rate_hz);
+
+      for (uint32_t k = 1; k <= ticks; k++) {
+        double t = k * dt;
+        double v = profile ? ProfileSpeed(profile, t) : speeds[i];
+
+        StreamAdvance(&stream, v, dt, t, stamp_modes[m]);
+        uint32_t now = (uint32_t)(uint64_t)(t * SYSTEM_CLOCK_HZ);
+        float v_est = SpeedEstimator_Update(
+            &est, stream.count, stream.edge_count, stream.edge_time, now);
+        double v_count = (stream.count - prev_count) / dt;
+        prev_count = stream.count;
+        StreamGate(&stream, v_est, dt);
+
+        /* Skip start-up; compare against the speed at the tick */
+        if (t < 0.25 && !profile)
+          continue;
+        err_count += (v_count - v) * (v_count - v);
+        err_est += (v_est - v) * (v_est - v);
+        conf += est.confidence;
+        samples++;
+      }
+
+      double count_rms = sqrt(err_count / samples);
+      double hybrid_rms = sqrt(err_est / samples);
+      conf /= samples;
+      if (profile)
+        printf("mode=%s profile=%s", name, profile->name);
+      else
+        printf("mode=%s speed=%.0f", name, speeds[i]);
+      printf(" count_rms=%.2f hybrid_rms=%.2f confidence=%.2f\n", count_rms,
+             hybrid_rms, conf);
+
+      if (hybrid_rms > count_rms + SPEED_BENCH_RMS_MARGIN) {
+        printf("mode=%s: hybrid_rms %.2f > count_rms %.2f\n", name,
+               hybrid_rms, count_rms);
+        failures++;
+      }
+      if (conf < SPEED_BENCH_MIN_CONFIDENCE) {
+        printf("mode=%s: confidence %.2f < %.2f\n", name, conf,
+               SPEED_BENCH_MIN_CONFIDENCE);
+        failures++;
+      }
+    }
+  }
+
+  /* Worst-case path cost: period measurement with blend */
+  SpeedEstimator_t est;
+  SpeedEstimator_Init(&est, SYSTEM_CLOCK_HZ, 1, ENCODER_SPEED_BLEND_COUNTS,
+                      ENCODER_STOP_TIMEOUT_MS / 1000.0f);
+  const uint32_t calls = 10000000;
+  uint32_t period = SYSTEM_CLOCK_HZ / 100;
+  double start = Sim_WallTime();
+  for (uint32_t k = 1; k <= calls; k++) {
+    int32_t count = (int32_t)(k * 12);
+    SpeedEstimator_Update(&est, count, count, k * period - 1000, k * period);
+  }
+  double ns = (Sim_WallTime() - start) * 1e9 / calls;
+  printf("update_ns_per_call=%.2f\n", ns);
+  printf("velocity_check=%.1f\n", est.velocity);
+
+  return Sim_Bench_Result("speed", failures);
+}
@@ -0,0 +1,263 @@
+/**
+ ******************************************************************************
+ * @file    sim_bench_telemetry.c
+ * @brief   Telemetry framing and link bench (--bench-telemetry)
+ ******************************************************************************
+ */
+
+#include "control_loop.h"
+#include "main.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include "sim_periph.h"
+#include "telemetry.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* --bench-telemetry: random frames encoded, link test length */
+#define TELEMETRY_FRAMES 20000U
+#define TELEMETRY_LINK_TIME 2.0
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Reference CRC for telemetry frames: table-driven CRC-32 (MSB
+ *         first, init 0xFFFFFFFF) over little-endian words, independent of
+ *         the simulated CRC unit
+ */
+static uint32_t ReferenceCrc(const uint8_t *data, uint32_t words) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i << 24;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc & 0x80000000U) ? (crc << 1) ^ 0x04C11DB7U : crc << 1;
+      table[i] = crc;
+    }
+  }
+
+  uint32_t crc = 0xFFFFFFFFU;
+  for (uint32_t w = 0; w < words; w++) {
+    /* The unit takes each word MSB first */
+    for (int byte = 3; byte >= 0; byte--)
+      crc = (crc << 8) ^ table[(crc >> 24) ^ data[4 * w + byte]];
+  }
+  return crc;
+}
+
+/**
+ * @brief  COBS decode (no delimiter)
+ * @retval Decoded length, -1 if malformed or too long
+ */
+static int32_t CobsDecode(const uint8_t *in, uint32_t length, uint8_t *out,
+                          uint32_t capacity) {
+  uint32_t i = 0, o = 0;
+
+  while (i < length) {
+    uint8_t code = in[i++];
+    if (code == 0)
+      return -1;
+    for (uint8_t k = 1; k < code; k++) {
+      if (i >= length || in[i] == 0 || o >= capacity)
+        return -1;
+      out[o++] = in[i++];
+    }
+    if (code < 0xFF && i < length) {
+      if (o >= capacity)
+        return -1;
+      out[o++] = 0;
+    }
+  }
+  return (int32_t)o;
+}
+
+/**
+ * @brief  Check and unpack one received frame (delimiter stripped)
+ * @retval 0 if valid, -1 otherwise
+ */
+static int DecodeTelemetryFrame(const uint8_t *in, uint32_t length,
+                                Telemetry_Frame_t *frame) {
+  uint8_t payload[TELEMETRY_ENCODED_MAX];
+  int32_t n = CobsDecode(in, length, payload, sizeof(payload));
+
+  if (n != (int32_t)TELEMETRY_PAYLOAD_LEN)
+    return -1;
+  uint32_t crc = (uint32_t)payload[TELEMETRY_FRAME_LEN] |
+                 (uint32_t)payload[TELEMETRY_FRAME_LEN + 1] << 8 |
+                 (uint32_t)payload[TELEMETRY_FRAME_LEN + 2] << 16 |
+                 (uint32_t)payload[TELEMETRY_FRAME_LEN + 3] << 24;
+  if (crc != ReferenceCrc(payload, TELEMETRY_FRAME_LEN / 4U))
+    return -1;
+  memcpy(frame, payload, TELEMETRY_FRAME_LEN);
+  return 0;
+}
+
+/**
+ * @brief  Frame with random fields, a quarter of the words zero
+ */
+static void RandomTelemetryFrame(Telemetry_Frame_t *frame, uint32_t *rng) {
+  uint32_t words[TELEMETRY_FRAME_LEN / 4U];
+
+  for (uint32_t i = 0; i < TELEMETRY_FRAME_LEN / 4U; i++) {
+    uint32_t value = Sim_XorShift(rng);
+    words[i] = (Sim_XorShift(rng) & 3U) ? value : 0U;
+  }
+  memcpy(frame, words, sizeof(words));
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Telemetry framing: COBS vectors, random frame round trips with
+ *         single-bit corruption, and (telemetry build) the DMA link at
+ *         several publish rates decoded from the USART3 byte stream
+ */
+int Sim_Bench_Telemetry(const Sim_Options_t *opt) {
+  Sim_Bench_InitBoard(opt->seed);
+
+  uint32_t rng = opt->seed ? opt->seed : 1;
+  uint32_t failures = 0;
+
+  /* COBS: block boundaries and zero runs */
+  static const uint32_t lengths[] = {0, 1, 2, 253, 254, 255, 508, 509, 600};
+  uint32_t vectors = 0, cobs_failures = 0;
+  for (uint32_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+    for (uint32_t pattern = 0; pattern < 4; pattern++) {
+      uint8_t in[600], out[620], back[620];
+      uint32_t n = lengths[l];
+
+      for (uint32_t i = 0; i < n; i++) {
+        switch (pattern) {
+        case 0: /* All zero */
+          in[i] = 0;
+          break;
+        case 1: /* No zero */
+          in[i] = (uint8_t)(1 + i % 255);
+          break;
+        case 2: /* Alternating */
+          in[i] = (uint8_t)((i & 1) ? 0x5A : 0);
+          break;
+        default: /* Random, about 10% zero */
+          in[i] = (Sim_XorShift(&rng) % 10U)
+                      ? (uint8_t)(1 + Sim_XorShift(&rng) % 255)
+                      : 0;
+          break;
+        }
+      }
+
+      uint32_t m = Telemetry_CobsEncode(in, n, out);
+      uint8_t ok = (m <= n + n / 254U + 1U);
+      for (uint32_t i = 0; i < m; i++)
+        ok &= (out[i] != 0);
+      ok &= (CobsDecode(out, m, back, sizeof(back)) == (int32_t)n &&
+             memcmp(in, back, n) == 0);
+      vectors++;
+      cobs_failures += !ok;
+    }
+  }
+  printf("cobs_vectors=%u cobs_failures=%u\n", vectors, cobs_failures);
+  failures += cobs_failures;
+
+  /* Frames: round trip, then one flipped bit must be rejected */
+  uint32_t roundtrip_failures = 0, undetected = 0, max_len = 0;
+  double elapsed = 0.0;
+  for (uint32_t n = 0; n < TELEMETRY_FRAMES; n++) {
+    Telemetry_Frame_t frame, decoded;
+    uint8_t encoded[TELEMETRY_ENCODED_MAX];
+    RandomTelemetryFrame(&frame, &rng);
+
+    double start = Sim_WallTime();
+    uint32_t length = Telemetry_Encode(&frame, encoded);
+    elapsed += Sim_WallTime() - start;
+    if (length > max_len)
+      max_len = length;
+
+    uint8_t ok = (length <= TELEMETRY_ENCODED_MAX && encoded[length - 1] == 0);
+    for (uint32_t i = 0; ok && i + 1 < length; i++)
+      ok = (encoded[i] != 0);
+    ok = ok && DecodeTelemetryFrame(encoded, length - 1, &decoded) == 0 &&
+         memcmp(&frame, &decoded, sizeof(frame)) == 0;
+    roundtrip_failures += !ok;
+
+    /* A flip that makes a zero splits the frame where the receiver would */
+    uint32_t at = Sim_XorShift(&rng) % (length - 1);
+    encoded[at] ^= (uint8_t)(1U << (Sim_XorShift(&rng) % 8U));
+    uint32_t end = 0;
+    while (encoded[end] != 0)
+      end++;
+    if (DecodeTelemetryFrame(encoded, end, &decoded) == 0)
+      undetected++;
+  }
+  printf("frames=%u roundtrip_failures=%u corrupted=%u undetected=%u "
+         "max_encoded_bytes=%u ns_per_encode=%.1f\n",
+         TELEMETRY_FRAMES, roundtrip_failures, TELEMETRY_FRAMES, undetected,
+         max_len, elapsed * 1e9 / TELEMETRY_FRAMES);
+  failures += roundtrip_failures + undetected;
+
+#if TELEMETRY_ENABLE
+  /* Link: publish from the main context, decode what the USART sent */
+  static const uint32_t rates[] = {500, 1000, 2000};
+  for (uint32_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+    char *stream = NULL;
+    size_t stream_len = 0;
+    FILE *capture = open_memstream(&stream, &stream_len);
+    if (capture == NULL)
+      return EXIT_FAILURE;
+
+    Sim_Bench_InitBoard(opt->seed);
+    Sim_USART3_SetOutput(capture);
+    Telemetry_Init();
+
+    double period = 1.0 / rates[r];
+    for (double t = 0.0; t < TELEMETRY_LINK_TIME; t += period) {
+      Telemetry_Frame_t frame;
+      RandomTelemetryFrame(&frame, &rng);
+      Telemetry_Publish(&frame);
+      Sim_Board_Advance(period);
+    }
+    for (double waited = 0.0; Telemetry_IsBusy() && waited < 0.01;
+         waited += 0.001)
+      Sim_Board_Advance(0.001);
+    Sim_USART3_SetOutput(NULL);
+    fclose(capture);
+
+    Telemetry_Stats_t stats;
+    Telemetry_GetStats(&stats);
+    uint32_t received = 0, bad = 0, missing = 0;
+    int32_t last_seq = -1;
+    size_t start = 0;
+    for (size_t i = 0; i < stream_len; i++) {
+      if (stream[i] != 0)
+        continue;
+      Telemetry_Frame_t frame;
+      if (DecodeTelemetryFrame((const uint8_t *)stream + start,
+                               (uint32_t)(i - start), &frame) == 0) {
+        if (last_seq >= 0)
+          missing += (uint16_t)(frame.seq - last_seq - 1);
+        last_seq = frame.seq;
+        received++;
+      } else {
+        bad++;
+      }
+      start = i + 1;
+    }
+    free(stream);
+
+    double load = 100.0 * stream_len * 10.0 /
+                  (TELEMETRY_UART_BAUD * TELEMETRY_LINK_TIME);
+    printf("rate_hz=%u published=%u sent=%u dropped=%u received=%u bad=%u "
+           "seq_gaps=%u link_load_pct=%.1f\n",
+           rates[r], stats.published, stats.sent, stats.dropped, received,
+           bad, missing, load);
+    if (received != stats.sent || bad != 0 || missing != stats.dropped ||
+        stats.published != stats.sent + stats.dropped)
+      failures++;
+  }
+#endif
+
+  return Sim_Bench_Result("telemetry", failures);
+}
@@ -0,0 +1,344 @@
+/**
+ ******************************************************************************
+ * @file    sim_board.c
+ * @brief   Simulated robot board: wires the plant to the MCU pins
+ ******************************************************************************
+ */
+
+#include "sim_board.h"
+#include "encoder.h"
+#include "main.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ================ Private Defines ================ */
+
+#define RAD_TO_DEG 57.29577951f
+#define GRAVITY 9.80665f
+
+/* Default cost of an interrupt handler in cycles: exception entry and exit
+ * (about 24 on a Cortex-M3) plus a short body. A model, not a measurement. */
+#define SIM_IRQ_CYCLES 100U
+
+/* Quadrature (A, B) levels for count mod 4, forward = 00 -> 10 -> 11 -> 01 */
+static const uint8_t quad_a[4] = {0, 1, 1, 0};
+static const uint8_t quad_b[4] = {0, 0, 1, 1};
+
+/* ================ Firmware Globals ================ */
+
+/* Normally defined in main.c, which the host build replaces */
+volatile uint32_t systick_counter = 0;
+
+/* ================ Private Variables ================ */
+
+static Plant_t plant;
+static double step_dt;
+static double sim_time;       /* CPU time */
+static double next_step_time; /* Physics time */
+static double next_tick_time;
+static uint8_t advancing = 0;
+
+/* General-purpose timers with update interrupts (0 = not armed) */
+static TIM_TypeDef *const timers[] = {TIM2, TIM3, TIM4};
+static const int32_t timer_irqs[] = {TIM2_IRQn, TIM3_IRQn, TIM4_IRQn};
+#define TIMER_COUNT (sizeof(timers) / sizeof(timers[0]))
+static double next_update_time[TIMER_COUNT];
+
+/* Encoder line state (count the pins currently show) */
+static int64_t left_edges;
+static int64_t right_edges;
+
+/* Wheels spun at fixed rates instead of by the motors */
+static uint8_t spin_wheels = 0;
+static float spin_omega[2];
+
+/* Body turned at a set yaw rate instead of by the wheels */
+static uint8_t rotate_body = 0;
+static float rotate_rate;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Read one H-bridge from the direction pins and a TIM3 channel
+ * @note   PWM mode 1: active while CNT < CCR, over ARR + 1 counts edge-aligned
+ *         or 2 * ARR center-aligned (duty CCR / ARR)
+ */
+static void ReadBridge(GPIO_TypeDef *port, uint8_t in1_pin, uint8_t in2_pin,
+                       volatile uint32_t *ccr, uint32_t ccer_enable,
+                       Plant_Bridge_t *bridge) {
+  uint32_t period = TIM3->ARR & 0xFFFF;
+
+  if (!(TIM3->CR1 & TIM_CR1_CMS))
+    period++;
+
+  bridge->in1 = Sim_GPIO_GetOutput(port, in1_pin);
+  bridge->in2 = Sim_GPIO_GetOutput(port, in2_pin);
+  bridge->duty = 0.0f;
+
+  if ((TIM3->CR1 & TIM_CR1_CEN) && (TIM3->CCER & ccer_enable)) {
+    uint32_t compare = *ccr & 0xFFFF;
+    bridge->duty = (compare >= period) ? 1.0f : (float)compare / period;
+  }
+}
+
+/**
+ * @brief  Emit quadrature edges until the pins show the wheel position
+ */
+static void DriveEncoder(GPIO_TypeDef *port, uint8_t pin_a, uint8_t pin_b,
+                         int64_t *edges, double angle) {
+  int64_t target = (int64_t)floor(angle * ENCODER_CPR / (2.0 * M_PI));
+
+  while (*edges != target) {
+    *edges += (target > *edges) ? 1 : -1;
+    uint8_t phase = (uint8_t)(*edges & 3);
+    Sim_GPIO_SetInput(port, pin_a, quad_a[phase]);
+    Sim_GPIO_SetInput(port, pin_b, quad_b[phase]);
+  }
+}
+
+/**
+ * @brief  One physics step
+ */
+static void Step(void) {
+  Plant_Bridge_t left, right;
+  double t = next_step_time;
+
+  next_step_time += step_dt;
+
+  if (spin_wheels) {
+    plant.left.omega = spin_omega[0];
+    plant.right.omega = spin_omega[1];
+    plant.left.angle += spin_omega[0] * step_dt;
+    plant.right.angle += spin_omega[1] * step_dt;
+  } else {
+    Sim_Board_GetBridges(&left, &right);
+    Plant_Step(&plant, &left, &right, (float)step_dt);
+  }
+
+  if (rotate_body) {
+    plant.yaw_rate = rotate_rate;
+    plant.theta += (double)rotate_rate * step_dt;
+  }
+
+  /* Wiring follows the encoder backend the firmware selected */
+  if (Encoder_GetMode() == ENCODER_MODE_TIMER) {
+    DriveEncoder(GPIOA, 0, 1, &left_edges, plant.left.angle);
+    DriveEncoder(GPIOA, 8, 9, &right_edges, plant.right.angle);
+  } else {
+    DriveEncoder(GPIOA, 1, 2, &left_edges, plant.left.angle);
+    DriveEncoder(GPIOB, 8, 9, &right_edges, plant.right.angle);
+  }
+
+  float gyro[3] = {0.0f, 0.0f, plant.yaw_rate * RAD_TO_DEG};
+  float accel[3] = {plant.accel / GRAVITY, plant.v * plant.yaw_rate / GRAVITY,
+                    1.0f};
+  Sim_MPU6050_Step(t, gyro, accel);
+}
+
+/**
+ * @brief  Timer update period in seconds
+ */
+static double TimerPeriod(const TIM_TypeDef *tim) {
+  /* Center-aligned: an update at both ends of the up/down count */
+  uint32_t counts = (tim->CR1 & TIM_CR1_CMS) ? (tim->ARR & 0xFFFF)
+                                             : (tim->ARR & 0xFFFF) + 1;
+  return (double)((tim->PSC & 0xFFFF) + 1) * counts / SYSTEM_CLOCK_HZ;
+}
+
+/**
+ * @brief  Arm or disarm timers whose CEN/UIE changed since the last event
+ * @note   Timers in slave/encoder mode are clocked by their inputs instead
+ */
+static void SyncTimers(void) {
+  for (uint32_t i = 0; i < TIMER_COUNT; i++) {
+    uint8_t running = (timers[i]->CR1 & TIM_CR1_CEN) &&
+                      (timers[i]->DIER & TIM_DIER_UIE) &&
+                      !(timers[i]->SMCR & TIM_SMCR_SMS);
+    if (!running)
+      next_update_time[i] = 0.0;
+    else if (next_update_time[i] == 0.0)
+      next_update_time[i] = sim_time + TimerPeriod(timers[i]);
+  }
+}
+
+/**
+ * @brief  Keep DWT->CYCCNT at SYSCLK cycles of simulated time
+ */
+static void SyncCycleCounter(void) {
+  if (Sim_DWT.CTRL & DWT_CTRL_CYCCNTENA_Msk)
+    Sim_DWT.CYCCNT = (uint32_t)(uint64_t)(sim_time * SYSTEM_CLOCK_HZ + 0.5);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Fill in default board configuration
+ */
+void Sim_Board_DefaultConfig(Sim_Board_Config_t *config) {
+  Plant_DefaultConfig(&config->plant);
+  config->imu.gyro_bias_dps[0] = 0.3f;
+  config->imu.gyro_bias_dps[1] = -0.2f;
+  config->imu.gyro_bias_dps[2] = 0.5f;
+  config->imu.gyro_tempco_dps = 0.02f;
+  config->imu.gyro_noise_dps = 0.05f;
+  config->imu.accel_noise_g = 0.004f;
+  config->imu.temperature_c = 25.0f;
+  config->imu.seed = 1;
+  config->physics_hz = 10000.0f;
+  config->irq_cycles = SIM_IRQ_CYCLES;
+}
+
+/**
+ * @brief  Reset peripherals, plant and sensors
+ */
+void Sim_Board_Init(const Sim_Board_Config_t *config) {
+  Sim_Periph_Reset();
+  Plant_Init(&plant, &config->plant);
+  Sim_MPU6050_Init(&config->imu);
+  Sim_Periph_SetClock(Sim_Board_GetTime, Sim_Board_Advance);
+  Sim_Periph_SetIRQCost(config->irq_cycles, Sim_Board_Spend);
+
+  step_dt = 1.0 / config->physics_hz;
+  sim_time = 0.0;
+  next_step_time = step_dt;
+  next_tick_time = 0.001;
+  left_edges = 0;
+  right_edges = 0;
+  spin_wheels = 0;
+  rotate_body = 0;
+  for (uint32_t i = 0; i < TIMER_COUNT; i++)
+    next_update_time[i] = 0.0;
+  systick_counter = 0;
+}
+
+/**
+ * @brief  Advance simulated time, running physics and interrupts
+ */
+void Sim_Board_Advance(double seconds) {
+  /* Called again from inside a handler (bus time spent in an ISR): the CPU
+   * is busy, so only the clock moves. Pending events catch up on return. */
+  if (advancing) {
+    sim_time += seconds;
+    SyncCycleCounter();
+    return;
+  }
+
+  double end = sim_time + seconds;
+  advancing = 1;
+
+  for (;;) {
+    SyncTimers();
+
+    /* Earliest pending event */
+    double t = next_step_time;
+    int32_t timer = -1;
+    if (next_tick_time < t)
+      t = next_tick_time;
+    double periph_time = Sim_Periph_NextEventTime();
+    if (periph_time < t)
+      t = periph_time;
+    for (uint32_t i = 0; i < TIMER_COUNT; i++) {
+      if (next_update_time[i] != 0.0 && next_update_time[i] < t) {
+        t = next_update_time[i];
+        timer = (int32_t)i;
+      }
+    }
+    if (t > end)
+      break;
+
+    if (t > sim_time)
+      sim_time = t;
+    SyncCycleCounter();
+
+    if (timer >= 0) {
+      /* Updates due while the CPU was busy set the same UIF: one interrupt */
+      do
+        next_update_time[timer] += TimerPeriod(timers[timer]);
+      while (next_update_time[timer] <= sim_time);
+      timers[timer]->SR |= TIM_SR_UIF;
+      Sim_RaiseIRQ(timer_irqs[timer]);
+    } else if (t == periph_time) {
+      Sim_Periph_Service();
+    } else if (t == next_tick_time) {
+      next_tick_time += 0.001;
+      Sim_RaiseIRQ(SysTick_IRQn);
+    } else {
+      Step();
+    }
+  }
+
+  /* A handler that consumed CPU or bus time pushes the clock past end; the
+   * events due meanwhile have run late, in order */
+  if (sim_time < end)
+    sim_time = end;
+  SyncCycleCounter();
+  advancing = 0;
+}
+
+/**
+ * @brief  Get simulated time in seconds
+ */
+double Sim_Board_GetTime(void) { return sim_time; }
+
+/**
+ * @brief  Spend CPU cycles on firmware computation
+ */
+void Sim_Board_Spend(uint32_t cycles) {
+  sim_time += (double)cycles / SYSTEM_CLOCK_HZ;
+  SyncCycleCounter();
+}
+
+/**
+ * @brief  Get plant (ground truth) state
+ */
+const Plant_t *Sim_Board_GetPlant(void) { return &plant; }
+
+/**
+ * @brief  Get the H-bridge inputs the firmware is currently driving
+ */
+void Sim_Board_GetBridges(Plant_Bridge_t *left, Plant_Bridge_t *right) {
+  ReadBridge(GPIOA, 4, 5, &TIM3->CCR1, TIM_CCER_CC1E, left);
+  ReadBridge(GPIOB, 0, 1, &TIM3->CCR2, TIM_CCER_CC2E, right);
+}
+
+/**
+ * @brief  Spin the wheels at fixed rates, ignoring the motors
+ */
+void Sim_Board_SpinWheels(uint8_t enable, float left_omega,
+                          float right_omega) {
+  spin_wheels = enable;
+  spin_omega[0] = left_omega;
+  spin_omega[1] = right_omega;
+}
+
+/**
+ * @brief  Turn the body at a fixed yaw rate, ignoring the wheels
+ */
+void Sim_Board_RotateBody(uint8_t enable, float yaw_rate) {
+  rotate_body = enable;
+  rotate_rate = yaw_rate;
+}
+
+/**
+ * @brief  Get the encoder positions the board has signalled (ground truth)
+ */
+void Sim_Board_GetEncoderEdges(int64_t *left, int64_t *right) {
+  *left = left_edges;
+  *right = right_edges;
+}
+
+/* ================ Firmware Services ================ */
+
+/**
+ * @brief  Delay in milliseconds (advances simulated time)
+ */
+void delay_ms(uint32_t ms) { Sim_Board_Advance(ms * 0.001); }
+
+/**
+ * @brief  Error handler
+ */
+void Error_Handler(void) {
+  fprintf(stderr, "Error_Handler called at t=%.4f s\n", sim_time);
+  exit(EXIT_FAILURE);
+}
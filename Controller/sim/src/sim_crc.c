@@ -0,0 +1,47 @@
+/**
+ ******************************************************************************
+ * @file    sim_crc.c
+ * @brief   Simulated CRC calculation unit
+ ******************************************************************************
+ *
+ * Same arithmetic as the STM32F1 CRC unit: CRC-32 with polynomial
+ * 0x04C11DB7, MSB first over each 32-bit word written to DR, no input or
+ * output reflection and no final XOR. CR.RESET loads 0xFFFFFFFF. DR reads
+ * return the running value. Calculation takes no simulated time.
+ *
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+
+/* ================ Private Defines ================ */
+
+#define CRC_POLY 0x04C11DB7UL
+
+/* ================ Register Hooks ================ */
+
+/**
+ * @brief  DR write: feed one word
+ */
+void Sim_CRC_WriteDR(uint32_t value) {
+  uint32_t crc = CRC->DR ^ value;
+
+  for (int bit = 0; bit < 32; bit++)
+    crc = (crc & 0x80000000UL) ? (crc << 1) ^ CRC_POLY : crc << 1;
+  CRC->DR = crc;
+}
+
+/**
+ * @brief  CR write: RESET reloads the initial value (self-clearing)
+ */
+void Sim_CRC_WriteCR(uint32_t value) {
+  if (value & CRC_CR_RESET)
+    CRC->DR = 0xFFFFFFFFUL;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset the calculation unit
+ */
+void Sim_CRC_Reset(void) { CRC->DR = 0xFFFFFFFFUL; }
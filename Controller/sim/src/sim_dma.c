@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * @file    sim_dma.c
+ * @brief   Simulated DMA1 controller
+ ******************************************************************************
+ *
+ * Peripherals call Sim_DMA_Request() when they raise a DMA request; one
+ * data item moves per request. Peripheral-side accesses go through
+ * Sim_ReadReg/Sim_WriteReg so register side effects (e.g. RXNE clearing on
+ * a DR read) still happen. CPAR/CMAR hold 32-bit addresses, which is why
+ * the simulator is linked as a non-PIE executable.
+ *
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+#define DMA_CHANNELS 7
+#define CHANNEL_STRIDE 0x14U
+
+/* Per-channel flag positions in DMA1->ISR / IFCR */
+#define FLAG_GIF 0x1U
+#define FLAG_TCIF 0x2U
+#define FLAG_HTIF 0x4U
+#define FLAG_TEIF 0x8U
+
+/* ================ Private Variables ================ */
+
+/* Transfer size latched on enable and items moved since */
+static uint32_t start_count[DMA_CHANNELS];
+static uint32_t moved[DMA_CHANNELS];
+
+/* ================ Private Functions ================ */
+
+static DMA_Channel_TypeDef *Channel(uint8_t channel) {
+  return (DMA_Channel_TypeDef *)((uintptr_t)DMA1_Channel1 +
+                                 (channel - 1) * CHANNEL_STRIDE);
+}
+
+static uint32_t ReadMemory(uintptr_t addr, uint32_t size) {
+  switch (size) {
+  case 1:
+    return *(volatile uint8_t *)addr;
+  case 2:
+    return *(volatile uint16_t *)addr;
+  default:
+    return *(volatile uint32_t *)addr;
+  }
+}
+
+static void WriteMemory(uintptr_t addr, uint32_t size, uint32_t value) {
+  switch (size) {
+  case 1:
+    *(volatile uint8_t *)addr = (uint8_t)value;
+    break;
+  case 2:
+    *(volatile uint16_t *)addr = (uint16_t)value;
+    break;
+  default:
+    *(volatile uint32_t *)addr = value;
+    break;
+  }
+}
+
+/**
+ * @brief  Set channel flags and raise the channel interrupt if enabled
+ */
+static void SetFlags(uint8_t channel, uint32_t flags) {
+  DMA_Channel_TypeDef *ch = Channel(channel);
+  uint32_t shift = (channel - 1) * 4U;
+  uint8_t raise = 0;
+
+  DMA1->ISR |= (flags | FLAG_GIF) << shift;
+
+  if ((flags & FLAG_TCIF) && (ch->CCR & DMA_CCR_TCIE))
+    raise = 1;
+  if ((flags & FLAG_HTIF) && (ch->CCR & DMA_CCR_HTIE))
+    raise = 1;
+  if ((flags & FLAG_TEIF) && (ch->CCR & DMA_CCR_TEIE))
+    raise = 1;
+
+  if (raise)
+    Sim_RaiseIRQ(DMA1_Channel1_IRQn + channel - 1);
+}
+
+/* ================ Register Hooks ================ */
+
+/**
+ * @brief  DMA1 register write side effects
+ * @retval 1 if the register belongs to DMA1
+ */
+uint8_t Sim_DMA_Write(volatile uint32_t *reg, uint32_t value) {
+  if (reg == &DMA1->IFCR) {
+    DMA1->ISR &= ~value; /* Write 1 to clear */
+    return 1;
+  }
+
+  for (uint8_t channel = 1; channel <= DMA_CHANNELS; channel++) {
+    DMA_Channel_TypeDef *ch = Channel(channel);
+    if (reg != &ch->CCR)
+      continue;
+
+    /* Enabling latches the transfer size and restarts the addresses */
+    if ((value & DMA_CCR_EN) && !(ch->CCR & DMA_CCR_EN)) {
+      start_count[channel - 1] = ch->CNDTR & 0xFFFF;
+      moved[channel - 1] = 0;
+    }
+    ch->CCR = value;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset DMA model state
+ */
+void Sim_DMA_Reset(void) {
+  memset(start_count, 0, sizeof(start_count));
+  memset(moved, 0, sizeof(moved));
+}
+
+/**
+ * @brief  Peripheral DMA request: move one data item on a DMA1 channel
+ */
+void Sim_DMA_Request(uint8_t channel) {
+  if (channel < 1 || channel > DMA_CHANNELS)
+    return;
+
+  DMA_Channel_TypeDef *ch = Channel(channel);
+  uint32_t ccr = ch->CCR;
+  uint32_t remaining = ch->CNDTR & 0xFFFF;
+
+  if (!(ccr & DMA_CCR_EN) || remaining == 0)
+    return;
+
+  uint32_t psize = 1U << ((ccr & DMA_CCR_PSIZE) >> DMA_CCR_PSIZE_Pos);
+  uint32_t msize = 1U << ((ccr & DMA_CCR_MSIZE) >> DMA_CCR_MSIZE_Pos);
+  uint32_t index = moved[channel - 1];
+  uintptr_t paddr = (uintptr_t)ch->CPAR + ((ccr & DMA_CCR_PINC) ? index * psize : 0);
+  uintptr_t maddr = (uintptr_t)ch->CMAR + ((ccr & DMA_CCR_MINC) ? index * msize : 0);
+
+  /* Peripheral registers are 32-bit words; narrower accesses hit the low
+   * bits */
+  volatile uint32_t *preg = (volatile uint32_t *)(paddr & ~(uintptr_t)3);
+
+  if (ccr & DMA_CCR_DIR) {
+    Sim_WriteReg(preg, ReadMemory(maddr, msize));
+  } else {
+    WriteMemory(maddr, msize, Sim_ReadReg(preg));
+  }
+
+  moved[channel - 1] = index + 1;
+  remaining--;
+  ch->CNDTR = remaining;
+
+  uint32_t flags = 0;
+  if (remaining == start_count[channel - 1] / 2)
+    flags |= FLAG_HTIF;
+  if (remaining == 0) {
+    flags |= FLAG_TCIF;
+    if (ccr & DMA_CCR_CIRC) {
+      ch->CNDTR = start_count[channel - 1];
+      moved[channel - 1] = 0;
+    }
+  }
+  if (flags)
+    SetFlags(channel, flags);
+}
+
+/**
+ * @brief  Items moved since the channel was enabled (or last wrapped)
+ */
+uint32_t Sim_DMA_Moved(uint8_t channel) {
+  return (channel >= 1 && channel <= DMA_CHANNELS) ? moved[channel - 1] : 0;
+}
@@ -0,0 +1,298 @@
+/**
+ ******************************************************************************
+ * @file    sim_flash.c
+ * @brief   Simulated main flash and its program/erase controller
+ ******************************************************************************
+ *
+ * The flash contents live in Sim_FlashMem (FLASH_BASE in the host build).
+ * The firmware writes halfwords into it directly, as on the target; the
+ * model checks them against its own copy of the contents at the next FLASH
+ * register access:
+ *   - Written with CR.PG set and the controller unlocked: programmed if the
+ *     halfword was erased (0xFFFF) or the value is 0x0000, otherwise PGERR
+ *     and the old value stays
+ *   - Written any other way: the old value stays
+ * CR.STRT with CR.PER erases the page at AR. KEY1 then KEY2 in KEYR clears
+ * CR.LOCK; a wrong key locks the controller until the next reset. SR.EOP,
+ * PGERR and WRPRTERR are write-1-to-clear.
+ *
+ * Operations complete before the register access returns (BSY never reads
+ * set) and stall the CPU with interrupts held off: 52us per halfword, 20ms
+ * per page erase.
+ *
+ * Sim_Flash_CutPower() makes a later operation the last one: a halfword
+ * being programmed ends up with its old or its new value, a page being
+ * erased with random bits set; nothing after it reaches the flash. Contents
+ * survive Sim_Periph_Reset(); Sim_Flash_Erase() starts from a blank chip.
+ *
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+#define PAGE_SIZE 0x400U
+#define PAGE_COUNT (SIM_FLASH_SIZE / PAGE_SIZE)
+
+#define PROGRAM_TIME 52e-6
+#define ERASE_TIME 20e-3
+
+#define SR_W1C (FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR)
+
+/* ================ Private Variables ================ */
+
+uint32_t Sim_FlashMem[SIM_FLASH_SIZE / 4];
+
+static uint16_t contents[SIM_FLASH_SIZE / 2]; /* What the flash holds */
+static uint8_t blank = 0;                      /* contents initialized */
+static uint8_t key_stage = 0;
+static uint8_t key_error = 0;
+
+static uint8_t powered = 1;
+static uint8_t cut_armed = 0;
+static uint32_t cut_countdown = 0; /* Operations left before the cut one */
+static uint32_t random_state = 1;
+
+static Sim_Flash_Stats_t stats;
+static uint32_t page_erases[PAGE_COUNT];
+
+/* ================ Private Functions ================ */
+
+static uint16_t *Mem(void) { return (uint16_t *)Sim_FlashMem; }
+
+static uint32_t Random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/**
+ * @brief  Busy time of an operation: the CPU stalls, interrupts wait
+ */
+static void Stall(double seconds) {
+  uint32_t primask = Sim_GetPrimask();
+
+  Sim_SetPrimask(1U);
+  Sim_Wait(seconds);
+  stats.busy_time += seconds;
+  Sim_SetPrimask(primask);
+}
+
+/**
+ * @brief  Start an operation
+ * @retval 1 to carry it out, 0 if the power fails during it
+ */
+static uint8_t Operation(void) {
+  if (!cut_armed)
+    return 1;
+  if (cut_countdown--)
+    return 1;
+
+  cut_armed = 0;
+  powered = 0;
+  return 0;
+}
+
+/**
+ * @brief  Halfword found written in Sim_FlashMem
+ */
+static void Program(uint32_t index) {
+  uint16_t value = Mem()[index];
+  uint16_t old = contents[index];
+
+  Mem()[index] = old;
+  if (!powered || (FLASH->CR & (FLASH_CR_PG | FLASH_CR_LOCK)) != FLASH_CR_PG)
+    return;
+
+  if (old != 0xFFFFU && value != 0x0000U) {
+    FLASH->SR |= FLASH_SR_PGERR;
+    stats.errors++;
+    return;
+  }
+  if (!Operation()) {
+    if (Random() & 1U)
+      contents[index] = Mem()[index] = value;
+    return;
+  }
+
+  contents[index] = Mem()[index] = value;
+  stats.programs++;
+  Stall(PROGRAM_TIME);
+  FLASH->SR |= FLASH_SR_EOP;
+}
+
+/**
+ * @brief  Check Sim_FlashMem for halfwords written since the last access
+ */
+static void Sync(void) {
+  for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+    uint32_t first = page * (PAGE_SIZE / 2);
+
+    if (memcmp(&Mem()[first], &contents[first], PAGE_SIZE) == 0)
+      continue;
+    for (uint32_t i = first; i < first + PAGE_SIZE / 2; i++) {
+      if (Mem()[i] != contents[i])
+        Program(i);
+    }
+  }
+}
+
+/**
+ * @brief  Page erase started with CR.PER + CR.STRT
+ */
+static void Erase(uint32_t address) {
+  uint32_t offset = address - (uint32_t)FLASH_BASE;
+
+  if (!powered)
+    return;
+  if (address < (uint32_t)FLASH_BASE || offset >= SIM_FLASH_SIZE) {
+    FLASH->SR |= FLASH_SR_WRPRTERR;
+    stats.errors++;
+    return;
+  }
+
+  uint32_t page = offset / PAGE_SIZE;
+  uint16_t *words = &contents[page * (PAGE_SIZE / 2)];
+
+  if (!Operation()) {
+    /* Cut short: some bits already erased */
+    for (uint32_t i = 0; i < PAGE_SIZE / 2; i++)
+      words[i] |= (uint16_t)(Random() & Random());
+  } else {
+    memset(words, 0xFF, PAGE_SIZE);
+    stats.erases++;
+    if (++page_erases[page] > stats.max_page_erases)
+      stats.max_page_erases = page_erases[page];
+    Stall(ERASE_TIME);
+    FLASH->SR |= FLASH_SR_EOP;
+  }
+  memcpy(&Mem()[page * (PAGE_SIZE / 2)], words, PAGE_SIZE);
+}
+
+/* ================ Register Hooks ================ */
+
+/**
+ * @brief  SR read: finish the operations written so far
+ */
+uint32_t Sim_Flash_ReadSR(void) {
+  Sync();
+  return FLASH->SR;
+}
+
+/**
+ * @brief  SR write: EOP, PGERR and WRPRTERR are write-1-to-clear
+ */
+void Sim_Flash_WriteSR(uint32_t value) {
+  Sync();
+  FLASH->SR &= ~(value & SR_W1C);
+}
+
+/**
+ * @brief  KEYR write: unlock sequence
+ */
+void Sim_Flash_WriteKEYR(uint32_t value) {
+  Sync();
+  if (!(FLASH->CR & FLASH_CR_LOCK) || key_error)
+    return;
+
+  if (key_stage == 0 && value == FLASH_KEY1) {
+    key_stage = 1;
+  } else if (key_stage == 1 && value == FLASH_KEY2) {
+    key_stage = 0;
+    FLASH->CR &= ~FLASH_CR_LOCK;
+  } else {
+    key_error = 1;
+  }
+}
+
+/**
+ * @brief  CR write: ignored while locked; STRT starts a page erase
+ */
+void Sim_Flash_WriteCR(uint32_t value) {
+  /* Halfwords written under PG count before PG clears */
+  Sync();
+  if (FLASH->CR & FLASH_CR_LOCK)
+    return;
+
+  FLASH->CR = value & ~FLASH_CR_STRT;
+  if ((value & (FLASH_CR_PER | FLASH_CR_STRT)) ==
+      (FLASH_CR_PER | FLASH_CR_STRT))
+    Erase(FLASH->AR);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset the controller (locked, power on); contents persist
+ */
+void Sim_Flash_Reset(void) {
+  if (!blank) {
+    Sim_Flash_Erase();
+    return;
+  }
+
+  /* Writes nobody checked never happened */
+  memcpy(Sim_FlashMem, contents, sizeof(contents));
+  FLASH->CR = FLASH_CR_LOCK;
+  FLASH->SR = 0;
+  key_stage = 0;
+  key_error = 0;
+  powered = 1;
+  cut_armed = 0;
+}
+
+/**
+ * @brief  Blank chip: all bits erased, statistics cleared
+ */
+void Sim_Flash_Erase(void) {
+  blank = 1;
+  memset(contents, 0xFF, sizeof(contents));
+  memset(page_erases, 0, sizeof(page_erases));
+  memset(&stats, 0, sizeof(stats));
+  Sim_Flash_Reset();
+}
+
+/**
+ * @brief  Load the flash contents from a file
+ */
+int8_t Sim_Flash_Load(FILE *file) {
+  uint8_t image[SIM_FLASH_SIZE];
+
+  if (fread(image, 1, sizeof(image), file) != sizeof(image))
+    return -1;
+  Sim_Flash_Erase();
+  memcpy(contents, image, sizeof(image));
+  Sim_Flash_Reset();
+  return 0;
+}
+
+/**
+ * @brief  Save the flash contents to a file
+ */
+int8_t Sim_Flash_Save(FILE *file) {
+  return (fwrite(contents, 1, sizeof(contents), file) == sizeof(contents))
+             ? 0
+             : -1;
+}
+
+/**
+ * @brief  Fail the power during a later program or erase
+ */
+void Sim_Flash_CutPower(uint32_t operations, uint32_t seed) {
+  cut_armed = 1;
+  cut_countdown = operations;
+  random_state = seed ? seed : 1U;
+}
+
+/**
+ * @brief  Check whether the power failed (until the next reset)
+ */
+uint8_t Sim_Flash_PowerLost(void) { return !powered; }
+
+/**
+ * @brief  Operation counts and busy time since the chip was blank
+ */
+void Sim_Flash_GetStats(Sim_Flash_Stats_t *out) { *out = stats; }
@@ -0,0 +1,342 @@
+/**
+ ******************************************************************************
+ * @file    sim_i2c.c
+ * @brief   Simulated I2C1 master with bus timing
+ ******************************************************************************
+ *
+ * Every bus operation (START, address, data byte) completes after its SCL
+ * time at the clock programmed in CR2/CCR. Completion sets the status flag
+ * and raises I2C1_EV/I2C1_ER when enabled in CR2; a received byte with
+ * DMAEN set is handed to DMA1 channel 7. Polling SR1 while an operation is
+ * in flight waits for it, so blocking drivers see realistic bus time.
+ *
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+#include <math.h>
+#include <stddef.h>
+
+/* ================ Private Defines ================ */
+
+/* CPU time burnt per SR1 poll while the bus is stuck */
+#define POLL_TIME 0.25e-6
+
+/* I2C1 RX is hard-wired to DMA1 channel 7 */
+#define I2C1_RX_DMA_CHANNEL 7
+
+typedef enum {
+  PHASE_IDLE,
+  PHASE_ADDRESS, /* START sent, waiting for address byte */
+  PHASE_TX,      /* Transmitter mode */
+  PHASE_RX       /* Receiver mode */
+} Phase_t;
+
+typedef enum {
+  OP_NONE,
+  OP_START,
+  OP_ADDRESS,
+  OP_TX,
+  OP_RX
+} Op_t;
+
+/* ================ Private Variables ================ */
+
+static const Sim_I2C_Slave_t *slave = NULL;
+static Phase_t phase = PHASE_IDLE;
+
+/* Operation in flight */
+static Op_t op = OP_NONE;
+static double op_due = INFINITY;
+static uint32_t op_bits = 0;
+static uint8_t op_data = 0;
+
+static uint8_t start_pending = 0; /* START requested during a transfer */
+static uint8_t stop_pending = 0;  /* STOP requested during a transfer */
+static uint8_t stuck = 0;         /* Bus held low: nothing completes */
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  SCL period in seconds from CR2.FREQ and CCR (RM0008 I2C_CCR)
+ */
+static double BitTime(void) {
+  uint32_t freq_mhz = I2C1->CR2 & I2C_CR2_FREQ;
+  uint32_t ccr = I2C1->CCR & I2C_CCR_CCR;
+  uint32_t clocks;
+
+  if (freq_mhz == 0 || ccr == 0)
+    return 10e-6; /* Unconfigured: assume 100kHz */
+
+  if (!(I2C1->CCR & I2C_CCR_FS))
+    clocks = 2 * ccr;
+  else if (!(I2C1->CCR & I2C_CCR_DUTY))
+    clocks = 3 * ccr;
+  else
+    clocks = 25 * ccr;
+
+  return (double)clocks / (freq_mhz * 1e6);
+}
+
+static void Schedule(Op_t next, uint32_t bits, uint8_t data) {
+  op = next;
+  op_bits = bits;
+  op_data = data;
+  op_due = stuck ? INFINITY : Sim_Now() + bits * BitTime();
+}
+
+static void RaiseEvent(void) {
+  if (I2C1->CR2 & I2C_CR2_ITEVTEN)
+    Sim_RaiseIRQ(I2C1_EV_IRQn);
+}
+
+static void RaiseBufferEvent(void) {
+  if ((I2C1->CR2 & I2C_CR2_ITEVTEN) && (I2C1->CR2 & I2C_CR2_ITBUFEN))
+    Sim_RaiseIRQ(I2C1_EV_IRQn);
+}
+
+static void DoStop(void) {
+  if (phase != PHASE_IDLE && slave)
+    slave->stop(slave->ctx);
+  I2C1->SR1 &= ~(I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_TXE | I2C_SR1_BTF);
+  I2C1->SR2 &= ~(I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+  phase = PHASE_IDLE;
+  stop_pending = 0;
+}
+
+/**
+ * @brief  Receive another byte unless the master NACKs the current one
+ */
+static void ContinueReceive(void) {
+  if (phase != PHASE_RX || op != OP_NONE || stop_pending)
+    return;
+  if (!(I2C1->CR1 & I2C_CR1_ACK))
+    return;
+
+  /* LAST: NACK after the byte that ends the DMA transfer */
+  if ((I2C1->CR2 & I2C_CR2_DMAEN) && (I2C1->CR2 & I2C_CR2_LAST) &&
+      DMA1_Channel7->CNDTR <= 1)
+    return;
+
+  Schedule(OP_RX, 9, 0);
+}
+
+/**
+ * @brief  Finish the operation in flight
+ */
+static void Complete(void) {
+  Op_t done = op;
+  op = OP_NONE;
+  op_due = INFINITY;
+
+  switch (done) {
+  case OP_START:
+    I2C1->SR1 |= I2C_SR1_SB;
+    I2C1->SR2 |= I2C_SR2_MSL | I2C_SR2_BUSY;
+    phase = PHASE_ADDRESS;
+    RaiseEvent();
+    break;
+
+  case OP_ADDRESS: {
+    uint8_t read = op_data & 1U;
+    if (slave == NULL || slave->address != (op_data >> 1)) {
+      I2C1->SR1 |= I2C_SR1_AF; /* No device acknowledged */
+      phase = PHASE_IDLE;
+      if (I2C1->CR2 & I2C_CR2_ITERREN)
+        Sim_RaiseIRQ(I2C1_ER_IRQn);
+      break;
+    }
+    slave->start(slave->ctx, read);
+    I2C1->SR1 |= I2C_SR1_ADDR;
+    if (read) {
+      I2C1->SR2 &= ~I2C_SR2_TRA;
+      phase = PHASE_RX;
+    } else {
+      I2C1->SR2 |= I2C_SR2_TRA;
+      phase = PHASE_TX;
+    }
+    RaiseEvent();
+    break;
+  }
+
+  case OP_TX:
+    slave->write(slave->ctx, op_data);
+    I2C1->SR1 |= I2C_SR1_TXE | I2C_SR1_BTF;
+    RaiseEvent();
+    break;
+
+  case OP_RX:
+    I2C1->DR = slave->read(slave->ctx);
+    I2C1->SR1 |= I2C_SR1_RXNE;
+    if (I2C1->CR2 & I2C_CR2_DMAEN)
+      Sim_DMA_Request(I2C1_RX_DMA_CHANNEL);
+    else
+      RaiseBufferEvent();
+    break;
+
+  default:
+    break;
+  }
+
+  if (stop_pending)
+    DoStop();
+  if (start_pending && op == OP_NONE) {
+    start_pending = 0;
+    Schedule(OP_START, 1, 0);
+  }
+}
+
+/**
+ * @brief  Wait (as a polling CPU would) for the operation in flight
+ */
+static void PollWait(void) {
+  if (op == OP_NONE)
+    return;
+
+  double remaining = op_due - Sim_Now();
+  if (remaining > 0.0)
+    Sim_Wait(isinf(remaining) ? POLL_TIME : remaining);
+
+  /* Sim_Wait from thread context already serviced the event */
+  if (op != OP_NONE && Sim_Now() >= op_due)
+    Complete();
+}
+
+/* ================ Register Hooks ================ */
+
+/**
+ * @brief  Register write side effects
+ */
+void Sim_I2C1_Write(uintptr_t offset, uint32_t value) {
+  if (offset == offsetof(I2C_TypeDef, CR1)) {
+    if (value & I2C_CR1_SWRST) {
+      I2C1->CR1 = value;
+      Sim_I2C1_Reset();
+      return;
+    }
+
+    /* START and STOP are cleared by hardware once generated */
+    I2C1->CR1 = value & ~(I2C_CR1_START | I2C_CR1_STOP);
+
+    if (value & I2C_CR1_STOP) {
+      if (op != OP_NONE)
+        stop_pending = 1;
+      else
+        DoStop();
+    }
+
+    if ((value & I2C_CR1_START) && (value & I2C_CR1_PE)) {
+      if (op != OP_NONE)
+        start_pending = 1;
+      else
+        Schedule(OP_START, 1, 0);
+    }
+    return;
+  }
+
+  if (offset == offsetof(I2C_TypeDef, DR)) {
+    I2C1->DR = value & 0xFF;
+
+    if (phase == PHASE_ADDRESS && (I2C1->SR1 & I2C_SR1_SB)) {
+      I2C1->SR1 &= ~I2C_SR1_SB;
+      Schedule(OP_ADDRESS, 9, (uint8_t)value);
+    } else if (phase == PHASE_TX) {
+      I2C1->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+      Schedule(OP_TX, 9, (uint8_t)value);
+    }
+    return;
+  }
+
+  if (offset == offsetof(I2C_TypeDef, SR1)) {
+    /* Error flags are rc_w0 */
+    I2C1->SR1 &= value | ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO |
+                           I2C_SR1_OVR | I2C_SR1_TIMEOUT);
+    return;
+  }
+
+  *(volatile uint32_t *)((uintptr_t)I2C1 + offset) = value;
+}
+
+/**
+ * @brief  Register read side effects
+ */
+uint32_t Sim_I2C1_Read(uintptr_t offset) {
+  if (offset == offsetof(I2C_TypeDef, SR1)) {
+    PollWait();
+    return I2C1->SR1;
+  }
+
+  if (offset == offsetof(I2C_TypeDef, SR2)) {
+    uint32_t value = I2C1->SR2;
+
+    /* SR1 then SR2 read clears ADDR */
+    if (I2C1->SR1 & I2C_SR1_ADDR) {
+      I2C1->SR1 &= ~I2C_SR1_ADDR;
+      if (phase == PHASE_RX) {
+        Schedule(OP_RX, 9, 0);
+      } else if (phase == PHASE_TX) {
+        I2C1->SR1 |= I2C_SR1_TXE;
+        RaiseBufferEvent();
+      }
+    }
+    return value;
+  }
+
+  if (offset == offsetof(I2C_TypeDef, DR)) {
+    uint32_t value = I2C1->DR;
+
+    if (I2C1->SR1 & I2C_SR1_RXNE) {
+      I2C1->SR1 &= ~I2C_SR1_RXNE;
+      ContinueReceive();
+    }
+    return value;
+  }
+
+  return *(volatile uint32_t *)((uintptr_t)I2C1 + offset);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset the I2C1 model (SWRST or power-on)
+ */
+void Sim_I2C1_Reset(void) {
+  I2C1->SR1 = 0;
+  I2C1->SR2 = 0;
+  phase = PHASE_IDLE;
+  op = OP_NONE;
+  op_due = INFINITY;
+  start_pending = 0;
+  stop_pending = 0;
+}
+
+/**
+ * @brief  Attach a slave device to I2C1
+ */
+void Sim_I2C1_Attach(const Sim_I2C_Slave_t *device) { slave = device; }
+
+/**
+ * @brief  Hold the bus (nothing completes) or release it
+ */
+void Sim_I2C1_SetStuck(uint8_t hold) {
+  stuck = hold;
+  if (op == OP_NONE)
+    return;
+  if (stuck)
+    op_due = INFINITY;
+  else
+    op_due = Sim_Now() + op_bits * BitTime();
+}
+
+/**
+ * @brief  Time of the next bus event (INFINITY if none)
+ */
+double Sim_I2C1_NextEventTime(void) { return op_due; }
+
+/**
+ * @brief  Complete the operation in flight if it is due
+ */
+void Sim_I2C1_Service(void) {
+  if (op != OP_NONE && Sim_Now() >= op_due)
+    Complete();
+}
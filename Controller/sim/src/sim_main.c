@@ -0,0 +1,888 @@
+/**
+ ******************************************************************************
+ * @file    sim_main.c
+ * @brief   Host closed-loop simulator for the Controller firmware
+ ******************************************************************************
+ *
+ * Runs the unmodified control stack (differential_drive, pid, encoder, imu,
+ * motor, interrupt handlers) against the simulated board and reports
+ * step-response metrics; exits non-zero when the step misses the limits
+ * below. Mirrors the start-up sequence of main.c.
+ * --bench-X runs one of the module benches (sim_bench_*.c) instead.
+ *
+ * Usage: controller_sim [options]   (see --help)
+ *
+ ******************************************************************************
+ */
+
+#include "autotune.h"
+#include "control_loop.h"
+#include "differential_drive.h"
+#include "encoder.h"
+#include "imu.h"
+#include "main.h"
+#include "odometry.h"
+#include "param_server.h"
+#include "pid.h"
+#include "settings.h"
+#include "sim_bench.h"
+#include "sim_board.h"
+#include "sim_periph.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* Speed band for settle time (fraction of target) */
+#define SETTLE_BAND 0.05
+
+/* Step response limits: the run fails unless the speed settles within
+ * SETTLE_BAND, stays there to the end, and peaks at most this much over */
+#define MAX_OVERSHOOT_PCT 10.0
+
+/* How long --i2c-glitch holds the bus */
+#define I2C_GLITCH_DURATION 0.02
+
+/* Longest wait for the trace ring to drain after a run */
+#define TRACE_DRAIN_TIME 0.05
+
+/* Modelled cost of one control update in cycles (software floating point
+ * on the Cortex-M3, about 170us): an estimate for the DWT statistics, not a
+ * measurement */
+#define LOOP_UPDATE_CYCLES 12000U
+
+/* ================ Private Types ================ */
+
+/* --autotune rule names */
+typedef struct {
+  const char *name;
+  Autotune_Rule_t rule;
+} AutotuneRuleName_t;
+
+static const AutotuneRuleName_t autotune_rules[] = {
+    {"zn-pi", AUTOTUNE_RULE_ZN_PI},
+    {"zn-pid", AUTOTUNE_RULE_ZN_PID},
+    {"tl-pi", AUTOTUNE_RULE_TL_PI},
+    {"tl-pid", AUTOTUNE_RULE_TL_PID},
+};
+
+/* --bench-X options: each runs one bench instead of the drive */
+typedef struct {
+  const char *option;
+  int (*run)(const Sim_Options_t *opt);
+  const char *help;
+} BenchOption_t;
+
+static const BenchOption_t benches[] = {
+    {"bench-pid", Sim_Bench_Pid, "Compare PID_t and PID_Q16_t on a wheel"},
+    {"bench-encoder", Sim_Bench_Encoder,
+     "Encoder CPU load vs edge rate, both modes"},
+    {"bench-speed", Sim_Bench_Speed,
+     "Speed estimator vs count delta on edge streams"},
+    {"bench-imu", Sim_Bench_Imu,
+     "Heading error on yaw profiles, both IMU modes"},
+    {"bench-calib", Sim_Bench_Calib,
+     "Gyro calibration time and bias error, still and moved"},
+    {"bench-attitude", Sim_Bench_Attitude,
+     "Attitude filters: accuracy and cost per update"},
+    {"bench-odometry", Sim_Bench_Odometry,
+     "Odometry pose error on analytic trajectories"},
+    {"bench-profile", Sim_Bench_Profile,
+     "Speed profile vs ideal trapezoid/S-curve"},
+    {"bench-autotune", Sim_Bench_Autotune,
+     "Relay autotuner Ku/Tu on exact limit cycles"},
+    {"bench-telemetry", Sim_Bench_Telemetry,
+     "Telemetry framing round trip and link load"},
+    {"bench-params", Sim_Bench_Params,
+     "Parameter server vectors, fuzzing and link throughput"},
+    {"bench-eeprom", Sim_Bench_Eeprom,
+     "EEPROM emulation: wear, power cuts, settings records"},
+    {"bench-motor", Sim_Bench_Motor,
+     "PWM frequency/resolution and deadband compensation"},
+    {"bench-loop", Sim_Bench_Loop,
+     "Control loop DWT statistics with modelled update costs"},
+};
+
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+/* Modelled control update cost (--loop-cycles) */
+static uint32_t loop_update_cycles = LOOP_UPDATE_CYCLES;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Table entry of a bench
+ */
+static const BenchOption_t *FindBench(int (*run)(const Sim_Options_t *)) {
+  for (uint32_t i = 0; i < BENCH_COUNT; i++) {
+    if (benches[i].run == run)
+      return &benches[i];
+  }
+  return NULL;
+}
+
+/**
+ * @brief  Wheel rate in encoder counts per second
+ */
+static double CountsPerSecond(float omega) {
+  return omega * ENCODER_CPR / (2.0 * M_PI);
+}
+
+/**
+ * @brief  Parse "a,b" into two floats
+ */
+static int ParsePair(const char *text, float pair[2]) {
+  return sscanf(text, "%f,%f", &pair[0], &pair[1]) == 2 ? 0 : -1;
+}
+
+/**
+ * @brief  Parse "s:p,i,d/s:p,i,d..." into gain points
+ * @retval Number of points, 0 on error
+ */
+static uint8_t ParseSchedule(const char *text, PID_GainPoint_t *points) {
+  uint8_t count = 0;
+
+  while (*text && count < PID_SCHEDULE_MAX_POINTS) {
+    PID_GainPoint_t *p = &points[count];
+    int used = 0;
+    if (sscanf(text, "%f:%f,%f,%f%n", &p->point, &p->Kp, &p->Ki, &p->Kd,
+               &used) != 4)
+      return 0;
+    count++;
+    text += used;
+    if (*text == '/')
+      text++;
+    else if (*text)
+      return 0;
+  }
+  return *text ? 0 : count;
+}
+
+/**
+ * @brief  Motor current from the bridge and wheel rate
+ */
+static double MotorCurrent(const Plant_Config_t *config,
+                           const Plant_Bridge_t *bridge, float omega) {
+  double volts = 0.0;
+  if (bridge->in1 != bridge->in2)
+    volts = (bridge->in1 ? 1.0 : -1.0) * bridge->duty * config->battery_v;
+  return (volts - config->ke * omega) / config->resistance;
+}
+
+/**
+ * @brief  Parse "a,b,c" into three floats
+ */
+static int ParseGains(const char *text, float gains[3]) {
+  return sscanf(text, "%f,%f,%f", &gains[0], &gains[1], &gains[2]) == 3 ? 0
+                                                                        : -1;
+}
+
+/**
+ * @brief  Parse an --autotune rule name
+ * @retval 0 on success, -1 if unknown
+ */
+static int ParseAutotuneRule(const char *text, Autotune_Rule_t *rule) {
+  for (size_t i = 0; i < sizeof(autotune_rules) / sizeof(autotune_rules[0]);
+       i++) {
+    if (strcmp(text, autotune_rules[i].name) == 0) {
+      *rule = autotune_rules[i].rule;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief  Print one autotuned loop
+ */
+static void PrintAutotuneLoop(const char *name,
+                              const DriveAutotune_Loop_t *loop) {
+  printf("autotune_%s_ku=%.4f\n", name, loop->ku);
+  printf("autotune_%s_tu_s=%.4f\n", name, loop->tu);
+  printf("autotune_%s_pid=%.4f,%.4f,%.4f\n", name, loop->Kp, loop->Ki,
+         loop->Kd);
+}
+
+/**
+ * @brief  Ground truth position in the frame of a start pose
+ */
+static void LocalPosition(const Plant_t *plant, double x0, double y0,
+                          double theta0, double *x, double *y) {
+  double dx = plant->x - x0;
+  double dy = plant->y - y0;
+  *x = cos(theta0) * dx + sin(theta0) * dy;
+  *y = cos(theta0) * dy - sin(theta0) * dx;
+}
+
+static void PrintUsage(const char *prog) {
+  printf("Usage: %s [options]\n"
+         "  -t, --time SEC          Simulated run time (default 5)\n"
+         "  -r, --rate HZ           Control loop rate (default %u)\n"
+         "  -s, --speed CPS         Target speed in counts/s (default 500)\n"
+         "      --speed-pid P,I,D   Speed PID gains\n"
+         "      --heading-pid P,I,D Heading PID gains\n"
+         "      --profile A,J       Speed profile accel (counts/s^2), jerk "
+         "(counts/s^3, 0 = trapezoidal)\n"
+         "      --feedforward V,S,A Speed feedforward gains Kv, Ks, Ka\n"
+         "      --speed-schedule S:P,I,D/S:P,I,D...\n"
+         "                          Speed PID gains over |speed| (counts/s)\n"
+         "      --autotune RULE     Relay-tune speed and heading PIDs first "
+         "(zn-pi, zn-pid,\n"
+         "                          tl-pi, tl-pid), then run the step\n"
+         "      --seed N            Sensor noise seed (default 1)\n"
+         "      --csv FILE          Write per-tick trace\n"
+         "      --trace FILE        Write the USART3 stream: trace dump "
+         "(trace_decode.py),\n"
+         "                          or frames in controller_sim_telemetry "
+         "(telemetry_decode.py)\n"
+         "      --commands FILE     Send FILE to the parameter server on "
+         "USART3 RX at the step\n"
+         "      --flash FILE        Boot from the flash image in FILE "
+         "(blank if missing),\n"
+         "                          restoring stored settings as main.c "
+         "does; save it after\n"
+         "      --imu-temp C        MPU6050 die temperature (default 25)\n"
+         "      --i2c-glitch SEC    Hold the I2C bus for 20ms at SEC\n"
+         "      --loop-cycles N     Modelled cycles of one control update "
+         "(default %u)\n"
+         "      --imu-mode MODE     IMU acquisition: register or fifo "
+         "(default %s)\n",
+         prog, CONTROL_LOOP_HZ, LOOP_UPDATE_CYCLES,
+         IMU_MODE == IMU_MODE_FIFO ? "fifo" : "register");
+  for (uint32_t i = 0; i < BENCH_COUNT; i++)
+    printf("      --%-18s%s\n", benches[i].option, benches[i].help);
+  printf("      --attitude-log FILE Replay recorded raw samples in "
+         "--bench-attitude\n"
+         "  -h, --help              Show this help\n");
+}
+
+/**
+ * @brief  Print ControlLoop timing statistics in microseconds
+ */
+static void PrintLoopStats(void) {
+  const double us_per_cycle = 1e6 / SYSTEM_CLOCK_HZ;
+  ControlLoop_Stats_t stats;
+  ControlLoop_GetStats(&stats);
+
+  printf("loop_rate_hz=%u\n", ControlLoop_GetRate());
+  printf("loop_iterations=%u\n", stats.iterations);
+  printf("loop_overruns=%u\n", stats.overruns);
+  if (stats.iterations > 1) {
+    printf("loop_jitter_us=%.2f..%.2f\n", stats.jitter_min * us_per_cycle,
+           stats.jitter_max * us_per_cycle);
+  }
+  if (stats.iterations > 0) {
+    printf("loop_exec_us=%.1f..%.1f\n", stats.exec_min * us_per_cycle,
+           stats.exec_max * us_per_cycle);
+  }
+
+  printf("loop_exec_hist=");
+  for (uint32_t i = 0; i < CONTROL_LOOP_HIST_BINS; i++)
+    printf("%u%c", stats.exec_hist[i],
+           i + 1 < CONTROL_LOOP_HIST_BINS ? ',' : '\n');
+  printf("loop_jitter_hist=");
+  for (uint32_t i = 0; i < CONTROL_LOOP_HIST_BINS; i++)
+    printf("%u%c", stats.jitter_hist[i],
+           i + 1 < CONTROL_LOOP_HIST_BINS ? ',' : '\n');
+}
+
+/**
+ * @brief  Print IMU acquisition statistics
+ */
+static void PrintImuStats(void) {
+  IMU_Stats_t stats;
+  IMU_GetStats(&stats);
+
+  printf("imu_reads_started=%u\n", stats.started);
+  printf("imu_reads_completed=%u\n", stats.completed);
+  printf("imu_errors=%u\n", stats.errors);
+  printf("imu_timeouts=%u\n", stats.timeouts);
+  printf("imu_recoveries=%u\n", stats.recoveries);
+  if (IMU_GetMode() != IMU_MODE_FIFO)
+    return;
+  printf("imu_fifo_batches=%u\n", stats.fifo_batches);
+  printf("imu_fifo_samples=%u\n", stats.fifo_samples);
+  printf("imu_fifo_max_batch=%u\n", stats.fifo_max_batch);
+  printf("imu_fifo_backlog=%u\n", stats.fifo_backlog);
+  printf("imu_fifo_overflows=%u\n", stats.fifo_overflows);
+  printf("imu_fifo_resets=%u\n", stats.fifo_resets);
+}
+
+/**
+ * @brief  Print trace or telemetry statistics
+ */
+static void PrintStreamStats(void) {
+#if TELEMETRY_ENABLE
+  Telemetry_Stats_t stats;
+  Telemetry_GetStats(&stats);
+
+  printf("telemetry_published=%u\n", stats.published);
+  printf("telemetry_sent=%u\n", stats.sent);
+  printf("telemetry_dropped=%u\n", stats.dropped);
+  printf("telemetry_replies=%u\n", stats.replies);
+  printf("telemetry_replies_dropped=%u\n", stats.replies_dropped);
+  printf("telemetry_bytes=%u\n", Sim_USART3_BytesSent());
+#else
+  Trace_Stats_t stats;
+  Trace_GetStats(&stats);
+
+  printf("trace_recorded=%u\n", stats.recorded);
+  printf("trace_dropped=%u\n", stats.dropped);
+  printf("trace_sent=%u\n", stats.sent);
+  printf("trace_packets=%u\n", stats.packets);
+  printf("trace_bytes=%u\n", Sim_USART3_BytesSent());
+#endif
+}
+
+#if !TELEMETRY_ENABLE
+/**
+ * @brief  Parameter server replies (the trace build has no reply channel
+ *         on the target; the simulator prints them)
+ */
+static int8_t PrintParamReply(const char *text, uint32_t length) {
+  printf("param_reply=%.*s\n", (int)length, text);
+  return 0;
+}
+#endif
+
+/**
+ * @brief  Start the parameter server (same choice as main.c)
+ */
+static void ParamsInit(void) {
+#if TELEMETRY_ENABLE
+  ParamServer_Init(Telemetry_SendReply);
+#else
+  ParamServer_Init(PrintParamReply);
+#endif
+}
+
+/**
+ * @brief  Control update, then its modelled CPU cost, so the ControlLoop
+ *         DWT statistics see it
+ */
+static void DriveTick(float dt) {
+  DifferentialDrive_Update(dt);
+  Sim_Board_Spend(loop_update_cycles);
+}
+
+/**
+ * @brief  Advance one period, running the main loop background work
+ *         more often while command bytes arrive
+ */
+static void AdvanceMainLoop(double period) {
+  double left = period;
+
+  while (Sim_USART3_RxQueued() != 0 && left > PARAM_POLL_STEP) {
+    Sim_Board_Advance(PARAM_POLL_STEP);
+    left -= PARAM_POLL_STEP;
+    Sim_StreamFlush();
+    ParamServer_Poll();
+  }
+  Sim_Board_Advance(left);
+  Sim_StreamFlush();
+  ParamServer_Poll();
+}
+
+/**
+ * @brief  Print parameter server statistics
+ */
+static void PrintParamStats(void) {
+  ParamServer_Stats_t stats;
+  ParamServer_GetStats(&stats);
+
+  printf("param_lines=%u\n", stats.lines);
+  printf("param_gets=%u\n", stats.gets);
+  printf("param_sets=%u\n", stats.sets);
+  printf("param_saves=%u\n", stats.saves);
+  printf("param_errors=%u\n", stats.errors);
+  printf("param_overflows=%u\n", stats.overflows);
+  printf("param_overruns=%u\n", stats.overruns);
+  printf("param_replies_dropped=%u\n", stats.replies_dropped);
+}
+
+/**
+ * @brief  Closed-loop run of the full control stack
+ */
+static int RunDrive(const Sim_Options_t *opt) {
+  Sim_Board_Config_t config;
+  Sim_Board_DefaultConfig(&config);
+  config.imu.seed = opt->seed;
+  if (opt->imu_temp_set)
+    config.imu.temperature_c = opt->imu_temp;
+  Sim_Board_Init(&config);
+
+  if (opt->flash_path) {
+    FILE *file = fopen(opt->flash_path, "rb");
+    Sim_Flash_Erase();
+    if (file) {
+      int8_t status = Sim_Flash_Load(file);
+      fclose(file);
+      if (status != 0) {
+        fprintf(stderr, "%s: not a %lu byte flash image\n", opt->flash_path,
+                SIM_FLASH_SIZE);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  uint8_t *commands = NULL;
+  long commands_len = 0;
+  if (opt->commands_path) {
+    FILE *file = fopen(opt->commands_path, "rb");
+    if (file == NULL) {
+      perror(opt->commands_path);
+      return EXIT_FAILURE;
+    }
+    fseek(file, 0, SEEK_END);
+    commands_len = ftell(file);
+    rewind(file);
+    commands = malloc(commands_len > 0 ? (size_t)commands_len : 1U);
+    if (commands == NULL ||
+        fread(commands, 1, (size_t)commands_len, file) !=
+            (size_t)commands_len) {
+      fprintf(stderr, "%s: read failed\n", opt->commands_path);
+      fclose(file);
+      free(commands);
+      return EXIT_FAILURE;
+    }
+    fclose(file);
+  }
+
+  FILE *csv = NULL;
+  if (opt->csv_path) {
+    csv = fopen(opt->csv_path, "w");
+    if (csv == NULL) {
+      perror(opt->csv_path);
+      return EXIT_FAILURE;
+    }
+    fprintf(csv, "t,target,speed_left,speed_right,heading_true,heading_est,"
+                 "x,y,duty_left,duty_right\n");
+  }
+
+  FILE *trace = NULL;
+  if (opt->trace_path) {
+    trace = fopen(opt->trace_path, "wb");
+    if (trace == NULL) {
+      perror(opt->trace_path);
+      if (csv)
+        fclose(csv);
+      return EXIT_FAILURE;
+    }
+    Sim_USART3_SetOutput(trace);
+  }
+
+  double wall_start = Sim_WallTime();
+
+  /* Same sequence as main.c */
+  Sim_StreamInit();
+  ParamsInit();
+  DifferentialDrive_Init();
+  if (IMU_GetMode() != opt->imu_mode)
+    IMU_InitMode(opt->imu_mode);
+  Settings_Result_t settings = SETTINGS_NONE;
+  if (opt->flash_path)
+    settings = Settings_Restore();
+  if (opt->speed_gains_set)
+    DifferentialDrive_SetSpeedPID(opt->speed_gains[0], opt->speed_gains[1],
+                                  opt->speed_gains[2]);
+  if (opt->heading_gains_set)
+    DifferentialDrive_SetHeadingPID(opt->heading_gains[0],
+                                    opt->heading_gains[1],
+                                    opt->heading_gains[2]);
+  if (opt->profile_set)
+    DifferentialDrive_SetProfile(opt->profile[0], opt->profile[1]);
+  if (opt->feedforward_set)
+    DifferentialDrive_SetFeedforward(opt->feedforward[0], opt->feedforward[1],
+                                     opt->feedforward[2]);
+  if (opt->schedule_count &&
+      DifferentialDrive_SetSpeedSchedule(opt->schedule, opt->schedule_count) !=
+          0) {
+    fprintf(stderr, "speed schedule points must increase\n");
+    return EXIT_FAILURE;
+  }
+  IMU_Calibration_t calib = {0};
+  double calib_time = -1.0;
+  if (settings != SETTINGS_RESTORED) {
+    delay_ms(1000);
+    double start = Sim_Board_GetTime();
+    IMU_CalibStatus_t status = DifferentialDrive_Calibrate();
+    calib_time = Sim_Board_GetTime() - start;
+    IMU_GetCalibration(&calib);
+    if (opt->flash_path && status == IMU_CALIB_OK && Settings_Store() != 0)
+      fprintf(stderr, "settings store failed\n");
+    delay_ms(500);
+  }
+  double boot_time = Sim_Board_GetTime();
+
+  const Plant_t *plant = Sim_Board_GetPlant();
+  double period = 1.0 / opt->rate_hz;
+
+  /* Same as main.c: updates run from the TIM4 interrupt */
+  if (ControlLoop_Init((uint32_t)opt->rate_hz, DriveTick) != 0) {
+    fprintf(stderr, "rate must be %u-%u Hz\n", CONTROL_LOOP_MIN_HZ,
+            CONTROL_LOOP_MAX_HZ);
+    return EXIT_FAILURE;
+  }
+  ControlLoop_Start();
+
+  if (opt->autotune) {
+    double start = Sim_Board_GetTime();
+    if (DifferentialDrive_StartAutotune(opt->autotune_rule) != 0) {
+      fprintf(stderr, "--autotune needs --feedforward\n");
+      return EXIT_FAILURE;
+    }
+    while (DifferentialDrive_GetState() == DRIVE_STATE_AUTOTUNING)
+      AdvanceMainLoop(period);
+
+    DriveAutotune_Result_t result;
+    DifferentialDrive_GetAutotuneResult(&result);
+    printf("autotune_status=%s\n",
+           result.status == AUTOTUNE_DONE ? "done" : "failed");
+    printf("autotune_time_s=%.3f\n", Sim_Board_GetTime() - start);
+    if (result.status != AUTOTUNE_DONE)
+      return EXIT_FAILURE;
+    PrintAutotuneLoop("left", &result.left);
+    PrintAutotuneLoop("right", &result.right);
+    PrintAutotuneLoop("heading", &result.heading);
+
+    /* Coast to rest, then start the step from a fresh reference */
+    delay_ms(1000);
+    DifferentialDrive_Calibrate();
+    delay_ms(500);
+  }
+
+  double t0 = Sim_Board_GetTime();
+  double x0 = plant->x;
+  double y0 = plant->y;
+  double theta0 = plant->theta;
+
+  double settle_time = -1.0;
+  double peak = 0.0;
+  double heading_sq = 0.0;
+  double peak_current = 0.0;
+  uint32_t ticks = 0;
+
+  DifferentialDrive_SetSpeed(opt->target_speed);
+  if (commands) {
+    if (Sim_USART3_Receive(commands, (uint32_t)commands_len) !=
+        (uint32_t)commands_len)
+      fprintf(stderr, "%s: too long, truncated\n", opt->commands_path);
+    free(commands);
+  }
+
+  /* Sample ground truth once per loop period */
+  while (Sim_Board_GetTime() - t0 < opt->duration) {
+    AdvanceMainLoop(period);
+
+    double t = Sim_Board_GetTime() - t0;
+    if (opt->i2c_glitch >= 0.0)
+      Sim_I2C1_SetStuck(t >= opt->i2c_glitch &&
+                        t < opt->i2c_glitch + I2C_GLITCH_DURATION);
+    double speed_left = CountsPerSecond(plant->left.omega);
+    double speed_right = CountsPerSecond(plant->right.omega);
+    double speed = 0.5 * (speed_left + speed_right);
+    double heading = (plant->theta - theta0) * RAD_TO_DEG;
+
+    if (opt->target_speed != 0.0f) {
+      double error = fabs(speed - opt->target_speed);
+      if (error > SETTLE_BAND * fabs(opt->target_speed))
+        settle_time = -1.0;
+      else if (settle_time < 0.0)
+        settle_time = t;
+    }
+    if (fabs(speed) > fabs(peak))
+      peak = speed;
+    heading_sq += heading * heading;
+    ticks++;
+
+    Plant_Bridge_t left, right;
+    Sim_Board_GetBridges(&left, &right);
+    double current =
+        fmax(fabs(MotorCurrent(&plant->config, &left, plant->left.omega)),
+             fabs(MotorCurrent(&plant->config, &right, plant->right.omega)));
+    if (current > peak_current)
+      peak_current = current;
+
+    if (csv) {
+      double x, y;
+      LocalPosition(plant, x0, y0, theta0, &x, &y);
+      fprintf(csv, "%.4f,%.1f,%.1f,%.1f,%.4f,%.4f,%.5f,%.5f,%.3f,%.3f\n", t,
+              DifferentialDrive_GetProfiledSpeed(), speed_left, speed_right, heading,
+              IMU_GetHeading(), x, y,
+              (left.in2 ? -left.duty : left.duty),
+              (right.in2 ? -right.duty : right.duty));
+    }
+  }
+
+  ControlLoop_Stop();
+
+  /* Let the last packets go out */
+  for (double waited = 0.0; waited < TRACE_DRAIN_TIME; waited += 0.001) {
+    Sim_StreamFlush();
+    if (!Sim_StreamIsBusy())
+      break;
+    Sim_Board_Advance(0.001);
+  }
+
+  double wall = Sim_WallTime() - wall_start;
+  double sim_total = Sim_Board_GetTime();
+
+  if (csv)
+    fclose(csv);
+  if (trace) {
+    Sim_USART3_SetOutput(NULL);
+    fclose(trace);
+  }
+  if (opt->flash_path) {
+    FILE *file = fopen(opt->flash_path, "wb");
+    if (file == NULL || Sim_Flash_Save(file) != 0)
+      perror(opt->flash_path);
+    if (file)
+      fclose(file);
+  }
+
+  double overshoot = 0.0;
+  if (opt->target_speed != 0.0f)
+    overshoot = 100.0 * (fabs(peak) - fabs(opt->target_speed)) /
+                fabs(opt->target_speed);
+  double final_speed =
+      CountsPerSecond(0.5f * (plant->left.omega + plant->right.omega));
+
+  printf("target_speed=%.1f\n", opt->target_speed);
+  printf("final_speed=%.1f\n", final_speed);
+  printf("settle_time_s=%.3f\n", settle_time);
+  printf("overshoot_pct=%.2f\n", overshoot > 0.0 ? overshoot : 0.0);
+  printf("peak_current_a=%.3f\n", peak_current);
+  printf("heading_rms_deg=%.4f\n", ticks ? sqrt(heading_sq / ticks) : 0.0);
+  printf("heading_final_deg=%.4f\n", (plant->theta - theta0) * RAD_TO_DEG);
+  printf("heading_est_deg=%.4f\n", IMU_GetHeading());
+  double distance, drift;
+  LocalPosition(plant, x0, y0, theta0, &distance, &drift);
+  printf("distance_m=%.4f\n", distance);
+  printf("lateral_drift_m=%.5f\n", drift);
+  Odometry_Pose_t pose;
+  Odometry_GetPose(&pose);
+  printf("odometry_x_m=%.4f\n", pose.x * 1e-3);
+  printf("odometry_y_m=%.5f\n", pose.y * 1e-3);
+  printf("odometry_theta_deg=%.4f\n", pose.theta);
+  printf("odometry_error_mm=%.2f\n",
+         hypot(pose.x - distance * 1e3, pose.y - drift * 1e3));
+  printf("imu_samples=%u\n", Sim_MPU6050_GetSampleCount());
+  if (calib_time >= 0.0) {
+    printf("calib_status=%s\n", Sim_CalibStatusName(calib.status));
+    printf("calib_time_s=%.3f\n", calib_time);
+    printf("calib_readings=%u\n", calib.readings);
+    printf("calib_restarts=%u\n", calib.restarts);
+    printf("calib_bias_dps=%.4f\n", calib.bias);
+    printf("calib_std_error_dps=%.4f\n", calib.std_error);
+  }
+  PrintImuStats();
+  PrintLoopStats();
+  PrintStreamStats();
+  if (opt->commands_path)
+    PrintParamStats();
+  if (opt->flash_path) {
+    static const char *const results[] = {"restored", "none", "temperature",
+                                          "bias_check", "flash_error"};
+    Sim_Flash_Stats_t flash;
+    Sim_Flash_GetStats(&flash);
+    printf("settings_result=%s\n", results[settings]);
+    printf("boot_time_s=%.3f\n", boot_time);
+    printf("flash_programs=%u\n", flash.programs);
+    printf("flash_erases=%u\n", flash.erases);
+    printf("flash_busy_ms=%.2f\n", flash.busy_time * 1e3);
+  }
+  printf("sim_time_s=%.3f\n", sim_total);
+  printf("wall_time_s=%.4f\n", wall);
+  printf("realtime_factor=%.1f\n", wall > 0.0 ? sim_total / wall : 0.0);
+
+  int failures = 0;
+  if (opt->target_speed != 0.0f) {
+    double band = SETTLE_BAND * fabs(opt->target_speed);
+    if (settle_time < 0.0) {
+      printf("drive: speed not settled within %.1f counts/s\n", band);
+      failures++;
+    }
+    if (fabs(final_speed - opt->target_speed) > band) {
+      printf("drive: final speed %.1f off target by more than %.1f\n",
+             final_speed, band);
+      failures++;
+    }
+    if (overshoot > MAX_OVERSHOOT_PCT) {
+      printf("drive: overshoot %.2f%% > %.1f%%\n", overshoot,
+             MAX_OVERSHOOT_PCT);
+      failures++;
+    }
+  }
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* ================ Main Program ================ */
+
+int main(int argc, char **argv) {
+  enum { OPT_SPEED_PID = 256, OPT_HEADING_PID, OPT_SEED, OPT_CSV,
+         OPT_I2C_GLITCH, OPT_TRACE, OPT_IMU_MODE, OPT_ATTITUDE_LOG,
+         OPT_PROFILE, OPT_FEEDFORWARD, OPT_SPEED_SCHEDULE, OPT_AUTOTUNE,
+         OPT_COMMANDS, OPT_FLASH, OPT_IMU_TEMP, OPT_LOOP_CYCLES, OPT_BENCH };
+  static const struct option drive_options[] = {
+      {"time", required_argument, NULL, 't'},
+      {"rate", required_argument, NULL, 'r'},
+      {"speed", required_argument, NULL, 's'},
+      {"speed-pid", required_argument, NULL, OPT_SPEED_PID},
+      {"heading-pid", required_argument, NULL, OPT_HEADING_PID},
+      {"profile", required_argument, NULL, OPT_PROFILE},
+      {"feedforward", required_argument, NULL, OPT_FEEDFORWARD},
+      {"speed-schedule", required_argument, NULL, OPT_SPEED_SCHEDULE},
+      {"autotune", required_argument, NULL, OPT_AUTOTUNE},
+      {"seed", required_argument, NULL, OPT_SEED},
+      {"csv", required_argument, NULL, OPT_CSV},
+      {"trace", required_argument, NULL, OPT_TRACE},
+      {"imu-mode", required_argument, NULL, OPT_IMU_MODE},
+      {"attitude-log", required_argument, NULL, OPT_ATTITUDE_LOG},
+      {"commands", required_argument, NULL, OPT_COMMANDS},
+      {"flash", required_argument, NULL, OPT_FLASH},
+      {"imu-temp", required_argument, NULL, OPT_IMU_TEMP},
+      {"i2c-glitch", required_argument, NULL, OPT_I2C_GLITCH},
+      {"loop-cycles", required_argument, NULL, OPT_LOOP_CYCLES},
+      {"help", no_argument, NULL, 'h'},
+  };
+  enum { DRIVE_OPTIONS = sizeof(drive_options) / sizeof(drive_options[0]) };
+
+  /* One --bench-X per bench, then the terminator */
+  struct option long_options[DRIVE_OPTIONS + BENCH_COUNT + 1];
+  memcpy(long_options, drive_options, sizeof(drive_options));
+  for (uint32_t i = 0; i < BENCH_COUNT; i++)
+    long_options[DRIVE_OPTIONS + i] = (struct option){
+        benches[i].option, no_argument, NULL, OPT_BENCH + (int)i};
+  long_options[DRIVE_OPTIONS + BENCH_COUNT] = (struct option){0};
+  const BenchOption_t *bench = NULL;
+
+  Sim_Options_t opt = {
+      .duration = 5.0,
+      .rate_hz = CONTROL_LOOP_HZ,
+      .target_speed = 500.0f,
+      .seed = 1,
+      .imu_mode = IMU_MODE,
+      .i2c_glitch = -1.0,
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "t:r:s:h", long_options, NULL)) != -1) {
+    switch (c) {
+    case 't':
+      opt.duration = atof(optarg);
+      break;
+    case 'r':
+      opt.rate_hz = atof(optarg);
+      break;
+    case 's':
+      opt.target_speed = (float)atof(optarg);
+      break;
+    case OPT_SPEED_PID:
+      if (ParseGains(optarg, opt.speed_gains) != 0) {
+        fprintf(stderr, "bad --speed-pid '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      opt.speed_gains_set = 1;
+      break;
+    case OPT_HEADING_PID:
+      if (ParseGains(optarg, opt.heading_gains) != 0) {
+        fprintf(stderr, "bad --heading-pid '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      opt.heading_gains_set = 1;
+      break;
+    case OPT_PROFILE:
+      if (ParsePair(optarg, opt.profile) != 0 || opt.profile[0] <= 0.0f) {
+        fprintf(stderr, "bad --profile '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      opt.profile_set = 1;
+      break;
+    case OPT_FEEDFORWARD:
+      if (ParseGains(optarg, opt.feedforward) != 0) {
+        fprintf(stderr, "bad --feedforward '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      opt.feedforward_set = 1;
+      break;
+    case OPT_SPEED_SCHEDULE:
+      opt.schedule_count = ParseSchedule(optarg, opt.schedule);
+      if (opt.schedule_count == 0) {
+        fprintf(stderr, "bad --speed-schedule '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case OPT_AUTOTUNE:
+      if (ParseAutotuneRule(optarg, &opt.autotune_rule) != 0) {
+        fprintf(stderr, "bad --autotune '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      opt.autotune = 1;
+      break;
+    case OPT_SEED:
+      opt.seed = (uint32_t)strtoul(optarg, NULL, 0);
+      break;
+    case OPT_CSV:
+      opt.csv_path = optarg;
+      break;
+    case OPT_TRACE:
+      opt.trace_path = optarg;
+      break;
+    case OPT_ATTITUDE_LOG:
+      opt.attitude_log = optarg;
+      bench = FindBench(Sim_Bench_Attitude);
+      break;
+    case OPT_COMMANDS:
+      opt.commands_path = optarg;
+      break;
+    case OPT_FLASH:
+      opt.flash_path = optarg;
+      break;
+    case OPT_IMU_TEMP:
+      opt.imu_temp = (float)atof(optarg);
+      opt.imu_temp_set = 1;
+      break;
+    case OPT_IMU_MODE:
+      if (strcmp(optarg, "register") == 0) {
+        opt.imu_mode = IMU_MODE_REGISTER;
+      } else if (strcmp(optarg, "fifo") == 0) {
+        opt.imu_mode = IMU_MODE_FIFO;
+      } else {
+        fprintf(stderr, "bad --imu-mode '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case OPT_I2C_GLITCH:
+      opt.i2c_glitch = atof(optarg);
+      break;
+    case OPT_LOOP_CYCLES:
+      loop_update_cycles = (uint32_t)strtoul(optarg, NULL, 0);
+      break;
+    case 'h':
+      PrintUsage(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      if (c >= OPT_BENCH && c < OPT_BENCH + (int)BENCH_COUNT) {
+        bench = &benches[c - OPT_BENCH];
+        break;
+      }
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opt.duration <= 0.0 || opt.rate_hz <= 0.0) {
+    fprintf(stderr, "time and rate must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  if (bench)
+    return bench->run(&opt);
+  return RunDrive(&opt);
+}
@@ -0,0 +1,340 @@
+/**
+ ******************************************************************************
+ * @file    sim_mpu6050.c
+ * @brief   Simulated MPU6050 on the I2C1 bus
+ ******************************************************************************
+ */
+
+#include "sim_mpu6050.h"
+#include <math.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+#define MPU_ADDR 0x68
+
+#define REG_SMPLRT_DIV 0x19
+#define REG_CONFIG 0x1A
+#define REG_GYRO_CONFIG 0x1B
+#define REG_ACCEL_CONFIG 0x1C
+#define REG_FIFO_EN 0x23
+#define REG_INT_ENABLE 0x38
+#define REG_INT_STATUS 0x3A
+#define REG_ACCEL_XOUT_H 0x3B
+#define REG_TEMP_OUT_H 0x41
+#define REG_GYRO_XOUT_H 0x43
+#define REG_USER_CTRL 0x6A
+#define REG_PWR_MGMT_1 0x6B
+#define REG_FIFO_COUNTH 0x72
+#define REG_FIFO_COUNTL 0x73
+#define REG_FIFO_R_W 0x74
+#define REG_WHO_AM_I 0x75
+
+#define PWR_DEVICE_RESET 0x80
+#define PWR_SLEEP 0x40
+
+#define USER_CTRL_FIFO_EN 0x40
+#define USER_CTRL_FIFO_RESET 0x04
+#define INT_FIFO_OFLOW 0x10
+#define INT_DATA_RDY 0x01
+
+#define FIFO_SIZE 1024U
+
+/* ================ Private Variables ================ */
+
+static uint8_t regs[128];
+static uint8_t reg_ptr = 0;
+static uint8_t ptr_pending = 0; /* Next written byte is the register address */
+
+static Sim_MPU6050_Config_t cfg;
+static uint32_t rng_state = 1;
+
+static double next_sample_time = 0.0;
+static uint32_t sample_count = 0;
+
+/* Yaw rate disturbance (Sim_MPU6050_SetDisturbance) */
+static double disturb_start = 0.0;
+static double disturb_end = 0.0;
+static float disturb_dps = 0.0f;
+static float disturb_hz = 0.0f;
+
+/* FIFO ring; the count is latched by reading FIFO_COUNTH */
+static uint8_t fifo[FIFO_SIZE];
+static uint32_t fifo_head = 0;
+static uint32_t fifo_count = 0;
+static uint16_t fifo_count_latch = 0;
+
+/* FIFO_EN bit -> first output register and length, in FIFO order */
+static const struct {
+  uint8_t enable;
+  uint8_t reg;
+  uint8_t len;
+} fifo_sources[] = {
+    {0x08, REG_ACCEL_XOUT_H, 6}, /* ACCEL_FIFO_EN */
+    {0x80, REG_TEMP_OUT_H, 2},   /* TEMP_FIFO_EN */
+    {0x40, REG_GYRO_XOUT_H, 2},  /* XG_FIFO_EN */
+    {0x20, REG_GYRO_XOUT_H + 2, 2},
+    {0x10, REG_GYRO_XOUT_H + 4, 2},
+};
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Power-on register values
+ */
+static void ResetRegisters(void) {
+  memset(regs, 0, sizeof(regs));
+  regs[REG_PWR_MGMT_1] = PWR_SLEEP;
+  regs[REG_WHO_AM_I] = MPU_ADDR;
+  reg_ptr = 0;
+  fifo_head = 0;
+  fifo_count = 0;
+  fifo_count_latch = 0;
+}
+
+/**
+ * @brief  Append a byte, overwriting the oldest when full
+ */
+static void FifoPush(uint8_t value) {
+  if (fifo_count == FIFO_SIZE) {
+    fifo_head = (fifo_head + 1) % FIFO_SIZE;
+    fifo_count--;
+    regs[REG_INT_STATUS] |= INT_FIFO_OFLOW;
+  }
+  fifo[(fifo_head + fifo_count) % FIFO_SIZE] = value;
+  fifo_count++;
+}
+
+/**
+ * @brief  Remove the oldest byte (an empty FIFO reads 0)
+ */
+static uint8_t FifoPop(void) {
+  if (fifo_count == 0)
+    return 0;
+  uint8_t value = fifo[fifo_head];
+  fifo_head = (fifo_head + 1) % FIFO_SIZE;
+  fifo_count--;
+  return value;
+}
+
+/**
+ * @brief  Uniform random number in (0, 1] (xorshift32)
+ */
+static double Uniform(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return ((double)rng_state + 1.0) / 4294967296.0;
+}
+
+/**
+ * @brief  Standard normal random number (Box-Muller)
+ */
+static float Gaussian(void) {
+  return (float)(sqrt(-2.0 * log(Uniform())) * cos(2.0 * M_PI * Uniform()));
+}
+
+/**
+ * @brief  Store a big-endian 16-bit value with saturation
+ */
+static void Store16(uint8_t reg, float value) {
+  long raw = lroundf(value);
+  if (raw > INT16_MAX)
+    raw = INT16_MAX;
+  if (raw < INT16_MIN)
+    raw = INT16_MIN;
+  regs[reg] = (uint8_t)((uint16_t)raw >> 8);
+  regs[reg + 1] = (uint8_t)raw;
+}
+
+/**
+ * @brief  Register write from the bus
+ */
+static void WriteRegister(uint8_t reg, uint8_t value) {
+  if (reg == REG_PWR_MGMT_1 && (value & PWR_DEVICE_RESET)) {
+    ResetRegisters();
+    return;
+  }
+  if (reg == REG_USER_CTRL && (value & USER_CTRL_FIFO_RESET)) {
+    fifo_head = 0;
+    fifo_count = 0;
+    value &= ~USER_CTRL_FIFO_RESET; /* Self-clearing */
+  }
+  if (reg == REG_FIFO_R_W) {
+    FifoPush(value);
+    return;
+  }
+  if (reg == REG_WHO_AM_I || reg == REG_INT_STATUS ||
+      reg == REG_FIFO_COUNTH || reg == REG_FIFO_COUNTL ||
+      (reg >= REG_ACCEL_XOUT_H && reg < 0x49))
+    return; /* Read-only */
+  regs[reg] = value;
+}
+
+/**
+ * @brief  Register read from the bus
+ */
+static uint8_t ReadRegister(uint8_t reg) {
+  uint8_t value;
+
+  switch (reg) {
+  case REG_INT_STATUS:
+    value = regs[reg];
+    regs[reg] = 0; /* Cleared by reading */
+    return value;
+  case REG_FIFO_COUNTH:
+    fifo_count_latch = (uint16_t)fifo_count;
+    return (uint8_t)(fifo_count_latch >> 8);
+  case REG_FIFO_COUNTL:
+    return (uint8_t)fifo_count_latch;
+  case REG_FIFO_R_W:
+    return FifoPop();
+  default:
+    return regs[reg];
+  }
+}
+
+/* ================ I2C Slave Callbacks ================ */
+
+static void SlaveStart(void *ctx, uint8_t read) {
+  (void)ctx;
+  ptr_pending = !read;
+}
+
+static void SlaveWrite(void *ctx, uint8_t data) {
+  (void)ctx;
+  if (ptr_pending) {
+    reg_ptr = data & 0x7F;
+    ptr_pending = 0;
+  } else {
+    WriteRegister(reg_ptr, data);
+    reg_ptr = (reg_ptr + 1) & 0x7F;
+  }
+}
+
+static uint8_t SlaveRead(void *ctx) {
+  (void)ctx;
+  uint8_t value = ReadRegister(reg_ptr);
+
+  /* Bursts from FIFO_R_W keep reading the FIFO */
+  if (reg_ptr != REG_FIFO_R_W)
+    reg_ptr = (reg_ptr + 1) & 0x7F;
+  return value;
+}
+
+static void SlaveStop(void *ctx) {
+  (void)ctx;
+  ptr_pending = 0;
+}
+
+static const Sim_I2C_Slave_t mpu_slave = {
+    .address = MPU_ADDR,
+    .ctx = NULL,
+    .start = SlaveStart,
+    .write = SlaveWrite,
+    .read = SlaveRead,
+    .stop = SlaveStop,
+};
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset the model and attach it to I2C1
+ */
+void Sim_MPU6050_Init(const Sim_MPU6050_Config_t *config) {
+  cfg = *config;
+  rng_state = config->seed ? config->seed : 1;
+  ResetRegisters();
+  next_sample_time = 0.0;
+  sample_count = 0;
+  disturb_end = 0.0;
+  Sim_I2C1_Attach(&mpu_slave);
+}
+
+/**
+ * @brief  Add a gyro Z rate the plant does not see
+ */
+void Sim_MPU6050_SetDisturbance(double start, double duration,
+                                float amplitude_dps, float freq_hz) {
+  disturb_start = start;
+  disturb_end = start + duration;
+  disturb_dps = amplitude_dps;
+  disturb_hz = freq_hz;
+}
+
+/**
+ * @brief  Get the current output data rate
+ */
+float Sim_MPU6050_GetSampleRate(void) {
+  if (regs[REG_PWR_MGMT_1] & PWR_SLEEP)
+    return 0.0f;
+
+  uint8_t dlpf = regs[REG_CONFIG] & 0x07;
+  float gyro_rate = (dlpf == 0 || dlpf == 7) ? 8000.0f : 1000.0f;
+  return gyro_rate / (1.0f + regs[REG_SMPLRT_DIV]);
+}
+
+/**
+ * @brief  Get number of samples produced since init
+ */
+uint32_t Sim_MPU6050_GetSampleCount(void) { return sample_count; }
+
+/**
+ * @brief  Advance the sensor to time t with the true body motion
+ */
+void Sim_MPU6050_Step(double t, const float gyro_dps[3],
+                      const float accel_g[3]) {
+  float rate = Sim_MPU6050_GetSampleRate();
+  if (rate <= 0.0f) {
+    next_sample_time = t;
+    return;
+  }
+
+  if (t < next_sample_time)
+    return;
+
+  /* Hold between samples; never fall more than one period behind */
+  double period = 1.0 / rate;
+  next_sample_time += period;
+  if (next_sample_time < t)
+    next_sample_time = t + period;
+
+  float gyro_lsb = 131.0f / (float)(1 << ((regs[REG_GYRO_CONFIG] >> 3) & 3));
+  float accel_lsb =
+      16384.0f / (float)(1 << ((regs[REG_ACCEL_CONFIG] >> 3) & 3));
+
+  float drift = cfg.gyro_tempco_dps * (cfg.temperature_c - 25.0f);
+  float disturbance = 0.0f;
+  if (t >= disturb_start && t < disturb_end)
+    disturbance =
+        disturb_dps * (disturb_hz > 0.0f
+                           ? (float)sin(2.0 * M_PI * disturb_hz *
+                                        (t - disturb_start))
+                           : 1.0f);
+
+  for (int axis = 0; axis < 3; axis++) {
+    float g = gyro_dps[axis] + (cfg.gyro_bias_dps[axis] + drift) +
+              cfg.gyro_noise_dps * Gaussian();
+    if (axis == 2)
+      g += disturbance;
+    float a = accel_g[axis] + cfg.accel_noise_g * Gaussian();
+    Store16(REG_GYRO_XOUT_H + 2 * axis, g * gyro_lsb);
+    Store16(REG_ACCEL_XOUT_H + 2 * axis, a * accel_lsb);
+  }
+
+  /* Temperature in degC = TEMP_OUT / 340 + 36.53 */
+  Store16(REG_TEMP_OUT_H, (cfg.temperature_c - 36.53f) * 340.0f);
+  sample_count++;
+  if (regs[REG_INT_ENABLE] & INT_DATA_RDY)
+    regs[REG_INT_STATUS] |= INT_DATA_RDY;
+
+  if (regs[REG_USER_CTRL] & USER_CTRL_FIFO_EN) {
+    for (uint32_t i = 0; i < sizeof(fifo_sources) / sizeof(fifo_sources[0]);
+         i++) {
+      if (!(regs[REG_FIFO_EN] & fifo_sources[i].enable))
+        continue;
+      for (uint8_t k = 0; k < fifo_sources[i].len; k++)
+        FifoPush(regs[fifo_sources[i].reg + k]);
+    }
+  }
+}
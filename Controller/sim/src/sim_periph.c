@@ -0,0 +1,479 @@
+/**
+ ******************************************************************************
+ * @file    sim_periph.c
+ * @brief   Simulated STM32F103 register layer for the host build
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+#include "stm32f1xx_hal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+#define SIM_IRQ_COUNT 68 /* Device IRQs 0..67 */
+
+/* Offset of a register inside the peripheral image */
+#define REG_OFFSET(reg) ((uintptr_t)(reg) - (uintptr_t)Sim_PeriphMem)
+#define PERIPH_OFFSET(base) ((uintptr_t)(base) - (uintptr_t)Sim_PeriphMem)
+
+/* Bus of a register offset: APB1 below APB2PERIPH_BASE, AHB from
+ * AHBPERIPH_BASE */
+#define APB2_OFFSET 0x10000UL
+#define AHB_OFFSET 0x18000UL
+
+/* ================ Public Variables ================ */
+
+uint32_t Sim_PeriphMem[SIM_PERIPH_SIZE / 4];
+DWT_Type Sim_DWT;
+CoreDebug_Type Sim_CoreDebug;
+
+/* ================ Private Variables ================ */
+
+/* NVIC state */
+static uint8_t irq_enabled[SIM_IRQ_COUNT];
+static uint8_t irq_pending[SIM_IRQ_COUNT];
+static uint8_t irq_active[SIM_IRQ_COUNT];
+static uint32_t irq_count[SIM_IRQ_COUNT];
+static uint32_t primask = 0;
+
+/* Register accesses */
+static Sim_Bus_Stats_t bus_stats;
+
+/* HAL tick */
+static volatile uint32_t uwTick = 0;
+
+/* Simulation clock */
+static double (*clock_now)(void) = NULL;
+static void (*clock_wait)(double seconds) = NULL;
+
+/* Modelled CPU cost of each interrupt handler */
+static uint32_t irq_cycles = 0;
+static void (*irq_spend)(uint32_t cycles) = NULL;
+
+/* ================ Interrupt Vectors ================ */
+
+/* Handlers are weak references: the simulator only delivers interrupts the
+ * linked firmware actually implements */
+#define SIM_VECTOR(name) extern void name(void) __attribute__((weak));
+SIM_VECTOR(SysTick_Handler)
+SIM_VECTOR(EXTI0_IRQHandler)
+SIM_VECTOR(EXTI1_IRQHandler)
+SIM_VECTOR(EXTI2_IRQHandler)
+SIM_VECTOR(EXTI3_IRQHandler)
+SIM_VECTOR(EXTI4_IRQHandler)
+SIM_VECTOR(EXTI9_5_IRQHandler)
+SIM_VECTOR(EXTI15_10_IRQHandler)
+SIM_VECTOR(DMA1_Channel1_IRQHandler)
+SIM_VECTOR(DMA1_Channel2_IRQHandler)
+SIM_VECTOR(DMA1_Channel3_IRQHandler)
+SIM_VECTOR(DMA1_Channel4_IRQHandler)
+SIM_VECTOR(DMA1_Channel5_IRQHandler)
+SIM_VECTOR(DMA1_Channel6_IRQHandler)
+SIM_VECTOR(DMA1_Channel7_IRQHandler)
+SIM_VECTOR(TIM1_UP_IRQHandler)
+SIM_VECTOR(TIM1_CC_IRQHandler)
+SIM_VECTOR(TIM2_IRQHandler)
+SIM_VECTOR(TIM3_IRQHandler)
+SIM_VECTOR(TIM4_IRQHandler)
+SIM_VECTOR(I2C1_EV_IRQHandler)
+SIM_VECTOR(I2C1_ER_IRQHandler)
+SIM_VECTOR(USART1_IRQHandler)
+SIM_VECTOR(USART2_IRQHandler)
+SIM_VECTOR(USART3_IRQHandler)
+#undef SIM_VECTOR
+
+/**
+ * @brief  Look up the handler for an IRQ number
+ */
+static void (*GetHandler(int32_t irqn))(void) {
+  switch (irqn) {
+  case SysTick_IRQn:
+    return SysTick_Handler;
+  case EXTI0_IRQn:
+    return EXTI0_IRQHandler;
+  case EXTI1_IRQn:
+    return EXTI1_IRQHandler;
+  case EXTI2_IRQn:
+    return EXTI2_IRQHandler;
+  case EXTI3_IRQn:
+    return EXTI3_IRQHandler;
+  case EXTI4_IRQn:
+    return EXTI4_IRQHandler;
+  case EXTI9_5_IRQn:
+    return EXTI9_5_IRQHandler;
+  case EXTI15_10_IRQn:
+    return EXTI15_10_IRQHandler;
+  case DMA1_Channel1_IRQn:
+    return DMA1_Channel1_IRQHandler;
+  case DMA1_Channel2_IRQn:
+    return DMA1_Channel2_IRQHandler;
+  case DMA1_Channel3_IRQn:
+    return DMA1_Channel3_IRQHandler;
+  case DMA1_Channel4_IRQn:
+    return DMA1_Channel4_IRQHandler;
+  case DMA1_Channel5_IRQn:
+    return DMA1_Channel5_IRQHandler;
+  case DMA1_Channel6_IRQn:
+    return DMA1_Channel6_IRQHandler;
+  case DMA1_Channel7_IRQn:
+    return DMA1_Channel7_IRQHandler;
+  case TIM1_UP_IRQn:
+    return TIM1_UP_IRQHandler;
+  case TIM1_CC_IRQn:
+    return TIM1_CC_IRQHandler;
+  case TIM2_IRQn:
+    return TIM2_IRQHandler;
+  case TIM3_IRQn:
+    return TIM3_IRQHandler;
+  case TIM4_IRQn:
+    return TIM4_IRQHandler;
+  case I2C1_EV_IRQn:
+    return I2C1_EV_IRQHandler;
+  case I2C1_ER_IRQn:
+    return I2C1_ER_IRQHandler;
+  case USART1_IRQn:
+    return USART1_IRQHandler;
+  case USART2_IRQn:
+    return USART2_IRQHandler;
+  case USART3_IRQn:
+    return USART3_IRQHandler;
+  default:
+    return NULL;
+  }
+}
+
+/**
+ * @brief  Charge the modelled cost of the handler that just ran
+ */
+static void SpendIRQCycles(void) {
+  if (irq_spend && irq_cycles)
+    irq_spend(irq_cycles);
+}
+
+/**
+ * @brief  Deliver all pending, enabled interrupts (lowest number first)
+ */
+static void DispatchIRQs(void) {
+  if (primask)
+    return;
+
+  for (int32_t irqn = 0; irqn < SIM_IRQ_COUNT; irqn++) {
+    if (!irq_pending[irqn] || !irq_enabled[irqn] || irq_active[irqn])
+      continue;
+
+    void (*handler)(void) = GetHandler(irqn);
+    irq_pending[irqn] = 0;
+    if (handler == NULL)
+      continue;
+
+    irq_active[irqn] = 1;
+    irq_count[irqn]++;
+    handler();
+    SpendIRQCycles();
+    irq_active[irqn] = 0;
+  }
+}
+
+/* ================ Core (core_cm3.h stand-in) ================ */
+
+void Sim_NVIC_EnableIRQ(int32_t irqn) {
+  if (irqn >= 0 && irqn < SIM_IRQ_COUNT) {
+    irq_enabled[irqn] = 1;
+    DispatchIRQs();
+  }
+}
+
+void Sim_NVIC_DisableIRQ(int32_t irqn) {
+  if (irqn >= 0 && irqn < SIM_IRQ_COUNT)
+    irq_enabled[irqn] = 0;
+}
+
+void Sim_NVIC_SetPriority(int32_t irqn, uint32_t priority) {
+  /* Handlers run to completion in the simulator; priority is not modelled */
+  (void)irqn;
+  (void)priority;
+}
+
+void Sim_SetPrimask(uint32_t value) {
+  primask = value & 1U;
+  DispatchIRQs();
+}
+
+uint32_t Sim_GetPrimask(void) { return primask; }
+
+/* ================ HAL (stm32f1xx_hal.h stand-in) ================ */
+
+void HAL_IncTick(void) { uwTick++; }
+
+uint32_t HAL_GetTick(void) { return uwTick; }
+
+/* ================ Register Access (stm32f1xx.h stand-in) ================ */
+
+/**
+ * @brief  Count a register access on its bus
+ */
+static void CountAccess(uintptr_t offset, uint8_t write) {
+  if (offset >= SIM_PERIPH_SIZE)
+    return; /* Core or flash image */
+  if (offset < APB2_OFFSET)
+    write ? bus_stats.apb1_writes++ : bus_stats.apb1_reads++;
+  else if (offset < AHB_OFFSET)
+    write ? bus_stats.apb2_writes++ : bus_stats.apb2_reads++;
+  else
+    write ? bus_stats.ahb_writes++ : bus_stats.ahb_reads++;
+}
+
+/**
+ * @brief  GPIO port whose BSRR or BRR a register is
+ * @retval Port, NULL if neither
+ */
+static GPIO_TypeDef *GpioSetReset(volatile uint32_t *reg) {
+  GPIO_TypeDef *const ports[] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE};
+
+  for (size_t i = 0; i < sizeof(ports) / sizeof(ports[0]); i++) {
+    if (reg == &ports[i]->BSRR || reg == &ports[i]->BRR)
+      return ports[i];
+  }
+  return NULL;
+}
+
+uint32_t Sim_ReadReg(volatile uint32_t *reg) {
+  uintptr_t offset = REG_OFFSET(reg);
+
+  CountAccess(offset, 0);
+
+  if (offset >= PERIPH_OFFSET(I2C1) && offset < PERIPH_OFFSET(I2C1) + 0x400)
+    return Sim_I2C1_Read(offset - PERIPH_OFFSET(I2C1));
+
+  if (reg == &USART3->DR)
+    return Sim_USART3_ReadDR();
+
+  if (reg == &FLASH->SR)
+    return Sim_Flash_ReadSR();
+
+  return *reg;
+}
+
+void Sim_WriteReg(volatile uint32_t *reg, uint32_t value) {
+  uintptr_t offset = REG_OFFSET(reg);
+  GPIO_TypeDef *port;
+
+  CountAccess(offset, 1);
+
+  /* Set wins over reset in BSRR; both registers stay 0 */
+  if ((port = GpioSetReset(reg)) != NULL) {
+    if (reg == &port->BSRR)
+      port->ODR = (port->ODR & ~(value >> 16)) | (value & 0xFFFFU);
+    else
+      port->ODR &= ~(value & 0xFFFFU);
+    return;
+  }
+
+  /* Timer status flags are rc_w0 */
+  if (reg == &TIM2->SR || reg == &TIM3->SR || reg == &TIM4->SR ||
+      reg == &TIM1->SR) {
+    *reg &= value;
+    return;
+  }
+
+  if (offset >= PERIPH_OFFSET(I2C1) && offset < PERIPH_OFFSET(I2C1) + 0x400) {
+    Sim_I2C1_Write(offset - PERIPH_OFFSET(I2C1), value);
+    return;
+  }
+
+  if (reg == &USART3->DR) {
+    Sim_USART3_WriteDR(value);
+    return;
+  }
+
+  if (reg == &CRC->DR) {
+    Sim_CRC_WriteDR(value);
+    return;
+  }
+  if (reg == &CRC->CR) {
+    Sim_CRC_WriteCR(value);
+    return;
+  }
+
+  if (reg == &FLASH->SR) {
+    Sim_Flash_WriteSR(value);
+    return;
+  }
+  if (reg == &FLASH->KEYR) {
+    Sim_Flash_WriteKEYR(value);
+    return;
+  }
+  if (reg == &FLASH->CR) {
+    Sim_Flash_WriteCR(value);
+    return;
+  }
+
+  if (offset >= PERIPH_OFFSET(DMA1) && offset < PERIPH_OFFSET(DMA1) + 0x400 &&
+      Sim_DMA_Write(reg, value))
+    return;
+
+  *reg = value;
+}
+
+/* ================ Clock ================ */
+
+double Sim_Now(void) { return clock_now ? clock_now() : 0.0; }
+
+void Sim_Wait(double seconds) {
+  if (clock_wait)
+    clock_wait(seconds);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset all peripheral registers and interrupt state
+ */
+void Sim_Periph_Reset(void) {
+  memset(Sim_PeriphMem, 0, sizeof(Sim_PeriphMem));
+  memset(&Sim_DWT, 0, sizeof(Sim_DWT));
+  memset(&Sim_CoreDebug, 0, sizeof(Sim_CoreDebug));
+  memset(irq_enabled, 0, sizeof(irq_enabled));
+  memset(irq_pending, 0, sizeof(irq_pending));
+  memset(irq_active, 0, sizeof(irq_active));
+  memset(irq_count, 0, sizeof(irq_count));
+  primask = 0;
+  uwTick = 0;
+  memset(&bus_stats, 0, sizeof(bus_stats));
+  Sim_I2C1_Reset();
+  Sim_DMA_Reset();
+  Sim_USART3_Reset();
+  Sim_CRC_Reset();
+  Sim_Flash_Reset();
+
+  /* DMA address registers and flash addresses are 32 bits wide */
+  if ((uintptr_t)Sim_PeriphMem > UINT32_MAX ||
+      (uintptr_t)Sim_FlashMem > UINT32_MAX) {
+    fprintf(stderr, "simulator must be linked as a non-PIE executable\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief  Register accesses since the last reset (or clear)
+ */
+void Sim_Periph_GetBusStats(Sim_Bus_Stats_t *out) { *out = bus_stats; }
+
+/**
+ * @brief  Clear the register access counts
+ */
+void Sim_Periph_ClearBusStats(void) {
+  memset(&bus_stats, 0, sizeof(bus_stats));
+}
+
+/**
+ * @brief  Connect the simulation clock
+ */
+void Sim_Periph_SetClock(double (*now)(void), void (*wait)(double seconds)) {
+  clock_now = now;
+  clock_wait = wait;
+}
+
+/**
+ * @brief  Set the modelled CPU cost of each interrupt handler
+ */
+void Sim_Periph_SetIRQCost(uint32_t cycles, void (*spend)(uint32_t cycles)) {
+  irq_cycles = cycles;
+  irq_spend = spend;
+}
+
+/**
+ * @brief  Time of the next peripheral event
+ */
+double Sim_Periph_NextEventTime(void) {
+  return fmin(Sim_I2C1_NextEventTime(), Sim_USART3_NextEventTime());
+}
+
+/**
+ * @brief  Complete peripheral events that are due
+ */
+void Sim_Periph_Service(void) {
+  Sim_I2C1_Service();
+  Sim_USART3_Service();
+}
+
+/**
+ * @brief  Drive a GPIO input pin level
+ */
+void Sim_GPIO_SetInput(GPIO_TypeDef *port, uint8_t pin, uint8_t level) {
+  uint32_t mask = 1UL << pin;
+  uint8_t old_level = (port->IDR & mask) ? 1 : 0;
+
+  if (old_level == level)
+    return;
+
+  if (level)
+    port->IDR |= mask;
+  else
+    port->IDR &= ~mask;
+
+  Sim_TIM_InputChanged(port, pin, level);
+
+  /* EXTI line routed to this port? */
+  uint32_t port_index = (uint32_t)(((uintptr_t)port - (uintptr_t)GPIOA) / 0x400);
+  uint32_t exticr = (AFIO->EXTICR[pin / 4] >> ((pin % 4) * 4)) & 0xF;
+  if (exticr != port_index || !(EXTI->IMR & mask))
+    return;
+
+  if ((level && (EXTI->RTSR & mask)) || (!level && (EXTI->FTSR & mask))) {
+    int32_t irqn;
+    if (pin <= 4)
+      irqn = EXTI0_IRQn + pin;
+    else if (pin <= 9)
+      irqn = EXTI9_5_IRQn;
+    else
+      irqn = EXTI15_10_IRQn;
+
+    EXTI->PR |= mask;
+    Sim_RaiseIRQ(irqn);
+    EXTI->PR &= ~mask; /* rc_w1: handler has acknowledged the line */
+  }
+}
+
+/**
+ * @brief  Read a GPIO output pin level
+ */
+uint8_t Sim_GPIO_GetOutput(GPIO_TypeDef *port, uint8_t pin) {
+  return (port->ODR >> pin) & 1U;
+}
+
+/**
+ * @brief  Mark an interrupt pending and dispatch it if enabled
+ */
+void Sim_RaiseIRQ(int32_t irqn) {
+  if (irqn == SysTick_IRQn) {
+    if (!primask && SysTick_Handler) {
+      SysTick_Handler();
+      SpendIRQCycles();
+    }
+    return;
+  }
+
+  if (irqn >= 0 && irqn < SIM_IRQ_COUNT) {
+    irq_pending[irqn] = 1;
+    DispatchIRQs();
+  }
+}
+
+/**
+ * @brief  Check whether an interrupt is enabled in the NVIC
+ */
+uint8_t Sim_IRQEnabled(int32_t irqn) {
+  return (irqn >= 0 && irqn < SIM_IRQ_COUNT) ? irq_enabled[irqn] : 0;
+}
+
+/**
+ * @brief  Number of times an interrupt handler has run since reset
+ */
+uint32_t Sim_IRQCount(int32_t irqn) {
+  return (irqn >= 0 && irqn < SIM_IRQ_COUNT) ? irq_count[irqn] : 0;
+}
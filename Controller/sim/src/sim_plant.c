@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * @file    sim_plant.c
+ * @brief   Two-wheel differential drive plant model
+ ******************************************************************************
+ */
+
+#include "sim_plant.h"
+#include <math.h>
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Fill in default parameters
+ */
+void Plant_DefaultConfig(Plant_Config_t *config) {
+  config->battery_v = 7.4f;
+  config->resistance = 4.0f;
+  config->ke = 0.25f;
+  config->kt = 0.25f;
+  config->inertia = 1.0e-3f;
+  config->viscous = 1.0e-3f;
+  config->coulomb = 0.02f;
+  config->right_gain = 1.05f;
+  config->wheel_radius = 0.0325f;
+  config->track_width = 0.15f;
+}
+
+/**
+ * @brief  Reset the robot to rest at the origin
+ */
+void Plant_Init(Plant_t *plant, const Plant_Config_t *config) {
+  plant->config = *config;
+  plant->left.omega = 0.0f;
+  plant->left.angle = 0.0;
+  plant->right.omega = 0.0f;
+  plant->right.angle = 0.0;
+  plant->x = 0.0;
+  plant->y = 0.0;
+  plant->theta = 0.0;
+  plant->v = 0.0f;
+  plant->yaw_rate = 0.0f;
+  plant->accel = 0.0f;
+}
+
+/**
+ * @brief  Advance one wheel (semi-implicit Euler)
+ */
+void Plant_WheelStep(const Plant_Config_t *config, Plant_Wheel_t *wheel,
+                     const Plant_Bridge_t *bridge, float gain, float dt) {
+  float current;
+
+  if (bridge->in1 && bridge->in2) {
+    current = 0.0f; /* Coast: bridge open */
+  } else {
+    float voltage = 0.0f; /* Brake: terminals shorted */
+    if (bridge->in1)
+      voltage = bridge->duty * config->battery_v;
+    else if (bridge->in2)
+      voltage = -bridge->duty * config->battery_v;
+    current = (voltage - config->ke * wheel->omega) / config->resistance;
+  }
+
+  float drive = gain * config->kt * current - config->viscous * wheel->omega;
+
+  /* Static friction holds the wheel until the drive torque exceeds it */
+  if (wheel->omega == 0.0f && fabsf(drive) <= config->coulomb) {
+    return;
+  }
+
+  float friction = (wheel->omega != 0.0f) ? copysignf(config->coulomb, wheel->omega)
+                                          : copysignf(config->coulomb, drive);
+  float omega = wheel->omega + (drive - friction) / config->inertia * dt;
+
+  /* Friction cannot reverse the wheel within one step */
+  if (wheel->omega != 0.0f && (omega > 0.0f) != (wheel->omega > 0.0f))
+    omega = 0.0f;
+
+  wheel->omega = omega;
+  wheel->angle += (double)omega * dt;
+}
+
+/**
+ * @brief  Advance the robot
+ */
+void Plant_Step(Plant_t *plant, const Plant_Bridge_t *left,
+                const Plant_Bridge_t *right, float dt) {
+  const Plant_Config_t *config = &plant->config;
+
+  Plant_WheelStep(config, &plant->left, left, 1.0f, dt);
+  Plant_WheelStep(config, &plant->right, right, config->right_gain, dt);
+
+  float r = config->wheel_radius;
+  float v = r * (plant->left.omega + plant->right.omega) * 0.5f;
+
+  plant->accel = (v - plant->v) / dt;
+  plant->v = v;
+  plant->yaw_rate =
+      r * (plant->right.omega - plant->left.omega) / config->track_width;
+
+  plant->theta += (double)plant->yaw_rate * dt;
+  plant->x += (double)v * cos(plant->theta) * dt;
+  plant->y += (double)v * sin(plant->theta) * dt;
+}
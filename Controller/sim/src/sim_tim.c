@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+ * @file    sim_tim.c
+ * @brief   Simulated timer encoder interface
+ ******************************************************************************
+ *
+ * GPIO input changes on a timer's CH1/CH2 pins (default mapping) clock the
+ * counter when SMCR selects encoder mode 3 and CEN is set. Direction follows
+ * RM0008 "Counting direction versus encoder signals" with non-inverted
+ * inputs; the input filter is not modelled. Counting past ARR or below 0
+ * wraps, sets UIF and raises the update interrupt when UIE is set.
+ *
+ * Channel 1/2 input capture (CCxS = 01, CCxE) latches CNT into CCRx on the
+ * TIx edge selected by CCxP and raises the capture interrupt when CCxIE is
+ * set. The polarity bits are otherwise ignored (non-inverted counting).
+ *
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+#include <stddef.h>
+
+/* ================ Private Types ================ */
+
+typedef struct {
+  TIM_TypeDef *tim;
+  GPIO_TypeDef *port;
+  uint8_t ch1_pin;
+  uint8_t ch2_pin;
+  int32_t update_irq;
+  int32_t cc_irq;
+} Encoder_Input_t;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Count one step up or down, wrapping at ARR
+ */
+static void Count(const Encoder_Input_t *input, int8_t dir) {
+  TIM_TypeDef *tim = input->tim;
+  uint32_t arr = tim->ARR & 0xFFFF;
+  uint32_t cnt = tim->CNT & 0xFFFF;
+  uint8_t wrapped = 0;
+
+  if (dir > 0) {
+    tim->CR1 &= ~TIM_CR1_DIR;
+    wrapped = (cnt >= arr);
+    cnt = wrapped ? 0 : cnt + 1;
+  } else {
+    tim->CR1 |= TIM_CR1_DIR;
+    wrapped = (cnt == 0);
+    cnt = wrapped ? arr : cnt - 1;
+  }
+  tim->CNT = cnt;
+
+  if (wrapped) {
+    tim->SR |= TIM_SR_UIF;
+    if (tim->DIER & TIM_DIER_UIE)
+      Sim_RaiseIRQ(input->update_irq);
+  }
+}
+
+/**
+ * @brief  Channel 1 or 2 input capture on a TIx edge
+ */
+static void Capture(const Encoder_Input_t *input, uint8_t level,
+                    uint8_t channel) {
+  TIM_TypeDef *tim = input->tim;
+  uint32_t shift = (channel == 1) ? 0 : 4;   /* CCER field */
+  uint32_t ccmr_shift = (channel == 1) ? 0 : 8; /* CCMR1 field */
+  uint8_t falling = (tim->CCER >> shift) & TIM_CCER_CC1P ? 1 : 0;
+
+  if (((tim->CCMR1 >> ccmr_shift) & TIM_CCMR1_CC1S) != TIM_CCMR1_CC1S_0 ||
+      !((tim->CCER >> shift) & TIM_CCER_CC1E) || level == falling)
+    return;
+
+  if (channel == 1)
+    tim->CCR1 = tim->CNT;
+  else
+    tim->CCR2 = tim->CNT;
+
+  uint32_t flag = (channel == 1) ? TIM_SR_CC1IF : TIM_SR_CC2IF;
+  uint32_t enable = (channel == 1) ? TIM_DIER_CC1IE : TIM_DIER_CC2IE;
+  tim->SR |= flag;
+  if (tim->DIER & enable)
+    Sim_RaiseIRQ(input->cc_irq);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Feed a GPIO input change to any timer in encoder mode on that pin
+ */
+void Sim_TIM_InputChanged(GPIO_TypeDef *port, uint8_t pin, uint8_t level) {
+  /* Default (no remap) CH1/CH2 pins */
+  const Encoder_Input_t inputs[] = {
+      {TIM1, GPIOA, 8, 9, TIM1_UP_IRQn, TIM1_CC_IRQn},
+      {TIM2, GPIOA, 0, 1, TIM2_IRQn, TIM2_IRQn},
+      {TIM3, GPIOA, 6, 7, TIM3_IRQn, TIM3_IRQn},
+      {TIM4, GPIOB, 6, 7, TIM4_IRQn, TIM4_IRQn},
+  };
+
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    const Encoder_Input_t *input = &inputs[i];
+    TIM_TypeDef *tim = input->tim;
+
+    if (input->port != port ||
+        (pin != input->ch1_pin && pin != input->ch2_pin))
+      continue;
+    if (!(tim->CR1 & TIM_CR1_CEN) ||
+        (tim->SMCR & TIM_SMCR_SMS) != (TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1))
+      continue;
+
+    uint8_t ti1 = (port->IDR >> input->ch1_pin) & 1U;
+    uint8_t ti2 = (port->IDR >> input->ch2_pin) & 1U;
+
+    /* TI1 edge: up when rising with TI2 low or falling with TI2 high.
+     * TI2 edge: up when rising with TI1 high or falling with TI1 low. */
+    int8_t dir;
+    if (pin == input->ch1_pin)
+      dir = (level ^ ti2) ? 1 : -1;
+    else
+      dir = (level ^ ti1) ? -1 : 1;
+
+    Count(input, dir);
+
+    if (pin == input->ch1_pin)
+      Capture(input, level, 1);
+    else
+      Capture(input, level, 2);
+  }
+}
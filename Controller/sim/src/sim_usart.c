@@ -0,0 +1,244 @@
+/**
+ ******************************************************************************
+ * @file    sim_usart.c
+ * @brief   Simulated USART3 transmitter and receiver
+ ******************************************************************************
+ *
+ * A byte written to DR moves to the shift register when it is free and
+ * takes 10 bit times (8N1) at the BRR baud rate from the 36MHz APB1 clock.
+ * TXE and TC follow the data and shift registers; with CR3.DMAT set an
+ * empty data register requests DMA1 channel 2. Sent bytes are written to
+ * the file given to Sim_USART3_SetOutput().
+ *
+ * Bytes queued with Sim_USART3_Receive() arrive back to back, one frame
+ * time apart. Each sets RXNE (ORE if the last one was not read) and, with
+ * CR3.DMAR set, requests DMA1 channel 3. One idle frame after the last
+ * byte sets IDLE. Reading DR clears RXNE, ORE and IDLE.
+ *
+ ******************************************************************************
+ */
+
+#include "sim_periph.h"
+#include <math.h>
+#include <stddef.h>
+
+/* ================ Private Defines ================ */
+
+#define USART3_CLOCK_HZ 36e6
+#define USART3_TX_DMA_CHANNEL 2
+#define USART3_RX_DMA_CHANNEL 3
+#define FRAME_BITS 10
+
+/* Bytes waiting to arrive (power of two) */
+#define RX_QUEUE_SIZE 65536U
+
+/* ================ Private Variables ================ */
+
+static FILE *output = NULL;
+static uint32_t bytes_sent = 0;
+
+static double shift_due = INFINITY; /* Shift register busy until */
+static uint8_t shift_data = 0;
+static uint8_t tdr_full = 0;
+static uint8_t tdr_data = 0;
+
+static uint8_t rx_queue[RX_QUEUE_SIZE];
+static uint32_t rx_head = 0; /* Free-running queue indices */
+static uint32_t rx_tail = 0;
+static double rx_due = INFINITY;   /* Next byte complete at */
+static double idle_due = INFINITY; /* Idle frame complete at */
+static uint8_t rdr_data = 0;
+static uint32_t bytes_received = 0;
+
+/* ================ Private Functions ================ */
+
+static double FrameTime(void) {
+  uint32_t brr = USART3->BRR & 0xFFFF;
+  return (brr ? FRAME_BITS * brr / USART3_CLOCK_HZ : INFINITY);
+}
+
+static uint8_t Enabled(void) {
+  return (USART3->CR1 & (USART_CR1_UE | USART_CR1_TE)) ==
+         (USART_CR1_UE | USART_CR1_TE);
+}
+
+/**
+ * @brief  Start shifting a byte out
+ */
+static void Shift(uint8_t data) {
+  shift_data = data;
+  shift_due = Sim_Now() + FrameTime();
+  USART3->SR &= ~USART_SR_TC;
+}
+
+/**
+ * @brief  Data register empty with a DMA channel ready to fill it
+ */
+static uint8_t DmaPending(void) {
+  return (USART3->SR & USART_SR_TXE) && (USART3->CR3 & USART_CR3_DMAT) &&
+         (DMA1_Channel2->CCR & DMA_CCR_EN) && (DMA1_Channel2->CNDTR & 0xFFFF);
+}
+
+static uint8_t RxEnabled(void) {
+  return (USART3->CR1 & (USART_CR1_UE | USART_CR1_RE)) ==
+         (USART_CR1_UE | USART_CR1_RE);
+}
+
+/**
+ * @brief  Set receiver flags and raise the interrupt if enabled
+ */
+static void SetRxFlags(uint32_t flags) {
+  USART3->SR |= flags;
+  if (((flags & USART_SR_RXNE) && (USART3->CR1 & USART_CR1_RXNEIE)) ||
+      ((flags & USART_SR_IDLE) && (USART3->CR1 & USART_CR1_IDLEIE)))
+    Sim_RaiseIRQ(USART3_IRQn);
+}
+
+/**
+ * @brief  A byte finished arriving on RX
+ */
+static void ReceiveByte(uint8_t data) {
+  bytes_received++;
+  if (!RxEnabled())
+    return;
+
+  if (USART3->SR & USART_SR_RXNE) {
+    USART3->SR |= USART_SR_ORE; /* The new byte is lost */
+    return;
+  }
+  rdr_data = data;
+  SetRxFlags(USART_SR_RXNE);
+
+  if ((USART3->CR3 & USART_CR3_DMAR) && (DMA1_Channel3->CCR & DMA_CCR_EN))
+    Sim_DMA_Request(USART3_RX_DMA_CHANNEL);
+}
+
+/* ================ Register Hooks ================ */
+
+/**
+ * @brief  DR write: load the data register
+ */
+void Sim_USART3_WriteDR(uint32_t value) {
+  if (!Enabled())
+    return;
+
+  if (isinf(shift_due)) {
+    Shift((uint8_t)value);
+  } else {
+    tdr_data = (uint8_t)value;
+    tdr_full = 1;
+    USART3->SR &= ~USART_SR_TXE;
+  }
+}
+
+/**
+ * @brief  DR read: take the received byte
+ */
+uint32_t Sim_USART3_ReadDR(void) {
+  /* Stands in for the SR-then-DR sequences that clear ORE and IDLE */
+  USART3->SR &= ~(USART_SR_RXNE | USART_SR_ORE | USART_SR_IDLE);
+  return rdr_data;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Reset the transmitter and receiver
+ */
+void Sim_USART3_Reset(void) {
+  shift_due = INFINITY;
+  tdr_full = 0;
+  bytes_sent = 0;
+  rx_head = 0;
+  rx_tail = 0;
+  rx_due = INFINITY;
+  idle_due = INFINITY;
+  bytes_received = 0;
+  USART3->SR = USART_SR_TXE | USART_SR_TC;
+}
+
+/**
+ * @brief  Queue bytes to arrive on RX
+ */
+uint32_t Sim_USART3_Receive(const uint8_t *data, uint32_t length) {
+  uint32_t queued = 0;
+
+  while (queued < length && rx_head - rx_tail < RX_QUEUE_SIZE)
+    rx_queue[rx_head++ & (RX_QUEUE_SIZE - 1U)] = data[queued++];
+
+  if (queued && isinf(rx_due)) {
+    rx_due = Sim_Now() + FrameTime();
+    idle_due = INFINITY;
+  }
+  return queued;
+}
+
+/**
+ * @brief  Bytes queued on RX that have not arrived yet
+ */
+uint32_t Sim_USART3_RxQueued(void) { return rx_head - rx_tail; }
+
+/**
+ * @brief  Bytes arrived on RX since reset
+ */
+uint32_t Sim_USART3_BytesReceived(void) { return bytes_received; }
+
+/**
+ * @brief  Write transmitted bytes to a file (NULL to discard)
+ */
+void Sim_USART3_SetOutput(FILE *file) { output = file; }
+
+/**
+ * @brief  Bytes transmitted since reset
+ */
+uint32_t Sim_USART3_BytesSent(void) { return bytes_sent; }
+
+/**
+ * @brief  Time of the next transmitter event (INFINITY if none)
+ */
+double Sim_USART3_NextEventTime(void) {
+  if (DmaPending())
+    return Sim_Now();
+  return fmin(shift_due, fmin(rx_due, idle_due));
+}
+
+/**
+ * @brief  Finish the byte in flight and serve DMA requests
+ */
+void Sim_USART3_Service(void) {
+  if (Sim_Now() >= shift_due) {
+    if (output)
+      fputc(shift_data, output);
+    bytes_sent++;
+    shift_due = INFINITY;
+
+    if (tdr_full) {
+      tdr_full = 0;
+      USART3->SR |= USART_SR_TXE;
+      Shift(tdr_data);
+    } else {
+      USART3->SR |= USART_SR_TC;
+    }
+  }
+
+  /* At most two requests: one to the shift register, one to DR */
+  while (DmaPending())
+    Sim_DMA_Request(USART3_TX_DMA_CHANNEL);
+
+  while (Sim_Now() >= rx_due) {
+    double arrived = rx_due;
+    ReceiveByte(rx_queue[rx_tail++ & (RX_QUEUE_SIZE - 1U)]);
+    if (rx_head != rx_tail) {
+      rx_due = arrived + FrameTime();
+    } else {
+      rx_due = INFINITY;
+      idle_due = arrived + FrameTime();
+    }
+  }
+
+  if (Sim_Now() >= idle_due) {
+    idle_due = INFINITY;
+    if (RxEnabled())
+      SetRxFlags(USART_SR_IDLE);
+  }
+}
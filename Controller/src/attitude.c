@@ -0,0 +1,348 @@
+/**
+ ******************************************************************************
+ * @file    attitude.c
+ * @brief   Gyro/accel attitude fusion (complementary and Madgwick)
+ ******************************************************************************
+ *
+ * Fixed-point formats:
+ *   - Unit vectors, quaternions, per-update gyro angles: Q30
+ *   - Madgwick objective f: Q29 (range ±2); gradient: Q27 (only its
+ *     direction is used)
+ *   - Yaw (complementary): binary angle, 2^32 = one turn, wraps for free
+ *
+ * Products are 32x32->64 then shifted back (SMULL/ASR on Cortex-M3).
+ *
+ ******************************************************************************
+ */
+
+#include "attitude.h"
+#include <math.h>
+#include <stddef.h>
+
+/* ================ Private Defines ================ */
+
+#define DEG_TO_RAD 0.01745329252f
+#define RAD_TO_DEG 57.29577951f
+
+/* Radians (Q30) to binary angle: 2^32 / (2 * pi) in Q30 */
+#define RAD_TO_TURN_Q30 683565276
+
+/* Smallest cos^2(pitch) in the yaw rate divisor (about 85 deg, Q30) */
+#define YAW_MIN_COS2 (Q30_ONE >> 7)
+
+/* Gyro samples carry 8 fractional bits so the bias keeps sub-LSB detail */
+#define GYRO_FRAC_BITS 8
+
+/* 2^30 / sqrt((i + 0.5) / 16) for i = 4..15: inverse square root seeds
+ * over the normalised input range [0.25, 1) */
+static const uint32_t rsqrt_seed[12] = {
+    2024667000U, 1831380208U, 1684624773U, 1568300315U,
+    1473161629U, 1393471397U, 1325455684U, 1266516759U,
+    1214800200U, 1168942037U, 1127913670U, 1090922784U,
+};
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Q30 multiply
+ */
+static inline q30_t Mul(q30_t a, q30_t b) {
+  return (q30_t)(((int64_t)a * b) >> Q30_SHIFT);
+}
+
+/**
+ * @brief  Fast inverse square root
+ * @param  x: Input, > 0
+ * @param  shift: Set so that c / sqrt(x) in Q30 is (c * result) >> shift
+ * @retval Mantissa (Q30, 1.0 - 2.0)
+ */
+static uint32_t Rsqrt(uint64_t x, uint32_t *shift) {
+  /* Even shift keeps the square root exact: u / 2^32 in [0.25, 1) */
+  uint32_t k = (uint32_t)__builtin_clzll(x) & ~1U;
+  uint32_t u = (uint32_t)((x << k) >> 32);
+  uint32_t r = rsqrt_seed[(u >> 28) - 4U];
+
+  /* Newton: r = r * (3 - u * r^2) / 2, ~3% -> ~1e-3 -> ~1e-6 */
+  for (uint32_t i = 0; i < 2; i++) {
+    uint64_t r2 = ((uint64_t)r * r) >> Q30_SHIFT;
+    uint32_t t = (uint32_t)(((uint64_t)u * r2) >> 32);
+    r = (uint32_t)(((uint64_t)r * (3U * (uint32_t)Q30_ONE - t)) >> 31);
+  }
+
+  *shift = 32U - k / 2U;
+  return r;
+}
+
+/**
+ * @brief  Scale n components to a Q30 unit vector
+ * @retval 0 on success, -1 for a zero vector (out untouched)
+ */
+static int8_t Normalize(q30_t *out, const int32_t *in, uint32_t n) {
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < n; i++)
+    sum += (uint64_t)((int64_t)in[i] * in[i]);
+  if (sum == 0)
+    return -1;
+
+  uint32_t shift;
+  uint32_t r = Rsqrt(sum, &shift);
+  for (uint32_t i = 0; i < n; i++)
+    out[i] = (q30_t)(((int64_t)in[i] * r) >> shift);
+  return 0;
+}
+
+/**
+ * @brief  Set the state from a unit accelerometer vector, yaw zero
+ */
+static void Align(Attitude_t *att, const q30_t a[3]) {
+  att->up[0] = a[0];
+  att->up[1] = a[1];
+  att->up[2] = a[2];
+  att->yaw = 0;
+
+  /* Shortest rotation taking world up to a: (1 + az, ay, -ax, 0), halved
+   * so 1 + az fits */
+  int32_t q[4] = {(Q30_ONE >> 1) + (a[2] >> 1), a[1] >> 1, -(a[0] >> 1), 0};
+  if (q[0] < (Q30_ONE >> 12)) {
+    /* Upside down: any half turn about a horizontal axis */
+    q[0] = 0;
+    q[1] = Q30_ONE;
+    q[2] = 0;
+  }
+  Normalize(att->q, q, 4);
+
+  att->aligned = 1;
+}
+
+/**
+ * @brief  Complementary filter step
+ * @param  d: Rotation this update (Q30 rad per axis)
+ * @param  a: Unit accelerometer vector, NULL to skip the correction
+ */
+static void UpdateComplementary(Attitude_t *att, const q30_t d[3],
+                                const q30_t *a) {
+  const q30_t *v = att->up;
+
+  /*
+   * Yaw: Z-Y-X Euler rate, (q sin(roll) + r cos(roll)) / cos(pitch). With
+   * v = (-sin(pitch), sin(roll) cos(pitch), cos(roll) cos(pitch)) that is
+   * (q vy + r vz) / (vy^2 + vz^2); the divisor is clamped near +-90 pitch.
+   */
+  int64_t cos2 = ((int64_t)v[1] * v[1] + (int64_t)v[2] * v[2]) >> Q30_SHIFT;
+  if (cos2 < YAW_MIN_COS2)
+    cos2 = YAW_MIN_COS2;
+  int64_t spin = (((int64_t)d[1] * v[1] + (int64_t)d[2] * v[2]) / cos2);
+  att->yaw += (uint32_t)(int32_t)((spin * RAD_TO_TURN_Q30) >> Q30_SHIFT);
+
+  /* A world-fixed vector seen from the body turns the other way: v += v x d */
+  int32_t next[3] = {
+      v[0] + Mul(v[1], d[2]) - Mul(v[2], d[1]),
+      v[1] + Mul(v[2], d[0]) - Mul(v[0], d[2]),
+      v[2] + Mul(v[0], d[1]) - Mul(v[1], d[0]),
+  };
+
+  /* Pull towards the accelerometer */
+  if (a != NULL) {
+    for (uint32_t i = 0; i < 3; i++)
+      next[i] += (int32_t)(((int64_t)att->correction *
+                            ((int64_t)a[i] - next[i])) >>
+                           Q30_SHIFT);
+  }
+
+  Normalize(att->up, next, 3);
+}
+
+/**
+ * @brief  Madgwick filter step
+ * @param  d: Rotation this update (Q30 rad per axis)
+ * @param  a: Unit accelerometer vector, NULL to skip the correction
+ */
+static void UpdateMadgwick(Attitude_t *att, const q30_t d[3], const q30_t *a) {
+  const q30_t w = att->q[0], x = att->q[1], y = att->q[2], z = att->q[3];
+
+  /* Gyro: dq = 0.5 * q (x) (0, d) */
+  int32_t dq[4] = {
+      (int32_t)((-(int64_t)x * d[0] - (int64_t)y * d[1] - (int64_t)z * d[2]) >>
+                31),
+      (int32_t)(((int64_t)w * d[0] + (int64_t)y * d[2] - (int64_t)z * d[1]) >>
+                31),
+      (int32_t)(((int64_t)w * d[1] - (int64_t)x * d[2] + (int64_t)z * d[0]) >>
+                31),
+      (int32_t)(((int64_t)w * d[2] + (int64_t)x * d[1] - (int64_t)y * d[0]) >>
+                31),
+  };
+
+  if (a != NULL) {
+    /* Objective: predicted minus measured gravity direction (Q29) */
+    int32_t f1 =
+        (int32_t)(((int64_t)x * z - (int64_t)w * y) >> Q30_SHIFT) - (a[0] >> 1);
+    int32_t f2 =
+        (int32_t)(((int64_t)w * x + (int64_t)y * z) >> Q30_SHIFT) - (a[1] >> 1);
+    int32_t f3 = (Q30_ONE >> 1) -
+                 (int32_t)(((int64_t)x * x + (int64_t)y * y) >> Q30_SHIFT) -
+                 (a[2] >> 1);
+
+    /* Gradient J^T f, halved (Q27) */
+    int32_t s[4] = {
+        (int32_t)((-(int64_t)y * f1 + (int64_t)x * f2) >> 32),
+        (int32_t)(((int64_t)z * f1 + (int64_t)w * f2 - 2 * (int64_t)x * f3) >>
+                  32),
+        (int32_t)((-(int64_t)w * f1 + (int64_t)z * f2 - 2 * (int64_t)y * f3) >>
+                  32),
+        (int32_t)(((int64_t)x * f1 + (int64_t)y * f2) >> 32),
+    };
+
+    q30_t step[4];
+    if (Normalize(step, s, 4) == 0) {
+      for (uint32_t i = 0; i < 4; i++)
+        dq[i] -= Mul(att->correction, step[i]);
+    }
+  }
+
+  int32_t next[4] = {w + dq[0], x + dq[1], y + dq[2], z + dq[3]};
+  Normalize(att->q, next, 4);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Initialize a filter
+ */
+void Attitude_Init(Attitude_t *att, Attitude_Filter_t filter, float period,
+                   float gain) {
+  att->filter = filter;
+  att->gain = gain;
+  for (uint32_t i = 0; i < 3; i++)
+    att->bias[i] = 0;
+
+  Attitude_SetPeriod(att, period);
+  Attitude_Reset(att);
+}
+
+/**
+ * @brief  Change the update period
+ */
+void Attitude_SetPeriod(Attitude_t *att, float period) {
+  att->period = period;
+
+  /* rad per update for one 1/256 LSB in Q54, so (sample * k) >> 24 is Q30;
+   * fits 31 bits up to a 0.2s period */
+  att->gyro_k = (int32_t)(DEG_TO_RAD / ATTITUDE_GYRO_LSB_PER_DPS * period *
+                              (float)(1ULL << 46) +
+                          0.5f);
+
+  /* Complementary: fraction of the accel error removed per update;
+   * Madgwick: beta * period */
+  float correction = (att->filter == ATTITUDE_FILTER_MADGWICK)
+                         ? att->gain * period
+                         : period / (att->gain + period);
+  att->correction = (q30_t)(correction * (float)Q30_ONE + 0.5f);
+}
+
+/**
+ * @brief  Set the gyro bias subtracted from every sample
+ */
+void Attitude_SetGyroBias(Attitude_t *att, const float bias_dps[3]) {
+  for (uint32_t i = 0; i < 3; i++)
+    att->bias[i] = (int32_t)lroundf(bias_dps[i] * ATTITUDE_GYRO_LSB_PER_DPS *
+                                    (float)(1 << GYRO_FRAC_BITS));
+}
+
+/**
+ * @brief  Re-align to the next accelerometer sample with yaw zero
+ */
+void Attitude_Reset(Attitude_t *att) {
+  att->q[0] = Q30_ONE;
+  att->q[1] = att->q[2] = att->q[3] = 0;
+  att->up[0] = att->up[1] = 0;
+  att->up[2] = Q30_ONE;
+  att->yaw = 0;
+  att->aligned = 0;
+}
+
+/**
+ * @brief  Fuse one sample
+ */
+void Attitude_Update(Attitude_t *att, const int16_t gyro[3],
+                     const int16_t accel[3]) {
+  const int32_t raw_accel[3] = {accel[0], accel[1], accel[2]};
+  q30_t a[3];
+  uint8_t have_accel = (Normalize(a, raw_accel, 3) == 0);
+
+  if (!att->aligned) {
+    if (have_accel)
+      Align(att, a);
+    return;
+  }
+
+  /* Rotation this update */
+  q30_t d[3];
+  for (uint32_t i = 0; i < 3; i++) {
+    int32_t rate = ((int32_t)gyro[i] << GYRO_FRAC_BITS) - att->bias[i];
+    d[i] = (q30_t)(((int64_t)rate * att->gyro_k) >> 24);
+  }
+
+  if (att->filter == ATTITUDE_FILTER_MADGWICK)
+    UpdateMadgwick(att, d, have_accel ? a : NULL);
+  else
+    UpdateComplementary(att, d, have_accel ? a : NULL);
+}
+
+/**
+ * @brief  Get Euler angles (Z-Y-X)
+ */
+void Attitude_GetEuler(const Attitude_t *att, float *roll, float *pitch,
+                       float *yaw) {
+  if (att->filter == ATTITUDE_FILTER_MADGWICK) {
+    const float s = 1.0f / (float)Q30_ONE;
+    float w = att->q[0] * s, x = att->q[1] * s, y = att->q[2] * s,
+          z = att->q[3] * s;
+    float sin_pitch = 2.0f * (w * y - z * x);
+    if (sin_pitch > 1.0f)
+      sin_pitch = 1.0f;
+    if (sin_pitch < -1.0f)
+      sin_pitch = -1.0f;
+
+    if (roll)
+      *roll = atan2f(2.0f * (w * x + y * z), 1.0f - 2.0f * (x * x + y * y)) *
+              RAD_TO_DEG;
+    if (pitch)
+      *pitch = asinf(sin_pitch) * RAD_TO_DEG;
+    if (yaw)
+      *yaw = atan2f(2.0f * (w * z + x * y), 1.0f - 2.0f * (y * y + z * z)) *
+             RAD_TO_DEG;
+    return;
+  }
+
+  float vx = (float)att->up[0], vy = (float)att->up[1], vz = (float)att->up[2];
+  if (roll)
+    *roll = atan2f(vy, vz) * RAD_TO_DEG;
+  if (pitch)
+    *pitch = atan2f(-vx, sqrtf(vy * vy + vz * vz)) * RAD_TO_DEG;
+  if (yaw)
+    *yaw = (float)(int32_t)att->yaw * (360.0f / 4294967296.0f);
+}
+
+/**
+ * @brief  Get the attitude quaternion (body to world)
+ */
+void Attitude_GetQuaternion(const Attitude_t *att, float q[4]) {
+  if (att->filter == ATTITUDE_FILTER_MADGWICK) {
+    for (uint32_t i = 0; i < 4; i++)
+      q[i] = (float)att->q[i] * (1.0f / (float)Q30_ONE);
+    return;
+  }
+
+  /* Complementary: compose Z-Y-X from the Euler angles */
+  float roll, pitch, yaw;
+  Attitude_GetEuler(att, &roll, &pitch, &yaw);
+  float cr = cosf(0.5f * roll * DEG_TO_RAD), sr = sinf(0.5f * roll * DEG_TO_RAD);
+  float cp = cosf(0.5f * pitch * DEG_TO_RAD),
+        sp = sinf(0.5f * pitch * DEG_TO_RAD);
+  float cy = cosf(0.5f * yaw * DEG_TO_RAD), sy = sinf(0.5f * yaw * DEG_TO_RAD);
+
+  q[0] = cr * cp * cy + sr * sp * sy;
+  q[1] = sr * cp * cy - cr * sp * sy;
+  q[2] = cr * sp * cy + sr * cp * sy;
+  q[3] = cr * cp * sy - sr * sp * cy;
+}
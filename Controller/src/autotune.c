@@ -0,0 +1,148 @@
+/**
+ ******************************************************************************
+ * @file    autotune.c
+ * @brief   Relay-feedback (Astrom-Hagglund) PID autotuner
+ ******************************************************************************
+ *
+ * A cycle runs from one upward relay switch to the next. Its period is the
+ * time between the switches and its amplitude half the measurement's
+ * peak-to-peak over the cycle. The first AUTOTUNE_SKIP_CYCLES are dropped,
+ * then the next `cycles` are averaged.
+ *
+ ******************************************************************************
+ */
+
+#include "autotune.h"
+#include <math.h>
+
+/* ================ Private Defines ================ */
+
+#define PI_F 3.14159265f
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Start a relay experiment
+ */
+void Autotune_Init(Autotune_t *at, float amplitude, float hysteresis,
+                   uint8_t cycles, float timeout) {
+  at->amplitude = amplitude;
+  at->hysteresis = hysteresis;
+  at->timeout = timeout;
+  at->cycles = cycles ? cycles : 1;
+
+  at->status = AUTOTUNE_RUNNING;
+  at->time = 0.0f;
+  at->relay = 1;
+  at->high = -INFINITY;
+  at->low = INFINITY;
+  at->last_rise = -1.0f;
+  at->seen = 0;
+  at->sum_amplitude = 0.0f;
+  at->sum_period = 0.0f;
+
+  at->ku = 0.0f;
+  at->tu = 0.0f;
+}
+
+/**
+ * @brief  Advance one tick
+ */
+float Autotune_Update(Autotune_t *at, float setpoint, float measurement,
+                      float dt) {
+  if (at->status != AUTOTUNE_RUNNING)
+    return 0.0f;
+
+  at->time += dt;
+  if (at->time > at->timeout) {
+    at->status = AUTOTUNE_FAILED;
+    return 0.0f;
+  }
+
+  if (measurement > at->high)
+    at->high = measurement;
+  if (measurement < at->low)
+    at->low = measurement;
+
+  float error = setpoint - measurement;
+
+  if (at->relay > 0 && error < -at->hysteresis) {
+    at->relay = -1;
+  } else if (at->relay < 0 && error > at->hysteresis) {
+    /* Upward switch: one full cycle since the previous one */
+    at->relay = 1;
+
+    if (at->last_rise >= 0.0f) {
+      if (at->seen >= AUTOTUNE_SKIP_CYCLES) {
+        at->sum_amplitude += 0.5f * (at->high - at->low);
+        at->sum_period += at->time - at->last_rise;
+      }
+      at->seen++;
+    }
+    at->last_rise = at->time;
+    at->high = measurement;
+    at->low = measurement;
+
+    if (at->seen >= AUTOTUNE_SKIP_CYCLES + at->cycles) {
+      float a = at->sum_amplitude / at->cycles;
+      float h = at->hysteresis;
+
+      if (a <= h) {
+        at->status = AUTOTUNE_FAILED;
+        return 0.0f;
+      }
+      at->ku = 4.0f * at->amplitude / (PI_F * sqrtf(a * a - h * h));
+      at->tu = at->sum_period / at->cycles;
+      at->status = AUTOTUNE_DONE;
+      return 0.0f;
+    }
+  }
+
+  return at->relay * at->amplitude;
+}
+
+/**
+ * @brief  Get the experiment status
+ */
+Autotune_Status_t Autotune_GetStatus(const Autotune_t *at) {
+  return at->status;
+}
+
+/**
+ * @brief  Gains from the measured Ku and Tu
+ */
+int8_t Autotune_ComputeGains(const Autotune_t *at, Autotune_Rule_t rule,
+                             float *Kp, float *Ki, float *Kd) {
+  if (at->status != AUTOTUNE_DONE)
+    return -1;
+
+  float kp, ti, td;
+  switch (rule) {
+  case AUTOTUNE_RULE_ZN_PI:
+    kp = 0.45f * at->ku;
+    ti = at->tu / 1.2f;
+    td = 0.0f;
+    break;
+  case AUTOTUNE_RULE_ZN_PID:
+    kp = 0.6f * at->ku;
+    ti = at->tu / 2.0f;
+    td = at->tu / 8.0f;
+    break;
+  case AUTOTUNE_RULE_TL_PI:
+    kp = at->ku / 3.2f;
+    ti = 2.2f * at->tu;
+    td = 0.0f;
+    break;
+  case AUTOTUNE_RULE_TL_PID:
+  default:
+    kp = at->ku / 2.2f;
+    ti = 2.2f * at->tu;
+    td = at->tu / 6.3f;
+    break;
+  }
+
+  *Kp = kp;
+  *Ki = kp / ti;
+  *Kd = kp * td;
+  return 0;
+}
@@ -0,0 +1,241 @@
+/**
+ ******************************************************************************
+ * @file    control_loop.c
+ * @brief   Timer-triggered control loop with DWT timing statistics
+ ******************************************************************************
+ *
+ * TIM4 runs from the 72MHz APB1 timer clock, prescaled to a 1MHz tick.
+ * Each update event calls the registered callback from the TIM4 interrupt,
+ * timestamping entry and exit with DWT->CYCCNT.
+ *
+ ******************************************************************************
+ */
+
+#include "control_loop.h"
+#include "main.h"
+
+/* ================ Private Defines ================ */
+
+/* APB1 prescaler is 2, so APB1 timers run at 2 x PCLK1 = SYSCLK */
+#define CONTROL_LOOP_TIM_CLOCK_HZ SYSTEM_CLOCK_HZ
+#define CONTROL_LOOP_TICK_HZ 1000000U
+
+/* ================ Private Variables ================ */
+
+static ControlLoop_Callback_t loop_callback = 0;
+static uint32_t loop_rate_hz = 0;
+static float loop_dt = 0.0f;
+static uint32_t period_cycles = 0;
+
+/* Previous update start (for jitter) */
+static uint32_t last_start = 0;
+static uint8_t have_last_start = 0;
+
+static volatile ControlLoop_Stats_t stats;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Clear statistics (caller ensures the ISR cannot run)
+ */
+static void ClearStats(void) {
+  stats.iterations = 0;
+  stats.overruns = 0;
+  stats.jitter_min = INT32_MAX;
+  stats.jitter_max = INT32_MIN;
+  stats.exec_min = UINT32_MAX;
+  stats.exec_max = 0;
+  for (uint32_t i = 0; i < CONTROL_LOOP_HIST_BINS; i++) {
+    stats.jitter_hist[i] = 0;
+    stats.exec_hist[i] = 0;
+  }
+  have_last_start = 0;
+}
+
+/**
+ * @brief  Record start-to-start jitter
+ */
+static void RecordJitter(int32_t jitter) {
+  uint32_t magnitude = (jitter < 0) ? (uint32_t)-jitter : (uint32_t)jitter;
+  uint32_t bin = magnitude >> CONTROL_LOOP_JITTER_BIN_SHIFT;
+
+  if (jitter < stats.jitter_min)
+    stats.jitter_min = jitter;
+  if (jitter > stats.jitter_max)
+    stats.jitter_max = jitter;
+  if (bin >= CONTROL_LOOP_HIST_BINS)
+    bin = CONTROL_LOOP_HIST_BINS - 1;
+  stats.jitter_hist[bin]++;
+}
+
+/**
+ * @brief  Record callback execution time
+ */
+static void RecordExec(uint32_t exec) {
+  uint32_t bin = CONTROL_LOOP_HIST_BINS - 1;
+
+  if (exec < stats.exec_min)
+    stats.exec_min = exec;
+  if (exec > stats.exec_max)
+    stats.exec_max = exec;
+  if (exec < period_cycles)
+    bin = (exec * CONTROL_LOOP_HIST_BINS) / period_cycles;
+  else
+    stats.overruns++;
+  stats.exec_hist[bin]++;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Configure TIM4 and the DWT cycle counter
+ */
+int8_t ControlLoop_Init(uint32_t rate_hz, ControlLoop_Callback_t callback) {
+  if (rate_hz < CONTROL_LOOP_MIN_HZ || rate_hz > CONTROL_LOOP_MAX_HZ ||
+      callback == 0)
+    return -1;
+
+  uint32_t ticks = CONTROL_LOOP_TICK_HZ / rate_hz;
+
+  loop_callback = callback;
+  loop_rate_hz = rate_hz;
+  loop_dt = (float)ticks / (float)CONTROL_LOOP_TICK_HZ;
+  period_cycles = ticks * (CONTROL_LOOP_TIM_CLOCK_HZ / CONTROL_LOOP_TICK_HZ);
+
+  /* Enable DWT cycle counter */
+  SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+  SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+  /* Enable TIM4 clock */
+  SET_BIT(RCC->APB1ENR, RCC_APB1ENR_TIM4EN);
+
+  /* Configure TIM4: 1MHz tick, update every period */
+  CLEAR_BIT(TIM4->CR1, TIM_CR1_CEN);
+  WRITE_REG(TIM4->PSC, CONTROL_LOOP_TIM_CLOCK_HZ / CONTROL_LOOP_TICK_HZ - 1);
+  WRITE_REG(TIM4->ARR, ticks - 1);
+  WRITE_REG(TIM4->CNT, 0);
+
+  /* Load PSC/ARR, then drop the update flag the UG event raised */
+  SET_BIT(TIM4->EGR, TIM_EGR_UG);
+  WRITE_REG(TIM4->SR, 0);
+
+  SET_BIT(TIM4->DIER, TIM_DIER_UIE);
+
+  NVIC_SetPriority(TIM4_IRQn, CONTROL_LOOP_IRQ_PRIORITY);
+  NVIC_EnableIRQ(TIM4_IRQn);
+
+  ClearStats();
+
+  return 0;
+}
+
+/**
+ * @brief  Start periodic updates
+ */
+void ControlLoop_Start(void) {
+  have_last_start = 0;
+  WRITE_REG(TIM4->CNT, 0);
+  SET_BIT(TIM4->CR1, TIM_CR1_CEN);
+}
+
+/**
+ * @brief  Stop periodic updates
+ */
+void ControlLoop_Stop(void) {
+  CLEAR_BIT(TIM4->CR1, TIM_CR1_CEN);
+  WRITE_REG(TIM4->SR, 0);
+}
+
+/**
+ * @brief  Change the loop rate
+ */
+int8_t ControlLoop_SetRate(uint32_t rate_hz) {
+  if (rate_hz < CONTROL_LOOP_MIN_HZ || rate_hz > CONTROL_LOOP_MAX_HZ)
+    return -1;
+
+  uint32_t ticks = CONTROL_LOOP_TICK_HZ / rate_hz;
+
+  /* The update interrupt reads the period and writes the statistics */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  loop_rate_hz = rate_hz;
+  loop_dt = (float)ticks / (float)CONTROL_LOOP_TICK_HZ;
+  period_cycles = ticks * (CONTROL_LOOP_TIM_CLOCK_HZ / CONTROL_LOOP_TICK_HZ);
+
+  /* ARR is not preloaded: restart the period if the counter is already
+   * past the new end, or it would run on to 0xFFFF */
+  WRITE_REG(TIM4->ARR, ticks - 1);
+  if (READ_REG(TIM4->CNT) >= ticks - 1)
+    WRITE_REG(TIM4->CNT, 0);
+
+  /* Histogram bins and jitter are relative to the period */
+  ClearStats();
+
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+ * @brief  Get configured loop rate
+ */
+uint32_t ControlLoop_GetRate(void) { return loop_rate_hz; }
+
+/**
+ * @brief  Get number of completed updates
+ */
+uint32_t ControlLoop_GetIterations(void) { return stats.iterations; }
+
+/**
+ * @brief  Copy a consistent snapshot of the timing statistics
+ */
+void ControlLoop_GetStats(ControlLoop_Stats_t *out) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  out->iterations = stats.iterations;
+  out->overruns = stats.overruns;
+  out->jitter_min = stats.jitter_min;
+  out->jitter_max = stats.jitter_max;
+  out->exec_min = stats.exec_min;
+  out->exec_max = stats.exec_max;
+  for (uint32_t i = 0; i < CONTROL_LOOP_HIST_BINS; i++) {
+    out->jitter_hist[i] = stats.jitter_hist[i];
+    out->exec_hist[i] = stats.exec_hist[i];
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Clear timing statistics
+ */
+void ControlLoop_ResetStats(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  ClearStats();
+  __set_PRIMASK(primask);
+}
+
+/* ================ Interrupt Handlers ================ */
+
+/**
+ * @brief  TIM4 update handler - runs one control iteration
+ */
+void ControlLoop_IRQHandler(void) {
+  uint32_t start = DWT->CYCCNT;
+
+  if (!READ_BIT(TIM4->SR, TIM_SR_UIF))
+    return;
+  WRITE_REG(TIM4->SR, ~TIM_SR_UIF); /* rc_w0: clear only UIF */
+
+  if (have_last_start)
+    RecordJitter((int32_t)(start - last_start - period_cycles));
+  last_start = start;
+  have_last_start = 1;
+
+  loop_callback(loop_dt);
+
+  RecordExec(DWT->CYCCNT - start);
+  stats.iterations++;
+}
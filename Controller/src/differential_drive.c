@@ -12,6 +12,12 @@
  *   Left Motor  = Base Speed - Heading Correction
  *   Right Motor = Base Speed + Heading Correction
  *
+ * Base Speed = Speed PID towards the profiled speed, with feedforward
+ * (optionally gain scheduled over the profiled speed)
+ *
+ * Autotuning runs inside the same tick in place of the PIDs: phase 1
+ * relays both wheel speeds, phase 2 the heading (see differential_drive.h).
+ *
  ******************************************************************************
  */
 
@@ -19,8 +25,27 @@
 #include "encoder.h"
 #include "imu.h"
 #include "main.h"
+#include "motion_profile.h"
 #include "motor.h"
+#include "odometry.h"
 #include "pid.h"
+#include "telemetry.h"
+#include "trace.h"
+
+/* ================ Private Defines ================ */
+
+/* Autotune relays and telemetry PID terms, one per controller */
+#define PID_SPEED_LEFT 0U
+#define PID_SPEED_RIGHT 1U
+#define PID_HEADING 2U
+#define PID_COUNT 3U
+
+/* ================ Private Types ================ */
+
+typedef enum {
+  AUTOTUNE_PHASE_SPEED = 0, /* Relays on both wheel speeds */
+  AUTOTUNE_PHASE_HEADING    /* Relay on the heading */
+} AutotunePhase_t;
 
 /* ================ Private Variables ================ */
 
@@ -28,6 +53,8 @@
 static PID_t speed_pid_left;
 static PID_t speed_pid_right;
 static PID_t heading_pid;
+static PID_t *const pids[PID_COUNT] = {&speed_pid_left, &speed_pid_right,
+                                       &heading_pid};
 
 /* Drive state */
 static DriveState_t drive_state = DRIVE_STATE_STOPPED;
@@ -35,6 +62,11 @@ static DriveState_t drive_state = DRIVE_STATE_STOPPED;
 /* Target values */
 static float target_speed = 0.0f;
 
+/* Speed profile and gain schedule */
+static MotionProfile_t speed_profile;
+static PID_Schedule_t speed_schedule;
+static uint8_t speed_scheduled = 0;
+
 /* Current measured values */
 static float current_speed_left = 0.0f;
 static float current_speed_right = 0.0f;
@@ -44,6 +76,149 @@ static float current_heading = 0.0f;
 static int16_t left_motor_output = 0;
 static int16_t right_motor_output = 0;
 
+/* Autotune run (one relay per PID) */
+static Autotune_t autotune[PID_COUNT];
+static Autotune_Rule_t autotune_rule;
+static AutotunePhase_t autotune_phase;
+static float autotune_saved[PID_COUNT][3]; /* Gains restored on failure */
+static DriveAutotune_Result_t autotune_result;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Clamp and apply the motor commands
+ */
+static void ApplyMotorOutputs(float left, float right) {
+  left_motor_output = (int16_t)left;
+  right_motor_output = (int16_t)right;
+
+  /* Clamp to motor limits */
+  if (left_motor_output > MOTOR_MAX_SPEED)
+    left_motor_output = MOTOR_MAX_SPEED;
+  if (left_motor_output < MOTOR_MIN_SPEED)
+    left_motor_output = MOTOR_MIN_SPEED;
+  if (right_motor_output > MOTOR_MAX_SPEED)
+    right_motor_output = MOTOR_MAX_SPEED;
+  if (right_motor_output < MOTOR_MIN_SPEED)
+    right_motor_output = MOTOR_MIN_SPEED;
+
+  /* Apply to motors */
+  Motor_SetBoth(left_motor_output, right_motor_output);
+}
+
+#if TELEMETRY_ENABLE
+/**
+ * @brief  Publish the tick's measurements, PID terms and motor commands
+ */
+static void PublishTelemetry(float setpoint) {
+  Telemetry_Frame_t frame;
+
+  frame.speed_left = current_speed_left;
+  frame.speed_right = current_speed_right;
+  frame.setpoint = setpoint;
+  frame.heading = current_heading;
+  for (uint8_t i = 0; i < PID_COUNT; i++)
+    PID_GetTerms(pids[i], frame.pid[i]);
+  frame.motor_left = left_motor_output;
+  frame.motor_right = right_motor_output;
+
+  Telemetry_Publish(&frame);
+}
+#endif
+
+/**
+ * @brief  Store a finished relay measurement and apply its gains
+ */
+static void FinishAutotuneLoop(uint8_t index, DriveAutotune_Loop_t *loop) {
+  loop->ku = autotune[index].ku;
+  loop->tu = autotune[index].tu;
+  if (Autotune_ComputeGains(&autotune[index], autotune_rule, &loop->Kp,
+                            &loop->Ki, &loop->Kd) == 0)
+    PID_SetGains(pids[index], loop->Kp, loop->Ki, loop->Kd);
+}
+
+/**
+ * @brief  End the autotune run: keep or restore the gains
+ * @note   Leaves the state STOPPED; the caller stops the motors
+ */
+static void EndAutotune(Autotune_Status_t status) {
+  if (status != AUTOTUNE_DONE) {
+    for (uint8_t i = 0; i < PID_COUNT; i++)
+      PID_SetGains(pids[i], autotune_saved[i][0], autotune_saved[i][1],
+                   autotune_saved[i][2]);
+  } else {
+    speed_scheduled = 0;
+  }
+  autotune_result.status = status;
+  drive_state = DRIVE_STATE_STOPPED;
+}
+
+/**
+ * @brief  One autotune tick (after the IMU and odometry updates)
+ *
+ * Feedforward holds both wheels at the operating point and the relays
+ * oscillate around it. The heading relay runs without the speed PIDs,
+ * which would otherwise absorb its differential and starve the oscillation.
+ */
+static void UpdateAutotune(float dt) {
+  const float setpoint = DRIVE_AUTOTUNE_SPEED;
+  float bias_left = speed_pid_left.Kv * setpoint + speed_pid_left.Ks;
+  float bias_right = speed_pid_right.Kv * setpoint + speed_pid_right.Ks;
+
+  current_speed_left = Encoder_GetSpeedLeft(dt);
+  current_speed_right = Encoder_GetSpeedRight(dt);
+  current_heading = IMU_GetHeading();
+
+  if (autotune_phase == AUTOTUNE_PHASE_SPEED) {
+    /* A wheel that has finished stays on feedforward */
+    float relay_left = Autotune_Update(&autotune[PID_SPEED_LEFT], setpoint,
+                                       current_speed_left, dt);
+    float relay_right = Autotune_Update(&autotune[PID_SPEED_RIGHT], setpoint,
+                                        current_speed_right, dt);
+
+    Autotune_Status_t left = Autotune_GetStatus(&autotune[PID_SPEED_LEFT]);
+    Autotune_Status_t right = Autotune_GetStatus(&autotune[PID_SPEED_RIGHT]);
+    if (left == AUTOTUNE_FAILED || right == AUTOTUNE_FAILED) {
+      EndAutotune(AUTOTUNE_FAILED);
+      DifferentialDrive_Stop();
+      return;
+    }
+    if (left == AUTOTUNE_RUNNING || right == AUTOTUNE_RUNNING) {
+      ApplyMotorOutputs(bias_left + relay_left, bias_right + relay_right);
+      return;
+    }
+
+    FinishAutotuneLoop(PID_SPEED_LEFT, &autotune_result.left);
+    FinishAutotuneLoop(PID_SPEED_RIGHT, &autotune_result.right);
+
+    /* Heading phase starts straight ahead */
+    IMU_ResetHeading();
+    Odometry_ResetYawReference();
+    current_heading = 0.0f;
+    autotune_phase = AUTOTUNE_PHASE_HEADING;
+  }
+
+  /* The relay stands in for the heading PID output (same sign convention) */
+  float heading_correction = Autotune_Update(&autotune[PID_HEADING], 0.0f,
+                                             current_heading, dt);
+
+  switch (Autotune_GetStatus(&autotune[PID_HEADING])) {
+  case AUTOTUNE_RUNNING:
+    ApplyMotorOutputs(bias_left - heading_correction,
+                      bias_right + heading_correction);
+    break;
+  case AUTOTUNE_DONE:
+    FinishAutotuneLoop(PID_HEADING, &autotune_result.heading);
+    EndAutotune(AUTOTUNE_DONE);
+    DifferentialDrive_Stop();
+    break;
+  default:
+    EndAutotune(AUTOTUNE_FAILED);
+    DifferentialDrive_Stop();
+    break;
+  }
+}
+
 /* ================ Public Functions ================ */
 
 /**
@@ -58,6 +233,8 @@ void DifferentialDrive_Init(void) {
   int8_t imu_status = IMU_Init();
   (void)imu_status; /* TODO: handle IMU init failure */
 
+  Odometry_Init();
+
   /* Initialize Speed PID for left wheel */
   PID_Init(&speed_pid_left, SPEED_PID_KP, SPEED_PID_KI, SPEED_PID_KD,
            -MOTOR_MAX_SPEED, MOTOR_MAX_SPEED);
@@ -71,71 +248,126 @@ void DifferentialDrive_Init(void) {
   PID_Init(&heading_pid, HEADING_PID_KP, HEADING_PID_KI, HEADING_PID_KD, -500,
            500); /* Max ±50% correction */
 
+  /* Speed feedforward from the profiled velocity and acceleration */
+  PID_SetFeedforward(&speed_pid_left, DRIVE_FF_KV, DRIVE_FF_KS, DRIVE_FF_KA);
+  PID_SetFeedforward(&speed_pid_right, DRIVE_FF_KV, DRIVE_FF_KS, DRIVE_FF_KA);
+
   /* Set integral limits */
-  PID_SetIntegralLimit(&speed_pid_left, 300);
-  PID_SetIntegralLimit(&speed_pid_right, 300);
-  PID_SetIntegralLimit(&heading_pid, 200);
+  DifferentialDrive_SetIntegralLimits(300, 200);
+
+  MotionProfile_Init(&speed_profile, DRIVE_MAX_ACCEL, DRIVE_MAX_JERK);
 
   drive_state = DRIVE_STATE_STOPPED;
   target_speed = 0.0f;
 }
 
 /**
- * @brief  Calibrate sensors
+ * @brief  Reset encoders, heading, pose, PIDs and profile; stop
  */
-void DifferentialDrive_Calibrate(void) {
-  drive_state = DRIVE_STATE_CALIBRATING;
-
-  /* Stop motors during calibration */
-  Motor_Stop();
-
-  /* Calibrate IMU gyro bias */
-  IMU_Calibrate();
-
-  /* Reset encoders and heading */
+static void ResetStopped(void) {
+  /* Reset encoders, heading and pose */
   Encoder_Reset();
   IMU_ResetHeading();
+  Odometry_Reset();
 
   /* Reset PIDs */
   PID_Reset(&speed_pid_left);
   PID_Reset(&speed_pid_right);
   PID_Reset(&heading_pid);
+  MotionProfile_Reset(&speed_profile, 0.0f);
 
   drive_state = DRIVE_STATE_STOPPED;
 }
 
+/**
+ * @brief  Calibrate sensors
+ */
+IMU_CalibStatus_t DifferentialDrive_Calibrate(void) {
+  drive_state = DRIVE_STATE_CALIBRATING;
+
+  /* Stop motors during calibration */
+  Motor_Stop();
+
+  /* Calibrate IMU gyro bias */
+  IMU_CalibStatus_t status = IMU_Calibrate();
+
+  ResetStopped();
+  return status;
+}
+
+/**
+ * @brief  Use a stored calibration instead of calibrating
+ */
+void DifferentialDrive_RestoreCalibration(float gyro_z_bias) {
+  Motor_Stop();
+  IMU_SetGyroBias(gyro_z_bias);
+  ResetStopped();
+}
+
 /**
  * @brief  Set target forward speed
  */
 void DifferentialDrive_SetSpeed(float speed) {
   target_speed = speed;
+  MotionProfile_SetTarget(&speed_profile, speed);
 
   if (speed != 0.0f) {
     if (drive_state == DRIVE_STATE_STOPPED) {
       /* Reset heading when starting to move */
       IMU_ResetHeading();
+      Odometry_ResetYawReference();
       PID_Reset(&heading_pid);
     }
     drive_state = DRIVE_STATE_RUNNING;
-  } else {
+  } else if (drive_state != DRIVE_STATE_RUNNING) {
     drive_state = DRIVE_STATE_STOPPED;
   }
+  /* Running towards zero: Update() stops at the end of the ramp */
 }
 
 /**
  * @brief  Update control loop
  */
 void DifferentialDrive_Update(float dt) {
-  if (dt <= 0.0f || drive_state != DRIVE_STATE_RUNNING) {
+  TRACE_ENTER(TRACE_ID_DRIVE_UPDATE);
+
+  if (dt <= 0.0f || (drive_state != DRIVE_STATE_RUNNING &&
+                     drive_state != DRIVE_STATE_AUTOTUNING)) {
     if (drive_state == DRIVE_STATE_STOPPED) {
       Motor_Stop();
     }
+    TRACE_EXIT(TRACE_ID_DRIVE_UPDATE);
     return;
   }
 
-  /* Update IMU */
+  /* Start the next IMU burst; it completes in the background */
+  IMU_StartRead();
+
+  /* Update IMU from the sample read during the previous tick */
   IMU_Update(dt);
 
+  /* Integrate the pose from the encoder deltas and the new heading */
+  Odometry_Update();
+
+  if (drive_state == DRIVE_STATE_AUTOTUNING) {
+    UpdateAutotune(dt);
+    TRACE_EXIT(TRACE_ID_DRIVE_UPDATE);
+    return;
+  }
+
+  /* Advance the speed profile; stop once a ramp to zero has finished */
+  float setpoint = MotionProfile_Update(&speed_profile, dt);
+  if (target_speed == 0.0f && MotionProfile_IsDone(&speed_profile)) {
+    DifferentialDrive_Stop();
+    TRACE_EXIT(TRACE_ID_DRIVE_UPDATE);
+    return;
+  }
+  if (speed_scheduled) {
+    float point = (setpoint < 0.0f) ? -setpoint : setpoint;
+    PID_ApplySchedule(&speed_pid_left, &speed_schedule, point);
+    PID_ApplySchedule(&speed_pid_right, &speed_schedule, point);
+  }
+
   /* Get current wheel speeds */
   current_speed_left = Encoder_GetSpeedLeft(dt);
   current_speed_right = Encoder_GetSpeedRight(dt);
@@ -143,41 +375,44 @@ void DifferentialDrive_Update(float dt) {
   /* Get current heading */
   current_heading = IMU_GetHeading();
 
+  TRACE_ENTER(TRACE_ID_DRIVE_PID);
+
   /* Compute speed PID outputs */
   float speed_output_left =
-      PID_Compute(&speed_pid_left, target_speed, current_speed_left, dt);
+      PID_ComputeFF(&speed_pid_left, setpoint, speed_profile.accel,
+                    current_speed_left, dt);
   float speed_output_right =
-      PID_Compute(&speed_pid_right, target_speed, current_speed_right, dt);
+      PID_ComputeFF(&speed_pid_right, setpoint, speed_profile.accel,
+                    current_speed_right, dt);
 
   /* Compute heading correction */
   /* Setpoint is 0 (straight line), measurement is current heading */
   float heading_correction =
       PID_Compute(&heading_pid, 0.0f, current_heading, dt);
 
+  TRACE_EXIT(TRACE_ID_DRIVE_PID);
+
   /* Apply heading correction to motor outputs */
   /* Positive heading means robot turned right, so we need to turn left */
   /* Turn left = slow down left wheel or speed up right wheel */
-  left_motor_output = (int16_t)(speed_output_left - heading_correction);
-  right_motor_output = (int16_t)(speed_output_right + heading_correction);
+  ApplyMotorOutputs(speed_output_left - heading_correction,
+                    speed_output_right + heading_correction);
 
-  /* Clamp to motor limits */
-  if (left_motor_output > MOTOR_MAX_SPEED)
-    left_motor_output = MOTOR_MAX_SPEED;
-  if (left_motor_output < MOTOR_MIN_SPEED)
-    left_motor_output = MOTOR_MIN_SPEED;
-  if (right_motor_output > MOTOR_MAX_SPEED)
-    right_motor_output = MOTOR_MAX_SPEED;
-  if (right_motor_output < MOTOR_MIN_SPEED)
-    right_motor_output = MOTOR_MIN_SPEED;
+#if TELEMETRY_ENABLE
+  PublishTelemetry(setpoint);
+#endif
 
-  /* Apply to motors */
-  Motor_SetBoth(left_motor_output, right_motor_output);
+  TRACE_EXIT(TRACE_ID_DRIVE_UPDATE);
 }
 
 /**
  * @brief  Stop the robot
  */
 void DifferentialDrive_Stop(void) {
+  /* Aborted autotune: keep the previous gains */
+  if (drive_state == DRIVE_STATE_AUTOTUNING)
+    EndAutotune(AUTOTUNE_FAILED);
+
   drive_state = DRIVE_STATE_STOPPED;
   target_speed = 0.0f;
   Motor_Stop();
@@ -185,6 +420,7 @@ void DifferentialDrive_Stop(void) {
   PID_Reset(&speed_pid_left);
   PID_Reset(&speed_pid_right);
   PID_Reset(&heading_pid);
+  MotionProfile_Reset(&speed_profile, 0.0f);
 }
 
 /**
@@ -192,10 +428,59 @@ void DifferentialDrive_Stop(void) {
  */
 DriveState_t DifferentialDrive_GetState(void) { return drive_state; }
 
+/**
+ * @brief  Start relay autotuning
+ */
+int8_t DifferentialDrive_StartAutotune(Autotune_Rule_t rule) {
+  if (drive_state != DRIVE_STATE_STOPPED)
+    return -1;
+
+  /* The relays oscillate around the feedforward operating point */
+  if (speed_pid_left.Kv == 0.0f || speed_pid_right.Kv == 0.0f)
+    return -1;
+
+  for (uint8_t i = 0; i < PID_COUNT; i++) {
+    autotune_saved[i][0] = pids[i]->Kp;
+    autotune_saved[i][1] = pids[i]->Ki;
+    autotune_saved[i][2] = pids[i]->Kd;
+  }
+
+  Autotune_Init(&autotune[PID_SPEED_LEFT], DRIVE_AUTOTUNE_SPEED_RELAY,
+                DRIVE_AUTOTUNE_SPEED_HYST, DRIVE_AUTOTUNE_CYCLES,
+                DRIVE_AUTOTUNE_TIMEOUT);
+  Autotune_Init(&autotune[PID_SPEED_RIGHT], DRIVE_AUTOTUNE_SPEED_RELAY,
+                DRIVE_AUTOTUNE_SPEED_HYST, DRIVE_AUTOTUNE_CYCLES,
+                DRIVE_AUTOTUNE_TIMEOUT);
+  Autotune_Init(&autotune[PID_HEADING], DRIVE_AUTOTUNE_HEADING_RELAY,
+                DRIVE_AUTOTUNE_HEADING_HYST, DRIVE_AUTOTUNE_CYCLES,
+                DRIVE_AUTOTUNE_TIMEOUT);
+  autotune_rule = rule;
+  autotune_phase = AUTOTUNE_PHASE_SPEED;
+  autotune_result = (DriveAutotune_Result_t){.status = AUTOTUNE_RUNNING};
+
+  IMU_ResetHeading();
+  Odometry_ResetYawReference();
+  PID_Reset(&speed_pid_left);
+  PID_Reset(&speed_pid_right);
+  PID_Reset(&heading_pid);
+  MotionProfile_Reset(&speed_profile, 0.0f);
+
+  drive_state = DRIVE_STATE_AUTOTUNING;
+  return 0;
+}
+
+/**
+ * @brief  Get the last autotune result
+ */
+void DifferentialDrive_GetAutotuneResult(DriveAutotune_Result_t *result) {
+  *result = autotune_result;
+}
+
 /**
  * @brief  Set speed PID gains
  */
 void DifferentialDrive_SetSpeedPID(float Kp, float Ki, float Kd) {
+  speed_scheduled = 0;
   PID_SetGains(&speed_pid_left, Kp, Ki, Kd);
   PID_SetGains(&speed_pid_right, Kp, Ki, Kd);
 }
@@ -207,6 +492,93 @@ void DifferentialDrive_SetHeadingPID(float Kp, float Ki, float Kd) {
   PID_SetGains(&heading_pid, Kp, Ki, Kd);
 }
 
+/**
+ * @brief  Get speed PID gains
+ */
+void DifferentialDrive_GetSpeedPID(float gains[3]) {
+  gains[0] = speed_pid_left.Kp;
+  gains[1] = speed_pid_left.Ki;
+  gains[2] = speed_pid_left.Kd;
+}
+
+/**
+ * @brief  Get heading PID gains
+ */
+void DifferentialDrive_GetHeadingPID(float gains[3]) {
+  gains[0] = heading_pid.Kp;
+  gains[1] = heading_pid.Ki;
+  gains[2] = heading_pid.Kd;
+}
+
+/**
+ * @brief  Set integral limits
+ */
+void DifferentialDrive_SetIntegralLimits(float speed, float heading) {
+  PID_SetIntegralLimit(&speed_pid_left, speed);
+  PID_SetIntegralLimit(&speed_pid_right, speed);
+  PID_SetIntegralLimit(&heading_pid, heading);
+}
+
+/**
+ * @brief  Get integral limits
+ */
+void DifferentialDrive_GetIntegralLimits(float limits[2]) {
+  limits[0] = speed_pid_left.integral_limit;
+  limits[1] = heading_pid.integral_limit;
+}
+
+/**
+ * @brief  Set speed profile limits
+ */
+void DifferentialDrive_SetProfile(float max_accel, float max_jerk) {
+  if (max_accel <= 0.0f)
+    return;
+  MotionProfile_SetLimits(&speed_profile, max_accel, max_jerk);
+}
+
+/**
+ * @brief  Set feedforward gains
+ */
+void DifferentialDrive_SetFeedforward(float Kv, float Ks, float Ka) {
+  PID_SetFeedforward(&speed_pid_left, Kv, Ks, Ka);
+  PID_SetFeedforward(&speed_pid_right, Kv, Ks, Ka);
+}
+
+/**
+ * @brief  Schedule the speed PID gains
+ */
+int8_t DifferentialDrive_SetSpeedSchedule(const PID_GainPoint_t *points,
+                                          uint8_t count) {
+  if (count == 0) {
+    speed_scheduled = 0;
+    return 0;
+  }
+
+  /* Build aside, then switch between control ticks */
+  PID_Schedule_t schedule;
+  if (PID_Schedule_Init(&schedule, points, count) != 0)
+    return -1;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  speed_schedule = schedule;
+  speed_scheduled = 1;
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+ * @brief  Get the target speed
+ */
+float DifferentialDrive_GetTargetSpeed(void) { return target_speed; }
+
+/**
+ * @brief  Get the profiled speed
+ */
+float DifferentialDrive_GetProfiledSpeed(void) {
+  return speed_profile.velocity;
+}
+
 /**
  * @brief  Get current average speed
  */
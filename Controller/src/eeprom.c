@@ -0,0 +1,325 @@
+/**
+ ******************************************************************************
+ * @file    eeprom.c
+ * @brief   EEPROM emulation in two flash pages
+ ******************************************************************************
+ *
+ * Same page protocol as the Cube EEPROM emulation (eeprom.c in
+ * Projects/STM32F103RB-Nucleo/Applications/EEPROM), with register-level
+ * flash access instead of HAL_FLASH_*, a fixed range of virtual addresses
+ * instead of the VirtAddVarTab table, and the flash unlocked only while a
+ * function of this module programs it.
+ *
+ * Recovery differs in two places: a transfer copies only the variables the
+ * receiving page does not have yet, so resuming one never rereads a page
+ * whose erase had started; and a page status other than ERASED,
+ * RECEIVE_DATA or VALID_PAGE is taken as an erase cut short, not as a
+ * reason to format both pages.
+ *
+ ******************************************************************************
+ */
+
+#include "eeprom.h"
+#include "main.h"
+
+/* ================ Private Defines ================ */
+
+/* Page to write in, page to read from */
+#define WRITE_IN_VALID_PAGE 0U
+#define READ_FROM_VALID_PAGE 1U
+
+#define NO_PAGE 0xFFFFFFFFUL
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Read a halfword from flash
+ */
+static uint16_t FlashRead(uint32_t address) {
+  return *(volatile uint16_t *)(uintptr_t)address;
+}
+
+/**
+ * @brief  Unlock the flash program/erase controller
+ */
+static void FlashUnlock(void) {
+  if (READ_BIT(FLASH->CR, FLASH_CR_LOCK)) {
+    WRITE_REG(FLASH->KEYR, FLASH_KEY1);
+    WRITE_REG(FLASH->KEYR, FLASH_KEY2);
+  }
+}
+
+/**
+ * @brief  Lock the flash program/erase controller
+ */
+static void FlashLock(void) { SET_BIT(FLASH->CR, FLASH_CR_LOCK); }
+
+/**
+ * @brief  Wait for the operation in progress and clear its flags
+ * @retval EE_OK or EE_FLASH_ERROR
+ */
+static uint16_t FlashWait(void) {
+  while (READ_BIT(FLASH->SR, FLASH_SR_BSY))
+    ;
+
+  uint32_t sr = READ_REG(FLASH->SR);
+  WRITE_REG(FLASH->SR, FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR);
+  return (sr & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) ? EE_FLASH_ERROR : EE_OK;
+}
+
+/**
+ * @brief  Program one halfword and read it back
+ * @retval EE_OK or EE_FLASH_ERROR
+ */
+static uint16_t FlashProgram(uint32_t address, uint16_t data) {
+  SET_BIT(FLASH->CR, FLASH_CR_PG);
+  *(volatile uint16_t *)(uintptr_t)address = data;
+  uint16_t status = FlashWait();
+  CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+
+  if (status == EE_OK && FlashRead(address) != data)
+    status = EE_FLASH_ERROR;
+  return status;
+}
+
+/**
+ * @brief  Check a page is erased (every record word reads 0xFFFFFFFF)
+ */
+static uint8_t PageErased(uint32_t page) {
+  for (uint32_t address = page; address < page + EE_PAGE_SIZE; address += 4) {
+    if (*(volatile uint32_t *)(uintptr_t)address != 0xFFFFFFFFUL)
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief  Erase a page unless it is already erased
+ * @retval EE_OK or EE_FLASH_ERROR
+ */
+static uint16_t FlashErase(uint32_t page) {
+  if (PageErased(page))
+    return EE_OK;
+
+  SET_BIT(FLASH->CR, FLASH_CR_PER);
+  WRITE_REG(FLASH->AR, page);
+  SET_BIT(FLASH->CR, FLASH_CR_STRT);
+  uint16_t status = FlashWait();
+  CLEAR_BIT(FLASH->CR, FLASH_CR_PER);
+
+  if (status == EE_OK && !PageErased(page))
+    status = EE_FLASH_ERROR;
+  return status;
+}
+
+/**
+ * @brief  Erase both pages and make page 0 the valid one
+ */
+static uint16_t Format(void) {
+  uint16_t status = FlashErase(EE_PAGE0_ADDRESS);
+  if (status == EE_OK)
+    status = FlashProgram(EE_PAGE0_ADDRESS, EE_VALID_PAGE);
+  if (status == EE_OK)
+    status = FlashErase(EE_PAGE1_ADDRESS);
+  return status;
+}
+
+/**
+ * @brief  Find the page to read from or write in
+ * @retval Page address, NO_PAGE if neither page is valid
+ */
+static uint32_t FindValidPage(uint8_t operation) {
+  uint16_t status0 = FlashRead(EE_PAGE0_ADDRESS);
+  uint16_t status1 = FlashRead(EE_PAGE1_ADDRESS);
+
+  if (operation == WRITE_IN_VALID_PAGE) {
+    /* During a transfer, writes go to the receiving page */
+    if (status1 == EE_VALID_PAGE)
+      return (status0 == EE_RECEIVE_DATA) ? EE_PAGE0_ADDRESS
+                                          : EE_PAGE1_ADDRESS;
+    if (status0 == EE_VALID_PAGE)
+      return (status1 == EE_RECEIVE_DATA) ? EE_PAGE1_ADDRESS
+                                          : EE_PAGE0_ADDRESS;
+    return NO_PAGE;
+  }
+
+  if (status0 == EE_VALID_PAGE)
+    return EE_PAGE0_ADDRESS;
+  if (status1 == EE_VALID_PAGE)
+    return EE_PAGE1_ADDRESS;
+  return NO_PAGE;
+}
+
+/**
+ * @brief  Append a record to the page being written
+ * @retval EE_OK, EE_PAGE_FULL, EE_NO_VALID_PAGE or EE_FLASH_ERROR
+ */
+static uint16_t AppendRecord(uint16_t virt_address, uint16_t data) {
+  uint32_t page = FindValidPage(WRITE_IN_VALID_PAGE);
+  if (page == NO_PAGE)
+    return EE_NO_VALID_PAGE;
+
+  /* First free record; one half written by a reset is skipped */
+  for (uint32_t address = page + 4; address < page + EE_PAGE_SIZE;
+       address += 4) {
+    if (*(volatile uint32_t *)(uintptr_t)address != 0xFFFFFFFFUL)
+      continue;
+
+    /* Data first: the record counts once its address is written */
+    uint16_t status = FlashProgram(address, data);
+    if (status == EE_OK)
+      status = FlashProgram(address + 2, virt_address);
+    return status;
+  }
+  return EE_PAGE_FULL;
+}
+
+/**
+ * @brief  Last record for a variable in a page
+ * @retval EE_OK or EE_NOT_FOUND
+ */
+static uint16_t FindRecord(uint32_t page, uint16_t virt_address,
+                           uint16_t *data) {
+  for (uint32_t address = page + EE_PAGE_SIZE - 2; address > page + 2;
+       address -= 4) {
+    if (FlashRead(address) == virt_address) {
+      *data = FlashRead(address - 2);
+      return EE_OK;
+    }
+  }
+  return EE_NOT_FOUND;
+}
+
+/**
+ * @brief  Copy the last value of every variable from the valid page to the
+ *         receiving one, except variables the receiving page already has
+ *         (newer, or copied before a reset)
+ */
+static uint16_t CopyVariables(uint32_t from, uint32_t to) {
+  for (uint16_t virt_address = 1; virt_address <= EE_VAR_COUNT;
+       virt_address++) {
+    uint16_t data;
+    if (FindRecord(to, virt_address, &data) == EE_OK ||
+        FindRecord(from, virt_address, &data) != EE_OK)
+      continue;
+
+    uint16_t status = AppendRecord(virt_address, data);
+    if (status != EE_OK)
+      return status;
+  }
+  return EE_OK;
+}
+
+/**
+ * @brief  Copy the variables over, erase the old page, validate the new one
+ * @param  from: Valid page
+ * @param  to: Receiving page
+ */
+static uint16_t ResumeTransfer(uint32_t from, uint32_t to) {
+  uint16_t status = CopyVariables(from, to);
+  if (status == EE_OK)
+    status = FlashErase(from);
+  if (status == EE_OK)
+    status = FlashProgram(to, EE_VALID_PAGE);
+  return status;
+}
+
+/**
+ * @brief  Complete a transfer whose copy finished: the old page was being
+ *         erased (its status may read anything)
+ */
+static uint16_t CompleteTransfer(uint32_t from, uint32_t to) {
+  uint16_t status = FlashErase(from);
+  if (status == EE_OK)
+    status = FlashProgram(to, EE_VALID_PAGE);
+  return status;
+}
+
+/**
+ * @brief  Move to the other page: the new value first, then the last value
+ *         of every other variable
+ */
+static uint16_t PageTransfer(uint16_t virt_address, uint16_t data) {
+  uint32_t from = FindValidPage(READ_FROM_VALID_PAGE);
+  if (from == NO_PAGE)
+    return EE_NO_VALID_PAGE;
+  uint32_t to =
+      (from == EE_PAGE0_ADDRESS) ? EE_PAGE1_ADDRESS : EE_PAGE0_ADDRESS;
+
+  uint16_t status = FlashProgram(to, EE_RECEIVE_DATA);
+  if (status == EE_OK)
+    status = AppendRecord(virt_address, data);
+
+  /* Erase the old page before validating the new one: a reset in between
+   * leaves RECEIVE_DATA with a (partly) erased page, which EE_Init()
+   * completes */
+  if (status == EE_OK)
+    status = ResumeTransfer(from, to);
+  return status;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Restore the pages to a valid state
+ */
+uint16_t EE_Init(void) {
+  uint16_t status0 = FlashRead(EE_PAGE0_ADDRESS);
+  uint16_t status1 = FlashRead(EE_PAGE1_ADDRESS);
+  uint16_t status;
+
+  FlashUnlock();
+
+  /* An erase cut short sets an arbitrary subset of the bits: a status
+   * other than the three below is a page that was being erased */
+  if (status0 == EE_VALID_PAGE && status1 == EE_RECEIVE_DATA) {
+    status = ResumeTransfer(EE_PAGE0_ADDRESS, EE_PAGE1_ADDRESS);
+  } else if (status1 == EE_VALID_PAGE && status0 == EE_RECEIVE_DATA) {
+    status = ResumeTransfer(EE_PAGE1_ADDRESS, EE_PAGE0_ADDRESS);
+  } else if (status0 == EE_VALID_PAGE && status1 != EE_VALID_PAGE) {
+    /* Normal state; page 1 may hold a partial erase */
+    status = FlashErase(EE_PAGE1_ADDRESS);
+  } else if (status1 == EE_VALID_PAGE && status0 != EE_VALID_PAGE) {
+    status = FlashErase(EE_PAGE0_ADDRESS);
+  } else if (status0 == EE_RECEIVE_DATA && status1 != EE_RECEIVE_DATA) {
+    status = CompleteTransfer(EE_PAGE1_ADDRESS, EE_PAGE0_ADDRESS);
+  } else if (status1 == EE_RECEIVE_DATA && status0 != EE_RECEIVE_DATA) {
+    status = CompleteTransfer(EE_PAGE0_ADDRESS, EE_PAGE1_ADDRESS);
+  } else {
+    /* First use (both erased) or an invalid state */
+    status = Format();
+  }
+
+  FlashLock();
+  return status;
+}
+
+/**
+ * @brief  Read the last value written to a variable
+ */
+uint16_t EE_ReadVariable(uint16_t virt_address, uint16_t *data) {
+  if (virt_address == 0 || virt_address > EE_VAR_COUNT)
+    return EE_BAD_ADDRESS;
+
+  uint32_t page = FindValidPage(READ_FROM_VALID_PAGE);
+  if (page == NO_PAGE)
+    return EE_NO_VALID_PAGE;
+
+  return FindRecord(page, virt_address, data);
+}
+
+/**
+ * @brief  Write a variable
+ */
+uint16_t EE_WriteVariable(uint16_t virt_address, uint16_t data) {
+  if (virt_address == 0 || virt_address > EE_VAR_COUNT)
+    return EE_BAD_ADDRESS;
+
+  FlashUnlock();
+  uint16_t status = AppendRecord(virt_address, data);
+  if (status == EE_PAGE_FULL)
+    status = PageTransfer(virt_address, data);
+  FlashLock();
+
+  return status;
+}
@@ -4,21 +4,51 @@
  * @brief   Dual Quadrature Encoder Implementation
  ******************************************************************************
  *
- * Hardware Setup:
+ * Hardware Setup (timer mode):
+ *   - Left Encoder A  -> PA0 (TIM2_CH1)
+ *   - Left Encoder B  -> PA1 (TIM2_CH2)
+ *   - Right Encoder A -> PA8 (TIM1_CH1)
+ *   - Right Encoder B -> PA9 (TIM1_CH2)
+ *
+ * Hardware Setup (EXTI mode):
  *   - Left Encoder A  -> PA1 (EXTI1)
  *   - Left Encoder B  -> PA2 (EXTI2)
  *   - Right Encoder A -> PB8 (EXTI8)
  *   - Right Encoder B -> PB9 (EXTI9)
  *
+ * Timer mode count = (overflows << 16) | CNT. The update interrupt adjusts
+ * the overflow count by the wrap direction, taken from CNT (just past 0 after
+ * counting up, just below 0xFFFF after counting down).
+ *
  ******************************************************************************
  */
 
 #include "encoder.h"
 #include "main.h"
+#include "speed_estimator.h"
+
+/* ================ Private Defines ================ */
+
+/* Encoder mode 3: count on both TI1 and TI2 edges (x4) */
+#define TIM_SMCR_SMS_ENCODER3 (TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1)
+
+/* Input filter: fSAMPLING = fCK_INT, N = 8 (rejects glitches < 111ns) */
+#define TIM_CCMR1_ENCODER_FILTER                                               \
+  (TIM_CCMR1_IC1F_0 | TIM_CCMR1_IC1F_1 | TIM_CCMR1_IC2F_0 | TIM_CCMR1_IC2F_1)
+
+/* Timer mode captures rising A and B edges: at most 3 counts apart */
+#define TIMER_COUNTS_PER_CAPTURE 3
 
 /* ================ Private Variables ================ */
 
-/* Encoder counters */
+static Encoder_Mode_t encoder_mode = ENCODER_MODE;
+static volatile uint32_t irq_count = 0;
+
+/* Timer mode: signed overflow counts (upper 16 bits of the count) */
+static volatile int32_t left_overflows = 0;
+static volatile int32_t right_overflows = 0;
+
+/* EXTI mode: encoder counters */
 static volatile int32_t left_count = 0;
 static volatile int32_t right_count = 0;
 
@@ -28,10 +58,20 @@ static volatile uint8_t left_last_B = 0;
 static volatile uint8_t right_last_A = 0;
 static volatile uint8_t right_last_B = 0;
 
-/* Previous counts for speed calculation */
+/* Previous counts for Encoder_GetDelta */
 static int32_t left_prev_count = 0;
 static int32_t right_prev_count = 0;
 
+/* Most recent timestamped edge (count at the edge, DWT->CYCCNT) */
+static volatile int32_t left_edge_count = 0;
+static volatile uint32_t left_edge_time = 0;
+static volatile int32_t right_edge_count = 0;
+static volatile uint32_t right_edge_time = 0;
+
+/* Speed estimators */
+static SpeedEstimator_t left_speed;
+static SpeedEstimator_t right_speed;
+
 /* ================ Private Functions ================ */
 
 /**
@@ -47,6 +87,9 @@ static void ProcessLeftEncoder(void) {
     else
       left_count--;
 
+    left_edge_count = left_count;
+    left_edge_time = DWT->CYCCNT;
+
     left_last_A = A;
     left_last_B = B;
   }
@@ -65,17 +108,177 @@ static void ProcessRightEncoder(void) {
     else
       right_count--;
 
+    right_edge_count = right_count;
+    right_edge_time = DWT->CYCCNT;
+
     right_last_A = A;
     right_last_B = B;
   }
 }
 
-/* ================ Public Functions ================ */
+/**
+ * @brief  Count a 16-bit counter wrap (update interrupt)
+ */
+static void CountOverflow(TIM_TypeDef *tim, volatile int32_t *overflows) {
+  if (READ_BIT(tim->SR, TIM_SR_UIF)) {
+    WRITE_REG(tim->SR, ~TIM_SR_UIF); /* rc_w0 */
+    if (READ_REG(tim->CNT) < 0x8000U)
+      (*overflows)++;
+    else
+      (*overflows)--;
+  }
+}
+
+/**
+ * @brief  Read a timer count extended to 32 bits
+ */
+static int32_t ReadExtended(TIM_TypeDef *tim, volatile int32_t *overflows) {
+  int32_t high;
+  uint32_t cnt;
+
+  do {
+    high = *overflows;
+    cnt = READ_REG(tim->CNT);
+  } while (high != *overflows);
+
+  /* Wrapped, but the update interrupt has not run yet */
+  if (READ_BIT(tim->SR, TIM_SR_UIF)) {
+    cnt = READ_REG(tim->CNT);
+    high += (cnt < 0x8000U) ? 1 : -1;
+  }
+
+  return (int32_t)(((uint32_t)high << 16) | (cnt & 0xFFFFU));
+}
+
+/**
+ * @brief  Timestamp a captured A or B edge (CC1/CC2 interrupt)
+ */
+static void CaptureEdge(TIM_TypeDef *tim, volatile int32_t *overflows,
+                        volatile int32_t *edge_count,
+                        volatile uint32_t *edge_time) {
+  if (READ_BIT(tim->SR, TIM_SR_CC1IF | TIM_SR_CC2IF)) {
+    WRITE_REG(tim->SR, ~(TIM_SR_CC1IF | TIM_SR_CC2IF)); /* rc_w0 */
+    *edge_time = DWT->CYCCNT;
+    *edge_count = ReadExtended(tim, overflows);
+  }
+}
+
+/**
+ * @brief  Keep edge capture on only while the estimator needs timestamps
+ */
+static void GateCapture(TIM_TypeDef *tim, float speed, float dt) {
+  float counts = (speed < 0.0f ? -speed : speed) * dt;
+
+  if (counts >= 2.0f * ENCODER_SPEED_BLEND_COUNTS)
+    CLEAR_BIT(tim->DIER, TIM_DIER_CC1IE | TIM_DIER_CC2IE);
+  else if (counts < ENCODER_SPEED_BLEND_COUNTS)
+    SET_BIT(tim->DIER, TIM_DIER_CC1IE | TIM_DIER_CC2IE);
+}
+
+/**
+ * @brief  Zero a timer count and its overflow count
+ */
+static void ResetExtended(TIM_TypeDef *tim, volatile int32_t *overflows) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  WRITE_REG(tim->CNT, 0);
+  WRITE_REG(tim->SR, ~TIM_SR_UIF);
+  *overflows = 0;
+  __set_PRIMASK(primask);
+}
 
 /**
- * @brief  Initialize both encoders using EXTI
+ * @brief  Configure a timer in encoder mode 3 with overflow interrupt
  */
-void Encoder_Init(void) {
+static void ConfigureEncoderTimer(TIM_TypeDef *tim) {
+  /* Disable timer during configuration */
+  CLEAR_BIT(tim->CR1, TIM_CR1_CEN);
+
+  /* Encoder mode 3 (counts on both TI1 and TI2 edges) */
+  MODIFY_REG(tim->SMCR, TIM_SMCR_SMS, TIM_SMCR_SMS_ENCODER3);
+
+  /* CC1S = 01: IC1 on TI1, CC2S = 01: IC2 on TI2, filtered */
+  WRITE_REG(tim->CCMR1,
+            TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC2S_0 | TIM_CCMR1_ENCODER_FILTER);
+
+  /* Non-inverted polarity, channels enabled */
+  MODIFY_REG(tim->CCER, 0x00FF, TIM_CCER_CC1E | TIM_CCER_CC2E);
+
+  /* Full 16-bit range, no prescaler */
+  WRITE_REG(tim->ARR, 0xFFFF);
+  WRITE_REG(tim->PSC, 0);
+  WRITE_REG(tim->CNT, 0);
+
+  /* Reload prescaler, then drop the UIF that UG raised */
+  SET_BIT(tim->EGR, TIM_EGR_UG);
+  WRITE_REG(tim->SR, 0);
+
+  /* Interrupt on counter wrap and (at low speed) rising A/B edge capture */
+  WRITE_REG(tim->DIER, TIM_DIER_UIE | TIM_DIER_CC1IE | TIM_DIER_CC2IE);
+  SET_BIT(tim->CR1, TIM_CR1_CEN);
+}
+
+/**
+ * @brief  Stop an encoder timer and its interrupt
+ */
+static void DisableEncoderTimer(TIM_TypeDef *tim) {
+  CLEAR_BIT(tim->CR1, TIM_CR1_CEN);
+  WRITE_REG(tim->DIER, 0);
+  WRITE_REG(tim->SMCR, 0);
+}
+
+/**
+ * @brief  Timer mode: TIM2 (left) and TIM1 (right) encoder interface
+ */
+static void InitTimerMode(void) {
+  /* Enable clocks */
+  SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPAEN); /* GPIOA */
+  SET_BIT(RCC->APB2ENR, RCC_APB2ENR_AFIOEN); /* AFIO */
+  SET_BIT(RCC->APB1ENR, RCC_APB1ENR_TIM2EN); /* TIM2 */
+  SET_BIT(RCC->APB2ENR, RCC_APB2ENR_TIM1EN); /* TIM1 */
+
+  /* Release the EXTI lines used by EXTI mode */
+  CLEAR_BIT(EXTI->IMR, EXTI_IMR_MR1 | EXTI_IMR_MR2 | EXTI_IMR_MR8 | EXTI_IMR_MR9);
+  NVIC_DisableIRQ(EXTI1_IRQn);
+  NVIC_DisableIRQ(EXTI2_IRQn);
+  NVIC_DisableIRQ(EXTI9_5_IRQn);
+
+  /* Configure PA0, PA1 as Input with Pull-up (TIM2_CH1, TIM2_CH2) */
+  /* PA0: bits 0-3, PA1: bits 4-7 in CRL */
+  /* MODE=00 (Input), CNF=10 (Input with pull-up/down) = 0x8 */
+  MODIFY_REG(GPIOA->CRL, 0x000000FF, (0x8 << 0) | (0x8 << 4));
+  SET_BIT(GPIOA->ODR, (1 << 0) | (1 << 1)); /* Enable pull-ups */
+
+  /* Configure PA8, PA9 as Input with Pull-up (TIM1_CH1, TIM1_CH2) */
+  /* PA8: bits 0-3, PA9: bits 4-7 in CRH */
+  MODIFY_REG(GPIOA->CRH, 0x000000FF, (0x8 << 0) | (0x8 << 4));
+  SET_BIT(GPIOA->ODR, (1 << 8) | (1 << 9)); /* Enable pull-ups */
+
+  /* No remap: TIM2_CH1/CH2 on PA0/PA1, TIM1_CH1/CH2 on PA8/PA9 */
+  CLEAR_BIT(AFIO->MAPR, AFIO_MAPR_TIM2_REMAP | AFIO_MAPR_TIM1_REMAP);
+
+  ConfigureEncoderTimer(TIM2);
+  ConfigureEncoderTimer(TIM1);
+
+  NVIC_SetPriority(TIM2_IRQn, ENCODER_IRQ_PRIORITY);
+  NVIC_SetPriority(TIM1_UP_IRQn, ENCODER_IRQ_PRIORITY);
+  NVIC_SetPriority(TIM1_CC_IRQn, ENCODER_IRQ_PRIORITY);
+  NVIC_EnableIRQ(TIM2_IRQn);
+  NVIC_EnableIRQ(TIM1_UP_IRQn);
+  NVIC_EnableIRQ(TIM1_CC_IRQn);
+}
+
+/**
+ * @brief  EXTI mode: interrupt on every A/B edge
+ */
+static void InitExtiMode(void) {
+  /* Stop the timer backend if it was running */
+  NVIC_DisableIRQ(TIM2_IRQn);
+  NVIC_DisableIRQ(TIM1_UP_IRQn);
+  NVIC_DisableIRQ(TIM1_CC_IRQn);
+  DisableEncoderTimer(TIM2);
+  DisableEncoderTimer(TIM1);
+
   /* Enable clocks */
   SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPAEN); /* GPIOA */
   SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPBEN); /* GPIOB */
@@ -121,23 +324,112 @@ void Encoder_Init(void) {
   left_last_B = (GPIOA->IDR >> 2) & 1;
   right_last_A = (GPIOB->IDR >> 8) & 1;
   right_last_B = (GPIOB->IDR >> 9) & 1;
+}
+
+/**
+ * @brief  Consistent copy of an edge timestamp
+ */
+static void ReadEdge(volatile int32_t *edge_count, volatile uint32_t *edge_time,
+                     int32_t *count, uint32_t *time) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *count = *edge_count;
+  *time = *edge_time;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Restart a wheel's speed estimate from rest at count 0
+ */
+static void ResetSpeed(SpeedEstimator_t *est, volatile int32_t *edge_count,
+                       volatile uint32_t *edge_time) {
+  uint32_t now = DWT->CYCCNT;
+
+  *edge_count = 0;
+  *edge_time = now;
+  SpeedEstimator_Reset(est, 0, now);
+}
+
+/**
+ * @brief  Get left encoder count for the active backend
+ */
+static int32_t ReadLeft(void) {
+  if (encoder_mode == ENCODER_MODE_TIMER)
+    return ReadExtended(TIM2, &left_overflows);
+  return left_count;
+}
+
+/**
+ * @brief  Get right encoder count for the active backend
+ */
+static int32_t ReadRight(void) {
+  if (encoder_mode == ENCODER_MODE_TIMER)
+    return ReadExtended(TIM1, &right_overflows);
+  return right_count;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Initialize both encoders using the default backend
+ */
+void Encoder_Init(void) { Encoder_InitMode(ENCODER_MODE); }
+
+/**
+ * @brief  Initialize both encoders using the given backend
+ */
+void Encoder_InitMode(Encoder_Mode_t mode) {
+  encoder_mode = mode;
+  irq_count = 0;
+
+  /* Enable DWT cycle counter for edge timestamps */
+  SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+  SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+  uint32_t edge_counts =
+      (mode == ENCODER_MODE_TIMER) ? TIMER_COUNTS_PER_CAPTURE : 1;
+  SpeedEstimator_Init(&left_speed, SYSTEM_CLOCK_HZ, edge_counts,
+                      ENCODER_SPEED_BLEND_COUNTS,
+                      ENCODER_STOP_TIMEOUT_MS / 1000.0f);
+  SpeedEstimator_Init(&right_speed, SYSTEM_CLOCK_HZ, edge_counts,
+                      ENCODER_SPEED_BLEND_COUNTS,
+                      ENCODER_STOP_TIMEOUT_MS / 1000.0f);
+  ResetSpeed(&left_speed, &left_edge_count, &left_edge_time);
+  ResetSpeed(&right_speed, &right_edge_count, &right_edge_time);
 
   /* Reset counters */
   left_count = 0;
   right_count = 0;
+  left_overflows = 0;
+  right_overflows = 0;
   left_prev_count = 0;
   right_prev_count = 0;
+
+  if (mode == ENCODER_MODE_TIMER)
+    InitTimerMode();
+  else
+    InitExtiMode();
 }
 
+/**
+ * @brief  Get the active backend
+ */
+Encoder_Mode_t Encoder_GetMode(void) { return encoder_mode; }
+
+/**
+ * @brief  Get the number of encoder interrupts serviced since init
+ */
+uint32_t Encoder_GetIrqCount(void) { return irq_count; }
+
 /**
  * @brief  Get left encoder count
  */
-int32_t Encoder_GetCountLeft(void) { return left_count; }
+int32_t Encoder_GetCountLeft(void) { return ReadLeft(); }
 
 /**
  * @brief  Get right encoder count
  */
-int32_t Encoder_GetCountRight(void) { return right_count; }
+int32_t Encoder_GetCountRight(void) { return ReadRight(); }
 
 /**
  * @brief  Get left wheel speed
@@ -146,11 +438,16 @@ float Encoder_GetSpeedLeft(float dt) {
   if (dt <= 0.0f)
     return 0.0f;
 
-  int32_t current = left_count;
-  int32_t delta = current - left_prev_count;
-  left_prev_count = current;
+  int32_t edge_count;
+  uint32_t edge_time;
+  ReadEdge(&left_edge_count, &left_edge_time, &edge_count, &edge_time);
+
+  float speed = SpeedEstimator_Update(&left_speed, ReadLeft(), edge_count,
+                                      edge_time, DWT->CYCCNT);
+  if (encoder_mode == ENCODER_MODE_TIMER)
+    GateCapture(TIM2, speed, dt);
 
-  return (float)delta / dt;
+  return speed;
 }
 
 /**
@@ -160,45 +457,64 @@ float Encoder_GetSpeedRight(float dt) {
   if (dt <= 0.0f)
     return 0.0f;
 
-  int32_t current = right_count;
-  int32_t delta = current - right_prev_count;
-  right_prev_count = current;
+  int32_t edge_count;
+  uint32_t edge_time;
+  ReadEdge(&right_edge_count, &right_edge_time, &edge_count, &edge_time);
 
-  return (float)delta / dt;
+  float speed = SpeedEstimator_Update(&right_speed, ReadRight(), edge_count,
+                                      edge_time, DWT->CYCCNT);
+  if (encoder_mode == ENCODER_MODE_TIMER)
+    GateCapture(TIM1, speed, dt);
+
+  return speed;
 }
 
+/**
+ * @brief  Confidence of the last left speed estimate
+ */
+float Encoder_GetConfidenceLeft(void) { return left_speed.confidence; }
+
+/**
+ * @brief  Confidence of the last right speed estimate
+ */
+float Encoder_GetConfidenceRight(void) { return right_speed.confidence; }
+
 /**
  * @brief  Reset both encoder counts
  */
 void Encoder_Reset(void) {
-  left_count = 0;
-  right_count = 0;
-  left_prev_count = 0;
-  right_prev_count = 0;
+  Encoder_ResetLeft();
+  Encoder_ResetRight();
 }
 
 /**
  * @brief  Reset left encoder
  */
 void Encoder_ResetLeft(void) {
+  if (encoder_mode == ENCODER_MODE_TIMER)
+    ResetExtended(TIM2, &left_overflows);
   left_count = 0;
   left_prev_count = 0;
+  ResetSpeed(&left_speed, &left_edge_count, &left_edge_time);
 }
 
 /**
  * @brief  Reset right encoder
  */
 void Encoder_ResetRight(void) {
+  if (encoder_mode == ENCODER_MODE_TIMER)
+    ResetExtended(TIM1, &right_overflows);
   right_count = 0;
   right_prev_count = 0;
+  ResetSpeed(&right_speed, &right_edge_count, &right_edge_time);
 }
 
 /**
  * @brief  Get delta counts
  */
 void Encoder_GetDelta(int32_t *left_delta, int32_t *right_delta) {
-  int32_t left_current = left_count;
-  int32_t right_current = right_count;
+  int32_t left_current = ReadLeft();
+  int32_t right_current = ReadRight();
 
   *left_delta = left_current - left_prev_count;
   *right_delta = right_current - right_prev_count;
@@ -212,14 +528,48 @@ void Encoder_GetDelta(int32_t *left_delta, int32_t *right_delta) {
 /**
  * @brief  EXTI1 handler (Left Encoder A - PA1)
  */
-void Encoder_EXTI1_Handler(void) { ProcessLeftEncoder(); }
+void Encoder_EXTI1_Handler(void) {
+  irq_count++;
+  ProcessLeftEncoder();
+}
 
 /**
  * @brief  EXTI2 handler (Left Encoder B - PA2)
  */
-void Encoder_EXTI2_Handler(void) { ProcessLeftEncoder(); }
+void Encoder_EXTI2_Handler(void) {
+  irq_count++;
+  ProcessLeftEncoder();
+}
 
 /**
  * @brief  EXTI9_5 handler (Right Encoder A/B - PB8/PB9)
  */
-void Encoder_EXTI9_5_Handler(void) { ProcessRightEncoder(); }
+void Encoder_EXTI9_5_Handler(void) {
+  irq_count++;
+  ProcessRightEncoder();
+}
+
+/**
+ * @brief  TIM2 handler (Left counter overflow / A, B edge capture)
+ */
+void Encoder_TIM2_Handler(void) {
+  irq_count++;
+  CountOverflow(TIM2, &left_overflows);
+  CaptureEdge(TIM2, &left_overflows, &left_edge_count, &left_edge_time);
+}
+
+/**
+ * @brief  TIM1 update handler (Right counter overflow)
+ */
+void Encoder_TIM1_UP_Handler(void) {
+  irq_count++;
+  CountOverflow(TIM1, &right_overflows);
+}
+
+/**
+ * @brief  TIM1 capture/compare handler (Right A, B edge capture)
+ */
+void Encoder_TIM1_CC_Handler(void) {
+  irq_count++;
+  CaptureEdge(TIM1, &right_overflows, &right_edge_count, &right_edge_time);
+}
@@ -7,63 +7,208 @@
  * I2C1 Configuration:
  *   - SCL: PB6
  *   - SDA: PB7
- *   - Clock: 100kHz (standard mode)
+ *   - Clock: 400kHz (fast mode)
+ *   - RX DMA: DMA1 Channel 7
+ *
+ * Configuration and calibration use blocking transfers with timeouts.
+ * Runtime acquisition is interrupt/DMA driven (see imu.h).
+ *
+ * FIFO mode runs each tick as a chain of phases started from the DMA
+ * complete interrupt of the one before, joined by repeated STARTs: the bus
+ * is released with a STOP only when the chain ends, so no interrupt waits
+ * for a STOP to go out before the next START. A FIFO reset is requested by
+ * bumping fifo_epoch; the chain resets the FIFO in place of the count/data
+ * reads and publishes an empty batch carrying the new epoch, and
+ * IMU_Update() ignores batches from older epochs.
  *
  ******************************************************************************
  */
 
 #include "imu.h"
 #include "main.h"
+#include "trace.h"
+#include <math.h>
 
-/* ================ Private Variables ================ */
-
-static IMU_Data_t imu_data = {0};
+/* ================ Private Defines ================ */
 
 /* Gyroscope sensitivity: 131 LSB/(deg/s) for ±250 deg/s range */
 #define GYRO_SENSITIVITY 131.0f
 
+/* Accelerometer sensitivity: 16384 LSB/g for ±2g range */
+#define ACCEL_SENSITIVITY 16384.0f
+
+/* Flag polls before a blocking transfer gives up (a few ms at 72MHz) */
+#define IMU_I2C_TIMEOUT 20000U
+
+/* I2C1 status flags that signal a failed transfer */
+#define I2C_SR1_ERRORS                                                         \
+  (I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR | I2C_SR1_TIMEOUT)
+
+/* Register mode output data rate */
+#define REGISTER_RATE_HZ 100U
+
+/* FIFO sample period for heading integration */
+#define FIFO_SAMPLE_PERIOD (1.0f / (float)IMU_FIFO_RATE_HZ)
+
+/* DMA buffer: a full FIFO batch, which also holds the sensor burst */
+#define IMU_DMA_BUF_LEN (2U * IMU_FIFO_MAX_BATCH)
+#if IMU_DMA_BUF_LEN < MPU6050_STATUS_BURST_LEN
+#error "IMU_FIFO_MAX_BATCH too small for the sensor burst"
+#endif
+
+/* Asynchronous transfer states */
+typedef enum {
+  XFER_IDLE,
+  XFER_START,   /* START sent, waiting for SB */
+  XFER_ADDR_W,  /* Address+W sent, waiting for ADDR */
+  XFER_REG,     /* Register pointer sent, waiting for BTF */
+  XFER_VALUE,   /* Register value sent (write), waiting for BTF */
+  XFER_RESTART, /* Repeated START sent, waiting for SB */
+  XFER_ADDR_R,  /* Address+R sent, waiting for ADDR */
+  XFER_DMA      /* DMA receiving, waiting for transfer complete */
+} IMU_XferState_t;
+
+/* Transfers chained within one tick */
+typedef enum {
+  PHASE_SENSOR,     /* Output registers (with INT_STATUS in FIFO mode) */
+  PHASE_FIFO_RESET, /* USER_CTRL write emptying the FIFO */
+  PHASE_FIFO_COUNT, /* FIFO_COUNTH/L */
+  PHASE_FIFO_DATA   /* Gyro Z samples from FIFO_R_W */
+} IMU_Phase_t;
+
+/* Gyro Z samples read from the FIFO in one tick */
+typedef struct {
+  int16_t gyro_z[IMU_FIFO_MAX_BATCH];
+  uint32_t count;
+  uint32_t epoch;    /* fifo_epoch served by the last FIFO reset */
+  uint32_t sequence; /* Incremented on every publish */
+} IMU_Batch_t;
+
+/* Running mean and variance (Welford) */
+typedef struct {
+  uint32_t count;
+  float mean;
+  float m2; /* Sum of squared differences from the mean */
+} RunningStats_t;
+
+/* ================ Private Variables ================ */
+
+static IMU_Data_t imu_data = {0};
+static IMU_Mode_t imu_mode = IMU_MODE;
+
+/* Asynchronous acquisition */
+static volatile IMU_XferState_t xfer_state = XFER_IDLE;
+static volatile IMU_Phase_t xfer_phase = PHASE_SENSOR;
+static uint8_t xfer_reg = 0;   /* Register the transfer starts at */
+static uint8_t xfer_value = 0; /* Value for PHASE_FIFO_RESET */
+static uint32_t xfer_len = 0;  /* Burst length in bytes */
+static volatile uint8_t recover_pending = 0;
+static uint8_t dma_buf[IMU_DMA_BUF_LEN];
+
+/* Double buffer: DMA interrupt fills samples[published ^ 1], then flips */
+static IMU_Sample_t samples[2];
+static volatile uint8_t published = 0;
+static uint32_t last_sequence = 0;
+
+/* FIFO batches: same double buffering as samples */
+static IMU_Batch_t batches[2];
+static volatile uint8_t batch_published = 0;
+static uint32_t last_batch_sequence = 0;
+
+/* FIFO resets: requested by bumping fifo_epoch (thread context), served
+ * into fifo_epoch_done by the chain (interrupt context) */
+static volatile uint32_t fifo_epoch = 0;
+static volatile uint32_t fifo_epoch_done = 0;
+static uint32_t fifo_epoch_serving = 0;
+static volatile uint8_t fifo_reset_needed = 0; /* Byte alignment in doubt */
+
+/* Heading integration state (IMU_Update) */
+static uint32_t integrated_epoch = 0;
+static float prev_rate = 0.0f;
+
+/* Roll/pitch fusion, fed once per sample; reset from IMU_Update() */
+static Attitude_t attitude;
+static volatile uint8_t attitude_reset = 0;
+
+static volatile IMU_Stats_t stats;
+static IMU_Calibration_t calibration;
+
 /* ================ Private Functions ================ */
 
 /**
- * @brief  Initialize I2C1 peripheral
+ * @brief  Configure I2C1 timing and enable it (400kHz fast mode)
+ */
+static void I2C1_Configure(void) {
+  /* Reset I2C1 */
+  SET_BIT(I2C1->CR1, I2C_CR1_SWRST);
+  CLEAR_BIT(I2C1->CR1, I2C_CR1_SWRST);
+
+  /* FREQ = APB1 clock in MHz = 36 */
+  WRITE_REG(I2C1->CR2, 36);
+
+  /* Fast mode, DUTY=0: T_low = 2 * T_high, T_scl = 3 * CCR * T_PCLK1 */
+  /* For 400kHz: CCR = 36MHz / (3 * 400kHz) = 30 */
+  WRITE_REG(I2C1->CCR, I2C_CCR_FS | 30);
+
+  /* TRISE = (T_rise / T_PCLK1) + 1 = (300ns / 27.7ns) + 1 = 11 */
+  WRITE_REG(I2C1->TRISE, 11);
+
+  /* Enable I2C1 */
+  SET_BIT(I2C1->CR1, I2C_CR1_PE);
+}
+
+/**
+ * @brief  Initialize I2C1 peripheral and its RX DMA channel
  */
 static void I2C1_Init(void) {
   /* Enable clocks */
   SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPBEN); /* GPIOB */
   SET_BIT(RCC->APB2ENR, RCC_APB2ENR_AFIOEN); /* AFIO */
   SET_BIT(RCC->APB1ENR, RCC_APB1ENR_I2C1EN); /* I2C1 */
+  SET_BIT(RCC->AHBENR, RCC_AHBENR_DMA1EN);   /* DMA1 */
 
   /* Configure PB6 (SCL) and PB7 (SDA) as Alternate Function Open-Drain */
   /* PB6: bits 24-27, PB7: bits 28-31 in CRL */
   /* MODE=11 (50MHz), CNF=11 (AF Open-Drain) = 0xF */
   MODIFY_REG(GPIOB->CRL, 0xFF000000, 0xFF000000);
 
-  /* Reset I2C1 */
-  SET_BIT(I2C1->CR1, I2C_CR1_SWRST);
-  CLEAR_BIT(I2C1->CR1, I2C_CR1_SWRST);
-
-  /* Configure I2C timing for 100kHz at 36MHz APB1 */
-  /* FREQ = APB1 clock in MHz = 36 */
-  WRITE_REG(I2C1->CR2, 36);
+  I2C1_Configure();
 
-  /* CCR for standard mode: T_high = T_low = CCR * T_PCLK1 */
-  /* For 100kHz: CCR = 36MHz / (2 * 100kHz) = 180 */
-  WRITE_REG(I2C1->CCR, 180);
+  /* DMA1 Channel 7: I2C1_DR -> dma_buf, 8-bit, memory increment */
+  WRITE_REG(DMA1_Channel7->CCR, 0);
+  WRITE_REG(DMA1_Channel7->CPAR, (uint32_t)(uintptr_t)&I2C1->DR);
+  WRITE_REG(DMA1_Channel7->CMAR, (uint32_t)(uintptr_t)dma_buf);
 
-  /* TRISE = (T_rise / T_PCLK1) + 1 = (1000ns / 27.7ns) + 1 = 37 */
-  WRITE_REG(I2C1->TRISE, 37);
+  NVIC_SetPriority(I2C1_EV_IRQn, IMU_IRQ_PRIORITY);
+  NVIC_SetPriority(I2C1_ER_IRQn, IMU_IRQ_PRIORITY);
+  NVIC_SetPriority(DMA1_Channel7_IRQn, IMU_IRQ_PRIORITY);
+  NVIC_EnableIRQ(I2C1_EV_IRQn);
+  NVIC_EnableIRQ(I2C1_ER_IRQn);
+  NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+}
 
-  /* Enable I2C1 */
-  SET_BIT(I2C1->CR1, I2C_CR1_PE);
+/**
+ * @brief  Wait for an I2C1 SR1 flag
+ * @retval 0 when set, -1 on timeout or bus error
+ */
+static int8_t I2C1_WaitFlag(uint32_t flag) {
+  uint32_t timeout = IMU_I2C_TIMEOUT;
+
+  while (1) {
+    uint32_t sr1 = READ_REG(I2C1->SR1);
+    if (sr1 & flag)
+      return 0;
+    if ((sr1 & I2C_SR1_ERRORS) || --timeout == 0)
+      return -1;
+  }
 }
 
 /**
  * @brief  Generate I2C START condition
  */
-static void I2C1_Start(void) {
+static int8_t I2C1_Start(void) {
   SET_BIT(I2C1->CR1, I2C_CR1_START);
-  while (!(I2C1->SR1 & I2C_SR1_SB))
-    ;
+  return I2C1_WaitFlag(I2C_SR1_SB);
 }
 
 /**
@@ -74,110 +219,316 @@ static void I2C1_Stop(void) { SET_BIT(I2C1->CR1, I2C_CR1_STOP); }
 /**
  * @brief  Send address with R/W bit
  */
-static void I2C1_SendAddress(uint8_t addr, uint8_t read) {
-  I2C1->DR = (addr << 1) | (read ? 1 : 0);
-  while (!(I2C1->SR1 & I2C_SR1_ADDR))
-    ;
-  (void)I2C1->SR2; /* Clear ADDR flag by reading SR2 */
+static int8_t I2C1_SendAddress(uint8_t addr, uint8_t read) {
+  WRITE_REG(I2C1->DR, (addr << 1) | (read ? 1 : 0));
+  if (I2C1_WaitFlag(I2C_SR1_ADDR) != 0)
+    return -1;
+  (void)READ_REG(I2C1->SR2); /* Clear ADDR flag by reading SR2 */
+  return 0;
 }
 
 /**
  * @brief  Write byte to I2C
  */
-static void I2C1_WriteByte(uint8_t data) {
-  I2C1->DR = data;
-  while (!(I2C1->SR1 & I2C_SR1_TXE))
-    ;
+static int8_t I2C1_WriteByte(uint8_t data) {
+  WRITE_REG(I2C1->DR, data);
+  return I2C1_WaitFlag(I2C_SR1_TXE);
 }
 
 /**
  * @brief  Read byte from I2C with ACK
  */
-static uint8_t I2C1_ReadByteAck(void) {
+static int8_t I2C1_ReadByteAck(uint8_t *data) {
   SET_BIT(I2C1->CR1, I2C_CR1_ACK);
-  while (!(I2C1->SR1 & I2C_SR1_RXNE))
-    ;
-  return I2C1->DR;
+  if (I2C1_WaitFlag(I2C_SR1_RXNE) != 0)
+    return -1;
+  *data = (uint8_t)READ_REG(I2C1->DR);
+  return 0;
 }
 
 /**
  * @brief  Read byte from I2C with NACK
  */
-static uint8_t I2C1_ReadByteNack(void) {
+static int8_t I2C1_ReadByteNack(uint8_t *data) {
   CLEAR_BIT(I2C1->CR1, I2C_CR1_ACK);
   I2C1_Stop();
-  while (!(I2C1->SR1 & I2C_SR1_RXNE))
+  if (I2C1_WaitFlag(I2C_SR1_RXNE) != 0)
+    return -1;
+  *data = (uint8_t)READ_REG(I2C1->DR);
+  return 0;
+}
+
+/**
+ * @brief  Release the bus after a failed blocking transfer
+ */
+static int8_t I2C1_Abort(void) {
+  I2C1_Stop();
+  WRITE_REG(I2C1->SR1, ~I2C_SR1_ERRORS); /* rc_w0 */
+  return -1;
+}
+
+/**
+ * @brief  Wait for an asynchronous read to finish before a blocking one
+ */
+static void WaitAsyncIdle(void) {
+  uint32_t timeout = IMU_I2C_TIMEOUT;
+
+  while (xfer_state != XFER_IDLE && --timeout != 0)
     ;
-  return I2C1->DR;
 }
 
 /**
  * @brief  Write to MPU6050 register
  */
-static void MPU6050_WriteReg(uint8_t reg, uint8_t value) {
-  I2C1_Start();
-  I2C1_SendAddress(MPU6050_ADDR, 0); /* Write */
-  I2C1_WriteByte(reg);
-  I2C1_WriteByte(value);
+static int8_t MPU6050_WriteReg(uint8_t reg, uint8_t value) {
+  WaitAsyncIdle();
+
+  if (I2C1_Start() != 0 || I2C1_SendAddress(MPU6050_ADDR, 0) != 0 ||
+      I2C1_WriteByte(reg) != 0 || I2C1_WriteByte(value) != 0)
+    return I2C1_Abort();
+
   I2C1_Stop();
+  return 0;
 }
 
 /**
  * @brief  Read from MPU6050 register
  */
-static uint8_t MPU6050_ReadReg(uint8_t reg) {
-  uint8_t value;
+static int8_t MPU6050_ReadReg(uint8_t reg, uint8_t *value) {
+  WaitAsyncIdle();
 
-  I2C1_Start();
-  I2C1_SendAddress(MPU6050_ADDR, 0); /* Write */
-  I2C1_WriteByte(reg);
+  if (I2C1_Start() != 0 || I2C1_SendAddress(MPU6050_ADDR, 0) != 0 ||
+      I2C1_WriteByte(reg) != 0)
+    return I2C1_Abort();
 
-  I2C1_Start();
-  I2C1_SendAddress(MPU6050_ADDR, 1); /* Read */
-  value = I2C1_ReadByteNack();
+  if (I2C1_Start() != 0 || I2C1_SendAddress(MPU6050_ADDR, 1) != 0 ||
+      I2C1_ReadByteNack(value) != 0)
+    return I2C1_Abort();
 
-  return value;
+  return 0;
 }
 
 /**
  * @brief  Read 16-bit value from MPU6050 (big-endian)
  */
-static int16_t MPU6050_ReadReg16(uint8_t reg) {
-  int16_t value;
+static int8_t MPU6050_ReadReg16(uint8_t reg, int16_t *value) {
+  uint8_t high, low;
+
+  WaitAsyncIdle();
+
+  if (I2C1_Start() != 0 || I2C1_SendAddress(MPU6050_ADDR, 0) != 0 ||
+      I2C1_WriteByte(reg) != 0)
+    return I2C1_Abort();
+
+  if (I2C1_Start() != 0 || I2C1_SendAddress(MPU6050_ADDR, 1) != 0 ||
+      I2C1_ReadByteAck(&high) != 0 || I2C1_ReadByteNack(&low) != 0)
+    return I2C1_Abort();
+
+  *value = (int16_t)((high << 8) | low);
+  return 0;
+}
+
+/**
+ * @brief  Stop the asynchronous transfer (DMA off, interrupts masked)
+ */
+static void AbortAsync(void) {
+  CLEAR_BIT(I2C1->CR2, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN | I2C_CR2_DMAEN |
+                           I2C_CR2_LAST);
+  CLEAR_BIT(DMA1_Channel7->CCR, DMA_CCR_EN);
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF7);
+  xfer_state = XFER_IDLE;
+}
+
+/**
+ * @brief  Reset I2C1 after a timeout or bus error
+ */
+static void Recover(void) {
+  AbortAsync();
+  I2C1_Configure();
+  recover_pending = 0;
+  stats.recoveries++;
+
+  /* A FIFO read cut short may have left half a sample behind */
+  if (xfer_phase == PHASE_FIFO_DATA)
+    fifo_reset_needed = 1;
+}
+
+/**
+ * @brief  Start an asynchronous burst read of len bytes from reg
+ */
+static void StartBurst(IMU_Phase_t phase, uint8_t reg, uint32_t len) {
+  /* Arm DMA for the burst */
+  CLEAR_BIT(DMA1_Channel7->CCR, DMA_CCR_EN);
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF7);
+  WRITE_REG(DMA1_Channel7->CNDTR, len);
+  WRITE_REG(DMA1_Channel7->CCR,
+            DMA_CCR_MINC | DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_PL_1);
+  SET_BIT(DMA1_Channel7->CCR, DMA_CCR_EN);
+
+  /* Kick off: the event interrupt takes it from here */
+  xfer_phase = phase;
+  xfer_reg = reg;
+  xfer_len = len;
+  xfer_state = XFER_START;
+  SET_BIT(I2C1->CR2, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+  SET_BIT(I2C1->CR1, I2C_CR1_ACK);
+  SET_BIT(I2C1->CR1, I2C_CR1_START);
+}
+
+/**
+ * @brief  Start an asynchronous single register write
+ */
+static void StartWrite(IMU_Phase_t phase, uint8_t reg, uint8_t value) {
+  xfer_phase = phase;
+  xfer_reg = reg;
+  xfer_value = value;
+  xfer_state = XFER_START;
+  SET_BIT(I2C1->CR2, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+  SET_BIT(I2C1->CR1, I2C_CR1_START);
+}
+
+/**
+ * @brief  Decode the sensor registers into the back buffer and publish it
+ * @param  raw: ACCEL_XOUT_H .. GYRO_ZOUT_L as read from the bus
+ */
+static void PublishSample(const uint8_t *raw) {
+  IMU_Sample_t *back = &samples[published ^ 1];
+
+  for (uint8_t i = 0; i < 3; i++) {
+    back->accel[i] = (int16_t)((raw[2 * i] << 8) | raw[2 * i + 1]);
+    back->gyro[i] = (int16_t)((raw[8 + 2 * i] << 8) | raw[9 + 2 * i]);
+  }
+  back->temp = (int16_t)((raw[6] << 8) | raw[7]);
+  back->sequence = samples[published].sequence + 1;
+
+  published ^= 1;
+  stats.completed++;
+}
+
+/**
+ * @brief  Decode count FIFO samples from the DMA buffer and publish them
+ */
+static void PublishBatch(uint32_t count) {
+  IMU_Batch_t *back = &batches[batch_published ^ 1];
+
+  for (uint32_t i = 0; i < count; i++)
+    back->gyro_z[i] = (int16_t)((dma_buf[2 * i] << 8) | dma_buf[2 * i + 1]);
+  back->count = count;
+  back->epoch = fifo_epoch_done;
+  back->sequence = batches[batch_published].sequence + 1;
+
+  batch_published ^= 1;
+}
+
+/**
+ * @brief  Continue the FIFO chain after the INT_STATUS/sensor burst
+ */
+static void FifoAfterSensor(uint8_t int_status) {
+  uint32_t epoch = fifo_epoch;
+
+  if (fifo_reset_needed || epoch != fifo_epoch_done) {
+    /* Empty the FIFO instead of reading it; FIFO_EN stays set */
+    fifo_epoch_serving = epoch;
+    fifo_reset_needed = 0;
+    StartWrite(PHASE_FIFO_RESET, MPU6050_REG_USER_CTRL,
+               MPU6050_USER_CTRL_FIFO_EN | MPU6050_USER_CTRL_FIFO_RESET);
+    return;
+  }
+
+  /* Overflow while nobody wanted the old samples is expected */
+  if (int_status & MPU6050_INT_FIFO_OFLOW)
+    stats.fifo_overflows++;
+
+  StartBurst(PHASE_FIFO_COUNT, MPU6050_REG_FIFO_COUNTH, 2);
+}
+
+/**
+ * @brief  Continue the FIFO chain after FIFO_COUNT
+ */
+static void FifoAfterCount(void) {
+  uint32_t available = (((uint32_t)dma_buf[0] << 8) | dma_buf[1]) / 2U;
+  uint32_t count = available;
 
-  I2C1_Start();
-  I2C1_SendAddress(MPU6050_ADDR, 0); /* Write */
-  I2C1_WriteByte(reg);
+  if (count > IMU_FIFO_MAX_BATCH) {
+    count = IMU_FIFO_MAX_BATCH;
+    stats.fifo_backlog++; /* The rest waits for the next tick */
+  }
 
-  I2C1_Start();
-  I2C1_SendAddress(MPU6050_ADDR, 1); /* Read */
-  uint8_t high = I2C1_ReadByteAck();
-  uint8_t low = I2C1_ReadByteNack();
+  /* Fewer than two bytes: nothing to read this tick */
+  if (count != 0)
+    StartBurst(PHASE_FIFO_DATA, MPU6050_REG_FIFO_R_W, 2U * count);
+  else
+    I2C1_Stop();
+}
 
-  value = (int16_t)((high << 8) | low);
-  return value;
+/**
+ * @brief  Trapezoidal heading integration over the latest FIFO batch
+ */
+static void IntegrateBatch(void) {
+  const IMU_Batch_t *batch = &batches[batch_published];
+
+  if (batch->sequence == last_batch_sequence)
+    return;
+  last_batch_sequence = batch->sequence;
+
+  /* Read before the last heading reset: drop */
+  if (batch->epoch != fifo_epoch)
+    return;
+
+  uint32_t i = 0;
+  if (batch->epoch != integrated_epoch) {
+    /* First samples since the reset: nothing to pair the first one with */
+    if (batch->count == 0)
+      return;
+    integrated_epoch = batch->epoch;
+    prev_rate =
+        ((float)batch->gyro_z[0] / GYRO_SENSITIVITY) - imu_data.gyro_z_bias;
+    imu_data.heading += prev_rate * FIFO_SAMPLE_PERIOD;
+    i = 1;
+  }
+
+  for (; i < batch->count; i++) {
+    float rate =
+        ((float)batch->gyro_z[i] / GYRO_SENSITIVITY) - imu_data.gyro_z_bias;
+    imu_data.heading += 0.5f * (prev_rate + rate) * FIFO_SAMPLE_PERIOD;
+    prev_rate = rate;
+  }
+  imu_data.gyro_z = prev_rate;
 }
 
 /* ================ Public Functions ================ */
 
 /**
- * @brief  Initialize MPU6050
+ * @brief  Initialize MPU6050 in the default mode
+ */
+int8_t IMU_Init(void) { return IMU_InitMode(IMU_MODE); }
+
+/**
+ * @brief  Initialize MPU6050 in a given mode
  */
-int8_t IMU_Init(void) {
+int8_t IMU_InitMode(IMU_Mode_t mode) {
+  uint8_t who_am_i = 0;
+
+  imu_mode = mode;
+  stats = (IMU_Stats_t){0};
+
   /* Initialize I2C1 */
   I2C1_Init();
 
   /* Check WHO_AM_I register */
-  uint8_t who_am_i = MPU6050_ReadReg(MPU6050_REG_WHO_AM_I);
-  if (who_am_i != 0x68) {
+  if (MPU6050_ReadReg(MPU6050_REG_WHO_AM_I, &who_am_i) != 0 ||
+      who_am_i != 0x68) {
     return -1; /* MPU6050 not found */
   }
 
   /* Wake up MPU6050 (clear sleep bit) */
   MPU6050_WriteReg(MPU6050_REG_PWR_MGMT_1, 0x00);
 
-  /* Set sample rate divider: 1kHz / (1 + 9) = 100Hz */
-  MPU6050_WriteReg(MPU6050_REG_SMPLRT_DIV, 9);
+  /* Set sample rate divider: 1kHz / (1 + 9) = 100Hz, or the FIFO rate */
+  if (mode == IMU_MODE_FIFO)
+    MPU6050_WriteReg(MPU6050_REG_SMPLRT_DIV, 1000U / IMU_FIFO_RATE_HZ - 1U);
+  else
+    MPU6050_WriteReg(MPU6050_REG_SMPLRT_DIV, 1000U / REGISTER_RATE_HZ - 1U);
 
   /* Set DLPF to ~44Hz bandwidth */
   MPU6050_WriteReg(MPU6050_REG_CONFIG, 0x03);
@@ -185,9 +536,26 @@ int8_t IMU_Init(void) {
   /* Set gyro range to ±250 deg/s */
   MPU6050_WriteReg(MPU6050_REG_GYRO_CONFIG, 0x00);
 
-  /* Set accelerometer range to ±2g (not used for heading, but set anyway) */
+  /* Set accelerometer range to ±2g */
   MPU6050_WriteReg(MPU6050_REG_ACCEL_CONFIG, 0x00);
 
+  /* FIFO mode: gyro Z into the FIFO, overflow reported in INT_STATUS.
+   * DATA_RDY in INT_STATUS paces IMU_Calibrate() in both modes */
+  if (mode == IMU_MODE_FIFO) {
+    MPU6050_WriteReg(MPU6050_REG_INT_ENABLE,
+                     MPU6050_INT_FIFO_OFLOW | MPU6050_INT_DATA_RDY);
+    MPU6050_WriteReg(MPU6050_REG_FIFO_EN, MPU6050_FIFO_EN_ZG);
+    MPU6050_WriteReg(MPU6050_REG_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN |
+                                                MPU6050_USER_CTRL_FIFO_RESET);
+  } else {
+    MPU6050_WriteReg(MPU6050_REG_USER_CTRL, 0x00);
+    MPU6050_WriteReg(MPU6050_REG_FIFO_EN, 0x00);
+    MPU6050_WriteReg(MPU6050_REG_INT_ENABLE, MPU6050_INT_DATA_RDY);
+  }
+
+  /* The chain empties the FIFO once more on its first tick */
+  fifo_epoch = fifo_epoch_done + 1U;
+
   /* Initialize IMU data */
   imu_data.gyro_x = 0.0f;
   imu_data.gyro_y = 0.0f;
@@ -195,46 +563,252 @@ int8_t IMU_Init(void) {
   imu_data.heading = 0.0f;
   imu_data.gyro_z_bias = 0.0f;
 
+  /* FIFO mode reads the sensor registers once per tick: IMU_Update()
+   * switches the period to dt */
+  Attitude_Init(&attitude, IMU_ATTITUDE_FILTER, 1.0f / REGISTER_RATE_HZ,
+                IMU_ATTITUDE_GAIN);
+  attitude_reset = 0;
+
+  return 0;
+}
+
+/**
+ * @brief  Get the active acquisition mode
+ */
+IMU_Mode_t IMU_GetMode(void) { return imu_mode; }
+
+/**
+ * @brief  Add a reading to a running mean and variance (Welford)
+ */
+static void RunningStats_Add(RunningStats_t *stats, float x) {
+  stats->count++;
+  float delta = x - stats->mean;
+  stats->mean += delta / (float)stats->count;
+  stats->m2 += delta * (x - stats->mean);
+}
+
+/**
+ * @brief  Standard deviation of the readings
+ */
+static float RunningStats_Deviation(const RunningStats_t *stats) {
+  return (stats->count > 1) ? sqrtf(stats->m2 / (float)(stats->count - 1U))
+                            : 0.0f;
+}
+
+/**
+ * @brief  Wait for data-ready, then read gyro Z (blocking)
+ * @param  rate: Reading in deg/s
+ * @retval 0 on success, -1 on a bus error or no new sample in time
+ */
+static int8_t ReadGyroZReady(float *rate) {
+  /* One reading per IMU_CALIB_RATE_HZ period of output samples */
+  uint32_t samples = (imu_mode == IMU_MODE_FIFO)
+                         ? IMU_FIFO_RATE_HZ / IMU_CALIB_RATE_HZ
+                         : REGISTER_RATE_HZ / IMU_CALIB_RATE_HZ;
+
+  for (uint32_t i = 0; i < samples; i++) {
+    uint32_t start = systick_counter;
+    uint8_t status = 0;
+
+    /* Reading INT_STATUS clears DATA_RDY */
+    while (!(status & MPU6050_INT_DATA_RDY)) {
+      if (MPU6050_ReadReg(MPU6050_REG_INT_STATUS, &status) != 0 ||
+          systick_counter - start > IMU_DATA_READY_TIMEOUT_MS)
+        return -1;
+    }
+  }
+
+  int16_t raw_z;
+  if (MPU6050_ReadReg16(MPU6050_REG_GYRO_ZOUT_H, &raw_z) != 0)
+    return -1;
+  *rate = (float)raw_z / GYRO_SENSITIVITY;
   return 0;
 }
 
 /**
  * @brief  Calibrate gyroscope (robot must be stationary)
  */
-void IMU_Calibrate(void) {
-  float sum = 0.0f;
-  const int samples = 100;
+IMU_CalibStatus_t IMU_Calibrate(void) {
+  RunningStats_t z = {0};
+  IMU_CalibStatus_t status;
+  uint32_t readings = 0, restarts = 0;
+
+  while (1) {
+    float rate;
+    if (ReadGyroZReady(&rate) != 0) {
+      status = IMU_CALIB_BUS_ERROR;
+      break;
+    }
+    readings++;
+
+    /* Moved: start over from this reading */
+    if (z.count > 0 && fabsf(rate - z.mean) > IMU_CALIB_MOTION_DPS) {
+      if (++restarts > IMU_CALIB_MAX_RESTARTS) {
+        status = IMU_CALIB_MOTION;
+        break;
+      }
+      z = (RunningStats_t){0};
+    }
+    RunningStats_Add(&z, rate);
+
+    /* Converged: standard error of the mean within tolerance */
+    if (z.count >= IMU_CALIB_MIN_SAMPLES &&
+        RunningStats_Deviation(&z) / sqrtf((float)z.count) <=
+            IMU_CALIB_TOLERANCE) {
+      status = IMU_CALIB_OK;
+      break;
+    }
+    if (readings >= IMU_CALIB_MAX_SAMPLES) {
+      status = IMU_CALIB_TIMEOUT;
+      break;
+    }
+  }
+
+  float noise = RunningStats_Deviation(&z);
+  calibration = (IMU_Calibration_t){
+      .status = status,
+      .readings = readings,
+      .samples = z.count,
+      .restarts = restarts,
+      .bias = z.mean,
+      .noise = noise,
+      .std_error = z.count ? noise / sqrtf((float)z.count) : 0.0f,
+  };
+  if (status == IMU_CALIB_OK)
+    IMU_SetGyroBias(z.mean);
+  return status;
+}
+
+/**
+ * @brief  Get the result of the last calibration
+ */
+void IMU_GetCalibration(IMU_Calibration_t *out) { *out = calibration; }
 
-  for (int i = 0; i < samples; i++) {
-    int16_t raw_z = MPU6050_ReadReg16(MPU6050_REG_GYRO_ZOUT_H);
-    sum += (float)raw_z / GYRO_SENSITIVITY;
+/**
+ * @brief  Set the gyro Z bias
+ */
+void IMU_SetGyroBias(float bias) {
+  imu_data.gyro_z_bias = bias;
+
+  const float biases[3] = {0.0f, 0.0f, bias};
+  Attitude_SetGyroBias(&attitude, biases);
+}
+
+/**
+ * @brief  Read the MPU6050 die temperature
+ */
+int8_t IMU_ReadTemperature(float *temp_c) {
+  int16_t raw;
+
+  if (MPU6050_ReadReg16(MPU6050_REG_TEMP_OUT_H, &raw) != 0)
+    return -1;
+
+  /* Register map: T = TEMP_OUT / 340 + 36.53 */
+  *temp_c = (float)raw / 340.0f + 36.53f;
+  return 0;
+}
 
-    /* Simple delay */
-    for (volatile int j = 0; j < 10000; j++)
-      ;
+/**
+ * @brief  Check the robot is still and the gyro Z bias still nulls the rate
+ */
+int8_t IMU_CheckGyroBias(float tolerance) {
+  RunningStats_t z = {0};
+
+  for (uint32_t i = 0; i < IMU_BIAS_CHECK_SAMPLES; i++) {
+    float rate;
+    if (ReadGyroZReady(&rate) != 0 ||
+        (z.count > 0 && fabsf(rate - z.mean) > IMU_CALIB_MOTION_DPS))
+      return -1;
+    RunningStats_Add(&z, rate);
   }
 
-  imu_data.gyro_z_bias = sum / samples;
+  return (fabsf(z.mean - imu_data.gyro_z_bias) <= tolerance) ? 0 : -1;
 }
 
 /**
- * @brief  Update IMU readings
+ * @brief  Start a non-blocking burst read
  */
-void IMU_Update(float dt) {
-  /* Read gyro Z (yaw rate) */
-  int16_t raw_z = MPU6050_ReadReg16(MPU6050_REG_GYRO_ZOUT_H);
+void IMU_StartRead(void) {
+  /* Previous read never finished: the bus or the sensor is stuck */
+  if (xfer_state != XFER_IDLE) {
+    stats.timeouts++;
+    recover_pending = 1;
+  }
+  if (recover_pending)
+    Recover();
+
+  stats.started++;
+  if (imu_mode == IMU_MODE_FIFO)
+    StartBurst(PHASE_SENSOR, MPU6050_REG_INT_STATUS,
+               MPU6050_STATUS_BURST_LEN);
+  else
+    StartBurst(PHASE_SENSOR, MPU6050_REG_ACCEL_XOUT_H, MPU6050_BURST_LEN);
+}
 
-  /* Convert to deg/s and subtract bias */
-  imu_data.gyro_z = ((float)raw_z / GYRO_SENSITIVITY) - imu_data.gyro_z_bias;
+/**
+ * @brief  Update IMU readings from the latest sample
+ */
+void IMU_Update(float dt) {
+  TRACE_ENTER(TRACE_ID_IMU_UPDATE);
+  const IMU_Sample_t *sample = &samples[published];
+
+  if (sample->sequence != last_sequence) {
+    last_sequence = sample->sequence;
+
+    imu_data.gyro_x = (float)sample->gyro[0] / GYRO_SENSITIVITY;
+    imu_data.gyro_y = (float)sample->gyro[1] / GYRO_SENSITIVITY;
+    imu_data.gyro_z =
+        ((float)sample->gyro[2] / GYRO_SENSITIVITY) - imu_data.gyro_z_bias;
+    imu_data.accel_x = (float)sample->accel[0] / ACCEL_SENSITIVITY;
+    imu_data.accel_y = (float)sample->accel[1] / ACCEL_SENSITIVITY;
+    imu_data.accel_z = (float)sample->accel[2] / ACCEL_SENSITIVITY;
+
+    TRACE_ENTER(TRACE_ID_ATTITUDE_UPDATE);
+    if (attitude_reset) {
+      attitude_reset = 0;
+      Attitude_Reset(&attitude);
+    }
+    if (imu_mode == IMU_MODE_FIFO && dt != attitude.period)
+      Attitude_SetPeriod(&attitude, dt);
+    Attitude_Update(&attitude, sample->gyro, sample->accel);
+    TRACE_EXIT(TRACE_ID_ATTITUDE_UPDATE);
+  }
 
-  /* Integrate heading */
-  imu_data.heading += imu_data.gyro_z * dt;
+  /* Integrate heading: every FIFO sample, or the latest rate over dt */
+  if (imu_mode == IMU_MODE_FIFO)
+    IntegrateBatch();
+  else
+    imu_data.heading += imu_data.gyro_z * dt;
 
   /* Normalize heading to -180 to +180 */
   while (imu_data.heading > 180.0f)
     imu_data.heading -= 360.0f;
   while (imu_data.heading < -180.0f)
     imu_data.heading += 360.0f;
+
+  TRACE_EXIT(TRACE_ID_IMU_UPDATE);
+}
+
+/**
+ * @brief  Copy the latest published raw sample
+ */
+void IMU_GetSample(IMU_Sample_t *sample) { *sample = samples[published]; }
+
+/**
+ * @brief  Copy acquisition statistics
+ */
+void IMU_GetStats(IMU_Stats_t *out) {
+  out->started = stats.started;
+  out->completed = stats.completed;
+  out->errors = stats.errors;
+  out->timeouts = stats.timeouts;
+  out->recoveries = stats.recoveries;
+  out->fifo_batches = stats.fifo_batches;
+  out->fifo_samples = stats.fifo_samples;
+  out->fifo_max_batch = stats.fifo_max_batch;
+  out->fifo_backlog = stats.fifo_backlog;
+  out->fifo_overflows = stats.fifo_overflows;
+  out->fifo_resets = stats.fifo_resets;
 }
 
 /**
@@ -248,11 +822,170 @@ float IMU_GetYawRate(void) { return imu_data.gyro_z; }
 float IMU_GetHeading(void) { return imu_data.heading; }
 
 /**
- * @brief  Reset heading to zero
+ * @brief  Reset heading to zero (and discard queued FIFO samples)
  */
-void IMU_ResetHeading(void) { imu_data.heading = 0.0f; }
+void IMU_ResetHeading(void) {
+  imu_data.heading = 0.0f;
+  fifo_epoch = fifo_epoch + 1U;
+  attitude_reset = 1;
+}
+
+/**
+ * @brief  Get the fused attitude
+ */
+void IMU_GetAttitude(float *roll, float *pitch, float *yaw) {
+  /* Snapshot: the control loop interrupt updates the filter */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  Attitude_t snapshot = attitude;
+  __set_PRIMASK(primask);
+
+  Attitude_GetEuler(&snapshot, roll, pitch, yaw);
+}
 
 /**
  * @brief  Get pointer to IMU data
  */
 IMU_Data_t *IMU_GetData(void) { return &imu_data; }
+
+/* ================ Interrupt Handlers ================ */
+
+/**
+ * @brief  I2C1 event handler - sequences a burst read up to DMA, or a write
+ */
+void IMU_I2C1_EV_Handler(void) {
+  uint32_t sr1 = READ_REG(I2C1->SR1);
+
+  switch (xfer_state) {
+  case XFER_START:
+    if (sr1 & I2C_SR1_SB) {
+      WRITE_REG(I2C1->DR, MPU6050_ADDR << 1);
+      xfer_state = XFER_ADDR_W;
+    }
+    break;
+
+  case XFER_ADDR_W:
+    if (sr1 & I2C_SR1_ADDR) {
+      (void)READ_REG(I2C1->SR2);
+      WRITE_REG(I2C1->DR, xfer_reg);
+      xfer_state = XFER_REG;
+    }
+    break;
+
+  case XFER_REG:
+    if (sr1 & I2C_SR1_BTF) {
+      if (xfer_phase == PHASE_FIFO_RESET) {
+        WRITE_REG(I2C1->DR, xfer_value);
+        xfer_state = XFER_VALUE;
+      } else {
+        SET_BIT(I2C1->CR1, I2C_CR1_START);
+        xfer_state = XFER_RESTART;
+      }
+    }
+    break;
+
+  case XFER_VALUE:
+    if (sr1 & I2C_SR1_BTF) {
+      /* FIFO emptied: batches from here on belong to the new epoch */
+      I2C1_Stop();
+      AbortAsync();
+      fifo_epoch_done = fifo_epoch_serving;
+      stats.fifo_resets++;
+      PublishBatch(0);
+    }
+    break;
+
+  case XFER_RESTART:
+    if (sr1 & I2C_SR1_SB) {
+      WRITE_REG(I2C1->DR, (MPU6050_ADDR << 1) | 1);
+      xfer_state = XFER_ADDR_R;
+    }
+    break;
+
+  case XFER_ADDR_R:
+    if (sr1 & I2C_SR1_ADDR) {
+      /* DMA takes over; LAST makes the final byte NACK */
+      SET_BIT(I2C1->CR2, I2C_CR2_DMAEN | I2C_CR2_LAST);
+      (void)READ_REG(I2C1->SR2);
+      xfer_state = XFER_DMA;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief  I2C1 error handler - aborts the burst read
+ */
+void IMU_I2C1_ER_Handler(void) {
+  uint32_t sr1 = READ_REG(I2C1->SR1);
+
+  WRITE_REG(I2C1->SR1, ~I2C_SR1_ERRORS); /* rc_w0 */
+  I2C1_Stop();
+  AbortAsync();
+  stats.errors++;
+
+  /* Bus error or lost arbitration leaves the peripheral in doubt */
+  if (sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO))
+    recover_pending = 1;
+
+  /* Samples popped before the error are lost, maybe half of one */
+  if (xfer_phase == PHASE_FIFO_DATA)
+    fifo_reset_needed = 1;
+}
+
+/**
+ * @brief  DMA1 Channel 7 handler - burst received, publish it and chain
+ */
+void IMU_DMA1_Channel7_Handler(void) {
+  uint32_t isr = READ_REG(DMA1->ISR);
+
+  AbortAsync();
+
+  if (isr & DMA_ISR_TEIF7) {
+    I2C1_Stop();
+    stats.errors++;
+    recover_pending = 1;
+    return;
+  }
+  if (!(isr & DMA_ISR_TCIF7)) {
+    I2C1_Stop();
+    return;
+  }
+
+  if (imu_mode != IMU_MODE_FIFO) {
+    I2C1_Stop();
+    PublishSample(dma_buf);
+    return;
+  }
+
+  /* The chain goes on with a repeated START (the last byte was NACKed), so
+   * there is no STOP to wait for here; it ends with one */
+  switch (xfer_phase) {
+  case PHASE_SENSOR:
+    PublishSample(&dma_buf[1]);
+    FifoAfterSensor(dma_buf[0]);
+    break;
+
+  case PHASE_FIFO_COUNT:
+    FifoAfterCount();
+    break;
+
+  case PHASE_FIFO_DATA: {
+    uint32_t count = xfer_len / 2U;
+    I2C1_Stop();
+    PublishBatch(count);
+    stats.fifo_batches++;
+    stats.fifo_samples += count;
+    if (count > stats.fifo_max_batch)
+      stats.fifo_max_batch = count;
+    break;
+  }
+
+  default:
+    I2C1_Stop();
+    break;
+  }
+}
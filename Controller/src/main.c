@@ -7,18 +7,20 @@
  */
 
 #include "main.h"
+#include "control_loop.h"
 #include "differential_drive.h"
 #include "encoder.h"
 #include "imu.h"
 #include "motor.h"
+#include "param_server.h"
+#include "settings.h"
+#include "telemetry.h"
+#include "trace.h"
 
 /* ================ Global Variables ================ */
 
 volatile uint32_t systick_counter = 0;
 
-/* Control loop timing */
-static volatile uint8_t control_flag = 0;
-
 /* ================ Function Prototypes ================ */
 
 void SystemClock_Config(void);
@@ -39,45 +41,90 @@ int main(void) {
   /* Initialize LED (PC13) */
   GPIO_LED_Init();
 
+#if TELEMETRY_ENABLE
+  /* Per-tick telemetry frames over USART3 */
+  Telemetry_Init();
+#else
+  /* Hot-path tracing over USART3 */
+  Trace_Init();
+#endif
+
+#if PARAM_SERVER_ENABLE
+  /* Live parameter commands on USART3 RX (replies need telemetry) */
+#if TELEMETRY_ENABLE
+  ParamServer_Init(Telemetry_SendReply);
+#else
+  ParamServer_Init(0);
+#endif
+#endif
+
   /* Initialize differential drive controller */
   DifferentialDrive_Init();
 
-  /* Calibrate sensors (robot must be stationary!) */
-  /* Blink LED fast during calibration */
-  for (int i = 0; i < 10; i++) {
-    GPIOC->ODR ^= LED_PIN;
-    delay_ms(100);
+#if SETTINGS_ENABLE
+  /* Stored gains, odometry and gyro bias: calibrate only if none are
+   * stored or the bias no longer holds */
+  if (Settings_Restore() != SETTINGS_RESTORED)
+#endif
+  {
+    /* Calibrate sensors (robot must be stationary!) */
+    /* Blink LED fast, then calibrate; again while the robot moves */
+    IMU_CalibStatus_t calib;
+    do {
+      for (int i = 0; i < 10; i++) {
+        GPIOC->ODR ^= LED_PIN;
+        delay_ms(100);
+      }
+      calib = DifferentialDrive_Calibrate();
+    } while (calib == IMU_CALIB_MOTION);
+
+#if SETTINGS_ENABLE
+    /* Skip the calibration next boot */
+    if (calib == IMU_CALIB_OK)
+      Settings_Store();
+#endif
+
+    /* Indicate calibration complete - LED on */
+    SET_BIT(GPIOC->ODR, LED_PIN);
+    delay_ms(500);
+    CLEAR_BIT(GPIOC->ODR, LED_PIN);
   }
 
-  DifferentialDrive_Calibrate();
-
-  /* Indicate calibration complete - LED on */
-  SET_BIT(GPIOC->ODR, LED_PIN);
-  delay_ms(500);
-  CLEAR_BIT(GPIOC->ODR, LED_PIN);
-
   /* Set target speed (encoder counts per second) */
   /* Adjust this value based on your encoder resolution and desired speed */
   float target_speed = 500.0f; /* counts/second */
 
   DifferentialDrive_SetSpeed(target_speed);
 
-  /* Control loop timing */
-  float dt = (float)CONTROL_PERIOD_MS / 1000.0f; /* Convert to seconds */
-  uint32_t last_time = systick_counter;
-
-  /* Main control loop */
-  while (1) {
-    /* Check if control interval has elapsed */
-    if ((systick_counter - last_time) >= CONTROL_PERIOD_MS) {
-      last_time = systick_counter;
+  /* Run the control loop from the TIM4 interrupt */
+  if (ControlLoop_Init(CONTROL_LOOP_HZ, DifferentialDrive_Update) != 0) {
+    Error_Handler();
+  }
+  ControlLoop_Start();
 
-      /* Update control loop */
-      DifferentialDrive_Update(dt);
+  uint32_t last_iteration = ControlLoop_GetIterations();
 
-      /* Toggle LED to show activity */
+  /* Main loop: background work only */
+  while (1) {
+    /* Toggle LED to show activity */
+    uint32_t iteration = ControlLoop_GetIterations();
+    if (iteration != last_iteration) {
+      last_iteration = iteration;
       GPIOC->ODR ^= LED_PIN;
     }
+
+#if !TELEMETRY_ENABLE
+    /* Drain trace events (the DMA interrupt chains further packets) */
+    Trace_Flush();
+#endif
+
+#if PARAM_SERVER_ENABLE
+    /* Execute received commands between control ticks */
+    ParamServer_Poll();
+#endif
+
+    /* Sleep until the next interrupt */
+    __WFI();
   }
 }
 
@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file    motion_profile.c
+ * @brief   Jerk/acceleration-limited velocity profile generator
+ ******************************************************************************
+ *
+ * S-curve update: each tick the acceleration moves by at most
+ * max_jerk * dt towards the largest value from which a ramp down at
+ * max_jerk still lands on the target, worked out for the discrete step so
+ * the profile does not overshoot or land early. The velocity integrates
+ * the acceleration with the trapezoidal rule.
+ *
+ ******************************************************************************
+ */
+
+#include "motion_profile.h"
+#include <math.h>
+
+/* ================ Private Defines ================ */
+
+/* Float rounding allowed on the last jerk step (accumulated over the ramp
+ * down, it can leave the acceleration just above one step) */
+#define LANDING_MARGIN 1.01f
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Clamp value between min and max
+ */
+static float clamp(float value, float min, float max) {
+  if (value < min)
+    return min;
+  if (value > max)
+    return max;
+  return value;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Initialize a profile at rest
+ */
+void MotionProfile_Init(MotionProfile_t *profile, float max_accel,
+                        float max_jerk) {
+  MotionProfile_SetLimits(profile, max_accel, max_jerk);
+  MotionProfile_Reset(profile, 0.0f);
+}
+
+/**
+ * @brief  Change the limits
+ */
+void MotionProfile_SetLimits(MotionProfile_t *profile, float max_accel,
+                             float max_jerk) {
+  profile->max_accel = max_accel;
+  profile->max_jerk = (max_jerk > 0.0f) ? max_jerk : 0.0f;
+}
+
+/**
+ * @brief  Set the velocity to move towards
+ */
+void MotionProfile_SetTarget(MotionProfile_t *profile, float target) {
+  profile->target = target;
+}
+
+/**
+ * @brief  Jump to a velocity with zero acceleration
+ */
+void MotionProfile_Reset(MotionProfile_t *profile, float velocity) {
+  profile->target = velocity;
+  profile->velocity = velocity;
+  profile->accel = 0.0f;
+}
+
+/**
+ * @brief  Advance one tick
+ */
+float MotionProfile_Update(MotionProfile_t *profile, float dt) {
+  float error = profile->target - profile->velocity;
+
+  if (dt <= 0.0f)
+    return profile->velocity;
+
+  if (error == 0.0f && profile->accel == 0.0f)
+    return profile->velocity;
+
+  /* Trapezoidal: constant acceleration, last step lands exactly */
+  if (profile->max_jerk == 0.0f) {
+    float step = profile->max_accel * dt;
+    float dv = clamp(error, -step, step);
+    profile->velocity += dv;
+    profile->accel = dv / dt;
+    return profile->velocity;
+  }
+
+  /*
+   * S-curve, worked in the direction of the error. The next acceleration a'
+   * must leave a landing: after this step (trapezoidal, +(a + a') dt / 2)
+   * ramping a' to zero at max_jerk adds a'^2 / (2 J), so
+   *   a'^2 + J dt a' - 2 J (error - a dt / 2) <= 0
+   * Take the largest such a' within one jerk step and max_accel.
+   */
+  float sign = (error < 0.0f) ? -1.0f : 1.0f;
+  float jerk = profile->max_jerk;
+  float jerk_step = jerk * dt;
+  float accel = sign * profile->accel;
+
+  /* Within the last jerk step of the target: this tick ramps the
+   * acceleration to zero and lands on it. The step before leaves at most
+   * jerk_step^2 / (2 J) = jerk_step * dt / 2 to go. */
+  if (accel >= 0.0f && accel <= LANDING_MARGIN * jerk_step &&
+      sign * error <= 0.5f * LANDING_MARGIN * jerk_step * dt) {
+    profile->velocity = profile->target;
+    profile->accel = 0.0f;
+    return profile->velocity;
+  }
+
+  float reach = sign * error - 0.5f * accel * dt;
+  float disc = jerk_step * jerk_step + 8.0f * jerk * reach;
+  float landing = (disc > 0.0f) ? 0.5f * (sqrtf(disc) - jerk_step)
+                                : -profile->max_accel;
+  float next = clamp(landing, accel - jerk_step, accel + jerk_step);
+  next = clamp(next, -profile->max_accel, profile->max_accel);
+
+  profile->velocity += sign * 0.5f * (accel + next) * dt;
+  profile->accel = sign * next;
+
+  return profile->velocity;
+}
+
+/**
+ * @brief  Check whether the target has been reached
+ */
+uint8_t MotionProfile_IsDone(const MotionProfile_t *profile) {
+  return (profile->velocity == profile->target && profile->accel == 0.0f);
+}
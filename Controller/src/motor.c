@@ -12,6 +12,13 @@
  *   - Right Motor IN1  -> PB0 (GPIO - direction)
  *   - Right Motor IN2  -> PB1 (GPIO - direction)
  *
+ * Register writes:
+ *   - Direction pins change through one BSRR write per port (never a
+ *     read-modify-write of ODR an interrupt could interleave with)
+ *   - Both compares load with the update event held off (CR1.UDIS), so the
+ *     wheels switch on the same PWM edge; the module owns TIM3 and writes
+ *     CR1 from a copy instead of reading it back
+ *
  ******************************************************************************
  */
 
@@ -19,7 +26,8 @@
 
 /* ================ Private Defines ================ */
 
-#define MOTOR_PWM_PERIOD 1000 /* PWM period for 0-100% */
+/* Largest ARR: one count below 16 bits, so ARR + 1 (full duty) fits */
+#define MOTOR_ARR_MAX 65534U
 
 /* Left motor direction pins */
 #define LEFT_IN1_PIN GPIO_ODR_ODR4
@@ -31,6 +39,22 @@
 #define RIGHT_IN2_PIN GPIO_ODR_ODR1
 #define RIGHT_PORT GPIOB
 
+/* ================ Private Variables ================ */
+
+static uint32_t pwm_hz = 0;
+static uint16_t pwm_arr = 0;
+
+/* Compensation table: per mille, and in timer counts for pwm_arr */
+static uint16_t comp_duty[MOTOR_COMP_POINTS];
+static uint16_t comp_counts[MOTOR_COMP_POINTS];
+
+/* TIM3->CR1 as last written */
+static uint32_t tim3_cr1 = 0;
+
+/* Commanded effort magnitudes, reapplied when the period changes */
+static uint16_t left_effort = 0;
+static uint16_t right_effort = 0;
+
 /* ================ Private Functions ================ */
 
 /**
@@ -51,6 +75,87 @@ static uint16_t abs_speed(int16_t speed) {
   return (speed < 0) ? (uint16_t)(-speed) : (uint16_t)speed;
 }
 
+/**
+ * @brief  BSRR word driving one H-bridge's IN1/IN2 for a speed sign
+ */
+static uint32_t direction_bits(int16_t speed, uint32_t in1, uint32_t in2) {
+  if (speed > 0)
+    return in1 | (in2 << 16); /* Forward: IN1=HIGH, IN2=LOW */
+  if (speed < 0)
+    return in2 | (in1 << 16); /* Reverse: IN1=LOW, IN2=HIGH */
+  return (in1 | in2) << 16;   /* Stop: IN1=LOW, IN2=LOW (brake) */
+}
+
+/**
+ * @brief  Load both compares for the same update event
+ * @note   Without UDIS an update between the two writes would start one
+ *         period with the new CCR1 and the old CCR2
+ */
+static void load_compares(uint32_t ccr1, uint32_t ccr2) {
+  WRITE_REG(TIM3->CR1, tim3_cr1 | TIM_CR1_UDIS);
+  WRITE_REG(TIM3->CCR1, ccr1);
+  WRITE_REG(TIM3->CCR2, ccr2);
+  WRITE_REG(TIM3->CR1, tim3_cr1);
+}
+
+/**
+ * @brief  Set both bridges: pins and compares back to back
+ */
+static void apply_both(uint32_t left_bsrr, uint32_t right_bsrr, uint32_t ccr1,
+                       uint32_t ccr2) {
+  /* No interrupt between the pins and the compares */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  WRITE_REG(TIM3->CR1, tim3_cr1 | TIM_CR1_UDIS);
+  WRITE_REG(TIM3->CCR1, ccr1);
+  WRITE_REG(TIM3->CCR2, ccr2);
+  WRITE_REG(LEFT_PORT->BSRR, left_bsrr);
+  WRITE_REG(RIGHT_PORT->BSRR, right_bsrr);
+  WRITE_REG(TIM3->CR1, tim3_cr1);
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Scale the compensation table to the current period
+ */
+static void scale_compensation(void) {
+  for (uint32_t i = 0; i < MOTOR_COMP_POINTS; i++)
+    comp_counts[i] = (uint16_t)(((uint32_t)comp_duty[i] * pwm_arr + 500U) /
+                                (uint32_t)MOTOR_MAX_SPEED);
+}
+
+/**
+ * @brief  Compare value for an effort magnitude (0-1000)
+ */
+static uint32_t effort_to_compare(uint16_t effort) {
+  if (effort == 0)
+    return 0;
+
+  uint32_t i = effort / MOTOR_COMP_STEP;
+  if (i >= MOTOR_COMP_POINTS - 1U)
+    return (comp_counts[MOTOR_COMP_POINTS - 1U] >= pwm_arr)
+               ? (uint32_t)pwm_arr + 1U /* Above ARR: never drops */
+               : comp_counts[MOTOR_COMP_POINTS - 1U];
+
+  uint32_t frac = effort % MOTOR_COMP_STEP;
+  uint32_t low = comp_counts[i];
+  uint32_t high = comp_counts[i + 1U];
+  return low + ((high - low) * frac + MOTOR_COMP_STEP / 2U) / MOTOR_COMP_STEP;
+}
+
+/**
+ * @brief  Split a frequency into a prescaler and a center-aligned ARR
+ * @retval ARR, with the prescaler in *psc
+ */
+static uint32_t period_for(uint32_t hz, uint32_t *psc) {
+  /* Center-aligned: one period is 2 * ARR counts */
+  uint32_t ticks = SYSTEM_CLOCK_HZ / (2U * hz);
+
+  /* Smallest prescaler (finest duty step) whose ARR fits */
+  *psc = ticks / (MOTOR_ARR_MAX + 1U);
+  return ticks / (*psc + 1U);
+}
+
 /* ================ Public Functions ================ */
 
 /**
@@ -78,40 +183,37 @@ void Motor_Init(void) {
   MODIFY_REG(GPIOB->CRL, 0x000000FF, (0x2 << 0) | (0x2 << 4));
 
   /* Initialize all direction pins low (motors stopped) */
-  CLEAR_BIT(LEFT_PORT->ODR, LEFT_IN1_PIN | LEFT_IN2_PIN);
-  CLEAR_BIT(RIGHT_PORT->ODR, RIGHT_IN1_PIN | RIGHT_IN2_PIN);
+  WRITE_REG(LEFT_PORT->BRR, LEFT_IN1_PIN | LEFT_IN2_PIN);
+  WRITE_REG(RIGHT_PORT->BRR, RIGHT_IN1_PIN | RIGHT_IN2_PIN);
 
-  /* Disable timer during configuration */
-  CLEAR_BIT(TIM3->CR1, TIM_CR1_CEN);
+  /* Disable timer during configuration (CMS only changes while stopped);
+   * center-aligned mode 1, preloaded ARR */
+  tim3_cr1 = TIM_CR1_CMS_0 | TIM_CR1_ARPE;
+  WRITE_REG(TIM3->CR1, tim3_cr1);
 
-  /* Set prescaler for 1kHz PWM at 72MHz */
-  /* 72MHz / 72 / 1000 = 1kHz */
-  WRITE_REG(TIM3->PSC, 71);
-  WRITE_REG(TIM3->ARR, MOTOR_PWM_PERIOD - 1);
-
-  /* Configure TIM3_CH1 (PA6) in PWM Mode 1 */
+  /* Configure TIM3_CH1 (PA6) in PWM Mode 1, preloaded CCR1 */
   MODIFY_REG(TIM3->CCMR1, TIM_CCMR1_OC1M | TIM_CCMR1_OC1PE,
              TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE);
 
-  /* Configure TIM3_CH2 (PA7) in PWM Mode 1 */
+  /* Configure TIM3_CH2 (PA7) in PWM Mode 1, preloaded CCR2 */
   MODIFY_REG(TIM3->CCMR1, TIM_CCMR1_OC2M | TIM_CCMR1_OC2PE,
              TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2PE);
 
   /* Enable CH1 and CH2 outputs */
   SET_BIT(TIM3->CCER, TIM_CCER_CC1E | TIM_CCER_CC2E);
 
-  /* Initialize duty cycles to 0 */
-  WRITE_REG(TIM3->CCR1, 0);
-  WRITE_REG(TIM3->CCR2, 0);
+  /* Period, compensation and zero duty */
+  left_effort = 0;
+  right_effort = 0;
+  Motor_SetDeadband(MOTOR_DEADBAND);
+  Motor_SetFrequency(MOTOR_PWM_HZ);
 
   /* Generate update event to load registers */
   SET_BIT(TIM3->EGR, TIM_EGR_UG);
 
-  /* Enable auto-reload preload */
-  SET_BIT(TIM3->CR1, TIM_CR1_ARPE);
-
   /* Enable timer */
-  SET_BIT(TIM3->CR1, TIM_CR1_CEN);
+  tim3_cr1 |= TIM_CR1_CEN;
+  WRITE_REG(TIM3->CR1, tim3_cr1);
 }
 
 /**
@@ -119,22 +221,11 @@ void Motor_Init(void) {
  */
 void Motor_SetLeft(int16_t speed) {
   speed = clamp_speed(speed);
+  left_effort = abs_speed(speed);
 
-  if (speed > 0) {
-    /* Forward: IN1=HIGH, IN2=LOW */
-    SET_BIT(LEFT_PORT->ODR, LEFT_IN1_PIN);
-    CLEAR_BIT(LEFT_PORT->ODR, LEFT_IN2_PIN);
-  } else if (speed < 0) {
-    /* Reverse: IN1=LOW, IN2=HIGH */
-    CLEAR_BIT(LEFT_PORT->ODR, LEFT_IN1_PIN);
-    SET_BIT(LEFT_PORT->ODR, LEFT_IN2_PIN);
-  } else {
-    /* Stop: IN1=LOW, IN2=LOW (brake) */
-    CLEAR_BIT(LEFT_PORT->ODR, LEFT_IN1_PIN | LEFT_IN2_PIN);
-  }
-
-  /* Set PWM duty cycle */
-  WRITE_REG(TIM3->CCR1, abs_speed(speed));
+  WRITE_REG(LEFT_PORT->BSRR,
+            direction_bits(speed, LEFT_IN1_PIN, LEFT_IN2_PIN));
+  WRITE_REG(TIM3->CCR1, effort_to_compare(left_effort));
 }
 
 /**
@@ -142,54 +233,122 @@ void Motor_SetLeft(int16_t speed) {
  */
 void Motor_SetRight(int16_t speed) {
   speed = clamp_speed(speed);
+  right_effort = abs_speed(speed);
 
-  if (speed > 0) {
-    /* Forward: IN1=HIGH, IN2=LOW */
-    SET_BIT(RIGHT_PORT->ODR, RIGHT_IN1_PIN);
-    CLEAR_BIT(RIGHT_PORT->ODR, RIGHT_IN2_PIN);
-  } else if (speed < 0) {
-    /* Reverse: IN1=LOW, IN2=HIGH */
-    CLEAR_BIT(RIGHT_PORT->ODR, RIGHT_IN1_PIN);
-    SET_BIT(RIGHT_PORT->ODR, RIGHT_IN2_PIN);
-  } else {
-    /* Stop: IN1=LOW, IN2=LOW (brake) */
-    CLEAR_BIT(RIGHT_PORT->ODR, RIGHT_IN1_PIN | RIGHT_IN2_PIN);
-  }
-
-  /* Set PWM duty cycle */
-  WRITE_REG(TIM3->CCR2, abs_speed(speed));
+  WRITE_REG(RIGHT_PORT->BSRR,
+            direction_bits(speed, RIGHT_IN1_PIN, RIGHT_IN2_PIN));
+  WRITE_REG(TIM3->CCR2, effort_to_compare(right_effort));
 }
 
 /**
- * @brief  Set both motors
+ * @brief  Set both motors (fast path: everything computed up front, then
+ *         six register writes)
  */
 void Motor_SetBoth(int16_t left_speed, int16_t right_speed) {
-  Motor_SetLeft(left_speed);
-  Motor_SetRight(right_speed);
+  left_speed = clamp_speed(left_speed);
+  right_speed = clamp_speed(right_speed);
+  left_effort = abs_speed(left_speed);
+  right_effort = abs_speed(right_speed);
+
+  apply_both(direction_bits(left_speed, LEFT_IN1_PIN, LEFT_IN2_PIN),
+             direction_bits(right_speed, RIGHT_IN1_PIN, RIGHT_IN2_PIN),
+             effort_to_compare(left_effort), effort_to_compare(right_effort));
 }
 
 /**
  * @brief  Stop both motors (brake)
  */
 void Motor_Stop(void) {
-  /* Set direction pins low */
-  CLEAR_BIT(LEFT_PORT->ODR, LEFT_IN1_PIN | LEFT_IN2_PIN);
-  CLEAR_BIT(RIGHT_PORT->ODR, RIGHT_IN1_PIN | RIGHT_IN2_PIN);
-
-  /* Set PWM to 0 */
-  WRITE_REG(TIM3->CCR1, 0);
-  WRITE_REG(TIM3->CCR2, 0);
+  /* Direction pins low, PWM 0 */
+  left_effort = 0;
+  right_effort = 0;
+  apply_both((LEFT_IN1_PIN | LEFT_IN2_PIN) << 16,
+             (RIGHT_IN1_PIN | RIGHT_IN2_PIN) << 16, 0, 0);
 }
 
 /**
  * @brief  Emergency stop (coast - let motors spin freely)
  */
 void Motor_Coast(void) {
-  /* Set both IN pins high (coast mode) */
-  SET_BIT(LEFT_PORT->ODR, LEFT_IN1_PIN | LEFT_IN2_PIN);
-  SET_BIT(RIGHT_PORT->ODR, RIGHT_IN1_PIN | RIGHT_IN2_PIN);
+  /* Both IN pins high (coast mode); PWM doesn't matter in coast mode */
+  left_effort = 0;
+  right_effort = 0;
+  apply_both(LEFT_IN1_PIN | LEFT_IN2_PIN, RIGHT_IN1_PIN | RIGHT_IN2_PIN, 0,
+             0);
+}
 
-  /* PWM doesn't matter in coast mode */
-  WRITE_REG(TIM3->CCR1, 0);
-  WRITE_REG(TIM3->CCR2, 0);
+/**
+ * @brief  Change the PWM frequency
+ */
+int8_t Motor_SetFrequency(uint32_t hz) {
+  uint32_t psc;
+
+  if (hz < MOTOR_PWM_MIN_HZ || hz > MOTOR_PWM_MAX_HZ)
+    return -1;
+
+  uint32_t arr = period_for(hz, &psc);
+  pwm_arr = (uint16_t)arr;
+  pwm_hz = SYSTEM_CLOCK_HZ / (2U * (psc + 1U) * arr);
+  scale_compensation();
+
+  /* Hold the update event so PSC, ARR and both compares latch together */
+  WRITE_REG(TIM3->CR1, tim3_cr1 | TIM_CR1_UDIS);
+  WRITE_REG(TIM3->PSC, psc);
+  WRITE_REG(TIM3->ARR, arr);
+  load_compares(effort_to_compare(left_effort),
+                effort_to_compare(right_effort));
+  return 0;
+}
+
+/**
+ * @brief  Get the PWM frequency
+ */
+uint32_t Motor_GetFrequency(void) { return pwm_hz; }
+
+/**
+ * @brief  Get the PWM resolution
+ */
+uint16_t Motor_GetResolution(void) { return pwm_arr; }
+
+/**
+ * @brief  Load an effort-to-duty compensation table
+ */
+int8_t Motor_SetCompensation(const uint16_t duty[MOTOR_COMP_POINTS]) {
+  for (uint32_t i = 0; i < MOTOR_COMP_POINTS; i++) {
+    if (duty[i] > MOTOR_MAX_SPEED || (i > 0 && duty[i] < duty[i - 1U]))
+      return -1;
+  }
+
+  for (uint32_t i = 0; i < MOTOR_COMP_POINTS; i++)
+    comp_duty[i] = duty[i];
+  scale_compensation();
+
+  load_compares(effort_to_compare(left_effort),
+                effort_to_compare(right_effort));
+  return 0;
+}
+
+/**
+ * @brief  Load a linear table from a deadband to full duty
+ */
+int8_t Motor_SetDeadband(uint16_t deadband) {
+  uint16_t duty[MOTOR_COMP_POINTS];
+
+  if (deadband >= MOTOR_MAX_SPEED)
+    return -1;
+
+  for (uint32_t i = 0; i < MOTOR_COMP_POINTS; i++)
+    duty[i] = (uint16_t)(deadband + ((uint32_t)(MOTOR_MAX_SPEED - deadband) *
+                                         i +
+                                     (MOTOR_COMP_POINTS - 1U) / 2U) /
+                                        (MOTOR_COMP_POINTS - 1U));
+  return Motor_SetCompensation(duty);
+}
+
+/**
+ * @brief  Get the compensation table
+ */
+void Motor_GetCompensation(uint16_t duty[MOTOR_COMP_POINTS]) {
+  for (uint32_t i = 0; i < MOTOR_COMP_POINTS; i++)
+    duty[i] = comp_duty[i];
 }
@@ -0,0 +1,269 @@
+/**
+ ******************************************************************************
+ * @file    odometry.c
+ * @brief   Wheel odometry: pose (x, y, theta) from encoders and IMU yaw
+ ******************************************************************************
+ *
+ * Odometry_Update() runs from DifferentialDrive_Update() in the control
+ * loop interrupt; the getters and resets take a PRIMASK snapshot.
+ *
+ ******************************************************************************
+ */
+
+#include "odometry.h"
+#include "attitude.h"
+#include "encoder.h"
+#include "imu.h"
+#include "main.h"
+#include "trace.h"
+
+/* ================ Private Defines ================ */
+
+#define PI_F 3.14159265f
+
+/* Binary angle: 2^32 = one turn */
+#define ANGLE_PER_DEGREE 11930464.71f
+#define DEGREES_PER_ANGLE (360.0f / 4294967296.0f)
+#define ANGLE_PER_RAD 683565275.6f
+
+/* Q30 sine table: 256 intervals per quadrant */
+#define SIN_TABLE_BITS 8
+
+/* pi^2 / 24 in Q30: arc to chord factor 1 - dtheta^2 / 24 */
+#define CHORD_K 441558626
+
+/* Fractional bits of distances: per step Q8, accumulated Q16 (micrometres) */
+#define STEP_FRAC_BITS 8
+#define POSE_FRAC_BITS 16
+
+/* ================ Private Variables ================ */
+
+/* sin(i * pi / 512) in Q30 for i = 0..256 */
+static const q30_t sin_table[(1U << SIN_TABLE_BITS) + 1] = {
+    0, 6588356, 13176464, 19764076, 26350943, 32936819,
+    39521455, 46104602, 52686014, 59265442, 65842639, 72417357,
+    78989349, 85558366, 92124163, 98686491, 105245103, 111799753,
+    118350194, 124896179, 131437462, 137973796, 144504935, 151030634,
+    157550647, 164064728, 170572633, 177074115, 183568930, 190056834,
+    196537583, 203010932, 209476638, 215934457, 222384147, 228825464,
+    235258165, 241682010, 248096755, 254502159, 260897982, 267283981,
+    273659918, 280025552, 286380643, 292724951, 299058239, 305380268,
+    311690799, 317989595, 324276419, 330551034, 336813204, 343062693,
+    349299266, 355522689, 361732726, 367929144, 374111709, 380280190,
+    386434353, 392573967, 398698801, 404808624, 410903207, 416982319,
+    423045732, 429093217, 435124548, 441139496, 447137835, 453119340,
+    459083786, 465030947, 470960600, 476872522, 482766489, 488642281,
+    494499676, 500338453, 506158392, 511959275, 517740883, 523502998,
+    529245404, 534967884, 540670223, 546352205, 552013618, 557654248,
+    563273883, 568872310, 574449320, 580004702, 585538248, 591049748,
+    596538995, 602005783, 607449906, 612871159, 618269338, 623644239,
+    628995660, 634323400, 639627258, 644907034, 650162530, 655393548,
+    660599890, 665781362, 670937767, 676068911, 681174602, 686254647,
+    691308855, 696337036, 701339000, 706314559, 711263525, 716185713,
+    721080937, 725949013, 730789757, 735602987, 740388522, 745146182,
+    749875788, 754577161, 759250125, 763894504, 768510122, 773096806,
+    777654384, 782182683, 786681534, 791150767, 795590213, 799999706,
+    804379079, 808728167, 813046808, 817334838, 821592095, 825818421,
+    830013654, 834177638, 838310216, 842411232, 846480531, 850517961,
+    854523370, 858496606, 862437520, 866345964, 870221790, 874064853,
+    877875009, 881652112, 885396022, 889106597, 892783698, 896427186,
+    900036924, 903612776, 907154608, 910662286, 914135678, 917574653,
+    920979082, 924348837, 927683790, 930983817, 934248793, 937478595,
+    940673101, 943832191, 946955747, 950043650, 953095785, 956112036,
+    959092290, 962036435, 964944360, 967815955, 970651112, 973449725,
+    976211688, 978936898, 981625251, 984276646, 986890984, 989468165,
+    992008094, 994510675, 996975812, 999403415, 1001793390, 1004145648,
+    1006460100, 1008736660, 1010975242, 1013175761, 1015338134, 1017462281,
+    1019548121, 1021595575, 1023604567, 1025575020, 1027506862, 1029400018,
+    1031254418, 1033069992, 1034846671, 1036584389, 1038283080, 1039942680,
+    1041563127, 1043144360, 1044686319, 1046188946, 1047652185, 1049075980,
+    1050460278, 1051805027, 1053110176, 1054375676, 1055601479, 1056787540,
+    1057933813, 1059040255, 1060106826, 1061133483, 1062120190, 1063066909,
+    1063973603, 1064840240, 1065666786, 1066453210, 1067199483, 1067905576,
+    1068571464, 1069197120, 1069782521, 1070327646, 1070832474, 1071296985,
+    1071721163, 1072104991, 1072448455, 1072751542, 1073014240, 1073236540,
+    1073418433, 1073559913, 1073660973, 1073721611, 1073741824,
+};
+
+static Odometry_Heading_t heading_source = ODOMETRY_HEADING;
+static float track_width_mm = ODOMETRY_TRACK_WIDTH_MM;
+
+/* Constants folded from the geometry */
+static int32_t step_per_count;  /* Half a count in Q16 um (for dL + dR) */
+static int32_t angle_per_count; /* Heading per count of dR - dL */
+
+/* Pose */
+static int64_t pose_x; /* Q16 um */
+static int64_t pose_y;
+static uint32_t pose_theta; /* Binary angle */
+
+/* Previous IMU heading (binary angle) */
+static uint32_t yaw_prev;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Sine of a binary angle (Q30)
+ */
+static q30_t Sin(uint32_t angle) {
+  uint32_t offset = angle & 0x3FFFFFFFU;
+
+  /* Second and fourth quadrants run the table backwards */
+  if (angle & 0x40000000U)
+    offset = 0x3FFFFFFFU - offset;
+
+  uint32_t index = offset >> (30 - SIN_TABLE_BITS);
+  int32_t frac = (int32_t)((offset >> (14 - SIN_TABLE_BITS)) & 0xFFFFU);
+  q30_t lo = sin_table[index];
+  q30_t value =
+      lo + (int32_t)(((int64_t)(sin_table[index + 1] - lo) * frac) >> 16);
+
+  return (angle & 0x80000000U) ? -value : value;
+}
+
+/**
+ * @brief  Cosine of a binary angle (Q30)
+ */
+static inline q30_t Cos(uint32_t angle) { return Sin(angle + 0x40000000U); }
+
+/**
+ * @brief  Degrees to binary angle (any range wraps)
+ */
+static inline uint32_t DegreesToAngle(float degrees) {
+  return (uint32_t)(int64_t)(degrees * ANGLE_PER_DEGREE);
+}
+
+/**
+ * @brief  Fold the geometry into per-count constants
+ */
+static void UpdateConstants(void) {
+  float count_um = PI_F * (float)WHEEL_DIAMETER_MM * 1000.0f / ENCODER_CPR;
+
+  step_per_count = (int32_t)(count_um * 0.5f * 65536.0f + 0.5f);
+  angle_per_count =
+      (int32_t)(count_um / (track_width_mm * 1000.0f) * ANGLE_PER_RAD + 0.5f);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Initialize odometry
+ */
+void Odometry_Init(void) {
+  heading_source = ODOMETRY_HEADING;
+  track_width_mm = ODOMETRY_TRACK_WIDTH_MM;
+  UpdateConstants();
+  Odometry_Reset();
+}
+
+/**
+ * @brief  Set the track width
+ */
+void Odometry_SetTrackWidth(float track_mm) {
+  if (track_mm <= 0.0f)
+    return;
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  track_width_mm = track_mm;
+  UpdateConstants();
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the track width
+ */
+float Odometry_GetTrackWidth(void) { return track_width_mm; }
+
+/**
+ * @brief  Select the heading source
+ */
+void Odometry_SetHeadingSource(Odometry_Heading_t source) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  heading_source = source;
+  yaw_prev = DegreesToAngle(IMU_GetHeading());
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Get the heading source
+ */
+Odometry_Heading_t Odometry_GetHeadingSource(void) { return heading_source; }
+
+/**
+ * @brief  Set the pose to zero
+ */
+void Odometry_Reset(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  pose_x = 0;
+  pose_y = 0;
+  pose_theta = 0;
+  yaw_prev = 0;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  IMU heading reset to zero: measure the next yaw change from zero
+ */
+void Odometry_ResetYawReference(void) { yaw_prev = 0; }
+
+/**
+ * @brief  Integrate one control tick
+ */
+void Odometry_Update(void) {
+  TRACE_ENTER(TRACE_ID_ODOMETRY_UPDATE);
+
+  int32_t left_delta, right_delta;
+  Encoder_GetDelta(&left_delta, &right_delta);
+  Odometry_Step(left_delta, right_delta, IMU_GetHeading());
+
+  TRACE_EXIT(TRACE_ID_ODOMETRY_UPDATE);
+}
+
+/**
+ * @brief  Integrate one step
+ */
+void Odometry_Step(int32_t left_delta, int32_t right_delta, float yaw_deg) {
+  int32_t dtheta;
+
+  if (heading_source == ODOMETRY_HEADING_IMU) {
+    uint32_t yaw = DegreesToAngle(yaw_deg);
+    dtheta = (int32_t)(yaw - yaw_prev);
+    yaw_prev = yaw;
+  } else {
+    dtheta = (int32_t)((int64_t)(right_delta - left_delta) * angle_per_count);
+  }
+
+  /* Travel along the arc (Q8 um) */
+  int64_t step = ((int64_t)(left_delta + right_delta) * step_per_count) >>
+                 (POSE_FRAC_BITS - STEP_FRAC_BITS);
+
+  /* Chord of the arc, along the mid-step heading */
+  uint32_t sq = (uint32_t)(((int64_t)dtheta * dtheta) >> 32);
+  q30_t chord = Q30_ONE - (int32_t)(((uint64_t)sq * CHORD_K) >> 30);
+  uint32_t mid = pose_theta + (uint32_t)(dtheta >> 1);
+  q30_t dx = (q30_t)(((int64_t)chord * Cos(mid)) >> Q30_SHIFT);
+  q30_t dy = (q30_t)(((int64_t)chord * Sin(mid)) >> Q30_SHIFT);
+
+  pose_x += (step * dx) >> (30 - (POSE_FRAC_BITS - STEP_FRAC_BITS));
+  pose_y += (step * dy) >> (30 - (POSE_FRAC_BITS - STEP_FRAC_BITS));
+  pose_theta += (uint32_t)dtheta;
+}
+
+/**
+ * @brief  Get the current pose
+ */
+void Odometry_GetPose(Odometry_Pose_t *pose) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  int64_t x = pose_x;
+  int64_t y = pose_y;
+  uint32_t theta = pose_theta;
+  __set_PRIMASK(primask);
+
+  pose->x = (float)x * (1.0f / (65536.0f * 1000.0f));
+  pose->y = (float)y * (1.0f / (65536.0f * 1000.0f));
+  pose->theta = (float)(int32_t)theta * DEGREES_PER_ANGLE;
+}
@@ -0,0 +1,643 @@
+/**
+ ******************************************************************************
+ * @file    param_server.c
+ * @brief   Live parameter get/set over USART3 RX with a circular DMA ring
+ ******************************************************************************
+ *
+ * The DMA writes the ring forever; the main loop owns a tail (start of the
+ * line being assembled) and a scan position, both free-running byte counts.
+ * The DMA interrupt counts completed half rings, which with CNDTR gives the
+ * free-running head, so an overwritten line is detected rather than parsed;
+ * parsing then resyncs at the next '\n' in the part of the ring still
+ * intact, so only the lines the DMA overwrote are lost.
+ *
+ * Lines are parsed through a cursor over the ring, so a line wrapping past
+ * the end is read in place like any other.
+ *
+ ******************************************************************************
+ */
+
+#include "param_server.h"
+#include "control_loop.h"
+#include "differential_drive.h"
+#include "main.h"
+#include "settings.h"
+
+/* ================ Private Defines ================ */
+
+#define RX_MASK (PARAM_SERVER_RX_SIZE - 1U)
+#define RX_HALF (PARAM_SERVER_RX_SIZE / 2U)
+
+/* USART3 is on APB1 (SYSCLK / 2) */
+#define PARAM_UART_CLOCK_HZ (SYSTEM_CLOCK_HZ / 2U)
+
+/* Significant digits kept when parsing a number */
+#define NUMBER_MAX_MANTISSA 99999999U
+
+/* ================ Private Types ================ */
+
+typedef enum {
+  PARAM_SPEED_KP = 0,
+  PARAM_SPEED_KI,
+  PARAM_SPEED_KD,
+  PARAM_HEADING_KP,
+  PARAM_HEADING_KI,
+  PARAM_HEADING_KD,
+  PARAM_SPEED_ILIMIT,
+  PARAM_HEADING_ILIMIT,
+  PARAM_TARGET_SPEED,
+  PARAM_LOOP_HZ,
+  PARAM_COUNT
+} ParamId_t;
+
+typedef struct {
+  const char *name;
+  float min;
+  float max;
+  uint8_t integer; /* Whole numbers only */
+} Param_t;
+
+/* Characters [pos, end) of a ring, both free-running */
+typedef struct {
+  const uint8_t *ring;
+  uint32_t mask;
+  uint32_t pos;
+  uint32_t end;
+} Cursor_t;
+
+typedef struct {
+  ParamId_t id;
+  float value;
+} Assignment_t;
+
+/* ================ Private Variables ================ */
+
+static const Param_t params[PARAM_COUNT] = {
+    [PARAM_SPEED_KP] = {"speed.kp", 0.0f, 1000.0f, 0},
+    [PARAM_SPEED_KI] = {"speed.ki", 0.0f, 1000.0f, 0},
+    [PARAM_SPEED_KD] = {"speed.kd", 0.0f, 1000.0f, 0},
+    [PARAM_HEADING_KP] = {"heading.kp", 0.0f, 1000.0f, 0},
+    [PARAM_HEADING_KI] = {"heading.ki", 0.0f, 1000.0f, 0},
+    [PARAM_HEADING_KD] = {"heading.kd", 0.0f, 1000.0f, 0},
+    [PARAM_SPEED_ILIMIT] = {"speed.ilimit", 0.0f, 1000.0f, 0},
+    [PARAM_HEADING_ILIMIT] = {"heading.ilimit", 0.0f, 1000.0f, 0},
+    [PARAM_TARGET_SPEED] = {"target_speed", -5000.0f, 5000.0f, 0},
+    [PARAM_LOOP_HZ] = {"loop_hz", (float)CONTROL_LOOP_MIN_HZ,
+                       (float)CONTROL_LOOP_MAX_HZ, 1},
+};
+
+static uint8_t rx_ring[PARAM_SERVER_RX_SIZE];
+static volatile uint32_t rx_halves = 0; /* Half rings completed by the DMA */
+static uint32_t rx_tail = 0;            /* Start of the current line */
+static uint32_t rx_scan = 0;            /* Next byte to look at */
+static uint8_t discarding = 0;          /* Skipping to the next '\n' */
+
+static ParamServer_Reply_t reply_sink = 0;
+static ParamServer_Stats_t stats;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Current character, or -1 at the end
+ */
+static int32_t Peek(const Cursor_t *c) {
+  return (c->pos != c->end) ? (int32_t)c->ring[c->pos & c->mask] : -1;
+}
+
+static uint8_t IsSpace(int32_t ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+static void SkipSpaces(Cursor_t *c) {
+  while (IsSpace(Peek(c)))
+    c->pos++;
+}
+
+/**
+ * @brief  Next space-separated token
+ * @retval 0 if none is left
+ */
+static uint8_t NextToken(Cursor_t *c, Cursor_t *token) {
+  SkipSpaces(c);
+  *token = *c;
+  while (Peek(c) >= 0 && !IsSpace(Peek(c)))
+    c->pos++;
+  token->end = c->pos;
+  return token->pos != token->end;
+}
+
+/**
+ * @brief  Compare a token with a terminated string
+ */
+static uint8_t TokenEquals(const Cursor_t *token, const char *text) {
+  Cursor_t c = *token;
+  while (*text != '\0') {
+    if (Peek(&c) != (uint8_t)*text)
+      return 0;
+    c.pos++;
+    text++;
+  }
+  return c.pos == c.end;
+}
+
+/**
+ * @brief  Look a name up in the registry
+ * @retval Parameter id, or PARAM_COUNT if unknown
+ */
+static ParamId_t FindParam(const Cursor_t *token) {
+  for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+    if (TokenEquals(token, params[i].name))
+      return (ParamId_t)i;
+  }
+  return PARAM_COUNT;
+}
+
+/**
+ * @brief  Parse a whole token as a decimal number ([-+]digits[.digits])
+ * @retval 0 on success, -1 if malformed
+ */
+static int8_t ParseNumber(Cursor_t token, float *value, uint8_t *integer) {
+  uint32_t mantissa = 0;
+  int32_t exponent = 0; /* Powers of ten applied to the mantissa */
+  uint8_t digits = 0;
+  uint8_t negative = 0;
+  uint8_t point = 0;
+
+  if (Peek(&token) == '-' || Peek(&token) == '+') {
+    negative = (Peek(&token) == '-');
+    token.pos++;
+  }
+
+  for (int32_t ch = Peek(&token); ch >= 0; token.pos++, ch = Peek(&token)) {
+    if (ch == '.' && !point) {
+      point = 1;
+      continue;
+    }
+    if (ch < '0' || ch > '9')
+      return -1;
+
+    digits++;
+    if (mantissa <= NUMBER_MAX_MANTISSA / 10U) {
+      mantissa = mantissa * 10U + (uint32_t)(ch - '0');
+      if (point)
+        exponent--;
+    } else if (!point) {
+      exponent++; /* Integer digit beyond the precision kept */
+    }
+  }
+  if (digits == 0)
+    return -1;
+
+  float result = (float)mantissa;
+  for (; exponent > 0; exponent--)
+    result *= 10.0f;
+  for (; exponent < 0; exponent++)
+    result /= 10.0f;
+
+  *value = negative ? -result : result;
+  *integer = !point;
+  return 0;
+}
+
+/**
+ * @brief  Append text to a reply, truncating at PARAM_SERVER_REPLY_MAX
+ */
+static void Append(char *reply, uint32_t *length, const char *text) {
+  while (*text != '\0' && *length < PARAM_SERVER_REPLY_MAX)
+    reply[(*length)++] = *text++;
+}
+
+/**
+ * @brief  Append a number with up to 6 decimals, trailing zeros dropped
+ */
+static void AppendNumber(char *reply, uint32_t *length, float value) {
+  char text[24];
+  char *p = text + sizeof(text);
+  *--p = '\0';
+
+  uint8_t negative = (value < 0.0f);
+  if (negative)
+    value = -value;
+
+  uint32_t whole = (uint32_t)value;
+  uint32_t fraction = (uint32_t)((value - (float)whole) * 1e6f + 0.5f);
+  if (fraction >= 1000000U) {
+    whole++;
+    fraction -= 1000000U;
+  }
+
+  if (fraction != 0) {
+    uint8_t significant = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+      uint32_t digit = fraction % 10U;
+      fraction /= 10U;
+      if (digit != 0)
+        significant = 1;
+      if (significant)
+        *--p = (char)('0' + digit);
+    }
+    *--p = '.';
+  }
+  do {
+    *--p = (char)('0' + whole % 10U);
+    whole /= 10U;
+  } while (whole != 0);
+  if (negative)
+    *--p = '-';
+
+  Append(reply, length, p);
+}
+
+/**
+ * @brief  Current value of a parameter
+ */
+static float GetValue(ParamId_t id) {
+  float values[3];
+
+  switch (id) {
+  case PARAM_SPEED_KP:
+  case PARAM_SPEED_KI:
+  case PARAM_SPEED_KD:
+    DifferentialDrive_GetSpeedPID(values);
+    return values[id - PARAM_SPEED_KP];
+  case PARAM_HEADING_KP:
+  case PARAM_HEADING_KI:
+  case PARAM_HEADING_KD:
+    DifferentialDrive_GetHeadingPID(values);
+    return values[id - PARAM_HEADING_KP];
+  case PARAM_SPEED_ILIMIT:
+  case PARAM_HEADING_ILIMIT:
+    DifferentialDrive_GetIntegralLimits(values);
+    return values[id - PARAM_SPEED_ILIMIT];
+  case PARAM_TARGET_SPEED:
+    return DifferentialDrive_GetTargetSpeed();
+  case PARAM_LOOP_HZ:
+    return (float)ControlLoop_GetRate();
+  default:
+    return 0.0f;
+  }
+}
+
+/**
+ * @brief  Apply one checked value (interrupts masked)
+ */
+static void SetValue(ParamId_t id, float value) {
+  float values[3];
+
+  switch (id) {
+  case PARAM_SPEED_KP:
+  case PARAM_SPEED_KI:
+  case PARAM_SPEED_KD:
+    DifferentialDrive_GetSpeedPID(values);
+    values[id - PARAM_SPEED_KP] = value;
+    DifferentialDrive_SetSpeedPID(values[0], values[1], values[2]);
+    break;
+  case PARAM_HEADING_KP:
+  case PARAM_HEADING_KI:
+  case PARAM_HEADING_KD:
+    DifferentialDrive_GetHeadingPID(values);
+    values[id - PARAM_HEADING_KP] = value;
+    DifferentialDrive_SetHeadingPID(values[0], values[1], values[2]);
+    break;
+  case PARAM_SPEED_ILIMIT:
+  case PARAM_HEADING_ILIMIT:
+    DifferentialDrive_GetIntegralLimits(values);
+    values[id - PARAM_SPEED_ILIMIT] = value;
+    DifferentialDrive_SetIntegralLimits(values[0], values[1]);
+    break;
+  case PARAM_TARGET_SPEED:
+    DifferentialDrive_SetSpeed(value);
+    break;
+  case PARAM_LOOP_HZ:
+    ControlLoop_SetRate((uint32_t)value);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief  get NAME
+ */
+static int8_t ExecuteGet(Cursor_t *c, char *reply, uint32_t *length) {
+  Cursor_t name, extra;
+
+  if (!NextToken(c, &name) || NextToken(c, &extra)) {
+    Append(reply, length, "err usage: get NAME");
+    return -1;
+  }
+
+  ParamId_t id = FindParam(&name);
+  if (id == PARAM_COUNT) {
+    Append(reply, length, "err unknown name");
+    return -1;
+  }
+
+  Append(reply, length, params[id].name);
+  Append(reply, length, "=");
+  AppendNumber(reply, length, GetValue(id));
+  return 0;
+}
+
+#if SETTINGS_ENABLE
+/**
+ * @brief  save: store the live parameters in flash
+ */
+static int8_t ExecuteSave(Cursor_t *c, char *reply, uint32_t *length) {
+  Cursor_t extra;
+
+  if (NextToken(c, &extra)) {
+    Append(reply, length, "err usage: save");
+    return -1;
+  }
+
+  /* Flash writes stall the control interrupt */
+  if (DifferentialDrive_GetState() != DRIVE_STATE_STOPPED) {
+    Append(reply, length, "err drive running");
+    return -1;
+  }
+  if (Settings_Store() != 0) {
+    Append(reply, length, "err flash");
+    return -1;
+  }
+
+  Append(reply, length, "ok");
+  return 0;
+}
+#endif
+
+/**
+ * @brief  set NAME=VALUE [NAME=VALUE ...]: check everything, then apply
+ */
+static int8_t ExecuteSet(Cursor_t *c, char *reply, uint32_t *length) {
+  Assignment_t sets[PARAM_SERVER_MAX_SETS];
+  uint8_t count = 0;
+  Cursor_t pair;
+
+  while (NextToken(c, &pair)) {
+    if (count == PARAM_SERVER_MAX_SETS) {
+      Append(reply, length, "err too many values");
+      return -1;
+    }
+
+    /* Split at '=' */
+    Cursor_t name = pair;
+    while (Peek(&name) >= 0 && Peek(&name) != '=')
+      name.pos++;
+    if (Peek(&name) != '=') {
+      Append(reply, length, "err usage: set NAME=VALUE");
+      return -1;
+    }
+    Cursor_t number = pair;
+    number.pos = name.pos + 1U;
+    name.end = name.pos;
+    name.pos = pair.pos;
+
+    ParamId_t id = FindParam(&name);
+    if (id == PARAM_COUNT) {
+      Append(reply, length, "err unknown name");
+      return -1;
+    }
+
+    float value;
+    uint8_t integer;
+    if (ParseNumber(number, &value, &integer) != 0 ||
+        (params[id].integer && !integer)) {
+      Append(reply, length, "err bad value");
+      return -1;
+    }
+    if (!(value >= params[id].min && value <= params[id].max)) {
+      Append(reply, length, "err out of range");
+      return -1;
+    }
+
+    sets[count].id = id;
+    sets[count].value = value;
+    count++;
+  }
+
+  if (count == 0) {
+    Append(reply, length, "err usage: set NAME=VALUE");
+    return -1;
+  }
+
+  /* The control loop is an interrupt: nothing runs between these */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < count; i++)
+    SetValue(sets[i].id, sets[i].value);
+  __set_PRIMASK(primask);
+
+  Append(reply, length, "ok");
+  return 0;
+}
+
+/**
+ * @brief  Free-running count of bytes the DMA has written
+ */
+static uint32_t RxHead(void) {
+  uint32_t halves = rx_halves;
+  uint32_t pos =
+      (PARAM_SERVER_RX_SIZE - READ_REG(DMA1_Channel3->CNDTR)) & RX_MASK;
+
+  /* The DMA crossed a half-ring boundary whose interrupt has not run yet */
+  if ((pos >= RX_HALF) != (halves & 1U))
+    halves++;
+
+  return (halves >> 1) * PARAM_SERVER_RX_SIZE + pos;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Start USART3 reception into the DMA ring
+ */
+void ParamServer_Init(ParamServer_Reply_t reply) {
+  reply_sink = reply;
+  rx_halves = 0;
+  rx_tail = 0;
+  rx_scan = 0;
+  discarding = 0;
+  stats = (ParamServer_Stats_t){0};
+
+  /* Enable clocks */
+  SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPBEN);   /* GPIOB */
+  SET_BIT(RCC->APB1ENR, RCC_APB1ENR_USART3EN); /* USART3 */
+  SET_BIT(RCC->AHBENR, RCC_AHBENR_DMA1EN);     /* DMA1 */
+
+  /* PB11 (RX): input with pull-up, so an open line idles high */
+  MODIFY_REG(GPIOB->CRH, GPIO_CRH_MODE11 | GPIO_CRH_CNF11, GPIO_CRH_CNF11_1);
+  SET_BIT(GPIOB->ODR, GPIO_ODR_ODR11);
+
+  /* DMA1 Channel 3: USART3_DR -> ring, byte-wide, circular, half/full
+   * interrupts */
+  WRITE_REG(DMA1_Channel3->CCR, 0);
+  WRITE_REG(DMA1_Channel3->CPAR, (uint32_t)(uintptr_t)&USART3->DR);
+  WRITE_REG(DMA1_Channel3->CMAR, (uint32_t)(uintptr_t)rx_ring);
+  WRITE_REG(DMA1_Channel3->CNDTR, PARAM_SERVER_RX_SIZE);
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF3);
+  WRITE_REG(DMA1_Channel3->CCR,
+            DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE);
+  SET_BIT(DMA1_Channel3->CCR, DMA_CCR_EN);
+
+  /* USART3: keep the TX stream's setup, add the receiver */
+  if (!READ_BIT(USART3->CR1, USART_CR1_UE)) {
+    WRITE_REG(USART3->BRR,
+              (PARAM_UART_CLOCK_HZ + PARAM_SERVER_UART_BAUD / 2U) /
+                  PARAM_SERVER_UART_BAUD);
+    SET_BIT(USART3->CR1, USART_CR1_UE);
+  }
+  SET_BIT(USART3->CR3, USART_CR3_DMAR);
+  SET_BIT(USART3->CR1, USART_CR1_RE | USART_CR1_IDLEIE);
+
+  NVIC_SetPriority(USART3_IRQn, PARAM_SERVER_IRQ_PRIORITY);
+  NVIC_SetPriority(DMA1_Channel3_IRQn, PARAM_SERVER_IRQ_PRIORITY);
+  NVIC_EnableIRQ(USART3_IRQn);
+  NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+}
+
+/**
+ * @brief  Parse and execute every complete line received so far
+ */
+void ParamServer_Poll(void) {
+  uint32_t head = RxHead();
+
+  /* Bytes not yet scanned have been overwritten: drop the line they were
+   * part of and resync at the next '\n' in the newer half of the ring,
+   * which leaves the DMA half a ring of room while it is parsed */
+  if (head - rx_scan > PARAM_SERVER_RX_SIZE) {
+    stats.overruns++;
+    rx_scan = head - RX_HALF;
+    rx_tail = rx_scan;
+    discarding = (rx_ring[(rx_scan - 1U) & RX_MASK] != '\n');
+  }
+
+  /* Only the scanned start of the current line was overwritten: it has no
+   * '\n' yet and is already longer than the ring */
+  if (head - rx_tail > PARAM_SERVER_RX_SIZE) {
+    if (!discarding)
+      stats.overflows++;
+    discarding = 1;
+    rx_tail = rx_scan;
+  }
+
+  while (rx_scan != head) {
+    uint8_t ch = rx_ring[rx_scan & RX_MASK];
+    rx_scan++;
+
+    if (ch != '\n') {
+      /* A line filling the whole ring can never complete */
+      if (rx_scan - rx_tail >= PARAM_SERVER_RX_SIZE) {
+        if (!discarding)
+          stats.overflows++;
+        discarding = 1;
+        rx_tail = rx_scan;
+      }
+      continue;
+    }
+
+    if (!discarding)
+      ParamServer_Execute(rx_ring, PARAM_SERVER_RX_SIZE, rx_tail,
+                          rx_scan - 1U - rx_tail);
+    discarding = 0;
+    rx_tail = rx_scan;
+  }
+}
+
+/**
+ * @brief  Execute one command line in place
+ */
+int8_t ParamServer_Execute(const uint8_t *ring, uint32_t size, uint32_t start,
+                           uint32_t length) {
+  Cursor_t c = {ring, size - 1U, start, start + length};
+  Cursor_t command;
+  char reply[PARAM_SERVER_REPLY_MAX];
+  uint32_t reply_len = 0;
+  int8_t status;
+
+  /* Blank lines (e.g. "\r\n" keep-alives) get no reply */
+  if (!NextToken(&c, &command))
+    return 0;
+  stats.lines++;
+
+  if (TokenEquals(&command, "get")) {
+    status = ExecuteGet(&c, reply, &reply_len);
+    if (status == 0)
+      stats.gets++;
+  } else if (TokenEquals(&command, "set")) {
+    status = ExecuteSet(&c, reply, &reply_len);
+    if (status == 0)
+      stats.sets++;
+#if SETTINGS_ENABLE
+  } else if (TokenEquals(&command, "save")) {
+    status = ExecuteSave(&c, reply, &reply_len);
+    if (status == 0)
+      stats.saves++;
+#endif
+  } else {
+    Append(reply, &reply_len, "err unknown command");
+    status = -1;
+  }
+  if (status != 0)
+    stats.errors++;
+
+  if (reply_sink && reply_sink(reply, reply_len) != 0)
+    stats.replies_dropped++;
+
+  return status;
+}
+
+/**
+ * @brief  Read a parameter by name
+ */
+int8_t ParamServer_Get(const char *name, float *value) {
+  uint32_t length = 0;
+  while (name[length] != '\0')
+    length++;
+
+  /* Any power of two at least as long as the name works as the ring */
+  uint32_t size = 1;
+  while (size < length)
+    size <<= 1;
+
+  Cursor_t token = {(const uint8_t *)name, size - 1U, 0, length};
+  ParamId_t id = FindParam(&token);
+  if (id == PARAM_COUNT)
+    return -1;
+
+  *value = GetValue(id);
+  return 0;
+}
+
+/**
+ * @brief  Get parameter server statistics
+ */
+void ParamServer_GetStats(ParamServer_Stats_t *out) { *out = stats; }
+
+/* ================ Interrupt Handlers ================ */
+
+/**
+ * @brief  USART3 interrupt handler (line idle)
+ */
+void ParamServer_USART3_Handler(void) {
+  /* Reading SR then DR clears IDLE; waking the main loop is the point */
+  if (READ_BIT(USART3->SR, USART_SR_IDLE))
+    (void)READ_REG(USART3->DR);
+}
+
+/**
+ * @brief  DMA1 channel 3 interrupt handler (ring half/full)
+ */
+void ParamServer_DMA1_Channel3_Handler(void) {
+  uint32_t isr = READ_REG(DMA1->ISR);
+
+  /* Count each boundary once, even if both are pending */
+  if (isr & DMA_ISR_HTIF3) {
+    WRITE_REG(DMA1->IFCR, DMA_IFCR_CHTIF3);
+    rx_halves = rx_halves + 1U;
+  }
+  if (isr & DMA_ISR_TCIF3) {
+    WRITE_REG(DMA1->IFCR, DMA_IFCR_CTCIF3);
+    rx_halves = rx_halves + 1U;
+  }
+}
@@ -20,6 +20,17 @@ static float clamp(float value, float min, float max) {
   return value;
 }
 
+/**
+ * @brief  Clamp 64-bit intermediate to a Q16.16 range
+ */
+static q16_t clamp_q16(int64_t value, q16_t min, q16_t max) {
+  if (value < min)
+    return min;
+  if (value > max)
+    return max;
+  return (q16_t)value;
+}
+
 /* ================ Public Functions ================ */
 
 /**
@@ -31,8 +42,14 @@ void PID_Init(PID_t *pid, float Kp, float Ki, float Kd, float output_min,
   pid->Ki = Ki;
   pid->Kd = Kd;
 
+  pid->Kv = 0.0f;
+  pid->Ks = 0.0f;
+  pid->Ka = 0.0f;
+
   pid->integral = 0.0f;
   pid->prev_measurement = 0.0f;
+  pid->proportional = 0.0f;
+  pid->derivative = 0.0f;
 
   pid->integral_limit = output_max * 0.5f; /* Default: 50% of max output */
   pid->output_min = output_min;
@@ -45,6 +62,14 @@ void PID_Init(PID_t *pid, float Kp, float Ki, float Kd, float output_min,
  *         to reduce "derivative kick" when setpoint changes
  */
 float PID_Compute(PID_t *pid, float setpoint, float measurement, float dt) {
+  return PID_ComputeFF(pid, setpoint, 0.0f, measurement, dt);
+}
+
+/**
+ * @brief  Compute PID output plus feedforward
+ */
+float PID_ComputeFF(PID_t *pid, float setpoint, float setpoint_accel,
+                    float measurement, float dt) {
   if (dt <= 0.0f) {
     return 0.0f;
   }
@@ -66,9 +91,18 @@ float PID_Compute(PID_t *pid, float setpoint, float measurement, float dt) {
   float D = -pid->Kd *
             dmeasurement; /* Negative because we use measurement, not error */
   pid->prev_measurement = measurement;
+  pid->proportional = P;
+  pid->derivative = D;
+
+  /* Feedforward: what the plant needs at this setpoint, without error */
+  float F = pid->Kv * setpoint + pid->Ka * setpoint_accel;
+  if (setpoint > 0.0f)
+    F += pid->Ks;
+  else if (setpoint < 0.0f)
+    F -= pid->Ks;
 
   /* Calculate output */
-  float output = P + I + D;
+  float output = P + I + D + F;
 
   /* Apply output saturation */
   output = clamp(output, pid->output_min, pid->output_max);
@@ -88,6 +122,8 @@ float PID_Compute(PID_t *pid, float setpoint, float measurement, float dt) {
 void PID_Reset(PID_t *pid) {
   pid->integral = 0.0f;
   pid->prev_measurement = 0.0f;
+  pid->proportional = 0.0f;
+  pid->derivative = 0.0f;
 }
 
 /**
@@ -107,3 +143,341 @@ void PID_SetIntegralLimit(PID_t *pid, float limit) {
   /* Clamp existing integral if necessary */
   pid->integral = clamp(pid->integral, -limit, limit);
 }
+
+/**
+ * @brief  Set feedforward gains
+ */
+void PID_SetFeedforward(PID_t *pid, float Kv, float Ks, float Ka) {
+  pid->Kv = Kv;
+  pid->Ks = Ks;
+  pid->Ka = Ka;
+}
+
+/**
+ * @brief  Get the P, I and D terms of the last compute
+ */
+void PID_GetTerms(const PID_t *pid, float terms[3]) {
+  terms[0] = pid->proportional;
+  terms[1] = pid->integral;
+  terms[2] = pid->derivative;
+}
+
+/* ================ Gain Schedule ================ */
+
+/**
+ * @brief  Build a gain schedule
+ */
+int8_t PID_Schedule_Init(PID_Schedule_t *schedule,
+                         const PID_GainPoint_t *points, uint8_t count) {
+  if (count == 0 || count > PID_SCHEDULE_MAX_POINTS)
+    return -1;
+  for (uint8_t i = 1; i < count; i++) {
+    if (!(points[i].point > points[i - 1].point))
+      return -1;
+  }
+
+  schedule->count = count;
+  for (uint8_t i = 0; i < count; i++) {
+    schedule->point[i] = points[i].point;
+    schedule->gains[i][0] = points[i].Kp;
+    schedule->gains[i][1] = points[i].Ki;
+    schedule->gains[i][2] = points[i].Kd;
+  }
+
+  /* Slopes: the only divides, done once */
+  for (uint8_t i = 0; i + 1 < count; i++) {
+    float inv_span = 1.0f / (schedule->point[i + 1] - schedule->point[i]);
+    for (uint8_t k = 0; k < 3; k++)
+      schedule->slope[i][k] =
+          (schedule->gains[i + 1][k] - schedule->gains[i][k]) * inv_span;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief  Interpolate the schedule
+ */
+void PID_Schedule_Interpolate(const PID_Schedule_t *schedule, float point,
+                              float gains[3]) {
+  const uint8_t last = schedule->count - 1;
+
+  /* Outside the table: hold the end gains */
+  if (point <= schedule->point[0] || last == 0) {
+    for (uint8_t k = 0; k < 3; k++)
+      gains[k] = schedule->gains[0][k];
+    return;
+  }
+  if (point >= schedule->point[last]) {
+    for (uint8_t k = 0; k < 3; k++)
+      gains[k] = schedule->gains[last][k];
+    return;
+  }
+
+  /* Segment containing the point (tables are short: linear search) */
+  uint8_t i = 0;
+  while (point >= schedule->point[i + 1])
+    i++;
+
+  float offset = point - schedule->point[i];
+  for (uint8_t k = 0; k < 3; k++)
+    gains[k] = schedule->gains[i][k] + schedule->slope[i][k] * offset;
+}
+
+/**
+ * @brief  Interpolate the schedule and load the gains into a PID
+ * @note   The integral is stored already scaled by Ki, so a changing Ki
+ *         does not bump the output.
+ */
+void PID_ApplySchedule(PID_t *pid, const PID_Schedule_t *schedule,
+                       float point) {
+  float gains[3];
+  PID_Schedule_Interpolate(schedule, point, gains);
+  PID_SetGains(pid, gains[0], gains[1], gains[2]);
+}
+
+/* ================ Batched PID ================ */
+
+/**
+ * @brief  Min/max written as selects (IT blocks on Thumb-2, no branches
+ *         around the arithmetic)
+ */
+static inline float select_max(float a, float b) { return (a > b) ? a : b; }
+static inline float select_min(float a, float b) { return (a < b) ? a : b; }
+
+/**
+ * @brief  Initialize a batch
+ */
+int8_t PID_Batch_Init(PID_Batch_t *batch, uint8_t count, float dt) {
+  if (count == 0 || count > PID_BATCH_MAX || !(dt > 0.0f))
+    return -1;
+
+  batch->count = count;
+  batch->dt = dt;
+  batch->inv_dt = 1.0f / dt;
+  for (uint8_t i = 0; i < PID_BATCH_MAX; i++) {
+    batch->Ki[i] = batch->Kd[i] = 0.0f;
+    batch->Kp[i] = batch->Ki_dt[i] = batch->Kd_dt[i] = 0.0f;
+    batch->Kv[i] = batch->Ks[i] = batch->Ka[i] = 0.0f;
+    batch->integral_limit[i] = 0.0f;
+    batch->output_min[i] = batch->output_max[i] = 0.0f;
+    batch->integral[i] = batch->prev_measurement[i] = 0.0f;
+    batch->proportional[i] = batch->derivative[i] = 0.0f;
+  }
+  return 0;
+}
+
+/**
+ * @brief  Configure one controller
+ */
+void PID_Batch_Setup(PID_Batch_t *batch, uint8_t index, float Kp, float Ki,
+                     float Kd, float output_min, float output_max) {
+  PID_Batch_SetGains(batch, index, Kp, Ki, Kd);
+  batch->Kv[index] = batch->Ks[index] = batch->Ka[index] = 0.0f;
+  batch->integral_limit[index] = output_max * 0.5f; /* As PID_Init */
+  batch->output_min[index] = output_min;
+  batch->output_max[index] = output_max;
+  PID_Batch_Reset(batch, index);
+}
+
+/**
+ * @brief  Change the sample time
+ */
+void PID_Batch_SetPeriod(PID_Batch_t *batch, float dt) {
+  if (!(dt > 0.0f))
+    return;
+
+  batch->dt = dt;
+  batch->inv_dt = 1.0f / dt;
+  for (uint8_t i = 0; i < batch->count; i++) {
+    batch->Ki_dt[i] = batch->Ki[i] * dt;
+    batch->Kd_dt[i] = batch->Kd[i] * batch->inv_dt;
+  }
+}
+
+/**
+ * @brief  Set one controller's gains (no divide: 1/dt is kept)
+ */
+void PID_Batch_SetGains(PID_Batch_t *batch, uint8_t index, float Kp,
+                        float Ki, float Kd) {
+  batch->Ki[index] = Ki;
+  batch->Kd[index] = Kd;
+  batch->Kp[index] = Kp;
+  batch->Ki_dt[index] = Ki * batch->dt;
+  batch->Kd_dt[index] = Kd * batch->inv_dt;
+}
+
+/**
+ * @brief  Set one controller's feedforward gains
+ */
+void PID_Batch_SetFeedforward(PID_Batch_t *batch, uint8_t index, float Kv,
+                              float Ks, float Ka) {
+  batch->Kv[index] = Kv;
+  batch->Ks[index] = Ks;
+  batch->Ka[index] = Ka;
+}
+
+/**
+ * @brief  Set one controller's integral limit
+ */
+void PID_Batch_SetIntegralLimit(PID_Batch_t *batch, uint8_t index,
+                                float limit) {
+  batch->integral_limit[index] = limit;
+  batch->integral[index] =
+      select_min(select_max(batch->integral[index], -limit), limit);
+}
+
+/**
+ * @brief  Reset one controller's state
+ */
+void PID_Batch_Reset(PID_Batch_t *batch, uint8_t index) {
+  batch->integral[index] = 0.0f;
+  batch->prev_measurement[index] = 0.0f;
+  batch->proportional[index] = 0.0f;
+  batch->derivative[index] = 0.0f;
+}
+
+/**
+ * @brief  Reset every controller's state
+ */
+void PID_Batch_ResetAll(PID_Batch_t *batch) {
+  for (uint8_t i = 0; i < batch->count; i++)
+    PID_Batch_Reset(batch, i);
+}
+
+/**
+ * @brief  Update every controller
+ * @note   Per controller: same result as PID_ComputeFF. The anti-windup
+ *         undo and the static feedforward sign are selects, not branches.
+ */
+void PID_Batch_Compute(PID_Batch_t *batch, const float *setpoint,
+                       const float *setpoint_accel, const float *measurement,
+                       float *output) {
+  for (uint8_t i = 0; i < batch->count; i++) {
+    float sp = setpoint[i];
+    float meas = measurement[i];
+    float error = sp - meas;
+
+    /* Integral with clamp */
+    float dI = batch->Ki_dt[i] * error;
+    float limit = batch->integral_limit[i];
+    float integral =
+        select_min(select_max(batch->integral[i] + dI, -limit), limit);
+
+    /* Derivative on measurement */
+    float D = -batch->Kd_dt[i] * (meas - batch->prev_measurement[i]);
+    batch->prev_measurement[i] = meas;
+
+    /* Feedforward */
+    float sign = (sp > 0.0f) ? 1.0f : ((sp < 0.0f) ? -1.0f : 0.0f);
+    float F = batch->Kv[i] * sp + batch->Ks[i] * sign;
+    if (setpoint_accel)
+      F += batch->Ka[i] * setpoint_accel[i];
+
+    float P = batch->Kp[i] * error;
+    float raw = P + integral + D + F;
+    float out =
+        select_min(select_max(raw, batch->output_min[i]), batch->output_max[i]);
+
+    /* Anti-windup: saturated in the error's direction keeps the old sum */
+    uint8_t wound = (out >= batch->output_max[i] && error > 0.0f) |
+                    (out <= batch->output_min[i] && error < 0.0f);
+    batch->integral[i] = wound ? integral - dI : integral;
+    batch->proportional[i] = P;
+    batch->derivative[i] = D;
+
+    output[i] = out;
+  }
+}
+
+/**
+ * @brief  Get one controller's terms from the last update
+ */
+void PID_Batch_GetTerms(const PID_Batch_t *batch, uint8_t index,
+                        float terms[3]) {
+  terms[0] = batch->proportional[index];
+  terms[1] = batch->integral[index];
+  terms[2] = batch->derivative[index];
+}
+
+/* ================ Q16.16 Fixed-Point PID ================ */
+
+/**
+ * @brief  Initialize fixed-point PID controller
+ */
+void PID_Q16_Init(PID_Q16_t *pid, float Kp, float Ki, float Kd,
+                  float output_min, float output_max, float dt) {
+  pid->dt = dt;
+  PID_Q16_SetGains(pid, Kp, Ki, Kd);
+
+  pid->integral = 0;
+  pid->prev_measurement = 0;
+
+  pid->integral_limit =
+      Q16_FROM_FLOAT(output_max * 0.5f); /* Default: 50% of max output */
+  pid->output_min = Q16_FROM_FLOAT(output_min);
+  pid->output_max = Q16_FROM_FLOAT(output_max);
+}
+
+/**
+ * @brief  Compute fixed-point PID output using derivative on measurement
+ * @note   Integer-only: three 32x32->64 multiplies, no divide. Mirrors
+ *         PID_Compute, including the anti-windup undo on saturation.
+ */
+q16_t PID_Q16_Compute(PID_Q16_t *pid, q16_t setpoint, q16_t measurement) {
+  /* Calculate error */
+  int32_t error = setpoint - measurement;
+
+  /* Proportional term */
+  int64_t P = ((int64_t)pid->Kp * error) >> Q16_SHIFT;
+
+  /* Integral term with anti-windup */
+  int32_t dI = (int32_t)(((int64_t)pid->Ki_dt * error) >> PID_Q16_KI_SHIFT);
+  pid->integral = clamp_q16((int64_t)pid->integral + dI, -pid->integral_limit,
+                            pid->integral_limit);
+
+  /* Derivative term (on measurement to avoid kick) */
+  int64_t D = -(((int64_t)pid->Kd_dt * (measurement - pid->prev_measurement)) >>
+                Q16_SHIFT);
+  pid->prev_measurement = measurement;
+
+  /* Calculate output with saturation */
+  q16_t output =
+      clamp_q16(P + pid->integral + D, pid->output_min, pid->output_max);
+
+  /* Anti-windup: if output saturated, stop integrating in that direction */
+  if ((output >= pid->output_max && error > 0) ||
+      (output <= pid->output_min && error < 0)) {
+    pid->integral -= dI; /* Undo the integration */
+  }
+
+  return output;
+}
+
+/**
+ * @brief  Reset fixed-point PID controller state
+ */
+void PID_Q16_Reset(PID_Q16_t *pid) {
+  pid->integral = 0;
+  pid->prev_measurement = 0;
+}
+
+/**
+ * @brief  Set new fixed-point PID gains
+ * @note   Rescales Ki and Kd by the stored sample time (float, cold path)
+ */
+void PID_Q16_SetGains(PID_Q16_t *pid, float Kp, float Ki, float Kd) {
+  pid->Kp = Q16_FROM_FLOAT(Kp);
+  pid->Ki_dt = (int32_t)(Ki * pid->dt * (float)(1UL << PID_Q16_KI_SHIFT));
+  pid->Kd_dt = (pid->dt > 0.0f) ? Q16_FROM_FLOAT(Kd / pid->dt) : 0;
+}
+
+/**
+ * @brief  Set integral limit for anti-windup
+ */
+void PID_Q16_SetIntegralLimit(PID_Q16_t *pid, float limit) {
+  pid->integral_limit = Q16_FROM_FLOAT(limit);
+  /* Clamp existing integral if necessary */
+  pid->integral =
+      clamp_q16(pid->integral, -pid->integral_limit, pid->integral_limit);
+}
@@ -0,0 +1,256 @@
+/**
+ ******************************************************************************
+ * @file    settings.c
+ * @brief   Calibration, gains and odometry parameters kept in flash
+ ******************************************************************************
+ */
+
+#include "settings.h"
+#include "differential_drive.h"
+#include "eeprom.h"
+#include "imu.h"
+#include "odometry.h"
+#include <math.h>
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* Record: version, sequence, Settings_t floats as halves, heading source,
+ * CRC */
+#define SETTINGS_FLOATS 11U
+#define SETTINGS_DATA_WORDS (2U + 2U * SETTINGS_FLOATS + 1U)
+#define SETTINGS_WORDS (SETTINGS_DATA_WORDS + 1U)
+
+/* Saves alternate between two record slots */
+#define SETTINGS_SLOTS 2U
+
+/* EEPROM variable of word i of a slot */
+#define SETTINGS_VIRT_ADDRESS(slot, i)                                         \
+  ((uint16_t)(1U + (slot) * SETTINGS_WORDS + (i)))
+
+/* CRC-16/CCITT-FALSE */
+#define CRC16_POLY 0x1021U
+#define CRC16_INIT 0xFFFFU
+
+_Static_assert(SETTINGS_SLOTS * SETTINGS_WORDS <= EE_VAR_COUNT,
+               "settings slots do not fit the EEPROM variables");
+
+/* ================ Private Variables ================ */
+
+/* Die temperature the live gyro bias was calibrated at */
+static float bias_temp_c = 0.0f;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Floats of a record in storage order
+ */
+static void GetFloats(const Settings_t *in, float *floats) {
+  floats[0] = in->gyro_z_bias;
+  floats[1] = in->gyro_temp_c;
+  memcpy(&floats[2], in->speed_pid, sizeof(in->speed_pid));
+  memcpy(&floats[5], in->heading_pid, sizeof(in->heading_pid));
+  memcpy(&floats[8], in->integral_limits, sizeof(in->integral_limits));
+  floats[10] = in->track_width_mm;
+}
+
+static void SetFloats(Settings_t *out, const float *floats) {
+  out->gyro_z_bias = floats[0];
+  out->gyro_temp_c = floats[1];
+  memcpy(out->speed_pid, &floats[2], sizeof(out->speed_pid));
+  memcpy(out->heading_pid, &floats[5], sizeof(out->heading_pid));
+  memcpy(out->integral_limits, &floats[8], sizeof(out->integral_limits));
+  out->track_width_mm = floats[10];
+}
+
+/**
+ * @brief  CRC-16 over the data words, high byte of each first (unlike a
+ *         sum mod 255, tells erased 0xFFFF from 0x0000)
+ */
+static uint16_t Crc16(const uint16_t *words, uint32_t count) {
+  uint16_t crc = CRC16_INIT;
+
+  for (uint32_t i = 0; i < count; i++) {
+    crc ^= words[i];
+    for (uint32_t bit = 0; bit < 16U; bit++)
+      crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ CRC16_POLY)
+                            : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+/**
+ * @brief  Serialize a record
+ */
+static void Encode(const Settings_t *in, uint16_t sequence, uint16_t *words) {
+  float floats[SETTINGS_FLOATS];
+
+  GetFloats(in, floats);
+  words[0] = SETTINGS_VERSION;
+  words[1] = sequence;
+  memcpy(&words[2], floats, sizeof(floats));
+  words[SETTINGS_DATA_WORDS - 1U] = in->heading_source;
+  words[SETTINGS_DATA_WORDS] = Crc16(words, SETTINGS_DATA_WORDS);
+}
+
+/**
+ * @brief  Read and check the record in one slot
+ * @param  sequence: Sequence number of the record
+ * @retval 0 if valid, -1 if empty, another version, or corrupt
+ */
+static int8_t LoadSlot(uint32_t slot, Settings_t *out, uint16_t *sequence) {
+  uint16_t words[SETTINGS_WORDS];
+  float floats[SETTINGS_FLOATS];
+
+  for (uint32_t i = 0; i < SETTINGS_WORDS; i++) {
+    if (EE_ReadVariable(SETTINGS_VIRT_ADDRESS(slot, i), &words[i]) != EE_OK)
+      return -1;
+  }
+  if (words[0] != SETTINGS_VERSION ||
+      words[SETTINGS_DATA_WORDS] != Crc16(words, SETTINGS_DATA_WORDS))
+    return -1;
+
+  memcpy(floats, &words[2], sizeof(floats));
+  for (uint32_t i = 0; i < SETTINGS_FLOATS; i++) {
+    if (!isfinite(floats[i]))
+      return -1;
+  }
+
+  Settings_t loaded;
+  SetFloats(&loaded, floats);
+  loaded.heading_source = words[SETTINGS_DATA_WORDS - 1U];
+  if (loaded.track_width_mm <= 0.0f ||
+      loaded.heading_source > ODOMETRY_HEADING_ENCODER)
+    return -1;
+
+  *out = loaded;
+  *sequence = words[1];
+  return 0;
+}
+
+/**
+ * @brief  Find the newest valid record
+ * @retval Its slot, or SETTINGS_SLOTS if none
+ */
+static uint32_t NewestSlot(Settings_t *out, uint16_t *sequence) {
+  uint32_t newest = SETTINGS_SLOTS;
+
+  for (uint32_t slot = 0; slot < SETTINGS_SLOTS; slot++) {
+    Settings_t record;
+    uint16_t seq;
+    if (LoadSlot(slot, &record, &seq) != 0)
+      continue;
+    /* Sequence numbers wrap: newer means ahead by less than half */
+    if (newest == SETTINGS_SLOTS || (int16_t)(seq - *sequence) > 0) {
+      newest = slot;
+      *out = record;
+      *sequence = seq;
+    }
+  }
+  return newest;
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Load the newest stored record
+ */
+int8_t Settings_Load(Settings_t *out) {
+  uint16_t sequence = 0;
+
+  return (NewestSlot(out, &sequence) < SETTINGS_SLOTS) ? 0 : -1;
+}
+
+/**
+ * @brief  Store a record
+ */
+int8_t Settings_Save(const Settings_t *in) {
+  uint16_t words[SETTINGS_WORDS];
+  Settings_t newest;
+  uint16_t sequence = 0;
+
+  /* Overwrite the other slot: the newest record stays intact until this
+   * one is complete */
+  uint32_t slot = NewestSlot(&newest, &sequence);
+  slot = (slot == 0) ? 1U : 0U;
+  Encode(in, (uint16_t)(sequence + 1U), words);
+
+  /* CRC last: a save cut short never loads */
+  for (uint32_t i = 0; i < SETTINGS_WORDS; i++) {
+    uint16_t stored;
+    if (EE_ReadVariable(SETTINGS_VIRT_ADDRESS(slot, i), &stored) == EE_OK &&
+        stored == words[i])
+      continue;
+    if (EE_WriteVariable(SETTINGS_VIRT_ADDRESS(slot, i), words[i]) != EE_OK)
+      return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief  Read the live parameters
+ */
+void Settings_Capture(Settings_t *out) {
+  out->gyro_z_bias = IMU_GetData()->gyro_z_bias;
+  out->gyro_temp_c = bias_temp_c;
+  DifferentialDrive_GetSpeedPID(out->speed_pid);
+  DifferentialDrive_GetHeadingPID(out->heading_pid);
+  DifferentialDrive_GetIntegralLimits(out->integral_limits);
+  out->track_width_mm = Odometry_GetTrackWidth();
+  out->heading_source = (uint16_t)Odometry_GetHeadingSource();
+}
+
+/**
+ * @brief  Apply gains, integral limits and odometry parameters
+ */
+void Settings_Apply(const Settings_t *in) {
+  DifferentialDrive_SetSpeedPID(in->speed_pid[0], in->speed_pid[1],
+                                in->speed_pid[2]);
+  DifferentialDrive_SetHeadingPID(in->heading_pid[0], in->heading_pid[1],
+                                  in->heading_pid[2]);
+  DifferentialDrive_SetIntegralLimits(in->integral_limits[0],
+                                      in->integral_limits[1]);
+  Odometry_SetTrackWidth(in->track_width_mm);
+  Odometry_SetHeadingSource((Odometry_Heading_t)in->heading_source);
+}
+
+/**
+ * @brief  Start the EEPROM emulation and restore the stored parameters
+ */
+Settings_Result_t Settings_Restore(void) {
+  Settings_t stored;
+  float temp_c;
+
+  if (EE_Init() != EE_OK)
+    return SETTINGS_FLASH_ERROR;
+
+  /* A calibration that follows happens at this temperature */
+  uint8_t have_temp = (IMU_ReadTemperature(&temp_c) == 0);
+  bias_temp_c = have_temp ? temp_c : 0.0f;
+
+  if (Settings_Load(&stored) != 0)
+    return SETTINGS_NONE;
+  Settings_Apply(&stored);
+
+  if (!have_temp ||
+      fabsf(temp_c - stored.gyro_temp_c) > SETTINGS_MAX_TEMP_DELTA)
+    return SETTINGS_TEMPERATURE;
+
+  IMU_SetGyroBias(stored.gyro_z_bias);
+  if (IMU_CheckGyroBias(SETTINGS_BIAS_TOLERANCE) != 0)
+    return SETTINGS_BIAS_CHECK;
+
+  DifferentialDrive_RestoreCalibration(stored.gyro_z_bias);
+  bias_temp_c = stored.gyro_temp_c;
+  return SETTINGS_RESTORED;
+}
+
+/**
+ * @brief  Store the live parameters
+ */
+int8_t Settings_Store(void) {
+  Settings_t live;
+
+  Settings_Capture(&live);
+  return Settings_Save(&live);
+}
@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * @file    speed_estimator.c
+ * @brief   Hybrid period/count wheel speed estimator
+ ******************************************************************************
+ */
+
+#include "speed_estimator.h"
+
+/* ================ Private Functions ================ */
+
+static float abs_f(float x) { return (x < 0.0f) ? -x : x; }
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Initialize estimator
+ */
+void SpeedEstimator_Init(SpeedEstimator_t *est, uint32_t clock_hz,
+                         uint32_t edge_counts, uint32_t blend_counts,
+                         float stop_time) {
+  est->clock_hz = (float)clock_hz;
+  est->edge_counts = (float)(edge_counts ? edge_counts : 1);
+  est->blend_scale = 1.0f / (float)(blend_counts ? blend_counts : 1);
+  est->stop_ticks = (uint32_t)(stop_time * (float)clock_hz);
+
+  SpeedEstimator_Reset(est, 0, 0);
+}
+
+/**
+ * @brief  Restart from rest at a given count
+ */
+void SpeedEstimator_Reset(SpeedEstimator_t *est, int32_t count, uint32_t now) {
+  est->count = count;
+  est->time = now;
+  est->edge_count = count;
+  est->edge_time = now;
+  est->move_time = now;
+  est->edge_valid = 0;
+
+  est->velocity = 0.0f;
+  est->confidence = 1.0f;
+}
+
+/**
+ * @brief  Update the estimate
+ */
+float SpeedEstimator_Update(SpeedEstimator_t *est, int32_t count,
+                            int32_t edge_count, uint32_t edge_time,
+                            uint32_t now) {
+  uint32_t tick = now - est->time;
+  if (tick == 0)
+    return est->velocity;
+
+  int32_t delta = count - est->count;
+  int32_t edges = edge_count - est->edge_count;
+  uint32_t span = edge_time - est->edge_time;
+  uint8_t new_edge = (edge_time != est->edge_time);
+
+  /* Edge spacing errors (A/B phase, duty cycle) repeat every quadrature
+   * cycle: measure from the edge before last if that spans whole cycles
+   * and the last one does not */
+  if (new_edge && est->edge_valid > 1 &&
+      (edges % SPEED_ESTIMATOR_CYCLE_COUNTS) != 0 &&
+      ((edge_count - est->prev_edge_count) % SPEED_ESTIMATOR_CYCLE_COUNTS) ==
+          0) {
+    edges = edge_count - est->prev_edge_count;
+    span = edge_time - est->prev_edge_time;
+  }
+
+  /* 0 up to blend_counts / 2, rising to 1 at blend_counts. Blending at a
+   * count or two per tick would bias the estimate, since only ticks that
+   * saw an edge reach this point. */
+  float weight = 2.0f * abs_f((float)delta) * est->blend_scale - 1.0f;
+  if (weight < 0.0f)
+    weight = 0.0f;
+  else if (weight > 1.0f)
+    weight = 1.0f;
+
+  /* Timestamped edges may be edge_counts apart while the wheel still
+   * moves, so their span may reach edge_counts stop timeouts */
+  if (new_edge && est->edge_valid && edges != 0 &&
+      (float)span < est->edge_counts * (float)est->stop_ticks) {
+    /* Period measurement, blended towards the count delta */
+    float v_period = (float)edges * est->clock_hz / (float)span;
+    float v_count = (float)delta * est->clock_hz / (float)tick;
+    est->velocity = v_period + weight * (v_count - v_period);
+    est->confidence = 1.0f;
+    est->move_time = edge_time;
+  } else if (delta != 0 &&
+             (!est->edge_valid || weight >= 1.0f || est->velocity == 0.0f ||
+              (delta > 0) != (est->velocity > 0.0f))) {
+    /* No usable timestamps (starting, reversing, fast): count delta only.
+     * Starting from rest, the counts span the time since the last motion
+     * (at most the stop timeout), not just this tick. */
+    uint32_t span_count = tick;
+    if (est->velocity == 0.0f) {
+      span_count = now - est->move_time;
+      if (span_count > est->stop_ticks)
+        span_count = est->stop_ticks;
+      if (span_count < tick)
+        span_count = tick;
+    }
+    est->velocity = (float)delta * est->clock_hz / (float)span_count;
+    est->confidence = weight;
+    est->move_time = now;
+    /* Edges older than this tick (capture gated off, or before a
+     * reversal) are no start for a period measurement */
+    if (!new_edge)
+      est->edge_valid = 0;
+  } else if (est->velocity != 0.0f) {
+    /* Counts without a timestamped edge: still moving */
+    if (delta != 0)
+      est->move_time = now;
+    uint32_t since = now - est->move_time;
+
+    if (since >= est->stop_ticks) {
+      est->velocity = 0.0f;
+      est->confidence = 1.0f;
+      est->edge_valid = 0;
+    } else {
+      /* Slower than one count per 'since' without a count, and than
+       * edge_counts per time without a timestamped edge */
+      float bound = (delta == 0) ? est->clock_hz / (float)since : -1.0f;
+      if (est->edge_valid) {
+        float edge_bound = est->edge_counts * est->clock_hz /
+                           (float)(now - est->edge_time);
+        if (bound < 0.0f || edge_bound < bound)
+          bound = edge_bound;
+      }
+      float speed = abs_f(est->velocity);
+      if (bound >= 0.0f && speed > bound) {
+        est->confidence = bound / speed;
+        est->velocity = (est->velocity > 0.0f) ? bound : -bound;
+      }
+    }
+  }
+
+  if (new_edge) {
+    est->prev_edge_count = est->edge_count;
+    est->prev_edge_time = est->edge_time;
+    est->edge_count = edge_count;
+    est->edge_time = edge_time;
+    est->edge_valid = est->edge_valid ? 2 : 1;
+  }
+  est->count = count;
+  est->time = now;
+
+  return est->velocity;
+}
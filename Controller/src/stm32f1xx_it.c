@@ -5,8 +5,13 @@
  ******************************************************************************
  */
 
+#include "control_loop.h"
 #include "encoder.h"
+#include "imu.h"
 #include "main.h"
+#include "param_server.h"
+#include "telemetry.h"
+#include "trace.h"
 
 /* External variables */
 extern volatile uint32_t systick_counter;
@@ -82,26 +87,32 @@ void SysTick_Handler(void) {
  * @brief  EXTI1 interrupt handler - Left Encoder Channel A (PA1)
  */
 void EXTI1_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_ENCODER_LEFT_ISR);
   if (EXTI->PR & EXTI_PR_PR1) {
     EXTI->PR = EXTI_PR_PR1; /* Clear pending bit */
     Encoder_EXTI1_Handler();
   }
+  TRACE_EXIT(TRACE_ID_ENCODER_LEFT_ISR);
 }
 
 /**
  * @brief  EXTI2 interrupt handler - Left Encoder Channel B (PA2)
  */
 void EXTI2_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_ENCODER_LEFT_ISR);
   if (EXTI->PR & EXTI_PR_PR2) {
     EXTI->PR = EXTI_PR_PR2; /* Clear pending bit */
     Encoder_EXTI2_Handler();
   }
+  TRACE_EXIT(TRACE_ID_ENCODER_LEFT_ISR);
 }
 
 /**
  * @brief  EXTI9_5 interrupt handler - Right Encoder (PB8, PB9)
  */
 void EXTI9_5_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_ENCODER_RIGHT_ISR);
+
   /* Check EXTI8 (Right Encoder A) */
   if (EXTI->PR & EXTI_PR_PR8) {
     EXTI->PR = EXTI_PR_PR8; /* Clear pending bit */
@@ -113,4 +124,98 @@ void EXTI9_5_IRQHandler(void) {
     EXTI->PR = EXTI_PR_PR9; /* Clear pending bit */
     Encoder_EXTI9_5_Handler();
   }
+
+  TRACE_EXIT(TRACE_ID_ENCODER_RIGHT_ISR);
+}
+
+/**
+ * @brief  TIM2 interrupt handler - Left encoder counter overflow
+ */
+void TIM2_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_ENCODER_LEFT_ISR);
+  Encoder_TIM2_Handler();
+  TRACE_EXIT(TRACE_ID_ENCODER_LEFT_ISR);
+}
+
+/**
+ * @brief  TIM1 update interrupt handler - Right encoder counter overflow
+ */
+void TIM1_UP_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_ENCODER_RIGHT_ISR);
+  Encoder_TIM1_UP_Handler();
+  TRACE_EXIT(TRACE_ID_ENCODER_RIGHT_ISR);
+}
+
+/**
+ * @brief  TIM1 capture/compare interrupt handler - Right encoder A edge
+ */
+void TIM1_CC_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_ENCODER_RIGHT_ISR);
+  Encoder_TIM1_CC_Handler();
+  TRACE_EXIT(TRACE_ID_ENCODER_RIGHT_ISR);
+}
+
+/**
+ * @brief  TIM4 interrupt handler - Control loop update
+ */
+void TIM4_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_CONTROL_LOOP_ISR);
+  ControlLoop_IRQHandler();
+  TRACE_EXIT(TRACE_ID_CONTROL_LOOP_ISR);
+}
+
+/**
+ * @brief  I2C1 event interrupt handler - IMU burst read sequencing
+ */
+void I2C1_EV_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_IMU_I2C_ISR);
+  IMU_I2C1_EV_Handler();
+  TRACE_EXIT(TRACE_ID_IMU_I2C_ISR);
+}
+
+/**
+ * @brief  I2C1 error interrupt handler - IMU burst read abort
+ */
+void I2C1_ER_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_IMU_I2C_ISR);
+  IMU_I2C1_ER_Handler();
+  TRACE_EXIT(TRACE_ID_IMU_I2C_ISR);
 }
+
+/**
+ * @brief  DMA1 Channel 7 interrupt handler - IMU burst received (I2C1_RX)
+ */
+void DMA1_Channel7_IRQHandler(void) {
+  TRACE_ENTER(TRACE_ID_IMU_DMA_ISR);
+  IMU_DMA1_Channel7_Handler();
+  TRACE_EXIT(TRACE_ID_IMU_DMA_ISR);
+}
+
+#if TELEMETRY_ENABLE
+#if TRACE_ENABLE
+#error "Telemetry and the trace dump share USART3: build with TRACE_ENABLE=0"
+#endif
+
+/**
+ * @brief  DMA1 Channel 2 interrupt handler - Telemetry frame sent (USART3_TX)
+ */
+void DMA1_Channel2_IRQHandler(void) { Telemetry_DMA1_Channel2_Handler(); }
+#else
+/**
+ * @brief  DMA1 Channel 2 interrupt handler - Trace packet sent (USART3_TX)
+ */
+void DMA1_Channel2_IRQHandler(void) { Trace_DMA1_Channel2_Handler(); }
+#endif
+
+#if PARAM_SERVER_ENABLE
+/**
+ * @brief  DMA1 Channel 3 interrupt handler - Command ring half/full
+ *         (USART3_RX)
+ */
+void DMA1_Channel3_IRQHandler(void) { ParamServer_DMA1_Channel3_Handler(); }
+
+/**
+ * @brief  USART3 interrupt handler - Command line idle
+ */
+void USART3_IRQHandler(void) { ParamServer_USART3_Handler(); }
+#endif
@@ -0,0 +1,304 @@
+/**
+ ******************************************************************************
+ * @file    telemetry.c
+ * @brief   Per-tick binary telemetry frames over USART DMA
+ ******************************************************************************
+ *
+ * Two encoded-frame buffers: the DMA reads `active` while the publisher
+ * fills the other one. The F1 DMA has no double-buffer mode, so the DMA
+ * complete interrupt restarts the channel on the waiting buffer. Buffer
+ * ownership changes inside short PRIMASK sections; encoding runs outside
+ * them.
+ *
+ * Replies use a third buffer. `active` keeps naming the last frame buffer
+ * handed to the DMA while a reply is sent, so the publisher's back buffer
+ * stays the other one.
+ *
+ ******************************************************************************
+ */
+
+#include "telemetry.h"
+#include "main.h"
+#include <string.h>
+
+/* ================ Private Defines ================ */
+
+/* USART3 is on APB1 (SYSCLK / 2) */
+#define TELEMETRY_UART_CLOCK_HZ (SYSTEM_CLOCK_HZ / 2U)
+
+/* ================ Private Variables ================ */
+
+static uint8_t tx_buf[2][TELEMETRY_ENCODED_MAX];
+static uint32_t tx_len[2];
+static volatile uint8_t tx_busy = 0;
+static volatile uint8_t active = 0;  /* Buffer the DMA is reading */
+static volatile uint8_t pending = 0; /* The other buffer waits to be sent */
+
+static uint8_t reply_buf[TELEMETRY_ENCODED_MAX];
+static uint32_t reply_len;
+static volatile uint8_t reply_pending = 0; /* Waits to be sent */
+static volatile uint8_t reply_sending = 0; /* The DMA is reading it */
+
+static uint16_t seq = 0;
+static volatile uint32_t published = 0;
+static volatile uint32_t sent = 0;
+static volatile uint32_t dropped = 0;
+static volatile uint32_t replies = 0;
+static volatile uint32_t replies_dropped = 0;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Hardware CRC over whole words
+ */
+static uint32_t Crc(const uint32_t *words, uint32_t count) {
+  WRITE_REG(CRC->CR, CRC_CR_RESET);
+  for (uint32_t i = 0; i < count; i++)
+    WRITE_REG(CRC->DR, words[i]);
+  return READ_REG(CRC->DR);
+}
+
+/**
+ * @brief  Point the DMA at a buffer and start it (interrupts masked)
+ */
+static void StartDma(const uint8_t *buf, uint32_t length) {
+  tx_busy = 1;
+  CLEAR_BIT(DMA1_Channel2->CCR, DMA_CCR_EN);
+  WRITE_REG(DMA1_Channel2->CMAR, (uint32_t)(uintptr_t)buf);
+  WRITE_REG(DMA1_Channel2->CNDTR, length);
+  SET_BIT(DMA1_Channel2->CCR, DMA_CCR_EN);
+}
+
+/**
+ * @brief  Send a frame buffer (interrupts masked)
+ */
+static void StartFrame(uint8_t index) {
+  active = index;
+  StartDma(tx_buf[index], tx_len[index]);
+}
+
+/**
+ * @brief  Send the reply buffer (interrupts masked)
+ */
+static void StartReply(void) {
+  reply_pending = 0;
+  reply_sending = 1;
+  StartDma(reply_buf, reply_len);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Configure the CRC unit and USART3 TX with DMA
+ */
+void Telemetry_Init(void) {
+  tx_busy = 0;
+  active = 0;
+  pending = 0;
+  reply_pending = 0;
+  reply_sending = 0;
+  seq = 0;
+  published = 0;
+  sent = 0;
+  dropped = 0;
+  replies = 0;
+  replies_dropped = 0;
+
+  /* Enable clocks */
+  SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPBEN);   /* GPIOB */
+  SET_BIT(RCC->APB1ENR, RCC_APB1ENR_USART3EN); /* USART3 */
+  SET_BIT(RCC->AHBENR, RCC_AHBENR_DMA1EN);     /* DMA1 */
+  SET_BIT(RCC->AHBENR, RCC_AHBENR_CRCEN);      /* CRC */
+
+  /* PB10 (TX): alternate function push-pull, 50MHz */
+  MODIFY_REG(GPIOB->CRH, GPIO_CRH_MODE10 | GPIO_CRH_CNF10,
+             GPIO_CRH_MODE10 | GPIO_CRH_CNF10_1);
+
+  /* USART3: 8N1, TX only, DMA transmit */
+  WRITE_REG(USART3->CR1, 0);
+  WRITE_REG(USART3->BRR, (TELEMETRY_UART_CLOCK_HZ + TELEMETRY_UART_BAUD / 2U) /
+                             TELEMETRY_UART_BAUD);
+  WRITE_REG(USART3->CR3, USART_CR3_DMAT);
+  WRITE_REG(USART3->CR1, USART_CR1_UE | USART_CR1_TE);
+
+  /* DMA1 Channel 2: memory -> USART3_DR, byte-wide, complete interrupt */
+  WRITE_REG(DMA1_Channel2->CCR, 0);
+  WRITE_REG(DMA1_Channel2->CPAR, (uint32_t)(uintptr_t)&USART3->DR);
+  WRITE_REG(DMA1_Channel2->CCR, DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE);
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF2);
+
+  NVIC_SetPriority(DMA1_Channel2_IRQn, TELEMETRY_IRQ_PRIORITY);
+  NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+
+/**
+ * @brief  Send a frame
+ */
+void Telemetry_Publish(Telemetry_Frame_t *frame) {
+  uint32_t primask;
+
+  frame->timestamp = DWT->CYCCNT;
+  frame->seq = seq++;
+  frame->dropped = (uint16_t)dropped;
+  published = published + 1U;
+
+  /* Take the buffer the DMA is not reading; a frame waiting there is
+   * replaced by this newer one */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (pending) {
+    pending = 0;
+    dropped = dropped + 1U;
+  }
+  uint8_t back = active ^ 1U;
+  __set_PRIMASK(primask);
+
+  tx_len[back] = Telemetry_Encode(frame, tx_buf[back]);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (tx_busy)
+    pending = 1;
+  else
+    StartFrame(back);
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Send a text reply between frames
+ */
+int8_t Telemetry_SendReply(const char *text, uint32_t length) {
+  uint32_t words[TELEMETRY_REPLY_MAX / 4U + 1U];
+  uint32_t primask;
+
+  if (length > TELEMETRY_REPLY_MAX) {
+    replies_dropped = replies_dropped + 1U;
+    return -1;
+  }
+
+  /* One reply in flight at a time: the buffer is free once it is sent */
+  if (reply_pending || reply_sending) {
+    replies_dropped = replies_dropped + 1U;
+    return -1;
+  }
+
+  uint32_t count = (length + 3U) / 4U;
+  words[count] = 0;
+  if (count)
+    words[count - 1U] = 0; /* Zero padding */
+  memcpy(words, text, length);
+
+  /* The control loop uses the CRC unit too */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  words[count] = Crc(words, count);
+  __set_PRIMASK(primask);
+
+  reply_len = Telemetry_CobsEncode((const uint8_t *)words, (count + 1U) * 4U,
+                                   reply_buf);
+  reply_buf[reply_len++] = 0x00;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (tx_busy)
+    reply_pending = 1;
+  else
+    StartReply();
+  __set_PRIMASK(primask);
+
+  return 0;
+}
+
+/**
+ * @brief  Checksum and COBS-encode a frame
+ */
+uint32_t Telemetry_Encode(const Telemetry_Frame_t *frame, uint8_t *out) {
+  uint8_t payload[TELEMETRY_PAYLOAD_LEN];
+
+  uint32_t crc = Crc((const uint32_t *)frame, TELEMETRY_FRAME_LEN / 4U);
+  memcpy(payload, frame, TELEMETRY_FRAME_LEN);
+  payload[TELEMETRY_FRAME_LEN + 0] = (uint8_t)crc;
+  payload[TELEMETRY_FRAME_LEN + 1] = (uint8_t)(crc >> 8);
+  payload[TELEMETRY_FRAME_LEN + 2] = (uint8_t)(crc >> 16);
+  payload[TELEMETRY_FRAME_LEN + 3] = (uint8_t)(crc >> 24);
+
+  uint32_t length = Telemetry_CobsEncode(payload, sizeof(payload), out);
+  out[length++] = 0x00; /* Frame delimiter */
+  return length;
+}
+
+/**
+ * @brief  COBS-encode a buffer
+ */
+uint32_t Telemetry_CobsEncode(const uint8_t *in, uint32_t length,
+                              uint8_t *out) {
+  uint8_t *code = out; /* Where the current block's length goes */
+  uint8_t *p = out + 1;
+  uint8_t run = 1;
+
+  for (uint32_t i = 0; i < length; i++) {
+    if (in[i] == 0) {
+      *code = run;
+      code = p++;
+      run = 1;
+    } else {
+      *p++ = in[i];
+      if (++run == 0xFF) {
+        /* Full block of 254 data bytes, no zero follows */
+        *code = run;
+        code = p++;
+        run = 1;
+      }
+    }
+  }
+  *code = run;
+
+  return (uint32_t)(p - out);
+}
+
+/**
+ * @brief  Check whether a frame is being sent
+ */
+uint8_t Telemetry_IsBusy(void) { return tx_busy; }
+
+/**
+ * @brief  Get telemetry statistics
+ */
+void Telemetry_GetStats(Telemetry_Stats_t *out) {
+  out->published = published;
+  out->sent = sent;
+  out->dropped = dropped;
+  out->replies = replies;
+  out->replies_dropped = replies_dropped;
+}
+
+/* ================ Interrupt Handlers ================ */
+
+/**
+ * @brief  DMA1 channel 2 interrupt handler (USART3 TX complete)
+ */
+void Telemetry_DMA1_Channel2_Handler(void) {
+  if (!READ_BIT(DMA1->ISR, DMA_ISR_TCIF2))
+    return;
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF2);
+
+  /* The publisher preempts this handler: hand over under the mask */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (reply_sending) {
+    reply_sending = 0;
+    replies = replies + 1U;
+  } else {
+    sent = sent + 1U;
+  }
+
+  if (reply_pending) {
+    StartReply();
+  } else if (pending) {
+    pending = 0;
+    StartFrame(active ^ 1U);
+  } else {
+    tx_busy = 0;
+  }
+  __set_PRIMASK(primask);
+}
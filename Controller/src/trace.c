@@ -0,0 +1,238 @@
+/**
+ ******************************************************************************
+ * @file    trace.c
+ * @brief   Cycle-stamped enter/exit tracing with a USART binary dump
+ ******************************************************************************
+ *
+ * Ring slots carry a tag of (reservation index << 8) | event. The consumer
+ * only takes the slot at the tail once its tag holds the tail index, so a
+ * producer preempted between reserving and committing holds the drain back
+ * instead of sending a half-written event.
+ *
+ ******************************************************************************
+ */
+
+#include "trace.h"
+#include "main.h"
+
+/* ================ Private Defines ================ */
+
+#define TRACE_INDEX_MASK (TRACE_BUFFER_SIZE - 1U)
+#define TRACE_TAG_MASK 0x00FFFFFFU /* Index bits kept in a tag */
+
+#define TRACE_HEADER_LEN 6U
+#define TRACE_EVENT_LEN 5U
+#define TRACE_PACKET_LEN                                                       \
+  (TRACE_HEADER_LEN + TRACE_PACKET_EVENTS * TRACE_EVENT_LEN + 1U)
+
+/* USART3 is on APB1 (SYSCLK / 2) */
+#define TRACE_UART_CLOCK_HZ (SYSTEM_CLOCK_HZ / 2U)
+
+/* ================ Private Types ================ */
+
+typedef struct {
+  volatile uint32_t tag;
+  volatile uint32_t cycles;
+} Trace_Slot_t;
+
+/* ================ Private Variables ================ */
+
+static Trace_Slot_t ring[TRACE_BUFFER_SIZE];
+static volatile uint32_t head = 0; /* Next slot to reserve */
+static volatile uint32_t tail = 0; /* Next slot to send */
+static volatile uint32_t dropped = 0;
+
+static uint8_t tx_buf[TRACE_PACKET_LEN];
+static volatile uint8_t tx_busy = 0;
+static uint8_t tx_seq = 0;
+
+static volatile uint32_t sent = 0;
+static volatile uint32_t packets = 0;
+
+/* ================ Private Functions ================ */
+
+/**
+ * @brief  Increment a counter shared between interrupt priorities
+ */
+static void AtomicIncrement(volatile uint32_t *counter) {
+  uint32_t value;
+  do {
+    value = __LDREXW(counter);
+  } while (__STREXW(value + 1U, counter) != 0U);
+}
+
+/**
+ * @brief  Move committed events from the ring into tx_buf
+ * @retval Packet length in bytes, 0 if there was nothing to send
+ */
+static uint32_t Pack(void) {
+  uint8_t *p = &tx_buf[TRACE_HEADER_LEN];
+  uint32_t count = 0;
+
+  while (count < TRACE_PACKET_EVENTS) {
+    Trace_Slot_t *slot = &ring[tail & TRACE_INDEX_MASK];
+    uint32_t tag = slot->tag;
+
+    if ((tag >> 8) != (tail & TRACE_TAG_MASK))
+      break; /* Empty, or reserved but not committed yet */
+    __DMB();
+
+    uint32_t cycles = slot->cycles;
+    p[0] = (uint8_t)tag;
+    p[1] = (uint8_t)cycles;
+    p[2] = (uint8_t)(cycles >> 8);
+    p[3] = (uint8_t)(cycles >> 16);
+    p[4] = (uint8_t)(cycles >> 24);
+    p += TRACE_EVENT_LEN;
+
+    /* Slot is free for producers once the tail moves past it */
+    __DMB();
+    tail = tail + 1U;
+    count++;
+  }
+
+  if (count == 0)
+    return 0;
+
+  uint32_t lost = dropped;
+  tx_buf[0] = TRACE_SYNC_0;
+  tx_buf[1] = TRACE_SYNC_1;
+  tx_buf[2] = tx_seq++;
+  tx_buf[3] = (uint8_t)count;
+  tx_buf[4] = (uint8_t)lost;
+  tx_buf[5] = (uint8_t)(lost >> 8);
+
+  uint8_t checksum = 0;
+  for (uint8_t *q = &tx_buf[2]; q < p; q++)
+    checksum ^= *q;
+  *p++ = checksum;
+
+  sent = sent + count;
+  return (uint32_t)(p - tx_buf);
+}
+
+/**
+ * @brief  Send the next packet, or go idle if the ring is empty
+ */
+static void StartPacket(void) {
+  uint32_t length = Pack();
+
+  if (length == 0) {
+    tx_busy = 0;
+    return;
+  }
+
+  tx_busy = 1;
+  packets = packets + 1U;
+  CLEAR_BIT(DMA1_Channel2->CCR, DMA_CCR_EN);
+  WRITE_REG(DMA1_Channel2->CNDTR, length);
+  SET_BIT(DMA1_Channel2->CCR, DMA_CCR_EN);
+}
+
+/* ================ Public Functions ================ */
+
+/**
+ * @brief  Start the DWT cycle counter and configure USART3 TX with DMA
+ */
+void Trace_Init(void) {
+  /* Slot tags must not match an index before their first commit */
+  for (uint32_t i = 0; i < TRACE_BUFFER_SIZE; i++)
+    ring[i].tag = 0xFFFFFFFFU;
+  head = 0;
+  tail = 0;
+  dropped = 0;
+  sent = 0;
+  packets = 0;
+  tx_busy = 0;
+
+  /* DWT cycle counter */
+  SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+  SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+  /* Enable clocks */
+  SET_BIT(RCC->APB2ENR, RCC_APB2ENR_IOPBEN);   /* GPIOB */
+  SET_BIT(RCC->APB1ENR, RCC_APB1ENR_USART3EN); /* USART3 */
+  SET_BIT(RCC->AHBENR, RCC_AHBENR_DMA1EN);     /* DMA1 */
+
+  /* PB10 (TX): alternate function push-pull, 50MHz */
+  MODIFY_REG(GPIOB->CRH, GPIO_CRH_MODE10 | GPIO_CRH_CNF10,
+             GPIO_CRH_MODE10 | GPIO_CRH_CNF10_1);
+
+  /* USART3: 8N1, TX only, DMA transmit */
+  WRITE_REG(USART3->CR1, 0);
+  WRITE_REG(USART3->BRR,
+            (TRACE_UART_CLOCK_HZ + TRACE_UART_BAUD / 2U) / TRACE_UART_BAUD);
+  WRITE_REG(USART3->CR3, USART_CR3_DMAT);
+  WRITE_REG(USART3->CR1, USART_CR1_UE | USART_CR1_TE);
+
+  /* DMA1 Channel 2: memory -> USART3_DR, byte-wide, complete interrupt */
+  WRITE_REG(DMA1_Channel2->CCR, 0);
+  WRITE_REG(DMA1_Channel2->CPAR, (uint32_t)(uintptr_t)&USART3->DR);
+  WRITE_REG(DMA1_Channel2->CMAR, (uint32_t)(uintptr_t)tx_buf);
+  WRITE_REG(DMA1_Channel2->CCR, DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE);
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF2);
+
+  NVIC_SetPriority(DMA1_Channel2_IRQn, TRACE_IRQ_PRIORITY);
+  NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+
+/**
+ * @brief  Record an event
+ */
+void Trace_Record(uint8_t event) {
+  uint32_t cycles = DWT->CYCCNT;
+  uint32_t index;
+
+  /* Reserve a slot; a preempting producer makes the STREX fail and retry */
+  do {
+    index = __LDREXW(&head);
+    if (index - tail >= TRACE_BUFFER_SIZE) {
+      __CLREX();
+      AtomicIncrement(&dropped);
+      return;
+    }
+  } while (__STREXW(index + 1U, &head) != 0U);
+
+  Trace_Slot_t *slot = &ring[index & TRACE_INDEX_MASK];
+  slot->cycles = cycles;
+  __DMB();
+  slot->tag = (index << 8) | event; /* Commit */
+}
+
+/**
+ * @brief  Start sending buffered events if the USART is idle
+ */
+void Trace_Flush(void) {
+  /* The DMA interrupt only runs while a packet is in flight */
+  if (!tx_busy)
+    StartPacket();
+}
+
+/**
+ * @brief  Check whether a packet is being sent
+ */
+uint8_t Trace_IsBusy(void) { return tx_busy; }
+
+/**
+ * @brief  Get trace statistics
+ */
+void Trace_GetStats(Trace_Stats_t *out) {
+  out->recorded = head;
+  out->dropped = dropped;
+  out->sent = sent;
+  out->packets = packets;
+}
+
+/* ================ Interrupt Handlers ================ */
+
+/**
+ * @brief  DMA1 channel 2 interrupt handler (USART3 TX complete)
+ */
+void Trace_DMA1_Channel2_Handler(void) {
+  if (!READ_BIT(DMA1->ISR, DMA_ISR_TCIF2))
+    return;
+  WRITE_REG(DMA1->IFCR, DMA_IFCR_CGIF2);
+
+  /* Chain the next packet while events remain */
+  StartPacket();
+}
@@ -0,0 +1,372 @@
+#!/usr/bin/env python3
+"""
+Controller telemetry decoder
+Decodes the COBS-framed telemetry stream sent by telemetry.c on USART3
+(921600 baud) into a CSV with one row per control tick.
+
+Frame format (see telemetry.h):
+  COBS(frame | crc u32) | 0x00
+  frame (64 bytes, little-endian):
+    timestamp u32 | seq u16 | dropped u16 |
+    speed_left, speed_right, setpoint, heading f32 |
+    pid[3][3] f32 (P, I, D for left speed, right speed, heading) |
+    motor_left, motor_right i16
+  crc: STM32 CRC unit (CRC-32 0x04C11DB7, init 0xFFFFFFFF, MSB first,
+       no reflection) over the frame as 16 little-endian words
+
+Parameter server replies (param_server.h) share the stream:
+  COBS(text, zero-padded to whole words | crc u32) | 0x00
+
+Usage:
+  telemetry_decode.py capture.bin --csv telemetry.csv
+  telemetry_decode.py --port /dev/ttyUSB0 --seconds 5 --csv telemetry.csv
+  telemetry_decode.py --port /dev/ttyUSB0 --command 'set speed.kp=1.5'
+  telemetry_decode.py --self-test            (decode synthetic streams)
+"""
+
+import argparse
+import csv
+import random
+import struct
+import sys
+from typing import List, Optional, Tuple
+
+# Configuration
+CLOCK_HZ = 72_000_000
+BAUD_RATE = 921600
+
+FRAME_FORMAT = '<IHH4f9f2h'
+FRAME_LEN = struct.calcsize(FRAME_FORMAT)
+PAYLOAD_LEN = FRAME_LEN + 4
+REPLY_MAX = 60  # TELEMETRY_REPLY_MAX
+
+FIELDS = (['timestamp', 'seq', 'dropped', 'speed_left', 'speed_right',
+           'setpoint', 'heading'] +
+          [f'{loop}_{term}' for loop in ('left', 'right', 'heading')
+           for term in ('p', 'i', 'd')] +
+          ['motor_left', 'motor_right'])
+
+Frame = Tuple
+
+
+def _crc_table() -> List[int]:
+    table = []
+    for i in range(256):
+        crc = i << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+        table.append(crc & 0xFFFFFFFF)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def stm32_crc(data: bytes) -> int:
+    """CRC unit result for data fed as little-endian words"""
+    crc = 0xFFFFFFFF
+    for i in range(0, len(data), 4):
+        for byte in reversed(data[i:i + 4]):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC_TABLE[(crc >> 24) ^ byte]
+    return crc
+
+
+def cobs_encode(data: bytes) -> bytes:
+    """COBS encode exactly as telemetry.c does (no delimiter)"""
+    out = bytearray([0])
+    code_at = 0
+    run = 1
+    for byte in data:
+        if byte == 0:
+            out[code_at] = run
+            code_at = len(out)
+            out.append(0)
+            run = 1
+        else:
+            out.append(byte)
+            run += 1
+            if run == 0xFF:
+                out[code_at] = run
+                code_at = len(out)
+                out.append(0)
+                run = 1
+    out[code_at] = run
+    return bytes(out)
+
+
+def cobs_decode(data: bytes) -> Optional[bytes]:
+    """COBS decode, None if malformed"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        block = data[i:i + code - 1]
+        if 0 in block:
+            return None
+        out += block
+        i += code - 1
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(values: Frame) -> bytes:
+    """Build a frame on the wire exactly as telemetry.c does"""
+    frame = struct.pack(FRAME_FORMAT, *values)
+    return cobs_encode(frame + struct.pack('<I', stm32_crc(frame))) + b'\x00'
+
+
+def encode_reply(text: str) -> bytes:
+    """Build a reply on the wire exactly as telemetry.c does"""
+    data = text.encode('ascii')
+    data += bytes(-len(data) % 4)
+    return cobs_encode(data + struct.pack('<I', stm32_crc(data))) + b'\x00'
+
+
+class FrameParser:
+    """Split a byte stream on delimiters and check each frame"""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.frames = 0
+        self.bad_frames = 0      # COBS, length or CRC errors
+        self.lost_frames = 0     # Sequence number gaps
+        self.target_dropped = 0  # Frames replaced on target before sending
+        self.replies: List[str] = []
+        self._synced = False
+        self._last_seq: Optional[int] = None
+        self._last_dropped: Optional[int] = None
+
+    def feed(self, data: bytes) -> List[Frame]:
+        """Parse every complete frame in the buffered data"""
+        self.buffer += data
+        frames = []
+
+        while True:
+            end = self.buffer.find(0)
+            if end < 0:
+                break
+            chunk = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+
+            # The capture may start mid-frame: skip up to the first delimiter
+            if not self._synced:
+                self._synced = True
+                continue
+            if not chunk:
+                continue
+
+            payload = cobs_decode(chunk)
+            if (payload is None or len(payload) % 4 or
+                    not 4 < len(payload) <= max(PAYLOAD_LEN, REPLY_MAX + 4) or
+                    struct.unpack_from('<I', payload, len(payload) - 4)[0] !=
+                    stm32_crc(payload[:-4])):
+                self.bad_frames += 1
+                continue
+
+            # Replies are never the length of a frame
+            if len(payload) != PAYLOAD_LEN:
+                self.replies.append(payload[:-4].rstrip(b'\x00').decode(
+                    'ascii', 'replace'))
+                continue
+
+            values = struct.unpack_from(FRAME_FORMAT, payload)
+            seq, dropped = values[1], values[2]
+            if self._last_seq is not None:
+                self.lost_frames += (seq - self._last_seq - 1) & 0xFFFF
+            if self._last_dropped is not None:
+                self.target_dropped += (dropped - self._last_dropped) & 0xFFFF
+            self._last_seq = seq
+            self._last_dropped = dropped
+
+            self.frames += 1
+            frames.append(values)
+
+        return frames
+
+
+def decode(data: bytes) -> Tuple[FrameParser, List[Frame]]:
+    """Decode a complete capture"""
+    parser = FrameParser()
+    return parser, parser.feed(b'\x00' + data if data[:1] != b'\x00' and
+                               data else data)
+
+
+# ================ Synthetic Streams ================
+
+def synthesize(seed: int, count: int) -> List[Frame]:
+    """Frames as a 1kHz control loop would publish them"""
+    rng = random.Random(seed)
+    frames = []
+    for n in range(count):
+        pid = [float(rng.choice([0.0, rng.uniform(-500.0, 500.0)]))
+               for _ in range(9)]
+        frames.append(
+            ((0xFFFFFFFF - 5_000_000 + n * (CLOCK_HZ // 1000)) & 0xFFFFFFFF,
+             n & 0xFFFF, 0, rng.uniform(0.0, 800.0), rng.uniform(0.0, 800.0),
+             500.0, rng.uniform(-2.0, 2.0), *pid,
+             rng.randint(-1000, 1000), rng.randint(-1000, 1000)))
+    return frames
+
+
+def same(a: Frame, b: Frame) -> bool:
+    """Compare frames after a float32 round trip"""
+    return struct.pack(FRAME_FORMAT, *a) == struct.pack(FRAME_FORMAT, *b)
+
+
+def self_test() -> int:
+    """Decode synthetic streams and check the results"""
+    checks = 0
+
+    def check(condition: bool, message: str):
+        nonlocal checks
+        if not condition:
+            raise AssertionError(message)
+        checks += 1
+
+    # COBS block boundaries and zero runs
+    rng = random.Random(0)
+    for length in (0, 1, 2, 253, 254, 255, 508, 509, 600):
+        for data in (bytes(length), bytes(1 + i % 255 for i in range(length)),
+                     bytes(rng.choice([0, rng.randrange(1, 256)])
+                           for _ in range(length))):
+            encoded = cobs_encode(data)
+            check(0 not in encoded, 'zero in COBS output')
+            check(len(encoded) <= length + length // 254 + 1, 'COBS overhead')
+            check(cobs_decode(encoded) == data, 'COBS round trip')
+
+    # CRC unit reference value (one word 0x00000000 after reset)
+    check(stm32_crc(bytes(4)) == 0xC704DD7B, 'CRC reference')
+
+    for seed in range(3):
+        frames = synthesize(seed, 500)
+        data = b''.join(encode_frame(frame) for frame in frames)
+
+        # Clean stream
+        parser, decoded = decode(data)
+        check(len(decoded) == len(frames), 'frame count')
+        check(all(same(a, b) for a, b in zip(frames, decoded)),
+              'frames differ')
+        check(parser.bad_frames == 0 and parser.lost_frames == 0,
+              'clean stream flagged errors')
+
+        # Byte-at-a-time feeding gives the same result
+        parser = FrameParser()
+        fed = sum(len(parser.feed(bytes([byte])))
+                  for byte in b'\x00' + data)
+        check(fed == len(frames), 'streamed decode lost frames')
+
+        # Capture starting mid-frame, then a corrupted frame
+        corrupt = bytearray(data)
+        corrupt[len(corrupt) // 2] ^= 0x10
+        parser, decoded = decode(bytes(corrupt[37:]))
+        check(parser.bad_frames + parser.lost_frames >= 1,
+              'corruption not detected')
+        check(len(decoded) >= len(frames) - 3, 'more frames lost than hit')
+        truth = {struct.pack(FRAME_FORMAT, *frame) for frame in frames}
+        check(all(struct.pack(FRAME_FORMAT, *frame) in truth
+                  for frame in decoded), 'corruption produced phantom frames')
+
+        # Replies between frames are split out; frames are unaffected
+        texts = ['ok', 'speed.kp=1.5', 'err unknown name', 'x' * REPLY_MAX]
+        mixed = b''.join(encode_frame(frame) +
+                         (encode_reply(texts[n % 4]) if n % 50 == 0 else b'')
+                         for n, frame in enumerate(frames))
+        parser, decoded = decode(mixed)
+        check(len(decoded) == len(frames) and parser.bad_frames == 0 and
+              parser.lost_frames == 0, 'replies disturbed frames')
+        check(parser.replies == [texts[n % 4] for n in range(0, 500, 50)],
+              'replies differ')
+
+        # Frames dropped on target are reported, including the 16-bit wrap
+        dropped = [frame[:2] + ((n // 100) * 30000 & 0xFFFF,) + frame[3:]
+                   for n, frame in enumerate(frames)]
+        parser, _ = decode(b''.join(encode_frame(f) for f in dropped))
+        check(parser.target_dropped == 4 * 30000, 'target drops miscounted')
+
+    print(f'self-test: {checks} checks passed')
+    return 0
+
+
+# ================ Main Program ================
+
+def read_serial(port: str, baudrate: int, seconds: float,
+                commands: List[str]) -> bytes:
+    """Send parameter server commands, then capture raw bytes"""
+    import time
+
+    import serial
+
+    data = bytearray()
+    with serial.Serial(port, baudrate, timeout=0.1) as ser:
+        # One reply waits on target at a time: wait for each before the next
+        for command in commands:
+            ser.write(command.encode('ascii') + b'\n')
+            data += ser.read(4096)
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            data += ser.read(4096)
+    return bytes(data)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('capture', nargs='?', help='Binary capture file')
+    parser.add_argument('--port', help='Read from a serial port instead')
+    parser.add_argument('--baud', type=int, default=BAUD_RATE)
+    parser.add_argument('--seconds', type=float, default=5.0,
+                        help='Serial capture time')
+    parser.add_argument('--clock-hz', type=float, default=CLOCK_HZ)
+    parser.add_argument('--csv', help='Write one row per frame')
+    parser.add_argument('--command', action='append', default=[],
+                        help='Parameter server line to send (with --port)')
+    parser.add_argument('--self-test', action='store_true',
+                        help='Decode synthetic streams and check the results')
+    args = parser.parse_args()
+
+    if args.self_test:
+        return self_test()
+
+    if args.port:
+        data = read_serial(args.port, args.baud, args.seconds, args.command)
+    elif args.capture:
+        with open(args.capture, 'rb') as f:
+            data = f.read()
+    else:
+        parser.error('give a capture file or --port')
+
+    frames_parser, frames = decode(data)
+    span = 0.0
+    if len(frames) > 1:
+        cycles = (frames[-1][0] - frames[0][0]) & 0xFFFFFFFF
+        span = cycles / args.clock_hz
+    print(f'frames={frames_parser.frames} '
+          f'bad_frames={frames_parser.bad_frames} '
+          f'lost_frames={frames_parser.lost_frames} '
+          f'target_dropped={frames_parser.target_dropped} '
+          f'rate_hz={(len(frames) - 1) / span if span > 0 else 0.0:.1f}')
+    for reply in frames_parser.replies:
+        print(f'reply: {reply}')
+
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            writer = csv.writer(f)
+            writer.writerow(['t'] + FIELDS[1:])
+            now = 0
+            last = frames[0][0] if frames else 0
+            for frame in frames:
+                now += (frame[0] - last) & 0xFFFFFFFF
+                last = frame[0]
+                writer.writerow([f'{now / args.clock_hz:.6f}'] +
+                                [f'{v:.4f}' if isinstance(v, float) else v
+                                 for v in frame[1:]])
+        print(f'✓ Wrote {len(frames)} frames to {args.csv}')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,505 @@
+#!/usr/bin/env python3
+"""
+Controller trace decoder
+Decodes the binary trace dump sent by trace.c on USART3 (921600 baud) into
+per-function latency histograms and a Chrome/Perfetto trace JSON.
+
+Packet format (little-endian, see trace.h):
+  0xA5 0x5A | seq u8 | count u8 | dropped u16 |
+  count x (event u8, cycles u32) | checksum u8
+
+Usage:
+  trace_decode.py capture.bin --json trace.json
+  trace_decode.py --port /dev/ttyUSB0 --seconds 5 --json trace.json
+  trace_decode.py --synthetic capture.bin    (write a synthetic capture)
+  trace_decode.py --self-test                (decode synthetic traces)
+
+Open the JSON in https://ui.perfetto.dev or chrome://tracing.
+"""
+
+import argparse
+import json
+import random
+import struct
+import sys
+from typing import Dict, List, Optional, Tuple
+
+# Configuration
+CLOCK_HZ = 72_000_000
+BAUD_RATE = 921600
+
+SYNC = b'\xa5\x5a'
+HEADER_LEN = 6
+EVENT_LEN = 5
+EVENT_EXIT = 0x80
+PACKET_EVENTS = 64
+
+# Trace_Id_t order in trace.h
+TRACE_NAMES = [
+    'control_loop_isr',
+    'drive_update',
+    'imu_update',
+    'encoder_left_isr',
+    'encoder_right_isr',
+    'imu_i2c_isr',
+    'imu_dma_isr',
+    'attitude_update',
+    'odometry_update',
+    'drive_pid',
+]
+
+Event = Tuple[int, int]     # (event byte, 32-bit cycle stamp)
+Span = Tuple[int, int, int]  # (trace id, start, end) in unwrapped cycles
+
+
+def trace_name(trace_id: int) -> str:
+    """Name of a trace id (unknown ids keep their number)"""
+    if trace_id < len(TRACE_NAMES):
+        return TRACE_NAMES[trace_id]
+    return f'id_{trace_id}'
+
+
+def checksum(data: bytes) -> int:
+    """XOR of all bytes"""
+    value = 0
+    for byte in data:
+        value ^= byte
+    return value
+
+
+def encode_packet(seq: int, dropped: int, events: List[Event]) -> bytes:
+    """Build a packet exactly as trace.c does"""
+    body = struct.pack('<BBH', seq & 0xFF, len(events), dropped & 0xFFFF)
+    for event, cycles in events:
+        body += struct.pack('<BI', event, cycles & 0xFFFFFFFF)
+    return SYNC + body + bytes([checksum(body)])
+
+
+class PacketParser:
+    """Split a byte stream into trace packets, resynchronising on errors"""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.packets = 0
+        self.events = 0
+        self.bad_checksums = 0
+        self.skipped_bytes = 0
+        self.lost_packets = 0    # Sequence number gaps
+        self.target_dropped = 0  # Events lost to a full ring on target
+        self._last_seq: Optional[int] = None
+        self._last_dropped: Optional[int] = None
+
+    def feed(self, data: bytes) -> List[Tuple[bool, List[Event]]]:
+        """
+        Parse as many packets as the buffered data holds
+
+        Returns:
+            List of (gap, events); gap is True when events were lost
+            just before this packet (bad packet, sequence gap, target drop)
+        """
+        self.buffer += data
+        packets = []
+        gap = False
+
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # Keep a trailing first sync byte
+                keep = 1 if self.buffer[-1:] == SYNC[:1] else 0
+                self.skipped_bytes += len(self.buffer) - keep
+                del self.buffer[:len(self.buffer) - keep]
+                break
+            if start > 0:
+                self.skipped_bytes += start
+                del self.buffer[:start]
+            if len(self.buffer) < HEADER_LEN:
+                break
+
+            seq, count, dropped = struct.unpack_from('<BBH', self.buffer, 2)
+            length = HEADER_LEN + count * EVENT_LEN + 1
+            if count == 0:
+                self._skip_sync()
+                continue
+            if len(self.buffer) < length:
+                break
+            if checksum(self.buffer[2:length - 1]) != self.buffer[length - 1]:
+                self.bad_checksums += 1
+                self._skip_sync()
+                gap = True
+                continue
+
+            if self._last_seq is not None:
+                missing = (seq - self._last_seq - 1) & 0xFF
+                self.lost_packets += missing
+                gap = gap or missing > 0
+            if self._last_dropped is not None:
+                lost = (dropped - self._last_dropped) & 0xFFFF
+                self.target_dropped += lost
+                gap = gap or lost > 0
+            self._last_seq = seq
+            self._last_dropped = dropped
+
+            events = [struct.unpack_from('<BI', self.buffer,
+                                         HEADER_LEN + i * EVENT_LEN)
+                      for i in range(count)]
+            del self.buffer[:length]
+            self.packets += 1
+            self.events += count
+            packets.append((gap, events))
+            gap = False
+
+        return packets
+
+    def _skip_sync(self):
+        """Drop a false sync word and search again"""
+        self.skipped_bytes += 1
+        del self.buffer[:1]
+
+
+class Timeline:
+    """Unwrap 32-bit cycle stamps and pair enter/exit events into spans"""
+
+    def __init__(self):
+        self.spans: List[Span] = []
+        self.unmatched = 0  # Enters or exits without a partner
+        self._last: Optional[int] = None
+        self._now = 0
+        self._open: Dict[int, int] = {}
+
+    def add(self, event: int, cycles: int):
+        """Add one event in the order it was committed"""
+        if self._last is not None:
+            # Signed: a producer preempted between stamping and committing
+            # commits after events stamped later
+            delta = (cycles - self._last) & 0xFFFFFFFF
+            if delta >= 0x80000000:
+                delta -= 1 << 32
+            self._now += delta
+        else:
+            self._now = cycles
+        self._last = cycles
+
+        trace_id = event & ~EVENT_EXIT
+        if event & EVENT_EXIT:
+            start = self._open.pop(trace_id, None)
+            if start is None:
+                self.unmatched += 1
+            else:
+                self.spans.append((trace_id, start, self._now))
+        else:
+            # Handlers do not nest with themselves: an open enter lost its exit
+            if trace_id in self._open:
+                self.unmatched += 1
+            self._open[trace_id] = self._now
+
+    def break_pairs(self):
+        """Forget open enters after events were lost"""
+        self.unmatched += len(self._open)
+        self._open.clear()
+
+
+def decode(data: bytes) -> Tuple[PacketParser, Timeline]:
+    """Decode a complete capture"""
+    parser = PacketParser()
+    timeline = Timeline()
+    for gap, events in parser.feed(data):
+        if gap:
+            timeline.break_pairs()
+        for event, cycles in events:
+            timeline.add(event, cycles)
+    return parser, timeline
+
+
+# ================ Reports ================
+
+def percentile(values: List[int], fraction: float) -> int:
+    """Nearest-rank percentile of sorted values"""
+    index = min(len(values) - 1, max(0, int(round(fraction * len(values))) - 1))
+    return values[index]
+
+
+def latency_report(spans: List[Span], clock_hz: float) -> str:
+    """Per-function latency table and log2 cycle histograms"""
+    us = 1e6 / clock_hz
+    by_id: Dict[int, List[int]] = {}
+    for trace_id, start, end in spans:
+        by_id.setdefault(trace_id, []).append(end - start)
+
+    lines = [f"{'function':<18} {'calls':>7} {'min_us':>9} {'mean_us':>9} "
+             f"{'p50_us':>9} {'p99_us':>9} {'max_us':>9}"]
+    for trace_id in sorted(by_id):
+        values = sorted(by_id[trace_id])
+        mean = sum(values) / len(values)
+        lines.append(f'{trace_name(trace_id):<18} {len(values):>7} '
+                     f'{values[0] * us:>9.2f} {mean * us:>9.2f} '
+                     f'{percentile(values, 0.5) * us:>9.2f} '
+                     f'{percentile(values, 0.99) * us:>9.2f} '
+                     f'{values[-1] * us:>9.2f}')
+
+    for trace_id in sorted(by_id):
+        values = by_id[trace_id]
+        buckets: Dict[int, int] = {}
+        for value in values:
+            bucket = value.bit_length()  # 0, then [2^(k-1), 2^k)
+            buckets[bucket] = buckets.get(bucket, 0) + 1
+        peak = max(buckets.values())
+        lines.append('')
+        lines.append(f'{trace_name(trace_id)} (cycles)')
+        for bucket in range(min(buckets), max(buckets) + 1):
+            low = 0 if bucket == 0 else 1 << (bucket - 1)
+            high = 1 if bucket == 0 else 1 << bucket
+            count = buckets.get(bucket, 0)
+            bar = '#' * ((40 * count + peak - 1) // peak)
+            lines.append(f'  [{low:>8}, {high:>8}) {count:>7} {bar}')
+
+    return '\n'.join(lines)
+
+
+def chrome_trace(spans: List[Span], clock_hz: float) -> dict:
+    """Chrome/Perfetto trace events, one track per traced function"""
+    origin = min((start for _, start, _ in spans), default=0)
+    us = 1e6 / clock_hz
+    events = [{'name': 'process_name', 'ph': 'M', 'pid': 1,
+               'args': {'name': 'controller'}}]
+
+    for trace_id in sorted({span[0] for span in spans}):
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 1,
+                       'tid': trace_id + 1,
+                       'args': {'name': trace_name(trace_id)}})
+
+    for trace_id, start, end in sorted(spans, key=lambda span: span[1]):
+        name = trace_name(trace_id)
+        events.append({'name': name,
+                       'cat': 'isr' if name.endswith('_isr') else 'task',
+                       'ph': 'X', 'pid': 1, 'tid': trace_id + 1,
+                       'ts': (start - origin) * us,
+                       'dur': (end - start) * us,
+                       'args': {'cycles': end - start}})
+
+    return {'traceEvents': events, 'displayTimeUnit': 'ns'}
+
+
+# ================ Synthetic Traces ================
+
+def synthesize(seed: int, seconds: float = 1.0,
+               start: int = 0xFFFFFFFF - 20_000_000) -> Tuple[List[Event],
+                                                               List[Span]]:
+    """
+    Generate the events a target would commit, and the spans they describe
+
+    100Hz control loop ISR -> drive update -> IMU update, encoder ISRs
+    preempting at random, I2C/DMA ISRs. The cycle counter wraps early on,
+    and some encoder events are committed before an earlier-stamped event
+    (producer preempted between stamping and committing).
+    """
+    rng = random.Random(seed)
+    spans: List[Span] = []
+    period = CLOCK_HZ // 100
+    end = start + int(seconds * CLOCK_HZ)
+
+    tick = start
+    while tick < end:
+        isr = rng.randint(2500, 4000)
+        drive = isr - rng.randint(200, 400)
+        imu = rng.randint(300, 900)
+        spans.append((0, tick, tick + isr))
+        spans.append((1, tick + 100, tick + 100 + drive))
+        spans.append((2, tick + 400, tick + 400 + imu))
+        i2c = tick + rng.randint(5000, 6000)
+        for _ in range(4):
+            spans.append((5, i2c, i2c + rng.randint(150, 300)))
+            i2c += 1800
+        spans.append((6, i2c, i2c + rng.randint(100, 200)))
+        tick += period
+
+    for trace_id in (3, 4):
+        t = start + rng.randint(0, 10_000)
+        while t < end:
+            duration = rng.randint(40, 120)
+            spans.append((trace_id, t, t + duration))
+            t += duration + rng.randint(2_000, 60_000)
+
+    stamped = []
+    for trace_id, t0, t1 in spans:
+        stamped.append((t0, 0, trace_id))
+        stamped.append((t1, 1, trace_id))
+    stamped.sort()
+    events = [((trace_id | EVENT_EXIT) if exit_flag else trace_id, t)
+              for t, exit_flag, trace_id in stamped]
+
+    # Late commits: [A, enc enter, enc exit] -> [enc enter, enc exit, A]
+    i = 1
+    while i + 1 < len(events):
+        event = events[i][0]
+        if (event in (3, 4) and events[i + 1][0] == event | EVENT_EXIT and
+                events[i - 1][0] & ~EVENT_EXIT not in (3, 4) and
+                rng.random() < 0.3):
+            events[i - 1:i + 2] = [events[i], events[i + 1], events[i - 1]]
+            i += 3
+        else:
+            i += 1
+
+    events = [(event, cycles & 0xFFFFFFFF) for event, cycles in events]
+    return events, spans
+
+
+def packetize(events: List[Event], rng: random.Random,
+              drops: Optional[List[int]] = None) -> bytes:
+    """Split events into packets; drops[i] events lost before packet i"""
+    data = b''
+    seq = 0
+    dropped = 0
+    i = 0
+    while i < len(events):
+        if drops and seq < len(drops):
+            dropped += drops[seq]
+        count = rng.randint(1, PACKET_EVENTS)
+        data += encode_packet(seq, dropped, events[i:i + count])
+        i += count
+        seq += 1
+    return data
+
+
+def span_key(spans: List[Span]) -> List[Tuple[int, int]]:
+    """Spans as (id, duration) sorted by start, independent of the origin"""
+    return [(trace_id, end - start)
+            for trace_id, start, end in sorted(spans, key=lambda s: (s[1], s[0]))]
+
+
+def self_test() -> int:
+    """Decode synthetic traces and check the results"""
+    checks = 0
+
+    def check(condition: bool, message: str):
+        nonlocal checks
+        if not condition:
+            raise AssertionError(message)
+        checks += 1
+
+    for seed in range(3):
+        rng = random.Random(seed)
+        events, spans = synthesize(seed)
+
+        # Clean stream, counter wrap and late commits
+        parser, timeline = decode(packetize(events, rng))
+        check(parser.events == len(events), 'event count')
+        check(parser.bad_checksums == 0 and parser.skipped_bytes == 0,
+              'clean stream flagged errors')
+        check(timeline.unmatched == 0, 'unmatched events in clean stream')
+        check(span_key(timeline.spans) == span_key(spans),
+              'spans differ from the generated ones')
+
+        # Byte-at-a-time feeding gives the same result
+        data = packetize(events, random.Random(seed))
+        parser = PacketParser()
+        fed = sum(len(batch) for byte in data
+                  for _, batch in parser.feed(bytes([byte])))
+        check(fed == len(events), 'streamed decode lost events')
+
+        # Noise between packets and a corrupted packet
+        data = bytearray(packetize(events, random.Random(seed)))
+        corrupt = len(data) // 2
+        data[corrupt] ^= 0x5A
+        noisy = bytes(rng.randrange(256) for _ in range(37)) + bytes(data)
+        parser, timeline = decode(noisy)
+        check(parser.bad_checksums >= 1 or parser.lost_packets >= 1,
+              'corruption not detected')
+        check(parser.skipped_bytes >= 37, 'noise not skipped')
+        truth = set(span_key(spans))
+        check(all(key in truth for key in span_key(timeline.spans)),
+              'corruption produced phantom spans')
+        check(len(timeline.spans) >=
+              len(spans) - PACKET_EVENTS - len(TRACE_NAMES),
+              'more spans lost than one packet holds')
+
+        # Events dropped on target are reported
+        drops = [0] * 200
+        drops[50] = 7
+        drops[120] = 40000
+        drops[121] = 40000  # Wraps the 16-bit field
+        parser, _ = decode(packetize(events, random.Random(seed), drops))
+        check(parser.target_dropped == 80007, 'target drops miscounted')
+
+    # JSON is well formed and keeps durations
+    events, spans = synthesize(7, seconds=0.05)
+    _, timeline = decode(packetize(events, random.Random(7)))
+    trace = json.loads(json.dumps(chrome_trace(timeline.spans, CLOCK_HZ)))
+    complete = [e for e in trace['traceEvents'] if e['ph'] == 'X']
+    check(len(complete) == len(spans), 'JSON span count')
+    check(sum(e['args']['cycles'] for e in complete) ==
+          sum(end - start for _, start, end in spans), 'JSON durations')
+
+    print(f'self-test: {checks} checks passed')
+    return 0
+
+
+# ================ Main Program ================
+
+def read_serial(port: str, baudrate: int, seconds: float) -> bytes:
+    """Capture raw bytes from a serial port"""
+    import time
+
+    import serial
+
+    data = bytearray()
+    with serial.Serial(port, baudrate, timeout=0.1) as ser:
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            data += ser.read(4096)
+    return bytes(data)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('capture', nargs='?', help='Binary capture file')
+    parser.add_argument('--port', help='Read from a serial port instead')
+    parser.add_argument('--baud', type=int, default=BAUD_RATE)
+    parser.add_argument('--seconds', type=float, default=5.0,
+                        help='Serial capture time')
+    parser.add_argument('--clock-hz', type=float, default=CLOCK_HZ)
+    parser.add_argument('--json', help='Write Chrome/Perfetto trace JSON')
+    parser.add_argument('--synthetic', metavar='FILE',
+                        help='Write a synthetic capture and exit')
+    parser.add_argument('--self-test', action='store_true',
+                        help='Decode synthetic traces and check the results')
+    args = parser.parse_args()
+
+    if args.self_test:
+        return self_test()
+
+    if args.synthetic:
+        events, _ = synthesize(seed=1)
+        with open(args.synthetic, 'wb') as f:
+            f.write(packetize(events, random.Random(1)))
+        print(f'✓ Wrote {len(events)} events to {args.synthetic}')
+        return 0
+
+    if args.port:
+        data = read_serial(args.port, args.baud, args.seconds)
+    elif args.capture:
+        with open(args.capture, 'rb') as f:
+            data = f.read()
+    else:
+        parser.error('give a capture file or --port')
+
+    packets, timeline = decode(data)
+    print(f'packets={packets.packets} events={packets.events} '
+          f'bad_checksums={packets.bad_checksums} '
+          f'lost_packets={packets.lost_packets} '
+          f'target_dropped={packets.target_dropped} '
+          f'skipped_bytes={packets.skipped_bytes} '
+          f'unmatched={timeline.unmatched}')
+    if timeline.spans:
+        print()
+        print(latency_report(timeline.spans, args.clock_hz))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(chrome_trace(timeline.spans, args.clock_hz), f)
+        print(f'\n✓ Wrote {len(timeline.spans)} spans to {args.json}')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -222,6 +222,7 @@
 
 #define CLOCK_BUS_HIGH RCC->AHBENR
 #define DMACLOCK_ENABLE (1 << 0)
+#define DMA2CLOCK_ENABLE (1 << 1)
 
 /* --- DMA_CCRx generic values --------------------------------------------- */
 /* MEM2MEM: Memory to memory mode */
@@ -340,4 +341,105 @@ dma_set_memory_address(u32 dma, u8 channel, u32 address);
 void
 dma_set_number_of_data(u32 dma, u8 channel, u16 number);
 
+/* --- Channel manager ----------------------------------------------------- */
+/* Each channel serves several peripherals (RM0008 tables 78 and 79) but only one at a time.
+   A driver claims the channel through its request, then submits transfer descriptors that the
+   manager runs one after the other: the next starts from the interrupt of the previous, so
+   transfers chain back-to-back without the main loop. The channel interrupts (defined in
+   dma.c) report TC/HT/TE to the descriptor's callback.
+   Requests: controller, channel, and a number telling apart the requests of the channel. */
+#define DMA_REQ(dma_n, channel, n) (((dma_n) << 8) | ((channel) << 4) | (n))
+#define DMA_REQ_CONTROLLER(req) (((req) >> 8) & 0xF)
+#define DMA_REQ_CHANNEL(req) (((req) >> 4) & 0xF)
+
+/* DMA1 */
+#define DMA_REQ_ADC1 DMA_REQ(1, 1, 0)
+#define DMA_REQ_TIM2_CH3 DMA_REQ(1, 1, 1)
+#define DMA_REQ_TIM4_CH1 DMA_REQ(1, 1, 2)
+#define DMA_REQ_SPI1_RX DMA_REQ(1, 2, 0)
+#define DMA_REQ_USART3_TX DMA_REQ(1, 2, 1)
+#define DMA_REQ_TIM1_CH1 DMA_REQ(1, 2, 2)
+#define DMA_REQ_TIM2_UP DMA_REQ(1, 2, 3)
+#define DMA_REQ_TIM3_CH3 DMA_REQ(1, 2, 4)
+#define DMA_REQ_SPI1_TX DMA_REQ(1, 3, 0)
+#define DMA_REQ_USART3_RX DMA_REQ(1, 3, 1)
+#define DMA_REQ_TIM1_CH2 DMA_REQ(1, 3, 2)
+#define DMA_REQ_TIM3_CH4_UP DMA_REQ(1, 3, 3)
+#define DMA_REQ_SPI2_RX DMA_REQ(1, 4, 0)
+#define DMA_REQ_USART1_TX DMA_REQ(1, 4, 1)
+#define DMA_REQ_I2C2_TX DMA_REQ(1, 4, 2)
+#define DMA_REQ_TIM1_CH4_TRIG_COM DMA_REQ(1, 4, 3)
+#define DMA_REQ_TIM4_CH2 DMA_REQ(1, 4, 4)
+#define DMA_REQ_SPI2_TX DMA_REQ(1, 5, 0)
+#define DMA_REQ_USART1_RX DMA_REQ(1, 5, 1)
+#define DMA_REQ_I2C2_RX DMA_REQ(1, 5, 2)
+#define DMA_REQ_TIM1_UP DMA_REQ(1, 5, 3)
+#define DMA_REQ_TIM2_CH1 DMA_REQ(1, 5, 4)
+#define DMA_REQ_TIM4_CH3 DMA_REQ(1, 5, 5)
+#define DMA_REQ_USART2_RX DMA_REQ(1, 6, 0)
+#define DMA_REQ_I2C1_TX DMA_REQ(1, 6, 1)
+#define DMA_REQ_TIM1_CH3 DMA_REQ(1, 6, 2)
+#define DMA_REQ_TIM3_CH1_TRIG DMA_REQ(1, 6, 3)
+#define DMA_REQ_USART2_TX DMA_REQ(1, 7, 0)
+#define DMA_REQ_I2C1_RX DMA_REQ(1, 7, 1)
+#define DMA_REQ_TIM2_CH2_CH4 DMA_REQ(1, 7, 2)
+#define DMA_REQ_TIM4_UP DMA_REQ(1, 7, 3)
+/* DMA2 (high-density devices) */
+#define DMA_REQ_SPI3_RX DMA_REQ(2, 1, 0)
+#define DMA_REQ_TIM5_CH4_TRIG DMA_REQ(2, 1, 1)
+#define DMA_REQ_TIM8_CH3_UP DMA_REQ(2, 1, 2)
+#define DMA_REQ_SPI3_TX DMA_REQ(2, 2, 0)
+#define DMA_REQ_TIM5_CH3_UP DMA_REQ(2, 2, 1)
+#define DMA_REQ_TIM8_CH4_TRIG_COM DMA_REQ(2, 2, 2)
+#define DMA_REQ_UART4_RX DMA_REQ(2, 3, 0)
+#define DMA_REQ_TIM6_UP_DAC1 DMA_REQ(2, 3, 1)
+#define DMA_REQ_TIM8_CH1 DMA_REQ(2, 3, 2)
+#define DMA_REQ_SDIO DMA_REQ(2, 4, 0)
+#define DMA_REQ_TIM5_CH2 DMA_REQ(2, 4, 1)
+#define DMA_REQ_TIM7_UP_DAC2 DMA_REQ(2, 4, 2)
+#define DMA_REQ_ADC3 DMA_REQ(2, 5, 0)
+#define DMA_REQ_UART4_TX DMA_REQ(2, 5, 1)
+#define DMA_REQ_TIM5_CH1 DMA_REQ(2, 5, 2)
+#define DMA_REQ_TIM8_CH2 DMA_REQ(2, 5, 3)
+
+/* Callback events: the channel's ISR flags */
+#define DMA_EVENT_TC DMA_ISR_TCIF_BIT
+#define DMA_EVENT_HT DMA_ISR_HTIF_BIT
+#define DMA_EVENT_TE DMA_ISR_TEIF_BIT
+
+typedef struct dma_xfer dma_xfer_t;
+
+/* Called from the channel interrupt. On TC (not circular) or TE the transfer is over, the
+   descriptor may be submitted again, and the next one queued has already started. */
+typedef void (*dma_callback_t)(dma_xfer_t *xfer, u32 events);
+
+/* Transfer descriptor, owned by the manager from dma_submit until its TC or TE (or an abort).
+   config: DMA_CCR_DIR, DMA_CCR_MINC/PINC, DMA_CCR_CIRC, sizes, priority, DMA_CCR_HTIE;
+   TCIE, TEIE and EN are the manager's. A circular transfer runs until aborted. */
+struct dma_xfer {
+	u32 peripheral;          /* peripheral register address */
+	u32 memory;              /* buffer address */
+	u16 count;               /* items to transfer */
+	u32 config;              /* DMA_CCR_* bits */
+	dma_callback_t callback; /* or 0 */
+	void *arg;               /* for the callback */
+	dma_xfer_t *next;        /* manager: queue link */
+	volatile u8 queued;      /* manager: 1 from dma_submit until done */
+};
+
+int
+dma_claim(u16 request);
+int
+dma_release(u16 request);
+u16
+dma_owner(u32 dma, u8 channel);
+int
+dma_submit(u16 request, dma_xfer_t *xfer);
+int
+dma_abort(u16 request);
+int
+dma_busy(u16 request);
+u16
+dma_remaining(u16 request);
+
 #endif
@@ -16,6 +16,32 @@
 #define I2C2_BASE (APB1PERIPH_BASE + 0x5800)
 #define I2C1 ((I2C_TypeDef *)I2C1_BASE)
 #define I2C2 ((I2C_TypeDef *)I2C2_BASE)
+/* Register bits used by the interrupt-driven engine */
+#define I2C_CR1_PE (1 << 0)
+#define I2C_CR1_START (1 << 8)
+#define I2C_CR1_STOP (1 << 9)
+#define I2C_CR1_ACK (1 << 10)
+#define I2C_CR1_POS (1 << 11)
+#define I2C_CR1_SWRST (1 << 15)
+#define I2C_CR2_FREQ_MASK 0x3F
+#define I2C_CR2_ITERREN (1 << 8)
+#define I2C_CR2_ITEVTEN (1 << 9)
+#define I2C_CR2_ITBUFEN (1 << 10)
+#define I2C_CR2_DMAEN (1 << 11)
+#define I2C_CR2_LAST (1 << 12)
+#define I2C_SR1_SB (1 << 0)
+#define I2C_SR1_ADDR (1 << 1)
+#define I2C_SR1_BTF (1 << 2)
+#define I2C_SR1_RXNE (1 << 6)
+#define I2C_SR1_TXE (1 << 7)
+#define I2C_SR1_BERR (1 << 8)
+#define I2C_SR1_ARLO (1 << 9)
+#define I2C_SR1_AF (1 << 10)
+#define I2C_SR1_OVR (1 << 11)
+#define I2C_SR1_TIMEOUT (1 << 14)
+#define I2C_SR2_BUSY (1 << 1)
+#define I2C_CCR_FS (1 << 15)
+
 #define enableI2C2Interrupt() I2C2->CR2 |= (1 << 9)
 #define disableI2C2Interrupt() I2C2->CR2 &= ~(1 << 9)
 #define enableI2C2BufferInterrupt() I2C2->CR2 |= (1 << 10)
@@ -59,4 +85,52 @@ I2C_Addr(I2C_TypeDef *I2CP, unsigned char adr);
 int
 I2C_Read(I2C_TypeDef *I2CP);
 
+/* Interrupt-driven engine: each bus runs a queue of transactions from its event and error
+   interrupts, so the CPU is free while the bytes move and devices on one bus (MPU6050, the
+   extention expanders) take turns instead of blocking each other.
+   A transaction writes tx_len bytes, reads rx_len bytes, or writes then reads after a
+   repeated start (a register read); with both 0 it only addresses the device (a probe).
+   With i2c_dma_rx, reads of two bytes or more go through the RX DMA channel instead of one
+   interrupt per byte. */
+#define I2C_DONE 0
+#define I2C_PENDING 1
+#define I2C_ERR_NACK -1    /* address or data not acknowledged */
+#define I2C_ERR_BUS -2     /* misplaced start/stop (BERR) or overrun */
+#define I2C_ERR_ARLO -3    /* arbitration lost to another master */
+#define I2C_ERR_TIMEOUT -4 /* no progress for timeout_ms: the bus was reset */
+
+typedef struct i2c_xfer i2c_xfer_t;
+
+/* Called from the I2C interrupt with I2C_DONE or an I2C_ERR_*; the descriptor may be
+   submitted again, and the next transaction of the bus has already started. */
+typedef void (*i2c_callback_t)(i2c_xfer_t *xfer, int status);
+
+struct i2c_xfer {
+	uint8_t addr;            /* 8-bit bus address (as I2C_Addr), R/W bit ignored */
+	const uint8_t *tx;       /* bytes to write, i.e. the register number */
+	uint16_t tx_len;
+	uint8_t *rx;             /* read destination */
+	uint16_t rx_len;
+	uint16_t timeout_ms;     /* 0: twice the bus time + 2 ms */
+	i2c_callback_t callback; /* or 0 */
+	void *arg;               /* for the callback */
+	uint8_t reg;             /* i2c_read_regs: first register, tx points here */
+	volatile int8_t status;  /* I2C_PENDING from i2c_submit until done */
+	i2c_xfer_t *next;        /* engine: queue link */
+};
+
+int
+i2c_async_init(I2C_TypeDef *I2CP, uint32_t pclk1_hz, uint32_t bus_hz);
+int
+i2c_submit(I2C_TypeDef *I2CP, i2c_xfer_t *xfer);
+int
+i2c_busy(I2C_TypeDef *I2CP);
+int
+i2c_dma_rx(I2C_TypeDef *I2CP, int enable);
+int
+i2c_read_regs(I2C_TypeDef *I2CP, i2c_xfer_t *xfer, uint8_t addr, uint8_t reg, uint8_t *buf,
+              uint16_t n);
+void
+i2c_async_tick(void);
+
 #endif
@@ -373,9 +373,9 @@ int
 spi_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int rx_len);
 int
 spi2_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int rx_len);
-void
+int
 spi1_dma_receive(uint8_t *rx_buf, int rx_len);
-void
+int
 spi1_dma_transmit(uint8_t *tx_buf, int tx_len);
 
 #endif
@@ -0,0 +1,40 @@
+/* @file 			 : ring.h
+ *  @Description: Lock-free single-producer/single-consumer byte queue. One side may run in an
+ *                interrupt handler and the other in the main loop: the producer only writes
+ *                head, the consumer only writes tail, so neither needs to mask interrupts.
+ *                Indices run freely over 16 bits and are masked on access, which keeps all
+ *                `size` bytes usable; size must be a power of two (2 .. 32768).
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+typedef struct {
+	uint8_t *buf;
+	uint16_t mask;          /* size - 1 */
+	volatile uint16_t head; /* Next byte to write: producer only */
+	volatile uint16_t tail; /* Next byte to read: consumer only */
+} ring_t;
+
+int
+ring_init(ring_t *ring, uint8_t *buf, uint16_t size);
+void
+ring_reset(ring_t *ring);
+uint16_t
+ring_count(const ring_t *ring);
+uint16_t
+ring_space(const ring_t *ring);
+
+/* Producer side */
+int
+ring_put(ring_t *ring, uint8_t byte);
+uint16_t
+ring_write(ring_t *ring, const uint8_t *data, uint16_t len);
+
+/* Consumer side */
+int
+ring_get(ring_t *ring, uint8_t *byte);
+uint16_t
+ring_read(ring_t *ring, uint8_t *data, uint16_t len);
+#endif
@@ -16,6 +16,11 @@
 #include "gpio.h"
 #endif
 
+#ifndef RING_H
+
+#include "ring.h"
+#endif
+
 #include <math.h>
 
 /* If the STM32 HAL/CMSIS headers are included, they already define
@@ -52,6 +57,9 @@
 #define USART_CR1_RE 1 << 2
 #define USART_CR1_TE 1 << 3
 #define USART_CR1_UE 1 << 13
+#define USART_CR1_IDLEIE (1 << 4)
+#define USART_CR1_RXNEIE (1 << 5)
+#define USART_CR1_TXEIE (1 << 7)
 #define USART_DMA_EN 1 << 7
 #define USART_DMA_DIS ~(1 << 7)
 
@@ -89,20 +97,58 @@ GetString(USART_TypeDef *uart, char *data);
 unsigned char
 RecvString(USART_TypeDef *uart, unsigned char *x, unsigned char size);
 
+/* Buffered mode: interrupt-driven TX/RX queues (ring.h). The main loop is the only
+   writer and the only reader of each USART; the USART interrupt is the other side. */
+int
+usart_buffered_init(USART_TypeDef *usart, uint8_t *tx_buf, uint16_t tx_size, uint8_t *rx_buf,
+                    uint16_t rx_size);
+int
+usart_write(USART_TypeDef *usart, const void *data, int len);
+int
+usart_read(USART_TypeDef *usart, void *data, int len);
+int
+usart_rx_available(USART_TypeDef *usart);
+int
+usart_tx_pending(USART_TypeDef *usart);
+uint32_t
+usart_rx_overruns(USART_TypeDef *usart);
 void
-dma_read_usart1(char *data, int size);
+usart_set_stdout(USART_TypeDef *usart);
+
+/* Circular DMA reception: the channel fills a ring continuously, and its half/full transfer
+   interrupts and the USART IDLE interrupt (line quiet for a frame time after data) publish how
+   far it got. Readers take spans of the ring in place. USART1..USART4 only: UART5 has no DMA
+   request. count is the number of bytes just published; idle is 1 when the line went quiet. */
+typedef void (*usart_dma_rx_callback_t)(USART_TypeDef *usart, uint16_t count, int idle);
+
+int
+usart_dma_rx_start(USART_TypeDef *usart, uint8_t *buf, uint16_t size,
+                   usart_dma_rx_callback_t callback);
 void
+usart_dma_rx_stop(USART_TypeDef *usart);
+int
+usart_dma_rx_peek(USART_TypeDef *usart, const uint8_t **span);
+int
+usart_dma_rx_consume(USART_TypeDef *usart, int n);
+int
+usart_dma_rx_available(USART_TypeDef *usart);
+uint32_t
+usart_dma_rx_overflows(USART_TypeDef *usart);
+
+int
+dma_read_usart1(char *data, int size);
+int
 dma_write_usart1(char *data, int size);
-void
+int
 dma_read_usart2(char *data, int size);
-void
+int
 dma_write_usart2(char *data, int size);
-void
+int
 dma_read_usart3(char *data, int size);
-void
+int
 dma_write_usart3(char *data, int size);
-void
+int
 dma_read_usart4(char *data, int size);
-void
+int
 dma_write_usart4(char *data, int size);
 #endif
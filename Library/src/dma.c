@@ -1,4 +1,5 @@
 #include "dma.h"
+#include "nvic.h"
 
 /** @brief Reset The desired DMA Channel.
         @param[in] DMA i.e DMA1
@@ -233,3 +234,356 @@ dma_set_number_of_data(u32 dma, u8 channel, u16 number)
 {
 	DMA_CNDTR(dma, channel) = number;
 }
+
+/*---------------------------------------------------------------------------*/
+/* Channel manager: one slot per channel, DMA1 ch1..7 then DMA2 ch1..5 */
+#define DMA_SLOTS 12
+
+typedef struct {
+	u16 owner;               /* request, 0 = free */
+	dma_xfer_t *head;        /* running transfer */
+	dma_xfer_t *tail;        /* last queued */
+} dma_slot_t;
+
+static dma_slot_t dma_slots[DMA_SLOTS];
+
+/* DMA2 channels 4 and 5 share one interrupt on the F103 */
+static const u8 dma_slot_irqs[DMA_SLOTS] = {
+    NVIC_DMA1_CHANNEL1_IRQ,   NVIC_DMA1_CHANNEL2_IRQ,   NVIC_DMA1_CHANNEL3_IRQ,
+    NVIC_DMA1_CHANNEL4_IRQ,   NVIC_DMA1_CHANNEL5_IRQ,   NVIC_DMA1_CHANNEL6_IRQ,
+    NVIC_DMA1_CHANNEL7_IRQ,   NVIC_DMA2_CHANNEL1_IRQ,   NVIC_DMA2_CHANNEL2_IRQ,
+    NVIC_DMA2_CHANNEL3_IRQ,   NVIC_DMA2_CHANNEL4_5_IRQ, NVIC_DMA2_CHANNEL4_5_IRQ};
+
+/* Slot of a controller channel, -1 if there is none */
+static int
+dma_slot(u32 dma, u8 channel)
+{
+	if (dma == DMA1 && channel >= 1 && channel <= 7)
+		return channel - 1;
+	if (dma == DMA2 && channel >= 1 && channel <= 5)
+		return 7 + channel - 1;
+	return -1;
+}
+
+/* Slot of a request, -1 if it is not one */
+static int
+dma_request_slot(u16 request)
+{
+	u8 controller = DMA_REQ_CONTROLLER(request);
+
+	if (controller != 1 && controller != 2)
+		return -1;
+	return dma_slot(controller == 1 ? DMA1 : DMA2, DMA_REQ_CHANNEL(request));
+}
+
+static u32
+dma_slot_controller(int slot)
+{
+	return slot < 7 ? DMA1 : DMA2;
+}
+
+static u8
+dma_slot_channel(int slot)
+{
+	return slot < 7 ? slot + 1 : slot - 7 + 1;
+}
+
+/* Some owned slot needs the interrupt of this one */
+static int
+dma_irq_in_use(int slot)
+{
+	if (dma_slots[slot].owner)
+		return 1;
+	if (slot == 10)
+		return dma_slots[11].owner != 0;
+	if (slot == 11)
+		return dma_slots[10].owner != 0;
+	return 0;
+}
+
+/* The queue of a slot is shared with its interrupt: mask it around changes. Callbacks run
+   in that interrupt, where masking it again is harmless. */
+static void
+dma_lock(int slot)
+{
+	nvic_disable_irq(dma_slot_irqs[slot]);
+}
+
+static void
+dma_unlock(int slot)
+{
+	if (dma_irq_in_use(slot))
+		nvic_enable_irq(dma_slot_irqs[slot]);
+}
+
+/* Program and enable the channel for a descriptor. Whole-register writes rather than the
+   read-modify-write helpers above: this runs in the interrupt between chained transfers. */
+static void
+dma_start(int slot, dma_xfer_t *xfer)
+{
+	u32 dma = dma_slot_controller(slot);
+	u8 channel = dma_slot_channel(slot);
+
+	DMA_CCR(dma, channel) = 0;  // EN clear: CPAR, CMAR and CNDTR become writable
+	DMA_IFCR(dma) = DMA_IFCR_CIF(channel);
+	DMA_CPAR(dma, channel) = xfer->peripheral;
+	DMA_CMAR(dma, channel) = xfer->memory;
+	DMA_CNDTR(dma, channel) = xfer->count;
+	DMA_CCR(dma, channel) = (xfer->config & ~(DMA_CCR_EN | DMA_CCR_TCIE | DMA_CCR_TEIE)) |
+	                        DMA_CCR_TCIE | DMA_CCR_TEIE | DMA_CCR_EN;
+}
+
+/* Stop the channel and drop its queue (no callbacks) */
+static void
+dma_flush(int slot)
+{
+	u32 dma = dma_slot_controller(slot);
+	u8 channel = dma_slot_channel(slot);
+	dma_xfer_t *xfer = dma_slots[slot].head;
+
+	DMA_CCR(dma, channel) = 0;
+	DMA_IFCR(dma) = DMA_IFCR_CIF(channel);
+	while (xfer) {
+		dma_xfer_t *next = xfer->next;
+
+		xfer->next = 0;
+		xfer->queued = 0;
+		xfer = next;
+	}
+	dma_slots[slot].head = 0;
+	dma_slots[slot].tail = 0;
+}
+
+/** @brief Take the channel of a DMA request, enable its controller clock and interrupt.
+        Claiming a request that is already claimed succeeds.
+        @param[in] request i.e DMA_REQ_USART1_TX
+        @return 0, or -1 if another request of the channel owns it
+        @example   if (dma_claim(DMA_REQ_SPI2_TX) != 0)
+                           return -1; // USART1 RX has the channel
+*/
+int
+dma_claim(u16 request)
+{
+	int slot = dma_request_slot(request);
+	int ret = 0;
+
+	if (slot < 0 || request == 0)
+		return -1;
+
+	dma_lock(slot);
+	if (dma_slots[slot].owner == 0) {
+		CLOCK_BUS_HIGH |= (slot < 7) ? DMACLOCK_ENABLE : DMA2CLOCK_ENABLE;
+		dma_slots[slot].owner = request;
+	} else if (dma_slots[slot].owner != request) {
+		ret = -1;
+	}
+	dma_unlock(slot);
+	return ret;
+}
+
+/** @brief Stop the channel, drop its queued transfers (no callbacks) and free it.
+        @param[in] request the owner, i.e DMA_REQ_USART1_TX
+        @return 0, or -1 if the request does not own the channel
+*/
+int
+dma_release(u16 request)
+{
+	int slot = dma_request_slot(request);
+
+	if (slot < 0 || dma_slots[slot].owner != request)
+		return -1;
+
+	dma_lock(slot);
+	dma_flush(slot);
+	dma_slots[slot].owner = 0;
+	dma_unlock(slot);
+	return 0;
+}
+
+/** @brief Request owning a channel, 0 if free.
+        @example   dma_owner(DMA1, DMA_CHANNEL4) == DMA_REQ_USART1_TX
+*/
+u16
+dma_owner(u32 dma, u8 channel)
+{
+	int slot = dma_slot(dma, channel);
+
+	return slot < 0 ? 0 : dma_slots[slot].owner;
+}
+
+/** @brief Queue a transfer on a claimed channel. It starts now if the channel is idle,
+        otherwise from the interrupt that ends the one before it.
+        @param[in] request the owner, i.e DMA_REQ_USART1_TX
+        @param[in] xfer descriptor, left alone by the caller until its TC or TE callback
+        @return 0, or -1 if the request does not own the channel, the descriptor is still
+                queued, or the count is 0
+        @example   static dma_xfer_t tx = {(u32)&USART1->DR, 0, 0,
+                                           DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_PL_HIGH};
+                   tx.memory = (u32)line; tx.count = len;
+                   dma_submit(DMA_REQ_USART1_TX, &tx);
+*/
+int
+dma_submit(u16 request, dma_xfer_t *xfer)
+{
+	int slot = dma_request_slot(request);
+	dma_slot_t *s;
+
+	if (slot < 0 || xfer->count == 0)
+		return -1;
+	s = &dma_slots[slot];
+
+	dma_lock(slot);
+	if (s->owner != request || xfer->queued) {
+		dma_unlock(slot);
+		return -1;
+	}
+	xfer->next = 0;
+	xfer->queued = 1;
+	if (s->head) {
+		s->tail->next = xfer;
+		s->tail = xfer;
+	} else {
+		s->head = s->tail = xfer;
+		dma_start(slot, xfer);
+	}
+	dma_unlock(slot);
+	return 0;
+}
+
+/** @brief Stop the running transfer and drop the queued ones (no callbacks); the channel
+        stays claimed.
+        @return 0, or -1 if the request does not own the channel
+*/
+int
+dma_abort(u16 request)
+{
+	int slot = dma_request_slot(request);
+
+	if (slot < 0 || dma_slots[slot].owner != request)
+		return -1;
+
+	dma_lock(slot);
+	dma_flush(slot);
+	dma_unlock(slot);
+	return 0;
+}
+
+/** @brief 1 while a transfer of the request runs or waits, 0 otherwise. */
+int
+dma_busy(u16 request)
+{
+	int slot = dma_request_slot(request);
+
+	return slot >= 0 && dma_slots[slot].owner == request && dma_slots[slot].head != 0;
+}
+
+/** @brief Items the running transfer of the request has left (CNDTR), 0 if none runs. */
+u16
+dma_remaining(u16 request)
+{
+	int slot = dma_request_slot(request);
+
+	if (!dma_busy(request))
+		return 0;
+	return (u16)DMA_CNDTR(dma_slot_controller(slot), dma_slot_channel(slot));
+}
+
+/* Channel interrupt: retire the transfer on TC (unless circular) or TE, start the next one,
+   then tell the callback */
+static void
+dma_irq(int slot)
+{
+	dma_slot_t *s = &dma_slots[slot];
+	u32 dma = dma_slot_controller(slot);
+	u8 channel = dma_slot_channel(slot);
+	u32 events = (DMA_ISR(dma) >> (4 * (channel - 1))) &
+	             (DMA_EVENT_TC | DMA_EVENT_HT | DMA_EVENT_TE);
+	dma_xfer_t *xfer = s->head;
+
+	if (events == 0)
+		return;
+	DMA_IFCR(dma) = (events | DMA_IFCR_CGIF_BIT) << (4 * (channel - 1));
+	if (!xfer)
+		return;  // aborted meanwhile
+
+	if ((events & DMA_EVENT_TE) || ((events & DMA_EVENT_TC) && !(xfer->config & DMA_CCR_CIRC))) {
+		s->head = xfer->next;
+		if (s->head)
+			dma_start(slot, s->head);
+		else {
+			s->tail = 0;
+			DMA_CCR(dma, channel) = 0;
+		}
+		xfer->next = 0;
+		xfer->queued = 0;
+	}
+	if (xfer->callback)
+		xfer->callback(xfer, events);
+}
+
+void
+DMA1_Channel1_IRQHandler(void)
+{
+	dma_irq(0);
+}
+
+void
+DMA1_Channel2_IRQHandler(void)
+{
+	dma_irq(1);
+}
+
+void
+DMA1_Channel3_IRQHandler(void)
+{
+	dma_irq(2);
+}
+
+void
+DMA1_Channel4_IRQHandler(void)
+{
+	dma_irq(3);
+}
+
+void
+DMA1_Channel5_IRQHandler(void)
+{
+	dma_irq(4);
+}
+
+void
+DMA1_Channel6_IRQHandler(void)
+{
+	dma_irq(5);
+}
+
+void
+DMA1_Channel7_IRQHandler(void)
+{
+	dma_irq(6);
+}
+
+void
+DMA2_Channel1_IRQHandler(void)
+{
+	dma_irq(7);
+}
+
+void
+DMA2_Channel2_IRQHandler(void)
+{
+	dma_irq(8);
+}
+
+void
+DMA2_Channel3_IRQHandler(void)
+{
+	dma_irq(9);
+}
+
+void
+DMA2_Channel4_5_IRQHandler(void)
+{
+	dma_irq(10);
+	dma_irq(11);
+}
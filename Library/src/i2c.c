@@ -1,5 +1,7 @@
 #include "i2c.h"
 #include "gpio.h"
+#include "nvic.h"
+#include "dma.h"
 //#include "FreeRTOS.h"
 //#include "semphr.h"
 
@@ -171,3 +173,512 @@ I2C_Read(I2C_TypeDef *I2CP)
 
 	return (int)rx;
 }
+
+/*---------------------------------------------------------------------------*/
+/* Interrupt-driven engine, one state per bus (index 0 = I2C1) */
+#define I2C_BUSES 2
+
+/* Bounded wait for a STOP still on the bus before the next START (about one bit time) */
+#define I2C_STOP_SPIN 1000
+
+enum { I2C_PHASE_START, I2C_PHASE_ADDR, I2C_PHASE_DATA };
+enum { I2C_DMA_IDLE, I2C_DMA_RUNNING, I2C_DMA_DONE, I2C_DMA_FAILED };
+
+typedef struct {
+	I2C_TypeDef *i2c;
+	i2c_xfer_t *head;          /* running transaction */
+	i2c_xfer_t *tail;          /* last queued */
+	uint16_t index;            /* bytes moved in this direction */
+	uint8_t reading;           /* 0: address + tx bytes, 1: address + rx bytes */
+	uint8_t phase;             /* waiting for SB, for ADDR, or moving data */
+	volatile uint16_t timer;   /* ms left for the running transaction, 0 = none */
+	volatile uint8_t timedout; /* set by i2c_async_tick, handled in the error interrupt */
+	uint32_t bus_hz;
+	uint16_t cr2, ccr, trise;  /* restored after a reset */
+	uint8_t ev_irq, er_irq;
+	u16 dma_request;           /* RX channel claimed by i2c_dma_rx, 0 = byte by byte */
+	volatile uint8_t dma_state;
+	dma_xfer_t dma;
+} i2c_bus_t;
+
+static i2c_bus_t i2c_buses[I2C_BUSES];
+
+static i2c_bus_t *
+i2c_bus(I2C_TypeDef *I2CP)
+{
+	i2c_bus_t *b = (I2CP == I2C1) ? &i2c_buses[0] : (I2CP == I2C2) ? &i2c_buses[1] : 0;
+
+	return (b && b->i2c) ? b : 0;
+}
+
+/* The queue is shared with the bus interrupts: mask them around changes */
+static void
+i2c_lock(i2c_bus_t *b)
+{
+	nvic_disable_irq(b->ev_irq);
+	nvic_disable_irq(b->er_irq);
+}
+
+static void
+i2c_unlock(i2c_bus_t *b)
+{
+	nvic_enable_irq(b->ev_irq);
+	nvic_enable_irq(b->er_irq);
+}
+
+/* Program the clock registers and enable the peripheral with its interrupts */
+static void
+i2c_configure(i2c_bus_t *b)
+{
+	I2C_TypeDef *I2CP = b->i2c;
+
+	I2CP->CR1 = 0;
+	I2CP->CR2 = b->cr2;
+	I2CP->CCR = b->ccr;
+	I2CP->TRISE = b->trise;
+	I2CP->CR1 = I2C_CR1_PE;
+}
+
+/* Default timeout: twice the bus time of the transaction, plus 2 ms for the tick */
+static uint16_t
+i2c_timeout(i2c_bus_t *b, i2c_xfer_t *x)
+{
+	uint32_t bits = ((uint32_t)x->tx_len + x->rx_len + 2) * 9;
+
+	if (x->timeout_ms)
+		return x->timeout_ms;
+	return (uint16_t)(2 + 2 * bits * 1000 / b->bus_hz);
+}
+
+/* Start the transaction at the head of the queue */
+static void
+i2c_begin(i2c_bus_t *b)
+{
+	I2C_TypeDef *I2CP = b->i2c;
+	i2c_xfer_t *x = b->head;
+	unsigned int spin;
+
+	b->index = 0;
+	b->reading = (x->tx_len == 0 && x->rx_len > 0);
+	b->phase = I2C_PHASE_START;
+	b->timer = i2c_timeout(b, x);
+
+	for (spin = 0; (I2CP->CR1 & I2C_CR1_STOP) && spin < I2C_STOP_SPIN; spin++)
+		;
+	I2CP->CR1 = (I2CP->CR1 & ~I2C_CR1_POS) | I2C_CR1_ACK;
+	I2CP->CR1 |= I2C_CR1_START;
+}
+
+/* Retire the running transaction, start the next one, then tell the callback */
+static void
+i2c_finish(i2c_bus_t *b, int status)
+{
+	I2C_TypeDef *I2CP = b->i2c;
+	i2c_xfer_t *x = b->head;
+
+	if (b->dma_state != I2C_DMA_IDLE) {
+		if (b->dma_state == I2C_DMA_RUNNING)
+			dma_abort(b->dma_request);
+		b->dma_state = I2C_DMA_IDLE;
+		I2CP->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+	}
+	I2CP->CR2 &= ~I2C_CR2_ITBUFEN;
+	I2CP->CR1 &= ~I2C_CR1_POS;
+	b->timer = 0;
+	b->head = x->next;
+	if (b->head)
+		i2c_begin(b);
+	else
+		b->tail = 0;
+	x->next = 0;
+	x->status = status;
+	if (x->callback)
+		x->callback(x, status);
+}
+
+/* End of the RX DMA transfer: the last byte was NACKed (LAST), so STOP now and let the
+   event interrupt retire the transaction */
+static void
+i2c_dma_done(dma_xfer_t *xfer, u32 events)
+{
+	i2c_bus_t *b = xfer->arg;
+
+	if (b->dma_state != I2C_DMA_RUNNING)
+		return;
+	b->i2c->CR1 |= I2C_CR1_STOP;
+	b->dma_state = (events & DMA_EVENT_TE) ? I2C_DMA_FAILED : I2C_DMA_DONE;
+	nvic_set_pending_irq(b->ev_irq);
+}
+
+/* Hand the read to DMA before ADDR is cleared (RM0008 26.3.7): ACK stays set and LAST
+   makes the peripheral NACK the byte that ends the transfer */
+static int
+i2c_dma_start(i2c_bus_t *b, i2c_xfer_t *x)
+{
+	I2C_TypeDef *I2CP = b->i2c;
+
+	b->dma.peripheral = (u32)&I2CP->DR;
+	b->dma.memory = (u32)x->rx;
+	b->dma.count = x->rx_len;
+	b->dma.config = DMA_CCR_MINC | DMA_CCR_PSIZE_8BIT | DMA_CCR_MSIZE_8BIT | DMA_CCR_PL_HIGH;
+	b->dma.callback = i2c_dma_done;
+	b->dma.arg = b;
+	b->dma_state = I2C_DMA_RUNNING;
+	if (dma_submit(b->dma_request, &b->dma) != 0) {
+		b->dma_state = I2C_DMA_IDLE;
+		return -1;
+	}
+	I2CP->CR2 = (I2CP->CR2 & ~I2C_CR2_ITBUFEN) | I2C_CR2_DMAEN | I2C_CR2_LAST;
+	return 0;
+}
+
+/* Event interrupt: SB, ADDR, TXE, RXNE and BTF. The receive side follows RM0008 26.3.3:
+   the ACK/POS/STOP changes for the last two bytes happen while the clock is stretched. */
+static void
+i2c_event(i2c_bus_t *b)
+{
+	I2C_TypeDef *I2CP = b->i2c;
+	i2c_xfer_t *x = b->head;
+	uint16_t sr1 = I2CP->SR1;
+	uint16_t left;
+
+	if (!x) {  // nothing running: clear what is set so the interrupt does not repeat
+		if (sr1 & I2C_SR1_ADDR)
+			(void)I2CP->SR2;
+		if (sr1 & I2C_SR1_RXNE)
+			(void)I2CP->DR;
+		I2CP->CR2 &= ~I2C_CR2_ITBUFEN;
+		return;
+	}
+
+	if (b->dma_state != I2C_DMA_IDLE) {  // pended by i2c_dma_done, or BTF while DMA catches up
+		if (b->dma_state != I2C_DMA_RUNNING)
+			i2c_finish(b, b->dma_state == I2C_DMA_DONE ? I2C_DONE : I2C_ERR_BUS);
+		return;
+	}
+
+	if (b->phase == I2C_PHASE_START) {
+		if (sr1 & I2C_SR1_SB) {
+			I2CP->DR = b->reading ? (x->addr | 1) : (x->addr & ~1);
+			b->phase = I2C_PHASE_ADDR;
+		}
+		return;
+	}
+
+	if (b->phase == I2C_PHASE_ADDR) {
+		if (!(sr1 & I2C_SR1_ADDR))
+			return;
+		b->phase = I2C_PHASE_DATA;
+		if (!b->reading) {
+			(void)I2CP->SR2;
+			if (x->tx_len == 0) {  // probe: the address was acknowledged
+				I2CP->CR1 |= I2C_CR1_STOP;
+				i2c_finish(b, I2C_DONE);
+			} else {
+				I2CP->CR2 |= I2C_CR2_ITBUFEN;
+			}
+			return;
+		}
+		if (b->dma_request && x->rx_len >= 2 && i2c_dma_start(b, x) == 0) {
+			(void)I2CP->SR2;
+		} else if (x->rx_len == 1) {  // NACK and STOP before the byte arrives
+			I2CP->CR1 &= ~I2C_CR1_ACK;
+			(void)I2CP->SR2;
+			I2CP->CR1 |= I2C_CR1_STOP;
+			I2CP->CR2 |= I2C_CR2_ITBUFEN;
+		} else if (x->rx_len == 2) {  // NACK the second byte, STOP once both are in
+			I2CP->CR1 = (I2CP->CR1 & ~I2C_CR1_ACK) | I2C_CR1_POS;
+			(void)I2CP->SR2;
+			I2CP->CR2 &= ~I2C_CR2_ITBUFEN;
+		} else {
+			(void)I2CP->SR2;
+			if (x->rx_len > 3)
+				I2CP->CR2 |= I2C_CR2_ITBUFEN;
+			else
+				I2CP->CR2 &= ~I2C_CR2_ITBUFEN;
+		}
+		return;
+	}
+
+	if (!b->reading) {
+		if ((sr1 & I2C_SR1_TXE) && b->index < x->tx_len) {
+			I2CP->DR = x->tx[b->index++];
+			if (b->index == x->tx_len)
+				I2CP->CR2 &= ~I2C_CR2_ITBUFEN;  // then BTF: the last byte is out
+			return;
+		}
+		if ((sr1 & I2C_SR1_BTF) && b->index == x->tx_len) {
+			if (x->rx_len) {  // repeated start for the read
+				b->reading = 1;
+				b->index = 0;
+				b->phase = I2C_PHASE_START;
+				I2CP->CR1 |= I2C_CR1_START;
+			} else {
+				I2CP->CR1 |= I2C_CR1_STOP;
+				i2c_finish(b, I2C_DONE);
+			}
+		}
+		return;
+	}
+
+	left = x->rx_len - b->index;
+	if (left > 3) {
+		if (sr1 & I2C_SR1_RXNE) {
+			x->rx[b->index++] = (uint8_t)I2CP->DR;
+			if (left - 1 == 3)
+				I2CP->CR2 &= ~I2C_CR2_ITBUFEN;  // the last three go by BTF
+		}
+	} else if (left == 3) {
+		if (sr1 & I2C_SR1_BTF) {  // N-2 in DR, N-1 in the shift register
+			I2CP->CR1 &= ~I2C_CR1_ACK;
+			x->rx[b->index++] = (uint8_t)I2CP->DR;
+		}
+	} else if (left == 2) {
+		if (sr1 & I2C_SR1_BTF) {  // N-1 in DR, N (NACKed) in the shift register
+			I2CP->CR1 |= I2C_CR1_STOP;
+			x->rx[b->index++] = (uint8_t)I2CP->DR;
+			x->rx[b->index++] = (uint8_t)I2CP->DR;
+			i2c_finish(b, I2C_DONE);
+		}
+	} else if (sr1 & I2C_SR1_RXNE) {
+		x->rx[b->index++] = (uint8_t)I2CP->DR;
+		i2c_finish(b, I2C_DONE);
+	}
+}
+
+/* Error interrupt: NACK, bus error, arbitration loss, overrun; and the timeouts that
+   i2c_async_tick hands over */
+static void
+i2c_error(i2c_bus_t *b)
+{
+	I2C_TypeDef *I2CP = b->i2c;
+	uint16_t sr1 = I2CP->SR1;
+	int status;
+
+	if (b->timedout) {
+		b->timedout = 0;
+		if (!b->head || b->timer)
+			return;  // finished meanwhile
+		/* SWRST releases the lines whatever state the peripheral is stuck in */
+		I2CP->CR1 = I2C_CR1_SWRST;
+		I2CP->CR1 = 0;
+		i2c_configure(b);
+		i2c_finish(b, I2C_ERR_TIMEOUT);
+		return;
+	}
+
+	I2CP->SR1 = ~(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_TIMEOUT) &
+	            sr1;  // the error flags clear by writing 0
+	if (!b->head)
+		return;
+
+	if (sr1 & I2C_SR1_ARLO) {
+		status = I2C_ERR_ARLO;  // the peripheral already left the bus
+	} else if (sr1 & I2C_SR1_AF) {
+		status = I2C_ERR_NACK;
+		I2CP->CR1 |= I2C_CR1_STOP;
+	} else if (sr1 & (I2C_SR1_BERR | I2C_SR1_OVR | I2C_SR1_TIMEOUT)) {
+		status = I2C_ERR_BUS;
+		I2CP->CR1 |= I2C_CR1_STOP;
+	} else {
+		return;
+	}
+	i2c_finish(b, status);
+}
+
+/** @brief Switch a bus (after I2CInit) to the interrupt-driven engine and set its clock.
+        Fast mode (above 100 kHz) uses a 1:2 high:low clock, so the rate is pclk1 / (3 * CCR)
+        rounded down to a whole CCR: exactly 400 kHz from a 12, 24 or 36 MHz PCLK1, 381 kHz
+        from the 8 MHz HSI.
+        @param[in] I2CP i.e I2C1 or I2C2
+        @param[in] pclk1_hz APB1 clock, 2..36 MHz (4 MHz at least for fast mode)
+        @param[in] bus_hz SCL rate, up to 400000
+        @return 0, or -1 on a bad bus or clock
+        @example  I2CInit(I2C1, NOREMAP);
+                  i2c_async_init(I2C1, 36000000, 400000);
+*/
+int
+i2c_async_init(I2C_TypeDef *I2CP, uint32_t pclk1_hz, uint32_t bus_hz)
+{
+	uint32_t mhz = pclk1_hz / 1000000;
+	uint32_t ccr;
+	i2c_bus_t *b;
+
+	if (I2CP == I2C1)
+		b = &i2c_buses[0];
+	else if (I2CP == I2C2)
+		b = &i2c_buses[1];
+	else
+		return -1;
+	if (mhz < 2 || mhz > 36 || bus_hz == 0 || bus_hz > 400000 || (bus_hz > 100000 && mhz < 4))
+		return -1;
+
+	if (bus_hz > 100000) {
+		ccr = (pclk1_hz + 3 * bus_hz - 1) / (3 * bus_hz);
+		b->ccr = I2C_CCR_FS | (ccr ? ccr : 1);
+		b->trise = mhz * 300 / 1000 + 1;  // 300 ns
+	} else {
+		ccr = (pclk1_hz + 2 * bus_hz - 1) / (2 * bus_hz);
+		b->ccr = ccr < 4 ? 4 : ccr;
+		b->trise = mhz + 1;  // 1000 ns
+	}
+	b->cr2 = mhz | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+	b->bus_hz = bus_hz;
+	b->ev_irq = (I2CP == I2C1) ? NVIC_I2C1_EV_IRQ : NVIC_I2C2_EV_IRQ;
+	b->er_irq = (I2CP == I2C1) ? NVIC_I2C1_ER_IRQ : NVIC_I2C2_ER_IRQ;
+	b->head = b->tail = 0;
+	b->timer = 0;
+	b->timedout = 0;
+	b->dma_state = I2C_DMA_IDLE;
+	b->i2c = I2CP;
+
+	i2c_configure(b);
+	i2c_unlock(b);
+	return 0;
+}
+
+/** @brief Queue a transaction; it starts now if the bus is idle, otherwise from the
+        interrupt that ends the one before it.
+        @param[in] I2CP i.e I2C1 (after i2c_async_init)
+        @param[in] xfer descriptor, left alone by the caller until its callback (or until
+                   status is no longer I2C_PENDING)
+        @return 0, or -1 if the bus is not set up or the descriptor is still queued
+        @example  static uint8_t reg = 0x3B, raw[14];
+                  static i2c_xfer_t accel = {0xD0, &reg, 1, raw, 14, 0, on_accel};
+                  i2c_submit(I2C1, &accel); // write 0x3B, repeated start, read 14
+*/
+int
+i2c_submit(I2C_TypeDef *I2CP, i2c_xfer_t *xfer)
+{
+	i2c_bus_t *b = i2c_bus(I2CP);
+
+	if (!b || xfer->status == I2C_PENDING)
+		return -1;
+
+	i2c_lock(b);
+	xfer->next = 0;
+	xfer->status = I2C_PENDING;
+	if (b->head) {
+		b->tail->next = xfer;
+		b->tail = xfer;
+	} else {
+		b->head = b->tail = xfer;
+		i2c_begin(b);
+	}
+	i2c_unlock(b);
+	return 0;
+}
+
+/** @brief Move reads of two bytes or more to the bus's RX DMA channel (I2C1: DMA1 channel 7,
+        I2C2: DMA1 channel 5), one interrupt per transfer instead of one per byte. The channel
+        stays claimed until disabled: I2C2 shares channel 5 with USART1 RX and SPI2 TX.
+        Single-byte reads stay interrupt driven (RM0008 26.3.7: DMA needs two bytes or more).
+        @param[in] I2CP i.e I2C1 (after i2c_async_init)
+        @param[in] enable ENABLE or DISABLE
+        @return 0, or -1 if the bus is not set up, another peripheral holds the channel, or a
+                transaction is queued while disabling
+        @example  if (i2c_dma_rx(I2C1, ENABLE) != 0)
+                          ;  // reads stay byte by byte
+*/
+int
+i2c_dma_rx(I2C_TypeDef *I2CP, int enable)
+{
+	i2c_bus_t *b = i2c_bus(I2CP);
+	u16 request = (I2CP == I2C1) ? DMA_REQ_I2C1_RX : DMA_REQ_I2C2_RX;
+
+	if (!b)
+		return -1;
+	if (enable) {
+		if (dma_claim(request) != 0)
+			return -1;
+		b->dma_request = request;
+		return 0;
+	}
+	if (b->head)
+		return -1;
+	if (b->dma_request != request)
+		return 0;
+	b->dma_request = 0;
+	return dma_release(request);
+}
+
+/** @brief Read n contiguous registers: write the first register number, repeated start, read
+        n bytes (register auto-increment, as on the MPU6050). The descriptor's callback and
+        arg are kept; with i2c_dma_rx the n bytes arrive by DMA.
+        @param[in] I2CP i.e I2C1 (after i2c_async_init)
+        @param[in] xfer descriptor, not queued
+        @param[in] addr 8-bit bus address i.e 0xD0
+        @param[in] reg first register i.e ACCEL_XOUT_H (0x3B)
+        @param[out] buf n bytes
+        @param[in] n number of registers, 1 or more
+        @return 0, or -1 as i2c_submit
+        @example  static i2c_xfer_t raw = {.callback = on_raw};
+                  static uint8_t data[14];
+                  i2c_read_regs(I2C1, &raw, 0xD0, 0x3B, data, 14); // accel, temp, gyro
+*/
+int
+i2c_read_regs(I2C_TypeDef *I2CP, i2c_xfer_t *xfer, uint8_t addr, uint8_t reg, uint8_t *buf,
+              uint16_t n)
+{
+	if (n == 0 || xfer->status == I2C_PENDING)
+		return -1;
+	xfer->addr = addr;
+	xfer->reg = reg;
+	xfer->tx = &xfer->reg;
+	xfer->tx_len = 1;
+	xfer->rx = buf;
+	xfer->rx_len = n;
+	return i2c_submit(I2CP, xfer);
+}
+
+/** @brief 1 while a transaction runs or waits on the bus, 0 otherwise. */
+int
+i2c_busy(I2C_TypeDef *I2CP)
+{
+	i2c_bus_t *b = i2c_bus(I2CP);
+
+	return b && b->head != 0;
+}
+
+/** @brief Count down the transaction timeouts; call every millisecond (i.e. from the
+        TIM6 interrupt of millisInit). An expired transaction is handed to the bus error
+        interrupt, which resets the peripheral and completes it with I2C_ERR_TIMEOUT.
+*/
+void
+i2c_async_tick(void)
+{
+	int i;
+
+	for (i = 0; i < I2C_BUSES; i++) {
+		i2c_bus_t *b = &i2c_buses[i];
+
+		if (b->timer && --b->timer == 0) {
+			b->timedout = 1;
+			nvic_set_pending_irq(b->er_irq);
+		}
+	}
+}
+
+void
+I2C1_EV_IRQHandler(void)
+{
+	i2c_event(&i2c_buses[0]);
+}
+
+void
+I2C1_ER_IRQHandler(void)
+{
+	i2c_error(&i2c_buses[0]);
+}
+
+void
+I2C2_EV_IRQHandler(void)
+{
+	i2c_event(&i2c_buses[1]);
+}
+
+void
+I2C2_ER_IRQHandler(void)
+{
+	i2c_error(&i2c_buses[1]);
+}
@@ -15,7 +15,9 @@ the NSS pin.
 @param[in] dff Unsigned int32. Data frame format 8/16 bits @ref spi_dff.
 @param[in] lsbfirst Unsigned int32. Frame format lsb/msb first @ref
 spi_lsbfirst.
-@returns int. Error code.
+@param[in] remap Unsigned int8. 0 for the default pins, else the remapped ones.
+@returns int. 0, or -1 if there is no pin setup for the SPI with this remap
+(SPI2 default pins only, SPI3 remapped pins only); nothing is changed then.
 */
 typedef enum { NONE = 0, ONE, DONE } trans_status;
 volatile trans_status transceive_status;
@@ -26,6 +28,9 @@ spi_init_master(SPI_TypeDef *SPI, uint32_t br, uint32_t cpol, uint32_t cpha, uin
 {
 	uint32_t reg32 = SPI->CR1;
 
+	if (SPI != SPI1 && !(SPI == SPI2 && remap == 0) && !(SPI == SPI3 && remap != 0))
+		return -1;
+
 	if (remap != 0) {
 		if (SPI == SPI1) {
 			RCC->APB2ENR |= 1;          // Enable Alternate Function
@@ -76,7 +81,7 @@ spi_init_master(SPI_TypeDef *SPI, uint32_t br, uint32_t cpol, uint32_t cpha, uin
 	// SPI->CR2 |= SPI_CR2_SSOE; /* common case */
 	SPI->CR1 |= reg32;
 
-	return 0; /* TODO */
+	return 0;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -309,74 +314,83 @@ spi_enable_ss_output(SPI_TypeDef *SPI)
 	SPI->CR2 |= SPI_CR2_SSOE;
 }
 
-/* SPI transmit completed with DMA */
-void
-DMAChannel3_IRQHandler(void)
-{
-	if ((DMA1_ISR & DMA_ISR_TCIF3) != 0) {
-		DMA1_IFCR |= DMA_IFCR_CTCIF3;
-	}
-
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
+/* DMA transfers of the functions below, through the channel manager (dma.h): SPI1 on DMA1
+   ch2 (RX) / ch3 (TX), SPI2 on DMA1 ch4 (RX) / ch5 (TX). Each channel is claimed for the
+   transfer and released when it completes, so another peripheral of the channel (USART1
+   on ch4/ch5) gets -1 while it runs instead of corrupting it. */
+static dma_xfer_t spi1_dma_tx, spi1_dma_rx, spi2_dma_tx, spi2_dma_rx;
 
-	spi_disable_tx_dma(SPI1);
-
-	dma_disable_channel(DMA1, DMA_CHANNEL3);
-
-	// transceive_status++;
-}
-/* SPI2 transmit completed with DMA */
-void
-DMAChannel5_IRQHandler(void)
+/* SPI DMA transfer completed: stop the SPI request and free the channel */
+static void
+spi_dma_done(dma_xfer_t *xfer, u32 events)
 {
-	if ((DMA1_ISR & DMA_ISR_TCIF5) != 0) {
-		DMA1_IFCR |= DMA_IFCR_CTCIF5;
-	}
-
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
-
-	spi_disable_tx_dma(SPI2);
-
-	dma_disable_channel(DMA1, DMA_CHANNEL5);
-
+	u16 request = (u16)(uintptr_t)xfer->arg;
+
+	(void)events;
+	if (request == DMA_REQ_SPI1_TX)
+		spi_disable_tx_dma(SPI1);
+	else if (request == DMA_REQ_SPI1_RX)
+		spi_disable_rx_dma(SPI1);
+	else if (request == DMA_REQ_SPI2_TX)
+		spi_disable_tx_dma(SPI2);
+	else
+		spi_disable_rx_dma(SPI2);
 	// transceive_status++;
+	if (!dma_busy(request))
+		dma_release(request);
 }
-/* SPI receive completed with DMA */
-void
-DMAChannel2_IRQHandler(void)
+
+/* Queue one direction of an SPI transfer on its claimed channel */
+static int
+spi_dma_submit(SPI_TypeDef *SPI, u16 request, dma_xfer_t *xfer, uint8_t *buf, int len, u32 config)
 {
-	if ((DMA1_ISR & DMA_ISR_TCIF2) != 0) {
-		DMA1_IFCR |= DMA_IFCR_CTCIF2;
+	xfer->peripheral = (u32)&SPI->DR;
+	xfer->memory = (u32)buf;
+	xfer->count = (u16)len;
+	xfer->config = config | DMA_CCR_MINC | DMA_CCR_PSIZE_8BIT | DMA_CCR_MSIZE_8BIT;
+	xfer->callback = spi_dma_done;
+	xfer->arg = (void *)(uintptr_t)request;
+	return dma_submit(request, xfer);
+}
+
+/* Claim the channels a transfer needs, both or neither, once the previous transfer of each
+   direction is done: its completion releases the channel, so claiming first would lose it */
+static int
+spi_dma_claim(u16 rx_request, dma_xfer_t *rx, int rx_len, u16 tx_request, dma_xfer_t *tx,
+              int tx_len)
+{
+	while ((rx_len > 0 && rx->queued) || (tx_len > 0 && tx->queued))
+		;
+	if (rx_len > 0 && dma_claim(rx_request) != 0)
+		return -1;
+	if (tx_len > 0 && dma_claim(tx_request) != 0) {
+		if (rx_len > 0 && !dma_busy(rx_request))
+			dma_release(rx_request);
+		return -1;
 	}
-
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL2);
-
-	spi_disable_rx_dma(SPI1);
-
-	dma_disable_channel(DMA1, DMA_CHANNEL2);
-	// transceive_status++;
+	return 0;
 }
 
-/* SPI3 receive completed with DMA */
-void
-DMAChannel4_IRQHandler(void)
+/* A direction could not be queued: stop the SPI requests and transfers, free the channels */
+static void
+spi_dma_cancel(SPI_TypeDef *SPI, u16 rx_request, int rx_len, u16 tx_request, int tx_len)
 {
-	if ((DMA1_ISR & DMA_ISR_TCIF4) != 0) {
-		DMA1_IFCR |= DMA_IFCR_CTCIF4;
+	if (rx_len > 0) {
+		spi_disable_rx_dma(SPI);
+		dma_release(rx_request);
+	}
+	if (tx_len > 0) {
+		spi_disable_tx_dma(SPI);
+		dma_release(tx_request);
 	}
-
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL4);
-
-	spi_disable_rx_dma(SPI2);
-
-	dma_disable_channel(DMA1, DMA_CHANNEL4);
 }
 
-void
+int
 spi1_dma_transmit(uint8_t *tx_buf, int tx_len)
 {
-	volatile uint8_t temp_data;
-	dma_channel_reset(DMA1, DMA_CHANNEL3);
+	if (tx_len > 0xFFFF ||
+	    spi_dma_claim(DMA_REQ_SPI1_RX, &spi1_dma_rx, 0, DMA_REQ_SPI1_TX, &spi1_dma_tx, tx_len) != 0)
+		return -1;
 
 	/* Reset SPI data and status registers.
 	 * Here we assume that the SPI peripheral is NOT
@@ -391,28 +405,25 @@ spi1_dma_transmit(uint8_t *tx_buf, int tx_len)
 	transceive_status = ONE;
 	/* Set up tx dma */
 	if (tx_len > 0) {
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t)&SPI1->DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t)tx_buf);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL3, tx_len);
-		dma_set_read_from_memory(DMA1, DMA_CHANNEL3);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_LOW);
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
-		dma_enable_channel(DMA1, DMA_CHANNEL3);
+		if (spi_dma_submit(SPI1, DMA_REQ_SPI1_TX, &spi1_dma_tx, tx_buf, tx_len,
+		                   DMA_CCR_DIR | DMA_CCR_PL_LOW) != 0) {
+			spi_dma_cancel(SPI1, DMA_REQ_SPI1_RX, 0, DMA_REQ_SPI1_TX, tx_len);
+			return -1;
+		}
 		spi_enable_tx_dma(SPI1);
 	}
 	while (!(SPI1->SR & SPI_SR_TXE))
 		;  // Wait for bus free
 	while (SPI1->SR & SPI_SR_BSY)
 		;
+	return 0;
 }
-void
+int
 spi1_dma_receive(uint8_t *rx_buf, int rx_len)
 {
-	volatile uint8_t temp_data;
-	dma_channel_reset(DMA1, DMA_CHANNEL2);
+	if (rx_len > 0xFFFF ||
+	    spi_dma_claim(DMA_REQ_SPI1_RX, &spi1_dma_rx, rx_len, DMA_REQ_SPI1_TX, &spi1_dma_tx, 0) != 0)
+		return -1;
 
 	/* Reset SPI data and status registers.
 	 * Here we assume that the SPI peripheral is NOT
@@ -425,25 +436,20 @@ spi1_dma_receive(uint8_t *rx_buf, int rx_len)
 	   }
 	   */
 	// transceive_status = ONE;
-	/* Set up tx dma */
 
 	/* Set up rx dma, note it has higher priority to avoid overrun */
 	if (rx_len > 0) {
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL2, (uint32_t)&SPI1->DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL2, (uint32_t)rx_buf);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL2, rx_len);
-		dma_set_read_from_peripheral(DMA1, DMA_CHANNEL2);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL2);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL2, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL2, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL2, DMA_CCR_PL_HIGH);
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL2);
-		dma_enable_channel(DMA1, DMA_CHANNEL2);
+		if (spi_dma_submit(SPI1, DMA_REQ_SPI1_RX, &spi1_dma_rx, rx_buf, rx_len,
+		                   DMA_CCR_PL_HIGH) != 0) {
+			spi_dma_cancel(SPI1, DMA_REQ_SPI1_RX, rx_len, DMA_REQ_SPI1_TX, 0);
+			return -1;
+		}
 		spi_enable_rx_dma(SPI1);
 	}
 	while (!(SPI1->SR & SPI_SR_TXE))
 		;
 	// BSY=0
+	return 0;
 }
 
 int
@@ -457,9 +463,10 @@ spi_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int rx_len)
 	/*return -1;
 }
 */
-	/* Reset DMA channels*/
-	dma_channel_reset(DMA1, DMA_CHANNEL3);
-	dma_channel_reset(DMA1, DMA_CHANNEL2);
+	if (tx_len > 0xFFFF || rx_len > 0xFFFF ||
+	    spi_dma_claim(DMA_REQ_SPI1_RX, &spi1_dma_rx, rx_len, DMA_REQ_SPI1_TX, &spi1_dma_tx,
+	                  tx_len) != 0)
+		return -1;
 
 	/* Reset SPI data and status registers.
 	 * Here we assume that the SPI peripheral is NOT
@@ -473,32 +480,22 @@ spi_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int rx_len)
 
 	/* Set up rx dma, note it has higher priority to avoid overrun */
 	if (rx_len > 0) {
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL2, (uint32_t)&SPI1->DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL2, (uint32_t)rx_buf);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL2, rx_len);
-		dma_set_read_from_peripheral(DMA1, DMA_CHANNEL2);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL2);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL2, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL2, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL2, DMA_CCR_PL_VERY_HIGH);
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL2);
-		dma_enable_channel(DMA1, DMA_CHANNEL2);
+		if (spi_dma_submit(SPI1, DMA_REQ_SPI1_RX, &spi1_dma_rx, rx_buf, rx_len,
+		                   DMA_CCR_PL_VERY_HIGH) != 0) {
+			spi_dma_cancel(SPI1, DMA_REQ_SPI1_RX, rx_len, DMA_REQ_SPI1_TX, tx_len);
+			return -1;
+		}
 		spi_enable_rx_dma(SPI1);
 	}
 
 	transceive_status = ONE;
 	/* Set up tx dma */
 	if (tx_len > 0) {
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t)&SPI1->DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t)tx_buf);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL3, tx_len);
-		dma_set_read_from_memory(DMA1, DMA_CHANNEL3);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_HIGH);
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
-		dma_enable_channel(DMA1, DMA_CHANNEL3);
+		if (spi_dma_submit(SPI1, DMA_REQ_SPI1_TX, &spi1_dma_tx, tx_buf, tx_len,
+		                   DMA_CCR_DIR | DMA_CCR_PL_HIGH) != 0) {
+			spi_dma_cancel(SPI1, DMA_REQ_SPI1_RX, rx_len, DMA_REQ_SPI1_TX, tx_len);
+			return -1;
+		}
 		spi_enable_tx_dma(SPI1);
 	}
 	while (!(SPI1->SR & SPI_SR_TXE))
@@ -521,9 +518,11 @@ spi2_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int rx_len)
 	/*return -1;
 }
 */
-	/* Reset DMA channels*/
-	dma_channel_reset(DMA1, DMA_CHANNEL4);
-	dma_channel_reset(DMA1, DMA_CHANNEL5);
+	/* DMA1 ch4/ch5 are also USART1's: fail rather than take them over */
+	if (tx_len > 0xFFFF || rx_len > 0xFFFF ||
+	    spi_dma_claim(DMA_REQ_SPI2_RX, &spi2_dma_rx, rx_len, DMA_REQ_SPI2_TX, &spi2_dma_tx,
+	                  tx_len) != 0)
+		return -1;
 
 	/* Reset SPI data and status registers.
 	 * Here we assume that the SPI peripheral is NOT
@@ -536,32 +535,22 @@ spi2_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int rx_len)
 	}
 	/* Set up rx dma, note it has higher priority to avoid overrun */
 	if (rx_len > 0) {
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL4, (uint32_t)&SPI2->DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL4, (uint32_t)rx_buf);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL4, rx_len);
-		dma_set_read_from_peripheral(DMA1, DMA_CHANNEL4);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL4);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL4, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL4, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL4, DMA_CCR_PL_VERY_HIGH);
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL4);
-		dma_enable_channel(DMA1, DMA_CHANNEL4);
+		if (spi_dma_submit(SPI2, DMA_REQ_SPI2_RX, &spi2_dma_rx, rx_buf, rx_len,
+		                   DMA_CCR_PL_VERY_HIGH) != 0) {
+			spi_dma_cancel(SPI2, DMA_REQ_SPI2_RX, rx_len, DMA_REQ_SPI2_TX, tx_len);
+			return -1;
+		}
 		spi_enable_rx_dma(SPI2);
 	}
 
 	transceive_status = ONE;
 	/* Set up tx dma */
 	if (tx_len > 0) {
-		dma_set_peripheral_address(DMA1, DMA_CHANNEL5, (uint32_t)&SPI2->DR);
-		dma_set_memory_address(DMA1, DMA_CHANNEL5, (uint32_t)tx_buf);
-		dma_set_number_of_data(DMA1, DMA_CHANNEL5, tx_len);
-		dma_set_read_from_memory(DMA1, DMA_CHANNEL5);
-		dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL5);
-		dma_set_peripheral_size(DMA1, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
-		dma_set_memory_size(DMA1, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
-		dma_set_priority(DMA1, DMA_CHANNEL5, DMA_CCR_PL_HIGH);
-		dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
-		dma_enable_channel(DMA1, DMA_CHANNEL5);
+		if (spi_dma_submit(SPI2, DMA_REQ_SPI2_TX, &spi2_dma_tx, tx_buf, tx_len,
+		                   DMA_CCR_DIR | DMA_CCR_PL_HIGH) != 0) {
+			spi_dma_cancel(SPI2, DMA_REQ_SPI2_RX, rx_len, DMA_REQ_SPI2_TX, tx_len);
+			return -1;
+		}
 		spi_enable_tx_dma(SPI2);
 	}
 	/* if(PINA&0x0020==0)
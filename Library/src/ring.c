@@ -0,0 +1,141 @@
+/* @file 			 : ring.c
+ *  @Description: Lock-free single-producer/single-consumer byte queue (see ring.h).
+ *
+ * Ordering: the producer stores the data before it publishes head (release), the consumer
+ * loads head (acquire) before it reads the data, and the same the other way round for tail
+ * and the free space. On the Cortex-M3 the acquire/release pairs compile to DMB; on the
+ * host they make the queue usable between two threads.
+ */
+#include "ring.h"
+
+#define RING_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define RING_STORE(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+
+/** @brief Attach a buffer to an empty queue.
+        @param[in] ring queue
+        @param[in] buf storage, `size` bytes
+        @param[in] size power of two, 2 .. 32768
+        @return 0, or -1 if size is not a power of two in range
+        @example  static uint8_t tx_buf[256]; ring_init(&tx, tx_buf, sizeof(tx_buf));
+*/
+int
+ring_init(ring_t *ring, uint8_t *buf, uint16_t size)
+{
+	if (size < 2 || size > 32768U || (size & (size - 1)) != 0)
+		return -1;
+
+	ring->buf = buf;
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	return 0;
+}
+
+/** @brief Empty the queue. Neither side may be using it.
+        @param[in] ring queue
+*/
+void
+ring_reset(ring_t *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/** @brief Bytes queued. Exact for the consumer, a lower bound for the producer.
+        @param[in] ring queue
+*/
+uint16_t
+ring_count(const ring_t *ring)
+{
+	return (uint16_t)(RING_LOAD(ring->head) - RING_LOAD(ring->tail));
+}
+
+/** @brief Free bytes. Exact for the producer, a lower bound for the consumer.
+        @param[in] ring queue
+*/
+uint16_t
+ring_space(const ring_t *ring)
+{
+	return (uint16_t)(ring->mask + 1U - ring_count(ring));
+}
+
+/** @brief Queue one byte (producer).
+        @param[in] ring queue
+        @param[in] byte value
+        @return 0, or -1 if the queue is full
+*/
+int
+ring_put(ring_t *ring, uint8_t byte)
+{
+	uint16_t head = ring->head;
+
+	if ((uint16_t)(head - RING_LOAD(ring->tail)) > ring->mask)
+		return -1;
+
+	ring->buf[head & ring->mask] = byte;
+	RING_STORE(ring->head, (uint16_t)(head + 1U));
+	return 0;
+}
+
+/** @brief Queue as many bytes as fit (producer).
+        @param[in] ring queue
+        @param[in] data bytes
+        @param[in] len byte count
+        @return bytes queued, 0 .. len
+*/
+uint16_t
+ring_write(ring_t *ring, const uint8_t *data, uint16_t len)
+{
+	uint16_t head = ring->head;
+	uint16_t space = (uint16_t)(ring->mask + 1U - (uint16_t)(head - RING_LOAD(ring->tail)));
+	uint16_t i;
+
+	if (len > space)
+		len = space;
+	for (i = 0; i < len; i++)
+		ring->buf[(uint16_t)(head + i) & ring->mask] = data[i];
+
+	/* One publish for the whole block */
+	RING_STORE(ring->head, (uint16_t)(head + len));
+	return len;
+}
+
+/** @brief Take one byte (consumer).
+        @param[in] ring queue
+        @param[out] byte value
+        @return 0, or -1 if the queue is empty
+*/
+int
+ring_get(ring_t *ring, uint8_t *byte)
+{
+	uint16_t tail = ring->tail;
+
+	if (RING_LOAD(ring->head) == tail)
+		return -1;
+
+	*byte = ring->buf[tail & ring->mask];
+	RING_STORE(ring->tail, (uint16_t)(tail + 1U));
+	return 0;
+}
+
+/** @brief Take up to len bytes (consumer).
+        @param[in] ring queue
+        @param[out] data destination
+        @param[in] len room in data
+        @return bytes taken, 0 .. len
+*/
+uint16_t
+ring_read(ring_t *ring, uint8_t *data, uint16_t len)
+{
+	uint16_t tail = ring->tail;
+	uint16_t count = (uint16_t)(RING_LOAD(ring->head) - tail);
+	uint16_t i;
+
+	if (len > count)
+		len = count;
+	for (i = 0; i < len; i++)
+		data[i] = ring->buf[(uint16_t)(tail + i) & ring->mask];
+
+	RING_STORE(ring->tail, (uint16_t)(tail + len));
+	return len;
+}
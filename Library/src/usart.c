@@ -34,10 +34,100 @@ This initialize the GPIO enables it's clock
 */
 #include "usart.h"
 #include "dma.h"
+#include "nvic.h"
 
 // double rate,Div;
 int __clk = 8;  // Default to 8 MHz if not initialized by initClk()
 
+#define USART_COUNT 5
+#define USART_CR3_DMAR (1 << 6)
+
+/* Buffered mode state, one per USART (index 0 = USART1) */
+typedef struct {
+	ring_t tx;                     /* main loop -> USART interrupt */
+	ring_t rx;                     /* USART interrupt -> main loop */
+	volatile uint32_t rx_overruns; /* bytes lost: rx queue full or ORE */
+	uint8_t enabled;
+} usart_buffer_t;
+
+static usart_buffer_t usart_buffers[USART_COUNT];
+static USART_TypeDef *usart_stdout = 0;
+
+static const u8 usart_irqs[USART_COUNT] = {NVIC_USART1_IRQ, NVIC_USART2_IRQ, NVIC_USART3_IRQ,
+                                           NVIC_UART4_IRQ, NVIC_UART5_IRQ};
+
+/* Circular DMA reception, USART1..USART4 (UART5 has no DMA request) */
+#define USART_DMA_RX_COUNT 4
+
+static const u16 usart_dma_rx_requests[USART_DMA_RX_COUNT] = {
+    DMA_REQ_USART1_RX, DMA_REQ_USART2_RX, DMA_REQ_USART3_RX, DMA_REQ_UART4_RX};
+static const u16 usart_dma_tx_requests[USART_DMA_RX_COUNT] = {
+    DMA_REQ_USART1_TX, DMA_REQ_USART2_TX, DMA_REQ_USART3_TX, DMA_REQ_UART4_TX};
+
+/* received only grows, in the interrupts; consumed only in the main loop. Both wrap at 2^32,
+   and with a power of two size the ring position is the count masked. */
+typedef struct {
+	USART_TypeDef *usart;
+	u16 request;
+	dma_xfer_t xfer;            /* circular, runs until stopped */
+	uint8_t *buf;
+	uint16_t size;
+	uint16_t last;              /* DMA position at the last publish */
+	volatile uint32_t received; /* bytes published since start */
+	uint32_t consumed;          /* bytes the reader is done with */
+	uint32_t overflows;         /* bytes lost: the DMA lapped the reader */
+	usart_dma_rx_callback_t callback;
+	volatile uint8_t enabled;
+} usart_dma_rx_t;
+
+static usart_dma_rx_t usart_dma_rx[USART_DMA_RX_COUNT];
+
+/* One-shot transfers of dma_read_usartN / dma_write_usartN */
+static dma_xfer_t usart_dma_reads[USART_DMA_RX_COUNT];
+static dma_xfer_t usart_dma_writes[USART_DMA_RX_COUNT];
+
+/* Index of a USART in usart_buffers, -1 if unknown */
+static int
+usart_index(USART_TypeDef *usart)
+{
+	if (usart == USART1)
+		return 0;
+	if (usart == USART2)
+		return 1;
+	if (usart == USART3)
+		return 2;
+	if (usart == USART4)
+		return 3;
+	if (usart == USART5)
+		return 4;
+	return -1;
+}
+
+/* Buffered state of a USART, 0 if not in buffered mode */
+static usart_buffer_t *
+usart_buffer(USART_TypeDef *usart)
+{
+	int i = usart_index(usart);
+
+	return (i >= 0 && usart_buffers[i].enabled) ? &usart_buffers[i] : 0;
+}
+
+/* Circular reception state of a USART, 0 if not receiving by DMA */
+static usart_dma_rx_t *
+usart_dma_rx_state(USART_TypeDef *usart)
+{
+	int i = usart_index(usart);
+
+	return (i >= 0 && i < USART_DMA_RX_COUNT && usart_dma_rx[i].enabled) ? &usart_dma_rx[i] : 0;
+}
+
+/* Let the interrupt drain the tx queue (after the bytes were published) */
+static void
+usart_start_tx(USART_TypeDef *usart)
+{
+	usart->CR1 |= USART_CR1_TXEIE;
+}
+
 /*
 void usartremap(USART_TypeDef *usart, int setmap){
     if(usart==USART1){
@@ -125,6 +215,14 @@ usartInit(USART_TypeDef *usart, uint32_t br, int setremap)
 void
 sendChar(USART_TypeDef *uart, char ch)
 {
+	usart_buffer_t *b = usart_buffer(uart);
+
+	if (b) {  // buffered: wait for room in the queue, not for the line
+		while (ring_put(&b->tx, (uint8_t)ch) != 0)
+			;
+		usart_start_tx(uart);
+		return;
+	}
 	while (!(uart->SR & USART_SR_TXE))
 		;
 	uart->DR = (ch & 0xFF);
@@ -139,6 +237,14 @@ sendChar(USART_TypeDef *uart, char ch)
 unsigned char
 GetChar(USART_TypeDef *urt)
 {
+	usart_buffer_t *b = usart_buffer(urt);
+	uint8_t c;
+
+	if (b) {  // buffered: the interrupt already took it from DR
+		while (ring_get(&b->rx, &c) != 0)
+			;
+		return c;
+	}
 	while (!(urt->SR & USART_SR_RXNE))
 		;
 	return ((unsigned char)(urt->DR & 0xFF));
@@ -198,193 +304,515 @@ Send_String(USART_TypeDef *uart, char *str)
 	}
 }
 
-/** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART1.
-        @param[in] *data i.e char *device="Hello Mcu";
-        @example   dma_write_usart1(device,10); and or \or
-                   dma_write_usart1("hello Mcu",10);
+/*---------------------------------------------------------------------------*/
+/** @brief Switch a USART (after usartInit) to buffered, interrupt-driven mode.
+        RXNE moves received bytes into the rx queue; TXE is enabled while the tx queue
+        holds bytes. sendChar, GetChar and the functions built on them use the queues
+        from then on, blocking only while a queue is full (tx) or empty (rx).
+        @param[in] usart i.e USART1
+        @param[in] tx_buf, tx_size transmit queue storage, size a power of two
+        @param[in] rx_buf, rx_size receive queue storage, size a power of two
+        @return 0, or -1 on a bad USART or size
+        @example  static uint8_t tx[256], rx[64];
+                  usartInit(USART1, 115200, 0);
+                  usart_buffered_init(USART1, tx, sizeof(tx), rx, sizeof(rx));
 */
-void
-dma_write_usart1(char *data, int size)
+int
+usart_buffered_init(USART_TypeDef *usart, uint8_t *tx_buf, uint16_t tx_size, uint8_t *rx_buf,
+                    uint16_t rx_size)
 {
-	/*
-	 * Using channel 4 for USART1_TX
-	 */
+	int i = usart_index(usart);
+
+	if (i < 0)
+		return -1;
+	usart_buffers[i].enabled = 0;
+
+	usart_dma_rx_stop(usart);
+	nvic_disable_irq(usart_irqs[i]);
+	usart->CR1 &= ~(USART_CR1_RXNEIE | USART_CR1_TXEIE);
+	if (ring_init(&usart_buffers[i].tx, tx_buf, tx_size) != 0 ||
+	    ring_init(&usart_buffers[i].rx, rx_buf, rx_size) != 0)
+		return -1;
+	usart_buffers[i].rx_overruns = 0;
+
+	/* DR belongs to the interrupt now, not to a DMA channel */
+	usart->CR3 &= ~(USART_DMA_EN | USART_CR3_DMAR);
+	usart_buffers[i].enabled = 1;
+	usart->CR1 |= USART_CR1_RXNEIE;
+	nvic_enable_irq(usart_irqs[i]);
+	return 0;
+}
 
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA1, DMA_CHANNEL4);
+/** @brief Queue bytes for transmission without waiting.
+        @param[in] usart i.e USART1 (buffered)
+        @param[in] data bytes
+        @param[in] len byte count
+        @return bytes queued (0 .. len, fewer when the queue fills), -1 if not buffered
+        @example  n = usart_write(USART1, line, len); // send the rest later
+*/
+int
+usart_write(USART_TypeDef *usart, const void *data, int len)
+{
+	usart_buffer_t *b = usart_buffer(usart);
+	uint16_t n;
+
+	if (!b || len < 0)
+		return -1;
+	if (len > 0xFFFF)
+		len = 0xFFFF;
+
+	n = ring_write(&b->tx, (const uint8_t *)data, (uint16_t)len);
+	if (n)
+		usart_start_tx(usart);
+	return n;
+}
 
-	dma_set_peripheral_address(DMA1, DMA_CHANNEL4, (u32)&USART1->DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL4, (u32)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL4, size);
-	dma_set_read_from_memory(DMA1, DMA_CHANNEL4);
-	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL4);
-	dma_set_peripheral_size(DMA1, DMA_CHANNEL4, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA1, DMA_CHANNEL4, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA1, DMA_CHANNEL4, DMA_CCR_PL_VERY_HIGH);
+/** @brief Take received bytes without waiting.
+        @param[in] usart i.e USART1 (buffered)
+        @param[out] data destination
+        @param[in] len room in data
+        @return bytes read (0 .. len), -1 if not buffered
+*/
+int
+usart_read(USART_TypeDef *usart, void *data, int len)
+{
+	usart_buffer_t *b = usart_buffer(usart);
 
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL4);
+	if (!b || len < 0)
+		return -1;
+	if (len > 0xFFFF)
+		len = 0xFFFF;
+	return ring_read(&b->rx, (uint8_t *)data, (uint16_t)len);
+}
 
-	dma_enable_channel(DMA1, DMA_CHANNEL4);
+/** @brief Received bytes waiting in the rx queue (-1 if not buffered). */
+int
+usart_rx_available(USART_TypeDef *usart)
+{
+	usart_buffer_t *b = usart_buffer(usart);
 
-	//  usart_enable_tx_dma(USART2);
-	USART1->CR3 |= USART_DMA_EN;
+	return b ? ring_count(&b->rx) : -1;
 }
-/** @brief Read String aka Array of Characters Using Direct Memory Access Channel for USART1.
-        @param[in] *data i.e char *device="Hello Mcu";
-        @example   dma_write_usart1(device,10); and or \or
-                   dma_write_usart1("hello Mcu",10);
+
+/** @brief Bytes still queued for transmission (-1 if not buffered). */
+int
+usart_tx_pending(USART_TypeDef *usart)
+{
+	usart_buffer_t *b = usart_buffer(usart);
+
+	return b ? ring_count(&b->tx) : -1;
+}
+
+/** @brief Received bytes lost since usart_buffered_init (queue full or hardware overrun). */
+uint32_t
+usart_rx_overruns(USART_TypeDef *usart)
+{
+	usart_buffer_t *b = usart_buffer(usart);
+
+	return b ? b->rx_overruns : 0;
+}
+
+/** @brief Select the USART printf writes to through _write (0 = none).
+        @example  usart_set_stdout(USART1); printf("speed %d\n", speed);
 */
 void
-dma_read_usart1(char *data, int size)
+usart_set_stdout(USART_TypeDef *usart)
 {
-	/*
-	 * Using channel 5 for USART1_RX
-	 */
+	usart_stdout = usart;
+}
 
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA1, DMA_CHANNEL5);
+/** @brief newlib retarget: stdout/stderr go to the usart_set_stdout USART. Buffered, it
+        returns once everything is queued, waiting only while the tx queue is full; so it
+        must not be called with the USART interrupt masked or from a handler of the same or
+        higher priority. Not buffered, it polls TXE like sendChar.
+*/
+int
+_write(int file, char *ptr, int len)
+{
+	int sent = 0;
+	int n;
 
-	dma_set_peripheral_address(DMA1, DMA_CHANNEL5, (uint32_t)&USART1->DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL5, (uint32_t)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL5, size);
-	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL5);
-	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL5);
-	dma_set_peripheral_size(DMA1, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA1, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA1, DMA_CHANNEL5, DMA_CCR_PL_HIGH);
+	if ((file != 1 && file != 2) || usart_stdout == 0)
+		return -1;
 
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
+	while (sent < len) {
+		n = usart_write(usart_stdout, ptr + sent, len - sent);
+		if (n < 0) {
+			sendChar(usart_stdout, ptr[sent]);
+			n = 1;
+		}
+		sent += n;
+	}
+	return len;
+}
 
-	dma_enable_channel(DMA1, DMA_CHANNEL5);
+static void
+usart_dma_rx_publish(usart_dma_rx_t *r, int idle);
 
-	// usart_enable_rx_dma(USART2);
-	USART1->CR3 |= 1 << 6;
+/* DMA callback of a circular reception: half or full buffer written */
+static void
+usart_dma_rx_event(dma_xfer_t *xfer, u32 events)
+{
+	usart_dma_rx_t *r = (usart_dma_rx_t *)xfer->arg;
+
+	if ((events & (DMA_EVENT_HT | DMA_EVENT_TC)) && r->enabled)
+		usart_dma_rx_publish(r, 0);
 }
 
-/** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART2.
-        @param[in] *data i.e char *device="Hello Mcu";
-        @example   dma_write_usart2(device,10); and or \or
-                   dma_write_usart2("hello Mcu",10);
+/*---------------------------------------------------------------------------*/
+/** @brief Receive continuously by DMA into buf (after usartInit). The channel runs in circular
+        mode, so no byte costs CPU time: the interrupts come at half and full buffer and when
+        the line goes idle after a burst, and each one publishes the bytes written since the
+        previous one. At 2 Mbaud with a 512 byte buffer that is ~800 interrupts/s plus one per
+        message. Channels: USART1 DMA1 ch5, USART2 DMA1 ch6, USART3 DMA1 ch3, UART4 DMA2 ch3
+        (the ones dma_read_usartN use).
+        The reader must keep up within size bytes of the DMA, and the USART and DMA channel
+        interrupts must share one priority (the reset default) since both publish. A
+        buffered USART (usart_buffered_init first) keeps its tx queue; reception moves here.
+        @param[in] usart i.e USART1 .. USART4
+        @param[in] buf, size ring storage, size a power of two (2 .. 32768)
+        @param[in] callback called from the interrupts after each publish, or 0
+        @return 0, or -1 on UART5, a bad size, or a DMA channel another peripheral holds
+        @example  static uint8_t rx[512];
+                  usartInit(USART2, 2000000, 0);
+                  usart_dma_rx_start(USART2, rx, sizeof(rx), on_rx);
 */
+int
+usart_dma_rx_start(USART_TypeDef *usart, uint8_t *buf, uint16_t size,
+                   usart_dma_rx_callback_t callback)
+{
+	int i = usart_index(usart);
+	usart_dma_rx_t *r;
+
+	if (i < 0 || i >= USART_DMA_RX_COUNT || buf == 0 || size < 2 || size > 32768 ||
+	    (size & (size - 1)))
+		return -1;
+	usart_dma_rx_stop(usart);
+	if (dma_claim(usart_dma_rx_requests[i]) != 0)
+		return -1;  // another peripheral of the channel has it
+	r = &usart_dma_rx[i];
+
+	r->usart = usart;
+	r->request = usart_dma_rx_requests[i];
+	r->buf = buf;
+	r->size = size;
+	r->last = 0;
+	r->received = 0;
+	r->consumed = 0;
+	r->overflows = 0;
+	r->callback = callback;
+
+	r->xfer.peripheral = (u32)&usart->DR;
+	r->xfer.memory = (u32)buf;
+	r->xfer.count = size;
+	r->xfer.config = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_PSIZE_8BIT |
+	                 DMA_CCR_MSIZE_8BIT | DMA_CCR_PL_HIGH;
+	r->xfer.callback = usart_dma_rx_event;
+	r->xfer.arg = r;
+
+	/* RX belongs to the DMA: no RXNE interrupt, and a stale byte or IDLE flag is dropped */
+	usart->CR1 &= ~USART_CR1_RXNEIE;
+	(void)usart->SR;
+	(void)usart->DR;
+
+	r->enabled = 1;
+	if (dma_submit(r->request, &r->xfer) != 0) {  // a dma_read_usartN still runs first
+		r->enabled = 0;
+		return -1;
+	}
+	usart->CR3 |= USART_CR3_DMAR;
+	usart->CR1 |= USART_CR1_IDLEIE;
+	nvic_enable_irq(usart_irqs[i]);
+	return 0;
+}
+
+/** @brief Stop circular DMA reception (nothing if not started). Unconsumed bytes are dropped. */
 void
-dma_write_usart2(char *data, int size)
+usart_dma_rx_stop(USART_TypeDef *usart)
 {
-	/*
-	 * Using channel 7 for USART2_TX
-	 */
+	int i = usart_index(usart);
 
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA1, DMA_CHANNEL7);
+	if (i < 0 || i >= USART_DMA_RX_COUNT || !usart_dma_rx[i].enabled)
+		return;
+
+	usart->CR1 &= ~USART_CR1_IDLEIE;
+	usart->CR3 &= ~USART_CR3_DMAR;
+	if (!usart_buffers[i].enabled)
+		nvic_disable_irq(usart_irqs[i]);
+	usart_dma_rx[i].enabled = 0;
+	dma_release(usart_dma_rx[i].request);
+}
 
-	dma_set_peripheral_address(DMA1, DMA_CHANNEL7, (u32)&USART2->DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL7, (u32)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL7, size);
-	dma_set_read_from_memory(DMA1, DMA_CHANNEL7);
-	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL7);
-	dma_set_peripheral_size(DMA1, DMA_CHANNEL7, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA1, DMA_CHANNEL7, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA1, DMA_CHANNEL7, DMA_CCR_PL_VERY_HIGH);
+/* Publish what the DMA wrote since the last call (interrupts only) */
+static void
+usart_dma_rx_publish(usart_dma_rx_t *r, int idle)
+{
+	uint16_t pos = r->size - dma_remaining(r->request);
+	uint16_t count;
+
+	/* Less than a lap since the last publish: HT and TC come every half buffer */
+	count = (uint16_t)(pos - r->last) & (r->size - 1);
+	r->last = pos & (r->size - 1);  // CNDTR reads 0 while it reloads
+	if (count == 0 && !idle)
+		return;
+	r->received += count;
+	if (r->callback)
+		r->callback(r->usart, count, idle);
+}
 
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL7);
+/* Bytes published and not consumed. If the DMA lapped the reader they are all dropped:
+   part of them was overwritten, and which part is unknown. */
+static uint32_t
+usart_dma_rx_pending(usart_dma_rx_t *r)
+{
+	uint32_t n = r->received - r->consumed;
 
-	dma_enable_channel(DMA1, DMA_CHANNEL7);
+	if (n > r->size) {
+		r->overflows += n;
+		r->consumed += n;
+		n = 0;
+	}
+	return n;
+}
 
-	//  usart_enable_tx_dma(USART2);
-	USART2->CR3 |= USART_DMA_EN;
+/** @brief Oldest received bytes, in place: the contiguous part up to the end of the ring
+        (a wrapped message takes two peeks). The bytes stay valid until consumed, as long
+        as the reader keeps within size bytes of the DMA.
+        @param[in] usart i.e USART2 (receiving by DMA)
+        @param[out] span start of the bytes in the ring
+        @return bytes at span (0 if none), -1 if not receiving by DMA
+        @example  while ((n = usart_dma_rx_peek(USART2, &p)) > 0)
+                          usart_dma_rx_consume(USART2, parse(p, n));
+*/
+int
+usart_dma_rx_peek(USART_TypeDef *usart, const uint8_t **span)
+{
+	usart_dma_rx_t *r = usart_dma_rx_state(usart);
+	uint32_t n;
+	uint16_t tail;
+
+	if (!r)
+		return -1;
+	n = usart_dma_rx_pending(r);
+	tail = (uint16_t)(r->consumed & (r->size - 1));
+	if (n > (uint32_t)(r->size - tail))
+		n = r->size - tail;
+	*span = &r->buf[tail];
+	return (int)n;
 }
-/** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART2.
-        @param[in] *data Expected recieved Array of characters i.e char device[size];
-        @param[in] size Number of expected recieved Array of characters i.e size  10
-        @example   dma_read_usart4(device,10);
+
+/** @brief Release bytes returned by usart_dma_rx_peek.
+        @param[in] usart i.e USART2 (receiving by DMA)
+        @param[in] n bytes done with
+        @return bytes released (fewer than n when fewer are pending, 0 when the DMA lapped
+                the span meanwhile: usart_dma_rx_overflows grew), -1 if not receiving by DMA
 */
+int
+usart_dma_rx_consume(USART_TypeDef *usart, int n)
+{
+	usart_dma_rx_t *r = usart_dma_rx_state(usart);
+	uint32_t pending;
+
+	if (!r || n < 0)
+		return -1;
+	pending = usart_dma_rx_pending(r);
+	if ((uint32_t)n > pending)
+		n = (int)pending;
+	r->consumed += (uint32_t)n;
+	return n;
+}
+
+/** @brief Received bytes not yet consumed, wrap included (-1 if not receiving by DMA). */
+int
+usart_dma_rx_available(USART_TypeDef *usart)
+{
+	usart_dma_rx_t *r = usart_dma_rx_state(usart);
+
+	return r ? (int)usart_dma_rx_pending(r) : -1;
+}
+
+/** @brief Received bytes dropped since usart_dma_rx_start because the DMA lapped the reader. */
+uint32_t
+usart_dma_rx_overflows(USART_TypeDef *usart)
+{
+	usart_dma_rx_t *r = usart_dma_rx_state(usart);
+
+	return r ? r->overflows : 0;
+}
+
+/* USART interrupt: receive into the rx queue, transmit from the tx queue, publish the DMA
+   reception when the line goes idle */
+static void
+usart_irq(USART_TypeDef *usart, int i)
+{
+	usart_buffer_t *b = &usart_buffers[i];
+	uint16_t sr = usart->SR;
+	uint8_t byte;
+
+	if ((usart->CR1 & USART_CR1_IDLEIE) && (sr & USART_SR_IDLE) && i < USART_DMA_RX_COUNT) {
+		(void)usart->DR;  // SR then DR read clears IDLE; the DMA already took the data
+		usart_dma_rx_publish(&usart_dma_rx[i], 1);
+	}
+
+	if ((usart->CR1 & USART_CR1_RXNEIE) && (sr & (USART_SR_RXNE | USART_SR_ORE))) {
+		byte = (uint8_t)usart->DR;  // SR then DR read also clears ORE
+		if (sr & USART_SR_ORE)
+			b->rx_overruns++;
+		if ((sr & USART_SR_RXNE) && ring_put(&b->rx, byte) != 0)
+			b->rx_overruns++;
+	}
+
+	if ((usart->CR1 & USART_CR1_TXEIE) && (sr & USART_SR_TXE)) {
+		if (ring_get(&b->tx, &byte) == 0)
+			usart->DR = byte;
+		else
+			usart->CR1 &= ~USART_CR1_TXEIE;  // queue empty: usart_start_tx re-arms
+	}
+}
+
 void
-dma_read_usart2(char *data, int size)
+USART1_IRQHandler(void)
+{
+	usart_irq(USART1, 0);
+}
+
+void
+USART2_IRQHandler(void)
+{
+	usart_irq(USART2, 1);
+}
+
+void
+USART3_IRQHandler(void)
+{
+	usart_irq(USART3, 2);
+}
+
+void
+UART4_IRQHandler(void)
 {
-	/*
-	 * Using channel 6 for USART2_RX
-	 */
+	usart_irq(USART4, 3);
+}
 
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA1, DMA_CHANNEL6);
+void
+UART5_IRQHandler(void)
+{
+	usart_irq(USART5, 4);
+}
 
-	dma_set_peripheral_address(DMA1, DMA_CHANNEL6, (uint32_t)&USART2->DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL6, (uint32_t)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL6, size);
-	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL6);
-	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL6);
-	dma_set_peripheral_size(DMA1, DMA_CHANNEL6, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA1, DMA_CHANNEL6, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA1, DMA_CHANNEL6, DMA_CCR_PL_HIGH);
+/* End of a one-shot transfer: free the channel unless another one follows */
+static void
+usart_dma_once_done(dma_xfer_t *xfer, u32 events)
+{
+	u16 request = (u16)(uintptr_t)xfer->arg;
 
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL6);
+	(void)events;
+	if (!dma_busy(request))
+		dma_release(request);
+}
+
+/* Run a one-shot transfer through the DMA manager, after the previous one of the same
+   direction (spins until it is done). */
+static int
+usart_dma_once(USART_TypeDef *usart, int tx, char *data, int size)
+{
+	int i = usart_index(usart);
+	dma_xfer_t *xfer;
+	u16 request;
+
+	if (i < 0 || i >= USART_DMA_RX_COUNT || size <= 0 || size > 0xFFFF)
+		return -1;
+	if (!tx && usart_dma_rx[i].enabled)
+		return -1;  // the circular reception owns the channel
+	xfer = tx ? &usart_dma_writes[i] : &usart_dma_reads[i];
+	request = tx ? usart_dma_tx_requests[i] : usart_dma_rx_requests[i];
+
+	while (xfer->queued)
+		;
+	if (dma_claim(request) != 0)
+		return -1;  // another peripheral of the channel has it
+
+	xfer->peripheral = (u32)&usart->DR;
+	xfer->memory = (u32)data;
+	xfer->count = (u16)size;
+	xfer->config = DMA_CCR_MINC | DMA_CCR_PSIZE_8BIT | DMA_CCR_MSIZE_8BIT |
+	               (tx ? (DMA_CCR_DIR | DMA_CCR_PL_VERY_HIGH) : DMA_CCR_PL_HIGH);
+	xfer->callback = usart_dma_once_done;
+	xfer->arg = (void *)(uintptr_t)request;
+	if (dma_submit(request, xfer) != 0)
+		return -1;
+
+	usart->CR3 |= tx ? USART_DMA_EN : USART_CR3_DMAR;
+	return 0;
+}
 
-	dma_enable_channel(DMA1, DMA_CHANNEL6);
+/** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART1.
+        @param[in] *data i.e char *device="Hello Mcu";
+        @example   dma_write_usart1(device,10); and or \or
+                   dma_write_usart1("hello Mcu",10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
+*/
+int
+dma_write_usart1(char *data, int size)
+{
+	return usart_dma_once(USART1, 1, data, size);
+}
+/** @brief Read String aka Array of Characters Using Direct Memory Access Channel for USART1.
+        @param[in] *data i.e char *device="Hello Mcu";
+        @example   dma_write_usart1(device,10); and or \or
+                   dma_write_usart1("hello Mcu",10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
+*/
+int
+dma_read_usart1(char *data, int size)
+{
+	return usart_dma_once(USART1, 0, data, size);
+}
 
-	// usart_enable_rx_dma(USART2);
-	USART2->CR3 |= 1 << 6;
+/** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART2.
+        @param[in] *data i.e char *device="Hello Mcu";
+        @example   dma_write_usart2(device,10); and or \or
+                   dma_write_usart2("hello Mcu",10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
+*/
+int
+dma_write_usart2(char *data, int size)
+{
+	return usart_dma_once(USART2, 1, data, size);
+}
+/** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART2.
+        @param[in] *data Expected recieved Array of characters i.e char device[size];
+        @param[in] size Number of expected recieved Array of characters i.e size  10
+        @example   dma_read_usart4(device,10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
+*/
+int
+dma_read_usart2(char *data, int size)
+{
+	return usart_dma_once(USART2, 0, data, size);
 }
 /*---------USART3 DMA-----------------*/
 /** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART3.
         @param[in] *data i.e char *device="Hello Mcu";
         @example   dma_write_usart3(device,10); and or \or
                    dma_write_usart3("hello Mcu",10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
 */
-void
+int
 dma_write_usart3(char *data, int size)
 {
-	/*
-	 * Using channel 2 for USART3_TX
-	 */
-
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA1, DMA_CHANNEL7);
-
-	dma_set_peripheral_address(DMA1, DMA_CHANNEL2, (u32)&USART3->DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL2, (u32)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL2, size);
-	dma_set_read_from_memory(DMA1, DMA_CHANNEL2);
-	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL2);
-	dma_set_peripheral_size(DMA1, DMA_CHANNEL2, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA1, DMA_CHANNEL2, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA1, DMA_CHANNEL2, DMA_CCR_PL_VERY_HIGH);
-
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL2);
-
-	dma_enable_channel(DMA1, DMA_CHANNEL2);
-
-	//  usart_enable_tx_dma(USART2);
-	USART3->CR3 |= USART_DMA_EN;
+	return usart_dma_once(USART3, 1, data, size);
 }
 /** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART3.
         @param[in] *data Expected recieved Array of characters i.e char device[size];
         @param[in] size Number of expected recieved Array of characters i.e size  10
         @example   dma_read_usart3(device,10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
 */
-void
+int
 dma_read_usart3(char *data, int size)
 {
-	/*
-	 * Using channel 3 for USART3_RX
-	 */
-
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA1, DMA_CHANNEL3);
-
-	dma_set_peripheral_address(DMA1, DMA_CHANNEL3, (uint32_t)&USART3->DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL3, (uint32_t)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL3, size);
-	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL3);
-	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL3);
-	dma_set_peripheral_size(DMA1, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA1, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA1, DMA_CHANNEL3, DMA_CCR_PL_HIGH);
-
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL3);
-
-	dma_enable_channel(DMA1, DMA_CHANNEL3);
-
-	// usart_enable_rx_dma(USART2);
-	USART3->CR3 |= 1 << 6;
+	return usart_dma_once(USART3, 0, data, size);
 }
 
 /*----------DMA USART4-----------------*/
@@ -392,61 +820,21 @@ dma_read_usart3(char *data, int size)
         @param[in] *data i.e char *device="Hello Mcu";
         @example   dma_write_usart4(device,10); and or \or
                    dma_write_usart4("hello Mcu",10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
 */
-void
+int
 dma_write_usart4(char *data, int size)
 {
-	/*
-	 * Using channel 5 for USART4_TX
-	 */
-
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA2, DMA_CHANNEL5);
-
-	dma_set_peripheral_address(DMA2, DMA_CHANNEL5, (u32)&USART4->DR);
-	dma_set_memory_address(DMA2, DMA_CHANNEL5, (u32)data);
-	dma_set_number_of_data(DMA2, DMA_CHANNEL5, size);
-	dma_set_read_from_memory(DMA2, DMA_CHANNEL5);
-	dma_enable_memory_increment_mode(DMA2, DMA_CHANNEL5);
-	dma_set_peripheral_size(DMA2, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA2, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA2, DMA_CHANNEL5, DMA_CCR_PL_VERY_HIGH);
-
-	dma_enable_transfer_complete_interrupt(DMA2, DMA_CHANNEL5);
-
-	dma_enable_channel(DMA2, DMA_CHANNEL5);
-
-	//  usart_enable_tx_dma(USART2);
-	USART4->CR3 |= USART_DMA_EN;
+	return usart_dma_once(USART4, 1, data, size);
 }
 /** @brief Send String aka Array of Characters Using Direct Memory Access Channel for USART4.
         @param[in] *data Expected recieved Array of characters i.e char device[size];
         @param[in] size Number of expected recieved Array of characters i.e size  10
         @example   dma_read_usart4(device,10);
+        @return 0, or -1 if another peripheral holds the DMA channel (see dma_claim)
 */
-void
+int
 dma_read_usart4(char *data, int size)
 {
-	/*
-	 * Using channel 3 for USART4_RX
-	 */
-
-	/* Reset DMA channel*/
-	dma_channel_reset(DMA2, DMA_CHANNEL3);
-
-	dma_set_peripheral_address(DMA2, DMA_CHANNEL3, (uint32_t)&USART4->DR);
-	dma_set_memory_address(DMA2, DMA_CHANNEL3, (uint32_t)data);
-	dma_set_number_of_data(DMA2, DMA_CHANNEL3, size);
-	dma_set_read_from_peripheral(DMA2, DMA_CHANNEL3);
-	dma_enable_memory_increment_mode(DMA2, DMA_CHANNEL3);
-	dma_set_peripheral_size(DMA2, DMA_CHANNEL3, DMA_CCR_PSIZE_8BIT);
-	dma_set_memory_size(DMA2, DMA_CHANNEL3, DMA_CCR_MSIZE_8BIT);
-	dma_set_priority(DMA2, DMA_CHANNEL3, DMA_CCR_PL_HIGH);
-
-	dma_enable_transfer_complete_interrupt(DMA2, DMA_CHANNEL3);
-
-	dma_enable_channel(DMA2, DMA_CHANNEL3);
-
-	// usart_enable_rx_dma(USART2);
-	USART4->CR3 |= 1 << 6;
+	return usart_dma_once(USART4, 0, data, size);
 }
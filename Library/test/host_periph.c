@@ -0,0 +1,29 @@
+/* @file 			 : host_periph.c
+ *  @Description: Peripheral registers for the host tests (see host_periph.h).
+ */
+#include "host_periph.h"
+#include <sys/mman.h>
+
+/* APB1, APB2 and AHB (DMA, RCC, flash interface) */
+#define PERIPH_BASE 0x40000000UL
+#define PERIPH_SIZE 0x30000UL
+/* SysTick, NVIC and SCB */
+#define SCS_BASE 0xE000E000UL
+#define SCS_SIZE 0x1000UL
+
+static int
+map_range(unsigned long base, unsigned long size)
+{
+	void *p = mmap((void *)base, size, PROT_READ | PROT_WRITE,
+	               MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	return (p == MAP_FAILED) ? -1 : 0;
+}
+
+int
+host_periph_map(void)
+{
+	if (map_range(PERIPH_BASE, PERIPH_SIZE) != 0 || map_range(SCS_BASE, SCS_SIZE) != 0)
+		return -1;
+	return 0;
+}
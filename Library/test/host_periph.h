@@ -0,0 +1,16 @@
+/* @file 			 : host_periph.h
+ *  @Description: Peripheral registers for the host tests. The drivers access registers at their
+ *                fixed STM32F1 addresses; host_periph_map() backs those ranges with plain zeroed
+ *                memory, which the tests then drive in place of the hardware. Register writes
+ *                stick as written (no write-1-to-clear, no read side effects), so a test sets
+ *                and clears status flags itself around each handler call.
+ */
+#ifndef HOST_PERIPH_H
+#define HOST_PERIPH_H
+
+/** @brief Map the APB/AHB peripheral and the Cortex-M3 system control ranges.
+        @return 0, or -1 if either range could not be mapped
+*/
+int
+host_periph_map(void);
+#endif
@@ -0,0 +1,345 @@
+/* @file 			 : i2c_model.c
+ *  @Description: Model of an STM32F1 I2C master and one device (see i2c_model.h).
+ */
+#include "i2c_model.h"
+#include "dma.h"
+#include "nvic.h"
+#include <time.h>
+
+void
+I2C1_EV_IRQHandler(void);
+void
+I2C1_ER_IRQHandler(void);
+void
+I2C2_EV_IRQHandler(void);
+void
+I2C2_ER_IRQHandler(void);
+void
+DMA1_Channel5_IRQHandler(void);
+void
+DMA1_Channel7_IRQHandler(void);
+
+/* DR written by the engine, distinguished from "nothing written" */
+#define DR_UNWRITTEN 0xFFFF
+
+i2c_model_t i2c_model = { .addr = 0xD0, .nack_data_at = -1 };
+
+/* The bus being played */
+static I2C_TypeDef *bus;
+static void (*event_handler)(void);
+static void (*error_handler)(void);
+static void (*dma_handler)(void);
+static u8 dma_channel;
+static int ev_irqn, er_irqn;
+
+/* Receive pipeline: DR and the shift register behind it */
+static uint8_t rx_dr, rx_shift;
+static int rx_dr_full, rx_shift_full;
+static uint16_t dma_total; /* CNDTR when the read started */
+
+static int addr_cleared;
+
+void
+i2c_model_bus(I2C_TypeDef *I2CP)
+{
+	bus = I2CP;
+	if (I2CP == I2C1) {
+		event_handler = I2C1_EV_IRQHandler;
+		error_handler = I2C1_ER_IRQHandler;
+		dma_handler = DMA1_Channel7_IRQHandler;
+		dma_channel = 7;
+		ev_irqn = 31;
+		er_irqn = 32;
+	} else {
+		event_handler = I2C2_EV_IRQHandler;
+		error_handler = I2C2_ER_IRQHandler;
+		dma_handler = DMA1_Channel5_IRQHandler;
+		dma_channel = 5;
+		ev_irqn = 33;
+		er_irqn = 34;
+	}
+}
+
+/* Reading DR takes the byte and moves the shift register up */
+uint8_t
+i2c_model_dr_read(I2C_TypeDef *I2CP)
+{
+	uint8_t value = rx_dr;
+
+	if (rx_shift_full) {
+		rx_dr = rx_shift;
+		rx_shift_full = 0;
+	} else {
+		rx_dr_full = 0;
+	}
+	I2CP->SR1 = (I2CP->SR1 & ~(I2C_SR1_RXNE | I2C_SR1_BTF)) | (rx_dr_full ? I2C_SR1_RXNE : 0);
+	return value;
+}
+
+/* Reading SR2 after SR1 clears ADDR */
+uint16_t
+i2c_model_sr2_read(I2C_TypeDef *I2CP)
+{
+	if (I2CP->SR1 & I2C_SR1_ADDR) {
+		addr_cleared = 1;
+		I2CP->SR1 &= ~I2C_SR1_ADDR;
+	}
+	return I2CP->SR2;
+}
+
+/* SWRST puts every register back to its reset value */
+uint16_t
+i2c_model_swrst(I2C_TypeDef *I2CP, uint16_t cr1)
+{
+	i2c_model.resets++;
+	I2CP->CR2 = 0;
+	I2CP->OAR1 = 0;
+	I2CP->OAR2 = 0;
+	I2CP->DR = 0;
+	I2CP->SR1 = 0;
+	I2CP->SR2 = 0;
+	I2CP->CCR = 0;
+	I2CP->TRISE = 2;
+	rx_dr_full = rx_shift_full = 0;
+	return cr1;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/* Run an interrupt handler of the engine, timed */
+static void
+interrupt(void (*handler)(void))
+{
+	uint64_t start = now_ns();
+
+	handler();
+	i2c_model.handler_ns += now_ns() - start;
+}
+
+static void
+event(void)
+{
+	i2c_model.events++;
+	interrupt(event_handler);
+}
+
+/* RX DMA channel: move DR to memory while RXNE, TC interrupt at the end */
+static void
+dma_pump(void)
+{
+	if (!(bus->CR2 & I2C_CR2_DMAEN) || !(DMA1_CCR(dma_channel) & DMA_CCR_EN))
+		return;
+	while (rx_dr_full && DMA_CNDTR(DMA1, dma_channel)) {
+		uint32_t memory = DMA_CMAR(DMA1, dma_channel);
+		uint16_t left = DMA_CNDTR(DMA1, dma_channel);
+
+		*(uint8_t *)(uintptr_t)(memory + dma_total - left) = i2c_model_dr_read(bus);
+		DMA_CNDTR(DMA1, dma_channel) = left - 1;
+		if (left == 1) {
+			DMA_ISR(DMA1) |= DMA_ISR_TCIF(dma_channel) | DMA_ISR_GIF(dma_channel);
+			i2c_model.dma_irqs++;
+			interrupt(dma_handler);
+		}
+	}
+}
+
+/* The engine pends its event interrupt when DMA completes */
+static void
+run_pended(void)
+{
+	if (NVIC_ISPR(ev_irqn / 32) & (1U << (ev_irqn % 32))) {
+		NVIC_ISPR(ev_irqn / 32) = 0;
+		event();
+	}
+}
+
+/* Address + data bytes written; returns 0 to go on, -1 when the bus is stuck */
+static int
+run_write(void)
+{
+	int first = 1, k = 0;
+
+	for (;;) {
+		if (bus->CR1 & (I2C_CR1_STOP | I2C_CR1_START))
+			return 0;
+		if (bus->CR2 & I2C_CR2_ITBUFEN) {
+			uint16_t data;
+
+			bus->SR1 |= I2C_SR1_TXE;
+			bus->DR = DR_UNWRITTEN;
+			event();
+			data = bus->DR;
+			if (data == DR_UNWRITTEN)
+				continue;
+			if (k == i2c_model.nack_data_at) {
+				bus->SR1 &= ~I2C_SR1_TXE;
+				bus->SR1 |= I2C_SR1_AF;
+				interrupt(error_handler);
+				return 0;
+			}
+			if (first)
+				i2c_model.ptr = (uint8_t)data;
+			else
+				i2c_model.regs[i2c_model.ptr++] = (uint8_t)data;
+			first = 0;
+			k++;
+			continue;
+		}
+		/* Last byte shifted out: BTF wants a STOP or a repeated START */
+		bus->SR1 |= I2C_SR1_TXE | I2C_SR1_BTF;
+		event();
+		bus->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+		if (!(bus->CR1 & (I2C_CR1_STOP | I2C_CR1_START))) {
+			i2c_model.protocol_errors++;
+			return -1;
+		}
+	}
+}
+
+/* Data bytes read until one is NACKed, then STOP after the byte in progress. With POS the
+   ACK decision is the one latched at the previous byte. */
+static int
+run_read(uint16_t ack_at_addr, int dma_on, int *steps, int max_steps)
+{
+	int k = 0, stopped = 0, last_acked = 1;
+	uint16_t ack_latch = ack_at_addr;
+
+	rx_dr_full = rx_shift_full = 0;
+	while (!stopped || rx_dr_full) {
+		int fire;
+
+		if (!stopped && !rx_shift_full && last_acked) {
+			uint8_t byte = i2c_model.regs[i2c_model.ptr++];
+			int acked;
+
+			if (bus->CR1 & I2C_CR1_POS)
+				acked = (ack_latch != 0);
+			else
+				acked = (bus->CR1 & I2C_CR1_ACK) != 0;
+			if (dma_on && (bus->CR2 & I2C_CR2_LAST) && k == dma_total - 1)
+				acked = 0;
+			ack_latch = bus->CR1 & I2C_CR1_ACK;
+			if (!rx_dr_full) {
+				rx_dr = byte;
+				rx_dr_full = 1;
+			} else {
+				rx_shift = byte;
+				rx_shift_full = 1;
+			}
+			k++;
+			last_acked = acked;
+			if (bus->CR1 & I2C_CR1_STOP) {
+				if (acked)
+					i2c_model.protocol_errors++;
+				stopped = 1;
+				bus->CR1 &= ~I2C_CR1_STOP;
+			}
+		} else if (!stopped && (bus->CR1 & I2C_CR1_STOP)) {
+			if (last_acked)
+				i2c_model.protocol_errors++;
+			stopped = 1;
+			bus->CR1 &= ~I2C_CR1_STOP;
+		}
+
+		dma_pump();
+		run_pended();
+		if (!stopped && (bus->CR1 & I2C_CR1_STOP))
+			continue;
+
+		bus->SR1 = (bus->SR1 & ~(I2C_SR1_RXNE | I2C_SR1_BTF)) |
+		           (rx_dr_full ? I2C_SR1_RXNE : 0) |
+		           (rx_dr_full && rx_shift_full ? I2C_SR1_BTF : 0);
+		fire = ((bus->CR2 & I2C_CR2_ITBUFEN) && rx_dr_full) || (rx_dr_full && rx_shift_full);
+		if (fire) {
+			event();
+		} else if (!last_acked && !stopped && !(bus->CR1 & I2C_CR1_STOP)) {
+			i2c_model.protocol_errors++; /* NACKed without a STOP */
+			return -1;
+		} else if (stopped && rx_dr_full) {
+			i2c_model.protocol_errors++; /* Data left unread */
+			return -1;
+		}
+		if ((*steps)++ > max_steps)
+			return -1;
+	}
+	return 0;
+}
+
+int
+i2c_model_run(int max_steps)
+{
+	int steps = 0;
+
+	while (steps++ < max_steps) {
+		uint16_t cr1 = bus->CR1, address, ack_at_addr;
+		int reading, dma_on;
+
+		if (i2c_model.hang)
+			return steps;
+		if (!(cr1 & I2C_CR1_START)) {
+			bus->CR1 &= ~I2C_CR1_STOP;
+			return steps;
+		}
+
+		/* START (after a pending STOP) */
+		bus->CR1 &= ~(I2C_CR1_START | I2C_CR1_STOP);
+		bus->SR1 = I2C_SR1_SB;
+		bus->DR = DR_UNWRITTEN;
+		event();
+		bus->SR1 &= ~I2C_SR1_SB;
+		address = bus->DR;
+		if (address == DR_UNWRITTEN) {
+			i2c_model.protocol_errors++;
+			return steps;
+		}
+		reading = address & 1;
+
+		if (i2c_model.nack_addr || (address & 0xFE) != i2c_model.addr) {
+			bus->SR1 |= I2C_SR1_AF;
+			interrupt(error_handler);
+			if (bus->SR1 & I2C_SR1_AF)
+				i2c_model.protocol_errors++;
+			continue;
+		}
+
+		ack_at_addr = bus->CR1 & I2C_CR1_ACK;
+		addr_cleared = 0;
+		bus->SR1 |= I2C_SR1_ADDR;
+		event();
+		if (!addr_cleared) {
+			i2c_model.protocol_errors++;
+			return steps;
+		}
+		dma_on = (bus->CR2 & I2C_CR2_DMAEN) && (DMA1_CCR(dma_channel) & DMA_CCR_EN);
+		dma_total = dma_on ? DMA_CNDTR(DMA1, dma_channel) : 0;
+		if (reading && dma_on && !(bus->CR2 & I2C_CR2_LAST))
+			i2c_model.protocol_errors++;
+
+		if ((reading ? run_read(ack_at_addr, dma_on, &steps, max_steps) : run_write()) != 0)
+			return steps;
+	}
+	return steps;
+}
+
+int
+i2c_model_tick_until_done(i2c_xfer_t *xfer, int max_ms)
+{
+	int ms = 0;
+
+	while (xfer->status == I2C_PENDING && ms < max_ms) {
+		i2c_async_tick();
+		ms++;
+		if (NVIC_ISPR(er_irqn / 32) & (1U << (er_irqn % 32))) {
+			NVIC_ISPR(er_irqn / 32) = 0;
+			interrupt(error_handler);
+		}
+	}
+	return ms;
+}
@@ -0,0 +1,64 @@
+/* @file 			 : i2c_model.h
+ *  @Description: Model of an STM32F1 I2C master and one register-file device (an MPU-6050
+ *                style pointer register set by the first byte written) for the host tests of
+ *                the interrupt-driven engine in i2c.c. i2c_model_run() plays the bus: it raises
+ *                SB, ADDR, TXE, RXNE and BTF as the peripheral would, runs the event and error
+ *                handlers, and feeds the RX DMA channel when DMAEN is set. Deviations from the
+ *                RM0008 sequences (no STOP after a NACKed byte, ADDR not cleared, data left
+ *                unread, a byte ACKed that ends a read) are counted as protocol errors.
+ *
+ *                Reading DR and SR2 has side effects the plain register memory cannot have, so
+ *                the tests build i2c.c with those reads, and the SWRST write, routed through the
+ *                i2c_model_* hooks below (see CMakeLists.txt).
+ */
+#ifndef I2C_MODEL_H
+#define I2C_MODEL_H
+
+#include "i2c.h"
+
+typedef struct {
+	uint8_t addr;         /* 8-bit address the device answers */
+	uint8_t regs[256];    /* register file */
+	uint8_t ptr;          /* register pointer */
+	int nack_addr;        /* NACK every address */
+	int nack_data_at;     /* NACK this written data byte (0 = the first), -1 = none */
+	int hang;             /* the bus stalls: nothing happens after the current state */
+	int protocol_errors;  /* sequences RM0008 does not allow */
+	int events;           /* event interrupts run */
+	int dma_irqs;         /* DMA interrupts run */
+	int resets;           /* SWRST writes */
+	uint64_t handler_ns;  /* host time spent in the engine's interrupt handlers */
+} i2c_model_t;
+
+extern i2c_model_t i2c_model;
+
+/** @brief Play the bus of I2C1 or I2C2 (and its RX DMA channel) from now on.
+        @param[in] I2CP I2C1 or I2C2
+*/
+void
+i2c_model_bus(I2C_TypeDef *I2CP);
+
+/** @brief Run queued transactions until the bus goes quiet, stalls, or after max_steps.
+        @param[in] max_steps bound on bus phases
+        @return bus phases run
+*/
+int
+i2c_model_run(int max_steps);
+
+/** @brief Call i2c_async_tick once per ms, running the pended error interrupt, until the
+        transaction is no longer pending.
+        @param[in] xfer transaction
+        @param[in] max_ms bound on ticks
+        @return ms ticked
+*/
+int
+i2c_model_tick_until_done(i2c_xfer_t *xfer, int max_ms);
+
+/* Hooks the test build of i2c.c calls in place of register accesses */
+uint8_t
+i2c_model_dr_read(I2C_TypeDef *I2CP);
+uint16_t
+i2c_model_sr2_read(I2C_TypeDef *I2CP);
+uint16_t
+i2c_model_swrst(I2C_TypeDef *I2CP, uint16_t cr1);
+#endif
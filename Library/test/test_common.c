@@ -0,0 +1,13 @@
+/* @file 			 : test_common.c
+ *  @Description: Checks shared by the host tests (see test_common.h).
+ */
+#include "test_common.h"
+
+unsigned test_failures;
+
+int
+test_result(const char *name)
+{
+	printf("%s_failures=%u\n", name, test_failures);
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
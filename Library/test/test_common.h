@@ -0,0 +1,28 @@
+/* @file 			 : test_common.h
+ *  @Description: Checks shared by the host tests. A failed CHECK prints its line and is
+ *                counted; test_result() prints <name>_failures=N and gives the exit status,
+ *                so ctest fails the test when any check did.
+ */
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern unsigned test_failures;
+
+#define CHECK(cond)                                                                         \
+	do {                                                                                    \
+		if (!(cond)) {                                                                      \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                 \
+			test_failures++;                                                                \
+		}                                                                                   \
+	} while (0)
+
+/** @brief Report the failed checks of a test.
+        @param[in] name test name
+        @return EXIT_SUCCESS if none failed, EXIT_FAILURE otherwise
+*/
+int
+test_result(const char *name);
+#endif
@@ -0,0 +1,287 @@
+/* @file 			 : test_dma.c
+ *  @Description: Host test of the DMA channel manager (dma.c) and of the drivers sharing its
+ *                channels. Checks request ownership, the per-channel queue started from the
+ *                completion interrupt, resubmission from a callback, circular transfers, the
+ *                DMA1 channel 4/5 hand-over between USART1 and SPI2, and that an SPI transfer
+ *                started while the previous one is still running waits for it, then gets the
+ *                channel its completion released. Also checks that spi_init_master refuses an
+ *                SPI/remap pair it has no pins for.
+ */
+#include "dma.h"
+#include "host_periph.h"
+#include "myspi.h"
+#include "nvic.h"
+#include "test_common.h"
+#include "usart.h"
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+void
+DMA1_Channel1_IRQHandler(void);
+void
+DMA1_Channel4_IRQHandler(void);
+void
+DMA1_Channel5_IRQHandler(void);
+void
+DMA2_Channel4_5_IRQHandler(void);
+
+#define USART_CR3_DMAT (1 << 7)
+#define ADC1_DR 0x4001244CUL
+
+static uint8_t buf1[8], buf2[8], buf3[8];
+
+/* Completions seen by the callbacks, in order */
+static int log_count;
+static u32 log_events[16];
+static dma_xfer_t *log_xfers[16];
+
+static void
+on_done(dma_xfer_t *xfer, u32 events)
+{
+	if (log_count < 16) {
+		log_xfers[log_count] = xfer;
+		log_events[log_count] = events;
+	}
+	log_count++;
+}
+
+static int resubmits_left;
+
+static void
+on_done_resubmit(dma_xfer_t *xfer, u32 events)
+{
+	on_done(xfer, events);
+	if ((events & DMA_EVENT_TC) && resubmits_left-- > 0)
+		CHECK(dma_submit(DMA_REQ_ADC1, xfer) == 0);
+}
+
+/* Raise events on a channel and run its handler; IFCR is write-1-to-clear */
+static void
+raise_events(u32 dma, u8 channel, u32 events, void (*handler)(void))
+{
+	DMA_ISR(dma) |= events << (4 * (channel - 1));
+	handler();
+	DMA_ISR(dma) &= ~DMA_IFCR(dma);
+	DMA_IFCR(dma) = 0;
+}
+
+static void
+test_ownership(void)
+{
+	CHECK(dma_claim(0) == -1);
+	CHECK(dma_claim(DMA_REQ(3, 1, 0)) == -1); /* No DMA3 */
+	CHECK(dma_claim(DMA_REQ(2, 6, 0)) == -1); /* DMA2 has 5 channels */
+	CHECK(dma_claim(DMA_REQ_ADC1) == 0);
+	CHECK(dma_claim(DMA_REQ_ADC1) == 0);      /* Again by its owner */
+	CHECK(dma_claim(DMA_REQ_TIM2_CH3) == -1); /* Same channel, other request */
+	CHECK(dma_owner(DMA1, 1) == DMA_REQ_ADC1);
+	CHECK(RCC->AHBENR & 1);
+	CHECK(NVIC_ISER(0) & (1 << 11));
+	CHECK(dma_release(DMA_REQ_TIM2_CH3) == -1);
+}
+
+static void
+test_queue(void)
+{
+	dma_xfer_t x1 = { ADC1_DR, (u32)(uintptr_t)buf1, 8, DMA_CCR_MINC | DMA_CCR_PL_HIGH,
+		              on_done, 0, 0, 0 };
+	dma_xfer_t x2 = x1, x3 = x1, again, circular;
+	u32 ccr;
+
+	x2.memory = (u32)(uintptr_t)buf2;
+	x2.count = 4;
+	x3.memory = (u32)(uintptr_t)buf3;
+	x3.count = 2;
+	x3.config |= DMA_CCR_HTIE;
+
+	/* Three queued: the first starts, the others follow from the interrupt */
+	CHECK(dma_submit(DMA_REQ_TIM2_CH3, &x1) == -1); /* Not the owner */
+	CHECK(dma_submit(DMA_REQ_ADC1, &x1) == 0);
+	CHECK(dma_submit(DMA_REQ_ADC1, &x1) == -1); /* Already queued */
+	CHECK(dma_submit(DMA_REQ_ADC1, &x2) == 0);
+	CHECK(dma_submit(DMA_REQ_ADC1, &x3) == 0);
+	ccr = DMA_CCR(DMA1, 1);
+	CHECK(DMA_CMAR(DMA1, 1) == x1.memory && DMA_CNDTR(DMA1, 1) == 8);
+	CHECK((ccr & DMA_CCR_EN) && (ccr & DMA_CCR_TCIE) && (ccr & DMA_CCR_TEIE));
+	CHECK(!(ccr & DMA_CCR_HTIE) && (ccr & DMA_CCR_MINC));
+	CHECK(dma_busy(DMA_REQ_ADC1) && dma_remaining(DMA_REQ_ADC1) == 8);
+
+	raise_events(DMA1, 1, DMA_EVENT_TC, DMA1_Channel1_IRQHandler);
+	CHECK(log_count == 1 && log_xfers[0] == &x1 && log_events[0] == DMA_EVENT_TC);
+	CHECK(!x1.queued && x2.queued);
+	CHECK(DMA_CMAR(DMA1, 1) == x2.memory && DMA_CNDTR(DMA1, 1) == 4);
+	CHECK(DMA_CCR(DMA1, 1) & DMA_CCR_EN);
+
+	/* An error ends a transfer too */
+	raise_events(DMA1, 1, DMA_EVENT_TE, DMA1_Channel1_IRQHandler);
+	CHECK(log_count == 2 && log_xfers[1] == &x2 && log_events[1] == DMA_EVENT_TE);
+	CHECK(DMA_CMAR(DMA1, 1) == x3.memory && (DMA_CCR(DMA1, 1) & DMA_CCR_HTIE));
+	raise_events(DMA1, 1, DMA_EVENT_HT, DMA1_Channel1_IRQHandler);
+	CHECK(log_count == 3 && log_events[2] == DMA_EVENT_HT && x3.queued);
+	raise_events(DMA1, 1, DMA_EVENT_TC, DMA1_Channel1_IRQHandler);
+	CHECK(log_count == 4 && !dma_busy(DMA_REQ_ADC1));
+	CHECK(DMA_CCR(DMA1, 1) == 0 && dma_remaining(DMA_REQ_ADC1) == 0);
+	raise_events(DMA1, 1, DMA_EVENT_TC, DMA1_Channel1_IRQHandler); /* Spurious */
+	CHECK(log_count == 4);
+
+	/* Resubmitted from its callback: back to back */
+	again = x1;
+	again.callback = on_done_resubmit;
+	resubmits_left = 3;
+	log_count = 0;
+	CHECK(dma_submit(DMA_REQ_ADC1, &again) == 0);
+	for (int k = 0; k < 4; k++)
+		raise_events(DMA1, 1, DMA_EVENT_TC, DMA1_Channel1_IRQHandler);
+	CHECK(log_count == 4 && !dma_busy(DMA_REQ_ADC1));
+
+	/* Circular: TC does not retire it, abort does */
+	circular = x1;
+	circular.config |= DMA_CCR_CIRC;
+	log_count = 0;
+	CHECK(dma_submit(DMA_REQ_ADC1, &circular) == 0);
+	CHECK(dma_submit(DMA_REQ_ADC1, &x2) == 0);
+	raise_events(DMA1, 1, DMA_EVENT_TC, DMA1_Channel1_IRQHandler);
+	CHECK(log_count == 1 && circular.queued && DMA_CMAR(DMA1, 1) == circular.memory);
+	CHECK(dma_abort(DMA_REQ_ADC1) == 0);
+	CHECK(!circular.queued && !x2.queued && !dma_busy(DMA_REQ_ADC1) && DMA_CCR(DMA1, 1) == 0);
+	CHECK(dma_owner(DMA1, 1) == DMA_REQ_ADC1);
+
+	/* Release drops the queue and frees the channel */
+	CHECK(dma_submit(DMA_REQ_ADC1, &x1) == 0);
+	CHECK(dma_release(DMA_REQ_ADC1) == 0);
+	CHECK(!x1.queued && dma_owner(DMA1, 1) == 0);
+	CHECK(dma_claim(DMA_REQ_TIM2_CH3) == 0);
+	CHECK(dma_release(DMA_REQ_TIM2_CH3) == 0);
+}
+
+/* USART1 TX/RX and SPI2 RX/TX share DMA1 channels 4 and 5 */
+static void
+test_sharing(void)
+{
+	uint8_t tx[4] = { 1, 2, 3, 4 }, rx[4];
+
+	CHECK(dma_write_usart1("hello", 5) == 0);
+	CHECK(dma_owner(DMA1, 4) == DMA_REQ_USART1_TX);
+	CHECK(DMA_CPAR(DMA1, 4) == (u32)(uintptr_t)&USART1->DR);
+	CHECK((DMA_CCR(DMA1, 4) & DMA_CCR_DIR) && (USART1->CR3 & USART_CR3_DMAT));
+
+	/* SPI2 needs channel 4 to receive: fails, keeping nothing */
+	CHECK(spi2_dma_transceive(tx, 4, rx, 4) == -1);
+	CHECK(dma_owner(DMA1, 5) == 0);
+	CHECK(spi2_dma_transceive(tx, 4, 0, 0) == 0);
+	CHECK(dma_owner(DMA1, 5) == DMA_REQ_SPI2_TX);
+	CHECK(dma_read_usart1((char *)rx, 4) == -1);
+
+	/* Each completion releases its channel */
+	raise_events(DMA1, 4, DMA_EVENT_TC, DMA1_Channel4_IRQHandler);
+	CHECK(dma_owner(DMA1, 4) == 0);
+	raise_events(DMA1, 5, DMA_EVENT_TC, DMA1_Channel5_IRQHandler);
+	CHECK(dma_owner(DMA1, 5) == 0 && !(SPI2->CR2 & SPI_CR2_TXDMAEN));
+
+	CHECK(spi2_dma_transceive(tx, 4, rx, 4) == 0);
+	CHECK(dma_owner(DMA1, 4) == DMA_REQ_SPI2_RX && (SPI2->CR2 & SPI_CR2_RXDMAEN));
+	CHECK(dma_write_usart1("x", 1) == -1);
+	raise_events(DMA1, 4, DMA_EVENT_TC, DMA1_Channel4_IRQHandler);
+	raise_events(DMA1, 5, DMA_EVENT_TC, DMA1_Channel5_IRQHandler);
+	CHECK(dma_write_usart1("x", 1) == 0);
+	raise_events(DMA1, 4, DMA_EVENT_TC, DMA1_Channel4_IRQHandler);
+	CHECK(dma_owner(DMA1, 4) == 0);
+
+	/* USART3 TX is channel 2 */
+	CHECK(dma_write_usart3("ab", 2) == 0);
+	CHECK(dma_owner(DMA1, 2) == DMA_REQ_USART3_TX && DMA_CNDTR(DMA1, 2) == 2);
+}
+
+/* DMA2 channels 4 and 5 share one interrupt */
+static void
+test_shared_irq(void)
+{
+	dma_xfer_t d4 = { ADC1_DR, (u32)(uintptr_t)buf1, 8, DMA_CCR_MINC, on_done, 0, 0, 0 };
+	dma_xfer_t d5 = d4;
+
+	CHECK(dma_claim(DMA_REQ_SDIO) == 0 && dma_claim(DMA_REQ_UART4_TX) == 0);
+	log_count = 0;
+	CHECK(dma_submit(DMA_REQ_SDIO, &d4) == 0 && dma_submit(DMA_REQ_UART4_TX, &d5) == 0);
+	DMA_ISR(DMA2) |= DMA_ISR_TCIF(4) | DMA_ISR_TCIF(5);
+	DMA2_Channel4_5_IRQHandler();
+	DMA_ISR(DMA2) = 0;
+	CHECK(log_count == 2 && log_xfers[0] == &d4 && log_xfers[1] == &d5);
+
+	/* Releasing channel 4 leaves the interrupt enabled for channel 5 */
+	CHECK(dma_release(DMA_REQ_SDIO) == 0);
+	NVIC_ISER(1) = 0;
+	CHECK(dma_claim(DMA_REQ_UART4_TX) == 0 && (NVIC_ISER(1) & (1 << (59 - 32))));
+	CHECK(dma_release(DMA_REQ_UART4_TX) == 0);
+}
+
+/* The timer signal plays the channel 5 completion interrupt */
+static void
+complete_spi2_tx(int sig)
+{
+	(void)sig;
+	raise_events(DMA1, 5, DMA_EVENT_TC, DMA1_Channel5_IRQHandler);
+}
+
+/* A second SPI2 transfer while the first is running: it waits for the completion, which
+   releases the channel, and only then claims it, so it starts rather than losing it */
+static void
+test_spi_back_to_back(void)
+{
+	static uint8_t first[4] = { 1, 2, 3, 4 }, second[4] = { 5, 6, 7, 8 };
+	struct itimerval shot = { { 0, 0 }, { 0, 20000 } };
+
+	CHECK(spi2_dma_transceive(first, sizeof(first), 0, 0) == 0);
+	CHECK(dma_busy(DMA_REQ_SPI2_TX));
+
+	signal(SIGALRM, complete_spi2_tx);
+	setitimer(ITIMER_REAL, &shot, NULL);
+	CHECK(spi2_dma_transceive(second, sizeof(second), 0, 0) == 0);
+	signal(SIGALRM, SIG_DFL);
+
+	CHECK(dma_owner(DMA1, 5) == DMA_REQ_SPI2_TX && dma_busy(DMA_REQ_SPI2_TX));
+	CHECK(DMA_CMAR(DMA1, 5) == (u32)(uintptr_t)second && (DMA_CCR(DMA1, 5) & DMA_CCR_EN));
+	CHECK(SPI2->CR2 & SPI_CR2_TXDMAEN);
+
+	raise_events(DMA1, 5, DMA_EVENT_TC, DMA1_Channel5_IRQHandler);
+	CHECK(dma_owner(DMA1, 5) == 0);
+}
+
+/* SPI2 has only its default pins and SPI3 only its remapped ones: the other pairings are
+   refused without touching the clocks, the remap or the SPI */
+static void
+test_spi_init(void)
+{
+	u32 mapr = AFIO->MAPR, apb1 = RCC->APB1ENR, apb2 = RCC->APB2ENR;
+	u32 cr1_2 = SPI2->CR1, cr1_3 = SPI3->CR1;
+
+	CHECK(spi_init_master(SPI2, SPI_CR1_BAUDRATE_FPCLK_DIV_8, SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+	                      SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST,
+	                      REMAP) == -1);
+	CHECK(spi_init_master(SPI3, SPI_CR1_BAUDRATE_FPCLK_DIV_8, SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+	                      SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST,
+	                      NO_REMAP) == -1);
+	CHECK(AFIO->MAPR == mapr && RCC->APB1ENR == apb1 && RCC->APB2ENR == apb2);
+	CHECK(SPI2->CR1 == cr1_2 && SPI3->CR1 == cr1_3);
+
+	CHECK(spi_init_master(SPI2, SPI_CR1_BAUDRATE_FPCLK_DIV_8, SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+	                      SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST,
+	                      NO_REMAP) == 0);
+	CHECK((SPI2->CR1 & SPI_CR1_MSTR) && (RCC->APB1ENR & (1 << 14)));
+}
+
+int
+main(void)
+{
+	if (host_periph_map() != 0) {
+		printf("cannot map the peripheral registers\n");
+		return EXIT_FAILURE;
+	}
+	test_ownership();
+	test_queue();
+	test_sharing();
+	test_shared_irq();
+	test_spi_back_to_back();
+	test_spi_init();
+	return test_result("dma");
+}
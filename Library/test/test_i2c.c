@@ -0,0 +1,224 @@
+/* @file 			 : test_i2c.c
+ *  @Description: Host test of the interrupt-driven I2C engine (i2c.c) against the bus model in
+ *                i2c_model.c. Checks the fast/standard mode clock setup, register reads of every
+ *                length through the RM0008 ACK/POS/STOP sequences, writes, a queue of
+ *                transactions to different devices, NACK, arbitration loss and bus errors, and
+ *                the timeout path: a stalled bus is reset with SWRST, reconfigured, and the
+ *                queue goes on.
+ */
+#include "host_periph.h"
+#include "i2c_model.h"
+#include "test_common.h"
+#include <string.h>
+
+void
+I2C1_ER_IRQHandler(void);
+
+/* Completions seen by the callback, in order */
+static int done_count;
+static int done_status;
+static i2c_xfer_t *done_xfers[16];
+
+static void
+on_done(i2c_xfer_t *xfer, int status)
+{
+	if (done_count < 16)
+		done_xfers[done_count] = xfer;
+	done_count++;
+	done_status = status;
+}
+
+static void
+test_init(void)
+{
+	i2c_xfer_t x = { 0 };
+
+	x.addr = 0xD0;
+	CHECK(i2c_submit(I2C1, &x) == -1); /* Not initialised */
+	CHECK(i2c_async_init(I2C1, 8000000, 500000) == -1);
+	CHECK(i2c_async_init(I2C1, 3000000, 400000) == -1); /* Fast mode needs 4 MHz */
+	CHECK(i2c_async_init(I2C1, 36000000, 400000) == 0);
+	CHECK(I2C1->CCR == (I2C_CCR_FS | 30) && I2C1->TRISE == 11 && (I2C1->CR2 & 0x3F) == 36);
+	CHECK((I2C1->CR2 & I2C_CR2_ITEVTEN) && (I2C1->CR2 & I2C_CR2_ITERREN));
+	CHECK(I2C1->CR1 & I2C_CR1_PE);
+	CHECK(i2c_async_init(I2C2, 8000000, 400000) == 0);
+	CHECK(I2C2->CCR == (I2C_CCR_FS | 7) && I2C2->TRISE == 3);
+	CHECK(i2c_async_init(I2C2, 8000000, 100000) == 0);
+	CHECK(I2C2->CCR == 40 && I2C2->TRISE == 9);
+}
+
+static void
+test_transfers(void)
+{
+	i2c_model_bus(I2C1);
+
+	/* Register reads of every length: write the register, repeated START, read */
+	for (int n = 1; n <= 20; n++) {
+		uint8_t reg = (uint8_t)(0x3B + n), out[32] = { 0 };
+		i2c_xfer_t r = { .addr = 0xD0, .tx = &reg, .tx_len = 1,
+		                 .rx = out, .rx_len = (uint16_t)n, .callback = on_done };
+
+		done_count = 0;
+		i2c_model.protocol_errors = 0;
+		CHECK(i2c_submit(I2C1, &r) == 0);
+		CHECK(r.status == I2C_PENDING && i2c_busy(I2C1));
+		i2c_model_run(10000);
+		CHECK(done_count == 1 && done_status == I2C_DONE && r.status == I2C_DONE);
+		CHECK(!i2c_busy(I2C1) && !(I2C1->CR1 & I2C_CR1_POS));
+		if (i2c_model.protocol_errors != 0 || memcmp(out, &i2c_model.regs[reg], n) != 0) {
+			printf("read of %d bytes: %d protocol errors%s\n", n, i2c_model.protocol_errors,
+			       memcmp(out, &i2c_model.regs[reg], n) ? ", wrong data" : "");
+			test_failures++;
+		}
+	}
+
+	/* Plain read from the current register */
+	{
+		uint8_t out[4];
+		i2c_xfer_t r = { .addr = 0xD0, .rx = out, .rx_len = 4, .callback = on_done };
+
+		i2c_model.ptr = 0x10;
+		done_count = 0;
+		i2c_model.protocol_errors = 0;
+		CHECK(i2c_submit(I2C1, &r) == 0);
+		i2c_model_run(1000);
+		CHECK(done_count == 1 && r.status == I2C_DONE && i2c_model.protocol_errors == 0);
+		CHECK(memcmp(out, &i2c_model.regs[0x10], 4) == 0);
+	}
+
+	/* Write */
+	{
+		uint8_t w[3] = { 0x6B, 0x00, 0x42 };
+		i2c_xfer_t t = { .addr = 0xD0, .tx = w, .tx_len = 3, .callback = on_done };
+
+		i2c_model.regs[0x6B] = 0xFF;
+		done_count = 0;
+		CHECK(i2c_submit(I2C1, &t) == 0);
+		i2c_model_run(1000);
+		CHECK(done_count == 1 && t.status == I2C_DONE && i2c_model.protocol_errors == 0);
+		CHECK(i2c_model.regs[0x6B] == 0 && i2c_model.regs[0x6C] == 0x42);
+	}
+}
+
+/* Three queued for different devices; the second one is absent and NACKs its address */
+static void
+test_queue(void)
+{
+	uint8_t reg = 0x75, who = 0, w[2] = { 0x12, 0x55 };
+	i2c_xfer_t a = { .addr = 0xD0, .tx = &reg, .tx_len = 1,
+	                 .rx = &who, .rx_len = 1, .callback = on_done };
+	i2c_xfer_t b = { .addr = 0x40, .tx = w, .tx_len = 2, .callback = on_done };
+	i2c_xfer_t c = { .addr = 0xD0, .callback = on_done };
+
+	done_count = 0;
+	CHECK(i2c_submit(I2C1, &a) == 0 && i2c_submit(I2C1, &b) == 0 && i2c_submit(I2C1, &c) == 0);
+	CHECK(i2c_submit(I2C1, &a) == -1); /* Already queued */
+	i2c_model_run(10000);
+	CHECK(done_count == 3 && done_xfers[0] == &a && done_xfers[1] == &b && done_xfers[2] == &c);
+	CHECK(a.status == I2C_DONE && who == i2c_model.regs[0x75]);
+	CHECK(b.status == I2C_ERR_NACK && c.status == I2C_DONE && !i2c_busy(I2C1));
+}
+
+static void
+test_errors(void)
+{
+	uint8_t w[3] = { 1, 2, 3 };
+	i2c_xfer_t t = { .addr = 0xD0, .tx = w, .tx_len = 3, .callback = on_done };
+
+	/* Data NACK */
+	i2c_model.nack_data_at = 1;
+	done_count = 0;
+	CHECK(i2c_submit(I2C1, &t) == 0);
+	i2c_model_run(1000);
+	i2c_model.nack_data_at = -1;
+	CHECK(t.status == I2C_ERR_NACK && done_count == 1);
+
+	/* Arbitration lost: no STOP, the other master has the bus */
+	t.tx_len = 1;
+	CHECK(i2c_submit(I2C1, &t) == 0);
+	I2C1->CR1 &= ~I2C_CR1_START;
+	I2C1->SR1 = I2C_SR1_ARLO;
+	I2C1_ER_IRQHandler();
+	CHECK(t.status == I2C_ERR_ARLO && I2C1->SR1 == 0 && !(I2C1->CR1 & I2C_CR1_STOP));
+
+	/* Bus error */
+	CHECK(i2c_submit(I2C1, &t) == 0);
+	I2C1->CR1 &= ~I2C_CR1_START;
+	I2C1->SR1 = I2C_SR1_BERR;
+	I2C1_ER_IRQHandler();
+	CHECK(t.status == I2C_ERR_BUS);
+	I2C1->CR1 &= ~I2C_CR1_STOP;
+}
+
+/* The device stops answering: the tick times the transaction out, the error interrupt
+   resets the peripheral (SWRST clears every register) and restores its setup */
+static void
+test_timeout(void)
+{
+	uint8_t reg = 1, out[200];
+	i2c_xfer_t t = { .addr = 0xD0, .tx = &reg, .tx_len = 1,
+	                 .rx = out, .rx_len = 2, .callback = on_done };
+	i2c_xfer_t next = { .addr = 0xD0, .callback = on_done };
+	i2c_xfer_t slow = { .addr = 0xD0, .rx = out, .rx_len = 200,
+	                    .timeout_ms = 50, .callback = on_done };
+	int resets = i2c_model.resets, ms;
+
+	done_count = 0;
+	CHECK(i2c_submit(I2C1, &t) == 0 && i2c_submit(I2C1, &next) == 0);
+	i2c_model.hang = 1;
+	ms = i2c_model_tick_until_done(&t, 100);
+	i2c_model.hang = 0;
+	/* Default: twice the bus time (under 1 ms here) plus 2 ms */
+	CHECK(t.status == I2C_ERR_TIMEOUT && ms == 2);
+	CHECK(i2c_model.resets == resets + 1);
+	CHECK((I2C1->CR1 & I2C_CR1_PE) && I2C1->CCR == (I2C_CCR_FS | 30) && I2C1->TRISE == 11);
+	CHECK((I2C1->CR2 & 0x3F) == 36 && (I2C1->CR2 & I2C_CR2_ITEVTEN) &&
+	      (I2C1->CR2 & I2C_CR2_ITERREN));
+
+	/* The queue goes on after the reset */
+	i2c_model_run(1000);
+	CHECK(next.status == I2C_DONE && done_count == 2 && i2c_model.protocol_errors == 0);
+
+	/* timeout_ms overrides the default */
+	CHECK(i2c_submit(I2C1, &slow) == 0);
+	i2c_model.hang = 1;
+	ms = i2c_model_tick_until_done(&slow, 100);
+	i2c_model.hang = 0;
+	CHECK(ms == 50 && slow.status == I2C_ERR_TIMEOUT && i2c_model.resets == resets + 2);
+	CHECK(!i2c_busy(I2C1));
+}
+
+/* I2C2 runs alongside with its own queue */
+static void
+test_i2c2(void)
+{
+	uint8_t reg = 0x20, out[5];
+	i2c_xfer_t r = { .addr = 0xD0, .tx = &reg, .tx_len = 1,
+	                 .rx = out, .rx_len = 5, .callback = on_done };
+
+	i2c_model_bus(I2C2);
+	i2c_model.protocol_errors = 0;
+	CHECK(i2c_submit(I2C2, &r) == 0);
+	i2c_model_run(1000);
+	CHECK(r.status == I2C_DONE && memcmp(out, &i2c_model.regs[0x20], 5) == 0);
+	CHECK(i2c_model.protocol_errors == 0);
+}
+
+int
+main(void)
+{
+	if (host_periph_map() != 0) {
+		printf("cannot map the peripheral registers\n");
+		return EXIT_FAILURE;
+	}
+	for (int i = 0; i < 256; i++)
+		i2c_model.regs[i] = (uint8_t)(i * 7 + 1);
+
+	test_init();
+	test_transfers();
+	test_queue();
+	test_errors();
+	test_timeout();
+	test_i2c2();
+	return test_result("i2c");
+}
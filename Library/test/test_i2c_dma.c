@@ -0,0 +1,216 @@
+/* @file 			 : test_i2c_dma.c
+ *  @Description: Host test of DMA register burst reads (i2c_read_regs with i2c_dma_rx) against
+ *                the bus model in i2c_model.c, and a measurement against the byte-wise engine.
+ *                Checks reads of every length with LAST ending them on a NACK, a queue mixing
+ *                DMA reads and a write, a timeout in the middle of a DMA read, and I2C2 sharing
+ *                DMA1 channel 5 with USART1 RX.
+ *
+ *                The measurement repeats the MPU-6050 sample read (14 registers from 0x3B)
+ *                byte-wise and with DMA, and reports interrupts per read and the host time spent
+ *                in the engine's handlers. The interrupt counts are what the target sees; the
+ *                host time only ranks the two paths, it is not a Cortex-M3 cycle count. The
+ *                test fails if DMA does not take fewer interrupts.
+ */
+#include "dma.h"
+#include "host_periph.h"
+#include "i2c_model.h"
+#include "test_common.h"
+#include <string.h>
+#include <time.h>
+
+/* MPU-6050 accelerometer, temperature and gyro registers */
+#define SAMPLE_REG 0x3B
+#define SAMPLE_LEN 14
+#define MEASURE_READS 20000
+
+static int done_count;
+
+static void
+on_done(i2c_xfer_t *xfer, int status)
+{
+	(void)xfer;
+	(void)status;
+	done_count++;
+}
+
+typedef struct {
+	double i2c_irqs;   /* per read */
+	double dma_irqs;   /* per read */
+	double handler_ns; /* per read, timing overhead removed */
+} read_cost_t;
+
+/* What the timing around each handler call adds: two clock reads with nothing between */
+static double
+timer_overhead_ns(void)
+{
+	struct timespec a, b;
+	double total = 0.0;
+	int n = 100000;
+
+	for (int i = 0; i < n; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		total += (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+	}
+	return total / n;
+}
+
+/* Repeat the sample read, checking every one */
+static read_cost_t
+measure(void)
+{
+	static uint8_t out[SAMPLE_LEN];
+	static i2c_xfer_t r = { .callback = on_done };
+	int events = i2c_model.events, dma_irqs = i2c_model.dma_irqs;
+	uint64_t ns = i2c_model.handler_ns;
+	int bad = 0;
+	read_cost_t cost;
+
+	for (int i = 0; i < MEASURE_READS; i++) {
+		memset(out, 0, sizeof(out));
+		if (i2c_read_regs(I2C1, &r, 0xD0, SAMPLE_REG, out, SAMPLE_LEN) != 0) {
+			bad++;
+			break;
+		}
+		i2c_model_run(1000);
+		if (r.status != I2C_DONE || memcmp(out, &i2c_model.regs[SAMPLE_REG], SAMPLE_LEN) != 0)
+			bad++;
+	}
+	CHECK(bad == 0 && i2c_model.protocol_errors == 0);
+
+	cost.i2c_irqs = (double)(i2c_model.events - events) / MEASURE_READS;
+	cost.dma_irqs = (double)(i2c_model.dma_irqs - dma_irqs) / MEASURE_READS;
+	cost.handler_ns = (double)(i2c_model.handler_ns - ns) / MEASURE_READS;
+	return cost;
+}
+
+static void
+test_measure(void)
+{
+	double overhead = timer_overhead_ns();
+	read_cost_t bytewise, dma;
+
+	i2c_model_bus(I2C1);
+	i2c_model.protocol_errors = 0;
+	bytewise = measure();
+	CHECK(i2c_dma_rx(I2C1, ENABLE) == 0);
+	dma = measure();
+	CHECK(i2c_dma_rx(I2C1, DISABLE) == 0);
+
+	bytewise.handler_ns -= overhead * (bytewise.i2c_irqs + bytewise.dma_irqs);
+	dma.handler_ns -= overhead * (dma.i2c_irqs + dma.dma_irqs);
+	printf("sample_read_bytes=%d reads=%d\n", SAMPLE_LEN, MEASURE_READS);
+	printf("bytewise_i2c_irqs=%.1f bytewise_host_ns=%.0f\n", bytewise.i2c_irqs,
+	       bytewise.handler_ns);
+	printf("dma_i2c_irqs=%.1f dma_dma_irqs=%.1f dma_host_ns=%.0f\n", dma.i2c_irqs, dma.dma_irqs,
+	       dma.handler_ns);
+	printf("irq_ratio=%.2f\n", (dma.i2c_irqs + dma.dma_irqs) / bytewise.i2c_irqs);
+	CHECK(dma.dma_irqs == 1.0);
+	CHECK(dma.i2c_irqs + dma.dma_irqs < bytewise.i2c_irqs);
+}
+
+/* Reads of every length: one byte stays byte-wise, two and more end with LAST */
+static void
+test_lengths(void)
+{
+	static uint8_t out[32];
+	static i2c_xfer_t r = { .callback = on_done };
+
+	CHECK(i2c_dma_rx(I2C1, ENABLE) == 0 && dma_owner(DMA1, 7) == DMA_REQ_I2C1_RX);
+	for (int n = 1; n <= 20; n++) {
+		int dma_irqs = i2c_model.dma_irqs;
+
+		memset(out, 0, sizeof(out));
+		i2c_model.protocol_errors = 0;
+		done_count = 0;
+		CHECK(i2c_read_regs(I2C1, &r, 0xD0, (uint8_t)(0x40 + n), out, (uint16_t)n) == 0);
+		i2c_model_run(10000);
+		if (done_count != 1 || r.status != I2C_DONE || i2c_model.protocol_errors != 0 ||
+		    memcmp(out, &i2c_model.regs[0x40 + n], n) != 0) {
+			printf("DMA read of %d bytes: status %d, %d protocol errors\n", n, r.status,
+			       i2c_model.protocol_errors);
+			test_failures++;
+		}
+		CHECK(!i2c_busy(I2C1) && !(I2C1->CR2 & (I2C_CR2_DMAEN | I2C_CR2_LAST)));
+		CHECK(i2c_model.dma_irqs - dma_irqs == (n >= 2));
+	}
+}
+
+static void
+test_queue(void)
+{
+	static uint8_t a1[6], a2[3];
+	static i2c_xfer_t q1 = { .callback = on_done }, q2 = { .callback = on_done };
+	uint8_t w[2] = { 0x70, 0x99 };
+	i2c_xfer_t t = { .addr = 0xD0, .tx = w, .tx_len = 2, .callback = on_done };
+
+	done_count = 0;
+	CHECK(i2c_read_regs(I2C1, &q1, 0xD0, 0x10, a1, sizeof(a1)) == 0);
+	CHECK(i2c_submit(I2C1, &t) == 0);
+	CHECK(i2c_read_regs(I2C1, &q2, 0xD0, 0x70, a2, sizeof(a2)) == 0);
+	i2c_model_run(10000);
+	CHECK(done_count == 3 && memcmp(a1, &i2c_model.regs[0x10], sizeof(a1)) == 0);
+	CHECK(a2[0] == 0x99 && memcmp(a2, &i2c_model.regs[0x70], sizeof(a2)) == 0);
+}
+
+/* A timeout in the middle of a DMA read aborts the channel; the next read works */
+static void
+test_timeout(void)
+{
+	static uint8_t out[8];
+	static i2c_xfer_t r = { .callback = on_done };
+
+	CHECK(i2c_read_regs(I2C1, &r, 0xD0, 0, out, 8) == 0);
+	i2c_model.hang = 1;
+	i2c_model_tick_until_done(&r, 100);
+	i2c_model.hang = 0;
+	CHECK(r.status == I2C_ERR_TIMEOUT && !dma_busy(DMA_REQ_I2C1_RX));
+
+	CHECK(i2c_read_regs(I2C1, &r, 0xD0, 0x22, out, 5) == 0);
+	i2c_model_run(1000);
+	CHECK(r.status == I2C_DONE && memcmp(out, &i2c_model.regs[0x22], 5) == 0);
+	CHECK(i2c_dma_rx(I2C1, DISABLE) == 0 && dma_owner(DMA1, 7) == 0);
+}
+
+/* I2C2 RX is DMA1 channel 5, also USART1 RX */
+static void
+test_i2c2(void)
+{
+	static uint8_t out[SAMPLE_LEN];
+	static i2c_xfer_t r = { .callback = on_done };
+	int dma_irqs;
+
+	CHECK(dma_claim(DMA_REQ_USART1_RX) == 0);
+	CHECK(i2c_dma_rx(I2C2, ENABLE) == -1);
+	CHECK(dma_release(DMA_REQ_USART1_RX) == 0);
+	CHECK(i2c_dma_rx(I2C2, ENABLE) == 0 && dma_claim(DMA_REQ_USART1_RX) == -1);
+
+	i2c_model_bus(I2C2);
+	i2c_model.protocol_errors = 0;
+	dma_irqs = i2c_model.dma_irqs;
+	CHECK(i2c_read_regs(I2C2, &r, 0xD0, SAMPLE_REG, out, SAMPLE_LEN) == 0);
+	i2c_model_run(1000);
+	CHECK(r.status == I2C_DONE && memcmp(out, &i2c_model.regs[SAMPLE_REG], SAMPLE_LEN) == 0);
+	CHECK(i2c_model.protocol_errors == 0 && i2c_model.dma_irqs == dma_irqs + 1);
+}
+
+int
+main(void)
+{
+	if (host_periph_map() != 0) {
+		printf("cannot map the peripheral registers\n");
+		return EXIT_FAILURE;
+	}
+	for (int i = 0; i < 256; i++)
+		i2c_model.regs[i] = (uint8_t)(i * 7 + 1);
+	CHECK(i2c_async_init(I2C1, 36000000, 400000) == 0);
+	CHECK(i2c_async_init(I2C2, 36000000, 400000) == 0);
+
+	test_measure();
+	i2c_model_bus(I2C1);
+	test_lengths();
+	test_queue();
+	test_timeout();
+	test_i2c2();
+	return test_result("i2c_dma");
+}
@@ -0,0 +1,233 @@
+/* @file 			 : test_ring.c
+ *  @Description: Host test of the SPSC byte queue (ring.c): sizes, the empty and full edges,
+ *                indices wrapping over 16 bits, then a producer and a consumer thread moving
+ *                a pseudo-random byte stream that must arrive whole and in order.
+ */
+#include "ring.h"
+#include "test_common.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Stress test: bytes streamed, queue size (small, so it is full and empty often and the
+   indices wrap many times), largest block of ring_write/ring_read */
+#define STRESS_BYTES 4000000UL
+#define STRESS_SIZE 64U
+#define STRESS_BLOCK 37U
+
+static uint8_t small_buf[8];
+static uint8_t big_buf[32768];
+static uint8_t stress_buf[STRESS_SIZE];
+static ring_t stress;
+
+/* xorshift32: the producer and the consumer each run the same stream */
+static uint32_t
+next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* Stream byte n is the low byte of step n of a seeded xorshift: a byte lost, repeated or
+   swapped breaks the sequence */
+static uint8_t
+stream_byte(uint32_t *state)
+{
+	return (uint8_t)next_random(state);
+}
+
+static void
+test_init(void)
+{
+	ring_t r;
+
+	CHECK(ring_init(&r, small_buf, 0) == -1);
+	CHECK(ring_init(&r, small_buf, 1) == -1);
+	CHECK(ring_init(&r, small_buf, 3) == -1);
+	CHECK(ring_init(&r, small_buf, 6) == -1);
+	CHECK(ring_init(&r, big_buf, 40000) == -1);
+	CHECK(ring_init(&r, small_buf, 2) == 0);
+	CHECK(ring_init(&r, big_buf, 32768) == 0);
+	CHECK(ring_count(&r) == 0 && ring_space(&r) == 32768);
+}
+
+/* Empty and full at indices start, start + 1 .. : every edge reports the same way */
+static void
+test_edges(uint16_t start)
+{
+	ring_t r;
+	uint8_t byte, out[16];
+	uint16_t i;
+
+	ring_init(&r, small_buf, sizeof(small_buf));
+	r.head = r.tail = start;
+
+	/* Empty */
+	CHECK(ring_get(&r, &byte) == -1);
+	CHECK(ring_read(&r, out, sizeof(out)) == 0);
+	CHECK(ring_count(&r) == 0 && ring_space(&r) == sizeof(small_buf));
+
+	/* Full: exactly size bytes fit */
+	for (i = 0; i < sizeof(small_buf); i++)
+		CHECK(ring_put(&r, (uint8_t)(0xA0 + i)) == 0);
+	CHECK(ring_put(&r, 0) == -1);
+	CHECK(ring_write(&r, (const uint8_t *)"x", 1) == 0);
+	CHECK(ring_count(&r) == sizeof(small_buf) && ring_space(&r) == 0);
+
+	/* One out, one in, then all out in order */
+	CHECK(ring_get(&r, &byte) == 0 && byte == 0xA0);
+	CHECK(ring_write(&r, (const uint8_t *)"yz", 2) == 1);
+	CHECK(ring_read(&r, out, sizeof(out)) == sizeof(small_buf));
+	for (i = 0; i + 1U < sizeof(small_buf); i++)
+		CHECK(out[i] == (uint8_t)(0xA1 + i));
+	CHECK(out[sizeof(small_buf) - 1] == 'y');
+	CHECK(ring_count(&r) == 0 && ring_get(&r, &byte) == -1);
+	CHECK((uint16_t)(r.head - start) == sizeof(small_buf) + 1U && r.head == r.tail);
+}
+
+/* The largest queue full across the 16-bit wrap: count is 32768, not 0 */
+static void
+test_wrap_full(void)
+{
+	ring_t r;
+	uint32_t state = 1, check = 1;
+	uint16_t i;
+	uint8_t byte;
+
+	ring_init(&r, big_buf, sizeof(big_buf));
+	r.head = r.tail = 0xFF00;
+	for (i = 0; i < 0x8000; i++)
+		CHECK(ring_put(&r, stream_byte(&state)) == 0);
+	CHECK(r.head == 0x7F00);
+	CHECK(ring_count(&r) == 0x8000 && ring_space(&r) == 0);
+	CHECK(ring_put(&r, 0) == -1);
+
+	for (i = 0; i < 0x8000; i++) {
+		if (ring_get(&r, &byte) != 0 || byte != stream_byte(&check)) {
+			CHECK(!"byte lost or out of order across the wrap");
+			break;
+		}
+	}
+	CHECK(ring_count(&r) == 0 && ring_get(&r, &byte) == -1);
+}
+
+/* Blocks through a small queue long enough for the indices to wrap several times */
+static void
+test_wrap_blocks(void)
+{
+	ring_t r;
+	uint8_t in[5], out[8];
+	uint32_t n, k;
+	uint32_t state = 7, check = 7;
+
+	ring_init(&r, small_buf, sizeof(small_buf));
+	for (n = 0; n < 3UL * 65536UL / sizeof(in); n++) {
+		for (k = 0; k < sizeof(in); k++)
+			in[k] = stream_byte(&state);
+		if (ring_write(&r, in, sizeof(in)) != sizeof(in) ||
+		    ring_read(&r, out, sizeof(out)) != sizeof(in)) {
+			CHECK(!"block lost at the 16-bit wrap");
+			return;
+		}
+		for (k = 0; k < sizeof(in); k++) {
+			if (out[k] != stream_byte(&check)) {
+				CHECK(!"block out of order at the 16-bit wrap");
+				return;
+			}
+		}
+	}
+}
+
+/* Producer thread: bursts of ring_put and ring_write of random length */
+static void *
+producer(void *arg)
+{
+	uint32_t state = 12345, rng = 99;
+	uint8_t block[STRESS_BLOCK];
+	unsigned long sent = 0;
+	uint32_t pending = 0; /* Bytes of block not queued yet */
+
+	(void)arg;
+	while (sent < STRESS_BYTES) {
+		uint32_t r = next_random(&rng);
+
+		if (pending == 0) {
+			pending = 1 + r % STRESS_BLOCK;
+			if (pending > STRESS_BYTES - sent)
+				pending = STRESS_BYTES - sent;
+			for (uint32_t k = 0; k < pending; k++)
+				block[k] = stream_byte(&state);
+		}
+
+		uint16_t done;
+		if (r & 0x80000000U) {
+			done = ring_write(&stress, block, (uint16_t)pending);
+		} else {
+			done = (ring_put(&stress, block[0]) == 0);
+		}
+		if (done) {
+			memmove(block, block + done, pending - done);
+			pending -= done;
+			sent += done;
+		} else {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void
+test_stress(void)
+{
+	pthread_t thread;
+	uint32_t check = 12345, rng = 4242;
+	unsigned long got = 0;
+	uint8_t out[100];
+
+	CHECK(ring_init(&stress, stress_buf, sizeof(stress_buf)) == 0);
+	CHECK(pthread_create(&thread, NULL, producer, NULL) == 0);
+
+	while (got < STRESS_BYTES) {
+		uint32_t r = next_random(&rng);
+		uint16_t n;
+
+		if (r & 0x80000000U)
+			n = ring_read(&stress, out, (uint16_t)(1 + r % sizeof(out)));
+		else
+			n = (ring_get(&stress, out) == 0);
+		for (uint16_t k = 0; k < n; k++) {
+			if (out[k] != stream_byte(&check)) {
+				printf("stress: byte %lu out of order\n", got + k);
+				test_failures++;
+				pthread_cancel(thread);
+				pthread_join(thread, NULL);
+				return;
+			}
+		}
+		got += n;
+		if (n == 0)
+			sched_yield();
+	}
+	pthread_join(thread, NULL);
+	CHECK(ring_count(&stress) == 0);
+	printf("stress_bytes=%lu queue_size=%u index_wraps=%lu\n", got, STRESS_SIZE,
+	       got / 65536UL);
+}
+
+int
+main(void)
+{
+	test_init();
+	test_edges(0);
+	test_edges(0xFFFC); /* Fills across the wrap, then empties past it */
+	test_edges(0xFFFF);
+	test_wrap_full();
+	test_wrap_blocks();
+	test_stress();
+	return test_result("ring");
+}
@@ -0,0 +1,231 @@
+/* @file 			 : test_usart_dma_rx.c
+ *  @Description: Host test of circular DMA reception with IDLE framing (usart.c). A model of
+ *                the DMA channel stores the bytes of a counting sequence one request at a time
+ *                and runs the channel handler on half/full transfer; idle_line() runs the USART
+ *                handler with IDLE set. Checks that frames are published at IDLE, at HT and at
+ *                TC, that spans wrap correctly, and that a reader lapped by the DMA loses the
+ *                lapped bytes, counted, rather than reading overwritten data.
+ */
+#include "dma.h"
+#include "host_periph.h"
+#include "nvic.h"
+#include "test_common.h"
+#include "usart.h"
+#include <string.h>
+
+void
+USART2_IRQHandler(void);
+void
+UART4_IRQHandler(void);
+void
+DMA1_Channel6_IRQHandler(void);
+void
+DMA2_Channel3_IRQHandler(void);
+
+#define USART_CR3_DMAR (1 << 6)
+
+static uint8_t rx2_buf[64];
+static uint8_t rx4_buf[16];
+static uint8_t sequence; /* Next byte the line delivers */
+
+static int cb_bytes, cb_idles, cb_calls;
+
+static void
+on_receive(USART_TypeDef *usart, uint16_t count, int idle)
+{
+	(void)usart;
+	cb_bytes += count;
+	cb_idles += idle;
+	cb_calls++;
+}
+
+/* Circular peripheral-to-memory channel: n requests, each storing the next byte at
+   size - CNDTR, with HT/TC raised as the hardware does and the handler run for them */
+static void
+dma_receive(u32 dma, u8 channel, uint8_t *buf, uint16_t size, int n, void (*handler)(void))
+{
+	for (int k = 0; k < n; k++) {
+		uint16_t cndtr = DMA_CNDTR(dma, channel);
+
+		buf[size - cndtr] = sequence++;
+		if (--cndtr == size / 2)
+			DMA_ISR(dma) |= DMA_ISR_HTIF(channel);
+		if (cndtr == 0) {
+			cndtr = size;
+			DMA_ISR(dma) |= DMA_ISR_TCIF(channel);
+		}
+		DMA_CNDTR(dma, channel) = cndtr;
+
+		if (DMA_ISR(dma) & (DMA_ISR_HTIF(channel) | DMA_ISR_TCIF(channel))) {
+			handler();
+			/* IFCR is write-1-to-clear */
+			DMA_ISR(dma) &= ~DMA_IFCR(dma);
+			DMA_IFCR(dma) = 0;
+		}
+	}
+}
+
+/* The line goes quiet: IDLE is set until the handler's SR/DR read sequence */
+static void
+idle_line(USART_TypeDef *usart, void (*handler)(void))
+{
+	usart->SR |= USART_SR_IDLE;
+	handler();
+	usart->SR &= ~USART_SR_IDLE;
+}
+
+/* Read everything published, span by span */
+static int
+drain(USART_TypeDef *usart, uint8_t *out)
+{
+	const uint8_t *span;
+	int n, total = 0;
+
+	while ((n = usart_dma_rx_peek(usart, &span)) > 0) {
+		memcpy(out + total, span, n);
+		total += n;
+		CHECK(usart_dma_rx_consume(usart, n) == n);
+	}
+	return total;
+}
+
+static void
+test_start(void)
+{
+	const uint8_t *span;
+	u32 ccr;
+
+	usartInit(USART2, 2000000, 0);
+	CHECK(usart_dma_rx_start(USART5, rx2_buf, sizeof(rx2_buf), 0) == -1); /* No DMA request */
+	CHECK(usart_dma_rx_start(USART2, rx2_buf, 48, 0) == -1);             /* Not a power of two */
+	CHECK(usart_dma_rx_peek(USART2, &span) == -1);
+	CHECK(usart_dma_rx_start(USART2, rx2_buf, sizeof(rx2_buf), on_receive) == 0);
+
+	ccr = DMA_CCR(DMA1, 6);
+	CHECK((ccr & DMA_CCR_CIRC) && (ccr & DMA_CCR_HTIE) && (ccr & DMA_CCR_TCIE));
+	CHECK((ccr & DMA_CCR_MINC) && (ccr & DMA_CCR_EN) && !(ccr & DMA_CCR_DIR));
+	CHECK(DMA_CNDTR(DMA1, 6) == sizeof(rx2_buf));
+	CHECK(DMA_CPAR(DMA1, 6) == (u32)(uintptr_t)&USART2->DR);
+	CHECK((USART2->CR3 & USART_CR3_DMAR) && (USART2->CR1 & USART_CR1_IDLEIE));
+	CHECK(!(USART2->CR1 & USART_CR1_RXNEIE));
+	CHECK((NVIC_ISER(0) & (1 << 16)) && (NVIC_ISER(1) & (1 << (38 - 32))));
+}
+
+static void
+test_framing(void)
+{
+	uint8_t out[256];
+	const uint8_t *span;
+	int calls;
+
+	/* A short frame is published at IDLE, not before */
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 10, DMA1_Channel6_IRQHandler);
+	CHECK(usart_dma_rx_available(USART2) == 0);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_available(USART2) == 10 && cb_bytes == 10 && cb_idles == 1);
+	CHECK(drain(USART2, out) == 10 && out[0] == 0 && out[9] == 9);
+
+	/* A long frame is published at HT (offset 32) before its IDLE */
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 50, DMA1_Channel6_IRQHandler);
+	CHECK(usart_dma_rx_available(USART2) == 22);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_available(USART2) == 50);
+	CHECK(drain(USART2, out) == 50);
+	for (int k = 0; k < 50; k++)
+		CHECK(out[k] == (uint8_t)(10 + k));
+
+	/* A frame across the end of the buffer comes as two spans */
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 20, DMA1_Channel6_IRQHandler);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_peek(USART2, &span) == 4 && span == &rx2_buf[60]);
+	CHECK(drain(USART2, out) == 20);
+	for (int k = 0; k < 20; k++)
+		CHECK(out[k] == (uint8_t)(60 + k));
+	CHECK(cb_bytes == 80 && usart_dma_rx_overflows(USART2) == 0);
+
+	/* IDLE with nothing new still reports the end of a frame */
+	calls = cb_calls;
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(cb_calls == calls + 1 && usart_dma_rx_available(USART2) == 0);
+}
+
+static void
+test_overflow(void)
+{
+	uint8_t out[256];
+	const uint8_t *span;
+
+	/* The reader falls behind: lapped bytes are dropped and counted */
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 70, DMA1_Channel6_IRQHandler);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_available(USART2) == 0 && usart_dma_rx_overflows(USART2) == 70);
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 5, DMA1_Channel6_IRQHandler);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(drain(USART2, out) == 5 && out[0] == (uint8_t)150);
+
+	/* Lapped while the reader holds a span: consuming it reports nothing read */
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 8, DMA1_Channel6_IRQHandler);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_peek(USART2, &span) == 8);
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 64, DMA1_Channel6_IRQHandler);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_consume(USART2, 8) == 0);
+	CHECK(usart_dma_rx_overflows(USART2) == 70 + 72);
+
+	/* Exactly a buffer full is not an overflow */
+	dma_receive(DMA1, 6, rx2_buf, sizeof(rx2_buf), 64, DMA1_Channel6_IRQHandler);
+	idle_line(USART2, USART2_IRQHandler);
+	CHECK(usart_dma_rx_available(USART2) == 64);
+	CHECK(drain(USART2, out) == 64);
+}
+
+/* UART4 on DMA2 channel 3, without a callback, next to buffered TX */
+static void
+test_uart4(void)
+{
+	static uint8_t tx_queue[16], rx_queue[16];
+	uint8_t out[32];
+	const uint8_t *span;
+
+	usartInit(USART4, 1000000, 0);
+	CHECK(usart_buffered_init(USART4, tx_queue, sizeof(tx_queue), rx_queue, sizeof(rx_queue)) == 0);
+	CHECK(usart_dma_rx_start(USART4, rx4_buf, sizeof(rx4_buf), 0) == 0);
+	CHECK(!(USART4->CR1 & USART_CR1_RXNEIE) && (USART4->CR3 & USART_CR3_DMAR));
+	CHECK(DMA_CCR(DMA2, 3) & DMA_CCR_CIRC);
+	CHECK(NVIC_ISER(1) & (1 << (52 - 32)));
+
+	for (int r = 0; r < 100; r++) {
+		int n = 1 + (r * 7) % 15;
+		uint8_t first = sequence;
+
+		dma_receive(DMA2, 3, rx4_buf, sizeof(rx4_buf), n, DMA2_Channel3_IRQHandler);
+		idle_line(USART4, UART4_IRQHandler);
+		CHECK(drain(USART4, out) == n);
+		for (int k = 0; k < n; k++)
+			CHECK(out[k] == (uint8_t)(first + k));
+	}
+	CHECK(usart_write(USART4, "ab", 2) == 2);
+
+	usart_dma_rx_stop(USART4);
+	CHECK(!(USART4->CR3 & USART_CR3_DMAR) && !(USART4->CR1 & USART_CR1_IDLEIE));
+	CHECK(DMA_CCR(DMA2, 3) == 0);
+	CHECK(usart_dma_rx_peek(USART4, &span) == -1);
+
+	/* Switching USART2 to buffered mode stops its DMA reception */
+	CHECK(usart_buffered_init(USART2, tx_queue, sizeof(tx_queue), rx_queue, sizeof(rx_queue)) == 0);
+	CHECK(usart_dma_rx_available(USART2) == -1 && DMA_CCR(DMA1, 6) == 0);
+}
+
+int
+main(void)
+{
+	if (host_periph_map() != 0) {
+		printf("cannot map the peripheral registers\n");
+		return EXIT_FAILURE;
+	}
+	test_start();
+	test_framing();
+	test_overflow();
+	test_uart4();
+	return test_result("usart_dma_rx");
+}